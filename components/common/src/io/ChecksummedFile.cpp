@@ -0,0 +1,91 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "io/ChecksummedFile.hpp"
+#include "io/File.hpp"
+#include "io/FileSystem.hpp"
+#include "io/exceptions/FileException.hpp"
+#include "io/serialization/MemorySerializer.hpp"
+#include "utilities/hashing/Hashing.hpp"
+#include "logging/Logger.hpp"
+
+namespace iyf {
+FileView ReadChecksummedFile(const FileSystem& filesystem, const Path& path, std::size_t minimumSize, std::string_view description) {
+    if (!filesystem.exists(path)) {
+        return FileView();
+    }
+    
+    FileView contents;
+    try {
+        contents = filesystem.mapWholeFile(path);
+    } catch (const FileException& e) {
+        LOG_W("Failed to read the {} {}: {}", description, path, e.what());
+        return FileView();
+    }
+    
+    if (contents.size() < minimumSize + ChecksumSize) {
+        LOG_W("Ignoring a truncated {} {}", description, path);
+        return FileView();
+    }
+    
+    const std::size_t dataSize = contents.size() - ChecksumSize;
+    
+    MemorySerializer checksumReader(contents.data() + dataSize, ChecksumSize);
+    if (HF(contents.data(), dataSize).value() != checksumReader.readUInt64()) {
+        LOG_W("Ignoring a corrupt {} {}", description, path);
+        return FileView();
+    }
+    
+    return contents.first(dataSize);
+}
+
+bool WriteChecksummedFile(const FileSystem& filesystem, const Path& path, const Path& temporaryPath, MemorySerializer& data, std::string_view description) {
+    data.writeUInt64(HF(data.data(), data.size()).value());
+    
+    try {
+        auto file = filesystem.openFile(temporaryPath, FileOpenMode::Write);
+        
+        if (file->writeBytes(data.data(), data.size()) != static_cast<std::int64_t>(data.size()) || !file->flush()) {
+            LOG_W("Failed to write the {} {}", description, temporaryPath);
+            return false;
+        }
+    } catch (const std::exception& e) {
+        LOG_W("Failed to write the {} {}: {}", description, temporaryPath, e.what());
+        return false;
+    }
+    
+    if (filesystem.rename(temporaryPath, path) != FileSystemResult::Success) {
+        LOG_W("Failed to replace the {} {}", description, path);
+        filesystem.remove(temporaryPath);
+        
+        return false;
+    }
+    
+    return true;
+}
+}
@@ -0,0 +1,63 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_CHECKSUMMED_FILE_HPP
+#define IYF_CHECKSUMMED_FILE_HPP
+
+#include "io/FileView.hpp"
+
+#include <cstdint>
+#include <string_view>
+
+namespace iyf {
+class FileSystem;
+class MemorySerializer;
+class Path;
+
+/// Size of the checksum that WriteChecksummedFile() appends to the data
+inline constexpr std::size_t ChecksumSize = 8;
+
+/// Maps a file that was written by WriteChecksummedFile() and verifies the checksum that's stored at its end.
+///
+/// Failures are logged as warnings, e.g., "Ignoring a corrupt {description} {path}".
+///
+/// \param minimumSize The smallest valid size of the data, not counting the checksum
+/// \return A view of the data without the checksum or an empty view if the file is missing, can't be read, is truncated
+/// or is corrupt.
+FileView ReadChecksummedFile(const FileSystem& filesystem, const Path& path, std::size_t minimumSize, std::string_view description);
+
+/// Appends a checksum of the data to it and replaces the file with it.
+///
+/// The data is written to temporaryPath first and then renamed to make sure that an interrupted write can't leave a
+/// truncated file behind. Failures are logged as warnings.
+///
+/// \return true if the file was written
+bool WriteChecksummedFile(const FileSystem& filesystem, const Path& path, const Path& temporaryPath, MemorySerializer& data, std::string_view description);
+}
+
+#endif // IYF_CHECKSUMMED_FILE_HPP
@@ -28,6 +28,7 @@
 
 #include "DefaultFileSystem.hpp"
 #include "DefaultFileSystemFile.hpp"
+#include "MemoryMappedFile.hpp"
 #include "utilities/ReadWholeFile.hpp"
 
 #include <filesystem>
@@ -53,6 +54,21 @@ std::unique_ptr<File> DefaultFileSystem::openFile(const Path& p, FileOpenMode mo
     return std::unique_ptr<DefaultFileSystemFile>(new DefaultFileSystemFile(p, mode));
 }
 
+FileView DefaultFileSystem::mapWholeFile(const Path& path) const {
+    if (!MemoryMappedFile::IsSupported()) {
+        return FileSystem::mapWholeFile(path);
+    }
+    
+    std::error_code ec;
+    const std::uintmax_t size = fs::file_size(path.getNativeString(), ec);
+    if (ec || size < MemoryMappedFile::MinimumMappedFileSize) {
+        return FileSystem::mapWholeFile(path);
+    }
+    
+    MemoryMappedFile file(path);
+    return file.mapWholeFile();
+}
+
 FileSystemResult DefaultFileSystem::openInFileBrowser(const Path& path) const {
 #ifdef __linux__
     std::string command = fmt::format("xdg-open \"{}\"", path);
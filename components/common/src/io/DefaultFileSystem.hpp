@@ -43,6 +43,10 @@ public:
 
     virtual std::unique_ptr<File> openFile(const Path& p, FileOpenMode mode) const final override;
     
+    /// Memory maps the file if the platform supports it (see MemoryMappedFile::IsSupported()) and if it's not
+    /// smaller than MemoryMappedFile::MinimumMappedFileSize. Otherwise, reads it into a buffer.
+    virtual FileView mapWholeFile(const Path& path) const final override;
+    
     virtual FileHash computeFileHash(const Path& path) const final override;
     virtual FileSystemResult openInFileBrowser(const Path& path) const final override;
     virtual FileSystemResult remove(const Path& path) const final override;
@@ -40,14 +40,14 @@ DefaultFileSystemFile::DefaultFileSystemFile(const Path& path, FileOpenMode open
 
     switch (openMode) {
     case FileOpenMode::Read:
-        mode = std::ios::in;
+        mode |= std::ios::in;
         break;
     case FileOpenMode::Write:
-        mode = std::ios::out;
+        mode |= std::ios::out;
         mode |= std::ios::trunc;
         break;
     case FileOpenMode::Append:
-        mode = std::ios::out;
+        mode |= std::ios::out;
         mode |= std::ios::app;
         break;
     default:
@@ -89,10 +89,11 @@ std::int64_t DefaultFileSystemFile::seek(std::int64_t offset, SeekFrom whence) {
         return -1;
     }
 
+    // File::seek() must return the new position, just like the other backends do
     if (openMode == FileOpenMode::Read) {
-        return bool(stream.seekg(offset, dir));
+        return stream.seekg(offset, dir) ? static_cast<std::int64_t>(stream.tellg()) : -1;
     } else {
-        return bool(stream.seekp(offset, dir));
+        return stream.seekp(offset, dir) ? static_cast<std::int64_t>(stream.tellp()) : -1;
     }
 }
 
@@ -114,6 +115,11 @@ std::int64_t DefaultFileSystemFile::readBytes(void* bytes, std::uint64_t count)
 }
 
 bool DefaultFileSystemFile::isEOF() {
+    // Just like PHYSFS_eof(), reaching the end counts even if no read has failed yet
+    if (openMode == FileOpenMode::Read && !stream.eof()) {
+        return stream.peek() == std::char_traits<char>::eof();
+    }
+    
     return stream.eof();
 }
 
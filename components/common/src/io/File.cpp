@@ -156,6 +156,10 @@ std::pair<std::unique_ptr<char[]>, std::int64_t> File::readWholeFile() {
     return {std::move(buffer), size};
 }
 
+FileView File::mapWholeFile() {
+    return FileView(readWholeFile());
+}
+
 File::~File() {}
     
 }
@@ -39,6 +39,7 @@
 #include "utilities/Endianess.hpp"
 #include "io/Path.hpp"
 #include "io/FileOpenMode.hpp"
+#include "io/FileView.hpp"
 
 namespace iyf {
 
@@ -248,6 +249,13 @@ public:
     /// nulls earlier.
     std::pair<std::unique_ptr<char[]>, std::int64_t> readWholeFile();
     
+    /// Returns a read-only view of the entire file. Backends that support memory mapping (e.g., MemoryMappedFile)
+    /// return a view of the mapping without copying anything. The rest read the file into a buffer, just like
+    /// readWholeFile() does.
+    ///
+    /// \remark The position in the file is not changed.
+    virtual FileView mapWholeFile();
+    
     // File write methods -------------------------------------------------------------------------
     
     /// Writes a string with an optional length indicator prefix.
@@ -27,6 +27,7 @@
 // WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "FileSystem.hpp"
+#include "File.hpp"
 
 #ifdef __linux__
 #include <unistd.h>
@@ -104,6 +105,10 @@ namespace iyf {
 
 FileSystem::~FileSystem() {}
 
+FileView FileSystem::mapWholeFile(const Path& path) const {
+    return openFile(path, FileOpenMode::Read)->mapWholeFile();
+}
+
 const UserInfo& FileSystem::getUserInfo() const {
     static const UserInfo info = BuildUserInfo();
     return info;
@@ -35,6 +35,7 @@
 
 #include "io/Path.hpp"
 #include "io/FileOpenMode.hpp"
+#include "io/FileView.hpp"
 #include "utilities/hashing/Hashing.hpp"
 #include "utilities/Flags.hpp"
 
@@ -147,6 +148,13 @@ public:
     virtual ~FileSystem() = 0;
     
     virtual std::unique_ptr<File> openFile(const Path& p, FileOpenMode mode) const = 0;
+    
+    /// Returns a read-only view of the entire file. Backends memory map the file whenever they can, which lets the
+    /// callers parse the data without copying it. Otherwise, the file is read into a buffer.
+    ///
+    /// \throws FileOpenException if the file can't be opened
+    /// \throws FileException if the file can't be read
+    virtual FileView mapWholeFile(const Path& path) const;
 
     virtual FileHash computeFileHash(const Path& path) const = 0;
     
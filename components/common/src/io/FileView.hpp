@@ -0,0 +1,103 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_FILE_VIEW_HPP
+#define IYF_FILE_VIEW_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+namespace iyf {
+/// A read-only view of the whole contents of a file. Returned by File::mapWholeFile() and FileSystem::mapWholeFile().
+///
+/// The view keeps the memory it points to alive. Depending on the backend, that's either a memory mapping of the
+/// file or a heap buffer that the file was read into. Copies share the memory and it's released once the last one
+/// is destroyed, even if the File that created it has already been closed.
+///
+/// \warning Unlike the buffer returned by File::readWholeFile(), the data is not null terminated.
+class FileView {
+public:
+    FileView() : bytes(nullptr), byteCount(0), memoryMapped(false) {}
+    
+    /// \param bytes Start of the contents
+    /// \param byteCount Size of the contents
+    /// \param owner Keeps the memory alive
+    /// \param memoryMapped Whether the memory is a mapping of the file or a copy of its contents
+    FileView(const char* bytes, std::size_t byteCount, std::shared_ptr<const void> owner, bool memoryMapped)
+        : bytes(bytes), byteCount(byteCount), owner(std::move(owner)), memoryMapped(memoryMapped) {}
+    
+    /// Takes over a buffer that was returned by File::readWholeFile()
+    explicit FileView(std::pair<std::unique_ptr<char[]>, std::int64_t> buffer)
+        : bytes(buffer.first.get()), byteCount(static_cast<std::size_t>(buffer.second)), owner(std::shared_ptr<char[]>(std::move(buffer.first))), memoryMapped(false) {}
+    
+    inline const char* data() const {
+        return bytes;
+    }
+    
+    inline std::size_t size() const {
+        return byteCount;
+    }
+    
+    inline bool empty() const {
+        return byteCount == 0;
+    }
+    
+    inline std::string_view asStringView() const {
+        return std::string_view(bytes, byteCount);
+    }
+    
+    /// Returns a view of the first byteCount bytes that shares the memory with this one.
+    inline FileView first(std::size_t count) const {
+        assert(count <= byteCount);
+        return FileView(bytes, count, owner, memoryMapped);
+    }
+    
+    /// Returns true if the data is read straight from a memory mapping of the file, without any copies.
+    inline bool isMemoryMapped() const {
+        return memoryMapped;
+    }
+    
+    /// Releases this view's reference to the memory.
+    inline void reset() {
+        bytes = nullptr;
+        byteCount = 0;
+        owner.reset();
+        memoryMapped = false;
+    }
+private:
+    const char* bytes;
+    std::size_t byteCount;
+    std::shared_ptr<const void> owner;
+    bool memoryMapped;
+};
+}
+
+#endif // IYF_FILE_VIEW_HPP
@@ -0,0 +1,201 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "MemoryMappedFile.hpp"
+
+#include <cstring>
+
+#include "logging/Logger.hpp"
+#include "io/exceptions/FileOpenException.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define IYF_POSIX_MEMORY_MAPPING
+#endif
+
+namespace iyf {
+/// Unmaps the memory once the file and all FileView objects that reference it are gone
+struct MemoryMappedFile::Mapping {
+    Mapping(void* address, std::size_t size) : address(address), size(size) {}
+    
+    ~Mapping() {
+#ifdef IYF_POSIX_MEMORY_MAPPING
+        if (address != nullptr) {
+            munmap(address, size);
+        }
+#endif
+    }
+    
+    void* address;
+    std::size_t size;
+};
+
+bool MemoryMappedFile::IsSupported() {
+#ifdef IYF_POSIX_MEMORY_MAPPING
+    return true;
+#else
+    return false;
+#endif
+}
+
+MemoryMappedFile::MemoryMappedFile(const Path& path) : File(path, FileOpenMode::Read), bytes(nullptr), size(0), position(0), eof(false) {
+#ifdef IYF_POSIX_MEMORY_MAPPING
+    const int descriptor = open(path.getCString(), O_RDONLY | O_CLOEXEC);
+    if (descriptor == -1) {
+        LOG_E("Failed to open a file {} for mapping. Error: {}", path, std::strerror(errno));
+        throw FileOpenException("Failed to open a file");
+    }
+    
+    struct stat fileStats;
+    if (fstat(descriptor, &fileStats) != 0 || !S_ISREG(fileStats.st_mode)) {
+        ::close(descriptor);
+        
+        LOG_E("Failed to map a file {}. It's not a regular file or its size is unknown.", path);
+        throw FileOpenException("Failed to map a file");
+    }
+    
+    size = static_cast<std::uint64_t>(fileStats.st_size);
+    
+    // Zero sized mappings aren't allowed. Empty files simply don't need one.
+    void* address = nullptr;
+    if (size != 0) {
+        address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (address == MAP_FAILED) {
+            ::close(descriptor);
+            
+            LOG_E("Failed to map a file {}. Error: {}", path, std::strerror(errno));
+            throw FileOpenException("Failed to map a file");
+        }
+    }
+    
+    // The mapping stays valid after the descriptor is closed
+    ::close(descriptor);
+    
+    mapping = std::make_shared<const Mapping>(address, size);
+    bytes = static_cast<const char*>(address);
+#else
+    LOG_E("Failed to open a file {}. Memory mapped files are not supported on this platform.", path);
+    throw FileOpenException("Memory mapped files are not supported on this platform");
+#endif
+}
+
+MemoryMappedFile::~MemoryMappedFile() {}
+
+bool MemoryMappedFile::close() {
+    // Any views that were returned by mapWholeFile() keep the mapping alive
+    mapping.reset();
+    bytes = nullptr;
+    size = 0;
+    position = 0;
+    
+    return true;
+}
+
+bool MemoryMappedFile::flush() {
+    return true;
+}
+
+std::int64_t MemoryMappedFile::seek(std::int64_t offset, SeekFrom whence) {
+    std::int64_t base;
+    
+    switch (whence) {
+    case SeekFrom::Start:
+        base = 0;
+        break;
+    case SeekFrom::Current:
+        base = static_cast<std::int64_t>(position);
+        break;
+    case SeekFrom::End:
+        base = static_cast<std::int64_t>(size);
+        break;
+    default:
+        return -1;
+    }
+    
+    const std::int64_t newPosition = base + offset;
+    if (newPosition < 0) {
+        return -1;
+    }
+    
+    // Just like with regular files, seeking past the end is allowed. Reads from there return 0 bytes.
+    position = static_cast<std::uint64_t>(newPosition);
+    eof = false;
+    
+    return newPosition;
+}
+
+std::int64_t MemoryMappedFile::tell() {
+    return static_cast<std::int64_t>(position);
+}
+
+std::int64_t MemoryMappedFile::readBytes(void* destination, std::uint64_t count) {
+    if (position >= size) {
+        eof = true;
+        return 0;
+    }
+    
+    const std::uint64_t available = size - position;
+    if (count > available) {
+        count = available;
+        eof = true;
+    }
+    
+    std::memcpy(destination, bytes + position, count);
+    position += count;
+    
+    return static_cast<std::int64_t>(count);
+}
+
+bool MemoryMappedFile::isEOF() {
+    // Just like PHYSFS_eof(), reaching the end counts even if no read has failed yet
+    return eof || position >= size;
+}
+
+std::int64_t MemoryMappedFile::writeBytes(const void*, std::uint64_t) {
+    return -1;
+}
+
+FileView MemoryMappedFile::mapWholeFile() {
+    if (mapping == nullptr) {
+        throw FileException("Failed to map a closed file ", path.getGenericString());
+    }
+    
+#ifdef IYF_POSIX_MEMORY_MAPPING
+    // Whoever maps a whole file is about to read all of it, so the kernel can start reading ahead right away
+    if (size != 0) {
+        posix_madvise(mapping->address, size, POSIX_MADV_WILLNEED);
+    }
+#endif
+    
+    return FileView(bytes, static_cast<std::size_t>(size), mapping, true);
+}
+
+}
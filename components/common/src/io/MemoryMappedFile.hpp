@@ -0,0 +1,97 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_MEMORY_MAPPED_FILE_HPP
+#define IYF_MEMORY_MAPPED_FILE_HPP
+
+#include <cstdint>
+#include <memory>
+
+#include "utilities/NonCopyable.hpp"
+#include "io/File.hpp"
+
+namespace iyf {
+class DefaultFileSystem;
+class VirtualFileSystem;
+
+/// A read-only File that maps the whole file into memory when it's opened.
+///
+/// Reads are plain memory copies and mapWholeFile() returns a view of the mapping itself, which lets loaders parse
+/// the data without copying it first. The mapping stays alive until the file and all views that it returned are
+/// destroyed.
+///
+/// \warning Changing or truncating the file on disk while it's mapped leads to undefined contents or even crashes.
+/// Only map files that the engine doesn't modify while they're in use, e.g., imported assets.
+///
+/// \remark Memory mapping is currently only implemented on POSIX systems. Use IsSupported() to check.
+class MemoryMappedFile : public File {
+public:
+    NON_COPYABLE(MemoryMappedFile)
+    
+    virtual ~MemoryMappedFile();
+    
+    /// Files that are smaller than this are read into a buffer by DefaultFileSystem::mapWholeFile() and
+    /// VirtualFileSystem::mapWholeFile(). Setting up and tearing down a mapping costs more than copying a few pages.
+    static constexpr std::uint64_t MinimumMappedFileSize = 128 * 1024;
+    
+    /// Returns true if memory mapped files are supported on the current platform.
+    static bool IsSupported();
+    
+    virtual bool close() final override;
+    virtual bool flush() final override;
+
+    virtual std::int64_t seek(std::int64_t offset, SeekFrom whence) final override;
+    virtual std::int64_t tell() final override;
+    virtual std::int64_t readBytes(void* bytes, std::uint64_t count) final override;
+
+    virtual bool isEOF() final override;
+    
+    /// Always fails because memory mapped files are read-only.
+    virtual std::int64_t writeBytes(const void* bytes, std::uint64_t count) final override;
+    
+    /// Returns a view of the mapping. Doesn't copy anything.
+    virtual FileView mapWholeFile() final override;
+protected:
+    friend class DefaultFileSystem;
+    friend class VirtualFileSystem;
+    
+    /// \throws FileOpenException if the file can't be opened or mapped
+    MemoryMappedFile(const Path& path);
+    
+    struct Mapping;
+    
+    std::shared_ptr<const Mapping> mapping;
+    const char* bytes;
+    std::uint64_t size;
+    std::uint64_t position;
+    bool eof;
+};
+
+}
+
+#endif // IYF_MEMORY_MAPPED_FILE_HPP
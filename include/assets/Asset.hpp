@@ -75,13 +75,26 @@ public:
         return loaded;
     }
     
+    /// \brief Marks that the asynchronous load of this asset failed (true) or clears the mark (false)
+    ///
+    /// \warning This should only be called inside the TypeManager.
+    inline void setLoadFailed(bool failed) {
+        loadFailed = failed;
+    }
+    
+    /// If this is true, the asynchronous load of this asset failed and isLoaded() will never become true. The
+    /// asset gets released once all of its handles are gone.
+    inline bool hasLoadFailed() const {
+        return loadFailed;
+    }
+    
     virtual AssetType getType() const = 0;
 protected:
-    Asset() : loaded(false) {}
+    Asset() : loaded(false), loadFailed(false) {}
 private:
     StringHash nameHash;
     bool loaded;
-    // What should I do with the 3 bytes here?
+    bool loadFailed;
 };
 
 }
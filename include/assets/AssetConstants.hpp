@@ -85,6 +85,9 @@ const std::string& PackFileExtension();
 /// \brief The extension used by files that store the world data
 const std::string& WorldFileExtension();
 
+/// \brief The extension used by cached snapshots of the asset manifest
+const std::string& ManifestCacheExtension();
+
 // -----------------------------------------------------------------------------
 // Special files 
 // -----------------------------------------------------------------------------
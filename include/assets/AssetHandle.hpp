@@ -30,11 +30,144 @@
 #define IYF_ASSET_HANDLE_HPP
 
 #include <atomic>
+#include <cstdint>
 
 #include "utilities/ReferenceCountedHandle.hpp"
 
 namespace iyf {
-using AssetHandleRefCounter = std::atomic<std::uint32_t>;
+class AssetReleaseList;
+
+/// \brief The reference counter of an Asset.
+///
+/// Behaves like an std::atomic<std::uint32_t>, but also pushes itself into an AssetReleaseList when the count drops to 0.
+/// This lets the TypeManager objects find released assets without scanning all of their counters.
+class AssetHandleRefCounter {
+public:
+    AssetHandleRefCounter(std::uint32_t count = 0) : count(count), id(0), releaseFrame(0), queued(false), releaseList(nullptr), next(nullptr) {}
+    
+    /// Explicitly disabled to get cleaner errors. Counters must stay at the same address because handles and the
+    /// AssetReleaseList point to them.
+    AssetHandleRefCounter(const AssetHandleRefCounter&) = delete;
+    /// Explicitly disabled to get cleaner errors.
+    AssetHandleRefCounter& operator=(const AssetHandleRefCounter&) = delete;
+    
+    /// Assigns a new count without notifying the AssetReleaseList. Meant for the owning TypeManager.
+    inline AssetHandleRefCounter& operator=(std::uint32_t value) {
+        count.store(value);
+        return *this;
+    }
+    
+    inline std::uint32_t load(std::memory_order order = std::memory_order_seq_cst) const {
+        return count.load(order);
+    }
+    
+    inline operator std::uint32_t() const {
+        return count.load();
+    }
+    
+    inline std::uint32_t operator++(int) {
+        return count.fetch_add(1);
+    }
+    
+    /// Decrements the count and pushes this counter into the AssetReleaseList if the count dropped to 0.
+    inline std::uint32_t operator--(int);
+    
+    /// Makes the counter report to the specified AssetReleaseList. Must be called before any handles are created.
+    ///
+    /// \param list The list or nullptr to stop reporting.
+    /// \param counterID The id of the Asset in the TypeManager.
+    inline void setReleaseList(AssetReleaseList* list, std::uint32_t counterID) {
+        releaseList = list;
+        id = counterID;
+    }
+    
+    inline std::uint32_t getID() const {
+        return id;
+    }
+    
+    /// The number of the garbage collection run that found this counter in the AssetReleaseList most recently. Used by the
+    /// owning TypeManager to implement a grace period. Only accessed by the thread that runs the garbage collection.
+    inline std::uint64_t getReleaseFrame() const {
+        return releaseFrame;
+    }
+    
+    inline void setReleaseFrame(std::uint64_t frame) {
+        releaseFrame = frame;
+    }
+private:
+    friend class AssetReleaseList;
+    
+    std::atomic<std::uint32_t> count;
+    std::uint32_t id;
+    std::uint64_t releaseFrame;
+    
+    /// Prevents the counter from being pushed into the AssetReleaseList multiple times before it gets drained.
+    std::atomic<bool> queued;
+    AssetReleaseList* releaseList;
+    
+    /// The next counter in the AssetReleaseList
+    AssetHandleRefCounter* next;
+};
+
+/// \brief A lock-free list of AssetHandleRefCounter objects that dropped to 0 since the last time the list was drained.
+///
+/// It's an intrusive stack, so pushing never allocates. Any thread may push. A single thread may drain.
+class AssetReleaseList {
+public:
+    AssetReleaseList() : head(nullptr) {}
+    
+    /// Explicitly disabled to get cleaner errors.
+    AssetReleaseList(const AssetReleaseList&) = delete;
+    /// Explicitly disabled to get cleaner errors.
+    AssetReleaseList& operator=(const AssetReleaseList&) = delete;
+    
+    /// Adds a counter to the list unless it's already there. May be called from any thread.
+    inline void push(AssetHandleRefCounter* counter) {
+        if (counter->queued.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+        
+        AssetHandleRefCounter* oldHead = head.load(std::memory_order_relaxed);
+        do {
+            counter->next = oldHead;
+        } while (!head.compare_exchange_weak(oldHead, counter, std::memory_order_release, std::memory_order_relaxed));
+    }
+    
+    /// Removes all counters from the list and calls function(AssetHandleRefCounter&) for each of them. The counts may have
+    /// changed since the counters were pushed, so the function must check them. Only one thread may drain the list.
+    ///
+    /// \return The number of drained counters.
+    template <typename F>
+    inline std::size_t drain(F&& function) {
+        AssetHandleRefCounter* current = head.exchange(nullptr, std::memory_order_acquire);
+        std::size_t drained = 0;
+        
+        while (current != nullptr) {
+            AssetHandleRefCounter* next = current->next;
+            
+            // Cleared before the call, so a counter that gets released again during or after the call will be pushed again
+            current->queued.store(false, std::memory_order_release);
+            function(*current);
+            
+            current = next;
+            drained++;
+        }
+        
+        return drained;
+    }
+private:
+    std::atomic<AssetHandleRefCounter*> head;
+};
+
+inline std::uint32_t AssetHandleRefCounter::operator--(int) {
+    const std::uint32_t previous = count.fetch_sub(1);
+    
+    if (previous == 1 && releaseList != nullptr) {
+        releaseList->push(this);
+    }
+    
+    return previous;
+}
 
 template <typename T>
 using AssetHandle = ReferenceCountedHandle<T, AssetHandleRefCounter>;
@@ -32,6 +32,7 @@
 #include "assets/Asset.hpp"
 #include "assets/AssetHandle.hpp"
 #include "assets/metadata/Metadata.hpp"
+#include "assets/StreamingScheduler.hpp"
 #include "assets/typeManagers/TypeManager.hpp"
 #include "utilities/NonCopyable.hpp"
 
@@ -43,6 +44,7 @@
 
 namespace iyf {
 class Engine;
+class FileSystem;
 class MeshLoader;
 class Serializer;
 
@@ -100,6 +102,19 @@ public:
     /// \returns The async load window.
     std::chrono::milliseconds getAsyncLoadWindow() const;
     
+    /// \brief Sets the number of collectGarbage() calls that an Asset has to stay unreferenced for before it gets unloaded.
+    ///
+    /// A non-zero grace period prevents unload/reload thrashing when an Asset gets released and reacquired within a few
+    /// frames, e.g., when a streaming system moves a boundary back and forth. The default is 0 (unload on the next call).
+    void setGarbageCollectionGracePeriod(std::uint32_t frames) {
+        garbageCollectionGracePeriod = frames;
+    }
+    
+    /// \brief Returns the current grace period. See setGarbageCollectionGracePeriod() for more info.
+    std::uint32_t getGarbageCollectionGracePeriod() const {
+        return garbageCollectionGracePeriod;
+    }
+    
     /// Creates and initializes all type managers and loads all system assets that will be stored in memory
     /// persistently
     void initialize();
@@ -107,10 +122,9 @@ public:
     /// Unloads all system assets and disposes of type managers
     void dispose();
     
-    /// \todo Running full collection every frame becomes extemely wasteful when many assets are loaded.
-    /// Running it every several frames or seconds (once again, with many objects) gives slowdown spikes.
-    /// More GarbageCollectionRunPolicy types should be created and they should allow for partial collection.
-    /// Moreover, AssetManager should be smarter and call collectGarbage() on TypeManager objects selectively.
+    /// Unloads the Assets whose reference counts dropped to 0 and stayed there for the grace period (see
+    /// setGarbageCollectionGracePeriod()). Uses GarbageCollectionRunPolicy::IncrementalCollection, so the cost depends on the
+    /// number of released Assets and not on the number of loaded ones. Meant to be called every frame.
     ///
     /// \warning This class does not and should not inherit from GarbageCollecting interface because it makes its
     /// own decisions on GarbageCollectionRunPolicy.
@@ -125,14 +139,17 @@ public:
     ///
     /// If an asset is loaded synchronously, it becomes available and safe to use immediately after this function returns.
     /// If an asset is loaded asynchronously, it cannot be used until Asset::isLoaded() returns true. Depending on the asset type, may take a
-    /// while.
+    /// while. Asynchronous loads are managed by the StreamingScheduler. If all handles of an asset are destroyed before its load
+    /// starts, the load is cancelled.
     ///
     /// \warning TODO FIXME Synchronous loading may introduce race conditions under certain circumstances
     ///
     /// \param nameHash hashed path to an asset
+    /// \param priority Only used if async is true. Loads with higher priorities start first. Use setStreamingPriority() to change
+    /// the priority of a queued load and StreamingScheduler::PriorityFromDistance() to derive it from the distance to the camera.
     /// \return An AssetHandle
     template <typename T>
-    inline AssetHandle<T> load(StringHash nameHash, bool async) {
+    inline AssetHandle<T> load(StringHash nameHash, bool async, float priority = StreamingScheduler::DefaultPriority) {
         auto manifestLock = editorMode ? std::unique_lock<std::mutex>(manifestMutex) : std::unique_lock<std::mutex>();
         std::lock_guard<std::mutex> assetLock(loadedAssetListMutex);
         
@@ -148,13 +165,20 @@ public:
         if (assetReference == loadedAssets.end()) {
             std::uint32_t id;
             
-            auto result = typeManager->load(nameHash, asset.path, asset.metadata, id, async);
+            auto result = typeManager->load(nameHash, asset.path, asset.metadata, id, async, priority);
             loadedAssets[nameHash] = {asset.type, id};
             
             assert(result.first != nullptr);
             assert(result.second != nullptr);
             
-            return AssetHandle<T>(static_cast<T*>(result.first), result.second);
+            AssetHandle<T> handle(static_cast<T*>(result.first), result.second);
+            
+            // The StreamingScheduler may only cancel the load once the handle holds a reference
+            if (async) {
+                streamingScheduler->markReferenced(nameHash);
+            }
+            
+            return handle;
         } else {
             auto result = typeManager->fetch(assetReference->second.second);
             
@@ -290,6 +314,26 @@ public:
         return loadedAssets.size();
     }
     
+    /// Changes the priority of an asynchronous load that hasn't started yet.
+    ///
+    /// \return true if the priority was changed, false if the load has already started or the asset isn't being loaded
+    bool setStreamingPriority(StringHash nameHash, float priority) {
+        return streamingScheduler->setPriority(nameHash, priority);
+    }
+    
+    /// The StreamingScheduler that manages asynchronous loads. Use it to adjust the StreamingBudget and to retrieve
+    /// StreamingStatistics.
+    ///
+    /// The returned pointer is guaranteed to stay valid until Engine::quit() is called.
+    inline StreamingScheduler* getStreamingScheduler() {
+        return streamingScheduler.get();
+    }
+    
+    /// \copydoc getStreamingScheduler()
+    inline const StreamingScheduler* getStreamingScheduler() const {
+        return streamingScheduler.get();
+    }
+    
     /// Obtain a const observer pointer to a specific TypeManager object. This method is typically used
     /// to retrieve debug data directly from type managers.
     ///
@@ -328,6 +372,14 @@ public:
         bool systemAsset;
         Metadata metadata;
     };
+    
+    /// Finds all assets of the specified type in baseDir, loads their metadata and adds them to the manifest.
+    ///
+    /// \remark buildManifestFromFilesystem() calls this for every AssetType that couldn't be loaded from the
+    /// ManifestCache. It's public to allow benchmarking without a running Engine.
+    ///
+    /// \return Number of assets that were added to the manifest
+    static std::size_t AddFilesToManifest(const FileSystem* filesystem, AssetType type, const Path& baseDir, std::unordered_map<StringHash, ManifestElement>& manifest);
 private:
     /// Called by checkForHashCollision(). Needed to avoid a deadlock when checking for hash collisions during asset move.
     std::optional<Path> checkForHashCollisionImpl(StringHash nameHash, const Path& checkPath) const;
@@ -362,8 +414,18 @@ private:
     
     friend class Engine;
     /// Builds the manifest from all converted assets that reside in the asset folder for the current platform and have corresponding metadata.
+    ///
+    /// Asset types with unchanged directories are loaded from the ManifestCache. The rest are scanned and the cache is
+    /// updated afterwards.
     void buildManifestFromFilesystem();
     
+    /// Returns the path of the ManifestCache file or an empty path if the cache can't be used.
+    Path getManifestCachePath() const;
+    
+    /// Deletes the ManifestCache. Called by the editor APIs that change the manifest because some of those changes
+    /// (e.g., overwritten metadata files) can't be detected by the ManifestCache.
+    void invalidateManifestCache();
+    
     friend class TypeManager;
     void notifyRemoval(StringHash handle) {
         std::lock_guard<std::mutex> lock(loadedAssetListMutex);
@@ -400,10 +462,14 @@ private:
     
     std::array<std::unique_ptr<TypeManager>, static_cast<std::size_t>(AssetType::ANY)> typeManagers;
     
+    std::unique_ptr<StreamingScheduler> streamingScheduler;
+    
     std::chrono::milliseconds asyncLoadWindow;
+    std::uint32_t garbageCollectionGracePeriod;
     
     bool editorMode;
     bool isInit;
+    bool manifestCacheInvalidated;
 };
 }
 
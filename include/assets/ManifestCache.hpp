@@ -0,0 +1,98 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_MANIFEST_CACHE_HPP
+#define IYF_MANIFEST_CACHE_HPP
+
+#include "assets/AssetManager.hpp"
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace iyf {
+class FileSystem;
+
+/// Stores a snapshot of the asset manifest in a single binary file that can be loaded instead of enumerating the asset
+/// directories and deserializing every metadata file.
+///
+/// The snapshot is split into one section per AssetType. Each section stores a fingerprint of the directories that the
+/// assets were found in (see ComputeFingerprint()) and only the sections with fingerprints that still match are loaded.
+/// Other asset types need to be scanned again.
+///
+/// The file starts with a header and a table of sections that is followed by an index of (StringHash, offset) pairs,
+/// sorted by AssetType and StringHash, and the packed records that store the paths and the binary metadata. A checksum
+/// of the contents is stored at the end of the file.
+///
+/// \warning The fingerprints are based on modification times of directories. They change when files are added, removed
+/// or renamed, but not when an existing metadata file is overwritten in place. The AssetManager invalidates the cache
+/// whenever it does that itself.
+class ManifestCache {
+public:
+    static constexpr std::uint32_t Magic = 0x434D4649; // "IFMC"
+    static constexpr std::uint16_t Version = 1;
+    static constexpr std::size_t TypeCount = static_cast<std::size_t>(AssetType::COUNT);
+    
+    /// Returned by ComputeFingerprint() if the sources can't be fingerprinted reliably. Never matches anything.
+    static constexpr std::uint64_t UncacheableFingerprint = 0;
+    
+    /// Changes made during this window may share a timestamp with the changes that were made before the scan on file
+    /// systems that only store modification times with a coarse resolution.
+    static constexpr std::int64_t RecentModificationWindowSeconds = 2;
+    
+    using Manifest = std::unordered_map<StringHash, AssetManager::ManifestElement>;
+    using Fingerprints = std::array<std::uint64_t, TypeCount>;
+    using TypeMask = std::bitset<TypeCount>;
+    
+    /// Computes a fingerprint of real directories and archives, e.g., the ones returned by
+    /// VirtualFileSystem::getRealSearchPathSources().
+    ///
+    /// \return The fingerprint or UncacheableFingerprint if a source doesn't exist or it was modified recently.
+    static std::uint64_t ComputeFingerprint(const std::vector<Path>& sources);
+    
+    /// Loads all sections of the snapshot that have fingerprints that match the provided ones into the manifest.
+    ///
+    /// Missing, corrupt and outdated snapshots are ignored.
+    ///
+    /// \return Types that were loaded. These don't need to be scanned.
+    static TypeMask Load(const FileSystem& filesystem, const Path& path, const Fingerprints& fingerprints, Manifest& manifest);
+    
+    /// Writes a snapshot of the manifest. Types with an UncacheableFingerprint are skipped.
+    ///
+    /// The snapshot is written to a temporary file first and then renamed to make sure that an interrupted write can't
+    /// leave a truncated snapshot behind.
+    ///
+    /// \return true if the snapshot was written
+    static bool Save(const FileSystem& filesystem, const Path& path, const Fingerprints& fingerprints, const Manifest& manifest);
+};
+
+}
+
+#endif // IYF_MANIFEST_CACHE_HPP
@@ -0,0 +1,262 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_STREAMING_SCHEDULER_HPP
+#define IYF_STREAMING_SCHEDULER_HPP
+
+#include "assets/Asset.hpp"
+#include "assets/AssetHandle.hpp"
+#include "assets/metadata/Metadata.hpp"
+#include "utilities/DataSizes.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace iyft {
+class ThreadPool;
+}
+
+namespace iyf {
+class StreamingRequestHandler;
+
+/// Limits that the StreamingScheduler enforces. The defaults are meant for a typical desktop and should be tuned per project.
+struct StreamingBudget {
+    StreamingBudget() : cpuMemory(MiB(256)), uploadPerFrame(MiB(32)), maxReadsInFlight(4) {}
+    
+    /// The maximum estimated size of the data that has been dispatched for reading, but hasn't been enabled yet.
+    ///
+    /// \remark A single request that's bigger than the budget is still dispatched once nothing else is in flight.
+    Bytes cpuMemory;
+    
+    /// The maximum estimated size of the data that AssetManager::enableLoadedAssets() may upload during a single frame.
+    ///
+    /// \remark A single request that's bigger than the budget is still enabled if it's the first one during the frame.
+    Bytes uploadPerFrame;
+    
+    /// The maximum number of reads that may run on the worker threads at the same time. Requests that haven't been
+    /// dispatched yet can still be reprioritized or cancelled, so there's no point in dispatching everything at once.
+    std::size_t maxReadsInFlight;
+};
+
+/// A single asynchronous asset load that's managed by the StreamingScheduler.
+struct StreamingRequest {
+    StreamingRequest(StreamingRequestHandler* handler, StringHash nameHash, std::uint32_t id, Asset* asset, const Path& path, const Metadata& metadata,
+                     const AssetHandleRefCounter* referenceCounter, std::uint64_t estimatedSize, float priority)
+        : handler(handler), nameHash(nameHash), id(id), asset(asset), path(path), metadata(metadata), referenceCounter(referenceCounter),
+          estimatedSize(estimatedSize), priority(priority), sequence(0), wasReferenced(false) {}
+    
+    /// The object that reads the data on a worker thread and releases the Asset if the request gets cancelled.
+    StreamingRequestHandler* handler;
+    
+    StringHash nameHash;
+    
+    /// The id of the Asset in the TypeManager
+    std::uint32_t id;
+    
+    /// The Asset that the data is being read into. Stored here because worker threads can't safely look it up.
+    Asset* asset;
+    
+    Path path;
+    
+    /// A copy of the Metadata. LoadedAssetData objects reference it, which is why the request has to live until the Asset
+    /// gets enabled.
+    Metadata metadata;
+    
+    /// The reference counter of the Asset. If it drops to 0 before the request is dispatched, the request is cancelled. May be
+    /// nullptr if the request must never be cancelled.
+    const AssetHandleRefCounter* referenceCounter;
+    
+    /// The estimated size of the data. Counts against the StreamingBudget.
+    std::uint64_t estimatedSize;
+    
+    /// Requests with higher priorities are dispatched first.
+    float priority;
+    
+    /// Used to dispatch requests with equal priorities in the order in which they were submitted.
+    std::uint64_t sequence;
+    
+    std::chrono::steady_clock::time_point submitted;
+    
+    /// Set by StreamingScheduler::markReferenced() once the AssetHandle that AssetManager::load() returns has been created. A
+    /// freshly submitted request has no references until then and it mustn't be cancelled in the meantime.
+    bool wasReferenced;
+};
+
+/// The interface that the StreamingScheduler uses to execute and cancel StreamingRequest objects.
+class StreamingRequestHandler {
+public:
+    virtual ~StreamingRequestHandler() {}
+    
+    /// Reads the data of the request. Called on a worker thread. Once the data gets enabled on the main thread,
+    /// StreamingScheduler::notifyEnabled() must be called.
+    ///
+    /// \warning Must not throw. Failed reads must be handed over to the main thread, which calls notifyEnabled() as well.
+    virtual void executeStreamingRequest(StreamingRequest& request) = 0;
+    
+    /// Called on the main thread when a request that hasn't been dispatched is cancelled because nothing references its Asset
+    /// any more. The handler must release the Asset. The request is destroyed once this function returns.
+    virtual void cancelStreamingRequest(StreamingRequest& request) = 0;
+};
+
+/// Numbers that describe the current state of the StreamingScheduler. Displayed in the editor and meant for budget tuning.
+struct StreamingStatistics {
+    /// The number of requests that are waiting to be dispatched (queue depth).
+    std::size_t queuedRequests = 0;
+    
+    /// The number of requests that are being read by the worker threads.
+    std::size_t readsInFlight = 0;
+    
+    /// The number of requests that have been read and are waiting for AssetManager::enableLoadedAssets().
+    std::size_t awaitingEnable = 0;
+    
+    /// The estimated size of all dispatched requests that haven't been enabled yet.
+    std::uint64_t bytesInFlight = 0;
+    
+    /// The estimated size of the data that has been enabled during the current frame.
+    std::uint64_t bytesUploadedThisFrame = 0;
+    
+    std::uint64_t completedRequests = 0;
+    std::uint64_t cancelledRequests = 0;
+    
+    /// Percentiles of the time between StreamingScheduler::submit() and StreamingScheduler::notifyEnabled(), computed from the
+    /// most recent requests.
+    std::chrono::nanoseconds latencyP50 = std::chrono::nanoseconds(0);
+    std::chrono::nanoseconds latencyP90 = std::chrono::nanoseconds(0);
+    std::chrono::nanoseconds latencyP99 = std::chrono::nanoseconds(0);
+};
+
+/// \brief Decides when asynchronous asset loads are read and enabled.
+///
+/// Requests are kept in a queue until update() dispatches them to a ThreadPool in priority order. Queued requests can be
+/// reprioritized and are cancelled automatically if all handles of their Asset get destroyed. Dispatching stops once the
+/// StreamingBudget::cpuMemory or StreamingBudget::maxReadsInFlight limit is reached. AssetManager::enableLoadedAssets() uses
+/// canUpload() to enforce StreamingBudget::uploadPerFrame.
+///
+/// submit(), markReferenced() and setPriority() may be called from any thread. Everything else must be called on the main thread.
+class StreamingScheduler {
+public:
+    /// The priority used by AssetManager::load() when no priority is specified.
+    static constexpr float DefaultPriority = 0.0f;
+    
+    /// The number of the most recent request latencies that are used to compute the percentiles.
+    static constexpr std::size_t LatencySampleCount = 1024;
+    
+    /// A helper for open world streaming. Closer assets get higher priorities.
+    static inline float PriorityFromDistance(float distanceToCamera) {
+        return -distanceToCamera;
+    }
+    
+    StreamingScheduler(iyft::ThreadPool* pool, StreamingBudget budget = StreamingBudget());
+    
+    /// \warning Calls waitForReads(). All handlers must still be alive.
+    ~StreamingScheduler();
+    
+    void setBudget(const StreamingBudget& newBudget);
+    const StreamingBudget& getBudget() const {
+        return budget;
+    }
+    
+    /// Adds a request to the queue. It will be dispatched during one of the upcoming update() calls.
+    ///
+    /// \return A pointer to the request. It stays valid until the request is cancelled or notifyEnabled() is called.
+    StreamingRequest* submit(std::unique_ptr<StreamingRequest> request);
+    
+    /// Must be called once the first AssetHandle of the Asset that the request loads has been created. From then on, the
+    /// request gets cancelled as soon as the reference count of the Asset drops to 0 before the request is dispatched.
+    ///
+    /// \return true if the request was found, false if it was already enabled or doesn't exist.
+    bool markReferenced(StringHash nameHash);
+    
+    /// Changes the priority of a queued request.
+    ///
+    /// \return true if the request was found and is still queued, false if it was already dispatched or doesn't exist.
+    bool setPriority(StringHash nameHash, float priority);
+    
+    /// Starts a new frame: cancels queued requests that are no longer referenced and dispatches the ones with the highest
+    /// priorities while the budget allows it.
+    void update();
+    
+    /// Checks if the data of an Asset with the specified estimated size may be uploaded during the current frame.
+    bool canUpload(std::uint64_t estimatedSize) const {
+        return (bytesUploadedThisFrame == 0) || (bytesUploadedThisFrame + estimatedSize <= budget.uploadPerFrame.count());
+    }
+    
+    /// Must be called by the StreamingRequestHandler once the Asset has been enabled (or failed to load). Destroys the request.
+    void notifyEnabled(StreamingRequest* request);
+    
+    /// Blocks until all dispatched reads finish.
+    void waitForReads() const;
+    
+    /// Calls waitForReads() and destroys all requests without notifying their handlers. Used when the handlers are being
+    /// destroyed.
+    void clear();
+    
+    StreamingStatistics getStatistics() const;
+private:
+    void dispatch(StreamingRequest* request);
+    
+    iyft::ThreadPool* pool;
+    StreamingBudget budget;
+    
+    /// Protects requests, queue and nextSequence, which may be modified by submit(), markReferenced() and setPriority() on any
+    /// thread.
+    mutable std::mutex mutex;
+    
+    /// All requests that haven't been enabled or cancelled yet
+    std::unordered_map<StringHash, std::unique_ptr<StreamingRequest>> requests;
+    
+    /// Requests that haven't been dispatched yet. Sorted lazily, right before dispatching.
+    std::vector<StreamingRequest*> queue;
+    bool queueSorted;
+    std::uint64_t nextSequence;
+    
+    std::size_t dispatchedReads;
+    std::atomic<std::size_t> finishedReads;
+    
+    /// Used by waitForReads() to sleep until the worker threads finish the dispatched reads
+    mutable std::mutex readsMutex;
+    mutable std::condition_variable readsFinished;
+    std::uint64_t bytesInFlight;
+    std::uint64_t bytesUploadedThisFrame;
+    std::uint64_t completedRequests;
+    std::uint64_t cancelledRequests;
+    
+    /// A ring buffer of the most recent latencies
+    std::vector<std::chrono::nanoseconds> latencies;
+    std::size_t nextLatency;
+};
+
+}
+
+#endif // IYF_STREAMING_SCHEDULER_HPP
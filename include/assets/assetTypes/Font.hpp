@@ -30,6 +30,7 @@
 #define IYF_FONT_HPP
 
 #include "assets/Asset.hpp"
+#include "io/FileView.hpp"
 
 namespace iyf {
 /// \brief A font Asset
@@ -38,6 +39,9 @@ public:
     const char* data;
     std::size_t size;
     
+    /// Keeps data alive. Usually a memory mapping of the font file.
+    FileView contents;
+    
     virtual AssetType getType() const final override {
         return AssetType::Font;
     }
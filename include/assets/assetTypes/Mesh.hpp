@@ -29,9 +29,12 @@
 #ifndef MESH_HPP
 #define MESH_HPP
 
+#include <algorithm>
+#include <cassert>
 #include <variant>
 
 #include "assets/Asset.hpp"
+#include "core/Constants.hpp"
 #include "graphics/culling/BoundingVolumes.hpp"
 #include "graphics/VertexDataLayouts.hpp"
 
@@ -44,6 +47,15 @@ struct PrimitiveData {
     std::uint32_t indexOffset;
 };
 
+/// A simplified detail level that reuses the vertices of the full detail mesh
+struct MeshLOD {
+    /// Relative to PrimitiveData::indexOffset. This way, moving the indices of the mesh only changes a single offset.
+    std::uint32_t indexOffset;
+    std::uint32_t indexCount;
+    /// Simplification error relative to the radius of the bounding sphere
+    float error;
+};
+
 class SubmeshList {
 public:
     SubmeshList(std::size_t submeshCount) {
@@ -109,10 +121,49 @@ public:
     /// When storing vertices of different layouts into a single vertex buffer, some padding is often required.
     /// It is added before the data and is considered to be a part of the allocation range. This particular
     /// variable is used during the destruction of the mesh object. It is needed when computing the range that 
-    /// has to be returned to the BufferRangeSet.
-    std::uint8_t padding;
+    /// has to be returned to the BufferRangeAllocator.
+    std::uint8_t vboPadding;
+    
+    /// Same as vboPadding, but for the index buffer. Needed when 16 and 32 bit indices share a buffer.
+    std::uint8_t iboPadding;
+    
+    // TODO maybe put something here? 4 whole Bytes are free because of alignment
     
-    // TODO maybe put something here? 5 whole Bytes are free because of alignment
+    /// Number of simplified detail levels, stored in lods. The full detail level is not included.
+    ///
+    /// \todo support LODs for meshes with submeshes
+    std::uint8_t lodCount;
+    MeshLOD lods[con::MaxMeshLODs - 1];
+    
+    /// \return the index range that needs to be drawn for the specified detail level. 0 is the full detail one.
+    ///
+    /// \warning Calling this when hasSubmeshes() == true will crash the Engine
+    inline PrimitiveData getLODPrimitiveData(std::uint8_t lod) const {
+        PrimitiveData data = getMeshPrimitiveData();
+        
+        if (lod > 0) {
+            assert(lod <= lodCount);
+            const MeshLOD& level = lods[lod - 1];
+            
+            data.indexOffset += level.indexOffset;
+            data.indexCount = level.indexCount;
+        }
+        
+        return data;
+    }
+    
+    /// \return the number of indices in the allocation of this mesh. The indices of the simplified detail levels
+    /// follow the full detail ones.
+    ///
+    /// \warning Calling this when hasSubmeshes() == true will crash the Engine
+    inline std::uint32_t getAllocatedIndexCount() const {
+        std::uint32_t count = getMeshPrimitiveData().indexCount;
+        for (std::uint8_t i = 0; i < lodCount; ++i) {
+            count = std::max(count, lods[i].indexOffset + lods[i].indexCount);
+        }
+        
+        return count;
+    }
     
     /// AABB before any world transformations.
     AABB aabb;
@@ -32,6 +32,7 @@
 #include "utilities/DataSizes.hpp"
 #include "assets/metadata/Metadata.hpp"
 #include "io/File.hpp"
+#include "io/FileView.hpp"
 #include "graphics/VertexDataLayouts.hpp"
 #include "graphics/AnimationDataStructures.hpp"
 #include "graphics/culling/BoundingVolumes.hpp"
@@ -39,10 +40,19 @@
 
 namespace iyf {
 class Engine;
+class FileSystem;
+
+namespace mf::v2 {
+struct MeshFileView;
+}
+
 /// This class reads mesh and animation files and writes their contents to provided memory buffers.
 class MeshLoader {
 public:
-    MeshLoader(Engine* engine) : engine(engine) {}
+    MeshLoader(Engine* engine);
+    
+    /// Used by tools and tests that don't have an Engine instance.
+    MeshLoader(const FileSystem* fileSystem) : fileSystem(fileSystem) {}
     
     struct MemoryRequirements {
         Bytes vertexSize;
@@ -52,10 +62,23 @@ public:
         std::size_t boneCount;
     };
     
+    /// A simplified detail level of a submesh that reuses its vertices
+    struct LoadedLODData {
+        /// Offset from the start of the index data of the whole mesh, in indices
+        std::uint32_t indexOffset;
+        std::uint32_t indexCount;
+        /// Simplification error relative to the radius of the bounding sphere of the whole mesh
+        float error;
+    };
+    
     struct LoadedSubMeshData {
         std::size_t numVertices;
         std::size_t numIndices;
         
+        /// Number of simplified levels. The full detail level is not included
+        std::size_t lodCount;
+        LoadedLODData lods[con::MaxMeshLODs - 1];
+        
 //         StringHash defaultTexture;
 //         
 //         AABB aabb;
@@ -73,6 +96,16 @@ public:
         StringHash animations[con::MaxAnimations];
     };
     
+    /// Vertex and index data of a mesh that was loaded by mapMesh().
+    struct MappedMeshData {
+        MappedMeshData() : vertexData(nullptr), indexData(nullptr) {}
+        
+        /// Keeps the memory that vertexData and indexData point to alive
+        FileView file;
+        const char* vertexData;
+        const char* indexData;
+    };
+    
     /// Load mesh data and write it to appropriate buffers. Make sure to call getMeshMemoryRequirements before this to know how much space will be needed in each buffer.
     /// 
     /// \param[in] path path to a mesh file that needs to be loaded
@@ -83,6 +116,18 @@ public:
     /// MemoryRequirements.boneCount (or more) before being passed to this function.
     /// \return if the mesh loading succeeded or not.
     bool loadMesh(const Path& path, LoadedMeshData& meshData, void* vertexBuffer, void* indexBuffer, std::vector<Bone>* skeleton = nullptr) const;
+    
+    /// Loads a mesh without copying its vertex and index data into caller provided buffers.
+    ///
+    /// Version 2 files get memory mapped (if the file system supports it) and the pointers in mappedData point straight into
+    /// the mapping. Older versions are read into a buffer that's owned by MappedMeshData::file.
+    ///
+    /// \param[in] path path to a mesh file that needs to be loaded
+    /// \param[out] meshData number of loaded meshes and per-submesh data
+    /// \param[out] mappedData vertex and index data. The sizes can be obtained by calling getMeshMemoryRequirements()
+    /// \param[out] skeleton same as in loadMesh()
+    /// \return if the mesh loading succeeded or not.
+    bool mapMesh(const Path& path, LoadedMeshData& meshData, MappedMeshData& mappedData, std::vector<Bone>* skeleton = nullptr) const;
     bool loadAnimation(const Path& path, Animation& buffer) const;
     
     /// Get the amount of memory that the data of this mesh will require on the GPU directly from the file.
@@ -100,11 +145,20 @@ protected:
     MemoryRequirements getMemoryRequirementsV1(File& fr) const;
     MemoryRequirements getMemoryRequirementsV1(const MeshMetadata& metadata) const;
     bool loadMeshV1(File& fr, LoadedMeshData& meshData, void* vertexBuffer, void* indexBuffer, std::vector<Bone>* skeleton = nullptr) const;
+    
+    /// Reads the rest of the header. Expects the magic and version numbers to have been read already.
+    MemoryRequirements getMemoryRequirementsV2(File& fr) const;
+    MemoryRequirements getMemoryRequirementsV2(const MeshMetadata& metadata) const;
+    /// Validates a mapped version 2 file and fills meshData and skeleton
+    bool loadMeshV2(const FileView& file, mf::v2::MeshFileView& view, LoadedMeshData& meshData, std::vector<Bone>* skeleton) const;
+    
+    /// Checks if the file exists and logs errors if it doesn't
+    bool checkIfMeshExists(const Path& path) const;
     bool loadAnimationV1(File& fr, Animation& buffer) const;
     std::pair<bool, std::uint16_t> readHeader(File& fr) const;
     std::pair<bool, std::uint16_t> readAnimationHeader(File& fr) const;
     
-    Engine* engine;
+    const FileSystem* fileSystem;
 };
 }
 
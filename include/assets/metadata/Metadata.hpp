@@ -35,6 +35,7 @@
 
 namespace iyf {
 // Forward declarations
+class Serializer;
 class AnimationMetadata;
 class MeshMetadata;
 class TextureMetadata;
@@ -66,6 +67,11 @@ public:
     
     static std::size_t GetAssetMetadataSize(AssetType type);
     
+    /// Creates a Metadata object of the specified type and deserializes its binary representation.
+    ///
+    /// \throws std::logic_error if the type is not a valid AssetType
+    static Metadata Deserialize(AssetType type, Serializer& serializer);
+    
     Metadata() : type(AssetType::COUNT) {}
     
     Metadata(const Metadata& other);
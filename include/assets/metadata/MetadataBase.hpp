@@ -134,6 +134,7 @@ protected:
     }
 private:
     friend class AssetManager;
+    friend class ManifestCache;
     
     virtual void serializeImpl(Serializer& fw, std::uint16_t version) const = 0;
     virtual void deserializeImpl(Serializer& fr, std::uint16_t version) = 0;
@@ -30,42 +30,63 @@
 #define IYF_CHUNKED_VECTOR_TYPE_MANAGER_HPP
 
 #include "assets/typeManagers/TypeManager.hpp"
+#include "assets/StreamingScheduler.hpp"
 #include "utilities/ChunkedVector.hpp"
 #include "threading/ThreadPool.hpp"
+#include "threading/MPSCQueue.hpp"
 #include "logging/Logger.hpp"
 
-#include <future>
+#include <algorithm>
+#include <deque>
+#include <exception>
 #include <memory>
 
 namespace iyf {
+/// The result of an asynchronously performed load operation. Worker threads push these into the completion queue of
+/// the TypeManager as soon as ChunkedVectorTypeManager::readFile() finishes.
 struct AsyncLoadInfo {
-    AsyncLoadInfo(std::future<std::unique_ptr<LoadedAssetData>> future, std::uint64_t estimatedSize) 
-        : future(std::move(future)), estimatedSize(estimatedSize) {}
-    /// The actual future of the asynchronously performed load operation
-    std::future<std::unique_ptr<LoadedAssetData>> future;
+    AsyncLoadInfo() : estimatedSize(0), request(nullptr) {}
+    AsyncLoadInfo(std::unique_ptr<LoadedAssetData> data, std::exception_ptr exception, std::uint64_t estimatedSize, StreamingRequest* request) 
+        : data(std::move(data)), exception(std::move(exception)), estimatedSize(estimatedSize), request(request) {}
+    
+    /// Everything that's required by ChunkedVectorTypeManager::enableAsset(). nullptr if readFile() threw.
+    std::unique_ptr<LoadedAssetData> data;
+    
+    /// The exception thrown by readFile(), if any. It gets rethrown on the main thread, just like std::future::get() would.
+    std::exception_ptr exception;
     
     /// Used to determine if the TypeManager should try to upload more data or not (e.g., Mesh and Texture type managers
     /// use this value to check if the data will fit into the staging buffer this frame).
     std::uint64_t estimatedSize;
+    
+    /// The request that produced this data. It owns the Metadata that LoadedAssetData references and must be handed back to
+    /// the StreamingScheduler once the asset is enabled.
+    StreamingRequest* request;
 };
 
 /// \todo is the default chunk size ok?
 template <typename T, size_t chunkSize = 8192>
-class ChunkedVectorTypeManager : public TypeManager {
+class ChunkedVectorTypeManager : public TypeManager, public StreamingRequestHandler {
 protected:
     static const std::uint32_t ClearedAsset = std::numeric_limits<std::uint32_t>::max();
     
+    /// Creates a ChunkedVectorTypeManager that doesn't belong to an AssetManager. See TypeManager::TypeManager() for what the
+    /// derived class needs to override.
+    ChunkedVectorTypeManager(std::size_t initialFreeListSize = 1024) : TypeManager(), collectionRun(0), missingAssetHandle(AssetHandle<T>::CreateInvalid()) {
+        freeList.reserve(initialFreeListSize);
+    }
+    
 public:
     static_assert(std::is_base_of<Asset, T>::value, "All assets need to be derived from the Asset base class");
     static_assert(std::is_default_constructible<T>::value, "All assets need to be default constructible");
     
-    ChunkedVectorTypeManager(AssetManager* manager, std::size_t initialFreeListSize = 1024) : TypeManager(manager), missingAssetHandle(AssetHandle<T>::CreateInvalid()) {
+    ChunkedVectorTypeManager(AssetManager* manager, std::size_t initialFreeListSize = 1024) : TypeManager(manager), collectionRun(0), missingAssetHandle(AssetHandle<T>::CreateInvalid()) {
         freeList.reserve(initialFreeListSize);
     }
     
     virtual ~ChunkedVectorTypeManager() { }
     
-    virtual std::pair<Asset*, AssetHandleRefCounter*> load(StringHash nameHash, const Path& path, const Metadata& meta, std::uint32_t& idOut, bool isAsync) final override {
+    virtual std::pair<Asset*, AssetHandleRefCounter*> load(StringHash nameHash, const Path& path, const Metadata& meta, std::uint32_t& idOut, bool isAsync, float priority) final override {
         // Find a free slot in the freeList or start using a new slot at the end
         std::uint32_t id;
         
@@ -74,11 +95,12 @@ public:
             
             id = assets.size() - 1;
             counts.emplace_back(0);
+            counts[id].setReleaseList(&releaseList, id);
             
             assets[id].setNameHash(nameHash);
             
             if (isAsync) {
-                toEnable.emplace_back(longTermWorkerPool->addTaskWithResult(&ChunkedVectorTypeManager<T, chunkSize>::readFile, this, nameHash, path, meta, assets[id]), estimateUploadSize(meta));
+                enqueueAsyncLoad(nameHash, path, meta, id, priority);
             } else {
                 std::unique_ptr<LoadedAssetData> loadedFile = readFile(nameHash, path, meta, assets[id]);
                 enableAsset(std::move(loadedFile), false);
@@ -98,18 +120,20 @@ public:
             
             assets[id].setNameHash(nameHash);
             
+            // Check if the asset has been cleared successfully. The counter must be reset before the StreamingScheduler
+            // gets a chance to look at it.
+            assert(counts[id] == ClearedAsset);
+            counts[id] = 0;
+            counts[id].setReleaseFrame(0);
+            
             if (isAsync) {
-                toEnable.emplace_back(longTermWorkerPool->addTaskWithResult(&ChunkedVectorTypeManager<T, chunkSize>::readFile, this, nameHash, path, meta, assets[id]), estimateUploadSize(meta));
+                enqueueAsyncLoad(nameHash, path, meta, id, priority);
             } else {
                 std::unique_ptr<LoadedAssetData> loadedFile = readFile(nameHash, path, meta, assets[id]);
                 enableAsset(std::move(loadedFile), false);
                 assert(assets[id].isLoaded());
             }
             
-            // Check if the asset has been cleared successfully
-            assert(counts[id] == ClearedAsset);
-            counts[id] = 0;
-            
             idOut = id;
             
             return std::make_pair(&assets[id], &counts[id]);
@@ -149,32 +173,32 @@ public:
     virtual void performFree(T& assetData) = 0;
     
     virtual void collectGarbage(GarbageCollectionRunPolicy policy = GarbageCollectionRunPolicy::FullCollection) override {
+        if (policy != GarbageCollectionRunPolicy::FullCollectionDuringDestruction) {
+            collectFailedLoads();
+        }
+        
+        if (policy == GarbageCollectionRunPolicy::IncrementalCollection) {
+            collectReleasedAssets();
+            return;
+        }
+        
         // Pointer increments are signifficantly faster than lookups via [] operator. We can't
         // use the iterator here because we need to know the ids of the elements that need to be freed
         std::size_t chunkCount = counts.chunkCount();
         std::size_t id = 0;
         
         for (std::size_t c = 0; c < chunkCount; ++c) {
-            std::atomic<std::uint32_t>* current = counts.getChunkStart(c);
-            std::atomic<std::uint32_t>* end = (c + 1 == chunkCount) ? (&counts[counts.size() - 1] + 1) : counts.getChunkEnd(c);
+            AssetHandleRefCounter* current = counts.getChunkStart(c);
+            AssetHandleRefCounter* end = (c + 1 == chunkCount) ? (&counts[counts.size() - 1] + 1) : counts.getChunkEnd(c);
             
             // Free all assets with reference count equal to 0 and notify the parent AssetManager that
             // these assets should no longer be in lookup map
             if (policy == GarbageCollectionRunPolicy::FullCollection) {
                 while (current != end) {
-                    if ((*current) == 0) {
-                        if (isLoggingRemovals()) {
-                            logAssetRemoval(id, assets[id].getNameHash());
-                        }
-                        
-                        notifyRemoval(assets[id].getNameHash());
-                        
-                        freeList.push_back(id);
-                        performFree(assets[id]);
-                        assets[id].setLoaded(false);
-                        
-                        // Set this to a special value in order to prevent repeated clearing
-                        *current = ClearedAsset;
+                    // Assets that are still being streamed in are freed once they get enabled or their StreamingRequest
+                    // gets cancelled.
+                    if ((*current) == 0 && assets[id].isLoaded()) {
+                        freeAsset(id);
                     }
                     
                     current++;
@@ -189,8 +213,8 @@ public:
                         logLeakedAsset(id, asset.getNameHash(), *current);
                     }
                     
-                    // No need to clear already cleared values
-                    if ((*current) != ClearedAsset) {
+                    // No need to clear already cleared values or assets that never finished loading
+                    if ((*current) != ClearedAsset && asset.isLoaded()) {
                         performFree(asset);
                     }
                     
@@ -202,6 +226,79 @@ public:
     }
 protected:
     
+    /// Frees the Asset, notifies the parent AssetManager that it should no longer be in the lookup map and makes the slot reusable.
+    void freeAsset(std::uint32_t id) {
+        T& asset = assets[id];
+        
+        if (isLoggingRemovals()) {
+            logAssetRemoval(id, asset.getNameHash());
+        }
+        
+        notifyRemoval(asset.getNameHash());
+        
+        freeList.push_back(id);
+        performFree(asset);
+        asset.setLoaded(false);
+        
+        // Set this to a special value in order to prevent repeated clearing
+        counts[id] = ClearedAsset;
+    }
+    
+    /// Notifies the parent AssetManager that the Asset should no longer be in the lookup map and makes the slot reusable. Used for
+    /// Assets that were never loaded, which means that there's nothing to free.
+    void releaseUnloadedAsset(std::uint32_t id, StringHash nameHash) {
+        if (isLoggingRemovals()) {
+            logAssetRemoval(id, nameHash);
+        }
+        
+        notifyRemoval(nameHash);
+        assets[id].setLoadFailed(false);
+        freeList.push_back(id);
+        counts[id] = ClearedAsset;
+    }
+    
+    /// Releases the Assets that failed to load once nothing references them any more. The garbage collector skips them because
+    /// they never become loaded.
+    void collectFailedLoads() {
+        auto newEnd = std::remove_if(failedLoads.begin(), failedLoads.end(), [this](std::uint32_t id) {
+            if (counts[id] != 0) {
+                return false;
+            }
+            
+            releaseUnloadedAsset(id, assets[id].getNameHash());
+            return true;
+        });
+        failedLoads.erase(newEnd, failedLoads.end());
+    }
+    
+    /// Implements GarbageCollectionRunPolicy::IncrementalCollection. The cost depends on the number of released Assets instead of
+    /// the number of loaded ones.
+    void collectReleasedAssets() {
+        const std::uint64_t run = ++collectionRun;
+        
+        releaseList.drain([this, run](AssetHandleRefCounter& counter) {
+            counter.setReleaseFrame(run);
+            pendingReleases.emplace_back(counter.getID(), run);
+        });
+        
+        // Runs only increase, so the entries are sorted and the ones with expired grace periods are at the front
+        const std::uint64_t gracePeriod = getGarbageCollectionGracePeriod();
+        while (!pendingReleases.empty() && pendingReleases.front().second + gracePeriod <= run) {
+            const auto [id, releaseRun] = pendingReleases.front();
+            pendingReleases.pop_front();
+            
+            const AssetHandleRefCounter& counter = counts[id];
+            
+            // Skip the Asset if it has been reacquired, already freed, released again (a newer entry exists) or if it's still
+            // being streamed in (enableAsyncLoadedAsset() will report it again).
+            if (counter != 0 || counter.getReleaseFrame() != releaseRun || !assets[id].isLoaded()) {
+                continue;
+            }
+            
+            freeAsset(id);
+        }
+    }
+    
     /// Used by TypeManagers that perform batching. Must return a value that's equal to the final data upload size.
     virtual std::uint64_t estimateUploadSize(const Metadata&) const {
         return 0;
@@ -209,40 +306,83 @@ protected:
     
     virtual void enableAsyncLoadedAsset(bool canBatch) final override {
         // This should only be called after hasAssetsToEnable
-        assert(!toEnable.empty());
-        assert(toEnable.front().future.valid());
-        assert(toEnable.front().future.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+        AsyncLoadInfo loaded;
+        [[maybe_unused]] const bool popped = toEnable.pop(loaded);
+        assert(popped);
         
-        std::unique_ptr<LoadedAssetData> data = toEnable.front().future.get();
+        if (loaded.exception) {
+            const std::uint32_t id = loaded.request->id;
+            notifyStreamingRequestEnabled(loaded.request);
+            
+            // The Asset will never be loaded. Its slot is released right away or once its last handle is gone.
+            assets[id].setLoadFailed(true);
+            if (counts[id] == 0) {
+                releaseUnloadedAsset(id, assets[id].getNameHash());
+            } else {
+                failedLoads.push_back(id);
+            }
+            
+            std::rethrow_exception(loaded.exception);
+        }
         
-        Asset& assetData = data->assetData;
-        assert(assetData.isLoaded());
+        enableAsset(std::move(loaded.data), canBatch);
+        assert(loaded.request->asset->isLoaded());
         
-        enableAsset(std::move(data), canBatch);
+        // Released while it was being streamed in. The garbage collector skipped it back then.
+        AssetHandleRefCounter& counter = counts[loaded.request->id];
+        if (counter == 0) {
+            releaseList.push(&counter);
+        }
         
-        toEnable.pop_front();
+        // Destroys the request and the Metadata copy that the LoadedAssetData referenced
+        notifyStreamingRequestEnabled(loaded.request);
     }
     
     /// \remark This default implementation doesn't handle the AssetsToEnableResult::Busy case because every TypeManager defines
     /// "busy" in a different way and some can't be busy at all.
     virtual AssetsToEnableResult hasAssetsToEnable() const override {
+        // Assets are enabled in the order in which their readFile() calls finish, so a slow load never blocks the
+        // ones that were requested after it.
         if (toEnable.empty()) {
             return AssetsToEnableResult::NoAssetsToEnable;
+        } else {
+            return AssetsToEnableResult::HasAssetsToEnable;
         }
+    }
+    
+    virtual std::uint64_t getNextUploadSize() const final override {
+        const AsyncLoadInfo* next = toEnable.front();
+        return (next != nullptr) ? next->estimatedSize : 0;
+    }
+    
+    /// Hands the load over to the StreamingScheduler, which calls executeStreamingRequest() on a worker thread once the
+    /// request is dispatched.
+    void enqueueAsyncLoad(StringHash nameHash, const Path& path, const Metadata& meta, std::uint32_t id, float priority) {
+        // The Asset pointer is obtained here because worker threads can't safely index the ChunkedVector while the main
+        // thread may be growing it. Elements of a ChunkedVector never move.
+        submitStreamingRequest(std::make_unique<StreamingRequest>(this, nameHash, id, &assets[id], path, meta, &counts[id], estimateUploadSize(meta), priority));
+    }
+    
+    virtual void executeStreamingRequest(StreamingRequest& request) final override {
+        T& asset = static_cast<T&>(*request.asset);
         
-        // TODO Technically, depending on the size of the files and how work gets assigned to threads, it's possible that
-        // a later operation will finish before an earlier one. Iterating over and checking many elements every frame  (e.g.,
-        // when loading a World) doesn't seem to be a particularly good idea as well. If this proves to be a problem, I'll 
-        // need to look for a smarter solution, e.g., use a syncronized queue that receives a LoadedAssetData object whenever
-        // readFile() finishes. However, the current solution seems to be good enough for now.
-        assert(toEnable.front().future.valid());
-        if (toEnable.front().future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
-            return AssetsToEnableResult::HasAssetsToEnable;
-        } else {
-            return AssetsToEnableResult::NoAssetsToEnable;
+        // The request mustn't be touched after the push because the main thread may destroy it at any moment
+        try {
+            toEnable.push(readFile(request.nameHash, request.path, request.metadata, asset), nullptr, request.estimatedSize, &request);
+        } catch (...) {
+            toEnable.push(nullptr, std::current_exception(), request.estimatedSize, &request);
         }
     }
     
+    virtual void cancelStreamingRequest(StreamingRequest& request) final override {
+        const std::uint32_t id = request.id;
+        assert(counts[id] == 0);
+        assert(!assets[id].isLoaded());
+        
+        // Nothing was read, so there's nothing to free
+        releaseUnloadedAsset(id, request.nameHash);
+    }
+    
     virtual bool refresh(StringHash nameHash, const Path& path, const Metadata& meta, std::uint32_t id) final override {
         if (manager->isGameMode()) {
             throw std::logic_error("This method can't be used when the engine is running in game mode.");
@@ -265,10 +405,22 @@ protected:
     }
     
     std::vector<std::uint32_t> freeList;
-    ChunkedVector<std::atomic<std::uint32_t>, chunkSize> counts;
+    ChunkedVector<AssetHandleRefCounter, chunkSize> counts;
+    
+    /// Counters that dropped to 0 since the previous IncrementalCollection run
+    AssetReleaseList releaseList;
+    
+    /// Pairs of Asset ids and the IncrementalCollection runs that found them in the releaseList. The Assets are freed once the
+    /// grace period expires.
+    std::deque<std::pair<std::uint32_t, std::uint64_t>> pendingReleases;
+    std::uint64_t collectionRun;
+    
+    /// Assets that failed to load while they were still referenced. Released by collectFailedLoads().
+    std::vector<std::uint32_t> failedLoads;
     ChunkedVector<T, chunkSize> assets;
     
-    std::deque<AsyncLoadInfo> toEnable;
+    /// Assets that have been read by the worker threads and are waiting to be enabled on the main thread, in completion order.
+    iyft::MPSCQueue<AsyncLoadInfo> toEnable;
     
     /// A value that can safely be used for missing assets.
     AssetHandle<T> missingAssetHandle;
@@ -29,35 +29,81 @@
 #ifndef MESH_TYPE_MANAGER_HPP
 #define MESH_TYPE_MANAGER_HPP
 
+#include <deque>
+#include <memory>
+#include <unordered_set>
 #include <vector>
 
 #include "graphics/GraphicsAPI.hpp"
+#include "physics/CollisionMeshCache.hpp"
 #include "physics/GraphicsToPhysicsDataMapping.hpp"
 #include "assets/AssetManager.hpp"
 #include "assets/assetTypes/Mesh.hpp"
 #include "assets/typeManagers/ChunkedVectorTypeManager.hpp"
-#include "utilities/BufferRangeSet.hpp"
+#include "utilities/BufferRangeAllocator.hpp"
 #include "utilities/DataSizes.hpp"
 
 namespace iyf {
 class Engine;
+
+/// Determines what mesh data the MeshTypeManager keeps in system RAM after it gets uploaded to the GPU.
+enum class MeshHostDataMode {
+    /// Keep a complete copy of every vertex and index buffer. Fast to access, but doubles the memory used by meshes.
+    MirrorBuffers,
+    /// Don't keep any copies of the vertex and index buffers. Positions and indices of meshes that get used by
+    /// the physics engine are stored in a compact CollisionMeshCache instead.
+    CollisionCache
+};
+
 /// \todo https://developer.nvidia.com/vulkan-memory-management Maybe I need to merge vertex and index buffers into
 /// a single one and layout the memory of objects like this: obj1Vert,obj1Ind,obj2Vert,obj2Ind,...
 class MeshTypeManager : public ChunkedVectorTypeManager<Mesh> {
 public:
     struct BufferWithRanges {
-        BufferWithRanges(Buffer buffer, Bytes size, void* data) : buffer(buffer), freeRanges(size), data(data) {}
+        BufferWithRanges(Buffer buffer, Bytes size, void* data, BufferRangeAllocatorType allocatorType)
+            : buffer(buffer), freeRanges(BufferRangeAllocator::Create(allocatorType, size)), data(data), stalledFreeRangeCount(0) {}
         
         Buffer buffer;
-        BufferRangeSet freeRanges;
+        std::unique_ptr<BufferRangeAllocator> freeRanges;
         
         /// Pointer to a "mirror" buffer in system RAM that has the exact same data as the GPU buffer.
         /// The data in this buffer should typically be used to build various acceleration structures,
-        /// such as those used by Steam Audio, or physics objects (such as terrains and convex meshes)
+        /// such as those used by Steam Audio, or physics objects (such as terrains and convex meshes).
+        ///
+        /// \remark nullptr if the MeshHostDataMode is not MeshHostDataMode::MirrorBuffers
         void* data;
+        
+        /// Set to the number of free ranges after a defragmentation pass that couldn't move anything. The buffer won't be
+        /// defragmented again until the number changes. 0 if the last pass was successful.
+        std::size_t stalledFreeRangeCount;
+    };
+    
+    /// Controls the incremental defragmenter that moves meshes to lower offsets in order to merge the free ranges of vertex
+    /// and index buffers.
+    struct DefragmentationSettings {
+        DefragmentationSettings() : enabled(true), fragmentationThreshold(0.5f), bytesPerFrame(Bytes(512 * 1024)) {}
+        
+        bool enabled;
+        
+        /// A buffer is defragmented once its BufferRangeAllocator::getFragmentation() exceeds this value.
+        float fragmentationThreshold;
+        
+        /// The maximum amount of vertex (and, separately, index) data that can be moved in a single frame.
+        Bytes bytesPerFrame;
+    };
+    
+    struct DefragmentationStatistics {
+        DefragmentationStatistics() : passes(0), movedMeshes(0), movedBytes(0) {}
+        
+        std::uint64_t passes;
+        std::uint64_t movedMeshes;
+        Bytes movedBytes;
     };
 
-    MeshTypeManager(AssetManager* manager, Bytes VBOSize, Bytes IBOSize);
+    /// \param allocatorType The BufferRangeAllocator that should manage the ranges of the vertex and index buffers.
+    /// \param hostDataMode What data should be kept in system RAM after it gets uploaded to the GPU.
+    MeshTypeManager(AssetManager* manager, Bytes VBOSize, Bytes IBOSize, BufferRangeAllocatorType allocatorType = BufferRangeAllocatorType::TLSF,
+                    MeshHostDataMode hostDataMode = MeshHostDataMode::MirrorBuffers);
     virtual ~MeshTypeManager();
     
     virtual AssetType getType() final {
@@ -106,7 +152,30 @@ public:
 
     /// \warning Make sure that the physics objects using these mappings get destroyed before the backing graphics data
     /// is cleared.
+    ///
+    /// \remark When using MeshHostDataMode::MirrorBuffers, the mappings point to the mirror buffers, so the defragmenter
+    /// won't move meshes that had this function called on them. When using MeshHostDataMode::CollisionCache, the first call
+    /// for each mesh reads the mesh file again in order to fill the cache.
     std::pair<GraphicsToPhysicsDataMapping, GraphicsToPhysicsDataMapping> getGraphicsToPhysicsDataMapping(const Mesh& assetData) const;
+    
+    inline MeshHostDataMode getHostDataMode() const {
+        return hostDataMode;
+    }
+    
+    /// \return The amount of system RAM used to store copies of mesh data
+    Bytes getHostMemoryUsage() const;
+    
+    inline void setDefragmentationSettings(const DefragmentationSettings& settings) {
+        defragmentationSettings = settings;
+    }
+    
+    inline const DefragmentationSettings& getDefragmentationSettings() const {
+        return defragmentationSettings;
+    }
+    
+    inline const DefragmentationStatistics& getDefragmentationStatistics() const {
+        return defragmentationStatistics;
+    }
 protected:
     virtual void initMissingAssetHandle() final override;
     
@@ -124,18 +193,73 @@ protected:
     
     struct RangeDataResult {
         BufferRange range;
+        /// Location of the data in the mirror buffer or nullptr if mirror buffers aren't used
         void* data;
+        /// Padding at the start of the range that was required to align the data
+        std::uint64_t padding;
         bool result;
         std::uint8_t bufferID;
     };
     
     RangeDataResult findRange(Bytes size, Bytes alignment, std::vector<BufferWithRanges>& buffers);
     
+    /// \return A new mirror buffer or nullptr if mirror buffers aren't used
+    char* allocateMirror(Bytes size) const;
+    
+    std::pair<GraphicsToPhysicsDataMapping, GraphicsToPhysicsDataMapping> getCachedCollisionData(const Mesh& assetData) const;
+    
+    /// Adds a newly created buffer to the provided vector and allocates a range in it
+    RangeDataResult addBufferWithRange(const Buffer& buffer, Bytes size, Bytes alignment, std::vector<BufferWithRanges>& buffers);
+    
+    /// The state of an incremental defragmentation pass over a single buffer.
+    struct DefragmentationPass {
+        DefragmentationPass() : bufferID(0), movedMeshes(0), active(false) {}
+        
+        /// Pairs of data offsets (in bytes) and ids of meshes that are stored in the buffer, sorted by offset. The ones at the
+        /// back are moved first.
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> candidates;
+        std::uint8_t bufferID;
+        std::uint64_t movedMeshes;
+        bool active;
+    };
+    
+    /// A range that was vacated by a moved mesh. Frames that are still in flight may be using it, so it can only be reused
+    /// once releaseFrame is reached.
+    struct RetiredRange {
+        RetiredRange(BufferRange range, std::uint64_t releaseFrame, std::uint8_t bufferID, bool vertexRange)
+            : range(range), releaseFrame(releaseFrame), bufferID(bufferID), vertexRange(vertexRange) {}
+        
+        BufferRange range;
+        std::uint64_t releaseFrame;
+        std::uint8_t bufferID;
+        bool vertexRange;
+    };
+    
+    /// Releases old RetiredRange objects and advances the defragmentation passes. Called every frame.
+    void defragment();
+    void defragmentBuffers(std::vector<BufferWithRanges>& buffers, DefragmentationPass& pass, bool vertexBuffers);
+    
     const Bytes VBOSize;
     const Bytes IBOSize;
+    const BufferRangeAllocatorType allocatorType;
+    const MeshHostDataMode hostDataMode;
     
     std::vector<BufferWithRanges> vertexDataBuffers;
     std::vector<BufferWithRanges> indexDataBuffers;
+    
+    DefragmentationSettings defragmentationSettings;
+    DefragmentationStatistics defragmentationStatistics;
+    DefragmentationPass vertexDefragmentationPass;
+    DefragmentationPass indexDefragmentationPass;
+    std::deque<RetiredRange> retiredRanges;
+    std::uint64_t frame;
+    
+    /// Meshes that can't be moved because getGraphicsToPhysicsDataMapping() gave out pointers to their data.
+    mutable std::unordered_set<const Mesh*> pinnedMeshes;
+    
+    /// Only used with MeshHostDataMode::CollisionCache. Filled lazily by getGraphicsToPhysicsDataMapping()
+    mutable CollisionMeshCache collisionMeshCache;
+    
     GraphicsAPI* gfx;
     Engine* engine;
 };
@@ -33,8 +33,10 @@
 #include "assets/AssetHandle.hpp"
 #include "assets/metadata/Metadata.hpp"
 #include "core/interfaces/GarbageCollecting.hpp"
+#include "io/FileView.hpp"
 
 #include <chrono>
+#include <memory>
 
 namespace iyft {
 class ThreadPool;
@@ -42,14 +44,17 @@ class ThreadPool;
 
 namespace iyf {
 class AssetManager;
+struct StreamingRequest;
 
 struct LoadedAssetData {
-    LoadedAssetData(const Metadata& metadata, Asset& assetData, std::pair<std::unique_ptr<char[]>, std::int64_t> rawData) 
+    LoadedAssetData(const Metadata& metadata, Asset& assetData, FileView rawData) 
         : assetData(assetData), metadata(metadata), rawData(std::move(rawData)) {}
     
     Asset& assetData;
     const Metadata& metadata;
-    std::pair<std::unique_ptr<char[]>, std::int64_t> rawData;
+    
+    /// Contents of the asset file. Usually a memory mapping of the file that the loaders can parse without copying it.
+    FileView rawData;
     
     virtual ~LoadedAssetData() {}
 };
@@ -80,6 +85,13 @@ public:
 protected:
     friend class AssetManager;
     
+    /// \brief Creates a TypeManager that doesn't belong to an AssetManager. Meant for tests that need to drive a real
+    /// TypeManager without starting the Engine.
+    ///
+    /// \warning The derived class must override notifyRemoval(), submitStreamingRequest(), notifyStreamingRequestEnabled() and
+    /// getGarbageCollectionGracePeriod() because there's no AssetManager to forward them to. refresh() can't be used at all.
+    TypeManager();
+    
     /// \brief Reload the specified asset from disk.
     ///
     /// \warning This function can only be used if the Engine is running in editor mode.
@@ -88,7 +100,9 @@ protected:
     virtual bool refresh(StringHash nameHash, const Path& path, const Metadata& meta, std::uint32_t id) = 0;
     
     /// Load an asset that has not been loaded yet
-    virtual std::pair<Asset*, AssetHandleRefCounter*> load(StringHash nameHash, const Path& path, const Metadata& meta, std::uint32_t& idOut, bool isAsync) = 0;
+    ///
+    /// \param priority Only used if isAsync is true. Asynchronous loads with higher priorities are read and enabled first.
+    virtual std::pair<Asset*, AssetHandleRefCounter*> load(StringHash nameHash, const Path& path, const Metadata& meta, std::uint32_t& idOut, bool isAsync, float priority) = 0;
     
     /// Fetch a handle to an asset that has already been loaded
     virtual std::pair<Asset*, AssetHandleRefCounter*> fetch(std::uint32_t id) = 0;
@@ -122,13 +136,22 @@ protected:
     /// \brief Checks if the TypeManager can enable any Assets.
     virtual AssetsToEnableResult hasAssetsToEnable() const = 0;
     
+    /// \brief Returns the estimated upload size of the Asset that the next enableAsyncLoadedAsset() call would enable. Used to
+    /// enforce StreamingBudget::uploadPerFrame.
+    virtual std::uint64_t getNextUploadSize() const {
+        return 0;
+    }
+    
     /// Our friend AssetManager calls this function once it finishes building the manifest. The "missing" assets
     /// are treated like any other assets and require the presence of a manifest to be loaded.
     virtual void initMissingAssetHandle() = 0;
     
     virtual void notifyMove(std::uint32_t id, StringHash sourceNameHash, StringHash destinationNameHash) = 0;
     
-    void notifyRemoval(StringHash nameHash);
+    virtual void notifyRemoval(StringHash nameHash);
+    virtual void submitStreamingRequest(std::unique_ptr<StreamingRequest> request);
+    virtual std::uint32_t getGarbageCollectionGracePeriod() const;
+    virtual void notifyStreamingRequestEnabled(StreamingRequest* request);
     void logLeakedAsset(std::size_t id, StringHash nameHash, std::uint32_t count) const;
     void logAssetCreation(std::size_t id, StringHash nameHash, bool isFetch, bool isAsync) const;
     void logAssetRemoval(std::size_t id, StringHash nameHash) const;
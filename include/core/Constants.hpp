@@ -132,6 +132,9 @@ const std::size_t MaxSubMeshes = 32;
 /// \brief Maximum number of animations that a single mesh can have.
 const std::size_t MaxAnimations = 64;
 
+/// \brief Maximum number of detail levels that a single mesh can have, including the full detail one.
+const std::size_t MaxMeshLODs = 4;
+
 /// \brief Maximum number of vertices that a single mesh (all of its sub-meshes) can have.
 /// \warning Simply increasing this won't be enough. A lot of places in this engine use std::uint16_t for vertex counts. You'll still need to create a custom
 /// binary data format capable of storing meshes with more than 65535 vertices, update the loader, change the data types in
@@ -39,6 +39,7 @@
 #include "core/TransformationComponent.hpp"
 #include "core/ComponentType.hpp"
 #include "core/Component.hpp"
+#include "core/TaskGraph.hpp"
 #include "core/interfaces/GarbageCollecting.hpp"
 #include "utilities/ChunkedVector.hpp"
 #include "utilities/IntegerPacking.hpp"
@@ -393,6 +394,26 @@ public:
     virtual void dispose() = 0;
     virtual void update(float delta, const EntityStateVector& entityStates) = 0;
     
+    /// Adds the jobs that this System needs to run every frame to the frame TaskGraph of the EntitySystemManager. Called once,
+    /// after all Systems have been initialized.
+    ///
+    /// The default implementation adds a single job that calls update(). It uses getUpdateAccess() and getUpdateAffinity(),
+    /// so Systems with a single update step only need to override those. Override this to split the work into smaller jobs.
+    ///
+    /// \remark Changing a TransformationComponent notifies all Components of the Entity, so jobs that write transformations
+    /// must also declare writes to every component type that reacts to those notifications (MeshComponent and LightComponent).
+    virtual void declareJobs(TaskGraph& graph, const EntityStateVector& entityStates);
+    
+    /// The data that update() reads and writes when it's called from the default declareJobs(). By default, the System
+    /// writes its own components and data and only reads the TransformationComponent objects.
+    virtual JobAccess getUpdateAccess() const;
+    
+    /// The threads that may call update() when it's called from the default declareJobs(). Systems that use the graphics
+    /// API, the window or other APIs that aren't thread safe must return JobAffinity::MainThread.
+    virtual JobAffinity getUpdateAffinity() const {
+        return JobAffinity::AnyThread;
+    }
+    
     /// Obtain the number of Component subtypes that are managed by this System. The return value must match
     /// the COUNT value from a subtype enumerator (located in ComponentTypes.hpp) that corresponds to this System.
     /// E.g., GraphicsSystem must return GraphicsComponent::COUNT here.
@@ -954,6 +975,10 @@ private:
     /// Checks if we need to resize and performs the operation if we do
     void resize(std::uint32_t newSize);
     
+    /// Asks all Systems to declare their jobs. The PhysicsSystem goes first because it may change TransformationComponents
+    /// that other Systems depend on.
+    void buildFrameGraph();
+    
     void manageEntityLifecycles(float delta);
     
     bool validateComponentAttachment() const;
@@ -986,6 +1011,9 @@ private:
     /// Contains all Systems that are derived from System and registered with this manager.
     SystemArray systems;
     
+    /// Jobs declared by the Systems. Executed on the frame worker pool of the Engine every update().
+    TaskGraph frameGraph;
+    
     std::vector<EntityKey> awaitingInitialization;
     std::vector<EntityKey> awaitingDestruction;
     
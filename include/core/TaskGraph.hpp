@@ -0,0 +1,216 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_TASK_GRAPH_HPP
+#define IYF_TASK_GRAPH_HPP
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "core/ComponentType.hpp"
+#include "utilities/NonCopyable.hpp"
+
+namespace iyft {
+class ThreadPool;
+}
+
+namespace iyf {
+/// Describes the data that a job of a TaskGraph reads and writes. Two jobs conflict (and, therefore, cannot run in
+/// parallel) if one of them writes data that the other one reads or writes.
+///
+/// Access can be declared for all components of a ComponentBaseType, for a single component subtype or for the data
+/// that a System keeps outside of its components (e.g., visibility lists or a physics world).
+class JobAccess {
+public:
+    JobAccess() {}
+    
+    /// Declares reads of all components of the base type and of the data of the System that manages them.
+    inline JobAccess& read(ComponentBaseType type) {
+        reads[static_cast<std::size_t>(type)].set();
+        return *this;
+    }
+    
+    /// Declares writes to all components of the base type and to the data of the System that manages them.
+    inline JobAccess& write(ComponentBaseType type) {
+        writes[static_cast<std::size_t>(type)].set();
+        return *this;
+    }
+    
+    inline JobAccess& read(const ComponentType& type) {
+        reads[static_cast<std::size_t>(type.getBaseType())][type.getSubType()] = true;
+        return *this;
+    }
+    
+    inline JobAccess& write(const ComponentType& type) {
+        writes[static_cast<std::size_t>(type.getBaseType())][type.getSubType()] = true;
+        return *this;
+    }
+    
+    /// Declares reads of the data that the System managing the base type stores outside of its components.
+    inline JobAccess& readSystemData(ComponentBaseType type) {
+        reads[static_cast<std::size_t>(type)][SystemDataBit] = true;
+        return *this;
+    }
+    
+    inline JobAccess& writeSystemData(ComponentBaseType type) {
+        writes[static_cast<std::size_t>(type)][SystemDataBit] = true;
+        return *this;
+    }
+    
+    /// TransformationComponent objects are managed by the EntitySystemManager and not by a System, so they don't have
+    /// a ComponentBaseType of their own.
+    inline JobAccess& readTransformations() {
+        reads[TransformationIndex][0] = true;
+        return *this;
+    }
+    
+    inline JobAccess& writeTransformations() {
+        writes[TransformationIndex][0] = true;
+        return *this;
+    }
+    
+    inline bool conflictsWith(const JobAccess& other) const {
+        for (std::size_t i = 0; i < ResourceCount; ++i) {
+            if ((writes[i] & (other.reads[i] | other.writes[i])).any() || (reads[i] & other.writes[i]).any()) {
+                return true;
+            }
+        }
+        
+        return false;
+    }
+private:
+    /// Component subtype enumerators can't have more than 63 values, so the last bit is free for the System data.
+    static const std::size_t SystemDataBit = 63;
+    
+    /// The last set of bits is used for the TransformationComponent objects.
+    static const std::size_t TransformationIndex = static_cast<std::size_t>(ComponentBaseType::COUNT);
+    static const std::size_t ResourceCount = TransformationIndex + 1;
+    
+    std::array<std::bitset<64>, ResourceCount> reads;
+    std::array<std::bitset<64>, ResourceCount> writes;
+};
+
+enum class JobAffinity {
+    /// The job can run on any worker of the pool.
+    AnyThread,
+    /// The job must run on the thread that called TaskGraph::execute(). Use this for jobs that touch the graphics API,
+    /// the window or other APIs that are not thread safe.
+    MainThread
+};
+
+/// A set of jobs with dependencies that is executed every frame. Dependencies are derived from the JobAccess declarations:
+/// a job depends on every previously added job that it conflicts with. Additional explicit dependencies may be provided for
+/// ordering constraints that can't be expressed via component access. Independent jobs run in parallel on the provided pool.
+///
+/// \remark The graph is built once and executed many times. Adding jobs is not thread safe and must not happen during
+/// execute().
+class TaskGraph : private NonCopyable {
+public:
+    using JobID = std::uint32_t;
+    using JobFunction = std::function<void(float)>;
+    
+    TaskGraph();
+    ~TaskGraph();
+    
+    /// Adds a new job to the graph.
+    ///
+    /// \param[in] name Name of the job. Used in debug output.
+    /// \param[in] function The function to execute. It receives the delta that was passed to execute().
+    /// \param[in] access The data that the job reads and writes.
+    /// \param[in] affinity The threads that are allowed to execute the job.
+    /// \param[in] explicitDependencies IDs of previously added jobs that must complete before this one starts.
+    /// \return The ID of the new job.
+    JobID addJob(std::string name, JobFunction function, const JobAccess& access, JobAffinity affinity = JobAffinity::AnyThread, const std::vector<JobID>& explicitDependencies = {});
+    
+    /// Executes all jobs and blocks until they complete. The calling thread executes all JobAffinity::MainThread jobs.
+    ///
+    /// \remark If a job throws, the remaining jobs still run and the first exception is rethrown once all jobs complete.
+    ///
+    /// \param[in] pool The pool to run the jobs on. If it's nullptr, all jobs are executed on the calling thread in the
+    /// order they were added.
+    /// \param[in] delta The delta to pass to each job.
+    void execute(iyft::ThreadPool* pool, float delta);
+    
+    /// Removes all jobs.
+    void clear();
+    
+    inline std::size_t getJobCount() const {
+        return jobs.size();
+    }
+    
+    inline const std::string& getJobName(JobID id) const {
+        return jobs[id]->name;
+    }
+    
+    /// Returns the IDs of jobs that must complete before the specified job can start.
+    std::vector<JobID> getDependencies(JobID id) const;
+    
+    /// Checks if the two jobs are ordered by the graph, directly or through other jobs.
+    bool isOrdered(JobID first, JobID second) const;
+private:
+    struct Job {
+        std::string name;
+        JobFunction function;
+        JobAccess access;
+        JobAffinity affinity;
+        
+        /// Jobs that can't start until this one completes.
+        std::vector<JobID> dependents;
+        
+        /// The number of jobs that need to complete before this one can start.
+        std::uint32_t dependencyCount;
+        
+        /// Reset to dependencyCount at the start of every execute().
+        std::atomic<std::uint32_t> remainingDependencies;
+    };
+    
+    void dispatch(iyft::ThreadPool* pool, JobID id, float delta);
+    void runJob(iyft::ThreadPool* pool, JobID id, float delta);
+    
+    std::vector<std::unique_ptr<Job>> jobs;
+    
+    std::atomic<std::size_t> remainingJobs;
+    
+    std::mutex mainThreadMutex;
+    std::condition_variable mainThreadNotifier;
+    std::vector<JobID> mainThreadJobs;
+    
+    std::mutex exceptionMutex;
+    std::exception_ptr firstException;
+};
+}
+
+#endif // IYF_TASK_GRAPH_HPP
@@ -0,0 +1,253 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_TRANSFORM_STORE_HPP
+#define IYF_TRANSFORM_STORE_HPP
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "glm/mat4x4.hpp"
+#include "glm/vec3.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+namespace iyft {
+class ThreadPool;
+}
+
+namespace iyf {
+/// Stores transformations as a structure of arrays and rebuilds their matrices in batches.
+///
+/// Unlike TransformationComponent, which keeps the hot data (position, rotation, scale and the matrix) next to the
+/// cold data (entity and hierarchy pointers) and rebuilds the matrix as soon as anything changes, the setters of
+/// the TransformStore only update the relevant arrays and set a dirty bit. updateDirtyTransforms() then rebuilds
+/// the local matrices of all dirty transforms 4 (SSE) or 8 (AVX) at a time and propagates the changes down the
+/// hierarchy, one level at a time.
+///
+/// \remark The store is optional. It's meant for systems that move many objects every frame (particles, crowds,
+/// debris, etc.) and don't need the per-change component notifications of TransformationComponent.
+/// Nothing in the engine uses it yet. The EntitySystemManager still updates the TransformationComponent objects.
+///
+/// \warning The setters and updateDirtyTransforms() must not be called concurrently.
+class TransformStore {
+public:
+    using Handle = std::uint32_t;
+    static constexpr Handle InvalidHandle = std::numeric_limits<Handle>::max();
+    
+    /// The storage is always padded to a multiple of this value. It matches the number of dirty bits in a word,
+    /// which means that threads never share dirty words and that SIMD loads never go out of bounds.
+    static constexpr std::size_t Padding = 64;
+    
+    /// Work is never split into chunks smaller than this because scheduling tiny chunks costs more than
+    /// updating them.
+    static constexpr std::size_t MinChunkSize = 4096;
+    
+    enum class Mode {
+        /// Rebuilds one matrix at a time. Kept as a reference and for debugging.
+        Scalar,
+        /// Rebuilds 8 matrices at a time if the engine was built with AVX support and 4 otherwise.
+        SIMD
+    };
+    
+    TransformStore();
+    
+    /// Creates an identity transformation. It's dirty until the next call to updateDirtyTransforms().
+    ///
+    /// \param parent The parent transformation or InvalidHandle if the new transformation is a root.
+    Handle create(Handle parent = InvalidHandle);
+    
+    /// Destroys a transformation. Its handle may be reused by create().
+    ///
+    /// \throws std::logic_error if the transformation still has children.
+    void destroy(Handle handle);
+    
+    /// Changes the parent of a transformation. The local transformation stays the same.
+    ///
+    /// \throws std::logic_error if the change would create a cycle.
+    void setParent(Handle child, Handle parent);
+    
+    inline Handle getParent(Handle handle) const {
+        return parents[handle];
+    }
+    
+    inline void setPosition(Handle handle, const glm::vec3& position) {
+        positionX[handle] = position.x;
+        positionY[handle] = position.y;
+        positionZ[handle] = position.z;
+        markDirty(handle);
+    }
+    
+    inline void translate(Handle handle, const glm::vec3& translation) {
+        positionX[handle] += translation.x;
+        positionY[handle] += translation.y;
+        positionZ[handle] += translation.z;
+        markDirty(handle);
+    }
+    
+    /// Sets the rotation. It's normalized before it's stored.
+    inline void setRotation(Handle handle, const glm::quat& rotation) {
+        storeRotation(handle, glm::normalize(rotation));
+    }
+    
+    /// Applies a rotation on top of the current one, just like TransformationComponent::rotate(). The result is
+    /// normalized every time, which means that the rotation never drifts.
+    inline void rotate(Handle handle, const glm::quat& rotation) {
+        storeRotation(handle, glm::normalize(rotation * getRotation(handle)));
+    }
+    
+    inline void setScale(Handle handle, const glm::vec3& scale) {
+        scaleX[handle] = scale.x;
+        scaleY[handle] = scale.y;
+        scaleZ[handle] = scale.z;
+        markDirty(handle);
+    }
+    
+    inline glm::vec3 getPosition(Handle handle) const {
+        return glm::vec3(positionX[handle], positionY[handle], positionZ[handle]);
+    }
+    
+    inline glm::quat getRotation(Handle handle) const {
+        return glm::quat(rotationW[handle], rotationX[handle], rotationY[handle], rotationZ[handle]);
+    }
+    
+    inline glm::vec3 getScale(Handle handle) const {
+        return glm::vec3(scaleX[handle], scaleY[handle], scaleZ[handle]);
+    }
+    
+    /// Returns the world space matrix of the transformation, as computed by the last call to updateDirtyTransforms().
+    inline const glm::mat4& getModelMatrix(Handle handle) const {
+        return worldMatrices[handle];
+    }
+    
+    /// Returns true if the transformation was changed after the last call to updateDirtyTransforms(). Changes of
+    /// the parents aren't taken into account.
+    inline bool isDirty(Handle handle) const {
+        return (dirtyBits[handle / Padding] & (std::uint64_t(1) << (handle % Padding))) != 0;
+    }
+    
+    /// Changes every time the world space matrix is rebuilt. Helps to determine what to cache.
+    inline std::uint32_t getUpdateCount(Handle handle) const {
+        return updateCounts[handle];
+    }
+    
+    inline bool isAlive(Handle handle) const {
+        return handle < alive.size() && alive[handle] != 0;
+    }
+    
+    /// Returns the number of live transformations.
+    inline std::size_t size() const {
+        return aliveCount;
+    }
+    
+    /// Rebuilds the local matrices of all dirty transformations and updates the world space matrices of them and of
+    /// all their descendants.
+    ///
+    /// \param pool An optional ThreadPool. If it's nullptr, everything is done by the calling thread.
+    void updateDirtyTransforms(iyft::ThreadPool* pool = nullptr);
+    
+    inline void setMode(Mode newMode) {
+        mode = newMode;
+    }
+    
+    inline Mode getMode() const {
+        return mode;
+    }
+    
+    /// Returns the name of the instruction set that the SIMD mode uses.
+    static const char* GetSIMDInstructionSetName();
+private:
+    inline void markDirty(Handle handle) {
+        dirtyBits[handle / Padding] |= std::uint64_t(1) << (handle % Padding);
+    }
+    
+    inline void storeRotation(Handle handle, const glm::quat& rotation) {
+        rotationX[handle] = rotation.x;
+        rotationY[handle] = rotation.y;
+        rotationZ[handle] = rotation.z;
+        rotationW[handle] = rotation.w;
+        markDirty(handle);
+    }
+    
+    /// Resets the hot data of a slot to an identity transformation.
+    void resetSlot(Handle handle);
+    void grow();
+    
+    /// Sorts the transformations that have a parent by their depth in the hierarchy.
+    void rebuildHierarchyOrder();
+    
+    /// Rebuilds the local matrices of the dirty transformations in the dirty words [firstWord, lastWord).
+    void rebuildWordsScalar(std::size_t firstWord, std::size_t lastWord);
+    void rebuildWordsSIMD(std::size_t firstWord, std::size_t lastWord);
+    
+    /// Updates the world space matrices of hierarchyOrder[begin, end). The parents must be up to date.
+    void propagateRange(std::size_t begin, std::size_t end);
+    
+    Mode mode;
+    std::size_t aliveCount;
+    bool hierarchyChanged;
+    
+    // Hot data. Each array has the same padded size.
+    std::vector<float> positionX;
+    std::vector<float> positionY;
+    std::vector<float> positionZ;
+    std::vector<float> rotationX;
+    std::vector<float> rotationY;
+    std::vector<float> rotationZ;
+    std::vector<float> rotationW;
+    std::vector<float> scaleX;
+    std::vector<float> scaleY;
+    std::vector<float> scaleZ;
+    
+    std::vector<std::uint64_t> dirtyBits;
+    
+    /// Only used by transformations that have a parent. The local matrices of roots are written straight to
+    /// worldMatrices.
+    std::vector<glm::mat4> localMatrices;
+    std::vector<glm::mat4> worldMatrices;
+    
+    /// Set when the world space matrix changed during the current update. Bytes instead of bits because the
+    /// threads that propagate a hierarchy level write to arbitrary elements.
+    std::vector<std::uint8_t> worldChanged;
+    std::vector<std::uint32_t> updateCounts;
+    
+    // Cold data
+    std::vector<Handle> parents;
+    std::vector<std::uint32_t> childCounts;
+    std::vector<std::uint8_t> alive;
+    std::vector<Handle> freeHandles;
+    
+    /// Transformations that have a parent, sorted by depth. The transformations at depth d + 1 (children of roots
+    /// have depth 1) occupy [levelOffsets[d], levelOffsets[d + 1]).
+    std::vector<Handle> hierarchyOrder;
+    std::vector<std::size_t> levelOffsets;
+    std::vector<std::uint32_t> depths;
+};
+}
+
+#endif // IYF_TRANSFORM_STORE_HPP
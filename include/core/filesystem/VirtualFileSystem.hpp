@@ -54,6 +54,10 @@ public:
 
     virtual std::unique_ptr<File> openFile(const Path& p, FileOpenMode mode) const final override;
     
+    /// Memory maps the file if it's stored in a mounted real directory (see DefaultFileSystem::mapWholeFile()).
+    /// Files that are stored in mounted archives can't be mapped and get read into a buffer instead.
+    virtual FileView mapWholeFile(const Path& path) const final override;
+    
     virtual FileHash computeFileHash(const Path& path) const final override;
     
     /// Open a file in the file browser. This function expects a real path.
@@ -115,6 +119,19 @@ public:
     /// \return the read only real name of directory containing the fileName
     Path getRealDirectory(const Path& fileName) const;
     
+    /// Finds the real sources of a virtual directory in the search path. That's every mounted real directory that
+    /// contains it and every mounted archive that may contain it. The paths are provided in platform dependent notation
+    /// and in search path order.
+    ///
+    /// Used to detect changes in asset directories. E.g., the modification time of a directory changes when a file is
+    /// added to or removed from it and the modification time of an archive changes when it's rebuilt.
+    ///
+    /// \warning This method breaks the sandbox, just like getRealDirectory() does.
+    ///
+    /// \param[in] path A virtual directory
+    /// \return Real directories and archives
+    std::vector<Path> getRealSearchPathSources(const Path& path) const;
+    
     /// \brief Deletes a file or an empty directory from the current write directory
     /// 
     /// \param[in] path file or directory to delete
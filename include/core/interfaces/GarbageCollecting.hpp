@@ -34,6 +34,10 @@ namespace iyf {
 enum class GarbageCollectionRunPolicy {
     /// Unload all Assets that have a reference count of 0 and tell the parent AssetManager to remove their names from lookup map
     FullCollection,
+    /// Like FullCollection, but only checks the Assets whose reference count dropped to 0 since the previous runs and waits for the
+    /// grace period (see AssetManager::setGarbageCollectionGracePeriod()) to expire. Meant to be called every frame because the cost
+    /// depends on the number of released Assets and not on the number of loaded ones.
+    IncrementalCollection,
     /// Unload all Assets that have a reference count of 0, do not notify the parent AssetManager, log resource leaks (assets that
     /// have not been unloaded)
     FullCollectionDuringDestruction
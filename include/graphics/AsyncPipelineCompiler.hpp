@@ -0,0 +1,124 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_ASYNC_PIPELINE_COMPILER_HPP
+#define IYF_ASYNC_PIPELINE_COMPILER_HPP
+
+#include "graphics/GraphicsAPI.hpp"
+#include "utilities/NonCopyable.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace iyft {
+class ThreadPool;
+}
+
+namespace iyf {
+
+/// Creates pipelines on worker threads to avoid stalling the frame when a pipeline is needed for the first time.
+///
+/// Each pipeline is identified by a key that must be unique for its PipelineCreateInfo, e.g., a hash of the material
+/// template variant and the render pass that it's used in. Requests with the same key are only compiled once.
+///
+/// The thread that records the draws should use getPipeline() that never blocks and returns the fallback pipeline until
+/// the requested one is ready. If the creation fails, the fallback is used until dispose() is called.
+///
+/// \warning The shaders, the layout and the render pass that are referenced by the PipelineCreateInfo must stay alive
+/// until the pipeline is ready.
+class AsyncPipelineCompiler : private NonCopyable {
+public:
+    enum class State : std::uint8_t {
+        Pending,
+        Ready,
+        Failed
+    };
+    
+    /// \param api The GraphicsAPI that creates the pipelines. Its createPipeline() must be safe to call from
+    /// multiple threads.
+    /// \param pool The pool that creates the pipelines. If it's nullptr, the pipelines are created immediately in
+    /// requestPipeline().
+    AsyncPipelineCompiler(GraphicsAPI* api, iyft::ThreadPool* pool);
+    ~AsyncPipelineCompiler();
+    
+    /// Starts creating the pipeline unless it has already been requested.
+    ///
+    /// \return A future that receives the pipeline or the exception that was thrown while creating it. If the key has
+    /// already been requested, the original future is returned and the info is ignored.
+    std::shared_future<Pipeline> requestPipeline(std::uint64_t key, const PipelineCreateInfo& info, std::string name);
+    
+    /// \return The pipeline if it's ready or the fallback if it's still being created, if it failed to be created or if
+    /// it was never requested.
+    const Pipeline& getPipeline(std::uint64_t key, const Pipeline& fallback) const;
+    
+    /// \return The state of the pipeline. Pipelines that were never requested are reported as State::Failed.
+    State getState(std::uint64_t key) const;
+    
+    inline bool isReady(std::uint64_t key) const {
+        return getState(key) == State::Ready;
+    }
+    
+    /// \return The number of pipelines that are still being created.
+    inline std::size_t getPendingCount() const {
+        return pendingCount.load(std::memory_order_acquire);
+    }
+    
+    /// Blocks until all requested pipelines are either ready or failed.
+    void waitForPending();
+    
+    /// Waits for the pending pipelines and destroys all pipelines that were created.
+    ///
+    /// \warning Must not be called while the pipelines are still being used by the GPU.
+    void dispose();
+private:
+    struct Entry {
+        Entry() : state(State::Pending) {}
+        
+        Pipeline pipeline;
+        std::atomic<State> state;
+        std::shared_future<Pipeline> future;
+    };
+    
+    Pipeline createPipeline(Entry* entry, const PipelineCreateInfo& info, const std::string& name);
+    
+    GraphicsAPI* api;
+    iyft::ThreadPool* pool;
+    
+    mutable std::mutex entryMutex;
+    std::unordered_map<std::uint64_t, std::unique_ptr<Entry>> entries;
+    std::atomic<std::size_t> pendingCount;
+};
+
+}
+
+#endif // IYF_ASYNC_PIPELINE_COMPILER_HPP
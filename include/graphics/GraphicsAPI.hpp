@@ -29,6 +29,7 @@
 #ifndef IYF_GRAPHICS_API_HPP
 #define IYF_GRAPHICS_API_HPP
 
+#include <array>
 #include <vector>
 #include <utility>
 #include <cstdint>
@@ -37,6 +38,7 @@
 #include "configuration/interfaces/Configurable.hpp"
 #include "graphics/GraphicsAPIConstants.hpp"
 #include "graphics/GraphicsAPIHandles.hpp"
+#include "io/Path.hpp"
 #include "utilities/DataSizes.hpp"
 #include "utilities/NonCopyable.hpp"
 #include "utilities/ForceInline.hpp"
@@ -290,6 +292,13 @@ public:
     /// \warning For performance reasons, this function assumes canBatchFitData() has already been called and returned true.
     virtual bool updateBuffer(MemoryBatch batch, const Buffer& destinationBuffer, const std::vector<BufferCopy>& copies, const void* data) = 0;
     
+    /// Copies data between device buffers without going through the host. The copies are recorded together with the uploads of the
+    /// batch and executed in order with them. Used to move data around when defragmenting buffers.
+    ///
+    /// \warning The sourceBuffer must have been created with BufferUsageFlagBits::TransferSource and the destinationBuffer with
+    /// BufferUsageFlagBits::TransferDestination. If both are the same buffer, the source and destination regions must not overlap.
+    virtual bool copyBuffer(MemoryBatch batch, const Buffer& sourceBuffer, const Buffer& destinationBuffer, const std::vector<BufferCopy>& copies) = 0;
+    
     /// Starts any pending uploads.
     ///
     /// \warning A MemoryBatch can only be used once per frame. MemoryBatch::Instant must never be used when calling this function.
@@ -342,6 +351,26 @@ public:
     PipelineBindPoint bindPoint;
 };
 
+/// Identifies the device and the driver that created the pipeline cache data. The data can only be reused if all
+/// values match.
+class PipelineCacheIdentity {
+public:
+    PipelineCacheIdentity() : vendorID(0), deviceID(0), driverVersion(0), cacheUUID() {}
+    
+    bool operator==(const PipelineCacheIdentity& other) const {
+        return vendorID == other.vendorID && deviceID == other.deviceID && driverVersion == other.driverVersion && cacheUUID == other.cacheUUID;
+    }
+    
+    bool operator!=(const PipelineCacheIdentity& other) const {
+        return !(*this == other);
+    }
+    
+    std::uint32_t vendorID;
+    std::uint32_t deviceID;
+    std::uint32_t driverVersion;
+    std::array<std::uint8_t, 16> cacheUUID;
+};
+
 class ColorBlendAttachmentState {
 public:
     ColorBlendAttachmentState() : blendEnable(false), srcColorBlendFactor(BlendFactor::One), dstColorBlendFactor(BlendFactor::Zero), srcAlphaBlendFactor(BlendFactor::One), 
@@ -630,6 +659,8 @@ public:
     PipelineLayoutHnd layout;
     RenderPassHnd renderPass;
     std::uint32_t subpass;
+    /// If not valid, the main pipeline cache of the GraphicsAPI is used
+    PipelineCacheHnd pipelineCache;
 };
 
 class ComputePipelineCreateInfo {
@@ -638,6 +669,8 @@ public:
     // TODO flags, base pipeline
     PipelineShadersInfo shader;
     PipelineLayoutHnd layout;
+    /// If not valid, the main pipeline cache of the GraphicsAPI is used
+    PipelineCacheHnd pipelineCache;
 };
 
 class CommandBufferInheritanceInfo {
@@ -913,7 +946,21 @@ public:
     
     virtual void copyImageToBuffer(const Image& srcImage, ImageLayout layout, const Buffer& dstBuffer, const std::vector<BufferImageCopy>& regions) = 0;
     
+    /// \brief Executes the commands recorded into secondary command buffers.
+    ///
+    /// Can only be called on primary command buffers. If a render pass is active, the current subpass must have
+    /// been started with SubpassContents::SecondaryCommandBuffers and the secondary buffers must have been begun
+    /// with CommandBufferUsageFlagBits::RenderPassContinue.
+    ///
+    /// \warning The state (bound pipeline, buffers, dynamic state, etc.) of this command buffer is undefined after
+    /// this call.
+    virtual void executeCommands(std::uint32_t count, CommandBuffer* const* buffers) = 0;
+    
     virtual CommandBufferHnd getHandle() = 0;
+    
+    inline BufferLevel getLevel() const {
+        return level;
+    }
 //    static void beginAll(const std::vector<CommandBuffer*> cmdBuffs) {
 //        
 //    }
@@ -1003,6 +1050,24 @@ public:
     virtual Pipeline createPipeline(const ComputePipelineCreateInfo& info, const char* name) = 0;
     virtual bool destroyPipeline(const Pipeline& pipeline) = 0;
     
+    /// \return The identity of the device and the driver that pipeline cache data must match to be reused.
+    virtual PipelineCacheIdentity getPipelineCacheIdentity() const = 0;
+    
+    /// \brief Create a pipeline cache, optionally seeded with data that was retrieved using getPipelineCacheData().
+    ///
+    /// Invalid or incompatible initial data is ignored by the drivers and an empty cache is created instead.
+    virtual PipelineCacheHnd createPipelineCache(const void* initialData, std::size_t byteCount, const char* name) = 0;
+    virtual bool destroyPipelineCache(PipelineCacheHnd handle) = 0;
+    virtual std::vector<std::uint8_t> getPipelineCacheData(PipelineCacheHnd handle) = 0;
+    
+    /// The pipeline cache that is used by all pipelines that don't specify a different one. Its contents are saved to
+    /// getPipelineCachePath() when the GraphicsAPI is disposed and loaded back during the next initialization.
+    virtual PipelineCacheHnd getMainPipelineCache() const = 0;
+    
+    /// \return A path in the preference directory that is unique for the identity or an empty path if there's no
+    /// preference directory.
+    Path getPipelineCachePath(const PipelineCacheIdentity& identity) const;
+    
     virtual PipelineLayoutHnd createPipelineLayout(const PipelineLayoutCreateInfo& info, const char* name) = 0;
     virtual bool destroyPipelineLayout(PipelineLayoutHnd handle) = 0;
     virtual DescriptorSetLayoutHnd createDescriptorSetLayout(const DescriptorSetLayoutCreateInfo& info, const char* name) = 0;
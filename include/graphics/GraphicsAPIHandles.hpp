@@ -72,6 +72,7 @@ IYF_MAKE_GRAPHICS_API_HANDLE(ShaderHnd)
 IYF_MAKE_GRAPHICS_API_HANDLE(PipelineLayoutHnd)
 IYF_MAKE_GRAPHICS_API_HANDLE(RenderPassHnd)
 IYF_MAKE_GRAPHICS_API_HANDLE(PipelineHnd)
+IYF_MAKE_GRAPHICS_API_HANDLE(PipelineCacheHnd)
 IYF_MAKE_GRAPHICS_API_HANDLE(DescriptorSetHnd)
 IYF_MAKE_GRAPHICS_API_HANDLE(SamplerHnd)
 IYF_MAKE_GRAPHICS_API_HANDLE(DescriptorPoolHnd)
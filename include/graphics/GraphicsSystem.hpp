@@ -35,7 +35,10 @@
 #include "graphics/LightComponent.hpp"
 #include "graphics/GraphicsAPI.hpp" // TODO maybe separate objects created by the API (e.g. buffers) from API for faster compilation times
 #include "graphics/culling/Frustum.hpp"
+#include "graphics/culling/SpatialIndex.hpp"
 #include "graphics/RenderDataKey.hpp"
+#include "graphics/LODSelection.hpp"
+#include "utilities/RadixSort.hpp"
 #include "core/ChunkedComponentVector.hpp"
 
 namespace iyf {
@@ -44,24 +47,58 @@ class Camera;
 class Skybox;
 
 using ChunkedMeshVector = ChunkedComponentVector<MeshComponent>;
+using ChunkedLightVector = ChunkedComponentVector<LightComponent>;
 
 class GraphicsSystem : public System {
 public:
     struct DrawingListElement {
         std::uint32_t componentID;
+        /// Distance from the near plane. Only computed for transparent meshes.
+        float depth;
         RenderDataKey key;
+        /// The detail level of the mesh that should be drawn. Picked after culling.
+        std::uint8_t lod = 0;
         
         inline bool operator<(const DrawingListElement& other) const {
             return key < other.key;
         }
     };
     
+    /// Opaque meshes are sorted by state to minimize state changes
+    struct OpaqueSortKey {
+        inline std::uint64_t operator()(const DrawingListElement& element) const {
+            return element.key.getKey();
+        }
+    };
+    
+    /// Transparent meshes need to be drawn back to front
+    struct TransparentSortKey {
+        inline std::uint64_t operator()(const DrawingListElement& element) const {
+            return element.key.getBackToFrontKey(element.depth);
+        }
+    };
+    
+    struct DrawingListElementID {
+        inline std::uint32_t operator()(const DrawingListElement& element) const {
+            return element.componentID;
+        }
+    };
+    
     struct VisibleComponents {
         void reset();
         void sort();
         
         std::vector<DrawingListElement> opaqueMeshEntityIDs;
         std::vector<DrawingListElement> transparentMeshEntityIDs;
+        
+        /// All point and spot lights of the World, gathered every frame. Capped at con::MaxPointLights and
+        /// con::MaxSpotLights, which is how many lights the shaders can read. The rest are dropped with a warning.
+        std::vector<PointLight> pointLights;
+        std::vector<SpotLight> spotLights;
+        
+        /// The lists barely change between frames, so the sorters reuse the previous order
+        util::CoherentRadixSorter<DrawingListElement, OpaqueSortKey, DrawingListElementID> opaqueSorter;
+        util::CoherentRadixSorter<DrawingListElement, TransparentSortKey, DrawingListElementID> transparentSorter;
     };
     
     GraphicsSystem(EntitySystemManager* manager, GraphicsAPI* api);
@@ -81,6 +118,11 @@ public:
     virtual void postDetach(Component& component, std::uint32_t id) final override;
     
     virtual void update(float delta, const EntityStateVector& entityStates) final override;
+    
+    /// Splits the update into a camera update, culling and draw recording. Only culling can run on the workers because
+    /// the other two need the input state and the graphics API.
+    virtual void declareJobs(TaskGraph& graph, const EntityStateVector& entityStates) final override;
+    
     virtual void collectGarbage(GarbageCollectionRunPolicy) final override {
         // This class does not have garbage that neesds to be collected
     }
@@ -126,6 +168,10 @@ public:
         return *(dynamic_cast<const ChunkedMeshVector*>(getContainer(static_cast<std::size_t>(GraphicsComponent::Mesh))));
     }
     
+    inline const ChunkedLightVector& getLightComponents() const {
+        return *(dynamic_cast<const ChunkedLightVector*>(getContainer(static_cast<std::size_t>(GraphicsComponent::Light))));
+    }
+    
     inline const Skybox* getSkybox() const {
         return skybox.get();
     }
@@ -136,9 +182,60 @@ public:
         return visibleComponents;
     }
     
+    /// Called by MeshComponent objects when they get attached or their transformation changes
+    void onMeshBoundsChanged(std::uint32_t id, const BoundingVolume& bounds, bool isStatic);
+    
+    /// Called by MeshComponent objects when they get detached
+    void onMeshRemoved(std::uint32_t id);
+    
+    /// Contains the current bounds of all meshes. Can be used for picking and overlap queries.
+    ///
+    /// \warning Only safe to use while the GraphicsSystem isn't updating
+    const SpatialIndex& getSpatialIndex() const {
+        return spatialIndex;
+    }
+    
+    /// If true (default), the SpatialIndex is used for culling. Otherwise, every mesh is tested using the FrustumCuller.
+    void setSpatialIndexCullingEnabled(bool enabled) {
+        spatialIndexCulling = enabled;
+    }
+    
+    bool isSpatialIndexCullingEnabled() const {
+        return spatialIndexCulling;
+    }
+    
+    /// Controls how the detail levels of visible meshes get picked
+    void setLODSelectionSettings(const LODSelectionSettings& settings) {
+        lodSettings = settings;
+    }
+    
+    const LODSelectionSettings& getLODSelectionSettings() const {
+        return lodSettings;
+    }
+    
     bool cameraInputPaused;
 protected:
+    void updateCameras(float delta);
     void performCulling();
+    void drawVisible();
+    
+    /// Returns the distance from the near plane of the frustum to the center of the bounding volume
+    float computeViewDepth(const BoundingVolume& bounds) const;
+    
+    /// Queries the SpatialIndex and sorts the results into opaque and transparent lists
+    void cullWithSpatialIndex();
+    
+    /// Tests the bounds of every mesh using the FrustumCuller and sorts the results into opaque and transparent lists
+    void cullWithFrustumCuller();
+    
+    /// Sorts the meshes of the Entities in visibleIDs into the opaque and transparent lists
+    void addVisibleMeshes();
+    
+    /// Copies the data of every point and spot light into the light lists of the visibleComponents
+    void gatherLights();
+    
+    /// Picks the detail levels of the visible meshes from the projected sizes of their bounding volumes
+    void selectLODs(std::vector<DrawingListElement>& elements);
     
     AssetManager* assetManager;
     GraphicsAPI* api;
@@ -151,6 +248,24 @@ protected:
     
     VisibleComponents visibleComponents;
     
+    SpatialIndex spatialIndex;
+    bool spatialIndexCulling;
+    
+    LODSelectionSettings lodSettings;
+    
+    /// The number of lights that gatherLights() dropped during the previous frame. Used to warn only when it changes.
+    std::size_t droppedLightCount;
+    
+    /// The bounds of all meshes that are tested during brute force culling. Kept up to date by onMeshBoundsChanged()
+    /// and onMeshRemoved() instead of being gathered every frame.
+    FrustumCuller culler;
+    AABBSet meshBounds;
+    /// The ID of the Entity that owns each box of meshBounds
+    std::vector<std::uint32_t> meshBoundsOwners;
+    /// The index of the box of each Entity in meshBounds or EntityKey::InvalidID if the Entity has no mesh
+    std::vector<std::uint32_t> meshBoundsSlots;
+    std::vector<std::uint32_t> visibleIDs;
+    
     std::uint32_t activeCamera;
     bool viewingFromEditorCamera;
     Camera editorCamera;
@@ -0,0 +1,136 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_INSTANCE_BATCHER_HPP
+#define IYF_INSTANCE_BATCHER_HPP
+
+#include "graphics/RenderDataKey.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+
+namespace iyf {
+/// The buffers and index range that a draw uses. Only draws with identical geometry can be merged into a single
+/// instanced draw.
+struct DrawGeometry {
+    std::uint8_t vboID;
+    std::uint8_t iboID;
+    std::uint32_t indexCount;
+    std::uint32_t firstIndex;
+    std::int32_t vertexOffset;
+    
+    inline bool operator==(const DrawGeometry& other) const {
+        return vboID == other.vboID && iboID == other.iboID && indexCount == other.indexCount && firstIndex == other.firstIndex && vertexOffset == other.vertexOffset;
+    }
+    
+    inline bool operator!=(const DrawGeometry& other) const {
+        return !(*this == other);
+    }
+};
+
+/// Per instance data. Stored in a vertex buffer that's bound with VertexInputRate::Instance.
+///
+/// \warning The layout must match the per instance attributes of instancedVertex.vert
+struct InstanceData {
+    glm::mat4 model;
+};
+
+/// A single instanced draw call.
+struct InstancedDrawBatch {
+    /// The RenderDataKey that all instances of this batch share
+    RenderDataKey key;
+    DrawGeometry geometry;
+    /// Index of the first InstanceData element of this batch
+    std::uint32_t firstInstance;
+    std::uint32_t instanceCount;
+};
+
+/// Groups draws that share the same state (RenderDataKey) and geometry into instanced draws.
+///
+/// Draws should be added in RenderDataKey order, i.e., in the order of a sorted draw list. Draws are only merged
+/// within a run of draws with the same key. Within such a run, all draws of the same geometry are merged, even if
+/// they aren't adjacent. Batches are emitted in key order and, within a key, in the order their geometry first
+/// appeared, which means that the state changes of the draw list are preserved.
+///
+/// The instance data of each batch is stored contiguously, ready to be uploaded to the GPU in a single copy.
+class InstanceBatcher {
+public:
+    InstanceBatcher();
+    
+    /// Removes all draws, batches and instance data. Keeps the allocated memory.
+    void clear();
+    
+    /// Adds a draw.
+    ///
+    /// \warning The model matrix is referenced, not copied. It must stay alive and unchanged until finish() returns.
+    void add(RenderDataKey key, const DrawGeometry& geometry, const glm::mat4& model);
+    
+    /// Builds the instance data. Must be called after the last add() and before using getInstanceData().
+    void finish();
+    
+    /// The batches in the order they need to be drawn in.
+    inline const std::vector<InstancedDrawBatch>& getBatches() const {
+        return batches;
+    }
+    
+    /// The instance data of all batches. InstancedDrawBatch::firstInstance indexes into it.
+    inline const std::vector<InstanceData>& getInstanceData() const {
+        return instanceData;
+    }
+    
+    /// The number of draws that were added since the last call to clear().
+    inline std::size_t getDrawCount() const {
+        return pending.size();
+    }
+private:
+    struct GeometryHash {
+        std::size_t operator()(const DrawGeometry& geometry) const;
+    };
+    
+    struct PendingInstance {
+        std::uint32_t batch;
+        const glm::mat4* model;
+    };
+    
+    std::vector<InstancedDrawBatch> batches;
+    std::vector<InstanceData> instanceData;
+    std::vector<PendingInstance> pending;
+    
+    /// Batches of the current key, indexed by geometry
+    std::unordered_map<DrawGeometry, std::uint32_t, GeometryHash> currentKeyBatches;
+    RenderDataKey currentKey;
+    /// Most draw lists contain long runs of the same geometry, which don't need to hit the map
+    std::uint32_t lastBatch;
+    bool finished;
+};
+}
+
+#endif // IYF_INSTANCE_BATCHER_HPP
@@ -0,0 +1,100 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_LOD_SELECTION_HPP
+#define IYF_LOD_SELECTION_HPP
+
+#include "assets/assetTypes/Mesh.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace iyf {
+/// Controls how GraphicsSystem picks the detail levels of meshes
+struct LODSelectionSettings {
+    LODSelectionSettings() : maxPixelError(1.0f), hysteresis(0.25f) {}
+    
+    /// The simplification error of the selected level, projected to the screen, must stay below this many pixels
+    float maxPixelError;
+    
+    /// A fraction of maxPixelError. A coarser level is only picked once its error drops below
+    /// maxPixelError * (1 - hysteresis) and the current level is only dropped for a finer one once its error grows
+    /// above maxPixelError * (1 + hysteresis). This keeps the meshes that sit near a boundary from flickering.
+    float hysteresis;
+};
+
+/// \brief Computes the radius of a bounding sphere on the screen.
+///
+/// \param[in] distance Distance from the camera to the center of the sphere
+/// \param[in] radius The radius of the sphere
+/// \param[in] pixelsPerUnit Half of the render surface height divided by the tangent of half of the vertical field of view
+/// \return The radius in pixels or infinity if the camera is inside the sphere
+inline float ComputeProjectedRadius(float distance, float radius, float pixelsPerUnit) {
+    if (distance <= radius) {
+        return std::numeric_limits<float>::infinity();
+    }
+    
+    return radius / std::sqrt(distance * distance - radius * radius) * pixelsPerUnit;
+}
+
+/// \brief Picks a detail level based on the size of the mesh on the screen.
+///
+/// \param[in] lods The simplified levels of the mesh, starting with level 1. Their errors must increase with the level.
+/// \param[in] lodCount Number of elements in lods
+/// \param[in] projectedRadius Radius of the bounding sphere on the screen, in pixels
+/// \param[in] currentLevel The level that was used during the previous frame. 0 is the full detail level
+/// \param[in] settings Error limits
+/// \return The level that should be used. 0 is the full detail level
+inline std::uint8_t SelectLOD(const MeshLOD* lods, std::uint8_t lodCount, float projectedRadius, std::uint8_t currentLevel,
+                              const LODSelectionSettings& settings) {
+    if (lodCount == 0 || !std::isfinite(projectedRadius)) {
+        return 0;
+    }
+    
+    auto projectedError = [lods, projectedRadius](std::uint8_t level) {
+        return (level == 0) ? 0.0f : lods[level - 1].error * projectedRadius;
+    };
+    
+    std::uint8_t level = (currentLevel > lodCount) ? lodCount : currentLevel;
+    
+    const float finerLimit = settings.maxPixelError * (1.0f + settings.hysteresis);
+    while (level > 0 && projectedError(level) > finerLimit) {
+        level--;
+    }
+    
+    const float coarserLimit = settings.maxPixelError * (1.0f - settings.hysteresis);
+    while (level < lodCount && projectedError(level + 1) <= coarserLimit) {
+        level++;
+    }
+    
+    return level;
+}
+}
+
+#endif // IYF_LOD_SELECTION_HPP
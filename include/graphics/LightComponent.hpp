@@ -44,15 +44,16 @@ public:
     
     void setLightType(LightType lightType);
     
-    inline void toDirectionalLight(DirectionalLight& dirLight) {
+    inline void toDirectionalLight(DirectionalLight& dirLight) const {
         std::memcpy(&dirLight, &light, sizeof(DirectionalLight));
     }
     
-    inline void toSpotLight(SpotLight& spotLight) {
+    inline void toSpotLight(SpotLight& spotLight) const {
         std::memcpy(&spotLight, &light, sizeof(SpotLight));
     }
     
-    inline void toPointLight(SpotLight& pointLight) {
+    /// PointLight matches the beginning of SpotLight
+    inline void toPointLight(PointLight& pointLight) const {
         std::memcpy(&pointLight, &light, sizeof(pointLight));
     }
     
@@ -45,7 +45,7 @@ namespace iyf {
 class MeshComponent : public Component {
 public:
     static constexpr ComponentType Type = ComponentType(ComponentBaseType::Graphics, GraphicsComponent::Mesh);
-    MeshComponent() : Component(ComponentType(ComponentBaseType::Graphics, GraphicsComponent::Mesh)), mesh(AssetHandle<Mesh>::CreateInvalid()), renderMode(MaterialRenderMode::Opaque) { }
+    MeshComponent() : Component(ComponentType(ComponentBaseType::Graphics, GraphicsComponent::Mesh)), mesh(AssetHandle<Mesh>::CreateInvalid()), renderMode(MaterialRenderMode::Opaque), lod(0), parent(nullptr), id(0) { }
     
     virtual ~MeshComponent() { }
     
@@ -85,12 +85,23 @@ public:
     
     inline void setMesh(const AssetHandle<Mesh>& meshData) {
         mesh = meshData;
+        lod = 0;
     }
     
     inline const AssetHandle<Mesh>& getMesh() const {
         return mesh;
     }
     
+    /// \return The detail level that was picked by the GraphicsSystem during the last culling run. 0 is the full detail level
+    inline std::uint8_t getLOD() const {
+        return lod;
+    }
+    
+    /// Used by the GraphicsSystem. The current level is needed to apply hysteresis.
+    inline void setLOD(std::uint8_t level) {
+        lod = level;
+    }
+    
     inline RenderDataKey getRenderDataKey() const {
         return key;
     }
@@ -102,10 +113,11 @@ public:
     
     virtual void attach(System*, std::uint32_t) final override;
     
-    /// We don't need the actual system pointer for this asset type and simply wipe the
-    /// AssetHandle objects to reduce their asset counts
+    /// Wipes the AssetHandle objects to reduce their asset counts and removes the bounds from the
+    /// SpatialIndex of the GraphicsSystem
     virtual void detach(System*, std::uint32_t) final override;
     
+    /// Updates the current bounds and the SpatialIndex of the GraphicsSystem
     virtual void onTransformationChanged(TransformationComponent* transformation) final override;
 protected:
     AssetHandle<Mesh> mesh;
@@ -113,6 +125,10 @@ protected:
     RenderDataKey key;
     BoundingVolume preTransformBounds;
     MaterialRenderMode renderMode;
+    std::uint8_t lod;
+    
+    System* parent;
+    std::uint32_t id;
 };
 }
 
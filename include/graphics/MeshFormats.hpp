@@ -30,9 +30,13 @@
 #define MESHFORMATS_HPP
 
 #include <cstdint>
+#include <type_traits>
+#include <vector>
 #include "core/Constants.hpp"
 
 namespace iyf {
+class Serializer;
+
 namespace mf {
 
 const char MagicNumber[4] = {'I', 'Y', 'F', 'M'};
@@ -47,10 +51,164 @@ const std::uint8_t MaxBonesPerVertex = 4;
 const std::uint8_t MaxAnimations = 64;
 }
 
+/// Version 2 mesh files consist of a fixed size Header, a table of ChunkEntry objects and the chunks themselves.
+///
+/// Every chunk starts at an offset that's a multiple of BlobAlignment, all fields are little endian and the vertex
+/// and index chunks have the exact layout the GPU expects. Therefore, a memory mapped file can be used as is: the
+/// loader only validates the Header and the table, and the vertex and index data can be uploaded straight from the
+/// mapping.
+namespace v2 {
+const std::uint16_t VersionNumber = 2;
+const std::uint32_t BlobAlignment = 16;
+const std::uint8_t MaxSubmeshes = 32;
+const std::uint8_t MaxBones = 255;
+const std::uint8_t MaxTextureChannels = 1;
+const std::uint8_t MaxColorChannels = 1;
+const std::uint8_t MaxBonesPerVertex = 4;
+const std::uint8_t MaxAnimations = 64;
+/// Includes the full detail level, which is described by the SubmeshRecord
+const std::uint8_t MaxLODs = 4;
+
+enum class ChunkType : std::uint32_t {
+    /// An array of SubmeshRecord objects
+    Submeshes = 0,
+    /// Vertex data, ready to be uploaded to the GPU
+    Vertices = 1,
+    /// Index data, ready to be uploaded to the GPU
+    Indices = 2,
+    /// An array of BoneRecord objects
+    Bones = 3,
+    /// An array of 64 bit animation name hashes
+    Animations = 4,
+    /// An array of LodRecord objects. Optional
+    Lods = 5,
+    COUNT
+};
+
+enum HeaderFlagBits : std::uint8_t {
+    Indices32Bit = 0x1
+};
+
+struct Header {
+    char magicNumber[4];
+    std::uint16_t versionNumber;
+    /// A VertexDataLayout value
+    std::uint8_t vertexDataLayout;
+    /// A combination of HeaderFlagBits
+    std::uint8_t flags;
+    std::uint32_t vertexCount;
+    std::uint32_t indexCount;
+    std::uint8_t submeshCount;
+    std::uint8_t boneCount;
+    std::uint8_t colorChannelCount;
+    std::uint8_t animationCount;
+    /// Number of ChunkEntry objects that immediately follow the header
+    std::uint32_t chunkCount;
+    float aabbMinimum[3];
+    float aabbMaximum[3];
+    /// Center and radius
+    float boundingSphere[4];
+};
+
+struct ChunkEntry {
+    ChunkType type;
+    std::uint32_t elementCount;
+    /// Offset from the start of the file, in bytes
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+struct SubmeshRecord {
+    /// Offset into the vertex chunk, in vertices
+    std::uint32_t vertexOffset;
+    std::uint32_t vertexCount;
+    /// Offset into the index chunk, in indices
+    std::uint32_t indexOffset;
+    std::uint32_t indexCount;
+};
+
+struct BoneRecord {
+    /// Column major
+    float transform[16];
+    std::uint8_t parent;
+    std::uint8_t padding[3];
+};
+
+/// A simplified version of a submesh. It reuses the vertices of the submesh, only the indices are different.
+struct LodRecord {
+    /// Offset into the index chunk, in indices. The indices of all detail levels follow the ones that the
+    /// SubmeshRecord objects point to.
+    std::uint32_t indexOffset;
+    std::uint32_t indexCount;
+    /// Simplification error relative to the radius of the bounding sphere of the whole mesh
+    float error;
+    std::uint8_t submesh;
+    /// 1 is the first simplified level. Levels of a submesh are stored in order
+    std::uint8_t level;
+    std::uint8_t padding[2];
+};
+
+static_assert(sizeof(Header) == 64 && std::is_trivially_copyable_v<Header>, "Unexpected mf::v2::Header layout");
+static_assert(sizeof(ChunkEntry) == 24 && std::is_trivially_copyable_v<ChunkEntry>, "Unexpected mf::v2::ChunkEntry layout");
+static_assert(sizeof(SubmeshRecord) == 16 && std::is_trivially_copyable_v<SubmeshRecord>, "Unexpected mf::v2::SubmeshRecord layout");
+static_assert(sizeof(BoneRecord) == 68 && std::is_trivially_copyable_v<BoneRecord>, "Unexpected mf::v2::BoneRecord layout");
+static_assert(sizeof(LodRecord) == 16 && std::is_trivially_copyable_v<LodRecord>, "Unexpected mf::v2::LodRecord layout");
+
+/// Everything that gets written to a version 2 mesh file. WriteMesh() fills in the magic number, the version number,
+/// the chunk table and every count in the header, except for the vertex count.
+struct MeshFileContents {
+    MeshFileContents() : header(), vertexData(nullptr), vertexDataSize(0), indexData(nullptr), indexDataSize(0) {}
+    
+    Header header;
+    std::vector<SubmeshRecord> submeshes;
+    const void* vertexData;
+    std::uint64_t vertexDataSize;
+    const void* indexData;
+    std::uint64_t indexDataSize;
+    std::vector<BoneRecord> bones;
+    std::vector<std::uint64_t> animations;
+    std::vector<LodRecord> lods;
+};
+
+/// Writes a version 2 mesh file to the serializer, which is expected to be at position 0.
+void WriteMesh(Serializer& output, const MeshFileContents& contents);
+
+/// Pointers into a version 2 mesh file that's fully resident in memory.
+struct MeshFileView {
+    MeshFileView() : header(), submeshes(nullptr), vertexData(nullptr), vertexDataSize(0), indexData(nullptr), indexDataSize(0), bones(nullptr), animations(nullptr),
+        lods(nullptr), lodCount(0) {}
+    
+    /// A copy, since the file data is not guaranteed to be suitably aligned for direct access
+    Header header;
+    const char* submeshes;
+    const char* vertexData;
+    std::uint64_t vertexDataSize;
+    const char* indexData;
+    std::uint64_t indexDataSize;
+    const char* bones;
+    const char* animations;
+    const char* lods;
+    std::uint32_t lodCount;
+    
+    SubmeshRecord getSubmesh(std::size_t id) const;
+    BoneRecord getBone(std::size_t id) const;
+    std::uint64_t getAnimation(std::size_t id) const;
+    LodRecord getLod(std::size_t id) const;
+};
+
+/// Validates the header and the chunk table of a version 2 mesh file and fills the view with pointers into the data.
+///
+/// \return false if the data is not a valid version 2 mesh file
+bool ParseMesh(const char* data, std::size_t size, MeshFileView& view);
+}
+
 }
 
 static_assert(con::MaxSubMeshes >= mf::v1::MaxSubmeshes, "mf::v1 submesh limit is above the engine's maximum limit.");
 static_assert(con::MaxAnimations >= mf::v1::MaxAnimations, "mf::v1 animation limit is above the engine's maximum limit.");
+static_assert(con::MaxSubMeshes >= mf::v2::MaxSubmeshes, "mf::v2 submesh limit is above the engine's maximum limit.");
+static_assert(con::MaxAnimations >= mf::v2::MaxAnimations, "mf::v2 animation limit is above the engine's maximum limit.");
+static_assert(con::MaxMeshLODs >= mf::v2::MaxLODs, "mf::v2 LOD limit is above the engine's maximum limit.");
 
 namespace af {
 const char MagicNumber[4] = {'I', 'Y', 'F', 'A'};
@@ -0,0 +1,142 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_MESH_OPTIMIZER_HPP
+#define IYF_MESH_OPTIMIZER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace iyf {
+/// The FIFO size that the optimizations target and the statistics are computed for by default. Post transform caches of
+/// modern GPUs don't behave like simple FIFOs, but meshes that are good for a FIFO of this size work well on them too.
+constexpr std::uint32_t DefaultVertexCacheSize = 16;
+
+/// Post transform vertex cache statistics of an index buffer
+struct VertexCacheStatistics {
+    VertexCacheStatistics() : vertexTransforms(0), acmr(0.0f), atvr(0.0f) {}
+    
+    /// Number of vertex shader invocations
+    std::size_t vertexTransforms;
+    /// Average cache miss ratio, i.e., transformed vertices per triangle. 0.5 is the theoretical minimum and 3.0 the
+    /// maximum.
+    float acmr;
+    /// Average transform to vertex ratio, i.e., transformed vertices per referenced vertex. 1.0 is the minimum.
+    float atvr;
+};
+
+/// Simulates a FIFO post transform cache of the specified size.
+VertexCacheStatistics AnalyzeVertexCache(const std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount,
+                                         std::uint32_t cacheSize = DefaultVertexCacheSize);
+
+/// \brief Reorders the triangles to improve post transform vertex cache efficiency.
+///
+/// Uses Tipsify from "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" by Sander, Nehab and Barczak.
+/// It runs in linear time and does not depend on the exact size of the cache.
+///
+/// \param[out] destination Reordered indices. Must not overlap with indices
+/// \param[in] indices Triangle list indices
+/// \param[in] indexCount Number of indices. Must be divisible by 3
+/// \param[in] vertexCount Number of vertices. All indices must be smaller than this
+/// \param[in] cacheSize The FIFO size to target
+/// \param[out] clusters If not nullptr, receives the first triangle of every cluster that starts with a cold cache.
+/// These clusters can be reordered by OptimizeOverdraw()
+void OptimizeVertexCache(std::uint32_t* destination, const std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount,
+                         std::uint32_t cacheSize = DefaultVertexCacheSize, std::vector<std::uint32_t>* clusters = nullptr);
+
+/// \brief Reorders clusters of triangles in order to draw the ones that are likely to occlude others first.
+///
+/// The clusters produced by OptimizeVertexCache() are split further wherever that does not increase the ACMR of the
+/// cluster by more than threshold times. The resulting clusters get sorted by how much they face away from the
+/// center of the mesh, just like described in the paper mentioned in OptimizeVertexCache() docs.
+///
+/// \param[out] destination Reordered indices. Must not overlap with indices
+/// \param[in] indices Indices that were optimized by OptimizeVertexCache()
+/// \param[in] indexCount Number of indices. Must be divisible by 3
+/// \param[in] positions Vertex positions, 3 floats each
+/// \param[in] positionStride Distance between positions of two consecutive vertices, in bytes
+/// \param[in] vertexCount Number of vertices. All indices must be smaller than this
+/// \param[in] clusters Clusters that were produced by OptimizeVertexCache()
+/// \param[in] cacheSize The FIFO size that was passed to OptimizeVertexCache()
+/// \param[in] threshold How much the ACMR may be worsened to get finer clusters. 1.0 keeps the ACMR
+/// \return The number of clusters that were sorted
+std::size_t OptimizeOverdraw(std::uint32_t* destination, const std::uint32_t* indices, std::size_t indexCount, const void* positions,
+                      std::size_t positionStride, std::size_t vertexCount, const std::vector<std::uint32_t>& clusters,
+                      std::uint32_t cacheSize = DefaultVertexCacheSize, float threshold = 1.05f);
+
+/// \brief Reorders the vertices in the order of their first use by the index buffer and updates the indices.
+///
+/// This makes vertex fetches more cache friendly. Vertices that are not referenced by any index are dropped.
+///
+/// \param[out] destination Reordered vertices. Must have room for vertexCount vertices and must not overlap with vertices
+/// \param[in,out] indices Index buffer to remap
+/// \param[in] indexCount Number of indices
+/// \param[in] vertices Vertex data
+/// \param[in] vertexCount Number of vertices. All indices must be smaller than this
+/// \param[in] vertexSize Size of a single vertex, in bytes
+/// \return The number of vertices that were written to destination
+std::size_t OptimizeVertexFetch(void* destination, std::uint32_t* indices, std::size_t indexCount, const void* vertices,
+                                std::size_t vertexCount, std::size_t vertexSize);
+
+/// Selects the optimizations that OptimizeMesh() runs
+struct MeshOptimizationSettings {
+    MeshOptimizationSettings() : optimizeVertexCache(true), optimizeOverdraw(true), optimizeVertexFetch(true),
+        vertexCacheSize(DefaultVertexCacheSize), overdrawThreshold(1.05f) {}
+    
+    bool optimizeVertexCache;
+    /// Only used if optimizeVertexCache is true
+    bool optimizeOverdraw;
+    bool optimizeVertexFetch;
+    std::uint32_t vertexCacheSize;
+    float overdrawThreshold;
+};
+
+/// Vertex cache statistics before and after OptimizeMesh()
+struct MeshOptimizationReport {
+    MeshOptimizationReport() : clusterCount(0), removedVertexCount(0) {}
+    
+    VertexCacheStatistics before;
+    VertexCacheStatistics after;
+    /// Number of clusters sorted by the overdraw optimization
+    std::size_t clusterCount;
+    /// Number of unreferenced vertices dropped by the fetch optimization
+    std::size_t removedVertexCount;
+};
+
+/// \brief Runs the optimizations enabled in settings on a single triangle list mesh, in place.
+///
+/// \param[in,out] vertices Vertex data. It may shrink if the fetch optimization drops unused vertices
+/// \param[in] vertexSize Size of a single vertex, in bytes. The vertex must start with a position made of 3 floats
+/// \param[in,out] indices Triangle list indices
+/// \param[in] settings Optimizations to run
+MeshOptimizationReport OptimizeMesh(std::vector<char>& vertices, std::size_t vertexSize, std::vector<std::uint32_t>& indices,
+                                    const MeshOptimizationSettings& settings);
+}
+
+#endif // IYF_MESH_OPTIMIZER_HPP
@@ -0,0 +1,96 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_MESH_SIMPLIFIER_HPP
+#define IYF_MESH_SIMPLIFIER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace iyf {
+/// \brief Reduces the number of triangles of a mesh without creating new vertices.
+///
+/// Uses the quadric error metric from "Surface Simplification Using Quadric Error Metrics" by Garland and Heckbert.
+/// Edges are collapsed into one of their existing vertices, so the simplified indices can be used with the original
+/// vertex buffer. Vertices on open borders may only slide along the border. Vertices that share their position with
+/// other vertices (e.g., UV seams) and vertices of non-manifold edges are never moved.
+///
+/// \param[out] destination Simplified indices. Cleared before use
+/// \param[in] indices Triangle list indices
+/// \param[in] indexCount Number of indices. Must be divisible by 3
+/// \param[in] positions Vertex positions, 3 floats each
+/// \param[in] positionStride Distance between positions of two consecutive vertices, in bytes
+/// \param[in] vertexCount Number of vertices. All indices must be smaller than this
+/// \param[in] targetIndexCount Simplification stops once the index count drops to or below this value
+/// \param[in] targetError Simplification stops before a collapse would make the error larger than this, in the same
+/// units as the positions
+/// \return The error of the simplified mesh, in the same units as the positions. It is the square root of the area
+/// weighted mean squared distance to the planes of the original triangles that were merged into each vertex.
+float SimplifyMesh(std::vector<std::uint32_t>& destination, const std::uint32_t* indices, std::size_t indexCount, const void* positions,
+                   std::size_t positionStride, std::size_t vertexCount, std::size_t targetIndexCount, float targetError);
+
+/// Controls GenerateLODs()
+struct LODGenerationSettings {
+    LODGenerationSettings() : generateLODs(true), lodCount(3), reductionFactor(0.5f), maxError(0.05f) {}
+    
+    bool generateLODs;
+    /// Number of simplified levels to generate. The full detail level is not included
+    std::uint8_t lodCount;
+    /// Each level targets this fraction of the triangles of the previous one
+    float reductionFactor;
+    /// Relative to the radius of the bounding sphere. Levels that can't be reduced enough without exceeding this
+    /// error are not generated
+    float maxError;
+};
+
+/// A simplified detail level generated by GenerateLODs()
+struct GeneratedLOD {
+    std::vector<std::uint32_t> indices;
+    /// Relative to the radius of the bounding sphere
+    float error;
+};
+
+/// \brief Builds a chain of simplified detail levels with SimplifyMesh().
+///
+/// Every level is simplified from the full detail mesh in order to avoid accumulating errors. The errors of the
+/// returned levels never decrease. Generation stops early when a level can't remove at least a quarter of the
+/// triangles of the previous one without exceeding settings.maxError.
+///
+/// \param[in] indices Triangle list indices
+/// \param[in] indexCount Number of indices. Must be divisible by 3
+/// \param[in] positions Vertex positions, 3 floats each
+/// \param[in] positionStride Distance between positions of two consecutive vertices, in bytes
+/// \param[in] vertexCount Number of vertices. All indices must be smaller than this
+/// \param[in] radius Radius of the bounding sphere of the mesh that the errors are relative to
+/// \param[in] settings Level count and error limits
+std::vector<GeneratedLOD> GenerateLODs(const std::uint32_t* indices, std::size_t indexCount, const void* positions, std::size_t positionStride,
+                                       std::size_t vertexCount, float radius, const LODGenerationSettings& settings);
+}
+
+#endif // IYF_MESH_SIMPLIFIER_HPP
@@ -0,0 +1,118 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_PARALLEL_COMMAND_RECORDER_HPP
+#define IYF_PARALLEL_COMMAND_RECORDER_HPP
+
+#include "graphics/GraphicsAPI.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace iyft {
+class ThreadPool;
+}
+
+namespace iyf {
+/// Splits a long list of items (e.g., visible meshes) into contiguous chunks and records each chunk into its own
+/// secondary command buffer on a different thread.
+///
+/// Command pools are externally synchronized, which means that buffers of the same pool can't be recorded on
+/// several threads at once. Because of that, every recording slot has a CommandPool of its own. Each slot owns one
+/// secondary buffer per swap image, so buffers that the GPU may still be executing are never re-recorded.
+///
+/// Once recording is done, executeRecorded() executes the secondary buffers from a primary buffer in the order of
+/// the items.
+class ParallelCommandRecorder : private NonCopyable {
+public:
+    /// Chunks with fewer items than this aren't worth the overhead of an extra secondary buffer and a task.
+    static constexpr std::size_t MinChunkSize = 256;
+    
+    /// Records the items in [first, last) into the buffer. The buffer has already been begun. The function must
+    /// set all state it needs (pipeline, viewport, scissor, vertex and index buffers) because secondary command
+    /// buffers don't inherit it from the primary buffer.
+    using RecordFunction = std::function<void(CommandBuffer* buffer, std::size_t first, std::size_t last)>;
+    
+    ParallelCommandRecorder();
+    ~ParallelCommandRecorder();
+    
+    /// Allocates the secondary buffers.
+    ///
+    /// \param pools One CommandPool for every recording slot. Typically, the worker count of the used iyft::ThreadPool
+    /// plus one for the calling thread. The pools are not owned by this object and must outlive it (or the
+    /// call to dispose()).
+    /// \param swapImageCount The number of swap images.
+    /// \param name A name that will be used to name the secondary buffers.
+    void initialize(std::vector<CommandPool*> pools, std::size_t swapImageCount, const std::string& name);
+    
+    /// Frees the secondary buffers.
+    void dispose();
+    
+    inline bool isInitialized() const {
+        return !pools.empty();
+    }
+    
+    /// The maximum number of secondary buffers that a single call to record() may use.
+    inline std::size_t getSlotCount() const {
+        return pools.size();
+    }
+    
+    /// Checks if recording itemCount items in parallel is worthwhile.
+    bool shouldRecordInParallel(std::size_t itemCount, const iyft::ThreadPool* threadPool) const;
+    
+    /// Records the items into secondary buffers. The calling thread records some of the chunks itself and, if it's a
+    /// worker of threadPool, the work is distributed among the remaining workers only.
+    ///
+    /// \param itemCount The number of items to record.
+    /// \param swapImage The index of the current swap image.
+    /// \param inheritance The render pass, subpass and framebuffer that the secondary buffers will be executed in.
+    /// \param threadPool The pool to run the helper tasks on. If it's nullptr, all chunks are recorded on the
+    /// calling thread, which is still useful for testing.
+    /// \param function The function that records the commands.
+    /// \return The number of secondary buffers that were recorded.
+    ///
+    /// \throws Rethrows the first exception that was thrown by function once the chunks that were running have
+    /// finished. Nothing is recorded in that case.
+    std::size_t record(std::size_t itemCount, std::size_t swapImage, const CommandBufferInheritanceInfo& inheritance, iyft::ThreadPool* threadPool, const RecordFunction& function);
+    
+    /// Executes the secondary buffers that were recorded by the last call to record().
+    void executeRecorded(CommandBuffer* primary) const;
+    
+    /// The secondary buffers that were recorded by the last call to record(), in item order.
+    inline const std::vector<CommandBuffer*>& getRecordedBuffers() const {
+        return recordedBuffers;
+    }
+private:
+    std::vector<CommandPool*> pools;
+    /// Secondary buffers. Index is swapImage * slotCount + slot
+    std::vector<CommandBuffer*> buffers;
+    std::vector<CommandBuffer*> recordedBuffers;
+};
+}
+
+#endif // IYF_PARALLEL_COMMAND_RECORDER_HPP
@@ -0,0 +1,73 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_PIPELINE_CACHE_STORE_HPP
+#define IYF_PIPELINE_CACHE_STORE_HPP
+
+#include "graphics/GraphicsAPI.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace iyf {
+class FileSystem;
+
+/// Saves and loads the data of pipeline caches between runs.
+///
+/// The driver specific data is wrapped in a header that stores the PipelineCacheIdentity of the device and the driver
+/// that produced it. A checksum of the contents is stored at the end of the file. Data that was produced by a different
+/// device or driver, as well as truncated or corrupt files, is never passed to the driver.
+class PipelineCacheStore {
+public:
+    static constexpr std::uint32_t Magic = 0x43504649; // "IFPC"
+    static constexpr std::uint16_t Version = 1;
+    
+    /// Different devices and drivers need to use different files. Otherwise, systems with multiple GPUs would keep
+    /// replacing the data of one with the data of the other.
+    ///
+    /// \return A file name that is unique for the identity.
+    static std::string MakeFileName(const PipelineCacheIdentity& identity);
+    
+    /// Loads the data that was saved by a device and a driver with a matching identity.
+    ///
+    /// Missing, corrupt and outdated files are ignored.
+    ///
+    /// \return true if the data was loaded
+    static bool Load(const FileSystem& filesystem, const Path& path, const PipelineCacheIdentity& identity, std::vector<std::uint8_t>& data);
+    
+    /// Writes the data to a temporary file first and then renames it to make sure that an interrupted write can't leave
+    /// a truncated file behind.
+    ///
+    /// \return true if the data was written
+    static bool Save(const FileSystem& filesystem, const Path& path, const PipelineCacheIdentity& identity, const void* data, std::size_t byteCount);
+};
+
+}
+
+#endif // IYF_PIPELINE_CACHE_STORE_HPP
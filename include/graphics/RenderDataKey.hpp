@@ -29,6 +29,10 @@
 #ifndef RENDERDATAKEY_HPP
 #define RENDERDATAKEY_HPP
 
+#include <cstdint>
+
+#include "utilities/IntegerPacking.hpp"
+
 namespace iyf {
 template <typename T>
 class IDType {
@@ -123,6 +127,12 @@ public:
         return MaterialID(key >> 8);
     }
     
+    /// Transparent objects need to be drawn back to front. The returned key sorts by decreasing view depth first and
+    /// uses the most significant state bits (pipeline and buffers) to break ties.
+    inline std::uint64_t getBackToFrontKey(float viewDepth) const {
+        return (std::uint64_t(~util::FloatToOrderedInt32(viewDepth)) << 32) | (key >> 32);
+    }
+    
     inline bool operator<(const RenderDataKey& other) const {
         return key < other.key;
     }
@@ -39,6 +39,7 @@
 
 #include <initializer_list>
 #include <future>
+#include <memory>
 
 namespace iyf {
 class World;
@@ -48,6 +49,7 @@ class Skybox;
 class Camera;
 class DebugRenderer;
 class RendererProperties;
+class AsyncPipelineCompiler;
 
 /// \warning All derived classes should be friends with Engine and their constructors should be protected to ensure
 /// they are not constructed in inappropriate places.
@@ -104,6 +106,20 @@ public:
         return gfx;
     }
     
+    /// Pipelines that are requested here are created on the long term worker threads. Draws that need a pipeline that
+    /// isn't ready yet should use getDefaultPipeline() instead of waiting for it.
+    ///
+    /// \warning The returned pointer is only valid between initialize() and dispose(). All pipelines that were created
+    /// by the compiler are destroyed in dispose().
+    AsyncPipelineCompiler* getPipelineCompiler() const {
+        return pipelineCompiler.get();
+    }
+    
+    /// \return A pipeline that any mesh with the VertexDataLayout::MeshVertex layout can be drawn with.
+    ///
+    /// \warning The returned value will only be valid after initialize() successfully completes.
+    virtual const Pipeline& getDefaultPipeline() const = 0;
+    
     /// If isPickingEnabled() is true, this function fetches the data from the ID buffer and pushes it to
     /// all std::future objects that were retrieved from getHoveredItemID().
     ///
@@ -162,6 +178,7 @@ protected:
     
     Engine* engine;
     GraphicsAPI* gfx;
+    std::unique_ptr<AsyncPipelineCompiler> pipelineCompiler;
     bool imGuiSubmissionRequired;
     bool drawingWorldThisFrame;
     bool pickingEnabled;
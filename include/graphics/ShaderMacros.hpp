@@ -96,6 +96,10 @@ public:
     /// Empty constructor that set a special value CUSTOM
     ShaderMacroWithValue() : ShaderMacroWithValue("CUSTOM") {}
     
+    /// Custom macros own their names, so copies need to duplicate them
+    ShaderMacroWithValue(const ShaderMacroWithValue& other);
+    ShaderMacroWithValue& operator=(const ShaderMacroWithValue& other);
+    
     ~ShaderMacroWithValue();
     
     inline ShaderMacro getMacroIdentifier() const {
@@ -0,0 +1,149 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_STAGING_RING_ALLOCATOR_HPP
+#define IYF_STAGING_RING_ALLOCATOR_HPP
+
+#include <cstdint>
+#include <deque>
+
+namespace iyf {
+/// Sub-allocates a staging buffer as a ring, which lets uploads run asynchronously without waiting for the GPU.
+///
+/// Allocations are grouped into submissions. Every submission is associated with a fence (an opaque ID that only the
+/// caller understands) and its memory is reclaimed once that fence gets signaled. Since the memory is handed out in
+/// submission order, it must also be reclaimed in submission order. reclaim() stops at the first submission that
+/// hasn't completed yet, even if some of the newer ones have.
+///
+/// The allocator never touches any API objects, so it can be used with simulated fences.
+class StagingRingAllocator {
+public:
+    /// Returned by allocate() if the allocation didn't fit.
+    static constexpr std::uint64_t InvalidOffset = ~static_cast<std::uint64_t>(0);
+    
+    explicit StagingRingAllocator(std::uint64_t capacity = 0);
+    
+    /// Changes the capacity. All memory must have been reclaimed before calling this.
+    ///
+    /// \throws std::logic_error if any memory is still in use.
+    void reset(std::uint64_t capacity);
+    
+    /// Checks if allocate() would succeed without changing anything.
+    bool canAllocate(std::uint64_t size, std::uint64_t alignment) const;
+    
+    /// Allocates a contiguous block of memory. Allocations that don't fit before the end of the ring wrap around to its
+    /// start and the skipped bytes stay in use until the submission gets reclaimed.
+    ///
+    /// \param[in] size The size of the block. Must be greater than 0.
+    /// \param[in] alignment The alignment of the offset. Doesn't need to be a power of two, but must be greater than 0.
+    ///
+    /// \return The offset of the block or InvalidOffset if it didn't fit.
+    std::uint64_t allocate(std::uint64_t size, std::uint64_t alignment);
+    
+    /// Closes the current submission. All memory that was allocated since the previous call will be reclaimed once
+    /// fenceID gets signaled. Empty submissions are allowed.
+    void submit(std::uint64_t fenceID);
+    
+    /// Reclaims the memory of completed submissions, oldest first.
+    ///
+    /// \param[in] isSignaled A callable that takes a fence ID and returns true if the fence has been signaled.
+    ///
+    /// \return The number of reclaimed submissions
+    template <typename T>
+    std::size_t reclaim(T&& isSignaled) {
+        std::size_t reclaimed = 0;
+        
+        while (!submissions.empty() && isSignaled(submissions.front().fenceID)) {
+            releaseOldest();
+            reclaimed++;
+        }
+        
+        return reclaimed;
+    }
+    
+    /// Reclaims the oldest submission without checking its fence. Used after waiting for the fence.
+    ///
+    /// \return false if there were no submissions
+    bool reclaimOldest() {
+        if (submissions.empty()) {
+            return false;
+        }
+        
+        releaseOldest();
+        return true;
+    }
+    
+    /// \return The fence ID of the oldest submission that hasn't been reclaimed yet. Must not be called if there are
+    /// no pending submissions.
+    inline std::uint64_t getOldestFenceID() const {
+        return submissions.front().fenceID;
+    }
+    
+    inline std::size_t getPendingSubmissionCount() const {
+        return submissions.size();
+    }
+    
+    inline std::uint64_t getCapacity() const {
+        return capacity;
+    }
+    
+    /// \return The number of bytes that can't be allocated right now, including the ones that were skipped when wrapping
+    /// around.
+    inline std::uint64_t getUsedSize() const {
+        return used;
+    }
+    
+    /// \return The number of bytes that were allocated since the last call to submit().
+    inline std::uint64_t getOpenSize() const {
+        return used - submittedSize;
+    }
+private:
+    struct Submission {
+        std::uint64_t fenceID;
+        /// Where the tail moves once this submission gets reclaimed
+        std::uint64_t end;
+        /// The number of bytes this submission holds, including padding
+        std::uint64_t size;
+    };
+    
+    bool findOffset(std::uint64_t size, std::uint64_t alignment, std::uint64_t& offset, std::uint64_t& padding) const;
+    void releaseOldest();
+    
+    std::uint64_t capacity;
+    /// Where the next allocation starts
+    std::uint64_t head;
+    /// Start of the oldest block that's still in use
+    std::uint64_t tail;
+    std::uint64_t used;
+    /// The part of used that belongs to submitted work
+    std::uint64_t submittedSize;
+    std::deque<Submission> submissions;
+};
+}
+
+#endif // IYF_STAGING_RING_ALLOCATOR_HPP
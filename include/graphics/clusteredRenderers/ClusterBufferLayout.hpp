@@ -0,0 +1,66 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_CLUSTER_BUFFER_LAYOUT_HPP
+#define IYF_CLUSTER_BUFFER_LAYOUT_HPP
+
+#include "graphics/clusteredRenderers/ClusteredRendererConstants.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace iyf {
+/// The lights that affect a single cluster.
+///
+/// \warning The layout must match the ClusterDataBuffer that ClusteredRendererProperties::makeRenderDataSet() generates
+struct Cluster {
+    /// Index of the first light ID of this cluster in ClusterData::lightIDs
+    std::uint32_t offset;
+    /// The number of point lights in the lower 16 bits and the number of spot lights in the upper 16 bits. The point
+    /// light IDs are stored first.
+    std::uint32_t lightCounts;
+};
+
+static_assert(sizeof(Cluster) == 8, "Cluster must match its std430 layout");
+
+struct ClusterData {
+    /// Constants that map gl_FragCoord and the view space depth to a cluster. See LightClusterer::getGridParameters()
+    ///
+    /// \remark All zeros if the lights weren't clustered this frame. The shaders loop over every light in that case.
+    float gridParameters[4];
+    Cluster clusters[MaxClusters];
+    std::uint32_t lightIDs[MaxLightIDs];
+};
+
+/// Size of the part of ClusterData that precedes the light IDs
+constexpr std::size_t ClusterDataHeaderSize = sizeof(float) * 4 + sizeof(Cluster) * MaxClusters;
+
+static_assert(offsetof(ClusterData, lightIDs) == ClusterDataHeaderSize, "ClusterData must match its std430 layout");
+}
+
+#endif // IYF_CLUSTER_BUFFER_LAYOUT_HPP
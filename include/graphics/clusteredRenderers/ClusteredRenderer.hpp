@@ -30,13 +30,21 @@
 #define CLUSTEREDRENDERER_HPP
 
 #include "graphics/Renderer.hpp"
+#include "graphics/InstanceBatcher.hpp"
+#include "graphics/ParallelCommandRecorder.hpp"
+#include "graphics/clusteredRenderers/ClusterBufferLayout.hpp"
+#include "graphics/clusteredRenderers/LightClusterer.hpp"
 #include "assets/AssetHandle.hpp"
 
+#include <memory>
 #include <mutex>
 #include <queue>
 
 namespace iyf {
 class Shader;
+class Camera;
+struct PointLight;
+struct SpotLight;
 
 class ClusteredRenderer : public Renderer {
 public:
@@ -59,6 +67,19 @@ public:
     virtual bool isRenderSurfaceSizeDynamic() const final override;
     virtual glm::uvec2 getRenderSurfaceSize() const final override;
     
+    virtual const Pipeline& getDefaultPipeline() const final override;
+    
+    /// Assigns the lights to the clusters of the camera's view frustum and uploads the per cluster light lists of the
+    /// current frame. The IDs in the lists are indices into the pointLights and spotLights vectors, so the shaders
+    /// must receive the lights in the same order. Called by drawWorld() every frame.
+    ///
+    /// \remark Lights can only be clustered if the camera uses the ReverseZ or the ReverseZInfiniteFar mode. If it
+    /// doesn't, or if the cluster data doesn't fit into the upload budget of this frame, the shaders are told to loop
+    /// over every light instead.
+    ///
+    /// \return true if the lights were clustered
+    bool updateLightClusters(const Camera& camera, const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights);
+    
 protected:
     virtual void initializeRenderPasses() final override;
     virtual void initializeFramebuffers() final override;
@@ -74,6 +95,36 @@ protected:
     void initializePickingPipeline();
     void destroyPickingPipeline();
     
+    void initializeParallelRecording();
+    void disposeParallelRecording();
+    
+    void initializeInstancing();
+    void disposeInstancing();
+    
+    void initializeLightClustering();
+    void disposeLightClustering();
+    
+    /// Uploads cluster data with zeroed grid parameters, which makes the shaders fall back to looping over every light
+    void disableLightClusters();
+    
+    /// Binds the cluster data of the current swap image to con::RendererDataBuffer. The layout must be one of the
+    /// layouts that were created with worldDescriptorSetLayouts.
+    void bindClusterData(CommandBuffer* buffer, PipelineLayoutHnd layout) const;
+    
+    /// Groups the visible opaque meshes into instanced draws and uploads their instance data.
+    ///
+    /// \return false if the instance data doesn't fit into the upload budget of this frame. The meshes need to be
+    /// drawn one by one with recordOpaqueRange() in that case.
+    bool prepareOpaqueBatches(const GraphicsSystem* graphicsSystem);
+    
+    /// Records the instanced draws in [first, last) that were prepared by prepareOpaqueBatches(). Just like
+    /// recordOpaqueRange(), it records all state it needs and can be called from multiple threads.
+    void recordOpaqueBatches(CommandBuffer* buffer, const GraphicsSystem* graphicsSystem, std::size_t first, std::size_t last) const;
+    
+    /// Records the draw calls of the visible opaque meshes in [first, last) into the buffer, along with all state
+    /// they need. Safe to call from multiple threads at once as long as each thread uses a different buffer.
+    void recordOpaqueRange(CommandBuffer* buffer, const GraphicsSystem* graphicsSystem, std::size_t first, std::size_t last) const;
+    
     void initializeTonemappingAndAdjustmentPipeline();
     void initializeMainRenderpassComponents();
     
@@ -86,8 +137,41 @@ protected:
     
     CommandBuffer* getCommandBuffer(CommandBufferID id) const;
     
+    /// Returns the buffer that the commands of the main subpass should be recorded to. It's the World buffer,
+    /// unless the opaque meshes are being recorded in parallel. The main subpass can't mix inline commands with
+    /// secondary buffers, so everything else that's drawn in it goes into an extra secondary buffer.
+    CommandBuffer* getMainSubpassCommandBuffer() const;
+    
     CommandPool* commandPool;
     std::vector<CommandBuffer*> commandBuffers;
+    
+    /// One pool for every recording thread
+    std::vector<CommandPool*> recordingPools;
+    ParallelCommandRecorder opaqueRecorder;
+    /// Secondary buffers, one per swap image, for the rest of the main subpass when recording in parallel
+    std::vector<CommandBuffer*> mainSubpassBuffers;
+    bool recordingOpaqueInParallel;
+    
+    InstanceBatcher opaqueBatcher;
+    /// Per frame instance data, one buffer per swap image
+    std::vector<Buffer> instanceBuffers;
+    bool opaqueBatchesReady;
+    
+    LightClusterer lightClusterer;
+    ClusterLightSet clusterPointLights;
+    ClusterLightSet clusterSpotLights;
+    /// Too big for the stack. Assembled on the CPU and then uploaded.
+    std::unique_ptr<ClusterData> clusterData;
+    /// Per frame cluster data, one buffer per swap image
+    std::vector<Buffer> clusterDataBuffers;
+    /// A single storage buffer at binding 0. Matches every per frame set that the generated shaders declare.
+    DescriptorSetLayoutHnd perFrameDataSetLayout;
+    /// The sets up to and including con::RendererDataBuffer. Pipelines that draw the world must be created with
+    /// layouts that start with these, or the bound cluster data gets disturbed.
+    std::vector<DescriptorSetLayoutHnd> worldDescriptorSetLayouts;
+    DescriptorPoolHnd clusterDataDescriptorPool;
+    /// One set per swap image, each pointing to the matching buffer in clusterDataBuffers
+    std::vector<DescriptorSetHnd> clusterDataDescriptorSets;
     SemaphoreHnd worldRenderComplete;
     FenceHnd preGUIFence;
     
@@ -115,6 +199,10 @@ protected:
     AssetHandle<Shader> vsSimple;
     AssetHandle<Shader> fsSimpleFlat;
     
+    PipelineLayoutHnd instancedPipelineLayout;
+    Pipeline instancedPipeline;
+    AssetHandle<Shader> vsInstanced;
+    
     ShaderHnd fullScreenQuadVS;
     ShaderHnd tonemapFS;
     PipelineLayoutHnd tonemapPipelineLayout;
@@ -0,0 +1,288 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_LIGHT_CLUSTERER_HPP
+#define IYF_LIGHT_CLUSTERER_HPP
+
+#include "graphics/clusteredRenderers/ClusteredRendererConstants.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace iyft {
+class ThreadPool;
+}
+
+namespace iyf {
+struct ClusterData;
+
+/// View space bounding spheres of lights stored as a structure of arrays.
+///
+/// The view space is left handed, just like the one produced by the Camera: +X points right, +Y points up and +Z
+/// points into the screen.
+///
+/// \remark The arrays are always padded to a multiple of ClusterLightSet::Padding elements. The SIMD code can read
+/// whole vectors without checking for the end of the data.
+class ClusterLightSet {
+public:
+    /// The storage is always padded to a multiple of this value
+    static constexpr std::size_t Padding = 8;
+    
+    ClusterLightSet() : count(0) {}
+    
+    /// Removes all lights. Keeps the allocated memory.
+    void clear();
+    
+    /// Makes sure that at least capacity lights can be stored without a reallocation.
+    void reserve(std::size_t capacity);
+    
+    /// Changes the number of lights. New lights have a zero radius at the origin and don't affect any clusters.
+    void resize(std::size_t newCount);
+    
+    /// Adds a new light and returns its index.
+    std::uint32_t add(float x, float y, float z, float radius) {
+        const std::uint32_t id = static_cast<std::uint32_t>(count);
+        resize(count + 1);
+        set(id, x, y, z, radius);
+        return id;
+    }
+    
+    inline void set(std::size_t id, float x, float y, float z, float radius) {
+        xs[id] = x;
+        ys[id] = y;
+        zs[id] = z;
+        radii[id] = radius;
+    }
+    
+    inline std::size_t size() const {
+        return count;
+    }
+    
+    inline bool empty() const {
+        return count == 0;
+    }
+    
+    /// Returns the number of elements in each array, including the padding.
+    inline std::size_t getPaddedSize() const {
+        return xs.size();
+    }
+    
+    inline const float* getX() const { return xs.data(); }
+    inline const float* getY() const { return ys.data(); }
+    inline const float* getZ() const { return zs.data(); }
+    inline const float* getRadius() const { return radii.data(); }
+private:
+    std::size_t count;
+    
+    std::vector<float> xs;
+    std::vector<float> ys;
+    std::vector<float> zs;
+    std::vector<float> radii;
+};
+
+/// The ranges of clusters that the bounding spheres of lights overlap, stored as a structure of arrays. Each range
+/// is [begin, end). Lights that don't overlap any clusters have an empty range on at least one axis.
+struct ClusterRanges {
+    /// Resizes all arrays. The contents are undefined afterwards.
+    void resize(std::size_t paddedCount);
+    
+    std::vector<std::uint8_t> beginX;
+    std::vector<std::uint8_t> endX;
+    std::vector<std::uint8_t> beginY;
+    std::vector<std::uint8_t> endY;
+    std::vector<std::uint8_t> beginZ;
+    std::vector<std::uint8_t> endZ;
+};
+
+/// Assigns point and spot lights to the clusters of a froxel grid.
+///
+/// The view frustum is split into countX * countY screen space tiles and countZ depth slices. The depth slices are
+/// distributed exponentially between the near and the far plane, which keeps the clusters roughly cubical. The
+/// clusters are indexed as x + countX * (y + countY * z), where tile row 0 is at the top of the screen.
+///
+/// Each light is treated as a sphere. Its ranges of columns, rows and slices are found by testing the sphere against
+/// the planes that separate the tiles and the slices and the light is added to every cluster in the box spanned by
+/// these ranges. This is conservative: a light may be added to a few clusters near the corners of the box that it
+/// doesn't actually reach, but it's never missing from a cluster that it does reach.
+///
+/// The ranges are computed for 4 (SSE) or 8 (AVX) lights at once. Large light sets are split into chunks and the
+/// depth slices are binned in parallel if a ThreadPool is provided. The output doesn't depend on the number of threads:
+/// the light IDs of each cluster are sorted, point lights first, and if the light ID storage overflows, the IDs
+/// with the highest indices are dropped from the clusters with the highest indices.
+class LightClusterer {
+public:
+    enum class Mode {
+        /// Processes one light at a time. Kept as a reference and for debugging.
+        Scalar,
+        /// Processes 8 lights at a time if the engine was built with AVX support and 4 otherwise.
+        SIMD
+    };
+    
+    /// Light sets are never split into chunks that are smaller than this.
+    static constexpr std::size_t MinChunkSize = 1024;
+    
+    /// \throws std::invalid_argument if any of the counts is 0 or greater than 255.
+    LightClusterer(std::uint32_t countX = ClusterVolumeX, std::uint32_t countY = ClusterVolumeY, std::uint32_t countZ = ClusterVolumeZ, std::size_t maxLightIDs = MaxLightIDs);
+    
+    /// Sets up the planes of the grid. Must be called whenever the projection changes. Until then, the grid covers a
+    /// square 90 degree frustum between 0.1 and 100.0.
+    ///
+    /// \param[in] fieldOfViewY Vertical field of view in radians
+    /// \param[in] aspectRatio Width divided by height
+    /// \param[in] zNear Distance to the near plane. Must be greater than 0.
+    /// \param[in] zFar Distance to the end of the last depth slice. The Camera may use a reverse Z projection with an
+    /// infinite far plane, but the grid always needs to end somewhere. Lights beyond it are ignored.
+    ///
+    /// \throws std::invalid_argument if zNear <= 0, zFar <= zNear or the field of view isn't in (0, pi)
+    void setProjection(float fieldOfViewY, float aspectRatio, float zNear, float zFar);
+    
+    /// Assigns the lights to clusters.
+    ///
+    /// \param[in] pointLights View space bounding spheres of point lights
+    /// \param[in] spotLights View space bounding spheres of spot lights
+    /// \param[in] pool An optional ThreadPool. If it's nullptr, everything is done by the calling thread.
+    void cluster(const ClusterLightSet& pointLights, const ClusterLightSet& spotLights, iyft::ThreadPool* pool = nullptr);
+    
+    /// Finds the cluster that contains a point in view space.
+    ///
+    /// \return false if the point is outside of the grid
+    bool findCluster(float x, float y, float z, std::uint32_t& clusterID) const;
+    
+    inline std::uint32_t getClusterID(std::uint32_t x, std::uint32_t y, std::uint32_t z) const {
+        return x + countX * (y + countY * z);
+    }
+    
+    inline std::uint32_t getClusterCount() const {
+        return countX * countY * countZ;
+    }
+    
+    inline std::uint32_t getPointLightCount(std::uint32_t clusterID) const {
+        return pointCounts[clusterID];
+    }
+    
+    inline std::uint32_t getSpotLightCount(std::uint32_t clusterID) const {
+        return spotCounts[clusterID];
+    }
+    
+    /// \return The IDs of the point lights in the cluster, followed by the IDs of the spot lights.
+    inline const std::uint32_t* getLightIDs(std::uint32_t clusterID) const {
+        return lightIDs.data() + offsets[clusterID];
+    }
+    
+    /// \return The number of light IDs that were stored in all clusters.
+    inline std::size_t getLightIDCount() const {
+        return usedLightIDs;
+    }
+    
+    /// \return true if the clusters needed more than maxLightIDs light IDs during the last call to cluster() and some
+    /// lights had to be dropped.
+    inline bool hasOverflowed() const {
+        return overflowed;
+    }
+    
+    /// Values that map a fragment to its cluster in the shaders: slice = log(viewDepth) * x + y. z and w are the
+    /// numbers of columns and rows. writeClusterData() divides them by the size of the framebuffer, which turns them
+    /// into scales for gl_FragCoord.xy.
+    std::array<float, 4> getGridParameters() const;
+    
+    /// Copies the results of the last call to cluster() into the layout used by the shaders.
+    ///
+    /// \throws std::logic_error if the grid dimensions or the capacity don't match the ones used by ClusterData.
+    void writeClusterData(ClusterData& data, float framebufferWidth, float framebufferHeight) const;
+    
+    inline void setMode(Mode newMode) {
+        mode = newMode;
+    }
+    
+    inline Mode getMode() const {
+        return mode;
+    }
+    
+    /// Computes the cluster ranges of lights in [begin, end) one by one.
+    ///
+    /// \remark Public for testing. Both versions must produce identical results.
+    void computeRangesScalar(const ClusterLightSet& lights, std::size_t begin, std::size_t end, ClusterRanges& ranges) const;
+    
+    /// Computes the cluster ranges of lights in [begin, end) using SIMD instructions.
+    void computeRangesSIMD(const ClusterLightSet& lights, std::size_t begin, std::size_t end, ClusterRanges& ranges) const;
+    
+    /// Returns the name of the instruction set that computeRangesSIMD() uses.
+    static const char* GetSIMDInstructionSetName();
+private:
+    /// The IDs of the lights that overlap each depth slice, in ascending order. The lights of slice s are stored in
+    /// [offsets[s], offsets[s + 1]).
+    struct SliceBins {
+        std::vector<std::uint32_t> offsets;
+        std::vector<std::uint32_t> lights;
+    };
+    
+    void computeRangeChunk(const ClusterLightSet& lights, ClusterRanges& ranges, std::size_t begin, std::size_t end) const;
+    void binBySlice(const ClusterRanges& ranges, std::size_t lightCount, SliceBins& bins) const;
+    void countSlice(std::uint32_t slice, const ClusterRanges& ranges, const SliceBins& bins, std::vector<std::uint32_t>& counts);
+    void fillSlice(std::uint32_t slice, const ClusterRanges& ranges, const SliceBins& bins, bool spotLights);
+    
+    std::uint32_t countX;
+    std::uint32_t countY;
+    std::uint32_t countZ;
+    std::size_t maxLightIDs;
+    
+    Mode mode;
+    
+    float zNear;
+    float zFar;
+    float tanHalfFovX;
+    float tanHalfFovY;
+    
+    /// The signed distance from the separating plane of column edge i is edgeX[i] * x + edgeXZ[i] * z. Positive values
+    /// are to the right of the edge.
+    std::vector<float> edgeX;
+    std::vector<float> edgeXZ;
+    /// The signed distance from the separating plane of row edge i is edgeY[i] * y + edgeYZ[i] * z. Positive values
+    /// are below the edge.
+    std::vector<float> edgeY;
+    std::vector<float> edgeYZ;
+    /// View space depths of the slice boundaries. sliceDepths[0] is zNear and sliceDepths[countZ] is zFar.
+    std::vector<float> sliceDepths;
+    
+    ClusterRanges pointRanges;
+    ClusterRanges spotRanges;
+    SliceBins pointBins;
+    SliceBins spotBins;
+    
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> pointCounts;
+    std::vector<std::uint32_t> spotCounts;
+    std::vector<std::uint32_t> cursors;
+    std::vector<std::uint32_t> lightIDs;
+    std::size_t usedLightIDs;
+    bool overflowed;
+};
+}
+
+#endif // IYF_LIGHT_CLUSTERER_HPP
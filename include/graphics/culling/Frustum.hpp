@@ -30,6 +30,7 @@
 #define FRUSTUM_HPP
 
 #include "graphics/culling/BoundingVolumes.hpp"
+#include "graphics/culling/FrustumCuller.hpp"
 
 #include <array>
 #include <glm/glm.hpp>
@@ -105,6 +106,20 @@ public:
         return planes[static_cast<std::size_t>(planeID)];
     }
     
+    /// Returns the planes in a format that can be used by the FrustumCuller.
+    inline CullingPlanes getCullingPlanes() const {
+        CullingPlanes result;
+        
+        for (std::size_t i = 0; i < planes.size(); ++i) {
+            result.x[i] = planes[i].x;
+            result.y[i] = planes[i].y;
+            result.z[i] = planes[i].z;
+            result.w[i] = planes[i].w;
+        }
+        
+        return result;
+    }
+    
     /// \todo Create a dedicated debug renderer for graphics stuff
     void drawDebug(DebugRenderer* renderer);
     
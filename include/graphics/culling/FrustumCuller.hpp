@@ -0,0 +1,188 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_FRUSTUM_CULLER_HPP
+#define IYF_FRUSTUM_CULLER_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace iyft {
+class ThreadPool;
+}
+
+namespace iyf {
+/// The planes of a Frustum stored as a structure of arrays.
+///
+/// The convention matches Frustum::isAABBInFrustum(): a box is outside of a plane if the dot product of the plane
+/// normal and the box corner that lies furthest along the negative normal is greater than -w.
+struct CullingPlanes {
+    std::array<float, 6> x;
+    std::array<float, 6> y;
+    std::array<float, 6> z;
+    std::array<float, 6> w;
+};
+
+/// Axis aligned bounding boxes stored as a structure of arrays. Each component is stored in a separate, tightly
+/// packed array, which allows the SIMD culling code to test 4 (SSE) or 8 (AVX) boxes against a plane at once.
+///
+/// \remark The arrays are always padded with empty boxes to a multiple of AABBSet::Padding elements. The SIMD code
+/// can read whole vectors without checking for the end of the data.
+class AABBSet {
+public:
+    /// The storage is always padded to a multiple of this value
+    static constexpr std::size_t Padding = 8;
+    
+    AABBSet() : count(0) {}
+    
+    /// Removes all boxes. Keeps the allocated memory.
+    void clear();
+    
+    /// Makes sure that at least capacity boxes can be stored without a reallocation.
+    void reserve(std::size_t capacity);
+    
+    /// Changes the number of boxes. New boxes are empty and never pass the culling tests.
+    void resize(std::size_t newCount);
+    
+    /// Adds a new box and returns its index. The arrays only grow when the padding runs out.
+    std::uint32_t add(float minX, float minY, float minZ, float maxX, float maxY, float maxZ) {
+        const std::uint32_t id = static_cast<std::uint32_t>(count);
+        
+        if (count == minXs.size()) {
+            resize(count + 1);
+        } else {
+            // The padding boxes are already empty, so one of them can simply be taken
+            count++;
+        }
+        
+        set(id, minX, minY, minZ, maxX, maxY, maxZ);
+        return id;
+    }
+    
+    /// Moves the last box into the place of the removed one. The indices of the other boxes don't change.
+    void removeAndSwap(std::size_t id);
+    
+    /// Replaces the box with the specified index.
+    inline void set(std::size_t id, float minX, float minY, float minZ, float maxX, float maxY, float maxZ) {
+        minXs[id] = minX;
+        minYs[id] = minY;
+        minZs[id] = minZ;
+        maxXs[id] = maxX;
+        maxYs[id] = maxY;
+        maxZs[id] = maxZ;
+    }
+    
+    /// Makes the box with the specified index empty. Empty boxes never pass the culling tests.
+    void setEmpty(std::size_t id);
+    
+    inline std::size_t size() const {
+        return count;
+    }
+    
+    inline bool empty() const {
+        return count == 0;
+    }
+    
+    /// Returns the number of elements in each array, including the padding.
+    inline std::size_t getPaddedSize() const {
+        return minXs.size();
+    }
+    
+    inline const float* getMinX() const { return minXs.data(); }
+    inline const float* getMinY() const { return minYs.data(); }
+    inline const float* getMinZ() const { return minZs.data(); }
+    inline const float* getMaxX() const { return maxXs.data(); }
+    inline const float* getMaxY() const { return maxYs.data(); }
+    inline const float* getMaxZ() const { return maxZs.data(); }
+private:
+    std::size_t count;
+    
+    std::vector<float> minXs;
+    std::vector<float> minYs;
+    std::vector<float> minZs;
+    std::vector<float> maxXs;
+    std::vector<float> maxYs;
+    std::vector<float> maxZs;
+};
+
+/// Culls an AABBSet against the planes of a Frustum and outputs the indices of the visible boxes.
+///
+/// Large sets are split into chunks that are processed by the calling thread and the workers of a ThreadPool. Each
+/// chunk writes to its own list and the lists are concatenated in chunk order once all chunks are done. This means
+/// that no locks are taken while culling and that the output is always sorted by index, no matter how many threads
+/// took part.
+class FrustumCuller {
+public:
+    enum class Mode {
+        /// Tests one box at a time. Kept as a reference and for debugging.
+        Scalar,
+        /// Tests 8 boxes at a time if the engine was built with AVX support and 4 otherwise.
+        SIMD
+    };
+    
+    /// Chunks are never smaller than this because scheduling tiny chunks costs more than culling them.
+    static constexpr std::size_t MinChunkSize = 4096;
+    
+    FrustumCuller() : mode(Mode::SIMD) {}
+    
+    /// Culls all boxes in the set.
+    ///
+    /// \param[in] planes The planes to test against
+    /// \param[in] boxes The boxes to test
+    /// \param[out] visibleIDs Indices of boxes that are inside or intersect the frustum, sorted in ascending order
+    /// \param[in] pool An optional ThreadPool. If it's nullptr, everything is done by the calling thread.
+    void cull(const CullingPlanes& planes, const AABBSet& boxes, std::vector<std::uint32_t>& visibleIDs, iyft::ThreadPool* pool = nullptr);
+    
+    inline void setMode(Mode newMode) {
+        mode = newMode;
+    }
+    
+    inline Mode getMode() const {
+        return mode;
+    }
+    
+    /// Culls boxes in [begin, end) one by one and appends the indices of the visible ones to visibleIDs.
+    static void CullRangeScalar(const CullingPlanes& planes, const AABBSet& boxes, std::size_t begin, std::size_t end, std::vector<std::uint32_t>& visibleIDs);
+    
+    /// Culls boxes in [begin, end) using SIMD instructions and appends the indices of the visible ones to visibleIDs.
+    static void CullRangeSIMD(const CullingPlanes& planes, const AABBSet& boxes, std::size_t begin, std::size_t end, std::vector<std::uint32_t>& visibleIDs);
+    
+    /// Returns the name of the instruction set that CullRangeSIMD() uses.
+    static const char* GetSIMDInstructionSetName();
+private:
+    void cullChunk(const CullingPlanes& planes, const AABBSet& boxes, std::size_t chunkID, std::size_t chunkSize);
+    
+    Mode mode;
+    
+    /// One list per chunk. Reused between frames to avoid allocations.
+    std::vector<std::vector<std::uint32_t>> chunkResults;
+};
+}
+
+#endif // IYF_FRUSTUM_CULLER_HPP
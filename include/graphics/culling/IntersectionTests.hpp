@@ -0,0 +1,172 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_INTERSECTION_TESTS_HPP
+#define IYF_INTERSECTION_TESTS_HPP
+
+#include "graphics/culling/BoundingVolumes.hpp"
+#include "graphics/culling/FrustumCuller.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace iyf {
+/// Plane mask used by TestAABBAgainstPlanes() when all 6 planes still need to be tested.
+constexpr std::uint8_t AllFrustumPlanes = 0x3F;
+
+enum class PlaneTestResult {
+    Outside,
+    Intersecting,
+    Inside
+};
+
+/// Tests an AABB against the planes of a frustum.
+///
+/// Uses the same convention as Frustum::isAABBInFrustum(). Planes that the box is completely inside of are removed
+/// from planeMask. Since children of hierarchical structures are contained by their parents, they can skip those planes.
+///
+/// \param[in] planes The planes of the frustum
+/// \param[in] aabb The box to test
+/// \param[in,out] planeMask Bit i is set if plane i still needs to be tested
+inline PlaneTestResult TestAABBAgainstPlanes(const CullingPlanes& planes, const AABB& aabb, std::uint8_t& planeMask) {
+    const glm::vec3& minCorner = aabb.vertices[static_cast<int>(AABB::Vertex::Minimum)];
+    const glm::vec3& maxCorner = aabb.vertices[static_cast<int>(AABB::Vertex::Maximum)];
+    
+    for (std::size_t p = 0; p < 6; ++p) {
+        const std::uint8_t bit = static_cast<std::uint8_t>(1 << p);
+        if ((planeMask & bit) == 0) {
+            continue;
+        }
+        
+        const bool negativeX = planes.x[p] < 0.0f;
+        const bool negativeY = planes.y[p] < 0.0f;
+        const bool negativeZ = planes.z[p] < 0.0f;
+        
+        // The corner that is furthest along the negative normal. If it's outside, the whole box is.
+        const float nearX = negativeX ? maxCorner.x : minCorner.x;
+        const float nearY = negativeY ? maxCorner.y : minCorner.y;
+        const float nearZ = negativeZ ? maxCorner.z : minCorner.z;
+        
+        if (planes.x[p] * nearX + planes.y[p] * nearY + planes.z[p] * nearZ > -planes.w[p]) {
+            return PlaneTestResult::Outside;
+        }
+        
+        // The opposite corner. If it's inside, the whole box is and the plane can be skipped from now on.
+        const float farX = negativeX ? minCorner.x : maxCorner.x;
+        const float farY = negativeY ? minCorner.y : maxCorner.y;
+        const float farZ = negativeZ ? minCorner.z : maxCorner.z;
+        
+        if (planes.x[p] * farX + planes.y[p] * farY + planes.z[p] * farZ <= -planes.w[p]) {
+            planeMask &= static_cast<std::uint8_t>(~bit);
+        }
+    }
+    
+    return (planeMask == 0) ? PlaneTestResult::Inside : PlaneTestResult::Intersecting;
+}
+
+inline bool AABBOverlapsAABB(const AABB& a, const AABB& b) {
+    const glm::vec3& aMin = a.vertices[static_cast<int>(AABB::Vertex::Minimum)];
+    const glm::vec3& aMax = a.vertices[static_cast<int>(AABB::Vertex::Maximum)];
+    const glm::vec3& bMin = b.vertices[static_cast<int>(AABB::Vertex::Minimum)];
+    const glm::vec3& bMax = b.vertices[static_cast<int>(AABB::Vertex::Maximum)];
+    
+    return aMin.x <= bMax.x && aMax.x >= bMin.x &&
+           aMin.y <= bMax.y && aMax.y >= bMin.y &&
+           aMin.z <= bMax.z && aMax.z >= bMin.z;
+}
+
+inline bool SphereOverlapsAABB(const BoundingSphere& sphere, const AABB& aabb) {
+    const glm::vec3& minCorner = aabb.vertices[static_cast<int>(AABB::Vertex::Minimum)];
+    const glm::vec3& maxCorner = aabb.vertices[static_cast<int>(AABB::Vertex::Maximum)];
+    
+    // Squared distance from the center to the closest point of the box
+    float distanceSquared = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        const float c = sphere.center[i];
+        const float closest = std::min(std::max(c, minCorner[i]), maxCorner[i]);
+        distanceSquared += (c - closest) * (c - closest);
+    }
+    
+    return distanceSquared <= sphere.radius * sphere.radius;
+}
+
+/// A ray with a precomputed inverse direction for fast slab tests.
+struct Ray {
+    Ray(const glm::vec3& origin, const glm::vec3& direction) : origin(origin), direction(direction),
+        inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z) {}
+    
+    glm::vec3 origin;
+    glm::vec3 direction;
+    glm::vec3 inverseDirection;
+};
+
+/// Slab test. Components of the direction may be zero; the resulting infinities are handled correctly as long as the
+/// origin doesn't lie exactly on a slab boundary.
+///
+/// \param[in] ray The ray to test
+/// \param[in] aabb The box to test
+/// \param[in] maxDistance Hits that are further away than this are ignored
+/// \param[out] distance Distance (in multiples of the direction length) to the entry point or 0 if the origin is inside
+/// the box. Only valid if this function returned true.
+inline bool IntersectRayAABB(const Ray& ray, const AABB& aabb, float maxDistance, float& distance) {
+    const glm::vec3& minCorner = aabb.vertices[static_cast<int>(AABB::Vertex::Minimum)];
+    const glm::vec3& maxCorner = aabb.vertices[static_cast<int>(AABB::Vertex::Maximum)];
+    
+    float tMin = 0.0f;
+    float tMax = maxDistance;
+    
+    for (int i = 0; i < 3; ++i) {
+        float t1 = (minCorner[i] - ray.origin[i]) * ray.inverseDirection[i];
+        float t2 = (maxCorner[i] - ray.origin[i]) * ray.inverseDirection[i];
+        
+        if (t1 > t2) {
+            std::swap(t1, t2);
+        }
+        
+        tMin = std::max(tMin, t1);
+        tMax = std::min(tMax, t2);
+        
+        if (tMin > tMax) {
+            return false;
+        }
+    }
+    
+    distance = tMin;
+    return true;
+}
+
+/// The result of a raycast against a spatial structure.
+struct RayHit {
+    RayHit() : id(0), distance(0.0f) {}
+    
+    std::uint32_t id;
+    float distance;
+};
+}
+
+#endif // IYF_INTERSECTION_TESTS_HPP
@@ -0,0 +1,147 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_LOOSE_OCTREE_HPP
+#define IYF_LOOSE_OCTREE_HPP
+
+#include "graphics/culling/IntersectionTests.hpp"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace iyf {
+/// A loose octree for objects that move.
+///
+/// Each node stores the objects whose centers lie inside the node and whose size doesn't exceed half of the node size.
+/// The bounds that are used during queries are twice as big as the node itself, which means that an object never
+/// needs to be stored in more than one node and that an update only does work if the object crosses a node boundary.
+///
+/// Objects whose centers lie outside of the world bounds are kept in the root, which is never culled.
+class LooseOctree {
+public:
+    static constexpr std::uint32_t InvalidHandle = std::numeric_limits<std::uint32_t>::max();
+    
+    /// \param[in] worldBounds The region that is subdivided. Doesn't need to be a cube; the largest side is used.
+    /// \param[in] maxDepth Maximum number of subdivisions
+    LooseOctree(const AABB& worldBounds, std::uint32_t maxDepth);
+    
+    /// Adds an object and returns a handle that must be used to update or remove it.
+    std::uint32_t insert(std::uint32_t id, const AABB& bounds);
+    
+    /// Changes the bounds of the object. Cheap if the object stays in the same node.
+    void update(std::uint32_t handle, const AABB& bounds);
+    
+    /// Removes the object. The handle becomes invalid and may be reused.
+    void remove(std::uint32_t handle);
+    
+    /// Removes all objects and nodes.
+    void clear();
+    
+    inline std::uint32_t getID(std::uint32_t handle) const {
+        return objects[handle].id;
+    }
+    
+    inline const AABB& getBounds(std::uint32_t handle) const {
+        return objects[handle].bounds;
+    }
+    
+    inline std::size_t size() const {
+        return objectCount;
+    }
+    
+    inline std::size_t getNodeCount() const {
+        return nodes.size();
+    }
+    
+    /// Appends the IDs of objects that are inside or intersect the frustum.
+    void queryFrustum(const CullingPlanes& planes, std::vector<std::uint32_t>& ids) const;
+    
+    /// Appends the IDs of objects whose bounds overlap the box.
+    void queryAABB(const AABB& aabb, std::vector<std::uint32_t>& ids) const;
+    
+    /// Appends the IDs of objects whose bounds overlap the sphere.
+    void querySphere(const BoundingSphere& sphere, std::vector<std::uint32_t>& ids) const;
+    
+    /// Finds the closest object whose bounds are hit by the ray.
+    ///
+    /// \param[in] ray The ray
+    /// \param[in] maxDistance Hits that are further away than this are ignored
+    /// \param[out] hit Updated if a hit is found
+    /// \return true if hit was updated
+    bool raycast(const Ray& ray, float maxDistance, RayHit& hit) const;
+private:
+    static constexpr std::uint32_t NoNode = std::numeric_limits<std::uint32_t>::max();
+    
+    struct Node {
+        Node(const glm::vec3& center, float halfSize, std::uint32_t parent, std::uint32_t depth);
+        
+        /// The bounds used during queries (twice the size of the node)
+        AABB looseBounds;
+        glm::vec3 center;
+        float halfSize;
+        std::uint32_t parent;
+        std::uint32_t depth;
+        /// Number of objects in this node and all of its descendants. Used to skip empty subtrees.
+        std::uint32_t subtreeObjectCount;
+        std::array<std::uint32_t, 8> children;
+        std::vector<std::uint32_t> objectHandles;
+    };
+    
+    struct Object {
+        AABB bounds;
+        std::uint32_t id;
+        std::uint32_t node;
+        /// Position in Node::objectHandles
+        std::uint32_t indexInNode;
+    };
+    
+    /// Finds (and creates if needed) the node that should store an object with these bounds
+    std::uint32_t findNode(const AABB& bounds);
+    bool fitsNode(std::uint32_t nodeID, const AABB& bounds) const;
+    void attachToNode(std::uint32_t handle, std::uint32_t nodeID);
+    void detachFromNode(std::uint32_t handle);
+    
+    template <typename NodeTest, typename ObjectTest>
+    void query(NodeTest nodeTest, ObjectTest objectTest, std::vector<std::uint32_t>& ids) const;
+    
+    void queryFrustumNode(std::uint32_t nodeID, const CullingPlanes& planes, std::uint8_t planeMask, std::vector<std::uint32_t>& ids) const;
+    void appendAll(std::uint32_t nodeID, std::vector<std::uint32_t>& ids) const;
+    
+    AABB worldBounds;
+    std::uint32_t maxDepth;
+    std::size_t objectCount;
+    
+    std::vector<Node> nodes;
+    std::vector<Object> objects;
+    std::vector<std::uint32_t> freeHandles;
+};
+}
+
+#endif // IYF_LOOSE_OCTREE_HPP
@@ -0,0 +1,135 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_SPATIAL_INDEX_HPP
+#define IYF_SPATIAL_INDEX_HPP
+
+#include "graphics/culling/StaticBVH.hpp"
+#include "graphics/culling/LooseOctree.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace iyf {
+/// Keeps track of the bounds of entities and answers frustum, ray, box and sphere queries without visiting every one
+/// of them.
+///
+/// Static entities (TransformationComponent::isStatic()) are stored in a StaticBVH and dynamic ones in a LooseOctree.
+/// Since the BVH can't be updated incrementally, static entities that were added or moved are kept in the octree
+/// until enough of them pile up. commit() then rebuilds the BVH. Queries always see all entities, no matter where
+/// they are stored at the moment.
+///
+/// \warning Not thread safe. Changes and queries must not overlap.
+class SpatialIndex {
+public:
+    /// The BVH is never rebuilt because of fewer pending static entities than this.
+    static constexpr std::size_t MinPendingStaticCount = 1024;
+    
+    /// \param[in] worldBounds The region subdivided by the octree. Dynamic entities outside of it still work, but they
+    /// are never culled as a group.
+    /// \param[in] maxOctreeDepth The maximum depth of the octree
+    SpatialIndex(const AABB& worldBounds = AABB(glm::vec3(-8192.0f, -8192.0f, -8192.0f), glm::vec3(8192.0f, 8192.0f, 8192.0f)), std::uint32_t maxOctreeDepth = 8);
+    
+    /// Adds an entity. Does nothing if the entity has already been added.
+    void insert(std::uint32_t id, const AABB& bounds, bool isStatic);
+    
+    /// Updates the bounds and the static flag of an entity. Adds the entity if it's missing.
+    void update(std::uint32_t id, const AABB& bounds, bool isStatic);
+    
+    /// Removes the entity. Does nothing if the entity hasn't been added.
+    void remove(std::uint32_t id);
+    
+    /// Removes all entities.
+    void clear();
+    
+    bool contains(std::uint32_t id) const {
+        return id < records.size() && records[id].location != Location::None;
+    }
+    
+    /// Rebuilds the BVH if enough static entities are waiting in the octree or if too many of its entries have been
+    /// removed. Call once per frame, before the queries.
+    ///
+    /// \param[in] force Rebuild if anything at all has changed since the last rebuild
+    /// \return true if the BVH was rebuilt
+    bool commit(bool force = false);
+    
+    /// Number of static entities in the BVH
+    inline std::size_t getStaticCount() const {
+        return bvh.size();
+    }
+    
+    /// Number of static entities that are waiting for the next BVH rebuild
+    inline std::size_t getPendingStaticCount() const {
+        return pendingStaticCount;
+    }
+    
+    /// Number of dynamic entities
+    inline std::size_t getDynamicCount() const {
+        return octree.size() - pendingStaticCount;
+    }
+    
+    /// Appends the IDs of entities that are inside or intersect the frustum. The order is unspecified.
+    void queryFrustum(const CullingPlanes& planes, std::vector<std::uint32_t>& ids) const;
+    
+    /// Appends the IDs of entities whose bounds overlap the box. The order is unspecified.
+    void queryAABB(const AABB& aabb, std::vector<std::uint32_t>& ids) const;
+    
+    /// Appends the IDs of entities whose bounds overlap the sphere. The order is unspecified.
+    void querySphere(const BoundingSphere& sphere, std::vector<std::uint32_t>& ids) const;
+    
+    /// Finds the entity whose bounds are hit first by the ray. Meant for picking.
+    ///
+    /// \param[in] origin Origin of the ray
+    /// \param[in] direction Direction of the ray. Distances are measured in multiples of its length.
+    /// \param[in] maxDistance Hits that are further away than this are ignored
+    /// \param[out] hit The closest hit. Only valid if this function returned true.
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+private:
+    enum class Location : std::uint8_t {
+        None, BVH, Octree
+    };
+    
+    struct Record {
+        Record() : location(Location::None), isStatic(false), slot(0) {}
+        
+        Location location;
+        bool isStatic;
+        /// The slot in the BVH or the handle in the octree
+        std::uint32_t slot;
+    };
+    
+    void rebuildBVH();
+    
+    std::vector<Record> records;
+    StaticBVH bvh;
+    LooseOctree octree;
+    std::size_t pendingStaticCount;
+};
+}
+
+#endif // IYF_SPATIAL_INDEX_HPP
@@ -0,0 +1,134 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_STATIC_BVH_HPP
+#define IYF_STATIC_BVH_HPP
+
+#include "graphics/culling/IntersectionTests.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace iyf {
+/// A bounding volume hierarchy for objects that don't move.
+///
+/// The tree is built once using binned SAH splits and stored as a flat, depth first ordered array of nodes. Objects
+/// can be removed without a rebuild (they become tombstones that the queries skip), but adding new ones requires a
+/// full rebuild. The SpatialIndex keeps new static objects elsewhere and rebuilds the tree in batches.
+class StaticBVH {
+public:
+    /// Marks entries that have been removed.
+    static constexpr std::uint32_t InvalidID = std::numeric_limits<std::uint32_t>::max();
+    
+    /// Maximum number of objects in a leaf
+    static constexpr std::uint32_t MaxLeafSize = 4;
+    
+    struct Entry {
+        AABB bounds;
+        std::uint32_t id;
+    };
+    
+    StaticBVH() : removedCount(0) {}
+    
+    /// Discards the current tree and builds a new one from the provided entries.
+    void build(std::vector<Entry> newEntries);
+    
+    /// Removes all objects.
+    void clear();
+    
+    /// Number of entries, including the removed ones. Entries are reordered during a build(), so the slot of an object
+    /// has to be found by iterating over all entries and calling getEntryID().
+    inline std::size_t getEntryCount() const {
+        return entries.size();
+    }
+    
+    /// Returns the ID of the object stored in the slot or InvalidID if it was removed.
+    inline std::uint32_t getEntryID(std::size_t slot) const {
+        return entries[slot].id;
+    }
+    
+    /// Returns the bounds of the object stored in the slot.
+    inline const AABB& getEntryBounds(std::size_t slot) const {
+        return entries[slot].bounds;
+    }
+    
+    /// Turns the entry in the slot into a tombstone. The bounds of the nodes aren't shrunk.
+    void remove(std::size_t slot);
+    
+    /// Number of live objects.
+    inline std::size_t size() const {
+        return entries.size() - removedCount;
+    }
+    
+    /// Number of removed objects that still occupy space in the tree.
+    inline std::size_t getRemovedCount() const {
+        return removedCount;
+    }
+    
+    inline std::size_t getNodeCount() const {
+        return nodes.size();
+    }
+    
+    /// Appends the IDs of objects that are inside or intersect the frustum.
+    void queryFrustum(const CullingPlanes& planes, std::vector<std::uint32_t>& ids) const;
+    
+    /// Appends the IDs of objects whose bounds overlap the box.
+    void queryAABB(const AABB& aabb, std::vector<std::uint32_t>& ids) const;
+    
+    /// Appends the IDs of objects whose bounds overlap the sphere.
+    void querySphere(const BoundingSphere& sphere, std::vector<std::uint32_t>& ids) const;
+    
+    /// Finds the closest object whose bounds are hit by the ray.
+    ///
+    /// \param[in] ray The ray
+    /// \param[in] maxDistance Hits that are further away than this are ignored
+    /// \param[out] hit Updated if a hit is found
+    /// \return true if hit was updated
+    bool raycast(const Ray& ray, float maxDistance, RayHit& hit) const;
+private:
+    struct Node {
+        AABB bounds;
+        /// Index of the first entry for leaves, index of the second child for inner nodes. The first child of an inner
+        /// node always immediately follows it.
+        std::uint32_t offset;
+        /// Number of entries in a leaf, 0 for inner nodes.
+        std::uint32_t count;
+    };
+    
+    void buildNode(std::uint32_t nodeID, std::uint32_t first, std::uint32_t count);
+    void queryFrustumNode(std::uint32_t nodeID, const CullingPlanes& planes, std::uint8_t planeMask, std::vector<std::uint32_t>& ids) const;
+    void appendAll(std::uint32_t nodeID, std::vector<std::uint32_t>& ids) const;
+    
+    std::vector<Node> nodes;
+    std::vector<Entry> entries;
+    std::size_t removedCount;
+};
+}
+
+#endif // IYF_STATIC_BVH_HPP
@@ -0,0 +1,158 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_MATERIAL_TEMPLATE_FORMAT_HPP
+#define IYF_MATERIAL_TEMPLATE_FORMAT_HPP
+
+#include "graphics/GraphicsAPIConstants.hpp"
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace iyf {
+class Serializer;
+
+namespace mtf {
+
+const char MagicNumber[5] = {'I', 'Y', 'F', 'M', 'T'};
+
+/// Version 1 files store a variant count that's followed by (vertex data layout, stage, macro hash, lookup hash, size,
+/// bytecode) tuples. The whole file needs to be read to find a specific variant.
+namespace v1 {
+const std::uint16_t VersionNumber = 1;
+}
+
+/// Version 2 material template files consist of a fixed size Header, a table of VariantRecord objects and the bytecode
+/// of the variants.
+///
+/// The table is sorted by (macro hash, vertex data layout, stage), so a variant can be found with a binary search. Every
+/// bytecode blob starts at an offset that's a multiple of BlobAlignment and all fields are little endian. ParseMaterialTemplate()
+/// only validates the Header and the table, which means that a memory mapped file can be used as is and the pages that
+/// store the variants that are never requested are never read.
+namespace v2 {
+const std::uint16_t VersionNumber = 2;
+const std::uint32_t BlobAlignment = 16;
+
+/// Same values as the stage IDs of version 1 files
+enum class VariantStage : std::uint8_t {
+    Vertex = 0,
+    Geometry = 1,
+    TessControl = 2,
+    TessEvaluation = 3,
+    Fragment = 4,
+    COUNT
+};
+
+/// \throws std::invalid_argument if the stage can't be stored in a material template file
+VariantStage ToVariantStage(ShaderStageFlagBits stage);
+ShaderStageFlagBits ToShaderStage(VariantStage stage);
+
+struct Header {
+    /// Same as in version 1 files
+    char magicNumber[5];
+    /// Little endian VersionNumber. Stored as bytes because it follows the magic number, just like in version 1 files
+    std::uint8_t versionNumber[2];
+    std::uint8_t padding0;
+    /// Number of VariantRecord objects that immediately follow the header
+    std::uint32_t variantCount;
+    std::uint32_t padding1;
+    /// The version hash of the macro combinations that the variants were compiled for
+    std::uint64_t macroVersionHash;
+    /// Used to detect truncated files without reading the bytecode
+    std::uint64_t fileSize;
+};
+
+struct VariantRecord {
+    std::uint64_t macroHash;
+    /// Offset of the bytecode from the start of the file, in bytes
+    std::uint64_t offset;
+    /// Size of the bytecode, in bytes
+    std::uint32_t size;
+    /// A VertexDataLayout value
+    std::uint8_t vertexDataLayout;
+    /// A VariantStage value
+    std::uint8_t stage;
+    std::uint8_t padding[2];
+};
+
+static_assert(sizeof(Header) == 32 && std::is_trivially_copyable_v<Header>, "Unexpected mtf::v2::Header layout");
+static_assert(sizeof(VariantRecord) == 24 && std::is_trivially_copyable_v<VariantRecord>, "Unexpected mtf::v2::VariantRecord layout");
+
+/// A compiled variant that needs to be written to a version 2 material template file
+struct VariantData {
+    std::uint64_t macroHash;
+    std::uint8_t vertexDataLayout;
+    VariantStage stage;
+    /// Must be a multiple of 4 bytes
+    const void* bytecode;
+    std::uint32_t size;
+};
+
+/// Writes a version 2 material template file to the serializer, which is expected to be at position 0. The variants may
+/// be provided in any order.
+///
+/// \throws std::invalid_argument if two variants have the same macro hash, vertex data layout and stage
+void WriteMaterialTemplate(Serializer& output, std::uint64_t macroVersionHash, const std::vector<VariantData>& variants);
+
+/// Pointers into a version 2 material template file that's fully resident in memory or memory mapped.
+struct MaterialTemplateFileView {
+    MaterialTemplateFileView() : header(), records(nullptr), data(nullptr) {}
+    
+    /// A copy, since the file data is not guaranteed to be suitably aligned for direct access
+    Header header;
+    const char* records;
+    const char* data;
+    
+    inline std::size_t getVariantCount() const {
+        return header.variantCount;
+    }
+    
+    VariantRecord getRecord(std::size_t id) const;
+    
+    /// Finds a variant using a binary search of the table.
+    ///
+    /// \return The ID of the record or -1 if the file doesn't contain the variant
+    std::int64_t findVariant(std::uint64_t macroHash, std::uint8_t vertexDataLayout, VariantStage stage) const;
+    
+    inline const char* getBytecode(const VariantRecord& record) const {
+        return data + record.offset;
+    }
+};
+
+/// Validates the header and the table of a version 2 material template file and fills the view. The bytecode of the
+/// variants is not accessed.
+///
+/// \return false if the data is not a valid version 2 material template file
+bool ParseMaterialTemplate(const char* data, std::size_t size, MaterialTemplateFileView& view);
+}
+
+}
+}
+
+#endif // IYF_MATERIAL_TEMPLATE_FORMAT_HPP
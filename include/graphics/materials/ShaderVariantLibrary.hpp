@@ -0,0 +1,107 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_SHADER_VARIANT_LIBRARY_HPP
+#define IYF_SHADER_VARIANT_LIBRARY_HPP
+
+#include "graphics/GraphicsAPIHandles.hpp"
+#include "graphics/VertexDataLayouts.hpp"
+#include "graphics/materials/MaterialTemplateFormat.hpp"
+#include "io/FileView.hpp"
+#include "io/Path.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace iyf {
+class FileSystem;
+class GraphicsAPI;
+
+/// Provides access to the shader variants that are stored in a version 2 material template file.
+///
+/// The file is memory mapped and only its header and variant table are read when it's opened. The bytecode of a variant
+/// is accessed when the variant is requested for the first time and shader modules are only created for the variants
+/// that have actually been requested. If the FileSystem can't map the file (e.g., it's stored in a compressed archive),
+/// the file is read into memory instead, but the shader modules are still created lazily.
+class ShaderVariantLibrary {
+public:
+    ShaderVariantLibrary() {}
+    ~ShaderVariantLibrary();
+    
+    ShaderVariantLibrary(const ShaderVariantLibrary&) = delete;
+    ShaderVariantLibrary& operator=(const ShaderVariantLibrary&) = delete;
+    
+    /// Maps a material template file. Closes the previous file, which requires all shaders to be released first.
+    ///
+    /// \return false if the file can't be read or if it's not a valid version 2 material template file
+    bool open(const FileSystem& filesystem, const Path& path);
+    
+    inline bool isOpen() const {
+        return !file.empty();
+    }
+    
+    inline std::size_t getVariantCount() const {
+        return view.getVariantCount();
+    }
+    
+    /// \return The version hash of the macro combinations that the variants were compiled for
+    inline std::uint64_t getMacroVersionHash() const {
+        return view.header.macroVersionHash;
+    }
+    
+    /// Finds the bytecode of a variant without creating a shader module.
+    ///
+    /// \return A pointer to the bytecode or nullptr if the library doesn't contain the variant
+    const char* findBytecode(std::uint64_t macroHash, VertexDataLayout vertexDataLayout, ShaderStageFlagBits stage, std::size_t& size) const;
+    
+    /// Returns the shader module of a variant and creates it if this is the first time it's requested.
+    ///
+    /// \return The handle or an invalid handle if the library doesn't contain the variant
+    ShaderHnd getShader(GraphicsAPI* api, std::uint64_t macroHash, VertexDataLayout vertexDataLayout, ShaderStageFlagBits stage);
+    
+    /// Destroys all shader modules that were created by getShader().
+    void releaseShaders(GraphicsAPI* api);
+    
+    /// \return The number of shader modules that currently exist
+    inline std::size_t getShaderCount() const {
+        std::lock_guard<std::mutex> lock(shaderMutex);
+        return shaders.size();
+    }
+private:
+    FileView file;
+    mtf::v2::MaterialTemplateFileView view;
+    
+    /// Record ID to shader module
+    std::unordered_map<std::uint32_t, ShaderHnd> shaders;
+    mutable std::mutex shaderMutex;
+};
+
+}
+
+#endif // IYF_SHADER_VARIANT_LIBRARY_HPP
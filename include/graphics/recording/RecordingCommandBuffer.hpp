@@ -0,0 +1,230 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_RECORDING_COMMAND_BUFFER_HPP
+#define IYF_RECORDING_COMMAND_BUFFER_HPP
+
+#include "graphics/GraphicsAPI.hpp"
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace iyf {
+class RecordingCommandPool;
+
+/// The commands that a RecordingCommandBuffer can record.
+enum class RecordedCommandType : std::uint8_t {
+    SetViewports,
+    SetScissors,
+    Draw,
+    DrawIndexed,
+    Dispatch,
+    BindVertexBuffers,
+    BindIndexBuffer,
+    PushConstants,
+    BindDescriptorSets,
+    BindPipeline,
+    BeginRenderPass,
+    NextSubpass,
+    EndRenderPass,
+    CopyImageToBuffer,
+    ExecuteCommands,
+    COUNT
+};
+
+/// A CommandBuffer that doesn't talk to any GPU. It serializes the commands into a compact stream, counts them and
+/// checks them against the rules that a real backend (and its validation layers) would enforce, e.g., that draws
+/// happen inside of a render pass with a bound pipeline or that secondary command buffers are only executed in
+/// subpasses that were begun with SubpassContents::SecondaryCommandBuffers.
+///
+/// It's used to test and benchmark command recording code without a GPU.
+///
+/// \remark Validation errors don't throw. They are collected and can be retrieved with getValidationErrors().
+class RecordingCommandBuffer : public CommandBuffer {
+public:
+    RecordingCommandBuffer(BufferLevel level, RecordingCommandPool* pool, std::string name);
+    
+    virtual void setViewports(std::uint32_t first, std::uint32_t count, const std::vector<Viewport>& viewports) override;
+    virtual void setScissors(std::uint32_t first, std::uint32_t count, const std::vector<Rect2D>& rectangles) override;
+    
+    virtual void setViewports(std::uint32_t first, std::uint32_t count, const Viewport* viewports) override;
+    virtual void setScissors(std::uint32_t first, std::uint32_t count, const Rect2D* rectangles) override;
+    
+    virtual void setViewport(std::uint32_t first, const Viewport& viewport) override;
+    virtual void setScissor(std::uint32_t first, const Rect2D& rectangle) override;
+    
+    virtual void draw(std::uint32_t vertexCount, std::uint32_t instanceCount, std::uint32_t firstVertex, std::uint32_t firstInstance) override;
+    virtual void drawIndexed(std::uint32_t indexCount, std::uint32_t instanceCount, std::uint32_t firstIndex, std::int32_t vertexOffset, std::uint32_t firstInstance) override;
+    
+    virtual void dispatch(std::uint32_t x, std::uint32_t y, std::uint32_t z) override;
+    
+    virtual void bindVertexBuffers(std::uint32_t firstBinding, std::uint32_t bindingCount, const std::vector<Buffer>& buffers) override;
+    virtual void bindVertexBuffer(std::uint32_t firstBinding, const Buffer& buffer) override;
+    virtual void bindIndexBuffer(const Buffer& buffer, IndexType indexType) override;
+    
+    virtual void pushConstants(PipelineLayoutHnd handle, ShaderStageFlags flags, std::uint32_t offset, std::uint32_t size, const void* data) override;
+    virtual bool bindDescriptorSets(PipelineBindPoint point, PipelineLayoutHnd layout, std::uint32_t firstSet, const std::vector<DescriptorSetHnd> descriptorSets, const std::vector<std::uint32_t> dynamicOffsets) override;
+    virtual bool bindDescriptorSets(PipelineBindPoint point, PipelineLayoutHnd layout, std::uint32_t firstSet, std::uint32_t descriptorSetCount, const DescriptorSetHnd* descriptorSets, std::uint32_t dynamicOffsetCount, const std::uint32_t* dynamicOffsets) override;
+    
+    virtual void bindPipeline(const Pipeline& pipeline) override;
+    
+    virtual void begin(const CommandBufferBeginInfo& cbbi = CommandBufferBeginInfo()) override;
+    virtual void end() override;
+    
+    virtual bool isRecording() const override {
+        return recording;
+    }
+    
+    virtual void beginRenderPass(const RenderPassBeginInfo& rpbi, SubpassContents contents = SubpassContents::Inline) override;
+    virtual void nextSubpass(SubpassContents contents = SubpassContents::Inline) override;
+    virtual void endRenderPass() override;
+    
+    virtual void copyImageToBuffer(const Image& srcImage, ImageLayout layout, const Buffer& dstBuffer, const std::vector<BufferImageCopy>& regions) override;
+    
+    virtual void executeCommands(std::uint32_t count, CommandBuffer* const* buffers) override;
+    
+    virtual CommandBufferHnd getHandle() override {
+        return CommandBufferHnd(this);
+    }
+    
+    inline const std::string& getName() const {
+        return name;
+    }
+    
+    /// The number of commands of the specified type that were recorded into this buffer since the last call to begin().
+    inline std::uint64_t getCommandCount(RecordedCommandType type) const {
+        return commandCounts[static_cast<std::size_t>(type)];
+    }
+    
+    /// The number of commands of the specified type that will run when this buffer is executed. Unlike
+    /// getCommandCount(), it includes the commands of the executed secondary command buffers.
+    std::uint64_t getExecutedCommandCount(RecordedCommandType type) const;
+    
+    /// The total number of commands recorded into this buffer since the last call to begin().
+    std::uint64_t getTotalCommandCount() const;
+    
+    /// Appends the payloads of all commands of the specified type to out, in execution order. Commands of executed
+    /// secondary buffers are included. Useful when comparing the output of different recording strategies.
+    void collectCommandPayloads(RecordedCommandType type, std::vector<std::uint8_t>& out) const;
+    
+    /// The serialized command stream.
+    inline const std::vector<std::uint8_t>& getCommandStream() const {
+        return stream;
+    }
+    
+    inline const std::vector<std::string>& getValidationErrors() const {
+        return validationErrors;
+    }
+    
+    inline bool hasValidationErrors() const {
+        return !validationErrors.empty();
+    }
+    
+    /// Removes all recorded commands and validation errors.
+    void reset();
+private:
+    /// Checks the state that's common to all commands and appends the header of a new command to the stream.
+    void recordHeader(RecordedCommandType type, std::uint32_t payloadSize);
+    void recordPayload(const void* data, std::size_t size);
+    
+    template <typename... Args>
+    void record(RecordedCommandType type, const Args&... args) {
+        recordHeader(type, (0 + ... + static_cast<std::uint32_t>(sizeof(Args))));
+        (recordPayload(&args, sizeof(Args)), ...);
+    }
+    
+    /// Validates commands that can only be recorded inline inside of a render pass.
+    void validateRenderPassCommand(const char* command);
+    /// Validates commands that aren't allowed in subpasses that expect secondary command buffers.
+    void validateInlineCommand(const char* command);
+    void validateDraw(const char* command, bool indexed);
+    
+    void addError(std::string error);
+    
+    /// Invalidates all bound state. Called after executing secondary buffers, just like Vulkan does.
+    void resetBoundState();
+    
+    RecordingCommandPool* pool;
+    std::string name;
+    
+    std::vector<std::uint8_t> stream;
+    std::array<std::uint64_t, static_cast<std::size_t>(RecordedCommandType::COUNT)> commandCounts;
+    std::vector<std::string> validationErrors;
+    
+    bool recording;
+    bool renderPassActive;
+    bool continuesRenderPass;
+    SubpassContents subpassContents;
+    
+    bool pipelineBound;
+    bool indexBufferBound;
+    bool viewportSet;
+    bool scissorSet;
+};
+
+/// A CommandPool that creates RecordingCommandBuffer instances.
+///
+/// Like in Vulkan, buffers that were allocated from the same pool must not be recorded on different threads at the
+/// same time. The pool detects when that happens and reports it as a validation error of the offending buffer.
+class RecordingCommandPool : public CommandPool {
+public:
+    RecordingCommandPool(std::string name);
+    virtual ~RecordingCommandPool();
+    
+    virtual CommandBuffer* allocateCommandBuffer(const char* name, BufferLevel level = BufferLevel::Primary, bool beginBuffer = true) override;
+    virtual std::vector<CommandBuffer*> allocateCommandBuffers(const std::vector<const char*>* names, std::uint32_t count, BufferLevel level = BufferLevel::Primary, bool beginBuffers = false) override;
+    virtual void freeCommandBuffer(CommandBuffer* cmdBuf) override;
+    virtual void freeCommandBuffers(const std::vector<CommandBuffer*>& cmdBuffs) override;
+    
+    inline std::size_t getAllocatedBufferCount() const {
+        return allocatedBuffers.size();
+    }
+    
+    inline const std::string& getName() const {
+        return name;
+    }
+private:
+    friend class RecordingCommandBuffer;
+    
+    /// \return false if another thread is recording a buffer that belongs to this pool
+    bool beginRecording();
+    void endRecording();
+    
+    std::string name;
+    std::vector<RecordingCommandBuffer*> allocatedBuffers;
+    
+    std::mutex recordingMutex;
+    std::thread::id recordingThread;
+    std::size_t recordingBufferCount;
+};
+}
+
+#endif // IYF_RECORDING_COMMAND_BUFFER_HPP
@@ -0,0 +1,104 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_SHADER_VARIANT_CACHE_HPP
+#define IYF_SHADER_VARIANT_CACHE_HPP
+
+#include "graphics/GraphicsAPIConstants.hpp"
+#include "graphics/ShaderConstants.hpp"
+#include "io/Path.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace iyf {
+class FileSystem;
+struct ShaderCompilationSettings;
+
+/// Stores compiled shader bytecode in a directory on disk, one file per variant.
+///
+/// Each file is named after a key (see ComputeKey()) that covers everything the compilation depends on. Changing the
+/// source, the macros, the settings or the helper functions therefore produces a new key and stale entries are simply
+/// never looked up again. Each file starts with a small header that repeats the key and ends with a checksum of the
+/// contents. Files that fail validation are treated as missing.
+///
+/// The cache may be used from multiple threads at the same time. Entries are written to unique temporary files first
+/// and then renamed, so an interrupted or concurrent write can't leave a truncated entry behind.
+class ShaderVariantCache {
+public:
+    static constexpr std::uint32_t Magic = 0x43535649; // "IVSC"
+    
+    /// Must be incremented whenever the compiler (e.g., shaderc) is updated or the way the source is turned into
+    /// bytecode changes in a way that ComputeKey() can't see.
+    static constexpr std::uint16_t Version = 1;
+    
+    /// \param filesystem A filesystem that can access the directory, usually the DefaultFileSystem
+    /// \param directory A real directory that will store the entries. It's created if it doesn't exist. The cache is
+    /// disabled if the directory is empty or if it can't be created.
+    ShaderVariantCache(const FileSystem* filesystem, Path directory);
+    
+    /// Computes a key of a shader variant.
+    ///
+    /// \param language The language of the source
+    /// \param stage The stage of the shader
+    /// \param source Complete source code of the shader
+    /// \param settings Settings that will be used to compile the shader. ShaderCompilationSettings::logAssembly is ignored
+    /// because it doesn't change the bytecode.
+    /// \param helperFunctionVersion The value returned by ShaderGenerator::GetHelperFunctionVersion()
+    static std::uint64_t ComputeKey(ShaderLanguage language, ShaderStageFlagBits stage, const std::string& source, const ShaderCompilationSettings& settings, std::uint32_t helperFunctionVersion);
+    
+    /// Loads the bytecode of a variant.
+    ///
+    /// \return true if a valid entry was found and its contents were written to bytecode
+    bool load(std::uint64_t key, std::vector<std::uint8_t>& bytecode) const;
+    
+    /// Stores the bytecode of a variant, replacing the old entry if one exists.
+    ///
+    /// \return true if the entry was written
+    bool store(std::uint64_t key, const std::vector<std::uint8_t>& bytecode) const;
+    
+    /// \return Path of the file that stores the entry with the specified key
+    Path makeEntryPath(std::uint64_t key) const;
+    
+    inline bool isEnabled() const {
+        return enabled;
+    }
+    
+    inline const Path& getDirectory() const {
+        return directory;
+    }
+private:
+    const FileSystem* filesystem;
+    Path directory;
+    bool enabled;
+};
+
+}
+
+#endif // IYF_SHADER_VARIANT_CACHE_HPP
@@ -0,0 +1,120 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_SHADER_VARIANT_COMPILER_HPP
+#define IYF_SHADER_VARIANT_COMPILER_HPP
+
+#include "graphics/shaderGeneration/ShaderGenerator.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace iyft {
+class ThreadPool;
+}
+
+namespace iyf {
+class FileSystem;
+class ShaderVariantCache;
+class VulkanGLSLShaderGenerator;
+
+/// A single variant of a shader that needs to be compiled by the ShaderVariantCompiler
+struct ShaderVariant {
+    ShaderVariant() : stage(ShaderStageFlagBits::Vertex), source(nullptr), loadedFromCache(false) {}
+    
+    ShaderStageFlagBits stage;
+    
+    /// Complete source code of the shader. Variants of the same shader should point to the same string, which must stay
+    /// alive until ShaderVariantCompiler::compile() returns.
+    const std::string* source;
+    
+    /// The name that will be used in error messages
+    std::string name;
+    
+    ShaderCompilationSettings settings;
+    
+    /// Set by ShaderVariantCompiler::compile(). Variants that weren't processed because another variant failed to compile
+    /// keep a default constructed (invalid) result.
+    ShaderCompilationResult result;
+    
+    /// Set by ShaderVariantCompiler::compile() if the result was loaded from the ShaderVariantCache
+    bool loadedFromCache;
+};
+
+/// Compiles many variants of GLSL shaders at once.
+///
+/// The variants are distributed among a private ThreadPool and the thread that calls compile(). Each of these threads
+/// has its own VulkanGLSLShaderGenerator and, therefore, its own shaderc::Compiler. A private pool is used because
+/// compile() is typically called from tasks that already run on one of the Engine's pools and waiting for tasks of the
+/// same pool from one of its workers could deadlock.
+///
+/// If a ShaderVariantCache is provided, variants are looked up in it before compiling and newly compiled variants are
+/// added to it.
+class ShaderVariantCompiler {
+public:
+    /// \param fileSystem File system that will be passed to the VulkanGLSLShaderGenerator instances
+    /// \param threadCount Total number of threads that compile the variants, including the one that calls compile(). If
+    /// 0, std::thread::hardware_concurrency() is used.
+    /// \param cache An optional cache of compiled variants
+    ShaderVariantCompiler(const FileSystem* fileSystem, std::size_t threadCount = 0, std::unique_ptr<ShaderVariantCache> cache = nullptr);
+    ~ShaderVariantCompiler();
+    
+    /// Compiles all variants and stores the results in them. Compilation stops early if a variant fails to compile.
+    ///
+    /// \remark This method is thread safe, but concurrent calls are executed one after another.
+    ///
+    /// \throws The first exception thrown while compiling a variant. It's rethrown once all threads stop working.
+    ///
+    /// \return true if all variants were compiled or loaded from the cache successfully
+    bool compile(std::vector<ShaderVariant>& variants);
+    
+    inline std::size_t getThreadCount() const {
+        return generators.size();
+    }
+    
+    /// \return The cache or nullptr if the compiler doesn't have one
+    inline const ShaderVariantCache* getCache() const {
+        return cache.get();
+    }
+private:
+    void compileVariant(const VulkanGLSLShaderGenerator& generator, ShaderVariant& variant) const;
+    
+    /// The first generator is used by the thread that calls compile(), others by the workers of the pool
+    std::vector<std::unique_ptr<VulkanGLSLShaderGenerator>> generators;
+    
+    /// nullptr if only one thread is used
+    std::unique_ptr<iyft::ThreadPool> pool;
+    std::unique_ptr<ShaderVariantCache> cache;
+    std::mutex compilationMutex;
+};
+
+}
+
+#endif // IYF_SHADER_VARIANT_COMPILER_HPP
@@ -105,6 +105,8 @@ public:
     
     virtual void copyImageToBuffer(const Image& srcImage, ImageLayout layout, const Buffer& dstBuffer, const std::vector<BufferImageCopy>& regions) final override;
     
+    virtual void executeCommands(std::uint32_t count, CommandBuffer* const* buffers) final override;
+    
     virtual CommandBufferHnd getHandle() override {
         return CommandBufferHnd(cmdBuff);
     }
@@ -113,6 +115,7 @@ protected:
     std::vector<VkDeviceSize> tempOffsets;
     std::vector<VkViewport> tempViewports;
     std::vector<VkRect2D> tempScissors;
+    std::vector<VkCommandBuffer> tempSecondaryBuffers;
     
     VulkanAPI* backend;
     VkCommandBuffer cmdBuff;
@@ -156,6 +159,12 @@ public:
     virtual Pipeline createPipeline(const ComputePipelineCreateInfo& info, const char* name) override;
     virtual bool destroyPipeline(const Pipeline& pipeline) override;
     
+    virtual PipelineCacheIdentity getPipelineCacheIdentity() const override;
+    virtual PipelineCacheHnd createPipelineCache(const void* initialData, std::size_t byteCount, const char* name) override;
+    virtual bool destroyPipelineCache(PipelineCacheHnd handle) override;
+    virtual std::vector<std::uint8_t> getPipelineCacheData(PipelineCacheHnd handle) override;
+    virtual PipelineCacheHnd getMainPipelineCache() const override;
+    
     virtual PipelineLayoutHnd createPipelineLayout(const PipelineLayoutCreateInfo& info, const char* name) override;
     virtual bool destroyPipelineLayout(PipelineLayoutHnd handle) override;
     virtual DescriptorSetLayoutHnd createDescriptorSetLayout(const DescriptorSetLayoutCreateInfo& info, const char* name) override;
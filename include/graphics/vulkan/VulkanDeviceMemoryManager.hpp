@@ -27,6 +27,7 @@
 // WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "graphics/vulkan/VulkanAPI.hpp"
+#include "graphics/StagingRingAllocator.hpp"
 
 // Do not include this in VulkanAPI.hpp or any other headers that get included in many places.
 // This library pulls in vulkan.h and that includes a ton of OS specific stuff.
@@ -56,6 +57,7 @@ public:
     virtual bool isStagingBufferNeeded(const Buffer& destinationBuffer) final override;
     virtual bool canBatchFitData(MemoryBatch batch, Bytes totalSize) final override;
     virtual bool updateBuffer(MemoryBatch batch, const Buffer& destinationBuffer, const std::vector<BufferCopy>& copies, const void* data) final override;
+    virtual bool copyBuffer(MemoryBatch batch, const Buffer& sourceBuffer, const Buffer& destinationBuffer, const std::vector<BufferCopy>& copies) final override;
     virtual bool updateImage(MemoryBatch batch, const Image& image, const TextureData& data) final override;
     virtual bool beginBatchUpload(MemoryBatch batch) final override;
     
@@ -66,37 +68,28 @@ public:
     virtual bool destroyImage(const Image& image) final override;
 private:
     struct StagingBufferData {
-        StagingBufferData() : currentOffset(0), maxRequestedUploadSize(0), uploadCalls(0), APIObjectsCreated(false) {}
+        StagingBufferData() : currentSlot(0), maxRequestedUploadSize(0), uploadCalls(0), APIObjectsCreated(false), recording(false) {}
         
-        std::vector<Buffer> buffers;
+        /// A single staging buffer that's sub-allocated as a ring. The uploads of several frames can use it at once.
+        Buffer buffer;
+        StagingRingAllocator ring;
+        
+        /// Every upload submission gets its own command buffer and fence. The fence IDs that the ring receives are
+        /// indices into these vectors. The slots are used in a round robin fashion.
         std::vector<CommandBuffer*> commandBuffers;
+        std::vector<FenceHnd> fences;
+        std::size_t currentSlot;
         
-        std::uint64_t currentOffset;
         std::uint64_t maxRequestedUploadSize;
         std::uint32_t uploadCalls;
         MemoryBatch batch;
         bool APIObjectsCreated;
         
-        inline bool hasDataThisFrame() const {
-            return currentOffset != 0;
-        }
-        
-        inline Buffer& getBufferForThisFrame(GraphicsAPI* gfx) {
-            const std::uint32_t swapImage = gfx->getCurrentSwapImage();
-            
-            assert(!buffers.empty());
-            assert(swapImage < buffers.size());
-            
-            return buffers[swapImage];
-        }
+        /// True if something was recorded into the command buffer of the current slot and it hasn't been submitted yet
+        bool recording;
         
-        inline CommandBuffer* getCommandBufferForThisFrame(GraphicsAPI* gfx) {
-            const std::uint32_t swapImage = gfx->getCurrentSwapImage();
-            
-            assert(!commandBuffers.empty());
-            assert(swapImage < commandBuffers.size());
-            
-            return commandBuffers[swapImage];
+        inline bool hasDataThisFrame() const {
+            return recording;
         }
     };
     
@@ -104,12 +97,27 @@ private:
     StagingBufferData& getStagingBufferForBatch(MemoryBatch batch);
     
     bool initOrUpdateStagingBuffer(MemoryBatch batch, Bytes size);
-    void executeUpload(CommandBuffer* commandBuffer, bool waitForCompletion);
+    
+    /// Returns the command buffer of the current slot and starts recording it if needed. Only waits for the GPU if
+    /// the uploads of all slots are still in flight.
+    CommandBuffer* beginRecording(StagingBufferData& data);
+    
+    /// Allocates staging memory for the current slot. Waits for older uploads if the ring is full.
+    ///
+    /// \throws std::runtime_error if the data doesn't fit even after all older uploads complete
+    std::uint64_t allocateStagingMemory(StagingBufferData& data, std::uint64_t size);
+    
+    /// Returns the staging memory of all completed uploads to the ring without waiting.
+    void reclaimStagingMemory(StagingBufferData& data);
+    
+    /// Waits for the oldest upload of the batch and returns its staging memory to the ring.
+    void waitForOldestUpload(StagingBufferData& data);
+    
+    void executeUpload(StagingBufferData& data, bool waitForCompletion);
     void resetData(StagingBufferData& data);
     
     VulkanAPI* gfx;
     CommandPool* commandPool;
-    FenceHnd uploadCompleteFence;
     std::array<StagingBufferData, StagingBufferCount> stagingBuffers;
     bool firstFrame;
     
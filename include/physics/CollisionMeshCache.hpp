@@ -0,0 +1,109 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_COLLISION_MESH_CACHE_HPP
+#define IYF_COLLISION_MESH_CACHE_HPP
+
+#include "physics/GraphicsToPhysicsDataMapping.hpp"
+#include "utilities/DataSizes.hpp"
+#include "utilities/hashing/Hashing.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+namespace iyf {
+/// \brief Stores compact copies of mesh data that physics engines need in order to build collision shapes.
+///
+/// Only the positions are kept (tightly packed as 3 floats) instead of complete vertices. 32 bit indices get
+/// narrowed to 16 bits whenever the vertex count allows it. This makes it possible to drop the host side copies
+/// of vertex and index buffers without losing the ability to build triangle mesh collision shapes.
+class CollisionMeshCache {
+public:
+    /// The stride of the cached positions
+    static constexpr std::uint32_t PositionStride = 3 * sizeof(float);
+    
+    CollisionMeshCache() : memoryUsage(0) {}
+    
+    /// \brief Creates a compact copy of the mesh data and stores it under the specified key, replacing old data, if any.
+    ///
+    /// \param[in] key Key that identifies the mesh, typically its name hash
+    /// \param[in] vertices Vertex data. The position must be stored as 3 floats
+    /// \param[in] vertexCount Number of vertices
+    /// \param[in] vertexStride Size of a single vertex, in bytes
+    /// \param[in] positionOffset Offset of the position attribute in a vertex, in bytes
+    /// \param[in] indices Index data
+    /// \param[in] indexCount Number of indices
+    /// \param[in] indexStride Size of a single index. Must be 2 or 4
+    /// \return Mappings that can be passed to the physics engine
+    std::pair<GraphicsToPhysicsDataMapping, GraphicsToPhysicsDataMapping> insert(StringHash key, const void* vertices, std::size_t vertexCount,
+        std::uint32_t vertexStride, std::uint32_t positionOffset, const void* indices, std::size_t indexCount, std::uint32_t indexStride);
+    
+    /// \return true if data for the key has been cached
+    inline bool contains(StringHash key) const {
+        return entries.find(key) != entries.end();
+    }
+    
+    /// \warning The mappings are only valid until the key is erased or replaced
+    ///
+    /// \throws std::out_of_range if nothing was cached under the key
+    std::pair<GraphicsToPhysicsDataMapping, GraphicsToPhysicsDataMapping> getMapping(StringHash key) const;
+    
+    /// \return true if the key was found and erased
+    bool erase(StringHash key);
+    
+    void clear();
+    
+    inline std::size_t getSize() const {
+        return entries.size();
+    }
+    
+    /// \return Total amount of memory used by the cached data
+    inline Bytes getMemoryUsage() const {
+        return Bytes(memoryUsage);
+    }
+private:
+    struct Entry {
+        /// Positions followed by indices
+        std::unique_ptr<char[]> data;
+        std::size_t vertexCount;
+        std::size_t indexCount;
+        std::uint32_t indexStride;
+        
+        inline std::size_t getSize() const {
+            return vertexCount * PositionStride + indexCount * indexStride;
+        }
+    };
+    
+    std::unordered_map<StringHash, Entry> entries;
+    std::uint64_t memoryUsage;
+};
+}
+
+#endif // IYF_COLLISION_MESH_CACHE_HPP
@@ -30,6 +30,8 @@
 #ifndef IYF_GRAPHICS_TO_PHYSICS_DATA_MAPPING_HPP
 #define IYF_GRAPHICS_TO_PHYSICS_DATA_MAPPING_HPP
 
+#include <cstddef>
+
 namespace iyf {
 struct GraphicsToPhysicsDataMapping {
     GraphicsToPhysicsDataMapping(const char* data, std::size_t count, std::size_t stride) : data(data), count(count), stride(stride) { }
@@ -56,6 +56,9 @@ public:
     
     virtual void update(float delta, const EntityStateVector& entityStates) final override;
     
+    /// Runs the simulation step on a worker and the debug drawing, which needs the renderer, on the main thread.
+    virtual void declareJobs(TaskGraph& graph, const EntityStateVector& entityStates) final override;
+    
     virtual Component& createAndAttachComponent(const EntityKey& key, const ComponentType& type) final override;
     
     virtual void collectGarbage(GarbageCollectionRunPolicy policy) final override;
@@ -74,6 +77,9 @@ protected:
         return dynamicsWorld;
     }
     
+    void stepSimulation(float delta);
+    void drawDebugData(float delta);
+    
     btBroadphaseInterface* broadphase;
     btDefaultCollisionConfiguration* collisionConfiguration;
     btCollisionDispatcher* dispatcher;
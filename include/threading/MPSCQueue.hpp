@@ -0,0 +1,157 @@
+// The IYFThreading library
+//
+// Copyright (C) 2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of other contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// \file MPSCQueue.hpp Contains a lock-free multi-producer single-consumer queue
+
+#ifndef IYFT_MPSC_QUEUE_HPP
+#define IYFT_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <utility>
+
+namespace iyft {
+
+/// \brief A lock-free, unbounded multi-producer single-consumer FIFO queue.
+///
+/// Any number of threads may push items concurrently. A single consumer thread pops them
+/// in the order in which the pushes were linked into the queue.
+///
+/// The implementation follows Dmitry Vyukov's non-intrusive MPSC node-based queue. push()
+/// is wait-free (a single atomic exchange) and pop() never blocks. Each push allocates a
+/// node, which makes the queue a good fit for infrequent, heavy items (e.g., loaded asset
+/// data) and a poor fit for fine grained tasks.
+///
+/// \remark A push that has exchanged the head, but hasn't linked its node yet, is invisible
+/// to the consumer. front() and pop() report an empty queue until the link is made, which
+/// only delays the item and never loses it.
+///
+/// \warning Only the consumer thread may call front(), pop() and empty(). push() is safe to
+/// call from any thread.
+template <typename T>
+class MPSCQueue {
+public:
+    MPSCQueue() : head(&stub), tail(&stub) {
+        stub.next.store(nullptr, std::memory_order_relaxed);
+    }
+    
+    /// \brief Destroys all items that were not popped. Must not race with push().
+    ~MPSCQueue() {
+        Node* current = tail->next.load(std::memory_order_acquire);
+        
+        while (current != nullptr) {
+            Node* next = current->next.load(std::memory_order_acquire);
+            delete current;
+            current = next;
+        }
+        
+        if (tail != &stub) {
+            delete tail;
+        }
+    }
+    
+    /// \brief Explicitly disabled to get cleaner errors.
+    MPSCQueue(const MPSCQueue&) = delete;
+    /// \brief Explicitly disabled to get cleaner errors.
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+    
+    /// \brief Pushes an item to the back of the queue. May be called from any thread.
+    template <typename... Args>
+    void push(Args&&... args) {
+        Node* node = new Node(std::forward<Args>(args)...);
+        
+        Node* previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+    
+    /// \brief Returns a pointer to the item at the front of the queue or nullptr if no
+    /// items are available. Consumer thread only.
+    ///
+    /// The item stays in the queue and can be inspected (or modified) before calling pop().
+    T* front() {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        return (next != nullptr) ? &next->item : nullptr;
+    }
+    
+    /// \copydoc front()
+    const T* front() const {
+        const Node* next = tail->next.load(std::memory_order_acquire);
+        return (next != nullptr) ? &next->item : nullptr;
+    }
+    
+    /// \brief Returns true if no items are available. Consumer thread only.
+    bool empty() const {
+        return front() == nullptr;
+    }
+    
+    /// \brief Pops an item from the front of the queue. Consumer thread only.
+    ///
+    /// \param[out] item The popped item. Only valid if this function returned true.
+    /// \return true if an item was popped, false if no items were available.
+    bool pop(T& item) {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        
+        if (next == nullptr) {
+            return false;
+        }
+        
+        // next becomes the new stub. Its item has been moved out and will be destroyed
+        // together with the node during the next pop() or in the destructor.
+        item = std::move(next->item);
+        
+        if (tail != &stub) {
+            delete tail;
+        }
+        
+        tail = next;
+        return true;
+    }
+private:
+    struct Node {
+        Node() : next(nullptr) {}
+        
+        template <typename... Args>
+        explicit Node(Args&&... args) : next(nullptr), item(std::forward<Args>(args)...) {}
+        
+        std::atomic<Node*> next;
+        T item;
+    };
+    
+    /// \brief The node that was pushed last. Modified by the producers.
+    alignas(64) std::atomic<Node*> head;
+    
+    /// \brief The current stub node. Its successor is the front of the queue. Only modified
+    /// by the consumer.
+    alignas(64) Node* tail;
+    
+    /// \brief The initial stub node. Requires T to be default constructible.
+    Node stub;
+};
+
+}
+
+#endif // IYFT_MPSC_QUEUE_HPP
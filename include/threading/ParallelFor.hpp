@@ -0,0 +1,129 @@
+// The IYFThreading library
+//
+// Copyright (C) 2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of other contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// \file ParallelFor.hpp Contains a function that spreads independent work over a ThreadPool.
+
+#ifndef IYFT_PARALLEL_FOR_HPP
+#define IYFT_PARALLEL_FOR_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+
+#include "ThreadPool.hpp"
+
+namespace iyft {
+/// \brief Returns the number of threads that ParallelFor() can use, including the calling thread.
+///
+/// A worker that calls ParallelFor() blocks until all of the work is done, which means that it can't execute
+/// any of the tasks it adds. Such a worker is counted once, as the calling thread.
+///
+/// \param pool The pool to run the work on. If it's nullptr, only the calling thread is used.
+inline std::size_t GetParallelForThreadCount(const ThreadPool* pool) {
+    if (pool == nullptr) {
+        return 1;
+    }
+    
+    const std::size_t workerCount = pool->getWorkerCount();
+    return pool->isWorkerThread() ? workerCount : (workerCount + 1);
+}
+
+/// \brief Calls work(i) for every i in [0, count) and blocks until all calls have completed.
+///
+/// The calling thread and up to count - 1 helper tasks keep claiming the next index until none are left, so
+/// each index is processed exactly once, but by an unspecified thread and in an unspecified order. The calls
+/// must be independent. It's safe to call this function from a worker of pool.
+///
+/// \throws Rethrows the first exception thrown by work. The remaining indices are skipped after a call throws,
+/// but the function still waits for the calls that are running, because they use the state of the caller.
+///
+/// \param pool The pool to run the helper tasks on. If it's nullptr, everything runs on the calling thread.
+/// \param count The number of indices to process.
+/// \param work The function to call. Must accept a single std::size_t.
+template <typename T>
+void ParallelFor(ThreadPool* pool, std::size_t count, const T& work) {
+    if (count == 0) {
+        return;
+    }
+    
+    std::size_t helperCount = GetParallelForThreadCount(pool) - 1;
+    if (helperCount > count - 1) {
+        helperCount = count - 1;
+    }
+    
+    if (helperCount == 0) {
+        for (std::size_t i = 0; i < count; ++i) {
+            work(i);
+        }
+        
+        return;
+    }
+    
+    std::atomic<std::size_t> next(0);
+    std::atomic<bool> failed(false);
+    auto claimAndRun = [&work, &next, &failed, count]() {
+        std::size_t i;
+        while (!failed.load(std::memory_order_relaxed) && (i = next.fetch_add(1, std::memory_order_relaxed)) < count) {
+            try {
+                work(i);
+            } catch (...) {
+                failed.store(true, std::memory_order_relaxed);
+                throw;
+            }
+        }
+    };
+    
+    // The Barrier notifies even if a helper throws and hands its exception to waitForAll()
+    Barrier barrier(static_cast<int>(helperCount));
+    for (std::size_t i = 0; i < helperCount; ++i) {
+        pool->addTask(barrier, claimAndRun);
+    }
+    
+    std::exception_ptr exception;
+    try {
+        claimAndRun();
+    } catch (...) {
+        exception = std::current_exception();
+    }
+    
+    try {
+        barrier.waitForAll();
+    } catch (...) {
+        if (exception == nullptr) {
+            exception = std::current_exception();
+        }
+    }
+    
+    if (exception != nullptr) {
+        std::rethrow_exception(exception);
+    }
+}
+
+}
+
+#endif // IYFT_PARALLEL_FOR_HPP
@@ -0,0 +1,476 @@
+// The IYFThreading library
+//
+// Copyright (C) 2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of other contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// \file Task.hpp Contains a move-only task type with inline storage and the pools used by the ThreadPool
+
+#ifndef IYFT_TASK_HPP
+#define IYFT_TASK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Spinlock.hpp"
+
+namespace iyft {
+
+/// \brief A move-only, type erased void() callable with inline storage.
+///
+/// Callables that fit into InlineSize bytes, don't need more than std::max_align_t alignment and
+/// can be moved without throwing are stored inside the Task itself and no memory is allocated.
+/// Everything else is stored on the heap.
+class Task {
+public:
+    /// \brief The number of bytes available for inline storage.
+    static constexpr std::size_t InlineSize = 64;
+    
+    /// \brief Creates an empty Task.
+    Task() noexcept : operations(nullptr) {}
+    
+    /// \brief Creates a Task that wraps the provided callable.
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    Task(F&& f) {
+        using Callable = std::decay_t<F>;
+        
+        if constexpr (FitsInline<Callable>()) {
+            new (&storage) Callable(std::forward<F>(f));
+            operations = &InlineOperations<Callable>;
+        } else {
+            Callable* callable = new Callable(std::forward<F>(f));
+            new (&storage) Callable*(callable);
+            operations = &HeapOperations<Callable>;
+        }
+    }
+    
+    /// \brief Explicitly disabled because the stored callables may be move-only.
+    Task(const Task&) = delete;
+    
+    /// \brief Explicitly disabled because the stored callables may be move-only.
+    Task& operator=(const Task&) = delete;
+    
+    Task(Task&& other) noexcept : operations(other.operations) {
+        if (operations != nullptr) {
+            operations->move(&storage, &other.storage);
+            other.operations = nullptr;
+        }
+    }
+    
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            
+            operations = other.operations;
+            if (operations != nullptr) {
+                operations->move(&storage, &other.storage);
+                other.operations = nullptr;
+            }
+        }
+        
+        return *this;
+    }
+    
+    ~Task() {
+        reset();
+    }
+    
+    /// \brief Executes the stored callable.
+    ///
+    /// \warning Calling this on an empty Task is undefined behaviour.
+    inline void operator()() {
+        operations->invoke(&storage);
+    }
+    
+    /// \brief Checks if the Task stores a callable.
+    explicit operator bool() const noexcept {
+        return operations != nullptr;
+    }
+    
+    /// \brief Checks if a callable of type F would be stored without allocating memory.
+    template <typename F>
+    static constexpr bool FitsInline() {
+        return sizeof(F) <= InlineSize && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+    }
+    
+    /// \brief Destroys the stored callable (if any) and makes the Task empty.
+    void reset() noexcept {
+        if (operations != nullptr) {
+            operations->destroy(&storage);
+            operations = nullptr;
+        }
+    }
+private:
+    using Storage = std::aligned_storage_t<InlineSize, alignof(std::max_align_t)>;
+    
+    /// \brief Type specific operations. One static instance exists for each stored type.
+    struct Operations {
+        void (*invoke)(void* storage);
+        void (*move)(void* destination, void* source) noexcept;
+        void (*destroy)(void* storage) noexcept;
+    };
+    
+    template <typename F>
+    static inline const Operations InlineOperations = {
+        [](void* storage) {
+            (*static_cast<F*>(storage))();
+        },
+        [](void* destination, void* source) noexcept {
+            F* f = static_cast<F*>(source);
+            new (destination) F(std::move(*f));
+            f->~F();
+        },
+        [](void* storage) noexcept {
+            static_cast<F*>(storage)->~F();
+        }
+    };
+    
+    template <typename F>
+    static inline const Operations HeapOperations = {
+        [](void* storage) {
+            (**static_cast<F**>(storage))();
+        },
+        [](void* destination, void* source) noexcept {
+            new (destination) F*(*static_cast<F**>(source));
+        },
+        [](void* storage) noexcept {
+            delete *static_cast<F**>(storage);
+        }
+    };
+    
+    Storage storage;
+    const Operations* operations;
+};
+
+/// \brief Creates a callable that invokes f with args, just like std::bind does.
+///
+/// Copies (or moves) of f and args are stored and passed to f as lvalues when the callable is invoked.
+/// Unlike std::bind, the result can hold move-only types and it can be stored in a Task without
+/// allocating memory if it's small enough.
+template <typename F, typename... Args>
+inline auto BindTask(F&& f, Args&&... args) {
+    return [f = std::forward<F>(f), boundArgs = std::make_tuple(std::forward<Args>(args)...)]() mutable -> decltype(auto) {
+        return std::apply(f, boundArgs);
+    };
+}
+
+/// \brief A growable ring buffer of Task objects.
+///
+/// Used instead of std::queue because std::deque allocates and frees memory blocks as the elements
+/// move through it. Once this queue reaches its peak size, it never allocates again.
+class TaskQueue {
+public:
+    TaskQueue() : head(0), count(0) {
+        buffer.resize(256);
+    }
+    
+    inline bool empty() const {
+        return count == 0;
+    }
+    
+    inline std::size_t size() const {
+        return count;
+    }
+    
+    inline void emplace(Task&& task) {
+        if (count == buffer.size()) {
+            grow();
+        }
+        
+        buffer[(head + count) & (buffer.size() - 1)] = std::move(task);
+        count++;
+    }
+    
+    inline Task& front() {
+        return buffer[head];
+    }
+    
+    inline void pop() {
+        buffer[head].reset();
+        head = (head + 1) & (buffer.size() - 1);
+        count--;
+    }
+private:
+    void grow() {
+        std::vector<Task> newBuffer(buffer.size() * 2);
+        
+        for (std::size_t i = 0; i < count; ++i) {
+            newBuffer[i] = std::move(buffer[(head + i) & (buffer.size() - 1)]);
+        }
+        
+        buffer = std::move(newBuffer);
+        head = 0;
+    }
+    
+    /// \brief The size of this vector is always a power of two.
+    std::vector<Task> buffer;
+    std::size_t head;
+    std::size_t count;
+};
+
+/// \brief A Task that can be linked into a free list.
+struct TaskNode {
+    Task task;
+    TaskNode* next = nullptr;
+    
+    /// \brief Links batches of nodes in the shared list of a TaskNodePool.
+    TaskNode* nextBatch = nullptr;
+};
+
+/// \brief Recycles TaskNode objects that are stored in the deques of a work stealing ThreadPool.
+///
+/// Each worker has its own cache of free nodes that it accesses without any synchronization.
+/// Nodes are often released by a different worker than the one that acquired them (e.g., when
+/// they're stolen), so the caches exchange nodes with a shared list in batches of BatchSize.
+/// The shared list is protected by a Spinlock, but it's only touched once per BatchSize nodes.
+///
+/// Nodes are allocated in blocks and never freed until the pool is destroyed.
+class TaskNodePool {
+public:
+    /// \param cacheCount The number of per-worker caches. Each worker must use its own ID when
+    /// calling acquire() and release().
+    explicit TaskNodePool(std::size_t cacheCount) : caches(cacheCount), sharedBatches(nullptr) {}
+    
+    /// \brief Explicitly disabled to get cleaner errors.
+    TaskNodePool(const TaskNodePool&) = delete;
+    /// \brief Explicitly disabled to get cleaner errors.
+    TaskNodePool& operator=(const TaskNodePool&) = delete;
+    
+    /// \brief Returns a node that holds the provided Task.
+    ///
+    /// \param cacheID The ID of the calling worker.
+    TaskNode* acquire(std::size_t cacheID, Task&& task) {
+        Cache& cache = caches[cacheID];
+        
+        if (cache.head == nullptr) {
+            refill(cache);
+        }
+        
+        TaskNode* node = cache.head;
+        cache.head = node->next;
+        cache.count--;
+        
+        node->task = std::move(task);
+        node->next = nullptr;
+        return node;
+    }
+    
+    /// \brief Returns the node to the pool. The Task must have been moved out or reset.
+    ///
+    /// \param cacheID The ID of the calling worker.
+    void release(std::size_t cacheID, TaskNode* node) {
+        Cache& cache = caches[cacheID];
+        
+        node->next = cache.head;
+        cache.head = node;
+        cache.count++;
+        
+        if (cache.count >= BatchSize * 2) {
+            flush(cache);
+        }
+    }
+private:
+    static const std::size_t BlockSize = 256;
+    static const std::size_t BatchSize = 64;
+    
+    struct alignas(64) Cache {
+        TaskNode* head = nullptr;
+        std::size_t count = 0;
+    };
+    
+    /// \brief Takes a batch from the shared list or allocates a new block if it's empty.
+    void refill(Cache& cache) {
+        std::lock_guard<Spinlock> lock(spinlock);
+        
+        if (sharedBatches != nullptr) {
+            cache.head = sharedBatches;
+            cache.count = BatchSize;
+            
+            sharedBatches = sharedBatches->nextBatch;
+            return;
+        }
+        
+        blocks.push_back(std::make_unique<TaskNode[]>(BlockSize));
+        TaskNode* block = blocks.back().get();
+        
+        for (std::size_t i = 0; i < BlockSize; ++i) {
+            block[i].next = (i + 1 < BlockSize) ? &block[i + 1] : nullptr;
+        }
+        
+        cache.head = block;
+        cache.count = BlockSize;
+    }
+    
+    /// \brief Moves BatchSize nodes from the cache to the shared list.
+    void flush(Cache& cache) {
+        TaskNode* batch = cache.head;
+        
+        TaskNode* last = batch;
+        for (std::size_t i = 1; i < BatchSize; ++i) {
+            last = last->next;
+        }
+        
+        cache.head = last->next;
+        cache.count -= BatchSize;
+        last->next = nullptr;
+        
+        std::lock_guard<Spinlock> lock(spinlock);
+        batch->nextBatch = sharedBatches;
+        sharedBatches = batch;
+    }
+    
+    std::vector<Cache> caches;
+    
+    /// \brief Protects sharedBatches and blocks.
+    Spinlock spinlock;
+    
+    /// \brief Batches of exactly BatchSize nodes linked through TaskNode::nextBatch.
+    TaskNode* sharedBatches;
+    std::vector<std::unique_ptr<TaskNode[]>> blocks;
+};
+
+/// \brief A thread safe, size class based pool of memory blocks.
+///
+/// Backs the PooledAllocator that ThreadPool::addTaskWithResult() uses for the shared states of
+/// futures. Blocks are recycled, but never returned to the system.
+class BlockPool {
+public:
+    /// \brief Returns the global pool instance.
+    ///
+    /// \remark The instance is intentionally leaked because futures may outlive static objects.
+    static BlockPool& Instance() {
+        static BlockPool* pool = new BlockPool();
+        return *pool;
+    }
+    
+    /// \brief Explicitly disabled to get cleaner errors.
+    BlockPool(const BlockPool&) = delete;
+    /// \brief Explicitly disabled to get cleaner errors.
+    BlockPool& operator=(const BlockPool&) = delete;
+    
+    void* allocate(std::size_t bytes) {
+        const std::size_t sizeClass = GetSizeClass(bytes);
+        if (sizeClass == SizeClassCount) {
+            return ::operator new(bytes);
+        }
+        
+        FreeList& list = freeLists[sizeClass];
+        {
+            std::lock_guard<Spinlock> lock(list.spinlock);
+            
+            if (list.head != nullptr) {
+                FreeBlock* block = list.head;
+                list.head = block->next;
+                return block;
+            }
+        }
+        
+        return ::operator new(MinBlockSize << sizeClass);
+    }
+    
+    void deallocate(void* pointer, std::size_t bytes) {
+        const std::size_t sizeClass = GetSizeClass(bytes);
+        if (sizeClass == SizeClassCount) {
+            ::operator delete(pointer);
+            return;
+        }
+        
+        FreeList& list = freeLists[sizeClass];
+        FreeBlock* block = static_cast<FreeBlock*>(pointer);
+        
+        std::lock_guard<Spinlock> lock(list.spinlock);
+        block->next = list.head;
+        list.head = block;
+    }
+private:
+    BlockPool() {}
+    
+    static const std::size_t MinBlockSize = 32;
+    static const std::size_t SizeClassCount = 6;
+    
+    /// \return The size class (block size is MinBlockSize << class) or SizeClassCount if the size
+    /// is too big to be pooled.
+    static std::size_t GetSizeClass(std::size_t bytes) {
+        std::size_t sizeClass = 0;
+        while (sizeClass < SizeClassCount && (MinBlockSize << sizeClass) < bytes) {
+            sizeClass++;
+        }
+        
+        return sizeClass;
+    }
+    
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    
+    struct alignas(64) FreeList {
+        Spinlock spinlock;
+        FreeBlock* head = nullptr;
+    };
+    
+    FreeList freeLists[SizeClassCount];
+};
+
+/// \brief A stateless allocator that takes its memory from BlockPool::Instance().
+template <typename T>
+class PooledAllocator {
+public:
+    using value_type = T;
+    
+    PooledAllocator() noexcept {}
+    
+    template <typename U>
+    PooledAllocator(const PooledAllocator<U>&) noexcept {}
+    
+    T* allocate(std::size_t n) {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "Over-aligned types are not supported");
+        return static_cast<T*>(BlockPool::Instance().allocate(n * sizeof(T)));
+    }
+    
+    void deallocate(T* pointer, std::size_t n) noexcept {
+        BlockPool::Instance().deallocate(pointer, n * sizeof(T));
+    }
+    
+    template <typename U>
+    friend bool operator==(const PooledAllocator&, const PooledAllocator<U>&) noexcept {
+        return true;
+    }
+    
+    template <typename U>
+    friend bool operator!=(const PooledAllocator&, const PooledAllocator<U>&) noexcept {
+        return false;
+    }
+};
+
+}
+
+#endif // IYFT_TASK_HPP
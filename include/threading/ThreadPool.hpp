@@ -36,13 +36,27 @@
 #include <mutex>
 #include <condition_variable>
 #include <future>
-#include <queue>
 #include <iostream>
+#include <random>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
 
-#if __cplusplus >= 201703L
-#define IYFT_HAS_CPP17
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define IYFT_CPU_RELAX() _mm_pause()
+#else
+#define IYFT_CPU_RELAX() std::this_thread::yield()
 #endif
 
+#include "Task.hpp"
+#include "WorkStealingDeque.hpp"
+
 #ifdef IYFT_THREAD_POOL_PROFILE
 #include "ThreadProfiler.hpp"
 #endif // IYFT_THREAD_POOL_PROFILE
@@ -81,24 +95,38 @@ public:
     ///
     /// \warning This function will cause a deadlock if you add less than taskCount 
     /// tasks that use this barrier to the ThreadPool.
+    ///
+    /// \throws The first exception that was thrown by a task that uses this barrier.
+    /// It's rethrown only after all tasks complete.
     void waitForAll() {
         std::unique_lock<std::mutex> lock(counterMutex);
         barrierCondition.wait(lock, [this]{
             return taskCount == 0;
         });
+        
+        if (exception != nullptr) {
+            std::rethrow_exception(exception);
+        }
     }
 private:
     friend class ThreadPool;
     
     /// \brief Called by the ThreadPool to notify that the task finished executing.
-    void notifyCompleted() {
-        {
-            std::lock_guard<std::mutex> lock(counterMutex);
-            taskCount--;
-            
-            if (taskCount < 0) {
-                throw std::runtime_error("Too many completed task notifications. Did you set the correct task count when creating the barrier?");
-            }
+    ///
+    /// \param taskException The exception that the task threw or nullptr if it completed
+    /// normally. Only the first one is kept.
+    void notifyCompleted(std::exception_ptr taskException = nullptr) {
+        // Notifying under the lock matters. Barriers usually live on the stack of the waiting thread, which may
+        // destroy it as soon as it observes taskCount == 0.
+        std::lock_guard<std::mutex> lock(counterMutex);
+        taskCount--;
+        
+        if (taskCount < 0) {
+            throw std::runtime_error("Too many completed task notifications. Did you set the correct task count when creating the barrier?");
+        }
+        
+        if (exception == nullptr) {
+            exception = taskException;
         }
         
         barrierCondition.notify_all();
@@ -112,6 +140,25 @@ private:
     
     /// \brief A condition variable that's used for waiting.
     std::condition_variable barrierCondition;
+    
+    /// \brief The first exception thrown by a task that used this barrier.
+    std::exception_ptr exception;
+};
+
+/// \brief Determines how a ThreadPool distributes tasks between its workers.
+enum class SchedulingMode {
+    /// \brief All tasks are stored in a single queue that is protected by a mutex.
+    ///
+    /// Simple and fair, but the workers start contending for the mutex when many small
+    /// tasks are submitted.
+    SharedQueue,
+    /// \brief Each worker owns a lock-free deque and steals from random victims when
+    /// it runs out of work.
+    ///
+    /// Tasks that are added from inside a worker are pushed to its own deque without
+    /// taking any locks. Tasks that are added from other threads go to a shared
+    /// injection queue.
+    WorkStealing
 };
 
 /// \brief A class that assigns work to multiple threads.
@@ -151,11 +198,30 @@ public:
     /// threads (e.g., set priorities and/or core affinities using native handles,
     /// set custom thread names, etc.).
     inline ThreadPool(std::size_t workerCount, SetupFunction setupFunction = &DefaultSetupFunction)
-        : tasksInFlight(0), running(true) {
+        : ThreadPool(workerCount, SchedulingMode::SharedQueue, setupFunction) {}
+    
+    /// \brief Creates a ThreadPool with the specified number of workers and the
+    /// specified SchedulingMode.
+    ///
+    /// \param workerCount The number of workers to create. Must be > 0
+    /// \param mode Determines how the tasks are distributed between the workers.
+    /// \param setupFunction An optional function that can be used to setup the
+    /// threads (e.g., set priorities and/or core affinities using native handles,
+    /// set custom thread names, etc.).
+    inline ThreadPool(std::size_t workerCount, SchedulingMode mode, SetupFunction setupFunction = &DefaultSetupFunction)
+        : pendingTasks(0), completionEpoch(0), completionWaiters(0), spinLimit(MinSpinLimit), taskNodes((mode == SchedulingMode::WorkStealing) ? workerCount : 0), queuedTaskCount(0), sleepingWorkers(0), mode(mode), running(true) {
         if (workerCount == 0) {
             throw std::logic_error("workerCount must be > 0");
         }
         
+        if (mode == SchedulingMode::WorkStealing) {
+            localQueues.reserve(workerCount);
+            
+            for (std::size_t i = 0; i < workerCount; ++i) {
+                localQueues.push_back(std::make_unique<WorkStealingDeque<TaskNode*>>());
+            }
+        }
+        
         workers.reserve(workerCount);
         
         for (std::size_t i = 0; i < workerCount; ++i) {
@@ -188,6 +254,11 @@ public:
         }
     }
     
+    /// \brief Returns the SchedulingMode that was chosen when creating this pool.
+    inline SchedulingMode getSchedulingMode() const {
+        return mode;
+    }
+    
     /// \brief The default thread setup function that does nothing.
     static void DefaultSetupFunction(std::size_t, std::size_t) {}
     
@@ -198,139 +269,136 @@ public:
         return workers.size();
     }
     
+    /// \brief Checks if the calling thread is one of the workers of this pool.
+    ///
+    /// Useful for code that splits its work into multiple tasks and then blocks until
+    /// they complete. A worker that blocks cannot execute the tasks it has just added,
+    /// so such code should submit one task less (or none at all) when this returns true.
+    inline bool isWorkerThread() const {
+        return CurrentWorker().pool == this;
+    }
+
     /// \brief Returns the number of tasks remaining in the queue.
     ///
+    /// \remark When the SchedulingMode::WorkStealing is used, the value is approximate
+    /// because the local queues of the workers are modified without taking any locks.
+    ///
     /// \return The number of tasks.
     inline std::size_t getRemainingTaskCount() const {
+        if (mode == SchedulingMode::WorkStealing) {
+            const std::int64_t count = queuedTaskCount.load();
+            return (count > 0) ? static_cast<std::size_t>(count) : 0;
+        }
+        
         std::unique_lock<std::mutex> lock(taskMutex);
         return tasks.size();
     }
     
     /// \brief Adds a task that returns nothing.
+    ///
+    /// \remark No memory is allocated if the callable and the copies of the arguments fit into the
+    /// inline storage of a Task and the queues have already grown to their peak size.
     template<typename F, typename... Args>
     inline void addTask(F&& f, Args&&... args) {
 #ifdef IYFT_THREAD_POOL_PROFILE
         IYFT_PROFILE(AddTaskNoResultNoBarrier);
 #endif // IYFT_THREAD_POOL_PROFILE
 
-        {
-            std::lock_guard<std::mutex> lock(taskMutex);
-            
-            checkRunning();
-            
-            // If I recall correctly, assigning a packaged_task that returns a 
-            // non-void to one that does invokes undefined behaviour.
-            auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-            tasks.emplace([func](){
-                func();
-            });
-        }
-        
-        newTaskNotifier.notify_one();
+        enqueue(Task(BindTask(std::forward<F>(f), std::forward<Args>(args)...)));
     }
     
     /// \brief Adds a task that returns nothing and notifies a barrier upon 
     /// completion.
+    ///
+    /// \remark The barrier is notified even if the task throws. The exception is
+    /// rethrown by Barrier::waitForAll().
     template<typename F, typename... Args>
     inline void addTask(Barrier& barrier, F&& f, Args&&... args) {
 #ifdef IYFT_THREAD_POOL_PROFILE
         IYFT_PROFILE(AddTaskNoResultWithBarrier);
 #endif // IYFT_THREAD_POOL_PROFILE
-        {
-            std::lock_guard<std::mutex> lock(taskMutex);
+        enqueue(Task([func = BindTask(std::forward<F>(f), std::forward<Args>(args)...), &barrier]() mutable {
+            BarrierNotifier notifier(barrier);
             
-            checkRunning();
-            
-            auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-            tasks.emplace([func, &barrier](){
+            try {
                 func();
-                barrier.notifyCompleted();
-            });
-        }
-        
-        newTaskNotifier.notify_one();
+            } catch (...) {
+                notifier.setException(std::current_exception());
+            }
+        }));
     }
     
     /// \brief Adds a task that returns a future.
+    ///
+    /// \remark The shared state of the future is allocated from a BlockPool.
     template<typename F, typename... Args>
-#ifdef IYFT_HAS_CPP17
     std::future<std::invoke_result_t<F, Args...>> addTaskWithResult(F&& f, Args&&... args) {
-#else // IYFT_HAS_CPP17
-     std::future<typename std::result_of<F&&(Args&&...)>::type> addTaskWithResult(F&& f, Args&&... args) {
-#endif // IYFT_HAS_CPP17
-    
 #ifdef IYFT_THREAD_POOL_PROFILE
         IYFT_PROFILE(AddTaskWithResultNoBarrier);
 #endif // IYFT_THREAD_POOL_PROFILE
 
-#ifdef IYFT_HAS_CPP17
         using ReturnValueType = std::invoke_result_t<F, Args...>;
-#else // IYFT_HAS_CPP17
-        using ReturnValueType = typename std::result_of<F&&(Args&&...)>::type;
-#endif // IYFT_HAS_CPP17
         
-        using TaskType = std::packaged_task<ReturnValueType()>;
+        std::promise<ReturnValueType> promise(std::allocator_arg, PooledAllocator<char>());
+        auto taskResult = promise.get_future();
         
-        TaskType task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-        auto taskResult = task.get_future();
+        enqueue(Task([func = BindTask(std::forward<F>(f), std::forward<Args>(args)...), promise = std::move(promise)]() mutable {
+            FulfillPromise(promise, func);
+        }));
         
-        {
-            std::lock_guard<std::mutex> lock(taskMutex);
-            
-            checkRunning();
-            
-            tasks.emplace(std::bind([](TaskType& task){
-                task();
-            }, std::move(task)));
-        }
-        
-        newTaskNotifier.notify_one();
         return taskResult;
     }
     
     /// \brief Adds a task that returns a future and notifies a barrier upon 
     /// completion.
     template<typename F, typename... Args>
-#ifdef IYFT_HAS_CPP17
     std::future<std::invoke_result_t<F, Args...>> addTaskWithResult(Barrier& barrier, F&& f, Args&&... args) {
-#else // IYFT_HAS_CPP17
-    std::future<typename std::result_of<F&&(Args&&...)>::value> addTaskWithResult(Barrier& barrier, F&& f, Args&&... args) {
-#endif // IYFT_HAS_CPP17
 #ifdef IYFT_THREAD_POOL_PROFILE
         IYFT_PROFILE(AddTaskWithResultWithBarrier);
 #endif // IYFT_THREAD_POOL_PROFILE
         
-#ifdef IYFT_HAS_CPP17
         using ReturnValueType = std::invoke_result_t<F, Args...>;
-#else // IYFT_HAS_CPP17
-        using ReturnValueType = typename std::result_of<F&&(Args&&...)>::type;
-#endif // IYFT_HAS_CPP17
-        using TaskType = std::packaged_task<ReturnValueType()>;
         
-        TaskType task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-        auto taskResult = task.get_future();
+        std::promise<ReturnValueType> promise(std::allocator_arg, PooledAllocator<char>());
+        auto taskResult = promise.get_future();
         
-        {
-            std::lock_guard<std::mutex> lock(taskMutex);
-            
-            checkRunning();
-            
-            tasks.emplace(std::bind([&barrier](TaskType& task){
-                task();
-                barrier.notifyCompleted();
-            }, std::move(task)));
-        }
+        enqueue(Task([func = BindTask(std::forward<F>(f), std::forward<Args>(args)...), promise = std::move(promise), &barrier]() mutable {
+            FulfillPromise(promise, func);
+            barrier.notifyCompleted();
+        }));
         
-        newTaskNotifier.notify_one();
         return taskResult;
     }
 
-    /// \brief Busily waits until all tasks complete.
+    /// \brief Returns the number of tasks that have been added, but haven't finished executing yet.
+    ///
+    /// \remark Unlike getRemainingTaskCount(), this includes the tasks that are currently being executed.
+    inline std::size_t getPendingTaskCount() const {
+        return pendingTasks.load();
+    }
+    
+    /// \brief Blocks until the pool becomes idle, i.e., until all tasks that were added before 
+    /// this call (and any tasks that they added) complete.
+    ///
+    /// The calling thread spins for a short, adaptively chosen amount of time and goes to sleep
+    /// if the tasks don't complete by then.
+    ///
+    /// \warning Calling this function from a worker of the same pool will cause a deadlock.
     void waitForAll() {
-        /// TODO a less strict operation would do.
-        while (tasksInFlight.load() != 0) {
-            ;
-        }
+        waitForIdle(nullptr);
+    }
+    
+    /// \brief Blocks until the pool becomes idle or until the timeout expires.
+    ///
+    /// \warning Calling this function from a worker of the same pool will cause a deadlock if
+    /// the timeout is long enough.
+    ///
+    /// \param timeout The maximum amount of time to wait for.
+    /// \return true if the pool became idle, false if the timeout expired first.
+    template <typename Rep, typename Period>
+    bool waitForAll(const std::chrono::duration<Rep, Period>& timeout) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        return waitForIdle(&deadline);
     }
 private:
     static std::size_t DetermineWorkerCount(std::size_t i) {
@@ -348,6 +416,293 @@ private:
         }
     }
     
+    /// \brief The minimum number of iterations that waitForAll() spins for before going to sleep.
+    static constexpr int MinSpinLimit = 64;
+    
+    /// \brief The maximum number of iterations that waitForAll() spins for before going to sleep.
+    static constexpr int MaxSpinLimit = 16384;
+    
+    /// \brief Implements both versions of waitForAll().
+    ///
+    /// \param deadline The point in time when the wait should stop or nullptr to wait indefinitely.
+    /// \return false if the deadline was reached before the pool became idle.
+    bool waitForIdle(const std::chrono::steady_clock::time_point* deadline) {
+#ifdef IYFT_THREAD_POOL_PROFILE
+        IYFT_PROFILE(WaitForAll)
+#endif // IYFT_THREAD_POOL_PROFILE
+        
+        // The epoch must be read first. If the pool becomes idle after this point, the epoch will
+        // change, even if new tasks arrive before we get to check pendingTasks.
+        const std::uint64_t startEpoch = completionEpoch.load();
+        
+        if (pendingTasks.load() == 0) {
+            return true;
+        }
+        
+        const int limit = spinLimit.load(std::memory_order_relaxed);
+        
+        {
+#ifdef IYFT_THREAD_POOL_PROFILE
+            IYFT_PROFILE(WaitForAllSpin)
+#endif // IYFT_THREAD_POOL_PROFILE
+            for (int i = 0; i < limit; ++i) {
+                if (completionEpoch.load() != startEpoch) {
+                    // Spinning paid off. Allow longer spins next time.
+                    spinLimit.store(std::min(limit * 2, MaxSpinLimit), std::memory_order_relaxed);
+                    return true;
+                }
+                
+                IYFT_CPU_RELAX();
+            }
+        }
+        
+        // Spinning was a waste of time. Make the next spin shorter.
+        spinLimit.store(std::max(limit / 2, MinSpinLimit), std::memory_order_relaxed);
+        
+#ifdef IYFT_THREAD_POOL_PROFILE
+        IYFT_PROFILE(WaitForAllBlock)
+#endif // IYFT_THREAD_POOL_PROFILE
+        std::unique_lock<std::mutex> lock(completionMutex);
+        completionWaiters++;
+        
+        const auto isIdle = [this, startEpoch](){
+            return completionEpoch.load() != startEpoch;
+        };
+        
+        bool result = true;
+        if (deadline == nullptr) {
+            completionNotifier.wait(lock, isIdle);
+        } else {
+            result = completionNotifier.wait_until(lock, *deadline, isIdle);
+        }
+        
+        completionWaiters--;
+        return result;
+    }
+    
+    /// \brief Called by the workers after a task finishes executing.
+    inline void notifyTaskCompleted() {
+        if (pendingTasks.fetch_sub(1) != 1) {
+            return;
+        }
+        
+        // The pool just became idle
+        completionEpoch.fetch_add(1);
+        
+        // completionEpoch and completionWaiters are sequentially consistent, so either we see the
+        // waiter or the waiter sees the new epoch before it goes to sleep.
+        if (completionWaiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(completionMutex);
+            completionNotifier.notify_all();
+        }
+    }
+    
+    /// \brief Calls the function and stores its result or exception in the promise.
+    template <typename R, typename F>
+    static void FulfillPromise(std::promise<R>& promise, F& func) {
+        try {
+            if constexpr (std::is_void_v<R>) {
+                func();
+                promise.set_value();
+            } else {
+                promise.set_value(func());
+            }
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }
+    
+    /// \brief Notifies a Barrier when it goes out of scope, i.e., even if the task that owns
+    /// it throws.
+    class BarrierNotifier {
+    public:
+        explicit BarrierNotifier(Barrier& barrier) : barrier(barrier) {}
+        
+        BarrierNotifier(const BarrierNotifier&) = delete;
+        BarrierNotifier& operator=(const BarrierNotifier&) = delete;
+        
+        /// \remark Only throws if the Barrier received too many notifications, which is a
+        /// programming error.
+        ~BarrierNotifier() noexcept(false) {
+            barrier.notifyCompleted(exception);
+        }
+        
+        void setException(std::exception_ptr taskException) {
+            exception = taskException;
+        }
+    private:
+        Barrier& barrier;
+        std::exception_ptr exception;
+    };
+    
+    /// \brief Executes a task.
+    ///
+    /// Tasks that return results store their exceptions in the promise and tasks that use a
+    /// Barrier pass them to it. Nothing can observe exceptions thrown by the remaining tasks,
+    /// so they are reported to std::cerr and dropped.
+    static void ExecuteTask(Task& task) {
+        try {
+            task();
+        } catch (const std::exception& e) {
+            std::cerr << "iyft::ThreadPool: an exception thrown by a task was dropped: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "iyft::ThreadPool: an exception of an unknown type thrown by a task was dropped" << std::endl;
+        }
+    }
+    
+    /// \brief Information about the pool worker that's running on the current thread.
+    struct WorkerContext {
+        /// \brief The pool that owns the current thread or nullptr if the current thread
+        /// does not belong to any pool.
+        const ThreadPool* pool = nullptr;
+        
+        /// \brief The number of the worker in its pool.
+        std::size_t index = 0;
+    };
+    
+    /// \brief Returns the WorkerContext of the current thread.
+    static WorkerContext& CurrentWorker() {
+        static thread_local WorkerContext context;
+        return context;
+    }
+    
+    /// \brief Adds a wrapped task to the appropriate queue and wakes up a worker.
+    void enqueue(Task task) {
+        if (mode == SchedulingMode::SharedQueue) {
+            {
+                std::lock_guard<std::mutex> lock(taskMutex);
+                
+                checkRunning();
+                
+                pendingTasks++;
+                tasks.emplace(std::move(task));
+            }
+            
+            newTaskNotifier.notify_one();
+            return;
+        }
+        
+        const WorkerContext& context = CurrentWorker();
+        if (context.pool == this) {
+            // Workers can't be running the destructor, so there's no need to check running
+            // and the local deque can be accessed without any locks.
+            pendingTasks++;
+            localQueues[context.index]->push(taskNodes.acquire(context.index, std::move(task)));
+        } else {
+            std::lock_guard<std::mutex> lock(taskMutex);
+            
+            checkRunning();
+            
+            pendingTasks++;
+            tasks.emplace(std::move(task));
+        }
+        
+        queuedTaskCount.fetch_add(1);
+        
+        // queuedTaskCount and sleepingWorkers are both sequentially consistent. Either
+        // we'll see the sleeping worker here or the worker will see the new task before
+        // going to sleep.
+        if (sleepingWorkers.load() > 0) {
+            std::lock_guard<std::mutex> lock(taskMutex);
+            newTaskNotifier.notify_one();
+        }
+    }
+    
+    /// \brief Tries to find a task for a worker that uses the SchedulingMode::WorkStealing.
+    ///
+    /// The local deque is checked first, the injection queue second and the deques of
+    /// randomly chosen victims last.
+    bool acquireStealingTask(std::size_t current, std::minstd_rand& rng, Task& activeTask) {
+        TaskNode* stolen = nullptr;
+        
+        if (localQueues[current]->pop(stolen)) {
+            activeTask = std::move(stolen->task);
+            taskNodes.release(current, stolen);
+            
+            queuedTaskCount.fetch_sub(1);
+            return true;
+        }
+        
+        {
+            std::unique_lock<std::mutex> lock(taskMutex, std::try_to_lock);
+            
+            if (lock.owns_lock() && !tasks.empty()) {
+                activeTask = std::move(tasks.front());
+                tasks.pop();
+                
+                queuedTaskCount.fetch_sub(1);
+                return true;
+            }
+        }
+        
+        const std::size_t count = localQueues.size();
+        if (count > 1) {
+            const std::size_t start = rng() % count;
+            
+            for (std::size_t i = 0; i < count; ++i) {
+                const std::size_t victim = (start + i) % count;
+                
+                if (victim != current && localQueues[victim]->steal(stolen)) {
+                    activeTask = std::move(stolen->task);
+                    taskNodes.release(current, stolen);
+                    
+                    queuedTaskCount.fetch_sub(1);
+                    return true;
+                }
+            }
+        }
+        
+        return false;
+    }
+    
+    /// The loop used by workers of a pool that uses SchedulingMode::WorkStealing.
+    void executeStealingTasks(std::size_t current) {
+        std::minstd_rand rng(static_cast<std::minstd_rand::result_type>(current + 1));
+        
+        /// The number of failed attempts to find a task before going to sleep.
+        const int SpinCount = 64;
+        
+        while (true) {
+            Task activeTask;
+            
+            bool found = false;
+            for (int i = 0; i < SpinCount && !found; ++i) {
+                found = acquireStealingTask(current, rng, activeTask);
+                
+                if (!found) {
+                    std::this_thread::yield();
+                }
+            }
+            
+            if (!found) {
+#ifdef IYFT_THREAD_POOL_PROFILE
+                IYFT_PROFILE(SleepAndAcquireTask)
+#endif // IYFT_THREAD_POOL_PROFILE
+                std::unique_lock<std::mutex> lock(taskMutex);
+                
+                sleepingWorkers.fetch_add(1);
+                newTaskNotifier.wait(lock, [this](){
+                    return !(this->running) || (this->queuedTaskCount.load() > 0);
+                });
+                sleepingWorkers.fetch_sub(1);
+                
+                // We make sure to finish any remaining tasks before exiting. Only external
+                // threads can add tasks after running became false and they'll get an
+                // exception, so queuedTaskCount can't grow anymore.
+                if (!running && queuedTaskCount.load() <= 0) {
+                    break;
+                }
+                
+                continue;
+            }
+            
+            // Execute the task in this thread
+            ExecuteTask(activeTask);
+            activeTask.reset();
+            notifyTaskCompleted();
+        }
+    }
+    
     /// Every single worker in the pool executes this function to acquire new tasks
     /// to work on.
     void executeTasks(std::size_t count, std::size_t current, SetupFunction setup) {
@@ -360,9 +715,18 @@ private:
         iyft::AssignThreadName(name.c_str());
 #endif // IYFT_THREAD_POOL_PROFILE
         
+        WorkerContext& context = CurrentWorker();
+        context.pool = this;
+        context.index = current;
+        
+        if (mode == SchedulingMode::WorkStealing) {
+            executeStealingTasks(current);
+            return;
+        }
+        
         // Don't quit until the destructor tells us to
         while (true) {
-            std::packaged_task<void()> activeTask;
+            Task activeTask;
             
             {   
 #ifdef IYFT_THREAD_POOL_PROFILE
@@ -387,9 +751,9 @@ private:
             }
         
             // Execute the task in this thread
-            tasksInFlight++;
-            activeTask();
-            tasksInFlight--;
+            ExecuteTask(activeTask);
+            activeTask.reset();
+            notifyTaskCompleted();
         }
     }
     
@@ -401,11 +765,50 @@ private:
     /// \todo Perhaps I should look into lock-free queues for lower latency.
     mutable std::mutex taskMutex;
     
-    /// \brief The number of tasks that are currently being worked on.
-    std::atomic<int> tasksInFlight;
+    /// \brief The number of tasks that were added, but haven't completed yet.
+    ///
+    /// \remark Incremented when a task is added (not when it's dequeued) to make sure that
+    /// waitForAll() can't miss tasks that have been dequeued but haven't started yet.
+    std::atomic<std::size_t> pendingTasks;
+    
+    /// \brief Incremented every time pendingTasks drops to zero.
+    std::atomic<std::uint64_t> completionEpoch;
+    
+    /// \brief The number of threads that are sleeping in waitForAll().
+    std::atomic<int> completionWaiters;
+    
+    /// \brief The number of iterations that waitForAll() will spin for before going to sleep.
+    /// Adjusted based on the outcome of previous waits.
+    std::atomic<int> spinLimit;
+    
+    /// \brief A mutex used together with completionNotifier.
+    std::mutex completionMutex;
+    
+    /// \brief A condition variable used to wake up the threads that wait in waitForAll().
+    std::condition_variable completionNotifier;
     
     /// \brief A vector that contains all pending tasks
-    std::queue<std::packaged_task<void()>> tasks;
+    ///
+    /// \remark When SchedulingMode::WorkStealing is used, this is the injection queue
+    /// that receives tasks from threads that don't belong to this pool.
+    TaskQueue tasks;
+    
+    /// \brief Per-worker deques. Only used with SchedulingMode::WorkStealing.
+    std::vector<std::unique_ptr<WorkStealingDeque<TaskNode*>>> localQueues;
+    
+    /// \brief Recycles the nodes that are stored in localQueues.
+    TaskNodePool taskNodes;
+    
+    /// \brief The total number of tasks in all queues. Only used with
+    /// SchedulingMode::WorkStealing.
+    std::atomic<std::int64_t> queuedTaskCount;
+    
+    /// \brief The number of workers that are waiting for newTaskNotifier. Only used
+    /// with SchedulingMode::WorkStealing.
+    std::atomic<int> sleepingWorkers;
+    
+    /// \brief The chosen SchedulingMode.
+    const SchedulingMode mode;
     
     /// \brief A condition variable used to notify the workers about newly available
     /// tasks.
@@ -0,0 +1,203 @@
+// The IYFThreading library
+//
+// Copyright (C) 2018, Manvydas Šliamka
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of other contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// \file WorkStealingDeque.hpp Contains a lock-free Chase-Lev work stealing deque
+
+#ifndef IYFT_WORK_STEALING_DEQUE_HPP
+#define IYFT_WORK_STEALING_DEQUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+
+namespace iyft {
+
+/// \brief A lock-free, dynamically growing Chase-Lev work stealing deque.
+///
+/// The owner thread pushes and pops items at the bottom of the deque. Any number of
+/// other threads may steal items from the top of the deque concurrently.
+///
+/// The implementation follows "Correct and Efficient Work-Stealing for Weak Memory
+/// Models" by Lê, Pop, Cohen and Zappa Nardelli.
+///
+/// \warning Only the owner thread may call push() and pop(). steal() is safe to call
+/// from any thread.
+///
+/// \tparam T The type of the stored items. Must be trivially copyable because items
+/// are read by thieves that may race with the owner. Pointers are the intended use.
+template <typename T>
+class WorkStealingDeque {
+public:
+    static_assert(std::is_trivially_copyable_v<T>, "WorkStealingDeque can only store trivially copyable types");
+
+    /// \brief Creates a deque with the specified initial capacity.
+    ///
+    /// \throws std::logic_error if initialCapacity is not a power of two.
+    ///
+    /// \param initialCapacity The initial capacity of the deque. Must be a power of two.
+    WorkStealingDeque(std::int64_t initialCapacity = 1024) : top(0), bottom(0) {
+        if (initialCapacity <= 0 || (initialCapacity & (initialCapacity - 1)) != 0) {
+            throw std::logic_error("initialCapacity must be a power of two");
+        }
+
+        arrays.push_back(std::make_unique<RingArray>(initialCapacity));
+        array.store(arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    /// \brief Explicitly disabled to get cleaner errors.
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    /// \brief Explicitly disabled to get cleaner errors.
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    /// \brief Returns an approximate number of items in the deque.
+    ///
+    /// \remark The value may be outdated by the time it's returned.
+    std::int64_t approximateSize() const {
+        const std::int64_t b = bottom.load(std::memory_order_relaxed);
+        const std::int64_t t = top.load(std::memory_order_relaxed);
+        return (b >= t) ? (b - t) : 0;
+    }
+
+    /// \brief Pushes an item to the bottom of the deque. Owner thread only.
+    void push(T item) {
+        const std::int64_t b = bottom.load(std::memory_order_relaxed);
+        const std::int64_t t = top.load(std::memory_order_acquire);
+        RingArray* a = array.load(std::memory_order_relaxed);
+
+        if (b - t > a->capacity - 1) {
+            a = grow(a, b, t);
+        }
+
+        a->store(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /// \brief Pops an item from the bottom of the deque. Owner thread only.
+    ///
+    /// \param[out] item The popped item. Only valid if this function returned true.
+    /// \return true if an item was popped, false if the deque was empty.
+    bool pop(T& item) {
+        const std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        RingArray* a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t <= b) {
+            item = a->load(b);
+
+            if (t == b) {
+                // The last item. We need to race the thieves for it.
+                const bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return won;
+            }
+
+            return true;
+        } else {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    /// \brief Steals an item from the top of the deque. May be called from any thread.
+    ///
+    /// \param[out] item The stolen item. Only valid if this function returned true.
+    /// \return true if an item was stolen, false if the deque was empty or another
+    /// thread won the race for the item.
+    bool steal(T& item) {
+        std::int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const std::int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t < b) {
+            RingArray* a = array.load(std::memory_order_consume);
+            item = a->load(t);
+
+            return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        }
+
+        return false;
+    }
+private:
+    /// \brief A power of two sized circular array that stores the items.
+    struct RingArray {
+        RingArray(std::int64_t capacity) : capacity(capacity), mask(capacity - 1), data(new std::atomic<T>[capacity]) {}
+
+        inline T load(std::int64_t i) const {
+            return data[i & mask].load(std::memory_order_relaxed);
+        }
+
+        inline void store(std::int64_t i, T item) {
+            data[i & mask].store(item, std::memory_order_relaxed);
+        }
+
+        const std::int64_t capacity;
+        const std::int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> data;
+    };
+
+    /// \brief Doubles the capacity of the array. Owner thread only.
+    ///
+    /// The old arrays are kept alive until the deque is destroyed because thieves
+    /// may still be reading from them.
+    RingArray* grow(RingArray* oldArray, std::int64_t b, std::int64_t t) {
+        auto newArray = std::make_unique<RingArray>(oldArray->capacity * 2);
+
+        for (std::int64_t i = t; i < b; ++i) {
+            newArray->store(i, oldArray->load(i));
+        }
+
+        RingArray* result = newArray.get();
+        arrays.push_back(std::move(newArray));
+        array.store(result, std::memory_order_release);
+
+        return result;
+    }
+
+    /// \brief Index of the next item to steal. Modified by thieves and by the owner
+    /// when it races for the last item.
+    alignas(64) std::atomic<std::int64_t> top;
+
+    /// \brief Index of the next free slot. Only modified by the owner.
+    alignas(64) std::atomic<std::int64_t> bottom;
+
+    /// \brief The currently active array.
+    std::atomic<RingArray*> array;
+
+    /// \brief All arrays that have ever been allocated by this deque. Owner thread only.
+    std::vector<std::unique_ptr<RingArray>> arrays;
+};
+
+}
+
+#endif // IYFT_WORK_STEALING_DEQUE_HPP
@@ -0,0 +1,161 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BUFFER_RANGE_ALLOCATOR_HPP
+#define BUFFER_RANGE_ALLOCATOR_HPP
+
+#include "utilities/DataSizes.hpp"
+
+#include <memory>
+
+namespace iyf {
+struct BufferRange {
+    inline constexpr BufferRange() : offset(0), size(0) {}
+    inline constexpr BufferRange(Bytes start, Bytes size) : offset(start), size(size) {}
+    
+    Bytes offset;
+    Bytes size;
+    
+    friend inline bool operator<(const BufferRange& l, const BufferRange& r) {
+        return l.offset < r.offset;
+    }
+    
+    friend inline bool operator>(const BufferRange& l, const BufferRange& r) {
+        return l.offset > r.offset;
+    }
+    
+    friend inline bool operator==(const BufferRange& l, const BufferRange& r) {
+        return (l.offset == r.offset) && (l.size == r.size);
+    }
+    
+    friend inline bool operator!=(const BufferRange& l, const BufferRange& r) {
+        return !(l == r);
+    }
+};
+
+enum class BufferRangeAllocatorType {
+    /// A BufferRangeSet. Uses first fit. Allocation time depends on the number of free ranges.
+    FirstFit,
+    /// A TLSFBufferRangeAllocator. Allocation and deallocation take constant time.
+    TLSF
+};
+
+/// Base class for objects that keep track of free and used ranges in data buffers. They do not store any pointers to
+/// actual data buffers and do not perform any memory management on their own, therefore they can be used for buffers that
+/// reside in either RAM or VRAM.
+///
+/// How to use:
+///
+/// 1. Call getFreeRange() to request a free range that would fit the specified number of bytes. This may fail because of
+/// fragmentation, so always check your return values.
+///
+/// 2. Call insert() to return a range that you no longer wish to use. The range must be identical to the
+/// FreeRange::completeRange that getFreeRange() returned.
+class BufferRangeAllocator {
+public:
+    /// Creates an allocator of the specified type.
+    static std::unique_ptr<BufferRangeAllocator> Create(BufferRangeAllocatorType type, Bytes totalSpace);
+    
+    BufferRangeAllocator(Bytes totalSpace) : totalSpace(totalSpace), freeSpace(totalSpace) {}
+    virtual ~BufferRangeAllocator() {}
+    
+    /// For example, imagine that a buffer already contains four two-byte objects. You need to store two more 5 byte
+    /// objects. To do so, you pass 10 (size) and 5 (alignment) to the getFreeRange() function. Assuming that the
+    /// amount of free space is sufficient and no other data exists in the buffer, you'll get:
+    ///     - completeRange with offset == 8 and size == 12
+    ///     - startPadding == 2
+    ///     - status = true
+    /// When writing the data into the actual buffer, start at the 10 byte offset (completeRange.offset + startPadding)
+    struct FreeRange {
+        /// The whole allocated range, including startPadding. Because of padding, this may end up being slightly bigger
+        /// than what was requested when calling getFreeRange(). A BufferRange object with the exact same offset and size
+        /// must be given to the insert() function in order to mark it as free for reuse.
+        BufferRange completeRange;
+        /// This value will only be non-zero when you try to store objects of different sizes into a single data buffer.
+        /// It indicates how much padding is needed at the start of the range in order to have a propper alignment.
+        std::uint32_t startPadding;
+        /// Was a free range found in this allocator or not? If this is false, ignore all other values in this object
+        bool status;
+    };
+    
+    /// Request a free BufferRange. Please read the docs of BufferRangeAllocator::FreeRange in order to know how to interpret
+    /// the returned data.
+    /// 
+    /// \param[in] size Total required size in Bytes
+    /// \param[in] alignment Typically, the size of a single object. Used to compute padding when storing objects of
+    /// diffrent sizes in a single data buffer.
+    virtual FreeRange getFreeRange(Bytes size, Bytes alignment) = 0;
+    
+    /// Used to mark a BufferRange as free for reuse.
+    ///
+    /// \warning The range must be a FreeRange::completeRange that was returned by getFreeRange() and hasn't been inserted yet.
+    /// Inserting anything else results in undefined behaviour.
+    virtual bool insert(const BufferRange& value) = 0;
+    
+    /// \return The size of the biggest free range. Allocations that are bigger than this will fail even if getFreeSpace()
+    /// is sufficient.
+    virtual Bytes getLargestFreeRange() const = 0;
+    
+    /// \return The number of separate free ranges.
+    virtual std::size_t getFreeRangeCount() const = 0;
+    
+    /// Tries to find a place for an existing allocation at a lower offset. Used to compact buffers.
+    ///
+    /// If this succeeds, the caller must copy the data to completeRange.offset + startPadding and insert() the old range once
+    /// nothing uses it anymore. If it fails, nothing changes.
+    ///
+    /// \param[in] range The complete range of the existing allocation
+    /// \param[in] startPadding The padding of the existing allocation
+    /// \param[in] alignment The alignment that was used when allocating the range
+    FreeRange relocate(const BufferRange& range, std::uint32_t startPadding, Bytes alignment);
+    
+    /// \return A value between 0 (all free space is in a single range) and 1 (the free space is split into many small ranges).
+    inline float getFragmentation() const {
+        if (freeSpace == Bytes(0)) {
+            return 0.0f;
+        }
+        
+        return 1.0f - static_cast<float>(getLargestFreeRange().count()) / static_cast<float>(freeSpace.count());
+    }
+    
+    /// Get the amount of remaining free space
+    inline Bytes getFreeSpace() const {
+        return freeSpace;
+    }
+    
+    /// Get the total amount of space
+    inline Bytes getTotalSpace() const {
+        return totalSpace;
+    }
+protected:
+    Bytes totalSpace;
+    Bytes freeSpace;
+};
+}
+
+#endif // BUFFER_RANGE_ALLOCATOR_HPP
@@ -29,78 +29,30 @@
 #ifndef BUFFER_RANGE_MANAGER_HPP
 #define BUFFER_RANGE_MANAGER_HPP
 
-#include "utilities/DataSizes.hpp"
+#include "utilities/BufferRangeAllocator.hpp"
 #include "utilities/FlatSet.hpp"
 
 namespace iyf {
-struct BufferRange {
-    inline constexpr BufferRange() : offset(0), size(0) {}
-    inline constexpr BufferRange(Bytes start, Bytes size) : offset(start), size(size) {}
-    
-    Bytes offset;
-    Bytes size;
-    
-    friend inline bool operator<(const BufferRange& l, const BufferRange& r) {
-        return l.offset < r.offset;
-    }
-    
-    friend inline bool operator>(const BufferRange& l, const BufferRange& r) {
-        return l.offset > r.offset;
-    }
-    
-    friend inline bool operator==(const BufferRange& l, const BufferRange& r) {
-        return (l.offset == r.offset) && (l.size == r.size);
-    }
-};
-
-/// This container is used to keep track of free ranges in data buffers for later reuse. It does not
-/// store any pointers to actual data buffers and does not perform any memory management on its own,
-/// therefore it can be used for buffers that reside in either RAM or VRAM.
-///
-/// How to use:
-///
-/// 1. Call getFreeRange() to request a free range that would fit the specified number of bytes. This
-/// may fail because of the fragmentation, so always check your return values.
+/// This container is used to keep track of free ranges in data buffers for later reuse. It stores the free ranges in a sorted
+/// FlatSet and returns the first one that fits. See BufferRangeAllocator for more info on how to use it.
 ///
-/// 2. Call insert() to return a range that you no longer wish to use back into the set. This will
-/// automatically merge touching ranges into a bigger one.
+/// Unlike the TLSFBufferRangeAllocator, this container also accepts ranges that weren't returned by getFreeRange(), as long as
+/// they don't overlap the free ones.
 ///
 /// \warning This container assumes that ranges CANNOT overlap.
 /// 
 /// \todo Test with zeros (e.g. a vertex only mesh has no need for an ibo and would be submitting
 /// 0 sized insert() and getFreeRange() calls).
 ///
-/// \todo Implement defragmentation and perform it once the number of fragments reaches
-/// a certain threshold.
-///
 /// \todo For now, getFreeRange() returns the first interval that can fit the size. How does
 /// this affect fragmentation? Would it be better to find the smallest interval that can
 /// fully contain the size? The biggest?
-class BufferRangeSet : public FlatSet<BufferRange> {
+class BufferRangeSet : public BufferRangeAllocator, public FlatSet<BufferRange> {
 public:
-    BufferRangeSet(Bytes totalSpace) : totalSpace(totalSpace), freeSpace(totalSpace) {
+    BufferRangeSet(Bytes totalSpace) : BufferRangeAllocator(totalSpace) {
         data.push_back({Bytes(0), totalSpace});
     }
     
-    /// For example, imagine that a buffer already contains four two-byte objects. You need to store two more 5 byte
-    /// objects. To do so, you pass 10 (size) and 5 (alignment) to the getFreeRange() function. Assuming that the
-    /// amount of free space is sufficient and no other data exists in the buffer, you'll get:
-    ///     - completeRange with offset == 8 and size == 12
-    ///     - startPadding == 2
-    ///     - status = true
-    /// When writing the data into the actual buffer, start at the 10 byte offset (completeRange.offset + startPadding)
-    struct FreeRange {
-        /// The whole allocated range, including startPadding. Because of padding, this may end up being slightly bigger
-        /// than what was requested when calling getFreeRange(). A BufferRange object with the exact same offset and size
-        /// must be given to the insert() function in order to mark it as free for reuse.
-        BufferRange completeRange;
-        /// This value will only be non-zero when you try to store objects of different sizes into a single data buffer.
-        /// It indicates how much padding is needed at the start of the range in order to have a propper alignment.
-        std::uint32_t startPadding;
-        /// Was a free range found in this BufferRangeSet or not? If this is false, ignore all other values in this object
-        bool status;
-    };
-    
     /// Used to mark a BufferRange as free for reuse.
     ///
     /// This method hides the one from the base class. The main difference is that this one
@@ -110,7 +62,7 @@ public:
     /// \warning This method does not check if the BufferRange being inserted overlaps with others.
     /// It is assumed that no overlap exists. Inserting overlapping BufferRanges results in undefinded
     /// behaviour.
-    bool insert(const BufferRange& value);
+    virtual bool insert(const BufferRange& value) final override;
     
     /// Used to mark a BufferRange as free for reuse.
     ///
@@ -123,26 +75,14 @@ public:
     /// behaviour.
     bool insert(const BufferRange&& value);
     
-    /// Request a free BufferRange. Please read the docs of BufferRangeSet::FreeRange in order to know how to interpret
-    /// the returned data.
-    /// 
-    /// \param[in] size Total required size in Bytes
-    /// \param[in] alignment Typically, the size of a single object. Used to compute padding when storing objects of
-    /// diffrent sizes in a single data buffer.
-    FreeRange getFreeRange(Bytes size, Bytes alignment);
+    virtual FreeRange getFreeRange(Bytes size, Bytes alignment) final override;
     
-    /// Get the amount of remaining free space
-    inline Bytes getFreeSpace() const {
-        return freeSpace;
-    }
+    /// \remark This walks all free ranges.
+    virtual Bytes getLargestFreeRange() const final override;
     
-    /// Get the total amount of space
-    inline Bytes getTotalSpace() const {
-        return totalSpace;
+    virtual std::size_t getFreeRangeCount() const final override {
+        return size();
     }
-private:
-    Bytes totalSpace;
-    Bytes freeSpace;
 };
 }
 
@@ -30,6 +30,8 @@
 #define INTEGERPACKING_HPP
 
 #include <array>
+#include <cstdint>
+#include <cstring>
 
 namespace iyf {
 namespace util {
@@ -67,6 +69,18 @@ inline constexpr std::uint32_t Int64ToInt32b(std::uint64_t in) {
     return (std::uint32_t)(in);
 }
 
+/// Maps a float to an unsigned integer in a way that preserves the order, which allows floats to be used in
+/// integer sort keys. NaNs end up at either end of the range.
+inline std::uint32_t FloatToOrderedInt32(float in) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &in, sizeof(bits));
+    
+    // Negative numbers need to have all bits flipped to reverse their order, positive ones just need to be moved
+    // above them.
+    const std::uint32_t mask = (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+    return bits ^ mask;
+}
+
 }
 }
 
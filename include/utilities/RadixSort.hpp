@@ -0,0 +1,321 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_RADIX_SORT_HPP
+#define IYF_RADIX_SORT_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace iyf {
+namespace util {
+/// \brief Sorts the data by 64 bit keys using an LSD radix sort with 8 bit digits.
+///
+/// The sort is stable. Histograms of all digits are built in a single pass and digits that are identical for all keys
+/// are skipped. This matters for render keys where the upper bits (e.g., pipelines) often take just a few values.
+///
+/// \param[in,out] data The data to sort. May end up swapped with scratch.
+/// \param[in,out] scratch Temporary storage. Reuse it to avoid allocations.
+/// \param[in] key A callable that returns the std::uint64_t key of an element. Called multiple times per element.
+template <typename T, typename KeyFunction>
+void RadixSort64(std::vector<T>& data, std::vector<T>& scratch, KeyFunction key) {
+    constexpr std::size_t DigitCount = 8;
+    constexpr std::size_t BucketCount = 256;
+    
+    const std::size_t count = data.size();
+    if (count < 2) {
+        return;
+    }
+    
+    std::array<std::array<std::uint32_t, BucketCount>, DigitCount> histograms = {};
+    for (const T& element : data) {
+        const std::uint64_t k = key(element);
+        
+        for (std::size_t d = 0; d < DigitCount; ++d) {
+            histograms[d][(k >> (d * 8)) & 0xFF]++;
+        }
+    }
+    
+    scratch.resize(count);
+    std::vector<T>* source = &data;
+    std::vector<T>* destination = &scratch;
+    
+    for (std::size_t d = 0; d < DigitCount; ++d) {
+        std::array<std::uint32_t, BucketCount>& histogram = histograms[d];
+        
+        // All keys have the same digit. This pass would not change anything.
+        const std::uint64_t firstDigit = (key((*source)[0]) >> (d * 8)) & 0xFF;
+        if (histogram[firstDigit] == count) {
+            continue;
+        }
+        
+        // Turn the counts into starting offsets
+        std::uint32_t offset = 0;
+        for (std::uint32_t& bucket : histogram) {
+            const std::uint32_t bucketSize = bucket;
+            bucket = offset;
+            offset += bucketSize;
+        }
+        
+        for (const T& element : *source) {
+            const std::size_t digit = (key(element) >> (d * 8)) & 0xFF;
+            (*destination)[histogram[digit]++] = element;
+        }
+        
+        std::swap(source, destination);
+    }
+    
+    if (source != &data) {
+        data.swap(scratch);
+    }
+}
+
+/// \brief Sorts lists that change little from call to call in close to O(n) time.
+///
+/// Draw lists are rebuilt every frame, but most of their elements and keys stay the same. The sorter remembers the
+/// order of the previous result and rearranges the new data to match it (new elements go to the end). The few elements
+/// that then break the order are pulled out, radix sorted and merged back. If too many elements are out of order,
+/// a full RadixSort64() is used instead.
+///
+/// Following the previous order requires random memory accesses, which is why lists longer than MaxCoherentSize and
+/// lists that keep failing to reuse the previous order (e.g., transparent lists of a moving camera) fall back to
+/// RadixSort64() directly.
+///
+/// \tparam T The type of the elements
+/// \tparam KeyFunction A callable that returns the std::uint64_t sort key of an element
+/// \tparam IDFunction A callable that returns a std::uint32_t ID of an element. IDs must be unique within a list and
+/// small because they are used to index internal arrays.
+template <typename T, typename KeyFunction, typename IDFunction>
+class CoherentRadixSorter {
+public:
+    /// If more than 1 / OutOfOrderDivisor of the elements are out of order, a full radix sort is faster than the merge
+    static constexpr std::size_t OutOfOrderDivisor = 8;
+    
+    /// Longer lists always use RadixSort64()
+    static constexpr std::size_t MaxCoherentSize = 65536;
+    
+    enum class Method {
+        /// Nothing needed to be moved
+        AlreadySorted,
+        /// A few elements were sorted separately and merged back
+        Merge,
+        /// The order was too different from the previous one
+        FullSort
+    };
+    
+    CoherentRadixSorter(KeyFunction key = KeyFunction(), IDFunction id = IDFunction()) : key(key), id(id), currentStamp(0), lastMethod(Method::AlreadySorted), fullSortStreak(0) {}
+    
+    /// Sorts the data in ascending key order.
+    void sort(std::vector<T>& data) {
+        const std::size_t count = data.size();
+        
+        // A cheap sequential check that catches lists that haven't changed at all
+        if (std::is_sorted(data.begin(), data.end(), [this](const T& a, const T& b) { return key(a) < key(b); })) {
+            lastMethod = Method::AlreadySorted;
+            rememberOrder(data);
+            return;
+        }
+        
+        // Following the previous order means random accesses. Once the working set stops fitting into the cache,
+        // they cost more than the passes of a radix sort.
+        if (count > MaxCoherentSize) {
+            RadixSort64(data, scratch, key);
+            lastMethod = Method::FullSort;
+            fullSortStreak = 0;
+            previousOrder.clear();
+            return;
+        }
+        
+        // There's nothing to reuse in the first call. The next one must try the previous order.
+        if (previousOrder.empty()) {
+            RadixSort64(data, scratch, key);
+            lastMethod = Method::FullSort;
+            fullSortStreak = 0;
+            rememberOrder(data);
+            return;
+        }
+        
+        // Lists that keep failing to reuse the previous order (e.g., transparent lists where all depths change) go
+        // straight to the radix sort. The previous order is retried every RetryInterval calls.
+        if (lastMethod == Method::FullSort && fullSortStreak % RetryInterval != 0) {
+            RadixSort64(data, scratch, key);
+            fullSortStreak++;
+            
+            // Only the call that retries needs the previous order
+            if (fullSortStreak % RetryInterval == 0) {
+                rememberOrder(data);
+            }
+            
+            return;
+        }
+        
+        arrangeInPreviousOrder(data);
+        
+        // Pull out the elements that break the order. If the last kept element is the one that's out of place (e.g.,
+        // an element with a key that increased), it's replaced instead of rejecting everything that follows it.
+        data.clear();
+        outOfOrder.clear();
+        
+        const std::size_t outOfOrderLimit = count / OutOfOrderDivisor;
+        std::uint64_t lastKey = 0;
+        std::uint64_t secondToLastKey = 0;
+        
+        for (const T& element : ordered) {
+            const std::uint64_t k = key(element);
+            
+            if (data.empty() || lastKey <= k) {
+                data.push_back(element);
+                secondToLastKey = lastKey;
+                lastKey = k;
+            } else if (data.size() < 2 || secondToLastKey <= k) {
+                outOfOrder.push_back(data.back());
+                data.back() = element;
+                lastKey = k;
+            } else {
+                outOfOrder.push_back(element);
+                
+                if (outOfOrder.size() > outOfOrderLimit) {
+                    break;
+                }
+            }
+        }
+        
+        if (outOfOrder.empty()) {
+            lastMethod = Method::AlreadySorted;
+        } else if (outOfOrder.size() > outOfOrderLimit) {
+            data.swap(ordered);
+            RadixSort64(data, scratch, key);
+            
+            lastMethod = Method::FullSort;
+            fullSortStreak = 1;
+        } else {
+            RadixSort64(outOfOrder, scratch, key);
+            
+            merged.resize(count);
+            std::merge(data.begin(), data.end(), outOfOrder.begin(), outOfOrder.end(), merged.begin(), [this](const T& a, const T& b) {
+                return key(a) < key(b);
+            });
+            
+            data.swap(merged);
+            lastMethod = Method::Merge;
+        }
+        
+        rememberOrder(data);
+    }
+    
+    /// Returns the method that was used during the last sort() call. Useful for profiling.
+    inline Method getLastMethod() const {
+        return lastMethod;
+    }
+    
+    /// Forgets the previous order. The next sort() will most likely be a full sort.
+    void reset() {
+        previousOrder.clear();
+        lastMethod = Method::AlreadySorted;
+    }
+private:
+    /// How often lists that needed a full sort retry the previous order
+    static constexpr std::size_t RetryInterval = 8;
+    
+    struct Slot {
+        /// Marks the IDs that are present in the current list
+        std::uint32_t stamp;
+        /// Position of the element in the current list
+        std::uint32_t position;
+    };
+    
+    /// Copies the data to ordered, following the previous order. Elements that weren't in the previous list are
+    /// appended at the end.
+    void arrangeInPreviousOrder(const std::vector<T>& data) {
+        const std::size_t count = data.size();
+        
+        // Old stamps could match if the counter wrapped around
+        currentStamp++;
+        if (currentStamp == 0) {
+            for (Slot& slot : slots) {
+                slot.stamp = 0;
+            }
+            
+            currentStamp = 1;
+        }
+        
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::uint32_t elementID = id(data[i]);
+            
+            if (elementID >= slots.size()) {
+                slots.resize(elementID + 1, Slot{0, 0});
+            }
+            
+            slots[elementID] = Slot{currentStamp, static_cast<std::uint32_t>(i)};
+        }
+        
+        // Stamps of the elements that have already been placed are reset to 0.
+        ordered.clear();
+        ordered.reserve(count);
+        
+        for (std::uint32_t previousID : previousOrder) {
+            if (previousID < slots.size() && slots[previousID].stamp == currentStamp) {
+                ordered.push_back(data[slots[previousID].position]);
+                slots[previousID].stamp = 0;
+            }
+        }
+        
+        for (const T& element : data) {
+            if (slots[id(element)].stamp == currentStamp) {
+                ordered.push_back(element);
+            }
+        }
+    }
+    
+    void rememberOrder(const std::vector<T>& data) {
+        previousOrder.resize(data.size());
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            previousOrder[i] = id(data[i]);
+        }
+    }
+    
+    KeyFunction key;
+    IDFunction id;
+    
+    std::uint32_t currentStamp;
+    Method lastMethod;
+    std::size_t fullSortStreak;
+    
+    std::vector<Slot> slots;
+    std::vector<std::uint32_t> previousOrder;
+    std::vector<T> ordered;
+    std::vector<T> outOfOrder;
+    std::vector<T> merged;
+    std::vector<T> scratch;
+};
+}
+}
+
+#endif // IYF_RADIX_SORT_HPP
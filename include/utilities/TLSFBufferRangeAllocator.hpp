@@ -0,0 +1,115 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef TLSF_BUFFER_RANGE_ALLOCATOR_HPP
+#define TLSF_BUFFER_RANGE_ALLOCATOR_HPP
+
+#include "utilities/BufferRangeAllocator.hpp"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace iyf {
+/// A BufferRangeAllocator that implements the Two-Level Segregated Fit algorithm. Free ranges are stored in segregated lists,
+/// one for each size class. Two bitmaps tell which of those lists aren't empty, so finding a suitable range and merging freed
+/// ranges with their neighbours take constant time, no matter how fragmented the buffer is.
+///
+/// The first level splits sizes into power of two classes and the second level splits each of those into SecondLevelCount
+/// linear subclasses. Requests get rounded up to the next subclass, which trades a tiny amount of memory for never having to
+/// search a list.
+///
+/// \warning Unlike the BufferRangeSet, this allocator only accepts ranges that it has returned from getFreeRange().
+class TLSFBufferRangeAllocator : public BufferRangeAllocator {
+public:
+    TLSFBufferRangeAllocator(Bytes totalSpace);
+    
+    virtual FreeRange getFreeRange(Bytes size, Bytes alignment) final override;
+    
+    /// \return false if the range was not allocated by this allocator.
+    virtual bool insert(const BufferRange& value) final override;
+    
+    virtual Bytes getLargestFreeRange() const final override;
+    
+    virtual std::size_t getFreeRangeCount() const final override {
+        return freeBlockCount;
+    }
+    
+    /// \return The number of ranges that are currently in use.
+    std::size_t getAllocatedRangeCount() const {
+        return allocatedBlocks.size();
+    }
+private:
+    static constexpr std::uint32_t SecondLevelLog2 = 5;
+    static constexpr std::uint32_t SecondLevelCount = 1 << SecondLevelLog2;
+    static constexpr std::uint32_t FirstLevelCount = 64 - SecondLevelLog2 + 1;
+    static constexpr std::uint32_t InvalidBlock = std::numeric_limits<std::uint32_t>::max();
+    
+    /// Describes a free or an allocated range. All blocks form a doubly linked list that is sorted by offset and free blocks
+    /// are also members of the list that corresponds to their size class.
+    struct Block {
+        std::uint64_t offset;
+        std::uint64_t size;
+        
+        std::uint32_t previousPhysical;
+        std::uint32_t nextPhysical;
+        
+        std::uint32_t previousFree;
+        std::uint32_t nextFree;
+        
+        bool free;
+    };
+    
+    static void MapSize(std::uint64_t size, std::uint32_t& firstLevel, std::uint32_t& secondLevel);
+    static std::uint64_t RoundUpToSizeClass(std::uint64_t size);
+    
+    std::uint32_t findFreeBlock(std::uint32_t firstLevel, std::uint32_t secondLevel) const;
+    std::uint32_t findFittingBlock(std::uint64_t size, std::uint64_t alignment) const;
+    
+    void insertFreeBlock(std::uint32_t block);
+    void removeFreeBlock(std::uint32_t block);
+    
+    std::uint32_t createBlock();
+    void destroyBlock(std::uint32_t block);
+    
+    std::vector<Block> blocks;
+    std::vector<std::uint32_t> unusedBlocks;
+    
+    /// Maps the offsets of allocated ranges to their blocks.
+    std::unordered_map<std::uint64_t, std::uint32_t> allocatedBlocks;
+    
+    std::uint64_t firstLevelBitmap;
+    std::array<std::uint32_t, FirstLevelCount> secondLevelBitmaps;
+    std::array<std::uint32_t, FirstLevelCount * SecondLevelCount> freeLists;
+    std::size_t freeBlockCount;
+};
+}
+
+#endif // TLSF_BUFFER_RANGE_ALLOCATOR_HPP
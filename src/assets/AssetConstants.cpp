@@ -150,6 +150,11 @@ const std::string& WorldFileExtension() {
     return ext;
 }
 
+const std::string& ManifestCacheExtension() {
+    static const std::string ext = u8".iyfmc";
+    return ext;
+}
+
 // -----------------------------------------------------------------------------
 // Special files 
 // -----------------------------------------------------------------------------
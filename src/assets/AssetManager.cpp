@@ -27,6 +27,7 @@
 // WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "assets/AssetManager.hpp"
+#include "assets/ManifestCache.hpp"
 #include "assets/loaders/MeshLoader.hpp"
 #include "assets/metadata/AnimationMetadata.hpp"
 #include "assets/metadata/MeshMetadata.hpp"
@@ -48,6 +49,8 @@
 #include "core/Platform.hpp"
 #include "core/Engine.hpp"
 #include "io/serialization/FileSerializer.hpp"
+#include "io/serialization/MemorySerializer.hpp"
+#include "io/DefaultFileSystem.hpp"
 #include "io/FileSystem.hpp"
 #include "io/serialization/FileSerializer.hpp"
 #include "io/interfaces/TextSerializable.hpp"
@@ -56,6 +59,8 @@
 #include "assets/typeManagers/MeshTypeManager.hpp"
 #include "assets/typeManagers/ShaderTypeManager.hpp"
 #include "assets/typeManagers/TextureTypeManager.hpp"
+#include "configuration/Configuration.hpp"
+#include "utilities/BufferRangeSet.hpp"
 #include "utilities/DataSizes.hpp"
 #include "utilities/FileInDir.hpp"
 
@@ -72,7 +77,7 @@ const std::chrono::milliseconds MaxAsyncLoadWindow = std::chrono::milliseconds(6
 
 using namespace iyf::literals;
 
-AssetManager::AssetManager(Engine* engine) : engine(engine), asyncLoadWindow(con::MinAsyncLoadWindow), isInit(false) {
+AssetManager::AssetManager(Engine* engine) : engine(engine), asyncLoadWindow(con::MinAsyncLoadWindow), garbageCollectionGracePeriod(0), isInit(false), manifestCacheInvalidated(false) {
     if (std::atomic<std::uint32_t>::is_always_lock_free) {
         LOG_V("std::uint32_t is lock free on this system");
     } else {
@@ -173,7 +178,12 @@ void AssetManager::initialize() {
     auto fr = brs.getFreeRange(Bytes(10), Bytes(5));
     LOG_D("Ranges {} {} {}", fr.completeRange.offset.count(), fr.completeRange.size.count(), fr.startPadding)
     
-    typeManagers[static_cast<std::size_t>(AssetType::Mesh)] = std::unique_ptr<MeshTypeManager>(new MeshTypeManager(this, 2_MiB, 1_MiB));
+    streamingScheduler = std::make_unique<StreamingScheduler>(engine->getLongTermWorkerPool());
+    
+    const bool keepMeshMirrorBuffers = engine->getConfiguration()->getValue(HS("keepMeshMirrorBuffers"), ConfigurationValueNamespace::Engine);
+    const MeshHostDataMode meshHostDataMode = keepMeshMirrorBuffers ? MeshHostDataMode::MirrorBuffers : MeshHostDataMode::CollisionCache;
+    
+    typeManagers[static_cast<std::size_t>(AssetType::Mesh)] = std::unique_ptr<MeshTypeManager>(new MeshTypeManager(this, 2_MiB, 1_MiB, BufferRangeAllocatorType::TLSF, meshHostDataMode));
     typeManagers[static_cast<std::size_t>(AssetType::Shader)] = std::unique_ptr<ShaderTypeManager>(new ShaderTypeManager(this));
     typeManagers[static_cast<std::size_t>(AssetType::Texture)] = std::unique_ptr<TextureTypeManager>(new TextureTypeManager(this));
     typeManagers[static_cast<std::size_t>(AssetType::Font)] = std::unique_ptr<FontTypeManager>(new FontTypeManager(this));
@@ -193,6 +203,9 @@ void AssetManager::initialize() {
 }
 
 void AssetManager::dispose() {
+    // The worker threads must not push data into TypeManagers that no longer exist
+    streamingScheduler->waitForReads();
+    
     for (auto& tm : typeManagers) {
         if (tm != nullptr) {
             tm->collectGarbage(GarbageCollectionRunPolicy::FullCollectionDuringDestruction);
@@ -200,6 +213,9 @@ void AssetManager::dispose() {
         }
     }
     
+    streamingScheduler->clear();
+    streamingScheduler = nullptr;
+    
     isInit = false;
 }
 
@@ -282,19 +298,17 @@ inline bool isFileNameValid(const std::string& name) {
 }
 
 template <typename T>
-inline T loadMetadata(const Path& path, bool isJSON) {
+inline T loadMetadata(const FileSystem& filesystem, const Path& path, bool isJSON) {
     T metadata;
     
+    const FileView contents = filesystem.mapWholeFile(path);
     if (isJSON) {
-        auto jsonFile = VirtualFileSystem::Instance().openFile(path, FileOpenMode::Read);
-        const auto wholeFile = jsonFile->readWholeFile();
-        
         rj::Document document;
-        document.Parse(wholeFile.first.get(), wholeFile.second);
+        document.Parse(contents.data(), contents.size());
         metadata.deserializeJSON(document);
     } else {
-        FileSerializer file(VirtualFileSystem::Instance(), path, FileOpenMode::Read);
-        metadata.deserialize(file);
+        MemorySerializer serializer(contents.data(), contents.size());
+        metadata.deserialize(serializer);
     }
     
     assert(metadata.isComplete());
@@ -303,47 +317,47 @@ inline T loadMetadata(const Path& path, bool isJSON) {
 }
 
 /// Loads the metadata and creates a AssetManager::ManifestElement from it
-inline AssetManager::ManifestElement buildManifestElement(AssetType type, bool isJSON, const Path& metadataPath, const Path& filePath) {
+inline AssetManager::ManifestElement buildManifestElement(const FileSystem& filesystem, AssetType type, bool isJSON, const Path& metadataPath, const Path& filePath) {
     AssetManager::ManifestElement me;
     me.type = type;
     me.path = filePath;
     
     switch (type) {
         case AssetType::Animation:
-            me.metadata = loadMetadata<AnimationMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<AnimationMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::Mesh:
-            me.metadata = loadMetadata<MeshMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<MeshMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::Texture:
-            me.metadata = loadMetadata<TextureMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<TextureMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::Font:
-            me.metadata = loadMetadata<FontMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<FontMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::Audio:
-            me.metadata = loadMetadata<AudioMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<AudioMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::Video:
-            me.metadata = loadMetadata<VideoMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<VideoMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::Script:
-            me.metadata = loadMetadata<ScriptMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<ScriptMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::Shader:
-            me.metadata = loadMetadata<ShaderMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<ShaderMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::Strings:
-            me.metadata = loadMetadata<StringMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<StringMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::Custom:
-            me.metadata = loadMetadata<CustomMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<CustomMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::MaterialTemplate:
-            me.metadata = loadMetadata<MaterialTemplateMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<MaterialTemplateMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::MaterialInstance:
-            me.metadata = loadMetadata<MaterialInstanceMetadata>(metadataPath, isJSON);
+            me.metadata = loadMetadata<MaterialInstanceMetadata>(filesystem, metadataPath, isJSON);
             break;
         case AssetType::COUNT:
             throw std::runtime_error("COUNT is not an asset type");
@@ -354,11 +368,7 @@ inline AssetManager::ManifestElement buildManifestElement(AssetType type, bool i
     return me;
 }
 
-/// Adds all assets of the specified type to the provided manifest
-///
-/// \warning Make sure this is always protected by a mutex
-inline void addFilesToManifest(FileSystem* filesystem, AssetType type, std::unordered_map<StringHash, AssetManager::ManifestElement>& manifest) {
-    const Path& baseDir = con::AssetTypeToPath(type);
+std::size_t AssetManager::AddFilesToManifest(const FileSystem* filesystem, AssetType type, const Path& baseDir, std::unordered_map<StringHash, ManifestElement>& manifest) {
     LOG_V("Examining contents of \"{}\"", baseDir.getGenericString());
     const auto contents = filesystem->getDirectoryContents(baseDir);
     
@@ -420,12 +430,13 @@ inline void addFilesToManifest(FileSystem* filesystem, AssetType type, std::unor
                   (hasFile ? result.second.filePath : "NOT FOUND"),
                   (hasTextMetadata ? result.second.textMetadataPath : "NOT FOUND"),
                   (hasBinaryMetadata ? result.second.binaryMetadataPath : "NOT FOUND"));
+            continue;
         }
         
         const bool isJSON = hasTextMetadata;
         const Path metadataPath = isJSON ? result.second.textMetadataPath : result.second.binaryMetadataPath;
         
-        auto me = buildManifestElement(type, isJSON, metadataPath, result.second.filePath);
+        auto me = buildManifestElement(*filesystem, type, isJSON, metadataPath, result.second.filePath);
         
         auto manifestItem = manifest.find(result.second.nameHash);
         if (manifestItem != manifest.end() && !manifestItem->second.systemAsset) {
@@ -437,6 +448,8 @@ inline void addFilesToManifest(FileSystem* filesystem, AssetType type, std::unor
     }
     
     LOG_V("Added {} {} file(s) to the manifest.\n\tIt now stores metadata of {} file(s).", count, con::AssetTypeToTranslationString(type), manifest.size());
+    
+    return count;
 }
 
 void AssetManager::buildManifestFromFilesystem() {
@@ -447,11 +460,61 @@ void AssetManager::buildManifestFromFilesystem() {
     // TODO automatically convert or delete items that were added or removed while the engine was off (e.g. thanks
     // to version control).
     std::lock_guard<std::mutex> manifestLock(manifestMutex);
-    for (std::size_t i = 0; i < static_cast<std::size_t>(AssetType::COUNT); ++i) {
-        addFilesToManifest(filesystem, static_cast<AssetType>(i), manifest);
+    
+    const Path cachePath = getManifestCachePath();
+    
+    ManifestCache::Fingerprints fingerprints;
+    ManifestCache::TypeMask cachedTypes;
+    
+    if (!cachePath.empty()) {
+        for (std::size_t i = 0; i < ManifestCache::TypeCount; ++i) {
+            const auto sources = filesystem->getRealSearchPathSources(con::AssetTypeToPath(static_cast<AssetType>(i)));
+            fingerprints[i] = ManifestCache::ComputeFingerprint(sources);
+        }
+        
+        cachedTypes = ManifestCache::Load(DefaultFileSystem::Instance(), cachePath, fingerprints, manifest);
+        LOG_V("Loaded {} of {} asset types from the manifest cache. It now stores metadata of {} file(s).", cachedTypes.count(), ManifestCache::TypeCount, manifest.size());
+    }
+    
+    for (std::size_t i = 0; i < ManifestCache::TypeCount; ++i) {
+        if (!cachedTypes.test(i)) {
+            const AssetType type = static_cast<AssetType>(i);
+            AddFilesToManifest(filesystem, type, con::AssetTypeToPath(type), manifest);
+        }
+    }
+    
+    if (!cachePath.empty() && !cachedTypes.all()) {
+        ManifestCache::Save(DefaultFileSystem::Instance(), cachePath, fingerprints, manifest);
     }
 }
 
+Path AssetManager::getManifestCachePath() const {
+    const VirtualFileSystem* filesystem = engine->getFileSystem();
+    
+    const Path& preferenceDirectory = filesystem->getPreferenceDirectory();
+    if (preferenceDirectory.empty()) {
+        return Path();
+    }
+    
+    // In editor mode, all Projects share the same preference directory
+    const StringHash writeDirectoryHash = HS(filesystem->getCurrentWriteDirectory().getGenericString());
+    return preferenceDirectory / fmt::format("manifest-{:016x}{}", writeDirectoryHash.value(), con::ManifestCacheExtension());
+}
+
+void AssetManager::invalidateManifestCache() {
+    if (manifestCacheInvalidated) {
+        return;
+    }
+    
+    const Path cachePath = getManifestCachePath();
+    if (!cachePath.empty() && DefaultFileSystem::Instance().exists(cachePath)) {
+        DefaultFileSystem::Instance().remove(cachePath);
+    }
+    
+    // The cache will be rebuilt during the next launch
+    manifestCacheInvalidated = true;
+}
+
 bool AssetManager::serializeMetadata(StringHash nameHash, Serializer& file) {
     std::lock_guard<std::mutex> manifestLock(manifestMutex);
     
@@ -470,7 +533,7 @@ bool AssetManager::serializeMetadata(StringHash nameHash, Serializer& file) {
 void AssetManager::collectGarbage() {
     for (auto& tm : typeManagers) {
         if (tm != nullptr) {
-            tm->collectGarbage(GarbageCollectionRunPolicy::FullCollection);
+            tm->collectGarbage(GarbageCollectionRunPolicy::IncrementalCollection);
         }
     }
 }
@@ -478,7 +541,10 @@ void AssetManager::collectGarbage() {
 void AssetManager::enableLoadedAssets() {
     const std::chrono::nanoseconds window = asyncLoadWindow;
     const auto start = std::chrono::steady_clock::now();
-    auto now = start;
+    
+    // Cancels unneeded loads, starts new ones and resets the per frame upload budget
+    streamingScheduler->update();
+    auto now = std::chrono::steady_clock::now();
 
     for (auto& tm : typeManagers) {
         if (tm != nullptr) {
@@ -486,14 +552,16 @@ void AssetManager::enableLoadedAssets() {
             
             if (canBatch) {
                 while ((tm->hasAssetsToEnable() == AssetsToEnableResult::HasAssetsToEnable) &&
-                       ((now + tm->estimateBatchOperationDuration()) - start < window)) {
+                       ((now + tm->estimateBatchOperationDuration()) - start < window) &&
+                       streamingScheduler->canUpload(tm->getNextUploadSize())) {
                     tm->enableAsyncLoadedAsset(true);
                     
                     now = std::chrono::steady_clock::now();
                 }
             } else {
                 while ((tm->hasAssetsToEnable() == AssetsToEnableResult::HasAssetsToEnable) &&
-                       (now - start < window)) {
+                       (now - start < window) &&
+                       streamingScheduler->canUpload(tm->getNextUploadSize())) {
                     tm->enableAsyncLoadedAsset(false);
                     
                     now = std::chrono::steady_clock::now();
@@ -586,6 +654,8 @@ void AssetManager::requestAssetRefresh(AssetType type, const Path& path) {
         throw std::logic_error("This method can't be used when the engine is running in game mode.");
     }
     
+    invalidateManifestCache();
+    
     const VirtualFileSystem* fs = engine->getFileSystem();
     
     auto validationResult = ValidateAndHashPath(fs, path);
@@ -613,7 +683,7 @@ void AssetManager::requestAssetRefresh(AssetType type, const Path& path) {
         return;
     }
     
-    AssetManager::ManifestElement me = buildManifestElement(type, textMetadataExists, textMetadataExists ? textMetadataPath : binaryMetadataPath, path);
+    AssetManager::ManifestElement me = buildManifestElement(*fs, type, textMetadataExists, textMetadataExists ? textMetadataPath : binaryMetadataPath, path);
     //manifest[nameHash] = std::move(me);
     auto manifestElement = manifest.insert_or_assign(nameHash, std::move(me));
     if (manifestElement.second) {
@@ -640,6 +710,8 @@ void AssetManager::requestAssetDeletion(const Path& path, [[maybe_unused]] bool
         throw std::logic_error("This method can't be used when the engine is running in game mode.");
     }
     
+    invalidateManifestCache();
+    
     std::lock_guard<std::mutex> manifestLock(manifestMutex);
     std::lock_guard<std::mutex> assetLock(loadedAssetListMutex);
     
@@ -705,6 +777,8 @@ void AssetManager::requestAssetMove(const Path& sourcePath, const Path& destinat
         throw std::logic_error("This method can't be used when the engine is running in game mode.");
     }
     
+    invalidateManifestCache();
+    
     std::lock_guard<std::mutex> manifestLock(manifestMutex);
     std::lock_guard<std::mutex> assetLock(loadedAssetListMutex);
     
@@ -839,6 +913,8 @@ void AssetManager::appendAssetToManifest(StringHash nameHash, const Path& path,
         throw std::logic_error("This method can't be used when the engine is running in game mode.");
     }
     
+    invalidateManifestCache();
+    
     std::lock_guard<std::mutex> manifestLock(manifestMutex);
     manifest[nameHash] = {path, metadata.getAssetType(), false, metadata};
 }
@@ -848,6 +924,8 @@ void AssetManager::removeAssetFromManifest(StringHash nameHash) {
         throw std::logic_error("This method can't be used when the engine is running in game mode.");
     }
     
+    invalidateManifestCache();
+    
     std::lock_guard<std::mutex> manifestLock(manifestMutex);
     std::lock_guard<std::mutex> assetLock(loadedAssetListMutex);
     
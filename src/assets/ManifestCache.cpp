@@ -0,0 +1,262 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "assets/ManifestCache.hpp"
+#include "io/ChecksummedFile.hpp"
+#include "io/exceptions/SerializerException.hpp"
+#include "io/serialization/MemorySerializer.hpp"
+#include "logging/Logger.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+
+namespace iyf {
+/// Magic, version, padding, type count and entry count
+static constexpr std::size_t HeaderSize = 4 + 2 + 2 + 4 + 4;
+
+/// Fingerprint, first entry and entry count
+static constexpr std::size_t SectionSize = 8 + 4 + 4;
+
+/// Name hash and record offset
+static constexpr std::size_t IndexEntrySize = 8 + 8;
+
+struct CacheSection {
+    std::uint64_t fingerprint;
+    std::uint32_t firstEntry;
+    std::uint32_t entryCount;
+};
+
+std::uint64_t ManifestCache::ComputeFingerprint(const std::vector<Path>& sources) {
+    namespace fs = std::filesystem;
+    
+    const fs::file_time_type now = fs::file_time_type::clock::now();
+    const fs::file_time_type recentModificationLimit = now - std::chrono::seconds(RecentModificationWindowSeconds);
+    
+    MemorySerializer data(1024);
+    data.writeUInt32(static_cast<std::uint32_t>(sources.size()));
+    
+    for (const Path& source : sources) {
+        std::error_code ec;
+        const fs::file_time_type modificationTime = fs::last_write_time(source.getNativeString(), ec);
+        
+        if (ec || modificationTime > recentModificationLimit) {
+            return UncacheableFingerprint;
+        }
+        
+        data.writeString(source.getGenericString(), StringLengthIndicator::UInt32);
+        data.writeInt64(static_cast<std::int64_t>(modificationTime.time_since_epoch().count()));
+    }
+    
+    const std::uint64_t fingerprint = HF(data.data(), data.size()).value();
+    return (fingerprint == UncacheableFingerprint) ? (fingerprint + 1) : fingerprint;
+}
+
+ManifestCache::TypeMask ManifestCache::Load(const FileSystem& filesystem, const Path& path, const Fingerprints& fingerprints, Manifest& manifest) {
+    TypeMask loadedTypes;
+    
+    const FileView contents = ReadChecksummedFile(filesystem, path, HeaderSize + SectionSize * TypeCount, "manifest cache");
+    if (contents.empty()) {
+        return loadedTypes;
+    }
+    
+    const std::size_t dataSize = contents.size();
+    MemorySerializer serializer(contents.data(), dataSize);
+    
+    try {
+        const std::uint32_t magic = serializer.readUInt32();
+        const std::uint16_t version = serializer.readUInt16();
+        serializer.readUInt16();
+        
+        const std::uint32_t typeCount = serializer.readUInt32();
+        const std::uint32_t entryCount = serializer.readUInt32();
+        
+        if (magic != Magic || version != Version || typeCount != TypeCount) {
+            LOG_V("Ignoring an outdated manifest cache {}", path);
+            return loadedTypes;
+        }
+        
+        const std::size_t indexStart = HeaderSize + SectionSize * TypeCount;
+        if (indexStart + static_cast<std::size_t>(entryCount) * IndexEntrySize > dataSize) {
+            LOG_W("Ignoring a manifest cache with an index that doesn't fit in the file {}", path);
+            return loadedTypes;
+        }
+        
+        std::array<CacheSection, TypeCount> sections;
+        for (CacheSection& section : sections) {
+            section.fingerprint = serializer.readUInt64();
+            section.firstEntry = serializer.readUInt32();
+            section.entryCount = serializer.readUInt32();
+            
+            if (static_cast<std::uint64_t>(section.firstEntry) + section.entryCount > entryCount) {
+                LOG_W("Ignoring a manifest cache with an invalid section table {}", path);
+                return loadedTypes;
+            }
+        }
+        
+        std::vector<std::pair<StringHash, AssetManager::ManifestElement>> elements;
+        for (std::size_t i = 0; i < TypeCount; ++i) {
+            const CacheSection& section = sections[i];
+            
+            if (fingerprints[i] == UncacheableFingerprint || section.fingerprint != fingerprints[i]) {
+                continue;
+            }
+            
+            const AssetType type = static_cast<AssetType>(i);
+            
+            // Parse the whole section before adding anything to the manifest. This way a failure can't leave a partially
+            // loaded type behind.
+            elements.clear();
+            elements.reserve(section.entryCount);
+            
+            for (std::uint32_t entry = section.firstEntry; entry < section.firstEntry + section.entryCount; ++entry) {
+                serializer.seek(indexStart + static_cast<std::size_t>(entry) * IndexEntrySize);
+                
+                const StringHash nameHash(serializer.readUInt64());
+                const std::uint64_t recordOffset = serializer.readUInt64();
+                
+                if (recordOffset >= dataSize) {
+                    throw SerializerException("A record offset is out of bounds");
+                }
+                
+                serializer.seek(static_cast<std::int64_t>(recordOffset));
+                
+                AssetManager::ManifestElement element;
+                
+                std::string assetPath;
+                serializer.readString(assetPath, StringLengthIndicator::UInt16, 0);
+                element.path = Path(assetPath);
+                element.type = type;
+                element.systemAsset = serializer.readUInt8() != 0;
+                
+                const MetadataSource source = static_cast<MetadataSource>(serializer.readUInt8());
+                element.metadata = Metadata::Deserialize(type, serializer);
+                
+                // The editor expects to see where the metadata originally came from
+                element.metadata.getBase().metadataSource = source;
+                
+                elements.emplace_back(nameHash, std::move(element));
+            }
+            
+            for (auto& element : elements) {
+                manifest[element.first] = std::move(element.second);
+            }
+            
+            loadedTypes.set(i);
+        }
+    } catch (const std::exception& e) {
+        LOG_W("Failed to load the manifest cache {}: {}", path, e.what());
+    }
+    
+    return loadedTypes;
+}
+
+bool ManifestCache::Save(const FileSystem& filesystem, const Path& path, const Fingerprints& fingerprints, const Manifest& manifest) {
+    std::array<std::vector<std::pair<StringHash, const AssetManager::ManifestElement*>>, TypeCount> elementsByType;
+    
+    for (const auto& element : manifest) {
+        const std::size_t type = static_cast<std::size_t>(element.second.type);
+        
+        if (type < TypeCount && fingerprints[type] != UncacheableFingerprint) {
+            elementsByType[type].emplace_back(element.first, &element.second);
+        }
+    }
+    
+    std::size_t entryCount = 0;
+    for (auto& elements : elementsByType) {
+        std::sort(elements.begin(), elements.end(), [](const auto& a, const auto& b) {
+            return a.first.value() < b.first.value();
+        });
+        
+        entryCount += elements.size();
+    }
+    
+    // The records are written first because their offsets need to be stored in the index
+    const std::size_t recordStart = HeaderSize + SectionSize * TypeCount + IndexEntrySize * entryCount;
+    
+    MemorySerializer records(entryCount * 256);
+    std::vector<std::uint64_t> recordOffsets;
+    recordOffsets.reserve(entryCount);
+    
+    try {
+        for (const auto& elements : elementsByType) {
+            for (const auto& element : elements) {
+                recordOffsets.push_back(recordStart + records.size());
+                
+                const MetadataBase& metadata = element.second->metadata.getBase();
+                
+                records.writeString(element.second->path.getGenericString(), StringLengthIndicator::UInt16);
+                records.writeUInt8(element.second->systemAsset ? 1 : 0);
+                records.writeUInt8(static_cast<std::uint8_t>(metadata.getMetadataSource()));
+                metadata.serialize(records);
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG_W("Failed to serialize the manifest cache {}: {}", path, e.what());
+        return false;
+    }
+    
+    MemorySerializer data(recordStart + records.size() + ChecksumSize);
+    data.writeUInt32(Magic);
+    data.writeUInt16(Version);
+    data.writeUInt16(0);
+    data.writeUInt32(static_cast<std::uint32_t>(TypeCount));
+    data.writeUInt32(static_cast<std::uint32_t>(entryCount));
+    
+    std::size_t firstEntry = 0;
+    for (std::size_t i = 0; i < TypeCount; ++i) {
+        data.writeUInt64(fingerprints[i]);
+        data.writeUInt32(static_cast<std::uint32_t>(firstEntry));
+        data.writeUInt32(static_cast<std::uint32_t>(elementsByType[i].size()));
+        
+        firstEntry += elementsByType[i].size();
+    }
+    
+    std::size_t entry = 0;
+    for (const auto& elements : elementsByType) {
+        for (const auto& element : elements) {
+            data.writeUInt64(element.first.value());
+            data.writeUInt64(recordOffsets[entry]);
+            
+            entry++;
+        }
+    }
+    
+    assert(data.size() == recordStart);
+    data.writeBytes(records.data(), records.size());
+    
+    if (!WriteChecksummedFile(filesystem, path, Path(path.getGenericString() + ".tmp"), data, "manifest cache")) {
+        return false;
+    }
+    
+    LOG_V("Wrote a manifest cache with {} entries to {}", entryCount, path);
+    return true;
+}
+
+}
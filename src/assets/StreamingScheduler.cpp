@@ -0,0 +1,268 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "assets/StreamingScheduler.hpp"
+#include "threading/ThreadPool.hpp"
+#include "threading/ThreadProfiler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace iyf {
+StreamingScheduler::StreamingScheduler(iyft::ThreadPool* pool, StreamingBudget budget)
+    : pool(pool), budget(budget), queueSorted(true), nextSequence(0), dispatchedReads(0), finishedReads(0), bytesInFlight(0),
+      bytesUploadedThisFrame(0), completedRequests(0), cancelledRequests(0), nextLatency(0) {
+    if (pool == nullptr) {
+        throw std::logic_error("The StreamingScheduler requires a ThreadPool");
+    }
+    
+    if (budget.maxReadsInFlight == 0) {
+        throw std::logic_error("StreamingBudget::maxReadsInFlight must be > 0");
+    }
+    
+    latencies.reserve(LatencySampleCount);
+}
+
+StreamingScheduler::~StreamingScheduler() {
+    waitForReads();
+}
+
+void StreamingScheduler::setBudget(const StreamingBudget& newBudget) {
+    if (newBudget.maxReadsInFlight == 0) {
+        throw std::logic_error("StreamingBudget::maxReadsInFlight must be > 0");
+    }
+    
+    budget = newBudget;
+}
+
+StreamingRequest* StreamingScheduler::submit(std::unique_ptr<StreamingRequest> request) {
+    assert(request != nullptr);
+    assert(request->handler != nullptr);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    StreamingRequest* result = request.get();
+    result->sequence = nextSequence++;
+    result->submitted = std::chrono::steady_clock::now();
+    
+    [[maybe_unused]] const bool inserted = requests.emplace(result->nameHash, std::move(request)).second;
+    assert(inserted);
+    
+    queue.push_back(result);
+    queueSorted = false;
+    
+    return result;
+}
+
+bool StreamingScheduler::markReferenced(StringHash nameHash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    const auto result = requests.find(nameHash);
+    if (result == requests.end()) {
+        return false;
+    }
+    
+    result->second->wasReferenced = true;
+    return true;
+}
+
+bool StreamingScheduler::setPriority(StringHash nameHash, float priority) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    // Linear, but reprioritizing many requests at once is cheaper this way than keeping a heap up to date, and the queue
+    // only holds requests that haven't been dispatched yet.
+    const auto result = std::find_if(queue.begin(), queue.end(), [nameHash](const StreamingRequest* request) {
+        return request->nameHash == nameHash;
+    });
+    
+    if (result == queue.end()) {
+        return false;
+    }
+    
+    if ((*result)->priority != priority) {
+        (*result)->priority = priority;
+        queueSorted = false;
+    }
+    
+    return true;
+}
+
+void StreamingScheduler::update() {
+    IYFT_PROFILE(StreamingSchedulerUpdate, iyft::ProfilerTag::Assets)
+    
+    bytesUploadedThisFrame = 0;
+    
+    std::vector<std::unique_ptr<StreamingRequest>> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        // Cancel requests of Assets that were referenced at some point, but aren't any more. This includes the ones that lost
+        // their last reference before this function saw them for the first time.
+        auto newEnd = std::remove_if(queue.begin(), queue.end(), [this, &cancelled](StreamingRequest* request) {
+            if (request->referenceCounter == nullptr || !request->wasReferenced) {
+                return false;
+            }
+            
+            if (request->referenceCounter->load(std::memory_order_acquire) != 0) {
+                return false;
+            }
+            
+            const auto node = requests.find(request->nameHash);
+            assert(node != requests.end());
+            
+            cancelled.push_back(std::move(node->second));
+            requests.erase(node);
+            
+            return true;
+        });
+        queue.erase(newEnd, queue.end());
+        
+        if (!queueSorted) {
+            // The highest priority ends up at the back, where it can be popped cheaply
+            std::sort(queue.begin(), queue.end(), [](const StreamingRequest* a, const StreamingRequest* b) {
+                if (a->priority != b->priority) {
+                    return a->priority < b->priority;
+                }
+                
+                return a->sequence > b->sequence;
+            });
+            
+            queueSorted = true;
+        }
+        
+        while (!queue.empty()) {
+            const std::size_t inFlight = dispatchedReads - finishedReads.load(std::memory_order_acquire);
+            if (inFlight >= budget.maxReadsInFlight) {
+                break;
+            }
+            
+            StreamingRequest* request = queue.back();
+            if ((bytesInFlight != 0) && (bytesInFlight + request->estimatedSize > budget.cpuMemory.count())) {
+                break;
+            }
+            
+            queue.pop_back();
+            dispatch(request);
+        }
+    }
+    
+    // Called without holding the lock because the handlers may end up calling back into the AssetManager
+    for (auto& request : cancelled) {
+        request->handler->cancelStreamingRequest(*request);
+        cancelledRequests++;
+    }
+}
+
+void StreamingScheduler::dispatch(StreamingRequest* request) {
+    dispatchedReads++;
+    bytesInFlight += request->estimatedSize;
+    
+    pool->addTask([this, request]() {
+        IYFT_PROFILE(StreamingRead, iyft::ProfilerTag::Assets)
+        
+        request->handler->executeStreamingRequest(*request);
+        
+        // Notifying under the lock prevents lost wake-ups and keeps the scheduler alive until notify_all() returns because
+        // the destructor calls waitForReads().
+        std::lock_guard<std::mutex> lock(readsMutex);
+        finishedReads.fetch_add(1, std::memory_order_release);
+        readsFinished.notify_all();
+    });
+}
+
+void StreamingScheduler::notifyEnabled(StreamingRequest* request) {
+    const auto now = std::chrono::steady_clock::now();
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    assert(bytesInFlight >= request->estimatedSize);
+    bytesInFlight -= request->estimatedSize;
+    bytesUploadedThisFrame += request->estimatedSize;
+    completedRequests++;
+    
+    const std::chrono::nanoseconds latency = now - request->submitted;
+    if (latencies.size() < LatencySampleCount) {
+        latencies.push_back(latency);
+    } else {
+        latencies[nextLatency] = latency;
+    }
+    nextLatency = (nextLatency + 1) % LatencySampleCount;
+    
+    [[maybe_unused]] const std::size_t erased = requests.erase(request->nameHash);
+    assert(erased == 1);
+}
+
+void StreamingScheduler::waitForReads() const {
+    std::unique_lock<std::mutex> lock(readsMutex);
+    readsFinished.wait(lock, [this]() {
+        return finishedReads.load(std::memory_order_acquire) == dispatchedReads;
+    });
+}
+
+void StreamingScheduler::clear() {
+    waitForReads();
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.clear();
+    requests.clear();
+    bytesInFlight = 0;
+}
+
+StreamingStatistics StreamingScheduler::getStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    StreamingStatistics statistics;
+    
+    const std::size_t finished = finishedReads.load(std::memory_order_acquire);
+    statistics.queuedRequests = queue.size();
+    statistics.readsInFlight = dispatchedReads - finished;
+    // A handler may hand the request over to the main thread before the read is counted as finished
+    statistics.awaitingEnable = (finished > completedRequests) ? (finished - completedRequests) : 0;
+    statistics.bytesInFlight = bytesInFlight;
+    statistics.bytesUploadedThisFrame = bytesUploadedThisFrame;
+    statistics.completedRequests = completedRequests;
+    statistics.cancelledRequests = cancelledRequests;
+    
+    if (!latencies.empty()) {
+        std::vector<std::chrono::nanoseconds> sorted = latencies;
+        std::sort(sorted.begin(), sorted.end());
+        
+        auto percentile = [&sorted](std::size_t p) {
+            return sorted[std::min(sorted.size() - 1, (sorted.size() * p) / 100)];
+        };
+        
+        statistics.latencyP50 = percentile(50);
+        statistics.latencyP90 = percentile(90);
+        statistics.latencyP99 = percentile(99);
+    }
+    
+    return statistics;
+}
+
+}
@@ -31,6 +31,7 @@
 #include "core/Engine.hpp"
 #include "core/filesystem/VirtualFileSystem.hpp"
 #include "io/File.hpp"
+#include "io/FileSystem.hpp"
 #include "graphics/MeshFormats.hpp"
 #include "logging/Logger.hpp"
 #include "graphics/culling/BoundingVolumes.hpp"
@@ -38,6 +39,7 @@
 #include "assets/metadata/MeshMetadata.hpp"
 
 #include <vector>
+#include <cstddef>
 #include <cstring>
 
 #include <glm/gtx/string_cast.hpp>
@@ -45,9 +47,9 @@
 namespace iyf {
 using namespace iyf::literals;
 
-bool MeshLoader::loadMesh(const Path& path, LoadedMeshData& submeshes, void* vertexBuffer, void* indexBuffer, std::vector<Bone>* skeleton) const {
-    VirtualFileSystem* fileSystem = engine->getFileSystem();
+MeshLoader::MeshLoader(Engine* engine) : fileSystem(engine->getFileSystem()) {}
 
+bool MeshLoader::checkIfMeshExists(const Path& path) const {
     FileSystemResult result;
     bool exists = fileSystem->exists(path, result);
 
@@ -56,32 +58,121 @@ bool MeshLoader::loadMesh(const Path& path, LoadedMeshData& submeshes, void* ver
         return false;
     }
     
-    if (exists) {
+    if (!exists) {
+        LOG_E("Can't load mesh from {}. File does not exist.", path);
+        return false;
+    }
+    
+    return true;
+}
+
+/// \return The version number of a mapped mesh file or 0 if the magic number is wrong
+static std::uint16_t GetMappedMeshVersion(const FileView& file) {
+    if (file.size() < sizeof(mf::MagicNumber) + sizeof(std::uint16_t) || std::strncmp(mf::MagicNumber, file.data(), 4) != 0) {
+        return 0;
+    }
+    
+    std::uint16_t version;
+    std::memcpy(&version, file.data() + sizeof(mf::MagicNumber), sizeof(std::uint16_t));
+    return version;
+}
+
+bool MeshLoader::loadMesh(const Path& path, LoadedMeshData& submeshes, void* vertexBuffer, void* indexBuffer, std::vector<Bone>* skeleton) const {
+    if (vertexBuffer == nullptr || indexBuffer == nullptr) {
+        LOG_E("Vertex and index buffer pointers passed to loadMesh function must never be nullptr.")
+        return false;
+    }
+    
+    if (!checkIfMeshExists(path)) {
+        return false;
+    }
+    
+    // Version 2 files are mapped and the vertex and index data is copied in two memcpy calls
+    const FileView file = fileSystem->mapWholeFile(path);
+    const std::uint16_t version = GetMappedMeshVersion(file);
+    
+    switch (version) {
+    case 0:
+        LOG_E("Can't load mesh from {}. Magic number is not {}", path, mf::MagicNumber);
+        return false;
+    case 1: {
         auto fr = fileSystem->openFile(path, FileOpenMode::Read);
-        auto headerData = readHeader(*fr);
+        readHeader(*fr);
         
-        if (!headerData.first) {
-            LOG_E("Can't load mesh from {}. Magic number is not {}", path, mf::MagicNumber);
-            
+        return loadMeshV1(*fr, submeshes, vertexBuffer, indexBuffer, skeleton);
+    }
+    case 2: {
+        mf::v2::MeshFileView view;
+        if (!loadMeshV2(file, view, submeshes, skeleton)) {
+            LOG_E("Can't load mesh from {}. The file is corrupted.", path);
             return false;
         }
         
-        switch (headerData.second) {
-        case 1:
-            return loadMeshV1(*fr, submeshes, vertexBuffer, indexBuffer, skeleton);
-        default:
-            LOG_E("Can't load mesh from {}. Unknown version number: {}", headerData.second, path);
+        std::memcpy(vertexBuffer, view.vertexData, view.vertexDataSize);
+        std::memcpy(indexBuffer, view.indexData, view.indexDataSize);
+        
+        return true;
+    }
+    default:
+        LOG_E("Can't load mesh from {}. Unknown version number: {}", path, version);
+        return false;
+    }
+}
+
+bool MeshLoader::mapMesh(const Path& path, LoadedMeshData& meshData, MappedMeshData& mappedData, std::vector<Bone>* skeleton) const {
+    if (!checkIfMeshExists(path)) {
+        return false;
+    }
+    
+    FileView file = fileSystem->mapWholeFile(path);
+    const std::uint16_t version = GetMappedMeshVersion(file);
+    
+    switch (version) {
+    case 0:
+        LOG_E("Can't load mesh from {}. Magic number is not {}", path, mf::MagicNumber);
+        return false;
+    case 1: {
+        // Version 1 files need to be parsed field by field, so the data gets copied into a buffer
+        file.reset();
+        
+        auto fr = fileSystem->openFile(path, FileOpenMode::Read);
+        readHeader(*fr);
+        
+        const MemoryRequirements requirements = getMemoryRequirementsV1(*fr);
+        const std::size_t size = requirements.vertexSize.count() + requirements.indexSize.count();
+        std::shared_ptr<char[]> buffer(new char[size]);
+        
+        fr->seek(sizeof(mf::MagicNumber) + sizeof(std::uint16_t), File::SeekFrom::Start);
+        if (!loadMeshV1(*fr, meshData, buffer.get(), buffer.get() + requirements.vertexSize.count(), skeleton)) {
             return false;
         }
-    } else {
-        LOG_E("Can't load mesh from {}. File does not exist.", path);
+        
+        mappedData.vertexData = buffer.get();
+        mappedData.indexData = buffer.get() + requirements.vertexSize.count();
+        mappedData.file = FileView(buffer.get(), size, std::move(buffer), false);
+        
+        return true;
+    }
+    case 2: {
+        mf::v2::MeshFileView view;
+        if (!loadMeshV2(file, view, meshData, skeleton)) {
+            LOG_E("Can't load mesh from {}. The file is corrupted.", path);
+            return false;
+        }
+        
+        mappedData.vertexData = view.vertexData;
+        mappedData.indexData = view.indexData;
+        mappedData.file = std::move(file);
+        
+        return true;
+    }
+    default:
+        LOG_E("Can't load mesh from {}. Unknown version number: {}", path, version);
         return false;
     }
 }
 
 bool MeshLoader::loadAnimation(const Path& path, Animation& buffer) const {
-    VirtualFileSystem* fileSystem = engine->getFileSystem();
-    
     FileSystemResult result;
     bool exists = fileSystem->exists(path, result);
 
@@ -113,35 +204,26 @@ bool MeshLoader::loadAnimation(const Path& path, Animation& buffer) const {
 }
 
 MeshLoader::MemoryRequirements MeshLoader::getMeshMemoryRequirements(const Path& path) const {
-    VirtualFileSystem* fileSystem = engine->getFileSystem();
-
-    FileSystemResult result;
-    bool exists = fileSystem->exists(path, result);
-
-    if (result != FileSystemResult::Success) {
-        LOG_E("Can't load mesh from {}. Failed to determine if the file exists", path);
-        throw std::runtime_error("Failed to determine if a mesh exists.");
+    if (!checkIfMeshExists(path)) {
+        throw std::runtime_error("Mesh file does not exist.");
     }
     
-    if (exists) {
-        auto fr = fileSystem->openFile(path, FileOpenMode::Read);
-        auto headerData = readHeader(*fr);
-        
-        if (!headerData.first) {
-            LOG_E("Can't load mesh from {}. Magic number is not {}", path, mf::MagicNumber)
-            throw std::runtime_error("Mesh file has an invalid magic number.");
-        }
-        
-        switch (headerData.second) {
-        case 1:
-            return getMemoryRequirementsV1(*fr);
-        default:
-            LOG_E("Can't load mesh from {}. Unknown version number: {}", path, headerData.second)
-            throw std::runtime_error("Mesh file is of an unknown version.");
-        }
-    } else {
-        LOG_E("Can't load mesh from {}. File does not exist.", path)
-        throw std::runtime_error("Mesh file does not exist.");
+    auto fr = fileSystem->openFile(path, FileOpenMode::Read);
+    auto headerData = readHeader(*fr);
+    
+    if (!headerData.first) {
+        LOG_E("Can't load mesh from {}. Magic number is not {}", path, mf::MagicNumber)
+        throw std::runtime_error("Mesh file has an invalid magic number.");
+    }
+    
+    switch (headerData.second) {
+    case 1:
+        return getMemoryRequirementsV1(*fr);
+    case 2:
+        return getMemoryRequirementsV2(*fr);
+    default:
+        LOG_E("Can't load mesh from {}. Unknown version number: {}", path, headerData.second)
+        throw std::runtime_error("Mesh file is of an unknown version.");
     }
 }
 
@@ -187,6 +269,8 @@ MeshLoader::MemoryRequirements MeshLoader::getMeshMemoryRequirements(const Metad
     switch (meshMetadata.getMeshFormatVersion()) {
     case 1:
         return getMemoryRequirementsV1(meshMetadata);
+    case 2:
+        return getMemoryRequirementsV2(meshMetadata);
     default:
         LOG_E("Unknown mesh version number in Metadata object: {}", meshMetadata.getMeshFormatVersion())
         throw std::runtime_error("Unknown mesh version.");
@@ -221,6 +305,38 @@ MeshLoader::MemoryRequirements MeshLoader::getMemoryRequirementsV1(const MeshMet
     return mr;
 }
 
+MeshLoader::MemoryRequirements MeshLoader::getMemoryRequirementsV2(File& fr) const {
+    // The whole fixed size header in a single read
+    mf::v2::Header header;
+    const std::size_t remainingSize = sizeof(mf::v2::Header) - offsetof(mf::v2::Header, vertexDataLayout);
+    if (fr.readBytes(&header.vertexDataLayout, remainingSize) != static_cast<std::int64_t>(remainingSize)) {
+        throw std::runtime_error("Mesh file is too small.");
+    }
+    
+    if (header.vertexDataLayout >= static_cast<std::uint8_t>(VertexDataLayout::COUNT)) {
+        throw std::runtime_error("Mesh file has an unknown vertex data layout.");
+    }
+    
+    MemoryRequirements mr;
+    mr.vertexDataLayout = static_cast<VertexDataLayout>(header.vertexDataLayout);
+    mr.vertexSize = Bytes(header.vertexCount * con::GetVertexDataLayoutDefinition(mr.vertexDataLayout).getSize().count());
+    mr.indices32Bit = header.flags & mf::v2::HeaderFlagBits::Indices32Bit;
+    mr.indexSize = Bytes(header.indexCount * (mr.indices32Bit ? sizeof(std::uint32_t) : sizeof(std::uint16_t)));
+    mr.boneCount = header.boneCount;
+    
+    return mr;
+}
+
+MeshLoader::MemoryRequirements MeshLoader::getMemoryRequirementsV2(const MeshMetadata& metadata) const {
+    // Version 2 uses the same vertex layouts. Unlike version 1, it may store 32 bit indices.
+    MemoryRequirements mr = getMemoryRequirementsV1(metadata);
+    
+    mr.indices32Bit = metadata.uses32BitIndices();
+    mr.indexSize = Bytes(metadata.getIndexCount() * (mr.indices32Bit ? sizeof(std::uint32_t) : sizeof(std::uint16_t)));
+    
+    return mr;
+}
+
 std::pair<bool, std::uint16_t> MeshLoader::readHeader(File& fr) const {
     char magicNumber[4];
     fr.readBytes(magicNumber, sizeof(char) * 4);
@@ -298,6 +414,7 @@ bool MeshLoader::loadMeshV1(File& fr, LoadedMeshData& meshData, void* vertexBuff
         auto& submeshData = meshData.submeshes[s];
         submeshData.numVertices = numVertices;
         submeshData.numIndices = numIndices;
+        submeshData.lodCount = 0;
         
 //         submeshData.aabb.minCorner.x = fr.readFloat();
 //         submeshData.aabb.minCorner.y = fr.readFloat();
@@ -358,6 +475,70 @@ bool MeshLoader::loadMeshV1(File& fr, LoadedMeshData& meshData, void* vertexBuff
     return true;
 }
 
+bool MeshLoader::loadMeshV2(const FileView& file, mf::v2::MeshFileView& view, LoadedMeshData& meshData, std::vector<Bone>* skeleton) const {
+    if (!mf::v2::ParseMesh(file.data(), file.size(), view)) {
+        return false;
+    }
+    
+    const mf::v2::Header& header = view.header;
+    if (header.vertexDataLayout >= static_cast<std::uint8_t>(VertexDataLayout::COUNT)) {
+        return false;
+    }
+    
+    const VertexDataLayout layout = static_cast<VertexDataLayout>(header.vertexDataLayout);
+    if (view.vertexDataSize != header.vertexCount * con::GetVertexDataLayoutDefinition(layout).getSize().count()) {
+        return false;
+    }
+    
+    if (header.boneCount > 0 && skeleton == nullptr) {
+        LOG_E("A pointer to the skeleton data vector must not be nullptr if the mesh has bones.")
+        return false;
+    }
+    
+    meshData.count = header.submeshCount;
+    for (std::size_t s = 0; s < header.submeshCount; ++s) {
+        const mf::v2::SubmeshRecord submesh = view.getSubmesh(s);
+        
+        meshData.submeshes[s].numVertices = submesh.vertexCount;
+        meshData.submeshes[s].numIndices = submesh.indexCount;
+        meshData.submeshes[s].lodCount = 0;
+    }
+    
+    // ParseMesh() has checked that the levels of each submesh are stored in order
+    for (std::size_t l = 0; l < view.lodCount; ++l) {
+        const mf::v2::LodRecord record = view.getLod(l);
+        LoadedSubMeshData& submesh = meshData.submeshes[record.submesh];
+        
+        submesh.lods[submesh.lodCount] = {record.indexOffset, record.indexCount, record.error};
+        submesh.lodCount++;
+    }
+    
+    meshData.aabb.vertices[static_cast<int>(AABB::Vertex::Minimum)] = glm::vec3(header.aabbMinimum[0], header.aabbMinimum[1], header.aabbMinimum[2]);
+    meshData.aabb.vertices[static_cast<int>(AABB::Vertex::Maximum)] = glm::vec3(header.aabbMaximum[0], header.aabbMaximum[1], header.aabbMaximum[2]);
+    
+    meshData.boundingSphere.center = glm::vec3(header.boundingSphere[0], header.boundingSphere[1], header.boundingSphere[2]);
+    meshData.boundingSphere.radius = header.boundingSphere[3];
+    
+    for (std::size_t b = 0; b < header.boneCount; ++b) {
+        const mf::v2::BoneRecord record = view.getBone(b);
+        const float* t = record.transform;
+        
+        Bone& bone = (*skeleton)[b];
+        bone.parent = record.parent;
+        bone.transform = glm::mat4(t[0],  t[1],  t[2],  t[3],
+                                   t[4],  t[5],  t[6],  t[7],
+                                   t[8],  t[9],  t[10], t[11],
+                                   t[12], t[13], t[14], t[15]);
+    }
+    
+    meshData.animationCount = header.animationCount;
+    for (std::size_t a = 0; a < header.animationCount; ++a) {
+        meshData.animations[a] = StringHash(view.getAnimation(a));
+    }
+    
+    return true;
+}
+
 bool MeshLoader::loadAnimationV1(File& fr, Animation& buffer) const {
     buffer.duration = fr.readFloat();
     buffer.ticksPerSecond = fr.readFloat();
@@ -43,6 +43,7 @@
 #include "logging/Logger.hpp"
 
 #include <new>
+#include <stdexcept>
 
 namespace iyf {
 // WARNING: When adding new metadata types, simply add a new COMMAND line to the IYF_METADATA_SWITCH macro
@@ -103,6 +104,13 @@ namespace iyf {
             return realA == realB;\
         }
     
+#define IYF_DESERIALIZE_METADATA_CASE(EnumType, MetaType) \
+    case AssetType::EnumType: { \
+            MetaType metadata; \
+            metadata.deserialize(serializer); \
+            return Metadata(std::move(metadata)); \
+        }
+    
 #define IYF_CONSTRUCT_METADATA_COPY(SWITCH_ON) \
     IYF_METADATA_SWITCH(SWITCH_ON, IYF_CONSTRUCT_METADATA_COPY_CASE)
     
@@ -115,6 +123,9 @@ namespace iyf {
 #define IYF_PERFORM_COMPARISON(SWITCH_ON) \
     IYF_METADATA_SWITCH(SWITCH_ON, IYF_PERFORM_COMPARISON_CASE)
 
+#define IYF_DESERIALIZE_METADATA(SWITCH_ON) \
+    IYF_METADATA_SWITCH(SWITCH_ON, IYF_DESERIALIZE_METADATA_CASE)
+
 Metadata::Metadata(const Metadata& other) {
     if (other.hasValidValue()) {
         IYF_CONSTRUCT_METADATA_COPY(other.getAssetType());
@@ -176,6 +187,12 @@ std::size_t Metadata::GetAssetMetadataSize(AssetType type) {
     return typeSize;
 }
 
+Metadata Metadata::Deserialize(AssetType type, Serializer& serializer) {
+    IYF_DESERIALIZE_METADATA(type);
+    
+    throw std::logic_error("Can't deserialize metadata of an invalid asset type");
+}
+
 bool Metadata::equals(const Metadata& other) const {
     if ((type == AssetType::ANY) || (other.type == AssetType::ANY)) {
         return false;
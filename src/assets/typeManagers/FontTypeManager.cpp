@@ -39,21 +39,22 @@ FontTypeManager::FontTypeManager(AssetManager* manager) : ChunkedVectorTypeManag
 }
 
 std::unique_ptr<LoadedAssetData> FontTypeManager::readFile(StringHash, const Path& path, const Metadata& metadata, Font& assetData) {
-    auto file = VirtualFileSystem::Instance().openFile(path, FileOpenMode::Read);
-    
-    return std::make_unique<LoadedAssetData>(metadata, assetData, file->readWholeFile());
+    return std::make_unique<LoadedAssetData>(metadata, assetData, VirtualFileSystem::Instance().mapWholeFile(path));
 }
 
 void FontTypeManager::enableAsset(std::unique_ptr<LoadedAssetData> loadedAssetData, bool) {
     Font& assetData = static_cast<Font&>(loadedAssetData->assetData);
 
-    assetData.data = loadedAssetData->rawData.first.release();
-    assetData.size = loadedAssetData->rawData.second;
+    assetData.contents = std::move(loadedAssetData->rawData);
+    assetData.data = assetData.contents.data();
+    assetData.size = assetData.contents.size();
     assetData.setLoaded(true);
 }
 
 void FontTypeManager::performFree(Font& assetData) {
-    delete[] assetData.data;
+    assetData.contents.reset();
+    assetData.data = nullptr;
+    assetData.size = 0;
 }
 
 void FontTypeManager::initMissingAssetHandle() {
@@ -31,28 +31,37 @@
 #include "core/Engine.hpp"
 #include "io/serialization/FileSerializer.hpp"
 #include "logging/Logger.hpp"
+#include "threading/ThreadProfiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
 
 namespace iyf {
 using namespace iyf::literals;
 
 struct LoadedMeshAssetData : public LoadedAssetData {
     LoadedMeshAssetData(const Metadata& metadata, Asset& assetData, MeshLoader::MemoryRequirements requirements, MeshLoader::LoadedMeshData loadedMeshData,
-                        std::unique_ptr<char[]> vbo, std::unique_ptr<char[]> ibo) 
-        : LoadedAssetData(metadata, assetData, {nullptr, 0}), requirements(std::move(requirements)), loadedMeshData(std::move(loadedMeshData)),
-        vbo(std::move(vbo)), ibo(std::move(ibo)) {}
+                        MeshLoader::MappedMeshData mappedData) 
+        : LoadedAssetData(metadata, assetData, std::move(mappedData.file)), requirements(std::move(requirements)), loadedMeshData(std::move(loadedMeshData)),
+        vbo(mappedData.vertexData), ibo(mappedData.indexData) {}
     
     MeshLoader::MemoryRequirements requirements;
     MeshLoader::LoadedMeshData loadedMeshData;
-    std::unique_ptr<char[]> vbo;
-    std::unique_ptr<char[]> ibo;
+    
+    /// Both point into rawData
+    const char* vbo;
+    const char* ibo;
 };
 
-// Transfer destination is needed because we'll be copying data there
-const BufferUsageFlags VBOUsageFlags = BufferUsageFlagBits::VertexBuffer | BufferUsageFlagBits::TransferDestination;
-const BufferUsageFlags IBOUsageFlags = BufferUsageFlagBits::IndexBuffer  | BufferUsageFlagBits::TransferDestination;
-const BufferUsageFlags CombinedUsageFlags = BufferUsageFlagBits::VertexBuffer | BufferUsageFlagBits::IndexBuffer | BufferUsageFlagBits::TransferDestination;
+// Transfer destination is needed because we'll be copying data there. Transfer source is needed by the defragmenter that
+// copies data between different parts of the same buffer.
+const BufferUsageFlags VBOUsageFlags = BufferUsageFlagBits::VertexBuffer | BufferUsageFlagBits::TransferDestination | BufferUsageFlagBits::TransferSource;
+const BufferUsageFlags IBOUsageFlags = BufferUsageFlagBits::IndexBuffer  | BufferUsageFlagBits::TransferDestination | BufferUsageFlagBits::TransferSource;
+const BufferUsageFlags CombinedUsageFlags = BufferUsageFlagBits::VertexBuffer | BufferUsageFlagBits::IndexBuffer | BufferUsageFlagBits::TransferDestination | BufferUsageFlagBits::TransferSource;
 
-MeshTypeManager::MeshTypeManager(AssetManager* manager, Bytes VBOSize, Bytes IBOSize) : ChunkedVectorTypeManager(manager), VBOSize(VBOSize), IBOSize(IBOSize) {
+MeshTypeManager::MeshTypeManager(AssetManager* manager, Bytes VBOSize, Bytes IBOSize, BufferRangeAllocatorType allocatorType, MeshHostDataMode hostDataMode)
+    : ChunkedVectorTypeManager(manager), VBOSize(VBOSize), IBOSize(IBOSize), allocatorType(allocatorType), hostDataMode(hostDataMode), frame(0) {
     engine = manager->getEngine();
     gfx = engine->getGraphicsAPI();
     
@@ -68,11 +77,33 @@ MeshTypeManager::MeshTypeManager(AssetManager* manager, Bytes VBOSize, Bytes IBO
     output = gfx->createBuffers(bci, &names);
     
     // The actual size of a buffer may be different (bigger) because of alignment requirements.
-    char* vboData = new char[VBOSize.count()];
-    vertexDataBuffers.emplace_back(output[0], output[0].size(), vboData);
+    vertexDataBuffers.emplace_back(output[0], output[0].size(), allocateMirror(output[0].size()), allocatorType);
+    indexDataBuffers.emplace_back(output[1], output[1].size(), allocateMirror(output[1].size()), allocatorType);
+}
+
+char* MeshTypeManager::allocateMirror(Bytes size) const {
+    if (hostDataMode != MeshHostDataMode::MirrorBuffers) {
+        return nullptr;
+    }
+    
+    return new char[size.count()];
+}
+
+Bytes MeshTypeManager::getHostMemoryUsage() const {
+    if (hostDataMode != MeshHostDataMode::MirrorBuffers) {
+        return collisionMeshCache.getMemoryUsage();
+    }
+    
+    Bytes total(0);
+    for (const auto& b : vertexDataBuffers) {
+        total += b.buffer.size();
+    }
+    
+    for (const auto& b : indexDataBuffers) {
+        total += b.buffer.size();
+    }
     
-    char* iboData = new char[IBOSize.count()];
-    indexDataBuffers.emplace_back(output[1], output[1].size(), iboData);
+    return total;
 }
 
 void MeshTypeManager::initMissingAssetHandle() {
@@ -115,22 +146,35 @@ void MeshTypeManager::performFree(Mesh& assetData) {
         const PrimitiveData& data = assetData.getMeshPrimitiveData();
         std::size_t vertexAlignment = con::GetVertexDataLayoutDefinition(assetData.vertexDataLayout).getSize();
         std::size_t indexAlignment = assetData.indices32Bit ? 4 : 2;
-
-        BufferRange vboRange(Bytes(data.vertexOffset * vertexAlignment), Bytes(data.vertexCount * vertexAlignment));
-        BufferRange iboRange(Bytes(data.indexOffset * indexAlignment), Bytes(data.indexCount * indexAlignment));
         
-        vertexDataBuffers[assetData.vboID].freeRanges.insert(vboRange);
-        indexDataBuffers[assetData.iboID].freeRanges.insert(iboRange);
+        // The ranges must include the padding, otherwise they won't match the ones that were allocated
+        BufferRange vboRange(Bytes(data.vertexOffset * vertexAlignment - assetData.vboPadding), Bytes(data.vertexCount * vertexAlignment + assetData.vboPadding));
+        BufferRange iboRange(Bytes(data.indexOffset * indexAlignment - assetData.iboPadding), Bytes(assetData.getAllocatedIndexCount() * indexAlignment + assetData.iboPadding));
+        
+        const bool vboFreed = vertexDataBuffers[assetData.vboID].freeRanges->insert(vboRange);
+        const bool iboFreed = indexDataBuffers[assetData.iboID].freeRanges->insert(iboRange);
+        assert(vboFreed && iboFreed);
+        (void)vboFreed;
+        (void)iboFreed;
     }
+    
+    pinnedMeshes.erase(&assetData);
+    collisionMeshCache.erase(assetData.getNameHash());
 }
 
 std::pair<GraphicsToPhysicsDataMapping, GraphicsToPhysicsDataMapping> MeshTypeManager::getGraphicsToPhysicsDataMapping(const Mesh& assetData) const {
+    if (hostDataMode == MeshHostDataMode::CollisionCache) {
+        return getCachedCollisionData(assetData);
+    }
+    
     const char* vboData = reinterpret_cast<const char*>(vertexDataBuffers[assetData.vboID].data);
     const char* iboData = reinterpret_cast<const char*>(indexDataBuffers[assetData.iboID].data);
     
     std::uint32_t vboStride = con::GetVertexDataLayoutDefinition(assetData.vertexDataLayout).getSize();
     std::uint32_t iboStride = assetData.indices32Bit ? 4 : 2;
     
+    pinnedMeshes.insert(&assetData);
+    
     if (assetData.submeshCount > 1) {
         throw std::runtime_error("IMPLEMENT ME");
     } else {
@@ -142,27 +186,87 @@ std::pair<GraphicsToPhysicsDataMapping, GraphicsToPhysicsDataMapping> MeshTypeMa
     }
 }
 
+std::pair<GraphicsToPhysicsDataMapping, GraphicsToPhysicsDataMapping> MeshTypeManager::getCachedCollisionData(const Mesh& assetData) const {
+    const StringHash nameHash = assetData.getNameHash();
+    if (collisionMeshCache.contains(nameHash)) {
+        return collisionMeshCache.getMapping(nameHash);
+    }
+    
+    if (assetData.submeshCount > 1) {
+        throw std::runtime_error("IMPLEMENT ME");
+    }
+    
+    // The GPU buffers can't be read back, so the data has to come from the file
+    const auto path = manager->getAssetPathCopy(nameHash);
+    const auto meta = manager->getMetadataCopy(nameHash);
+    if (!path || !meta) {
+        throw std::runtime_error("Failed to find the mesh in the manifest");
+    }
+    
+    const MeshLoader loader(engine);
+    const MeshLoader::MemoryRequirements requirements = loader.getMeshMemoryRequirements(*meta);
+    
+    MeshLoader::MappedMeshData mappedData;
+    MeshLoader::LoadedMeshData lmd;
+    if (!loader.mapMesh(*path, lmd, mappedData)) {
+        throw std::runtime_error("Failed to find a mesh file");
+    }
+    
+    const VertexDataLayoutDefinition& layout = con::GetVertexDataLayoutDefinition(requirements.vertexDataLayout);
+    const auto& attributes = layout.getAttributes();
+    const auto position = std::find_if(attributes.begin(), attributes.end(), [](const VertexAttribute& a) {
+        return a.type == VertexAttributeType::Position3D;
+    });
+    
+    if (position == attributes.end()) {
+        throw std::runtime_error("The vertex data layout of the mesh has no positions");
+    }
+    
+    return collisionMeshCache.insert(nameHash, mappedData.vertexData, lmd.submeshes[0].numVertices, static_cast<std::uint32_t>(layout.getSize().count()),
+                                     position->offset, mappedData.indexData, lmd.submeshes[0].numIndices, requirements.indices32Bit ? 4 : 2);
+}
+
 MeshTypeManager::RangeDataResult MeshTypeManager::findRange(Bytes size, Bytes alignment, std::vector<BufferWithRanges>& buffers) {
     // Look for a buffer that would be able to fit the required amount of data
     for (std::size_t i = 0; i < buffers.size(); ++i) {
         auto& b = buffers[i];
         
-        if (b.freeRanges.getFreeSpace() >= size) {
+        if (b.freeRanges->getFreeSpace() >= size) {
             // Try obtaining a free range
-            auto rangeAndResult = b.freeRanges.getFreeRange(size, alignment);
+            auto rangeAndResult = b.freeRanges->getFreeRange(size, alignment);
             
             // Even if there's enough free space in a buffer, retrieval may fail due to fragmentation.
             // In that case, we'll simply continue looking for an another buffer.
             if (rangeAndResult.status) {
                 char* location = static_cast<char*>(b.data);
-                location += (rangeAndResult.completeRange.offset.count() + rangeAndResult.startPadding);
+                if (location != nullptr) {
+                    location += (rangeAndResult.completeRange.offset.count() + rangeAndResult.startPadding);
+                }
                 
-                return {rangeAndResult.completeRange, location, rangeAndResult.status, static_cast<std::uint8_t>(i)};
+                return {rangeAndResult.completeRange, location, rangeAndResult.startPadding, rangeAndResult.status, static_cast<std::uint8_t>(i)};
             }
         }
     }
     
-    return {BufferRange(0_B, size), nullptr, false, 0};
+    return {BufferRange(0_B, size), nullptr, 0, false, 0};
+}
+
+MeshTypeManager::RangeDataResult MeshTypeManager::addBufferWithRange(const Buffer& buffer, Bytes size, Bytes alignment, std::vector<BufferWithRanges>& buffers) {
+    // The actual size of a buffer may be different (bigger) because of alignment requirements.
+    char* data = allocateMirror(buffer.size());
+    buffers.emplace_back(buffer, buffer.size(), data, allocatorType);
+    
+    auto rangeAndResult = buffers.back().freeRanges->getFreeRange(size, alignment);
+    
+    assert(rangeAndResult.status);
+    assert(buffers.size() <= 255);
+    
+    char* location = data;
+    if (location != nullptr) {
+        location += (rangeAndResult.completeRange.offset.count() + rangeAndResult.startPadding);
+    }
+    
+    return {rangeAndResult.completeRange, location, rangeAndResult.startPadding, rangeAndResult.status, static_cast<std::uint8_t>(buffers.size() - 1)};
 }
 
 std::unique_ptr<LoadedAssetData> MeshTypeManager::readFile(StringHash, const Path& path, const Metadata& meta, Mesh& assetData) {
@@ -173,16 +277,15 @@ std::unique_ptr<LoadedAssetData> MeshTypeManager::readFile(StringHash, const Pat
     //LOG_D(requirements.boneCount << " " << requirements.vertexBoneDataSize)
     assert(requirements.boneCount == 0);
     
-    std::unique_ptr<char[]> vbo = std::unique_ptr<char[]>(new char[requirements.vertexSize.count()]);
-    std::unique_ptr<char[]> ibo = std::unique_ptr<char[]>(new char[requirements.indexSize.count()]);
-    
+    // Version 2 files are memory mapped and the data gets uploaded straight from the mapping
+    MeshLoader::MappedMeshData mappedData;
     MeshLoader::LoadedMeshData lmd;
-    if (!loader.loadMesh(path, lmd, vbo.get(), ibo.get())) {
+    if (!loader.mapMesh(path, lmd, mappedData)) {
         throw std::runtime_error("Failed to find a mesh file");
     }
     
 //     LOG_D("Type manager reading file: {}", path);
-    return std::make_unique<LoadedMeshAssetData>(meta, assetData, std::move(requirements), std::move(lmd), std::move(vbo), std::move(ibo));
+    return std::make_unique<LoadedMeshAssetData>(meta, assetData, std::move(requirements), std::move(lmd), std::move(mappedData));
 }
 
 void MeshTypeManager::enableAsset(std::unique_ptr<LoadedAssetData> loadedAssetData, bool canBatch) {
@@ -217,76 +320,54 @@ void MeshTypeManager::enableAsset(std::unique_ptr<LoadedAssetData> loadedAssetDa
         
         output = gfx->createBuffers(bci, &names);
         
-        // The actual size of a buffer may be different (bigger) because of alignment requirements.
-        char* vboData = new char[newVBOSize.count()];
-        vertexDataBuffers.emplace_back(output[0], output[0].size(), vboData);
-        
-        char* iboData = new char[newIBOSize.count()];
-        indexDataBuffers.emplace_back(output[1], output[1].size(), iboData);
-        
-        auto vbo = vertexDataBuffers.back().freeRanges.getFreeRange(requirements.vertexSize, vertexAlignment);
-        auto ibo = indexDataBuffers.back().freeRanges.getFreeRange(requirements.indexSize, indexAlignment);
-        
-        assert(vbo.status);
-        assert(ibo.status);
-        assert(vertexDataBuffers.size() <= 255);
-        assert(indexDataBuffers.size() <= 255);
-        
-        char* vboLocation = vboData + (vbo.completeRange.offset.count() + vbo.startPadding);
-        char* iboLocation = iboData + (ibo.completeRange.offset.count() + ibo.startPadding);
-        
-        vboRangeResult = {vbo.completeRange, vboLocation, vbo.status, static_cast<uint8_t>(vertexDataBuffers.size() - 1)};
-        iboRangeResult = {ibo.completeRange, iboLocation, ibo.status, static_cast<uint8_t>(indexDataBuffers.size() - 1)};
+        vboRangeResult = addBufferWithRange(output[0], requirements.vertexSize, vertexAlignment, vertexDataBuffers);
+        iboRangeResult = addBufferWithRange(output[1], requirements.indexSize, indexAlignment, indexDataBuffers);
     } else if (!iboRangeResult.result) {
         Bytes newIBOSize = std::max(IBOSize, requirements.indexSize);
         
         BufferCreateInfo bci(IBOUsageFlags, newIBOSize, MemoryUsage::GPUOnly, false);
         
         Buffer output = gfx->createBuffer(bci, "MeshTypeManager IBO");
-        
-        char* iboData = new char[newIBOSize.count()];
-        indexDataBuffers.emplace_back(output, output.size(), iboData);
-        
-        auto ibo = indexDataBuffers.back().freeRanges.getFreeRange(requirements.indexSize, indexAlignment);
-        
-        assert(ibo.status);
-        assert(indexDataBuffers.size() <= 255);
-        
-        char* iboLocation = iboData + (ibo.completeRange.offset.count() + ibo.startPadding);
-        
-        iboRangeResult = {ibo.completeRange, iboLocation, ibo.status, static_cast<uint8_t>(indexDataBuffers.size() - 1)};
+        iboRangeResult = addBufferWithRange(output, requirements.indexSize, indexAlignment, indexDataBuffers);
     } else if (!vboRangeResult.result) {
         Bytes newVBOSize = std::max(VBOSize, requirements.vertexSize);
         
         BufferCreateInfo bci(VBOUsageFlags, newVBOSize, MemoryUsage::GPUOnly, false);
         
         Buffer output = gfx->createBuffer(bci, "MeshTypeManager VBO");
-        
-        char* vboData = new char[newVBOSize.count()];
-        vertexDataBuffers.emplace_back(output, output.size(), vboData);
-        
-        auto vbo = vertexDataBuffers.back().freeRanges.getFreeRange(requirements.vertexSize, vertexAlignment);
-        
-        assert(vbo.status);
-        assert(vertexDataBuffers.size() <= 255);
-        
-        char* vboLocation = vboData + (vbo.completeRange.offset.count() + vbo.startPadding);
-        
-        vboRangeResult = {vbo.completeRange, vboLocation, vbo.status, static_cast<uint8_t>(vertexDataBuffers.size() - 1)};
+        vboRangeResult = addBufferWithRange(output, requirements.vertexSize, vertexAlignment, vertexDataBuffers);
     }
     
     MeshLoader::LoadedMeshData& lmd = loadedData->loadedMeshData;
-    std::memcpy(vboRangeResult.data, loadedData->vbo.get(), requirements.vertexSize.count());
-    std::memcpy(iboRangeResult.data, loadedData->ibo.get(), requirements.indexSize.count());
+    
+    // Without the mirror buffers, the data gets uploaded straight from the loaded data and discarded afterwards
+    const void* vboSource = loadedData->vbo;
+    const void* iboSource = loadedData->ibo;
+    if (hostDataMode == MeshHostDataMode::MirrorBuffers) {
+        std::memcpy(vboRangeResult.data, loadedData->vbo, requirements.vertexSize.count());
+        std::memcpy(iboRangeResult.data, loadedData->ibo, requirements.indexSize.count());
+        
+        vboSource = vboRangeResult.data;
+        iboSource = iboRangeResult.data;
+    }
     
     assetData.vboID = vboRangeResult.bufferID;
     assetData.iboID = iboRangeResult.bufferID;
+    
+    // Padding can't be bigger than the alignment, which is the size of a single vertex or index
+    const std::uint64_t vboPadding = vboRangeResult.padding;
+    const std::uint64_t iboPadding = iboRangeResult.padding;
+    assert(vboPadding <= std::numeric_limits<std::uint8_t>::max());
+    assert(iboPadding <= std::numeric_limits<std::uint8_t>::max());
+    assetData.vboPadding = static_cast<std::uint8_t>(vboPadding);
+    assetData.iboPadding = static_cast<std::uint8_t>(iboPadding);
     assetData.submeshCount = lmd.count;
     assetData.hasBones = false; // TODO change
     assetData.vertexDataLayout = requirements.vertexDataLayout;
     assetData.indices32Bit = requirements.indices32Bit;
     assetData.aabb  = lmd.aabb;
     assetData.boundingSphere = lmd.boundingSphere;
+    assetData.lodCount = 0;
     
     if (lmd.count > 1) {
         assetData.meshData = SubmeshList(lmd.count);
@@ -295,26 +376,39 @@ void MeshTypeManager::enableAsset(std::unique_ptr<LoadedAssetData> loadedAssetDa
 //         for (std::size_t i = 0; i < assetData
     } else {
         PrimitiveData data;
-        assert(iboRangeResult.range.offset % indexAlignment == 0);
-        assert(vboRangeResult.range.offset % vertexAlignment == 0);
+        assert((iboRangeResult.range.offset + iboPadding) % indexAlignment == 0);
+        assert((vboRangeResult.range.offset + vboPadding) % vertexAlignment == 0);
         
         // range.offset is in bytes, we need a number of indices. Since one index is 2 bytes, we divide
-        data.indexOffset = iboRangeResult.range.offset / indexAlignment;
+        data.indexOffset = (iboRangeResult.range.offset + iboPadding) / indexAlignment;
         data.indexCount = lmd.submeshes[0].numIndices;
         // range offset is in bytes, we need a number of vertices.
-        data.vertexOffset = vboRangeResult.range.offset / vertexAlignment;
+        data.vertexOffset = (vboRangeResult.range.offset + vboPadding) / vertexAlignment;
         data.vertexCount = lmd.submeshes[0].numVertices;
         
         assetData.meshData = data;
+        
+        // The LOD offsets are relative to the start of the index data of the mesh, just like indexOffset expects them to be
+        const MeshLoader::LoadedSubMeshData& submesh = lmd.submeshes[0];
+        for (std::size_t l = 0; l < submesh.lodCount; ++l) {
+            assetData.lods[l] = {submesh.lods[l].indexOffset, submesh.lods[l].indexCount, submesh.lods[l].error};
+        }
+        
+        assetData.lodCount = static_cast<std::uint8_t>(submesh.lodCount);
+        assert(assetData.getAllocatedIndexCount() * indexAlignment == requirements.indexSize.count());
     }
     
+    // The data starts after the padding
+    const std::vector<BufferCopy> vboCopy = {{0, vboRangeResult.range.offset + vboPadding, requirements.vertexSize.count()}};
+    const std::vector<BufferCopy> iboCopy = {{0, iboRangeResult.range.offset + iboPadding, requirements.indexSize.count()}};
+    
     DeviceMemoryManager* manager = gfx->getDeviceMemoryManager();
     if (canBatch) {
-        manager->updateBuffer(MemoryBatch::MeshAssetData, vertexDataBuffers[vboRangeResult.bufferID].buffer, {{0, vboRangeResult.range.offset, vboRangeResult.range.size}}, vboRangeResult.data);
-        manager->updateBuffer(MemoryBatch::MeshAssetData, indexDataBuffers[iboRangeResult.bufferID].buffer, {{0, iboRangeResult.range.offset, iboRangeResult.range.size}}, iboRangeResult.data);
+        manager->updateBuffer(MemoryBatch::MeshAssetData, vertexDataBuffers[vboRangeResult.bufferID].buffer, vboCopy, vboSource);
+        manager->updateBuffer(MemoryBatch::MeshAssetData, indexDataBuffers[iboRangeResult.bufferID].buffer, iboCopy, iboSource);
     } else {
-        manager->updateBuffer(MemoryBatch::Instant, vertexDataBuffers[vboRangeResult.bufferID].buffer, {{0, vboRangeResult.range.offset, vboRangeResult.range.size}}, vboRangeResult.data);
-        manager->updateBuffer(MemoryBatch::Instant, indexDataBuffers[iboRangeResult.bufferID].buffer, {{0, iboRangeResult.range.offset, iboRangeResult.range.size}}, iboRangeResult.data);
+        manager->updateBuffer(MemoryBatch::Instant, vertexDataBuffers[vboRangeResult.bufferID].buffer, vboCopy, vboSource);
+        manager->updateBuffer(MemoryBatch::Instant, indexDataBuffers[iboRangeResult.bufferID].buffer, iboCopy, iboSource);
         
 //         gfx->updateDeviceVisibleBuffer(vertexDataBuffers[vboRangeResult.bufferID].buffer, {{0, vboRangeResult.range.offset, vboRangeResult.range.size}}, vboRangeResult.data);
 //         gfx->updateDeviceVisibleBuffer(indexDataBuffers[iboRangeResult.bufferID].buffer, {{0, iboRangeResult.range.offset, iboRangeResult.range.size}}, iboRangeResult.data);
@@ -326,26 +420,163 @@ void MeshTypeManager::enableAsset(std::unique_ptr<LoadedAssetData> loadedAssetDa
 }
 
 void MeshTypeManager::executeBatchOperations() {
+    // The copies are recorded into the same batch, so they need to happen before it gets submitted
+    defragment();
+    
     gfx->getDeviceMemoryManager()->beginBatchUpload(MemoryBatch::MeshAssetData);
 }
 
-AssetsToEnableResult MeshTypeManager::hasAssetsToEnable() const {
-    if (toEnable.empty()) {
-        return AssetsToEnableResult::NoAssetsToEnable;
+void MeshTypeManager::defragment() {
+    IYFT_PROFILE(MeshDefragmentation, iyft::ProfilerTag::Assets)
+    
+    frame++;
+    
+    // The frames that could have used these ranges are done
+    while (!retiredRanges.empty() && retiredRanges.front().releaseFrame <= frame) {
+        const RetiredRange& retired = retiredRanges.front();
+        
+        std::vector<BufferWithRanges>& buffers = retired.vertexRange ? vertexDataBuffers : indexDataBuffers;
+        buffers[retired.bufferID].freeRanges->insert(retired.range);
+        
+        retiredRanges.pop_front();
+    }
+    
+    if (!defragmentationSettings.enabled) {
+        return;
     }
     
-    assert(toEnable.front().future.valid());
-    if (toEnable.front().future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
-        DeviceMemoryManager* manager = gfx->getDeviceMemoryManager();
+    defragmentBuffers(vertexDataBuffers, vertexDefragmentationPass, true);
+    defragmentBuffers(indexDataBuffers, indexDefragmentationPass, false);
+}
+
+void MeshTypeManager::defragmentBuffers(std::vector<BufferWithRanges>& buffers, DefragmentationPass& pass, bool vertexBuffers) {
+    if (!pass.active) {
+        // Pick the most fragmented buffer
+        float maxFragmentation = defragmentationSettings.fragmentationThreshold;
+        bool found = false;
+        
+        for (std::size_t i = 0; i < buffers.size(); ++i) {
+            const BufferRangeAllocator& allocator = *buffers[i].freeRanges;
+            const float fragmentation = allocator.getFragmentation();
+            
+            if (fragmentation > maxFragmentation && allocator.getFreeRangeCount() != buffers[i].stalledFreeRangeCount) {
+                maxFragmentation = fragmentation;
+                pass.bufferID = static_cast<std::uint8_t>(i);
+                found = true;
+            }
+        }
         
-        if (!manager->canBatchFitData(MemoryBatch::MeshAssetData, Bytes(toEnable.front().estimatedSize))) {
-            return AssetsToEnableResult::Busy;
-        } else {
-            return AssetsToEnableResult::HasAssetsToEnable;
+        if (!found) {
+            return;
         }
-    } else {
+        
+        pass.candidates.clear();
+        pass.movedMeshes = 0;
+        pass.active = true;
+        defragmentationStatistics.passes++;
+        
+        for (std::size_t id = 0; id < assets.size(); ++id) {
+            const Mesh& mesh = assets[id];
+            
+            // TODO support submeshes once they can be loaded
+            if (!mesh.isLoaded() || mesh.hasSubmeshes() || pinnedMeshes.count(&mesh) != 0) {
+                continue;
+            }
+            
+            const PrimitiveData& data = mesh.getMeshPrimitiveData();
+            if (vertexBuffers && mesh.vboID == pass.bufferID) {
+                const std::uint64_t stride = con::GetVertexDataLayoutDefinition(mesh.vertexDataLayout).getSize();
+                pass.candidates.emplace_back(data.vertexOffset * stride, static_cast<std::uint32_t>(id));
+            } else if (!vertexBuffers && mesh.iboID == pass.bufferID) {
+                const std::uint64_t stride = mesh.indices32Bit ? 4 : 2;
+                pass.candidates.emplace_back(data.indexOffset * stride, static_cast<std::uint32_t>(id));
+            }
+        }
+        
+        std::sort(pass.candidates.begin(), pass.candidates.end());
+    }
+    
+    BufferWithRanges& buffer = buffers[pass.bufferID];
+    char* mirror = static_cast<char*>(buffer.data);
+    
+    std::vector<BufferCopy> copies;
+    Bytes movedBytes(0);
+    
+    // Start from the end of the buffer to make the free ranges at the start merge
+    while (!pass.candidates.empty() && movedBytes < defragmentationSettings.bytesPerFrame) {
+        const auto [offset, id] = pass.candidates.back();
+        pass.candidates.pop_back();
+        
+        // The mesh may have been freed and the slot reused since the pass started
+        Mesh& mesh = assets[id];
+        if (!mesh.isLoaded() || mesh.hasSubmeshes() || pinnedMeshes.count(&mesh) != 0 || (vertexBuffers ? mesh.vboID : mesh.iboID) != pass.bufferID) {
+            continue;
+        }
+        
+        PrimitiveData& data = mesh.getMeshPrimitiveData();
+        const std::uint64_t stride = vertexBuffers ? con::GetVertexDataLayoutDefinition(mesh.vertexDataLayout).getSize() : (mesh.indices32Bit ? 4 : 2);
+        std::uint32_t& elementOffset = vertexBuffers ? data.vertexOffset : data.indexOffset;
+        const std::uint32_t elementCount = vertexBuffers ? data.vertexCount : mesh.getAllocatedIndexCount();
+        std::uint8_t& padding = vertexBuffers ? mesh.vboPadding : mesh.iboPadding;
+        
+        if (elementOffset * stride != offset) {
+            continue;
+        }
+        
+        const Bytes dataSize(elementCount * stride);
+        const BufferRange oldRange(Bytes(offset - padding), dataSize + Bytes(padding));
+        
+        const auto newRange = buffer.freeRanges->relocate(oldRange, padding, Bytes(stride));
+        if (!newRange.status) {
+            continue;
+        }
+        
+        // The new range came from the free space, so it can't overlap the old one
+        const std::uint64_t newOffset = newRange.completeRange.offset.count() + newRange.startPadding;
+        if (mirror != nullptr) {
+            std::memcpy(mirror + newOffset, mirror + offset, dataSize.count());
+        }
+        copies.emplace_back(offset, newOffset, dataSize.count());
+        
+        assert(newOffset % stride == 0);
+        assert(newRange.startPadding <= std::numeric_limits<std::uint8_t>::max());
+        elementOffset = static_cast<std::uint32_t>(newOffset / stride);
+        padding = static_cast<std::uint8_t>(newRange.startPadding);
+        
+        retiredRanges.emplace_back(oldRange, frame + gfx->getSwapImageCount(), pass.bufferID, vertexBuffers);
+        
+        movedBytes += dataSize;
+        pass.movedMeshes++;
+        defragmentationStatistics.movedMeshes++;
+    }
+    
+    defragmentationStatistics.movedBytes += movedBytes;
+    
+    if (!copies.empty()) {
+        gfx->getDeviceMemoryManager()->copyBuffer(MemoryBatch::MeshAssetData, buffer.buffer, buffer.buffer, copies);
+    }
+    
+    if (pass.candidates.empty()) {
+        pass.active = false;
+        
+        // Don't retry until something changes. The retired ranges will change the count once they get released.
+        buffer.stalledFreeRangeCount = (pass.movedMeshes == 0) ? buffer.freeRanges->getFreeRangeCount() : 0;
+    }
+}
+
+AssetsToEnableResult MeshTypeManager::hasAssetsToEnable() const {
+    const AsyncLoadInfo* next = toEnable.front();
+    if (next == nullptr) {
         return AssetsToEnableResult::NoAssetsToEnable;
     }
+    
+    DeviceMemoryManager* manager = gfx->getDeviceMemoryManager();
+    
+    if (!manager->canBatchFitData(MemoryBatch::MeshAssetData, Bytes(next->estimatedSize))) {
+        return AssetsToEnableResult::Busy;
+    } else {
+        return AssetsToEnableResult::HasAssetsToEnable;
+    }
 }
 
 std::uint64_t MeshTypeManager::estimateUploadSize(const Metadata& meta) const {
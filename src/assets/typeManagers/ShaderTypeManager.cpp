@@ -47,8 +47,7 @@ void ShaderTypeManager::performFree(Shader& assetData) {
 }
 
 std::unique_ptr<LoadedAssetData> ShaderTypeManager::readFile(StringHash, const Path& path, const Metadata& meta, Shader& assetData) {
-    auto file = VirtualFileSystem::Instance().openFile(path, FileOpenMode::Read);
-    return std::make_unique<LoadedAssetData>(meta, assetData, file->readWholeFile());
+    return std::make_unique<LoadedAssetData>(meta, assetData, VirtualFileSystem::Instance().mapWholeFile(path));
 }
 
 void ShaderTypeManager::enableAsset(std::unique_ptr<LoadedAssetData> loadedAssetData, bool) {
@@ -56,7 +55,7 @@ void ShaderTypeManager::enableAsset(std::unique_ptr<LoadedAssetData> loadedAsset
     Shader& assetData = static_cast<Shader&>(loadedAssetData->assetData);
     
     const std::string name = fmt::format("Managed shader from {}", shaderMeta.getSourceAssetPath().getNativeString());
-    assetData.handle = api->createShader(shaderMeta.getShaderStage(), loadedAssetData->rawData.first.get(), loadedAssetData->rawData.second, name.c_str());
+    assetData.handle = api->createShader(shaderMeta.getShaderStage(), loadedAssetData->rawData.data(), loadedAssetData->rawData.size(), name.c_str());
     assetData.stage = shaderMeta.getShaderStage();
     assetData.setLoaded(true);
 }
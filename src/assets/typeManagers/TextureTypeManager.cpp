@@ -48,8 +48,7 @@ void TextureTypeManager::performFree(Texture& assetData) {
 }
 
 std::unique_ptr<LoadedAssetData> TextureTypeManager::readFile(StringHash, const Path& path, const Metadata& meta, Texture& assetData) {
-    auto file = VirtualFileSystem::Instance().openFile(path, FileOpenMode::Read);
-    return std::make_unique<LoadedAssetData>(meta, assetData, file->readWholeFile());
+    return std::make_unique<LoadedAssetData>(meta, assetData, VirtualFileSystem::Instance().mapWholeFile(path));
 }
 
 void TextureTypeManager::enableAsset(std::unique_ptr<LoadedAssetData> loadedAssetData, bool canBatch) {
@@ -61,7 +60,7 @@ void TextureTypeManager::enableAsset(std::unique_ptr<LoadedAssetData> loadedAsse
     const TextureLoader loader;
     TextureData textureData;
     
-    TextureLoader::Result result = loader.load(loadedAssetData->rawData.first.get(), loadedAssetData->rawData.second, textureData);
+    TextureLoader::Result result = loader.load(loadedAssetData->rawData.data(), loadedAssetData->rawData.size(), textureData);
     if (result != TextureLoader::Result::LoadSuccessful) {
         throw std::runtime_error("Failed to load a texture");
     }
@@ -94,21 +93,17 @@ void TextureTypeManager::initMissingAssetHandle() {
 }
 
 AssetsToEnableResult TextureTypeManager::hasAssetsToEnable() const {
-    if (toEnable.empty()) {
+    const AsyncLoadInfo* next = toEnable.front();
+    if (next == nullptr) {
         return AssetsToEnableResult::NoAssetsToEnable;
     }
     
-    assert(toEnable.front().future.valid());
-    if (toEnable.front().future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
-        DeviceMemoryManager* manager = gfx->getDeviceMemoryManager();
-        
-        if (!manager->canBatchFitData(MemoryBatch::MeshAssetData, Bytes(toEnable.front().estimatedSize))) {
-            return AssetsToEnableResult::Busy;
-        } else {
-            return AssetsToEnableResult::HasAssetsToEnable;
-        }
+    DeviceMemoryManager* manager = gfx->getDeviceMemoryManager();
+    
+    if (!manager->canBatchFitData(MemoryBatch::MeshAssetData, Bytes(next->estimatedSize))) {
+        return AssetsToEnableResult::Busy;
     } else {
-        return AssetsToEnableResult::NoAssetsToEnable;
+        return AssetsToEnableResult::HasAssetsToEnable;
     }
 }
 
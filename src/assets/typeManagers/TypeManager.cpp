@@ -30,6 +30,7 @@
 #include "logging/Logger.hpp"
 #include "configuration/Configuration.hpp"
 #include "assets/AssetManager.hpp"
+#include "assets/StreamingScheduler.hpp"
 #include "assets/typeManagers/TypeManager.hpp"
 
 namespace iyf {
@@ -45,6 +46,8 @@ TypeManager::TypeManager(AssetManager* manager) : manager(manager) {
     longTermWorkerPool = manager->getEngine()->getLongTermWorkerPool();
 }
 
+TypeManager::TypeManager() : manager(nullptr), longTermWorkerPool(nullptr), loggingRemovals(false), loggingCreations(false) {}
+
 void TypeManager::logLeakedAsset(std::size_t id, StringHash nameHash, std::uint32_t count) const {
     const Path path = *manager->getAssetPath(nameHash);
     LOG_W("Asset with id {} loaded from path {} still has {} live references.", id, path, count);
@@ -66,4 +69,16 @@ void TypeManager::notifyRemoval(StringHash nameHash) {
     manager->notifyRemoval(nameHash);
 }
 
+void TypeManager::submitStreamingRequest(std::unique_ptr<StreamingRequest> request) {
+    manager->getStreamingScheduler()->submit(std::move(request));
+}
+
+std::uint32_t TypeManager::getGarbageCollectionGracePeriod() const {
+    return manager->getGarbageCollectionGracePeriod();
+}
+
+void TypeManager::notifyStreamingRequestEnabled(StreamingRequest* request) {
+    manager->getStreamingScheduler()->notifyEnabled(request);
+}
+
 }
@@ -378,7 +378,8 @@ void Engine::init() {
     
     // TODO I need a smarter way to pick the number of workers
     longTermWorkerPool = std::make_unique<iyft::ThreadPool>(2);
-    frameWorkerPool = std::make_unique<iyft::ThreadPool>(2);
+    // Jobs of the frame TaskGraph enqueue their dependents from inside the workers, which is what work stealing is good at.
+    frameWorkerPool = std::make_unique<iyft::ThreadPool>(2, iyft::SchedulingMode::WorkStealing);
     
     if (!SystemLocalizer().executePendingSwap()) {
         throw std::runtime_error("Failed to swap in loaded strings");
@@ -596,7 +597,7 @@ void Engine::executeMainLoop() {
         
         inputState->pollInput(); //TODO really here?
         graphicsAPI->getDeviceMemoryManager()->beginFrame();
-        assetManager->collectGarbage(); // TODO really here? TODO Make it smarter. Iterating through all assets every frame is NOT smart
+        assetManager->collectGarbage(); // TODO really here?
         assetManager->enableLoadedAssets();
         
         currentTime = std::chrono::steady_clock::now();
@@ -32,6 +32,7 @@
 #include "graphics/GraphicsSystem.hpp"
 #include "physics/PhysicsSystem.hpp"
 #include "core/EntitySystemManager.hpp"
+#include "core/Engine.hpp"
 #include "threading/ThreadProfiler.hpp"
 
 namespace iyf {
@@ -97,10 +98,27 @@ void EntitySystemManager::initialize() {
         systems[i]->resize(initialCapacity);
     }
     
+    buildFrameGraph();
+    
     initialized = true;
 }
 
+void EntitySystemManager::buildFrameGraph() {
+    frameGraph.clear();
+    
+    System* physicsSystem = getSystemManagingComponentType(ComponentBaseType::Physics);
+    physicsSystem->declareJobs(frameGraph, entityStates);
+    
+    for (auto& s : systems) {
+        if (s.get() != physicsSystem) {
+            s->declareJobs(frameGraph, entityStates);
+        }
+    }
+}
+
 void EntitySystemManager::dispose() {
+    frameGraph.clear();
+    
     for (auto& s : systems) {
         s->dispose();
     }
@@ -232,52 +250,13 @@ void EntitySystemManager::update(float delta) {
         s->collectGarbage(GarbageCollectionRunPolicy::FullCollection);
     }
     
-    // Physics system is the first to get updated, since it may change TransformationComponents that other
-    // components may depend on
-    PhysicsSystem* physicsSystem = static_cast<PhysicsSystem*>(getSystemManagingComponentType(ComponentBaseType::Physics));
-    physicsSystem->update(delta, entityStates);
-    
     // TODO where do script ticks go?
     
-    GraphicsSystem* graphicsSystem = static_cast<GraphicsSystem*>(getSystemManagingComponentType(ComponentBaseType::Graphics));
-    
-//     // Update dirty transform matrices
-//     // We use a separate counter here because accessing a ChunkedVector element via ID is much slower than via the iterator
-//     std::uint32_t i = 0;
-//     for (auto& t : transformations) {
-//         // TODO replace entityHasAnyComponents with an iterator advance. The current solution is likely bad for performance
-//         if (t.update() && entityHasAnyComponents(i, ComponentBaseType::Graphics)) {
-//             // TODO this is no longer valid!!!
-//             //RenderDataComponent& renderData = graphicsSystem->getComponent(i);
-//             //renderData.updateCurrentBounds(t.getModelMatrix(), t.getScale());
-//         }
-//         
-//         i++;
-//     }
-
-    
-    // WARNING: Transforms are now updated in notifyTransformChanged() and MeshComponents update themselves when they receive a notification
+    // WARNING: Transforms are updated in notifyTransformChanged() and MeshComponents update themselves when they receive a notification
     // from the Transform
-        
-//     auto transform = transformations.begin();
-//     auto state = entityStates.begin();
-//     // Update dirty transform matrices and mesh bounds
-//     // We use iterators here because accessing a ChunkedVector element via ID is much slower than via the iterator
-//     for (std::uint32_t i = 0; i < nextID; ++i) {
-//         if ((*transform).update() && (*state).hasComponentsOfType(ComponentBaseType::Graphics)) {
-//             if (graphicsSystem->hasComponent(i, static_cast<std::uint32_t>(GraphicsComponent::Mesh))) {
-//                 MeshComponent& mc = graphicsSystem->getComponent<MeshComponent>(i);
-//                 mc.updateCurrentBounds((*transform).getModelMatrix(), (*transform).getScale());
-// //                 LOG_D(mc.getCurrentBoundingSphere().radius << " " << mc.getPreTransformBoundingSphere().radius);
-//                 //LOG_D("+++++++++++++++++++++++++++++++++++UPDATED");
-//             }
-//         }
-//         
-//         ++transform;
-//         ++state;
-//     }
     
-    graphicsSystem->update(delta, entityStates);
+    // The order and parallelism of System updates are determined by the jobs that were declared in buildFrameGraph()
+    frameGraph.execute(getEngine()->getFrameWorkerPool(), delta);
 }
 
 EntityKey EntitySystemManager::create(const std::string& name, bool active) {
@@ -549,6 +528,19 @@ std::string EntitySystemManager::makeUniqueName(const std::string& name) const {
     return name;
 }
 
+void System::declareJobs(TaskGraph& graph, const EntityStateVector& entityStates) {
+    graph.addJob("SystemUpdate" + std::to_string(static_cast<std::uint32_t>(getManagedComponentType())), [this, &entityStates](float delta) {
+        update(delta, entityStates);
+    }, getUpdateAccess(), getUpdateAffinity());
+}
+
+JobAccess System::getUpdateAccess() const {
+    JobAccess access;
+    access.write(getManagedComponentType()).readTransformations();
+    
+    return access;
+}
+
 // void System::initialize() {
 //     availableComponents.
 // }
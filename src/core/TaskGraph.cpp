@@ -0,0 +1,219 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "core/TaskGraph.hpp"
+#include "threading/ThreadPool.hpp"
+#include "threading/ThreadProfiler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace iyf {
+TaskGraph::TaskGraph() : remainingJobs(0) {}
+TaskGraph::~TaskGraph() {}
+
+TaskGraph::JobID TaskGraph::addJob(std::string name, JobFunction function, const JobAccess& access, JobAffinity affinity, const std::vector<JobID>& explicitDependencies) {
+    if (!function) {
+        throw std::invalid_argument("The job function must not be empty.");
+    }
+    
+    const JobID id = static_cast<JobID>(jobs.size());
+    
+    auto job = std::make_unique<Job>();
+    job->name = std::move(name);
+    job->function = std::move(function);
+    job->access = access;
+    job->affinity = affinity;
+    job->dependencyCount = 0;
+    job->remainingDependencies = 0;
+    
+    // Dependencies can only point to jobs that were added earlier, which means that the order of addition is always
+    // a valid topological order and the graph can never contain cycles.
+    for (JobID i = 0; i < id; ++i) {
+        Job& previous = *jobs[i];
+        
+        const bool explicitDependency = std::find(explicitDependencies.begin(), explicitDependencies.end(), i) != explicitDependencies.end();
+        if (explicitDependency || previous.access.conflictsWith(access)) {
+            previous.dependents.push_back(id);
+            job->dependencyCount++;
+        }
+    }
+    
+    for (JobID dependency : explicitDependencies) {
+        if (dependency >= id) {
+            throw std::invalid_argument("A job can only depend on jobs that were added before it.");
+        }
+    }
+    
+    jobs.push_back(std::move(job));
+    return id;
+}
+
+void TaskGraph::clear() {
+    jobs.clear();
+}
+
+std::vector<TaskGraph::JobID> TaskGraph::getDependencies(JobID id) const {
+    std::vector<JobID> result;
+    
+    for (JobID i = 0; i < id; ++i) {
+        const auto& dependents = jobs[i]->dependents;
+        
+        if (std::find(dependents.begin(), dependents.end(), id) != dependents.end()) {
+            result.push_back(i);
+        }
+    }
+    
+    return result;
+}
+
+bool TaskGraph::isOrdered(JobID first, JobID second) const {
+    if (first == second) {
+        return false;
+    }
+    
+    if (first > second) {
+        std::swap(first, second);
+    }
+    
+    // Jobs are stored in topological order, so a single forward pass is enough to find all jobs that are reachable
+    // from the first one.
+    std::vector<bool> reachable(jobs.size(), false);
+    reachable[first] = true;
+    
+    for (JobID i = first; i < second; ++i) {
+        if (!reachable[i]) {
+            continue;
+        }
+        
+        for (JobID dependent : jobs[i]->dependents) {
+            reachable[dependent] = true;
+        }
+    }
+    
+    return reachable[second];
+}
+
+void TaskGraph::execute(iyft::ThreadPool* pool, float delta) {
+    IYFT_PROFILE(TaskGraphExecute, iyft::ProfilerTag::World);
+    
+    if (jobs.empty()) {
+        return;
+    }
+    
+    firstException = nullptr;
+    
+    if (pool == nullptr) {
+        for (auto& job : jobs) {
+            job->function(delta);
+        }
+        
+        return;
+    }
+    
+    for (auto& job : jobs) {
+        job->remainingDependencies.store(job->dependencyCount, std::memory_order_relaxed);
+    }
+    
+    remainingJobs.store(jobs.size());
+    
+    for (JobID i = 0; i < jobs.size(); ++i) {
+        if (jobs[i]->dependencyCount == 0) {
+            dispatch(pool, i, delta);
+        }
+    }
+    
+    // The calling thread executes the jobs that can't run anywhere else and sleeps while it has nothing to do.
+    while (true) {
+        JobID id;
+        
+        {
+            IYFT_PROFILE(TaskGraphWait, iyft::ProfilerTag::World);
+            
+            std::unique_lock<std::mutex> lock(mainThreadMutex);
+            mainThreadNotifier.wait(lock, [this](){
+                return !mainThreadJobs.empty() || remainingJobs.load() == 0;
+            });
+            
+            if (mainThreadJobs.empty()) {
+                break;
+            }
+            
+            id = mainThreadJobs.back();
+            mainThreadJobs.pop_back();
+        }
+        
+        runJob(pool, id, delta);
+    }
+    
+    if (firstException != nullptr) {
+        std::rethrow_exception(firstException);
+    }
+}
+
+void TaskGraph::dispatch(iyft::ThreadPool* pool, JobID id, float delta) {
+    if (jobs[id]->affinity == JobAffinity::MainThread) {
+        {
+            std::lock_guard<std::mutex> lock(mainThreadMutex);
+            mainThreadJobs.push_back(id);
+        }
+        
+        mainThreadNotifier.notify_one();
+    } else {
+        pool->addTask(&TaskGraph::runJob, this, pool, id, delta);
+    }
+}
+
+void TaskGraph::runJob(iyft::ThreadPool* pool, JobID id, float delta) {
+    Job& job = *jobs[id];
+    
+    try {
+        job.function(delta);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(exceptionMutex);
+        
+        if (firstException == nullptr) {
+            firstException = std::current_exception();
+        }
+    }
+    
+    for (JobID dependent : job.dependents) {
+        if (jobs[dependent]->remainingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            dispatch(pool, dependent, delta);
+        }
+    }
+    
+    if (remainingJobs.fetch_sub(1) == 1) {
+        // Taking the lock makes sure that the main thread is either already waiting or will see the new value before it
+        // decides to go to sleep. Notifying while holding it prevents execute() from returning (and the graph from being
+        // destroyed) before notify_one() is done with the condition variable.
+        std::lock_guard<std::mutex> lock(mainThreadMutex);
+        mainThreadNotifier.notify_one();
+    }
+}
+}
@@ -0,0 +1,561 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "core/TransformStore.hpp"
+#include "threading/ParallelFor.hpp"
+#include "threading/ThreadProfiler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define IYF_TRANSFORM_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IYF_TRANSFORM_SSE
+#endif
+
+namespace iyf {
+/// Calls work(begin, end) for chunks of [0, count) that contain at least minChunkSize elements. Creating several
+/// chunks per thread balances the load when some of the helpers start late.
+template <typename Work>
+static void RunInChunks(iyft::ThreadPool* pool, std::size_t count, std::size_t minChunkSize, const Work& work) {
+    const std::size_t threadCount = iyft::GetParallelForThreadCount(pool);
+    const std::size_t chunkSize = std::max(minChunkSize, (count + threadCount * 4 - 1) / (threadCount * 4));
+    const std::size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    
+    iyft::ParallelFor(pool, chunkCount, [&work, chunkSize, count](std::size_t chunk) {
+        const std::size_t begin = chunk * chunkSize;
+        work(begin, std::min(begin + chunkSize, count));
+    });
+}
+
+/// Builds translate(position) * mat4_cast(rotation) * scale(scaling) without the full matrix multiplications.
+/// The SIMD code performs the same operations in the same order.
+inline static void BuildMatrix(float px, float py, float pz, float qx, float qy, float qz, float qw, float sx, float sy, float sz, glm::mat4& m) {
+    const float xx = qx * qx;
+    const float yy = qy * qy;
+    const float zz = qz * qz;
+    const float xy = qx * qy;
+    const float xz = qx * qz;
+    const float yz = qy * qz;
+    const float wx = qw * qx;
+    const float wy = qw * qy;
+    const float wz = qw * qz;
+    
+    m[0][0] = (1.0f - 2.0f * (yy + zz)) * sx;
+    m[0][1] = (2.0f * (xy + wz)) * sx;
+    m[0][2] = (2.0f * (xz - wy)) * sx;
+    m[0][3] = 0.0f;
+    
+    m[1][0] = (2.0f * (xy - wz)) * sy;
+    m[1][1] = (1.0f - 2.0f * (xx + zz)) * sy;
+    m[1][2] = (2.0f * (yz + wx)) * sy;
+    m[1][3] = 0.0f;
+    
+    m[2][0] = (2.0f * (xz + wy)) * sz;
+    m[2][1] = (2.0f * (yz - wx)) * sz;
+    m[2][2] = (1.0f - 2.0f * (xx + yy)) * sz;
+    m[2][3] = 0.0f;
+    
+    m[3][0] = px;
+    m[3][1] = py;
+    m[3][2] = pz;
+    m[3][3] = 1.0f;
+}
+
+/// result = parent * local. result must not alias the inputs.
+inline static void MultiplyMatrices(const glm::mat4& parent, const glm::mat4& local, glm::mat4& result) {
+#if defined(IYF_TRANSFORM_AVX) || defined(IYF_TRANSFORM_SSE)
+    const __m128 p0 = _mm_loadu_ps(&parent[0][0]);
+    const __m128 p1 = _mm_loadu_ps(&parent[1][0]);
+    const __m128 p2 = _mm_loadu_ps(&parent[2][0]);
+    const __m128 p3 = _mm_loadu_ps(&parent[3][0]);
+    
+    for (int column = 0; column < 4; ++column) {
+        const float* l = &local[column][0];
+        
+        __m128 r = _mm_mul_ps(p0, _mm_set1_ps(l[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(p1, _mm_set1_ps(l[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(p2, _mm_set1_ps(l[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(p3, _mm_set1_ps(l[3])));
+        
+        _mm_storeu_ps(&result[column][0], r);
+    }
+#else
+    for (int column = 0; column < 4; ++column) {
+        for (int row = 0; row < 4; ++row) {
+            result[column][row] = parent[0][row] * local[column][0] + parent[1][row] * local[column][1] +
+                                  parent[2][row] * local[column][2] + parent[3][row] * local[column][3];
+        }
+    }
+#endif
+}
+
+TransformStore::TransformStore() : mode(Mode::SIMD), aliveCount(0), hierarchyChanged(false) {}
+
+TransformStore::Handle TransformStore::create(Handle parent) {
+    if (parent != InvalidHandle && !isAlive(parent)) {
+        throw std::logic_error("The parent transformation does not exist");
+    }
+    
+    if (freeHandles.empty()) {
+        grow();
+    }
+    
+    const Handle handle = freeHandles.back();
+    freeHandles.pop_back();
+    
+    alive[handle] = 1;
+    aliveCount++;
+    
+    if (parent != InvalidHandle) {
+        parents[handle] = parent;
+        childCounts[parent]++;
+        hierarchyChanged = true;
+    }
+    
+    markDirty(handle);
+    return handle;
+}
+
+void TransformStore::destroy(Handle handle) {
+    if (!isAlive(handle)) {
+        throw std::logic_error("The transformation does not exist");
+    }
+    
+    if (childCounts[handle] != 0) {
+        throw std::logic_error("A transformation that has children can't be destroyed");
+    }
+    
+    if (parents[handle] != InvalidHandle) {
+        childCounts[parents[handle]]--;
+        parents[handle] = InvalidHandle;
+        hierarchyChanged = true;
+    }
+    
+    dirtyBits[handle / Padding] &= ~(std::uint64_t(1) << (handle % Padding));
+    resetSlot(handle);
+    
+    alive[handle] = 0;
+    aliveCount--;
+    freeHandles.push_back(handle);
+}
+
+void TransformStore::setParent(Handle child, Handle parent) {
+    if (!isAlive(child) || (parent != InvalidHandle && !isAlive(parent))) {
+        throw std::logic_error("The transformation does not exist");
+    }
+    
+    if (parents[child] == parent) {
+        return;
+    }
+    
+    for (Handle ancestor = parent; ancestor != InvalidHandle; ancestor = parents[ancestor]) {
+        if (ancestor == child) {
+            throw std::logic_error("A transformation can't be parented to itself or to one of its descendants");
+        }
+    }
+    
+    if (parents[child] != InvalidHandle) {
+        childCounts[parents[child]]--;
+    }
+    
+    if (parent != InvalidHandle) {
+        childCounts[parent]++;
+    }
+    
+    parents[child] = parent;
+    hierarchyChanged = true;
+    
+    // The local matrix needs to be rebuilt because roots don't store it
+    markDirty(child);
+}
+
+void TransformStore::resetSlot(Handle handle) {
+    positionX[handle] = 0.0f;
+    positionY[handle] = 0.0f;
+    positionZ[handle] = 0.0f;
+    rotationX[handle] = 0.0f;
+    rotationY[handle] = 0.0f;
+    rotationZ[handle] = 0.0f;
+    rotationW[handle] = 1.0f;
+    scaleX[handle] = 1.0f;
+    scaleY[handle] = 1.0f;
+    scaleZ[handle] = 1.0f;
+}
+
+void TransformStore::grow() {
+    const std::size_t oldSize = positionX.size();
+    const std::size_t newSize = std::max(Padding, oldSize * 2);
+    
+    // Unused slots hold identity transformations, so the SIMD code never computes garbage for them
+    positionX.resize(newSize, 0.0f);
+    positionY.resize(newSize, 0.0f);
+    positionZ.resize(newSize, 0.0f);
+    rotationX.resize(newSize, 0.0f);
+    rotationY.resize(newSize, 0.0f);
+    rotationZ.resize(newSize, 0.0f);
+    rotationW.resize(newSize, 1.0f);
+    scaleX.resize(newSize, 1.0f);
+    scaleY.resize(newSize, 1.0f);
+    scaleZ.resize(newSize, 1.0f);
+    
+    dirtyBits.resize(newSize / Padding, 0);
+    localMatrices.resize(newSize, glm::mat4(1.0f));
+    worldMatrices.resize(newSize, glm::mat4(1.0f));
+    worldChanged.resize(newSize, 0);
+    updateCounts.resize(newSize, 0);
+    
+    parents.resize(newSize, InvalidHandle);
+    childCounts.resize(newSize, 0);
+    alive.resize(newSize, 0);
+    
+    // Reversed, so that create() hands out the lowest handles first
+    freeHandles.reserve(freeHandles.size() + newSize - oldSize);
+    for (std::size_t i = newSize; i > oldSize; --i) {
+        freeHandles.push_back(static_cast<Handle>(i - 1));
+    }
+}
+
+void TransformStore::rebuildHierarchyOrder() {
+    hierarchyOrder.clear();
+    levelOffsets.clear();
+    
+    const std::size_t slotCount = parents.size();
+    if (depths.size() < slotCount) {
+        depths.resize(slotCount);
+    }
+    
+    // Depth 0 means "not computed yet". Roots end up with 1 to tell them apart.
+    std::fill(depths.begin(), depths.begin() + slotCount, 0);
+    std::uint32_t maxDepth = 0;
+    
+    for (std::size_t i = 0; i < slotCount; ++i) {
+        if (alive[i] == 0 || depths[i] != 0) {
+            continue;
+        }
+        
+        // Walk up to the first ancestor with a known depth and fill in the depths on the way back down
+        std::uint32_t length = 0;
+        Handle current = static_cast<Handle>(i);
+        while (current != InvalidHandle && depths[current] == 0) {
+            length++;
+            current = parents[current];
+        }
+        
+        std::uint32_t depth = (current == InvalidHandle) ? 0 : depths[current];
+        depth += length;
+        maxDepth = std::max(maxDepth, depth);
+        
+        current = static_cast<Handle>(i);
+        for (std::uint32_t d = depth; d > depth - length; --d) {
+            depths[current] = d;
+            current = parents[current];
+        }
+    }
+    
+    if (maxDepth <= 1) {
+        hierarchyChanged = false;
+        return;
+    }
+    
+    // Counting sort by depth. Roots are skipped because updating them needs no parent, so the children of roots
+    // (internal depth 2) end up in level 0.
+    const std::size_t levelCount = maxDepth - 1;
+    levelOffsets.assign(levelCount + 1, 0);
+    for (std::size_t i = 0; i < slotCount; ++i) {
+        if (alive[i] != 0 && depths[i] > 1) {
+            levelOffsets[depths[i] - 1]++;
+        }
+    }
+    
+    for (std::size_t d = 1; d <= levelCount; ++d) {
+        levelOffsets[d] += levelOffsets[d - 1];
+    }
+    
+    hierarchyOrder.resize(levelOffsets.back());
+    std::vector<std::size_t> cursors(levelOffsets.begin(), levelOffsets.end() - 1);
+    for (std::size_t i = 0; i < slotCount; ++i) {
+        if (alive[i] != 0 && depths[i] > 1) {
+            hierarchyOrder[cursors[depths[i] - 2]++] = static_cast<Handle>(i);
+        }
+    }
+    
+    hierarchyChanged = false;
+}
+
+inline static unsigned int CountTrailingZeros(std::uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward64(&bit, value);
+    return static_cast<unsigned int>(bit);
+#else
+    return static_cast<unsigned int>(__builtin_ctzll(value));
+#endif
+}
+
+void TransformStore::rebuildWordsScalar(std::size_t firstWord, std::size_t lastWord) {
+    for (std::size_t w = firstWord; w < lastWord; ++w) {
+        std::uint64_t bits = dirtyBits[w];
+        if (bits == 0) {
+            continue;
+        }
+        
+        dirtyBits[w] = 0;
+        
+        while (bits != 0) {
+            const std::size_t i = w * Padding + CountTrailingZeros(bits);
+            const bool isRoot = (parents[i] == InvalidHandle);
+            
+            BuildMatrix(positionX[i], positionY[i], positionZ[i], rotationX[i], rotationY[i], rotationZ[i], rotationW[i], scaleX[i], scaleY[i], scaleZ[i],
+                        isRoot ? worldMatrices[i] : localMatrices[i]);
+            
+            worldChanged[i] = 1;
+            if (isRoot) {
+                updateCounts[i]++;
+            }
+            
+            bits &= bits - 1;
+        }
+    }
+}
+
+#if defined(IYF_TRANSFORM_AVX) || defined(IYF_TRANSFORM_SSE)
+/// Stores 4 matrices that are held as a structure of arrays. elements[c][r] contains element [c][r] of all 4
+/// matrices. Lanes with a nullptr target are skipped.
+inline static void StoreMatrices(__m128 (&elements)[4][4], glm::mat4* const* targets) {
+    for (int column = 0; column < 4; ++column) {
+        __m128 r0 = elements[column][0];
+        __m128 r1 = elements[column][1];
+        __m128 r2 = elements[column][2];
+        __m128 r3 = elements[column][3];
+        
+        // Afterwards, rN holds the column of lane N
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        
+        if (targets[0] != nullptr) { _mm_storeu_ps(&(*targets[0])[column][0], r0); }
+        if (targets[1] != nullptr) { _mm_storeu_ps(&(*targets[1])[column][0], r1); }
+        if (targets[2] != nullptr) { _mm_storeu_ps(&(*targets[2])[column][0], r2); }
+        if (targets[3] != nullptr) { _mm_storeu_ps(&(*targets[3])[column][0], r3); }
+    }
+}
+#endif
+
+void TransformStore::rebuildWordsSIMD(std::size_t firstWord, std::size_t lastWord) {
+#if defined(IYF_TRANSFORM_AVX) || defined(IYF_TRANSFORM_SSE)
+#if defined(IYF_TRANSFORM_AVX)
+    constexpr std::size_t Width = 8;
+    using Vector = __m256;
+    #define IYF_TRANSFORM_SET1 _mm256_set1_ps
+    #define IYF_TRANSFORM_LOAD _mm256_loadu_ps
+    #define IYF_TRANSFORM_ADD _mm256_add_ps
+    #define IYF_TRANSFORM_SUB _mm256_sub_ps
+    #define IYF_TRANSFORM_MUL _mm256_mul_ps
+#else
+    constexpr std::size_t Width = 4;
+    using Vector = __m128;
+    #define IYF_TRANSFORM_SET1 _mm_set1_ps
+    #define IYF_TRANSFORM_LOAD _mm_loadu_ps
+    #define IYF_TRANSFORM_ADD _mm_add_ps
+    #define IYF_TRANSFORM_SUB _mm_sub_ps
+    #define IYF_TRANSFORM_MUL _mm_mul_ps
+#endif
+    
+    constexpr std::uint64_t FullMask = (std::uint64_t(1) << Width) - 1;
+    
+    const Vector one = IYF_TRANSFORM_SET1(1.0f);
+    const Vector two = IYF_TRANSFORM_SET1(2.0f);
+    
+    // Element [c][r] of the matrices of all lanes
+    Vector elements[4][4];
+    for (int column = 0; column < 3; ++column) {
+        elements[column][3] = IYF_TRANSFORM_SET1(0.0f);
+    }
+    elements[3][3] = one;
+    
+    for (std::size_t w = firstWord; w < lastWord; ++w) {
+        const std::uint64_t bits = dirtyBits[w];
+        if (bits == 0) {
+            continue;
+        }
+        
+        dirtyBits[w] = 0;
+        
+        for (std::size_t block = 0; block < Padding; block += Width) {
+            const std::uint64_t mask = (bits >> block) & FullMask;
+            if (mask == 0) {
+                continue;
+            }
+            
+            const std::size_t i = w * Padding + block;
+            
+            const Vector qx = IYF_TRANSFORM_LOAD(rotationX.data() + i);
+            const Vector qy = IYF_TRANSFORM_LOAD(rotationY.data() + i);
+            const Vector qz = IYF_TRANSFORM_LOAD(rotationZ.data() + i);
+            const Vector qw = IYF_TRANSFORM_LOAD(rotationW.data() + i);
+            const Vector sx = IYF_TRANSFORM_LOAD(scaleX.data() + i);
+            const Vector sy = IYF_TRANSFORM_LOAD(scaleY.data() + i);
+            const Vector sz = IYF_TRANSFORM_LOAD(scaleZ.data() + i);
+            
+            const Vector xx = IYF_TRANSFORM_MUL(qx, qx);
+            const Vector yy = IYF_TRANSFORM_MUL(qy, qy);
+            const Vector zz = IYF_TRANSFORM_MUL(qz, qz);
+            const Vector xy = IYF_TRANSFORM_MUL(qx, qy);
+            const Vector xz = IYF_TRANSFORM_MUL(qx, qz);
+            const Vector yz = IYF_TRANSFORM_MUL(qy, qz);
+            const Vector wx = IYF_TRANSFORM_MUL(qw, qx);
+            const Vector wy = IYF_TRANSFORM_MUL(qw, qy);
+            const Vector wz = IYF_TRANSFORM_MUL(qw, qz);
+            
+            // Same operation order as BuildMatrix() to get bit identical results
+            elements[0][0] = IYF_TRANSFORM_MUL(IYF_TRANSFORM_SUB(one, IYF_TRANSFORM_MUL(two, IYF_TRANSFORM_ADD(yy, zz))), sx);
+            elements[0][1] = IYF_TRANSFORM_MUL(IYF_TRANSFORM_MUL(two, IYF_TRANSFORM_ADD(xy, wz)), sx);
+            elements[0][2] = IYF_TRANSFORM_MUL(IYF_TRANSFORM_MUL(two, IYF_TRANSFORM_SUB(xz, wy)), sx);
+            
+            elements[1][0] = IYF_TRANSFORM_MUL(IYF_TRANSFORM_MUL(two, IYF_TRANSFORM_SUB(xy, wz)), sy);
+            elements[1][1] = IYF_TRANSFORM_MUL(IYF_TRANSFORM_SUB(one, IYF_TRANSFORM_MUL(two, IYF_TRANSFORM_ADD(xx, zz))), sy);
+            elements[1][2] = IYF_TRANSFORM_MUL(IYF_TRANSFORM_MUL(two, IYF_TRANSFORM_ADD(yz, wx)), sy);
+            
+            elements[2][0] = IYF_TRANSFORM_MUL(IYF_TRANSFORM_MUL(two, IYF_TRANSFORM_ADD(xz, wy)), sz);
+            elements[2][1] = IYF_TRANSFORM_MUL(IYF_TRANSFORM_MUL(two, IYF_TRANSFORM_SUB(yz, wx)), sz);
+            elements[2][2] = IYF_TRANSFORM_MUL(IYF_TRANSFORM_SUB(one, IYF_TRANSFORM_MUL(two, IYF_TRANSFORM_ADD(xx, yy))), sz);
+            
+            elements[3][0] = IYF_TRANSFORM_LOAD(positionX.data() + i);
+            elements[3][1] = IYF_TRANSFORM_LOAD(positionY.data() + i);
+            elements[3][2] = IYF_TRANSFORM_LOAD(positionZ.data() + i);
+            
+            glm::mat4* targets[Width];
+            for (std::size_t lane = 0; lane < Width; ++lane) {
+                if ((mask & (std::uint64_t(1) << lane)) == 0) {
+                    targets[lane] = nullptr;
+                    continue;
+                }
+                
+                const std::size_t id = i + lane;
+                const bool isRoot = (parents[id] == InvalidHandle);
+                
+                targets[lane] = isRoot ? &worldMatrices[id] : &localMatrices[id];
+                
+                worldChanged[id] = 1;
+                if (isRoot) {
+                    updateCounts[id]++;
+                }
+            }
+            
+#if defined(IYF_TRANSFORM_AVX)
+            __m128 low[4][4];
+            __m128 high[4][4];
+            for (int column = 0; column < 4; ++column) {
+                for (int row = 0; row < 4; ++row) {
+                    low[column][row] = _mm256_castps256_ps128(elements[column][row]);
+                    high[column][row] = _mm256_extractf128_ps(elements[column][row], 1);
+                }
+            }
+            
+            StoreMatrices(low, targets);
+            StoreMatrices(high, targets + 4);
+#else
+            StoreMatrices(elements, targets);
+#endif
+        }
+    }
+    
+    #undef IYF_TRANSFORM_SET1
+    #undef IYF_TRANSFORM_LOAD
+    #undef IYF_TRANSFORM_ADD
+    #undef IYF_TRANSFORM_SUB
+    #undef IYF_TRANSFORM_MUL
+#else
+    rebuildWordsScalar(firstWord, lastWord);
+#endif
+}
+
+void TransformStore::propagateRange(std::size_t begin, std::size_t end) {
+    for (std::size_t k = begin; k < end; ++k) {
+        const Handle handle = hierarchyOrder[k];
+        const Handle parent = parents[handle];
+        
+        if ((worldChanged[handle] | worldChanged[parent]) != 0) {
+            MultiplyMatrices(worldMatrices[parent], localMatrices[handle], worldMatrices[handle]);
+            
+            worldChanged[handle] = 1;
+            updateCounts[handle]++;
+        }
+    }
+}
+
+void TransformStore::updateDirtyTransforms(iyft::ThreadPool* pool) {
+    IYFT_PROFILE(UpdateDirtyTransforms, iyft::ProfilerTag::World);
+    
+    if (hierarchyChanged) {
+        rebuildHierarchyOrder();
+    }
+    
+    // The flags are only read while propagating. Flat stores never need to clear them.
+    const bool hasHierarchy = !hierarchyOrder.empty();
+    if (hasHierarchy) {
+        std::fill(worldChanged.begin(), worldChanged.end(), 0);
+    }
+    
+    // Chunks consist of whole dirty words, so no two threads ever write to the same word
+    RunInChunks(pool, dirtyBits.size(), MinChunkSize / Padding, [this](std::size_t firstWord, std::size_t lastWord) {
+        if (mode == Mode::SIMD) {
+            rebuildWordsSIMD(firstWord, lastWord);
+        } else {
+            rebuildWordsScalar(firstWord, lastWord);
+        }
+    });
+    
+    if (!hasHierarchy) {
+        return;
+    }
+    
+    // The parents of a level all belong to the previous levels, which are complete by the time RunInChunks()
+    // returns. The transformations of a single level are independent of each other.
+    for (std::size_t level = 0; level + 1 < levelOffsets.size(); ++level) {
+        const std::size_t levelBegin = levelOffsets[level];
+        const std::size_t levelSize = levelOffsets[level + 1] - levelBegin;
+        
+        RunInChunks(pool, levelSize, MinChunkSize, [this, levelBegin](std::size_t begin, std::size_t end) {
+            propagateRange(levelBegin + begin, levelBegin + end);
+        });
+    }
+}
+
+const char* TransformStore::GetSIMDInstructionSetName() {
+#if defined(IYF_TRANSFORM_AVX)
+    return "AVX";
+#elif defined(IYF_TRANSFORM_SSE)
+    return "SSE2";
+#else
+    return "None (scalar fallback)";
+#endif
+}
+}
@@ -40,6 +40,8 @@
 #include "core/filesystem/VirtualFileSystem.hpp"
 #include "core/filesystem/VirtualFileSystemFile.hpp"
 #include "io/File.hpp"
+#include "io/DefaultFileSystem.hpp"
+#include "io/MemoryMappedFile.hpp"
 #include "logging/Logger.hpp"
 #include "core/Project.hpp"
 #include "core/Constants.hpp"
@@ -75,6 +77,39 @@ std::unique_ptr<File> VirtualFileSystem::openFile(const Path& p, FileOpenMode mo
     return std::unique_ptr<VirtualFileSystemFile>(new VirtualFileSystemFile(p, mode));
 }
 
+FileView VirtualFileSystem::mapWholeFile(const Path& path) const {
+    assert(initialized);
+    
+    if (!MemoryMappedFile::IsSupported()) {
+        return FileSystem::mapWholeFile(path);
+    }
+    
+    std::string virtualPath = path.getGenericString();
+    const char* realDir = PHYSFS_getRealDir(virtualPath.c_str());
+    
+    // Archives can't be mapped. They need to be read (and, most likely, decompressed) by PhysFS.
+    if (realDir == nullptr || !DefaultFileSystem::Instance().isDirectory(Path(realDir))) {
+        return FileSystem::mapWholeFile(path);
+    }
+    
+    // The virtual path starts at the mount point of the real directory and not at its root
+    std::string mountPoint = PHYSFS_getMountPoint(realDir);
+    if (!mountPoint.empty() && mountPoint.front() == '/') {
+        mountPoint.erase(0, 1);
+    }
+    
+    if (!virtualPath.empty() && virtualPath.front() == '/') {
+        virtualPath.erase(0, 1);
+    }
+    
+    if (virtualPath.compare(0, mountPoint.size(), mountPoint) == 0) {
+        virtualPath.erase(0, mountPoint.size());
+    }
+    
+    // Handles small files as well
+    return DefaultFileSystem::Instance().mapWholeFile(Path(realDir) / virtualPath);
+}
+
 bool VirtualFileSystem::initialize(const Project* project, bool editorMode, bool skipSystemPackageMounting) {
     this->editorMode = editorMode;
 
@@ -317,6 +352,47 @@ Path VirtualFileSystem::getRealDirectory(const Path& fileName) const {
         return Path(dir) / fileName;
     }
 }
+
+std::vector<Path> VirtualFileSystem::getRealSearchPathSources(const Path& path) const {
+    assert(initialized);
+    
+    std::string virtualPath = path.getGenericString();
+    if (!virtualPath.empty() && virtualPath.front() == '/') {
+        virtualPath.erase(0, 1);
+    }
+    
+    std::vector<Path> sources;
+    char** searchPath = PHYSFS_getSearchPath();
+    
+    for (char** i = searchPath; *i != nullptr; ++i) {
+        const Path source(*i);
+        
+        if (!DefaultFileSystem::Instance().isDirectory(source)) {
+            // Looking inside the archive would cost as much as enumerating it
+            sources.push_back(source);
+            continue;
+        }
+        
+        std::string mountPoint = PHYSFS_getMountPoint(*i);
+        if (!mountPoint.empty() && mountPoint.front() == '/') {
+            mountPoint.erase(0, 1);
+        }
+        
+        // Directories that are mounted elsewhere can't contain the virtual path
+        if (virtualPath.compare(0, mountPoint.size(), mountPoint) != 0) {
+            continue;
+        }
+        
+        const Path realPath = source / virtualPath.substr(mountPoint.size());
+        if (DefaultFileSystem::Instance().isDirectory(realPath)) {
+            sources.push_back(realPath);
+        }
+    }
+    
+    PHYSFS_freeList(searchPath);
+    
+    return sources;
+}
     
 FileSystemResult VirtualFileSystem::remove(const Path& path) const {
     assert(initialized);
@@ -0,0 +1,156 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/AsyncPipelineCompiler.hpp"
+#include "threading/ThreadPool.hpp"
+#include "logging/Logger.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace iyf {
+
+AsyncPipelineCompiler::AsyncPipelineCompiler(GraphicsAPI* api, iyft::ThreadPool* pool) : api(api), pool(pool), pendingCount(0) {
+    if (api == nullptr) {
+        throw std::invalid_argument("The GraphicsAPI can't be nullptr");
+    }
+}
+
+AsyncPipelineCompiler::~AsyncPipelineCompiler() {
+    assert(entries.empty() && "dispose() must be called before destroying the AsyncPipelineCompiler");
+}
+
+std::shared_future<Pipeline> AsyncPipelineCompiler::requestPipeline(std::uint64_t key, const PipelineCreateInfo& info, std::string name) {
+    std::unique_lock<std::mutex> lock(entryMutex);
+    
+    auto result = entries.find(key);
+    if (result != entries.end()) {
+        return result->second->future;
+    }
+    
+    Entry* entry = entries.emplace(key, std::make_unique<Entry>()).first->second.get();
+    pendingCount.fetch_add(1, std::memory_order_acq_rel);
+    
+    auto task = [this, entry, info, name = std::move(name)]() {
+        return createPipeline(entry, info, name);
+    };
+    
+    if (pool != nullptr) {
+        entry->future = pool->addTaskWithResult(std::move(task)).share();
+        return entry->future;
+    }
+    
+    std::packaged_task<Pipeline()> immediateTask(std::move(task));
+    entry->future = immediateTask.get_future().share();
+    
+    // The lock is not needed while the pipeline is created and the GraphicsAPI may take a while
+    lock.unlock();
+    immediateTask();
+    
+    return entry->future;
+}
+
+Pipeline AsyncPipelineCompiler::createPipeline(Entry* entry, const PipelineCreateInfo& info, const std::string& name) {
+    try {
+        Pipeline pipeline = api->createPipeline(info, name.c_str());
+        
+        if (!pipeline.handle.isValid()) {
+            throw std::runtime_error("The GraphicsAPI returned an invalid pipeline handle");
+        }
+        
+        entry->pipeline = pipeline;
+        entry->state.store(State::Ready, std::memory_order_release);
+        pendingCount.fetch_sub(1, std::memory_order_acq_rel);
+        
+        return pipeline;
+    } catch (const std::exception& e) {
+        LOG_W("Failed to create the pipeline \"{}\". The fallback pipeline will be used instead. Error: {}", name, e.what());
+        
+        entry->state.store(State::Failed, std::memory_order_release);
+        pendingCount.fetch_sub(1, std::memory_order_acq_rel);
+        
+        throw;
+    }
+}
+
+const Pipeline& AsyncPipelineCompiler::getPipeline(std::uint64_t key, const Pipeline& fallback) const {
+    std::lock_guard<std::mutex> lock(entryMutex);
+    
+    auto result = entries.find(key);
+    if (result == entries.end() || result->second->state.load(std::memory_order_acquire) != State::Ready) {
+        return fallback;
+    }
+    
+    return result->second->pipeline;
+}
+
+AsyncPipelineCompiler::State AsyncPipelineCompiler::getState(std::uint64_t key) const {
+    std::lock_guard<std::mutex> lock(entryMutex);
+    
+    auto result = entries.find(key);
+    if (result == entries.end()) {
+        return State::Failed;
+    }
+    
+    return result->second->state.load(std::memory_order_acquire);
+}
+
+void AsyncPipelineCompiler::waitForPending() {
+    std::vector<std::shared_future<Pipeline>> futures;
+    
+    {
+        std::lock_guard<std::mutex> lock(entryMutex);
+        futures.reserve(entries.size());
+        
+        for (const auto& entry : entries) {
+            if (entry.second->future.valid()) {
+                futures.push_back(entry.second->future);
+            }
+        }
+    }
+    
+    for (const auto& future : futures) {
+        future.wait();
+    }
+}
+
+void AsyncPipelineCompiler::dispose() {
+    waitForPending();
+    
+    std::lock_guard<std::mutex> lock(entryMutex);
+    
+    for (const auto& entry : entries) {
+        if (entry.second->state.load(std::memory_order_acquire) == State::Ready) {
+            api->destroyPipeline(entry.second->pipeline);
+        }
+    }
+    
+    entries.clear();
+}
+
+}
@@ -27,10 +27,12 @@
 // WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "graphics/GraphicsAPI.hpp"
+#include "graphics/PipelineCacheStore.hpp"
 
 #include "utilities/ConstantMapper.hpp"
 #include "assets/loaders/TextureLoader.hpp"
 #include "core/Engine.hpp"
+#include "core/filesystem/VirtualFileSystem.hpp"
 #include "logging/Logger.hpp"
 #include "configuration/Configuration.hpp"
 // Needed to fetch the localized window name
@@ -529,6 +531,15 @@ ImageCreateInfo GraphicsAPI::buildImageCreateInfo(const TextureData& textureData
     return ici;
 }
 
+Path GraphicsAPI::getPipelineCachePath(const PipelineCacheIdentity& identity) const {
+    const Path& preferenceDirectory = engine->getFileSystem()->getPreferenceDirectory();
+    if (preferenceDirectory.empty()) {
+        return Path();
+    }
+    
+    return preferenceDirectory / PipelineCacheStore::MakeFileName(identity);
+}
+
 glm::uvec2 GraphicsAPI::getWindowSize() const {
     int w = 0;
     int h = 0;
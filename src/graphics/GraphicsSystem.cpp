@@ -32,6 +32,7 @@
 #include "graphics/Camera.hpp"
 #include "graphics/CubemapSkybox.hpp"
 #include "graphics/DebugRenderer.hpp"
+#include "graphics/ShaderConstants.hpp"
 #include "core/EntitySystemManager.hpp"
 #include "core/UnorderedComponentMap.hpp"
 #include "core/Engine.hpp"
@@ -41,6 +42,8 @@
 #include "physics/PhysicsSystem.hpp"
 #include "threading/ThreadProfiler.hpp"
 
+#include <algorithm>
+
 namespace iyf {
 static void checkEditorMode(const EntitySystemManager* manager) {
     if (!manager->isEditorMode()) {
@@ -63,11 +66,13 @@ void GraphicsSystem::postDetach(Component&, std::uint32_t) {
 void GraphicsSystem::VisibleComponents::reset() {
     opaqueMeshEntityIDs.clear();
     transparentMeshEntityIDs.clear();
+    pointLights.clear();
+    spotLights.clear();
 }
 
 void GraphicsSystem::VisibleComponents::sort() {
-    std::sort(opaqueMeshEntityIDs.begin(), opaqueMeshEntityIDs.end());
-    std::sort(transparentMeshEntityIDs.begin(), transparentMeshEntityIDs.end());
+    opaqueSorter.sort(opaqueMeshEntityIDs);
+    transparentSorter.sort(transparentMeshEntityIDs);
 }
 
 SystemSettings MakeGraphicsSystemSettings() {
@@ -78,7 +83,7 @@ SystemSettings MakeGraphicsSystemSettings() {
     return settings;
 }
 
-GraphicsSystem::GraphicsSystem(EntitySystemManager* manager, GraphicsAPI* api) : System(manager, MakeGraphicsSystemSettings(), ComponentBaseType::Graphics, static_cast<std::size_t>(GraphicsComponent::COUNT)), cameraInputPaused(false), api(api), drawFrustum(false), drawnFrustumID(EntityKey::InvalidID), activeCamera(EntityKey::InvalidID), viewingFromEditorCamera(false) {}
+GraphicsSystem::GraphicsSystem(EntitySystemManager* manager, GraphicsAPI* api) : System(manager, MakeGraphicsSystemSettings(), ComponentBaseType::Graphics, static_cast<std::size_t>(GraphicsComponent::COUNT)), cameraInputPaused(false), api(api), drawFrustum(false), drawnFrustumID(EntityKey::InvalidID), spatialIndexCulling(true), droppedLightCount(0), activeCamera(EntityKey::InvalidID), viewingFromEditorCamera(false) {}
 
 bool GraphicsSystem::isViewingFromEditorCamera() const {
     checkEditorMode(manager);
@@ -139,7 +144,7 @@ std::unique_ptr<Skybox> GraphicsSystem::setSkybox(std::unique_ptr<Skybox> newSky
 void GraphicsSystem::initialize() {
     components[static_cast<std::size_t>(GraphicsComponent::Mesh)] = std::make_unique<ChunkedMeshVector>(this, ComponentType(ComponentBaseType::Graphics, GraphicsComponent::Mesh));
     components[static_cast<std::size_t>(GraphicsComponent::Camera)] = std::make_unique<UnorderedComponentMap<Camera>>(this, ComponentType(ComponentBaseType::Graphics, GraphicsComponent::Camera));
-    components[static_cast<std::size_t>(GraphicsComponent::Light)] = std::make_unique<ChunkedMeshVector>(this, ComponentType(ComponentBaseType::Graphics, GraphicsComponent::Light));
+    components[static_cast<std::size_t>(GraphicsComponent::Light)] = std::make_unique<ChunkedLightVector>(this, ComponentType(ComponentBaseType::Graphics, GraphicsComponent::Light));
     
     if (!api->isInitialized()) {
         throw std::runtime_error("API must be initialized before initializing the GraphicsSystem.");
@@ -177,13 +182,166 @@ void GraphicsSystem::dispose() {
     if (skybox != nullptr) {
         skybox->dispose();
     }
+    
+    spatialIndex.clear();
+    
+    meshBounds.clear();
+    meshBoundsOwners.clear();
+    meshBoundsSlots.clear();
+}
+
+void GraphicsSystem::onMeshBoundsChanged(std::uint32_t id, const BoundingVolume& bounds, bool isStatic) {
+#if IYF_BOUNDING_VOLUME == IYF_SPHERE_BOUNDS
+    const glm::vec3 extent(bounds.radius, bounds.radius, bounds.radius);
+    spatialIndex.update(id, AABB(bounds.center - extent, bounds.center + extent), isStatic);
+#elif IYF_BOUNDING_VOLUME == IYF_AABB_BOUNDS
+    spatialIndex.update(id, bounds, isStatic);
+    
+    if (id >= meshBoundsSlots.size()) {
+        // InvalidID has no out of class definition and resize() would bind a reference to it
+        const std::uint32_t noSlot = EntityKey::InvalidID;
+        meshBoundsSlots.resize(std::max(static_cast<std::size_t>(id) + 1, meshBoundsSlots.size() * 2), noSlot);
+    }
+    
+    const glm::vec3& minCorner = bounds.getVertex(AABB::Vertex::Minimum);
+    const glm::vec3& maxCorner = bounds.getVertex(AABB::Vertex::Maximum);
+    
+    std::uint32_t& slot = meshBoundsSlots[id];
+    if (slot == EntityKey::InvalidID) {
+        slot = meshBounds.add(minCorner.x, minCorner.y, minCorner.z, maxCorner.x, maxCorner.y, maxCorner.z);
+        meshBoundsOwners.push_back(id);
+    } else {
+        meshBounds.set(slot, minCorner.x, minCorner.y, minCorner.z, maxCorner.x, maxCorner.y, maxCorner.z);
+    }
+#endif // IYF_BOUNDING_VOLUME
+}
+
+void GraphicsSystem::onMeshRemoved(std::uint32_t id) {
+    spatialIndex.remove(id);
+    
+#if IYF_BOUNDING_VOLUME == IYF_AABB_BOUNDS
+    if (id >= meshBoundsSlots.size() || meshBoundsSlots[id] == EntityKey::InvalidID) {
+        return;
+    }
+    
+    // The last box takes the place of the removed one
+    const std::uint32_t slot = meshBoundsSlots[id];
+    const std::uint32_t movedOwner = meshBoundsOwners.back();
+    
+    meshBounds.removeAndSwap(slot);
+    meshBoundsOwners[slot] = movedOwner;
+    meshBoundsOwners.pop_back();
+    
+    meshBoundsSlots[movedOwner] = slot;
+    meshBoundsSlots[id] = EntityKey::InvalidID;
+#endif // IYF_BOUNDING_VOLUME
+}
+
+float GraphicsSystem::computeViewDepth(const BoundingVolume& bounds) const {
+#if IYF_BOUNDING_VOLUME == IYF_SPHERE_BOUNDS
+    const glm::vec3& center = bounds.center;
+#elif IYF_BOUNDING_VOLUME == IYF_AABB_BOUNDS
+    const glm::vec3 center = (bounds.getVertex(AABB::Vertex::Minimum) + bounds.getVertex(AABB::Vertex::Maximum)) * 0.5f;
+#endif // IYF_BOUNDING_VOLUME
+    
+    // The normal of the near plane points towards the camera and the points in front of it have negative distances
+    const glm::vec4 nearPlane = frustum.getPlane(Frustum::Plane::Near);
+    return -(glm::dot(glm::vec3(nearPlane), center) + nearPlane.w);
+}
+
+void GraphicsSystem::cullWithSpatialIndex() {
+    spatialIndex.commit();
+    
+    visibleIDs.clear();
+    spatialIndex.queryFrustum(frustum.getCullingPlanes(), visibleIDs);
+    
+    addVisibleMeshes();
+}
+
+void GraphicsSystem::cullWithFrustumCuller() {
+    culler.cull(frustum.getCullingPlanes(), meshBounds, visibleIDs, manager->getEngine()->getFrameWorkerPool());
+    
+    // The culler returns the indices of the boxes
+    for (std::uint32_t& id : visibleIDs) {
+        id = meshBoundsOwners[id];
+    }
+    
+    addVisibleMeshes();
+}
+
+void GraphicsSystem::addVisibleMeshes() {
+    // Only a small fraction of all meshes is visible, so the slow random access is fine here
+    const ChunkedMeshVector* meshes = static_cast<const ChunkedMeshVector*>(getContainer(static_cast<std::size_t>(GraphicsComponent::Mesh)));
+    for (std::uint32_t id : visibleIDs) {
+        const MeshComponent& mc = static_cast<const MeshComponent&>(meshes->get(id));
+        
+        if (mc.getRenderMode() == MaterialRenderMode::Opaque) {
+            visibleComponents.opaqueMeshEntityIDs.push_back({id, 0.0f, mc.getRenderDataKey()});
+        } else {
+            visibleComponents.transparentMeshEntityIDs.push_back({id, computeViewDepth(mc.getCurrentBoundingVolume()), mc.getRenderDataKey()});
+        }
+    }
+}
+
+void GraphicsSystem::gatherLights() {
+    // The lights are assigned to clusters by the Renderer, which drops the ones that are out of view
+    const ChunkedLightVector* lights = static_cast<const ChunkedLightVector*>(getContainer(static_cast<std::size_t>(GraphicsComponent::Light)));
+    std::size_t droppedPointLights = 0;
+    std::size_t droppedSpotLights = 0;
+    
+    for (std::uint32_t i = 0; i < manager->getEntityCount(); ++i) {
+        if (!availableComponents[i][static_cast<std::size_t>(GraphicsComponent::Light)]) {
+            continue;
+        }
+        
+        const LightComponent& lc = static_cast<const LightComponent&>(lights->get(i));
+        switch (lc.getLightType()) {
+            case LightType::Point:
+                if (visibleComponents.pointLights.size() < con::MaxPointLights) {
+                    lc.toPointLight(visibleComponents.pointLights.emplace_back());
+                } else {
+                    droppedPointLights++;
+                }
+                break;
+            case LightType::Spot:
+                if (visibleComponents.spotLights.size() < con::MaxSpotLights) {
+                    lc.toSpotLight(visibleComponents.spotLights.emplace_back());
+                } else {
+                    droppedSpotLights++;
+                }
+                break;
+            case LightType::Directional:
+                break;
+        }
+    }
+    
+    // Warning every frame would flood the log
+    const std::size_t dropped = droppedPointLights + droppedSpotLights;
+    if (dropped != droppedLightCount && dropped != 0) {
+        LOG_W("The World has more lights than the shaders can read. {} point lights (limit: {}) and {} spot lights (limit: {}) won't be drawn.",
+              droppedPointLights, con::MaxPointLights, droppedSpotLights, con::MaxSpotLights);
+    }
+    
+    droppedLightCount = dropped;
 }
 
 void GraphicsSystem::performCulling() {
     IYFT_PROFILE(EntityCulling, iyft::ProfilerTag::Graphics);
     
     visibleComponents.reset();
+    gatherLights();
     
+    if (spatialIndexCulling) {
+        cullWithSpatialIndex();
+        selectLODs(visibleComponents.opaqueMeshEntityIDs);
+        selectLODs(visibleComponents.transparentMeshEntityIDs);
+        visibleComponents.sort();
+        return;
+    }
+    
+#if IYF_BOUNDING_VOLUME == IYF_AABB_BOUNDS
+    cullWithFrustumCuller();
+#else
     ChunkedMeshVector* meshes = static_cast<ChunkedMeshVector*>(getContainer(static_cast<std::size_t>(GraphicsComponent::Mesh)));
     auto meshesIt = meshes->begin();
     
@@ -199,28 +357,93 @@ void GraphicsSystem::performCulling() {
         const MeshComponent& mc = *meshesIt;
         const BoundingVolume& bounds = mc.getCurrentBoundingVolume();
         
-//         if (frustum.doesSphereIntersectPlane(Frustum::Plane::Bottom, bounds)) {
-//             LOG_D("YAY");
-//         } else {
-//             LOG_D("NAY"); 
-//         }
         if (frustum.isBoundingVolumeInFrustum(bounds)) {
             if (mc.getRenderMode() == MaterialRenderMode::Opaque) {
-                visibleComponents.opaqueMeshEntityIDs.push_back({i, mc.getRenderDataKey()});
+                visibleComponents.opaqueMeshEntityIDs.push_back({i, 0.0f, mc.getRenderDataKey()});
             } else {
-                visibleComponents.transparentMeshEntityIDs.push_back({i, mc.getRenderDataKey()});
+                visibleComponents.transparentMeshEntityIDs.push_back({i, computeViewDepth(bounds), mc.getRenderDataKey()});
             }
         }
         
         meshesIt++;
     }
+#endif // IYF_BOUNDING_VOLUME
     
+    selectLODs(visibleComponents.opaqueMeshEntityIDs);
+    selectLODs(visibleComponents.transparentMeshEntityIDs);
     visibleComponents.sort();
 }
 
-void GraphicsSystem::update(float delta, const EntityStateVector& entityStates) {
+void GraphicsSystem::selectLODs(std::vector<DrawingListElement>& elements) {
+    if (elements.empty()) {
+        return;
+    }
+    
+    const Camera& camera = getActiveCamera();
+    const glm::vec3 cameraPosition = camera.getPosition();
+    const float pixelsPerUnit = (camera.getRenderSurfaceSize().y * 0.5f) / std::tan(camera.getVerticalFOV() * 0.5f);
+    
+    ChunkedMeshVector* meshes = static_cast<ChunkedMeshVector*>(getContainer(static_cast<std::size_t>(GraphicsComponent::Mesh)));
+    const TransformationVector& transformations = manager->getEntityTransformations();
+    
+    for (DrawingListElement& element : elements) {
+        MeshComponent& mc = static_cast<MeshComponent&>(meshes->get(element.componentID));
+        const AssetHandle<Mesh>& mesh = mc.getMesh();
+        
+        if (mesh->lodCount == 0 || mesh->hasSubmeshes()) {
+            element.lod = 0;
+            continue;
+        }
+        
+        // The errors are relative to the radius of the bounding sphere of the mesh, so the sphere has to be transformed
+        // the same way as the mesh, even if the culling uses AABBs.
+        const TransformationComponent& transformation = transformations[element.componentID];
+        const BoundingSphere sphere = mesh->boundingSphere.transform(transformation.getModelMatrix(), transformation.getScale());
+        
+        const float projectedRadius = ComputeProjectedRadius(glm::distance(cameraPosition, sphere.center), sphere.radius, pixelsPerUnit);
+        const std::uint8_t lod = SelectLOD(mesh->lods, mesh->lodCount, projectedRadius, mc.getLOD(), lodSettings);
+        
+        mc.setLOD(lod);
+        element.lod = lod;
+    }
+}
+
+void GraphicsSystem::update(float delta, const EntityStateVector&) {
     IYFT_PROFILE(GraphicsUpdate, iyft::ProfilerTag::Graphics);
     
+    updateCameras(delta);
+    performCulling();
+    drawVisible();
+}
+
+void GraphicsSystem::declareJobs(TaskGraph& graph, const EntityStateVector&) {
+    // Moves the camera, updates the Camera components, the frustum and the skybox. Nothing in here uses the graphics
+    // API. Components of the camera Entity react to its transformation changes.
+    JobAccess cameraAccess;
+    cameraAccess.write(Camera::Type).write(MeshComponent::Type).write(LightComponent::Type).writeTransformations().writeSystemData(ComponentBaseType::Graphics);
+    graph.addJob("GraphicsCameraUpdate", [this](float delta) {
+        updateCameras(delta);
+    }, cameraAccess, JobAffinity::AnyThread);
+    
+    // Culling writes the visibleComponents, the culling data of this System and the current LOD of each visible
+    // MeshComponent, which selectLODs() keeps for hysteresis. The lights are copied into the visibleComponents.
+    JobAccess cullingAccess;
+    cullingAccess.write(MeshComponent::Type).read(LightComponent::Type).read(Camera::Type).readTransformations().writeSystemData(ComponentBaseType::Graphics);
+    graph.addJob("GraphicsCulling", [this](float) {
+        performCulling();
+    }, cullingAccess, JobAffinity::AnyThread);
+    
+    // The debug frustum is drawn using the debug renderer of the PhysicsSystem
+    JobAccess drawAccess;
+    drawAccess.read(ComponentBaseType::Graphics).writeSystemData(ComponentBaseType::Graphics).writeSystemData(ComponentBaseType::Physics).readTransformations();
+    graph.addJob("GraphicsDrawRecording", [this](float) {
+        drawVisible();
+    }, drawAccess, JobAffinity::MainThread);
+}
+
+void GraphicsSystem::updateCameras(float delta) {
+    IYFT_PROFILE(GraphicsCameraUpdate, iyft::ProfilerTag::Graphics);
+    
     const InputState* is = manager->getEngine()->getInputState();
     
     Camera& camera = getActiveCamera();
@@ -284,11 +507,15 @@ void GraphicsSystem::update(float delta, const EntityStateVector& entityStates)
     if (skybox != nullptr) {
         skybox->update(delta);
     }
+}
 
-    performCulling();
+void GraphicsSystem::drawVisible() {
+    IYFT_PROFILE(GraphicsDrawVisible, iyft::ProfilerTag::Graphics);
     
     //LOG_D(visibleComponents.opaqueMeshEntityIDs.size() << " " << visibleComponents.transparentMeshEntityIDs.size());
     
+    const glm::uvec2 renderSurfaceSize = renderer->getRenderSurfaceSize();
+    
     PhysicsSystem* physicsSystem = dynamic_cast<PhysicsSystem*>(manager->getSystemManagingComponentType(ComponentBaseType::Physics));
     if (manager->isEditorMode() && drawFrustum && physicsSystem != nullptr && physicsSystem->isDrawingDebug()) {
         Camera& tempCamera = getComponent<Camera>(drawnFrustumID);
@@ -0,0 +1,112 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/InstanceBatcher.hpp"
+
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+namespace iyf {
+static constexpr std::uint32_t NoBatch = std::numeric_limits<std::uint32_t>::max();
+
+std::size_t InstanceBatcher::GeometryHash::operator()(const DrawGeometry& geometry) const {
+    std::uint64_t hash = (std::uint64_t(geometry.vboID) << 56) ^ (std::uint64_t(geometry.iboID) << 48) ^ (std::uint64_t(geometry.indexCount) << 24);
+    hash ^= (std::uint64_t(geometry.firstIndex) * 0x9E3779B97F4A7C15ULL) ^ (std::uint64_t(static_cast<std::uint32_t>(geometry.vertexOffset)) * 0xC2B2AE3D27D4EB4FULL);
+    
+    return static_cast<std::size_t>(hash ^ (hash >> 29));
+}
+
+InstanceBatcher::InstanceBatcher() : lastBatch(NoBatch), finished(false) {}
+
+void InstanceBatcher::clear() {
+    batches.clear();
+    instanceData.clear();
+    pending.clear();
+    currentKeyBatches.clear();
+    
+    currentKey = RenderDataKey();
+    lastBatch = NoBatch;
+    finished = false;
+}
+
+void InstanceBatcher::add(RenderDataKey key, const DrawGeometry& geometry, const glm::mat4& model) {
+    assert(!finished);
+    
+    if (key.getKey() != currentKey.getKey() || batches.empty()) {
+        currentKey = key;
+        currentKeyBatches.clear();
+        lastBatch = NoBatch;
+    }
+    
+    std::uint32_t batchID = lastBatch;
+    if (batchID == NoBatch || batches[batchID].geometry != geometry) {
+        auto result = currentKeyBatches.emplace(geometry, static_cast<std::uint32_t>(batches.size()));
+        batchID = result.first->second;
+        
+        if (result.second) {
+            batches.push_back({key, geometry, 0, 0});
+        }
+        
+        lastBatch = batchID;
+    }
+    
+    batches[batchID].instanceCount++;
+    pending.push_back({batchID, &model});
+}
+
+void InstanceBatcher::finish() {
+    if (finished) {
+        throw std::logic_error("finish() has already been called");
+    }
+    
+    if (pending.size() > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::length_error("Too many instances");
+    }
+    
+    // Counting sort of the instances by batch. The batches are already in draw order, so the offsets are a prefix sum.
+    std::uint32_t offset = 0;
+    for (InstancedDrawBatch& batch : batches) {
+        batch.firstInstance = offset;
+        offset += batch.instanceCount;
+        
+        // Temporarily used as the write cursor of the batch
+        batch.instanceCount = 0;
+    }
+    
+    instanceData.resize(pending.size());
+    
+    for (const PendingInstance& instance : pending) {
+        InstancedDrawBatch& batch = batches[instance.batch];
+        instanceData[batch.firstInstance + batch.instanceCount].model = *instance.model;
+        batch.instanceCount++;
+    }
+    
+    finished = true;
+}
+}
@@ -27,6 +27,7 @@
 // WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "graphics/MeshComponent.hpp"
+#include "graphics/GraphicsSystem.hpp"
 #include "core/EntitySystemManager.hpp"
 #include "core/TransformationComponent.hpp"
 #include "logging/Logger.hpp"
@@ -34,17 +35,31 @@
 namespace iyf {
 void MeshComponent::onTransformationChanged(TransformationComponent* transformation) {
     updateCurrentBounds(transformation->getModelMatrix(), transformation->getScale());
+    
+    if (parent != nullptr) {
+        static_cast<GraphicsSystem*>(parent)->onMeshBoundsChanged(id, currentBounds, transformation->isStatic());
+    }
 }
 
-void MeshComponent::attach(System* system, std::uint32_t id) {
+void MeshComponent::attach(System* system, std::uint32_t ownID) {
     assert(mesh.isValid());
     
+    parent = system;
+    id = ownID;
+    
     TransformationComponent& transformation = system->getManager()->getEntityTransformation(id);
     updateCurrentBounds(transformation.getModelMatrix(), transformation.getScale());
+    
+    static_cast<GraphicsSystem*>(parent)->onMeshBoundsChanged(id, currentBounds, transformation.isStatic());
 }
 
 void MeshComponent::detach(System*, std::uint32_t) {
     mesh = AssetHandle<Mesh>::CreateInvalid();
+    
+    if (parent != nullptr) {
+        static_cast<GraphicsSystem*>(parent)->onMeshRemoved(id);
+        parent = nullptr;
+    }
 }
 }
 
@@ -0,0 +1,316 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/MeshFormats.hpp"
+#include "io/serialization/Serializer.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace iyf::mf::v2 {
+static std::uint64_t AlignUp(std::uint64_t value) {
+    return (value + BlobAlignment - 1) & ~static_cast<std::uint64_t>(BlobAlignment - 1);
+}
+
+static void WritePadding(Serializer& output, std::uint64_t targetPosition) {
+    static const char Zeros[BlobAlignment] = {};
+    
+    const std::int64_t position = output.tell();
+    assert(position >= 0 && static_cast<std::uint64_t>(position) <= targetPosition);
+    
+    output.writeBytes(Zeros, targetPosition - static_cast<std::uint64_t>(position));
+}
+
+void WriteMesh(Serializer& output, const MeshFileContents& contents) {
+    if (contents.submeshes.empty() || contents.submeshes.size() > MaxSubmeshes) {
+        throw std::invalid_argument("Invalid submesh count");
+    }
+    
+    if (contents.bones.size() > MaxBones || contents.animations.size() > MaxAnimations) {
+        throw std::invalid_argument("Too many bones or animations");
+    }
+    
+    if (contents.lods.size() > contents.submeshes.size() * (MaxLODs - 1)) {
+        throw std::invalid_argument("Too many LODs");
+    }
+    
+    const std::uint32_t indexSize = (contents.header.flags & HeaderFlagBits::Indices32Bit) ? 4 : 2;
+    if (contents.indexDataSize % indexSize != 0) {
+        throw std::invalid_argument("The size of the index data is not a multiple of the index size");
+    }
+    
+    std::vector<ChunkEntry> chunks;
+    chunks.push_back({ChunkType::Submeshes, static_cast<std::uint32_t>(contents.submeshes.size()), 0, contents.submeshes.size() * sizeof(SubmeshRecord)});
+    chunks.push_back({ChunkType::Vertices, contents.header.vertexCount, 0, contents.vertexDataSize});
+    chunks.push_back({ChunkType::Indices, static_cast<std::uint32_t>(contents.indexDataSize / indexSize), 0, contents.indexDataSize});
+    
+    if (!contents.bones.empty()) {
+        chunks.push_back({ChunkType::Bones, static_cast<std::uint32_t>(contents.bones.size()), 0, contents.bones.size() * sizeof(BoneRecord)});
+    }
+    
+    if (!contents.animations.empty()) {
+        chunks.push_back({ChunkType::Animations, static_cast<std::uint32_t>(contents.animations.size()), 0, contents.animations.size() * sizeof(std::uint64_t)});
+    }
+    
+    if (!contents.lods.empty()) {
+        chunks.push_back({ChunkType::Lods, static_cast<std::uint32_t>(contents.lods.size()), 0, contents.lods.size() * sizeof(LodRecord)});
+    }
+    
+    std::uint64_t offset = AlignUp(sizeof(Header) + chunks.size() * sizeof(ChunkEntry));
+    for (ChunkEntry& chunk : chunks) {
+        chunk.offset = offset;
+        offset = AlignUp(offset + chunk.size);
+    }
+    
+    const Header& header = contents.header;
+    output.writeBytes(MagicNumber, sizeof(MagicNumber));
+    output.writeUInt16(VersionNumber);
+    output.writeUInt8(header.vertexDataLayout);
+    output.writeUInt8(header.flags);
+    output.writeUInt32(header.vertexCount);
+    output.writeUInt32(chunks[2].elementCount);
+    output.writeUInt8(static_cast<std::uint8_t>(contents.submeshes.size()));
+    output.writeUInt8(static_cast<std::uint8_t>(contents.bones.size()));
+    output.writeUInt8(header.colorChannelCount);
+    output.writeUInt8(static_cast<std::uint8_t>(contents.animations.size()));
+    output.writeUInt32(static_cast<std::uint32_t>(chunks.size()));
+    
+    for (float f : header.aabbMinimum) {
+        output.writeFloat(f);
+    }
+    
+    for (float f : header.aabbMaximum) {
+        output.writeFloat(f);
+    }
+    
+    for (float f : header.boundingSphere) {
+        output.writeFloat(f);
+    }
+    
+    for (const ChunkEntry& chunk : chunks) {
+        output.writeUInt32(static_cast<std::uint32_t>(chunk.type));
+        output.writeUInt32(chunk.elementCount);
+        output.writeUInt64(chunk.offset);
+        output.writeUInt64(chunk.size);
+    }
+    
+    for (const ChunkEntry& chunk : chunks) {
+        WritePadding(output, chunk.offset);
+        
+        switch (chunk.type) {
+        case ChunkType::Submeshes:
+            for (const SubmeshRecord& submesh : contents.submeshes) {
+                output.writeUInt32(submesh.vertexOffset);
+                output.writeUInt32(submesh.vertexCount);
+                output.writeUInt32(submesh.indexOffset);
+                output.writeUInt32(submesh.indexCount);
+            }
+            break;
+        case ChunkType::Vertices:
+            output.writeBytes(contents.vertexData, contents.vertexDataSize);
+            break;
+        case ChunkType::Indices:
+            output.writeBytes(contents.indexData, contents.indexDataSize);
+            break;
+        case ChunkType::Bones:
+            for (const BoneRecord& bone : contents.bones) {
+                for (float f : bone.transform) {
+                    output.writeFloat(f);
+                }
+                
+                output.writeUInt8(bone.parent);
+                output.writeUInt8(0);
+                output.writeUInt8(0);
+                output.writeUInt8(0);
+            }
+            break;
+        case ChunkType::Animations:
+            for (std::uint64_t animation : contents.animations) {
+                output.writeUInt64(animation);
+            }
+            break;
+        case ChunkType::Lods:
+            for (const LodRecord& lod : contents.lods) {
+                output.writeUInt32(lod.indexOffset);
+                output.writeUInt32(lod.indexCount);
+                output.writeFloat(lod.error);
+                output.writeUInt8(lod.submesh);
+                output.writeUInt8(lod.level);
+                output.writeUInt8(0);
+                output.writeUInt8(0);
+            }
+            break;
+        case ChunkType::COUNT:
+            throw std::logic_error("COUNT is not a valid ChunkType");
+        }
+    }
+}
+
+bool ParseMesh(const char* data, std::size_t size, MeshFileView& view) {
+    if (data == nullptr || size < sizeof(Header)) {
+        return false;
+    }
+    
+    Header& header = view.header;
+    std::memcpy(&header, data, sizeof(Header));
+    
+    if (std::memcmp(header.magicNumber, MagicNumber, sizeof(MagicNumber)) != 0 || header.versionNumber != VersionNumber) {
+        return false;
+    }
+    
+    if (header.submeshCount == 0 || header.submeshCount > MaxSubmeshes || header.animationCount > MaxAnimations ||
+        header.chunkCount > static_cast<std::uint32_t>(ChunkType::COUNT)) {
+        return false;
+    }
+    
+    if (sizeof(Header) + header.chunkCount * sizeof(ChunkEntry) > size) {
+        return false;
+    }
+    
+    const std::uint64_t indexSize = (header.flags & HeaderFlagBits::Indices32Bit) ? 4 : 2;
+    const std::uint64_t expectedSizes[] = {
+        header.submeshCount * sizeof(SubmeshRecord),
+        0, // Depends on the vertex layout, which the loader validates
+        header.indexCount * indexSize,
+        header.boneCount * sizeof(BoneRecord),
+        header.animationCount * sizeof(std::uint64_t),
+        0, // Stored in the chunk entry
+    };
+    static_assert(sizeof(expectedSizes) / sizeof(expectedSizes[0]) == static_cast<std::size_t>(ChunkType::COUNT), "Update the size table");
+    
+    const char* chunks[static_cast<std::size_t>(ChunkType::COUNT)] = {};
+    
+    for (std::uint32_t i = 0; i < header.chunkCount; ++i) {
+        ChunkEntry chunk;
+        std::memcpy(&chunk, data + sizeof(Header) + i * sizeof(ChunkEntry), sizeof(ChunkEntry));
+        
+        const std::size_t type = static_cast<std::size_t>(chunk.type);
+        if (type >= static_cast<std::size_t>(ChunkType::COUNT) || chunks[type] != nullptr) {
+            return false;
+        }
+        
+        if (chunk.offset % BlobAlignment != 0 || chunk.offset > size || chunk.size > size - chunk.offset) {
+            return false;
+        }
+        
+        if (chunk.type == ChunkType::Lods) {
+            if (chunk.elementCount > header.submeshCount * (MaxLODs - 1) || chunk.size != chunk.elementCount * sizeof(LodRecord)) {
+                return false;
+            }
+            
+            view.lodCount = chunk.elementCount;
+        } else if (chunk.type != ChunkType::Vertices && chunk.size != expectedSizes[type]) {
+            return false;
+        }
+        
+        chunks[type] = data + chunk.offset;
+        
+        if (chunk.type == ChunkType::Vertices) {
+            view.vertexDataSize = chunk.size;
+        } else if (chunk.type == ChunkType::Indices) {
+            view.indexDataSize = chunk.size;
+        }
+    }
+    
+    view.submeshes = chunks[static_cast<std::size_t>(ChunkType::Submeshes)];
+    view.vertexData = chunks[static_cast<std::size_t>(ChunkType::Vertices)];
+    view.indexData = chunks[static_cast<std::size_t>(ChunkType::Indices)];
+    view.bones = chunks[static_cast<std::size_t>(ChunkType::Bones)];
+    view.animations = chunks[static_cast<std::size_t>(ChunkType::Animations)];
+    view.lods = chunks[static_cast<std::size_t>(ChunkType::Lods)];
+    
+    if (view.submeshes == nullptr || view.vertexData == nullptr || view.indexData == nullptr ||
+        (header.boneCount > 0 && view.bones == nullptr) || (header.animationCount > 0 && view.animations == nullptr)) {
+        return false;
+    }
+    
+    for (std::size_t i = 0; i < header.submeshCount; ++i) {
+        const SubmeshRecord submesh = view.getSubmesh(i);
+        
+        if (std::uint64_t(submesh.vertexOffset) + submesh.vertexCount > header.vertexCount ||
+            std::uint64_t(submesh.indexOffset) + submesh.indexCount > header.indexCount) {
+            return false;
+        }
+    }
+    
+    // Levels must be stored in order and point into the index data
+    for (std::size_t i = 0; i < view.lodCount; ++i) {
+        const LodRecord lod = view.getLod(i);
+        
+        if (lod.submesh >= header.submeshCount || lod.level == 0 || lod.level >= MaxLODs || std::uint64_t(lod.indexOffset) + lod.indexCount > header.indexCount) {
+            return false;
+        }
+        
+        if (lod.level > 1) {
+            if (i == 0) {
+                return false;
+            }
+            
+            const LodRecord previous = view.getLod(i - 1);
+            if (previous.submesh != lod.submesh || previous.level + 1 != lod.level) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+SubmeshRecord MeshFileView::getSubmesh(std::size_t id) const {
+    assert(id < header.submeshCount);
+    
+    SubmeshRecord submesh;
+    std::memcpy(&submesh, submeshes + id * sizeof(SubmeshRecord), sizeof(SubmeshRecord));
+    return submesh;
+}
+
+BoneRecord MeshFileView::getBone(std::size_t id) const {
+    assert(id < header.boneCount);
+    
+    BoneRecord bone;
+    std::memcpy(&bone, bones + id * sizeof(BoneRecord), sizeof(BoneRecord));
+    return bone;
+}
+
+std::uint64_t MeshFileView::getAnimation(std::size_t id) const {
+    assert(id < header.animationCount);
+    
+    std::uint64_t animation;
+    std::memcpy(&animation, animations + id * sizeof(std::uint64_t), sizeof(std::uint64_t));
+    return animation;
+}
+
+LodRecord MeshFileView::getLod(std::size_t id) const {
+    assert(id < lodCount);
+    
+    LodRecord lod;
+    std::memcpy(&lod, lods + id * sizeof(LodRecord), sizeof(LodRecord));
+    return lod;
+}
+}
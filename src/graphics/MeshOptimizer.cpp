@@ -0,0 +1,433 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace iyf {
+static constexpr std::uint32_t InvalidIndex = std::numeric_limits<std::uint32_t>::max();
+
+/// Vertex to triangle adjacency in a compressed form
+struct TriangleAdjacency {
+    TriangleAdjacency(const std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount)
+        : counts(vertexCount, 0), offsets(vertexCount + 1, 0), triangles(indexCount) {
+        for (std::size_t i = 0; i < indexCount; ++i) {
+            assert(indices[i] < vertexCount);
+            counts[indices[i]]++;
+        }
+        
+        for (std::size_t v = 0; v < vertexCount; ++v) {
+            offsets[v + 1] = offsets[v] + counts[v];
+        }
+        
+        std::vector<std::uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < indexCount; ++i) {
+            triangles[cursors[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+        }
+    }
+    
+    std::vector<std::uint32_t> counts;
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> triangles;
+};
+
+/// A FIFO cache that stores the time when each vertex entered it
+class FIFOCacheSimulator {
+public:
+    FIFOCacheSimulator(std::size_t vertexCount, std::uint32_t cacheSize) : timestamps(vertexCount, 0), time(cacheSize + 1), cacheSize(cacheSize) {}
+    
+    /// \return true if the vertex had to be transformed
+    inline bool access(std::uint32_t vertex) {
+        if (time - timestamps[vertex] > cacheSize) {
+            timestamps[vertex] = time++;
+            return true;
+        }
+        
+        return false;
+    }
+    
+    inline void flush() {
+        time += cacheSize + 1;
+    }
+private:
+    std::vector<std::uint64_t> timestamps;
+    std::uint64_t time;
+    std::uint32_t cacheSize;
+};
+
+VertexCacheStatistics AnalyzeVertexCache(const std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount, std::uint32_t cacheSize) {
+    assert(indexCount % 3 == 0);
+    
+    VertexCacheStatistics statistics;
+    if (indexCount == 0) {
+        return statistics;
+    }
+    
+    FIFOCacheSimulator cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+    std::size_t referencedCount = 0;
+    
+    for (std::size_t i = 0; i < indexCount; ++i) {
+        const std::uint32_t vertex = indices[i];
+        assert(vertex < vertexCount);
+        
+        if (cache.access(vertex)) {
+            statistics.vertexTransforms++;
+        }
+        
+        if (!referenced[vertex]) {
+            referenced[vertex] = true;
+            referencedCount++;
+        }
+    }
+    
+    statistics.acmr = static_cast<float>(statistics.vertexTransforms) / static_cast<float>(indexCount / 3);
+    statistics.atvr = static_cast<float>(statistics.vertexTransforms) / static_cast<float>(referencedCount);
+    
+    return statistics;
+}
+
+void OptimizeVertexCache(std::uint32_t* destination, const std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount,
+                         std::uint32_t cacheSize, std::vector<std::uint32_t>* clusters) {
+    assert(indexCount % 3 == 0);
+    assert(destination != indices);
+    
+    if (clusters != nullptr) {
+        clusters->clear();
+    }
+    
+    const TriangleAdjacency adjacency(indices, indexCount, vertexCount);
+    
+    // Number of triangles that use each vertex and haven't been emitted yet
+    std::vector<std::uint32_t> liveTriangles = adjacency.counts;
+    std::vector<bool> emitted(indexCount / 3, false);
+    
+    std::vector<std::uint64_t> cacheTimestamps(vertexCount, 0);
+    std::uint64_t time = cacheSize + 1;
+    
+    std::vector<std::uint32_t> deadEnds;
+    deadEnds.reserve(indexCount);
+    
+    std::vector<std::uint32_t> candidates;
+    candidates.reserve(64);
+    
+    std::size_t cursor = 0;
+    auto nextFromCursor = [&]() {
+        while (cursor < vertexCount && liveTriangles[cursor] == 0) {
+            ++cursor;
+        }
+        
+        return (cursor < vertexCount) ? static_cast<std::uint32_t>(cursor) : InvalidIndex;
+    };
+    
+    std::size_t outputTriangle = 0;
+    std::uint32_t fanningVertex = nextFromCursor();
+    if (fanningVertex != InvalidIndex && clusters != nullptr) {
+        clusters->push_back(0);
+    }
+    
+    while (fanningVertex != InvalidIndex) {
+        candidates.clear();
+        
+        // Emit all remaining triangles around the fanning vertex
+        for (std::uint32_t i = adjacency.offsets[fanningVertex]; i < adjacency.offsets[fanningVertex + 1]; ++i) {
+            const std::uint32_t triangle = adjacency.triangles[i];
+            if (emitted[triangle]) {
+                continue;
+            }
+            
+            for (std::size_t c = 0; c < 3; ++c) {
+                const std::uint32_t vertex = indices[triangle * 3 + c];
+                
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                liveTriangles[vertex]--;
+                
+                if (time - cacheTimestamps[vertex] > cacheSize) {
+                    cacheTimestamps[vertex] = time++;
+                }
+                
+                destination[outputTriangle * 3 + c] = vertex;
+            }
+            
+            emitted[triangle] = true;
+            outputTriangle++;
+        }
+        
+        // Prefer the oldest vertex that will still be in the cache after all of its triangles get emitted
+        std::uint32_t next = InvalidIndex;
+        std::int64_t bestPriority = -1;
+        for (std::uint32_t vertex : candidates) {
+            if (liveTriangles[vertex] == 0) {
+                continue;
+            }
+            
+            std::int64_t priority = 0;
+            const std::int64_t age = static_cast<std::int64_t>(time - cacheTimestamps[vertex]);
+            if (age + 2 * static_cast<std::int64_t>(liveTriangles[vertex]) <= cacheSize) {
+                priority = age;
+            }
+            
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+        
+        // A dead end. Recently used vertices are likely to still be in the cache
+        while (next == InvalidIndex && !deadEnds.empty()) {
+            const std::uint32_t vertex = deadEnds.back();
+            deadEnds.pop_back();
+            
+            if (liveTriangles[vertex] > 0) {
+                next = vertex;
+            }
+        }
+        
+        // Nothing is left in the neighbourhood. The cache is cold here, so this starts a new cluster
+        if (next == InvalidIndex) {
+            next = nextFromCursor();
+            
+            if (next != InvalidIndex && clusters != nullptr) {
+                clusters->push_back(static_cast<std::uint32_t>(outputTriangle));
+            }
+        }
+        
+        fanningVertex = next;
+    }
+    
+    assert(outputTriangle == indexCount / 3);
+}
+
+/// Splits each cluster wherever the ACMR of the triangles since the previous split is close to the ACMR of the whole cluster
+static std::vector<std::uint32_t> MakeSoftClusters(const std::uint32_t* indices, std::size_t triangleCount, std::size_t vertexCount,
+                                                   const std::vector<std::uint32_t>& clusters, std::uint32_t cacheSize, float threshold) {
+    std::vector<std::uint32_t> result;
+    result.reserve(clusters.size());
+    
+    FIFOCacheSimulator cache(vertexCount, cacheSize);
+    
+    for (std::size_t c = 0; c < clusters.size(); ++c) {
+        const std::size_t start = clusters[c];
+        const std::size_t end = (c + 1 < clusters.size()) ? clusters[c + 1] : triangleCount;
+        
+        std::size_t clusterMisses = 0;
+        cache.flush();
+        for (std::size_t i = start * 3; i < end * 3; ++i) {
+            clusterMisses += cache.access(indices[i]);
+        }
+        
+        const float maxACMR = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+        
+        result.push_back(static_cast<std::uint32_t>(start));
+        
+        std::size_t misses = 0;
+        std::size_t splitStart = start;
+        cache.flush();
+        for (std::size_t t = start; t < end; ++t) {
+            misses += cache.access(indices[t * 3 + 0]);
+            misses += cache.access(indices[t * 3 + 1]);
+            misses += cache.access(indices[t * 3 + 2]);
+            
+            if (t + 1 < end && static_cast<float>(misses) / static_cast<float>(t + 1 - splitStart) <= maxACMR) {
+                result.push_back(static_cast<std::uint32_t>(t + 1));
+                
+                misses = 0;
+                splitStart = t + 1;
+                cache.flush();
+            }
+        }
+    }
+    
+    return result;
+}
+
+std::size_t OptimizeOverdraw(std::uint32_t* destination, const std::uint32_t* indices, std::size_t indexCount, const void* positions,
+                             std::size_t positionStride, std::size_t vertexCount, const std::vector<std::uint32_t>& clusters,
+                             std::uint32_t cacheSize, float threshold) {
+    assert(indexCount % 3 == 0);
+    assert(destination != indices);
+    
+    const std::size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return 0;
+    }
+    
+    const char* positionBytes = static_cast<const char*>(positions);
+    auto position = [positionBytes, positionStride](std::uint32_t vertex, std::size_t component) {
+        float value;
+        std::memcpy(&value, positionBytes + vertex * positionStride + component * sizeof(float), sizeof(float));
+        return value;
+    };
+    
+    const std::vector<std::uint32_t> softClusters = MakeSoftClusters(indices, triangleCount, vertexCount,
+        clusters.empty() ? std::vector<std::uint32_t>{0} : clusters, cacheSize, threshold);
+    
+    double meshCenter[3] = {0.0, 0.0, 0.0};
+    for (std::size_t v = 0; v < vertexCount; ++v) {
+        for (std::size_t c = 0; c < 3; ++c) {
+            meshCenter[c] += position(static_cast<std::uint32_t>(v), c);
+        }
+    }
+    
+    for (std::size_t c = 0; c < 3; ++c) {
+        meshCenter[c] /= static_cast<double>(std::max(vertexCount, std::size_t(1)));
+    }
+    
+    // Clusters that face away from the center of the mesh are likely to occlude the rest of it, so they get drawn first
+    std::vector<float> sortKeys(softClusters.size());
+    for (std::size_t c = 0; c < softClusters.size(); ++c) {
+        const std::size_t start = softClusters[c];
+        const std::size_t end = (c + 1 < softClusters.size()) ? softClusters[c + 1] : triangleCount;
+        
+        double center[3] = {0.0, 0.0, 0.0};
+        double normal[3] = {0.0, 0.0, 0.0};
+        double totalArea = 0.0;
+        
+        for (std::size_t t = start; t < end; ++t) {
+            double p[3][3];
+            for (std::size_t v = 0; v < 3; ++v) {
+                for (std::size_t c2 = 0; c2 < 3; ++c2) {
+                    p[v][c2] = position(indices[t * 3 + v], c2);
+                }
+            }
+            
+            const double e1[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+            const double e2[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+            const double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+            const double area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            
+            for (std::size_t c2 = 0; c2 < 3; ++c2) {
+                center[c2] += area * (p[0][c2] + p[1][c2] + p[2][c2]) / 3.0;
+                normal[c2] += n[c2];
+            }
+            
+            totalArea += area;
+        }
+        
+        const double normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (totalArea <= 0.0 || normalLength <= 0.0) {
+            sortKeys[c] = 0.0f;
+            continue;
+        }
+        
+        double key = 0.0;
+        for (std::size_t c2 = 0; c2 < 3; ++c2) {
+            key += (center[c2] / totalArea - meshCenter[c2]) * normal[c2] / normalLength;
+        }
+        
+        sortKeys[c] = static_cast<float>(key);
+    }
+    
+    std::vector<std::uint32_t> order(softClusters.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sortKeys](std::uint32_t a, std::uint32_t b) {
+        return sortKeys[a] > sortKeys[b];
+    });
+    
+    std::size_t written = 0;
+    for (std::uint32_t c : order) {
+        const std::size_t start = softClusters[c];
+        const std::size_t end = (c + 1 < softClusters.size()) ? softClusters[c + 1] : triangleCount;
+        
+        std::memcpy(destination + written, indices + start * 3, (end - start) * 3 * sizeof(std::uint32_t));
+        written += (end - start) * 3;
+    }
+    
+    assert(written == indexCount);
+    return softClusters.size();
+}
+
+std::size_t OptimizeVertexFetch(void* destination, std::uint32_t* indices, std::size_t indexCount, const void* vertices,
+                                std::size_t vertexCount, std::size_t vertexSize) {
+    assert(destination != vertices);
+    
+    char* output = static_cast<char*>(destination);
+    const char* input = static_cast<const char*>(vertices);
+    
+    std::vector<std::uint32_t> remap(vertexCount, InvalidIndex);
+    std::uint32_t nextVertex = 0;
+    
+    for (std::size_t i = 0; i < indexCount; ++i) {
+        const std::uint32_t vertex = indices[i];
+        assert(vertex < vertexCount);
+        
+        if (remap[vertex] == InvalidIndex) {
+            std::memcpy(output + nextVertex * vertexSize, input + vertex * vertexSize, vertexSize);
+            remap[vertex] = nextVertex++;
+        }
+        
+        indices[i] = remap[vertex];
+    }
+    
+    return nextVertex;
+}
+
+MeshOptimizationReport OptimizeMesh(std::vector<char>& vertices, std::size_t vertexSize, std::vector<std::uint32_t>& indices,
+                                    const MeshOptimizationSettings& settings) {
+    assert(vertexSize >= 3 * sizeof(float));
+    assert(vertices.size() % vertexSize == 0);
+    
+    const std::size_t vertexCount = vertices.size() / vertexSize;
+    
+    MeshOptimizationReport report;
+    report.before = AnalyzeVertexCache(indices.data(), indices.size(), vertexCount, settings.vertexCacheSize);
+    
+    if (settings.optimizeVertexCache) {
+        std::vector<std::uint32_t> clusters;
+        std::vector<std::uint32_t> optimized(indices.size());
+        OptimizeVertexCache(optimized.data(), indices.data(), indices.size(), vertexCount, settings.vertexCacheSize,
+                            settings.optimizeOverdraw ? &clusters : nullptr);
+        
+        if (settings.optimizeOverdraw) {
+            report.clusterCount = OptimizeOverdraw(indices.data(), optimized.data(), optimized.size(), vertices.data(), vertexSize, vertexCount,
+                                                   clusters, settings.vertexCacheSize, settings.overdrawThreshold);
+        } else {
+            indices.swap(optimized);
+        }
+    }
+    
+    if (settings.optimizeVertexFetch) {
+        std::vector<char> optimized(vertices.size());
+        const std::size_t newVertexCount = OptimizeVertexFetch(optimized.data(), indices.data(), indices.size(), vertices.data(), vertexCount, vertexSize);
+        
+        optimized.resize(newVertexCount * vertexSize);
+        vertices.swap(optimized);
+        report.removedVertexCount = vertexCount - newVertexCount;
+    }
+    
+    report.after = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size() / vertexSize, settings.vertexCacheSize);
+    return report;
+}
+}
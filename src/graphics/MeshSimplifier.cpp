@@ -0,0 +1,636 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+namespace iyf {
+namespace {
+struct Vector3 {
+    float x;
+    float y;
+    float z;
+};
+
+inline Vector3 operator-(const Vector3& a, const Vector3& b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+inline Vector3 Cross(const Vector3& a, const Vector3& b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+inline float Dot(const Vector3& a, const Vector3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+/// The symmetric 4x4 matrix of Garland and Heckbert, stored as its 10 unique elements. The weight is the total area of
+/// the triangles that were accumulated into it and turns the sum of squared distances into a mean.
+struct Quadric {
+    Quadric() : a00(0.0), a11(0.0), a22(0.0), a01(0.0), a02(0.0), a12(0.0), b0(0.0), b1(0.0), b2(0.0), c(0.0), weight(0.0) {}
+    
+    /// \param[in] normal Unit length plane normal
+    /// \param[in] distance Plane distance from the origin
+    /// \param[in] planeWeight Multiplies the squared distance to the plane
+    /// \param[in] areaWeight Added to the weight
+    Quadric(const Vector3& normal, float distance, double planeWeight, double areaWeight) {
+        const double x = normal.x;
+        const double y = normal.y;
+        const double z = normal.z;
+        const double d = distance;
+        
+        a00 = planeWeight * x * x;
+        a11 = planeWeight * y * y;
+        a22 = planeWeight * z * z;
+        a01 = planeWeight * x * y;
+        a02 = planeWeight * x * z;
+        a12 = planeWeight * y * z;
+        b0 = planeWeight * x * d;
+        b1 = planeWeight * y * d;
+        b2 = planeWeight * z * d;
+        c = planeWeight * d * d;
+        weight = areaWeight;
+    }
+    
+    inline Quadric& operator+=(const Quadric& other) {
+        a00 += other.a00;
+        a11 += other.a11;
+        a22 += other.a22;
+        a01 += other.a01;
+        a02 += other.a02;
+        a12 += other.a12;
+        b0 += other.b0;
+        b1 += other.b1;
+        b2 += other.b2;
+        c += other.c;
+        weight += other.weight;
+        
+        return *this;
+    }
+    
+    /// \return the mean squared distance from the point to the accumulated planes
+    inline double evaluate(const Vector3& p) const {
+        const double x = p.x;
+        const double y = p.y;
+        const double z = p.z;
+        
+        const double sum = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                           2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        
+        return (weight > 0.0) ? std::abs(sum) / weight : std::abs(sum);
+    }
+    
+    double a00, a11, a22, a01, a02, a12;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+enum class VertexKind : std::uint8_t {
+    /// May collapse into any of its neighbours
+    Manifold,
+    /// On an open border. May only collapse into its neighbours on the same border
+    Border,
+    /// Never moves, but other vertices may collapse into it
+    Locked
+};
+
+/// Relative to the squared length of the border edge, so that borders resist simplification as much as surfaces do
+constexpr double BorderPlaneWeight = 2.0;
+
+/// How much more expensive than the goal of the pass a collapse may be, see SimplifyMesh()
+constexpr double PassCostMultiplier = 1.5;
+
+/// Collapses that rotate a remaining triangle further than ~75 degrees are rejected
+constexpr float FlipThreshold = 0.25f;
+
+struct PositionKey {
+    std::uint32_t x;
+    std::uint32_t y;
+    std::uint32_t z;
+    
+    inline bool operator==(const PositionKey& other) const {
+        return x == other.x && y == other.y && z == other.z;
+    }
+};
+
+struct PositionKeyHash {
+    inline std::size_t operator()(const PositionKey& key) const {
+        // Murmur style mixing of the three bit patterns
+        std::uint64_t h = key.x;
+        h = h * 0x9E3779B97F4A7C15ull ^ key.y;
+        h = h * 0x9E3779B97F4A7C15ull ^ key.z;
+        return static_cast<std::size_t>(h ^ (h >> 29));
+    }
+};
+
+inline std::uint64_t EdgeKey(std::uint32_t from, std::uint32_t to) {
+    return (static_cast<std::uint64_t>(from) << 32) | to;
+}
+
+struct Collapse {
+    std::uint32_t from;
+    std::uint32_t to;
+    double cost;
+};
+
+/// Everything SimplifyMesh() needs to know about the vertices of the mesh. Built once from the original indices.
+class SimplificationState {
+public:
+    SimplificationState(const std::uint32_t* indices, std::size_t indexCount, const void* positionData, std::size_t positionStride, std::size_t vertexCount)
+        : positions(vertexCount), remap(vertexCount), kinds(vertexCount, VertexKind::Manifold), borderNext(vertexCount, InvalidVertex),
+          borderPrevious(vertexCount, InvalidVertex), quadrics(vertexCount) {
+        const char* data = static_cast<const char*>(positionData);
+        for (std::size_t v = 0; v < vertexCount; ++v) {
+            std::memcpy(&positions[v], data + v * positionStride, sizeof(Vector3));
+        }
+        
+        buildPositionRemap();
+        classifyVertices(indices, indexCount);
+        buildQuadrics(indices, indexCount);
+    }
+    
+    static constexpr std::uint32_t InvalidVertex = 0xFFFFFFFF;
+    
+    inline bool canCollapse(std::uint32_t from, std::uint32_t to) const {
+        switch (kinds[from]) {
+        case VertexKind::Manifold:
+            return true;
+        case VertexKind::Border:
+            return remap[to] == borderNext[from] || remap[to] == borderPrevious[from];
+        case VertexKind::Locked:
+            return false;
+        }
+        
+        return false;
+    }
+    
+    inline double collapseCost(std::uint32_t from, std::uint32_t to) const {
+        Quadric q = quadrics[from];
+        q += quadrics[remap[to]];
+        
+        return q.evaluate(positions[to]);
+    }
+    
+    inline void collapse(std::uint32_t from, std::uint32_t to) {
+        assert(remap[from] == from);
+        quadrics[remap[to]] += quadrics[from];
+    }
+    
+    std::vector<Vector3> positions;
+private:
+    /// Vertices with identical positions map to the first one of them
+    void buildPositionRemap() {
+        std::unordered_map<PositionKey, std::uint32_t, PositionKeyHash> unique;
+        unique.reserve(positions.size());
+        
+        std::vector<std::uint32_t> groupSizes(positions.size(), 0);
+        for (std::size_t v = 0; v < positions.size(); ++v) {
+            PositionKey key;
+            std::memcpy(&key, &positions[v], sizeof(PositionKey));
+            
+            const auto result = unique.emplace(key, static_cast<std::uint32_t>(v));
+            remap[v] = result.first->second;
+            groupSizes[remap[v]]++;
+        }
+        
+        // Vertices that share a position with others have different attributes on each side of a seam. Moving one
+        // of them would tear the seam open.
+        for (std::size_t v = 0; v < positions.size(); ++v) {
+            if (groupSizes[remap[v]] > 1) {
+                kinds[v] = VertexKind::Locked;
+            }
+        }
+    }
+    
+    /// Finds the open borders and non-manifold edges. Seams are not borders because the topology is analyzed using
+    /// remapped positions.
+    void classifyVertices(const std::uint32_t* indices, std::size_t indexCount) {
+        std::unordered_map<std::uint64_t, std::uint32_t> edges;
+        edges.reserve(indexCount);
+        
+        for (std::size_t i = 0; i < indexCount; i += 3) {
+            for (std::size_t e = 0; e < 3; ++e) {
+                const std::uint32_t a = remap[indices[i + e]];
+                const std::uint32_t b = remap[indices[i + (e + 1) % 3]];
+                edges[EdgeKey(a, b)]++;
+            }
+        }
+        
+        std::vector<std::uint8_t> outgoing(positions.size(), 0);
+        std::vector<std::uint8_t> incoming(positions.size(), 0);
+        
+        for (const auto& edge : edges) {
+            const std::uint32_t a = static_cast<std::uint32_t>(edge.first >> 32);
+            const std::uint32_t b = static_cast<std::uint32_t>(edge.first & 0xFFFFFFFF);
+            
+            if (a == b) {
+                continue;
+            }
+            
+            // The same directed edge in multiple triangles means that the surface is non-manifold or inconsistently wound
+            if (edge.second > 1) {
+                kinds[a] = VertexKind::Locked;
+                kinds[b] = VertexKind::Locked;
+                continue;
+            }
+            
+            if (edges.find(EdgeKey(b, a)) == edges.end()) {
+                outgoing[a] = static_cast<std::uint8_t>(std::min(outgoing[a] + 1, 2));
+                incoming[b] = static_cast<std::uint8_t>(std::min(incoming[b] + 1, 2));
+                borderNext[a] = b;
+                borderPrevious[b] = a;
+            }
+        }
+        
+        for (std::size_t v = 0; v < positions.size(); ++v) {
+            if (kinds[v] == VertexKind::Locked || (outgoing[v] == 0 && incoming[v] == 0)) {
+                continue;
+            }
+            
+            // Vertices where multiple borders meet can't slide along any of them
+            kinds[v] = (outgoing[v] == 1 && incoming[v] == 1) ? VertexKind::Border : VertexKind::Locked;
+        }
+    }
+    
+    void buildQuadrics(const std::uint32_t* indices, std::size_t indexCount) {
+        for (std::size_t i = 0; i < indexCount; i += 3) {
+            const Vector3& p0 = positions[indices[i + 0]];
+            const Vector3& p1 = positions[indices[i + 1]];
+            const Vector3& p2 = positions[indices[i + 2]];
+            
+            Vector3 normal = Cross(p1 - p0, p2 - p0);
+            const float length = std::sqrt(Dot(normal, normal));
+            if (length == 0.0f) {
+                continue;
+            }
+            
+            normal = {normal.x / length, normal.y / length, normal.z / length};
+            
+            const double area = length * 0.5;
+            const Quadric plane(normal, -Dot(normal, p0), area, area);
+            for (std::size_t e = 0; e < 3; ++e) {
+                quadrics[remap[indices[i + e]]] += plane;
+            }
+            
+            // Planes that are perpendicular to the triangle keep border vertices from drifting away from the border
+            for (std::size_t e = 0; e < 3; ++e) {
+                const std::uint32_t a = remap[indices[i + e]];
+                const std::uint32_t b = remap[indices[i + (e + 1) % 3]];
+                
+                if (borderNext[a] != b) {
+                    continue;
+                }
+                
+                const Vector3 edge = positions[b] - positions[a];
+                const float edgeLengthSquared = Dot(edge, edge);
+                Vector3 edgeNormal = Cross(edge, normal);
+                const float edgeNormalLength = std::sqrt(Dot(edgeNormal, edgeNormal));
+                if (edgeNormalLength == 0.0f) {
+                    continue;
+                }
+                
+                edgeNormal = {edgeNormal.x / edgeNormalLength, edgeNormal.y / edgeNormalLength, edgeNormal.z / edgeNormalLength};
+                
+                const Quadric border(edgeNormal, -Dot(edgeNormal, positions[a]), edgeLengthSquared * BorderPlaneWeight, 0.0);
+                quadrics[a] += border;
+                quadrics[b] += border;
+            }
+        }
+    }
+    
+    std::vector<std::uint32_t> remap;
+    std::vector<VertexKind> kinds;
+    std::vector<std::uint32_t> borderNext;
+    std::vector<std::uint32_t> borderPrevious;
+    std::vector<Quadric> quadrics;
+};
+
+/// Vertex to triangle adjacency of the current index buffer in a compressed form
+struct TriangleAdjacency {
+    void build(const std::vector<std::uint32_t>& indices, std::size_t vertexCount) {
+        offsets.assign(vertexCount + 1, 0);
+        triangles.resize(indices.size());
+        
+        for (std::uint32_t index : indices) {
+            offsets[index + 1]++;
+        }
+        
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        
+        cursors.assign(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < indices.size(); ++i) {
+            triangles[cursors[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+        }
+    }
+    
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> triangles;
+    std::vector<std::uint32_t> cursors;
+};
+
+/// \return true if moving from onto to would turn any of the triangles around from upside down
+bool CollapseFlipsTriangles(const std::vector<Vector3>& positions, const std::vector<std::uint32_t>& indices, const TriangleAdjacency& adjacency,
+                            std::uint32_t from, std::uint32_t to) {
+    const Vector3& target = positions[to];
+    
+    for (std::uint32_t t = adjacency.offsets[from]; t < adjacency.offsets[from + 1]; ++t) {
+        const std::uint32_t* triangle = &indices[adjacency.triangles[t] * 3];
+        
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+            continue;
+        }
+        
+        // Rotate the triangle so that from comes first. This keeps the winding.
+        const std::size_t first = (triangle[0] == from) ? 0 : ((triangle[1] == from) ? 1 : 2);
+        const Vector3& a = positions[triangle[(first + 1) % 3]];
+        const Vector3& b = positions[triangle[(first + 2) % 3]];
+        
+        const Vector3 before = Cross(a - positions[from], b - positions[from]);
+        const Vector3 after = Cross(a - target, b - target);
+        
+        const float beforeLengthSquared = Dot(before, before);
+        const float afterLengthSquared = Dot(after, after);
+        if (afterLengthSquared == 0.0f) {
+            return true;
+        }
+        
+        if (Dot(before, after) < FlipThreshold * std::sqrt(beforeLengthSquared * afterLengthSquared)) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+/// \return false if collapsing the edge would pinch the surface, i.e., if the vertices share neighbours other than
+/// the opposite vertices of the triangles that share the edge. The triangles around to may reference vertices that
+/// already collapsed during this pass, so they get remapped first.
+bool CollapseKeepsTopology(const std::vector<std::uint32_t>& indices, const TriangleAdjacency& adjacency, const std::vector<std::uint32_t>& collapseTargets,
+                           std::uint32_t from, std::uint32_t to, std::vector<std::uint32_t>& fromNeighbours, std::vector<std::uint32_t>& toNeighbours) {
+    fromNeighbours.clear();
+    toNeighbours.clear();
+    
+    std::size_t sharedTriangles = 0;
+    for (std::uint32_t t = adjacency.offsets[from]; t < adjacency.offsets[from + 1]; ++t) {
+        const std::uint32_t* triangle = &indices[adjacency.triangles[t] * 3];
+        
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+            sharedTriangles++;
+        }
+        
+        for (std::size_t e = 0; e < 3; ++e) {
+            if (triangle[e] != from && triangle[e] != to) {
+                fromNeighbours.push_back(triangle[e]);
+            }
+        }
+    }
+    
+    for (std::uint32_t t = adjacency.offsets[to]; t < adjacency.offsets[to + 1]; ++t) {
+        const std::uint32_t* triangle = &indices[adjacency.triangles[t] * 3];
+        
+        for (std::size_t e = 0; e < 3; ++e) {
+            const std::uint32_t vertex = collapseTargets[triangle[e]];
+            if (vertex != from && vertex != to) {
+                toNeighbours.push_back(vertex);
+            }
+        }
+    }
+    
+    std::sort(fromNeighbours.begin(), fromNeighbours.end());
+    fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+    
+    std::sort(toNeighbours.begin(), toNeighbours.end());
+    toNeighbours.erase(std::unique(toNeighbours.begin(), toNeighbours.end()), toNeighbours.end());
+    
+    std::size_t commonNeighbours = 0;
+    auto fromIt = fromNeighbours.begin();
+    auto toIt = toNeighbours.begin();
+    while (fromIt != fromNeighbours.end() && toIt != toNeighbours.end()) {
+        if (*fromIt < *toIt) {
+            ++fromIt;
+        } else if (*toIt < *fromIt) {
+            ++toIt;
+        } else {
+            commonNeighbours++;
+            ++fromIt;
+            ++toIt;
+        }
+    }
+    
+    return sharedTriangles > 0 && sharedTriangles <= 2 && commonNeighbours == sharedTriangles;
+}
+
+void RemoveDegenerateTriangles(std::vector<std::uint32_t>& indices) {
+    std::size_t write = 0;
+    for (std::size_t i = 0; i < indices.size(); i += 3) {
+        const std::uint32_t a = indices[i + 0];
+        const std::uint32_t b = indices[i + 1];
+        const std::uint32_t c = indices[i + 2];
+        
+        if (a != b && b != c && a != c) {
+            indices[write++] = a;
+            indices[write++] = b;
+            indices[write++] = c;
+        }
+    }
+    
+    indices.resize(write);
+}
+}
+
+float SimplifyMesh(std::vector<std::uint32_t>& destination, const std::uint32_t* indices, std::size_t indexCount, const void* positions,
+                   std::size_t positionStride, std::size_t vertexCount, std::size_t targetIndexCount, float targetError) {
+    assert(indexCount % 3 == 0);
+    assert(positionStride >= sizeof(float) * 3);
+    
+    destination.assign(indices, indices + indexCount);
+    RemoveDegenerateTriangles(destination);
+    
+    if (destination.size() <= targetIndexCount) {
+        return 0.0f;
+    }
+    
+    SimplificationState state(destination.data(), destination.size(), positions, positionStride, vertexCount);
+    
+    const double maxCost = static_cast<double>(targetError) * static_cast<double>(targetError);
+    double resultCost = 0.0;
+    
+    std::vector<Collapse> candidates;
+    TriangleAdjacency adjacency;
+    std::vector<std::uint32_t> collapseTargets(vertexCount);
+    std::vector<bool> lockedThisPass(vertexCount);
+    std::vector<std::uint32_t> fromNeighbours;
+    std::vector<std::uint32_t> toNeighbours;
+    
+    bool limitReached = false;
+    while (!limitReached && destination.size() > targetIndexCount) {
+        candidates.clear();
+        
+        for (std::size_t i = 0; i < destination.size(); i += 3) {
+            for (std::size_t e = 0; e < 3; ++e) {
+                const std::uint32_t a = destination[i + e];
+                const std::uint32_t b = destination[i + (e + 1) % 3];
+                
+                // Only the cheaper direction of each edge is worth considering
+                const bool forward = state.canCollapse(a, b);
+                const bool backward = state.canCollapse(b, a);
+                
+                if (forward && backward) {
+                    const double forwardCost = state.collapseCost(a, b);
+                    const double backwardCost = state.collapseCost(b, a);
+                    
+                    if (forwardCost <= backwardCost) {
+                        candidates.push_back({a, b, forwardCost});
+                    } else {
+                        candidates.push_back({b, a, backwardCost});
+                    }
+                } else if (forward) {
+                    candidates.push_back({a, b, state.collapseCost(a, b)});
+                } else if (backward) {
+                    candidates.push_back({b, a, state.collapseCost(b, a)});
+                }
+            }
+        }
+        
+        if (candidates.empty()) {
+            break;
+        }
+        
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) {
+            return a.cost < b.cost;
+        });
+        
+        adjacency.build(destination, vertexCount);
+        std::iota(collapseTargets.begin(), collapseTargets.end(), 0);
+        std::fill(lockedThisPass.begin(), lockedThisPass.end(), false);
+        
+        std::size_t triangleCount = destination.size() / 3;
+        const std::size_t targetTriangleCount = targetIndexCount / 3;
+        std::size_t collapseCount = 0;
+        
+        // Most collapses remove two triangles. Collapses that are much more expensive than the ones that would be
+        // enough to reach the target are left for the next pass, which may find cheaper ones around the vertices that
+        // get locked during this one.
+        const std::size_t goal = std::min((triangleCount - targetTriangleCount) / 2, candidates.size() - 1);
+        const double passCost = std::min(candidates[goal].cost * PassCostMultiplier, maxCost);
+        
+        for (const Collapse& collapse : candidates) {
+            if (collapse.cost > maxCost || (collapse.cost > passCost && collapseCount > 0)) {
+                break;
+            }
+            
+            if (triangleCount <= targetTriangleCount) {
+                limitReached = true;
+                break;
+            }
+            
+            // Only the vertices that are not adjacent to any other collapse of this pass are still in their original
+            // positions, so the flip checks are only correct for them.
+            if (lockedThisPass[collapse.from]) {
+                continue;
+            }
+            
+            assert(collapseTargets[collapse.to] == collapse.to);
+            
+            if (!CollapseKeepsTopology(destination, adjacency, collapseTargets, collapse.from, collapse.to, fromNeighbours, toNeighbours) ||
+                CollapseFlipsTriangles(state.positions, destination, adjacency, collapse.from, collapse.to)) {
+                continue;
+            }
+            
+            for (std::uint32_t t = adjacency.offsets[collapse.from]; t < adjacency.offsets[collapse.from + 1]; ++t) {
+                const std::uint32_t* triangle = &destination[adjacency.triangles[t] * 3];
+                
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                    triangleCount--;
+                }
+                
+                lockedThisPass[triangle[0]] = true;
+                lockedThisPass[triangle[1]] = true;
+                lockedThisPass[triangle[2]] = true;
+            }
+            
+            state.collapse(collapse.from, collapse.to);
+            collapseTargets[collapse.from] = collapse.to;
+            resultCost = std::max(resultCost, collapse.cost);
+            collapseCount++;
+        }
+        
+        if (collapseCount == 0) {
+            break;
+        }
+        
+        for (std::uint32_t& index : destination) {
+            index = collapseTargets[index];
+        }
+        
+        RemoveDegenerateTriangles(destination);
+    }
+    
+    return static_cast<float>(std::sqrt(resultCost));
+}
+
+std::vector<GeneratedLOD> GenerateLODs(const std::uint32_t* indices, std::size_t indexCount, const void* positions, std::size_t positionStride,
+                                       std::size_t vertexCount, float radius, const LODGenerationSettings& settings) {
+    std::vector<GeneratedLOD> lods;
+    if (!settings.generateLODs || indexCount == 0 || radius <= 0.0f) {
+        return lods;
+    }
+    
+    assert(settings.reductionFactor > 0.0f && settings.reductionFactor < 1.0f);
+    
+    std::size_t previousIndexCount = indexCount;
+    float previousError = 0.0f;
+    
+    for (std::uint8_t l = 0; l < settings.lodCount; ++l) {
+        const std::size_t targetIndexCount = static_cast<std::size_t>(previousIndexCount / 3 * settings.reductionFactor) * 3;
+        
+        GeneratedLOD lod;
+        const float error = SimplifyMesh(lod.indices, indices, indexCount, positions, positionStride, vertexCount, targetIndexCount, settings.maxError * radius);
+        
+        // A level that barely differs from the previous one would only waste memory
+        if (lod.indices.empty() || lod.indices.size() > previousIndexCount * 3 / 4) {
+            break;
+        }
+        
+        lod.error = std::max(error / radius, previousError);
+        
+        previousIndexCount = lod.indices.size();
+        previousError = lod.error;
+        lods.push_back(std::move(lod));
+    }
+    
+    return lods;
+}
+}
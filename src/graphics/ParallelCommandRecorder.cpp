@@ -0,0 +1,150 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/ParallelCommandRecorder.hpp"
+#include "threading/ParallelFor.hpp"
+#include "threading/ThreadProfiler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#include "fmt/format.h"
+
+namespace iyf {
+ParallelCommandRecorder::ParallelCommandRecorder() {}
+
+ParallelCommandRecorder::~ParallelCommandRecorder() {
+    assert(!isInitialized());
+}
+
+void ParallelCommandRecorder::initialize(std::vector<CommandPool*> commandPools, std::size_t swapImageCount, const std::string& name) {
+    if (isInitialized()) {
+        throw std::logic_error("The ParallelCommandRecorder has already been initialized");
+    }
+    
+    if (commandPools.empty() || swapImageCount == 0) {
+        throw std::invalid_argument("At least one CommandPool and one swap image are required");
+    }
+    
+    pools = std::move(commandPools);
+    buffers.resize(pools.size() * swapImageCount);
+    
+    for (std::size_t swapImage = 0; swapImage < swapImageCount; ++swapImage) {
+        for (std::size_t slot = 0; slot < pools.size(); ++slot) {
+            const std::string bufferName = fmt::format("{} secondary buffer. Slot: {}. Swap: {}.", name, slot, swapImage);
+            buffers[swapImage * pools.size() + slot] = pools[slot]->allocateCommandBuffer(bufferName.c_str(), BufferLevel::Secondary, false);
+        }
+    }
+}
+
+void ParallelCommandRecorder::dispose() {
+    if (!isInitialized()) {
+        return;
+    }
+    
+    const std::size_t swapImageCount = buffers.size() / pools.size();
+    for (std::size_t swapImage = 0; swapImage < swapImageCount; ++swapImage) {
+        for (std::size_t slot = 0; slot < pools.size(); ++slot) {
+            pools[slot]->freeCommandBuffer(buffers[swapImage * pools.size() + slot]);
+        }
+    }
+    
+    buffers.clear();
+    recordedBuffers.clear();
+    pools.clear();
+}
+
+bool ParallelCommandRecorder::shouldRecordInParallel(std::size_t itemCount, const iyft::ThreadPool* threadPool) const {
+    if (!isInitialized() || threadPool == nullptr || pools.size() < 2) {
+        return false;
+    }
+    
+    return iyft::GetParallelForThreadCount(threadPool) > 1 && itemCount >= MinChunkSize * 2;
+}
+
+std::size_t ParallelCommandRecorder::record(std::size_t itemCount, std::size_t swapImage, const CommandBufferInheritanceInfo& inheritance, iyft::ThreadPool* threadPool, const RecordFunction& function) {
+    IYFT_PROFILE(ParallelCommandRecording, iyft::ProfilerTag::Graphics);
+    
+    assert(isInitialized());
+    assert(swapImage < buffers.size() / pools.size());
+    
+    recordedBuffers.clear();
+    
+    if (itemCount == 0) {
+        return 0;
+    }
+    
+    // Items are split into contiguous ranges, one per slot. Since each slot records into its own buffer from its own
+    // pool, no locking is needed and executing the buffers in slot order preserves the order of the items.
+    const std::size_t maxChunkCount = std::max(std::size_t(1), itemCount / MinChunkSize);
+    const std::size_t chunkCount = std::min({pools.size(), iyft::GetParallelForThreadCount(threadPool), maxChunkCount});
+    
+    CommandBuffer* const* swapImageBuffers = &buffers[swapImage * pools.size()];
+    recordedBuffers.assign(swapImageBuffers, swapImageBuffers + chunkCount);
+    
+    CommandBufferBeginInfo cbbi;
+    cbbi.flags = CommandBufferUsageFlagBits::OneTimeSubmit | CommandBufferUsageFlagBits::RenderPassContinue;
+    cbbi.inheritanceInfo = inheritance;
+    
+    // A buffer that threw is still ended, so that it can be reset and begun again next frame
+    auto work = [&cbbi, &function, swapImageBuffers, itemCount, chunkCount](std::size_t chunk) {
+        const std::size_t first = (itemCount * chunk) / chunkCount;
+        const std::size_t last = (itemCount * (chunk + 1)) / chunkCount;
+        
+        CommandBuffer* buffer = swapImageBuffers[chunk];
+        buffer->begin(cbbi);
+        
+        try {
+            function(buffer, first, last);
+        } catch (...) {
+            buffer->end();
+            throw;
+        }
+        
+        buffer->end();
+    };
+    
+    try {
+        iyft::ParallelFor(threadPool, chunkCount, work);
+    } catch (...) {
+        recordedBuffers.clear();
+        throw;
+    }
+    
+    return chunkCount;
+}
+
+void ParallelCommandRecorder::executeRecorded(CommandBuffer* primary) const {
+    if (recordedBuffers.empty()) {
+        return;
+    }
+    
+    primary->executeCommands(static_cast<std::uint32_t>(recordedBuffers.size()), recordedBuffers.data());
+}
+}
@@ -0,0 +1,116 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/PipelineCacheStore.hpp"
+#include "io/ChecksummedFile.hpp"
+#include "io/serialization/MemorySerializer.hpp"
+#include "utilities/hashing/Hashing.hpp"
+#include "logging/Logger.hpp"
+
+#include <cstring>
+
+namespace iyf {
+/// Magic, version, padding, vendor ID, device ID, driver version, cache UUID and data size
+static constexpr std::size_t HeaderSize = 4 + 2 + 2 + 4 + 4 + 4 + 16 + 8;
+
+static void WriteIdentity(MemorySerializer& serializer, const PipelineCacheIdentity& identity) {
+    serializer.writeUInt32(identity.vendorID);
+    serializer.writeUInt32(identity.deviceID);
+    serializer.writeUInt32(identity.driverVersion);
+    serializer.writeBytes(identity.cacheUUID.data(), identity.cacheUUID.size());
+}
+
+std::string PipelineCacheStore::MakeFileName(const PipelineCacheIdentity& identity) {
+    MemorySerializer data(32);
+    WriteIdentity(data, identity);
+    
+    return fmt::format("pipelineCache-{:016x}.bin", HF(data.data(), data.size()).value());
+}
+
+bool PipelineCacheStore::Load(const FileSystem& filesystem, const Path& path, const PipelineCacheIdentity& identity, std::vector<std::uint8_t>& data) {
+    data.clear();
+    
+    const FileView contents = ReadChecksummedFile(filesystem, path, HeaderSize, "pipeline cache");
+    if (contents.empty()) {
+        return false;
+    }
+    
+    const std::size_t dataSize = contents.size();
+    MemorySerializer serializer(contents.data(), dataSize);
+    
+    const std::uint32_t magic = serializer.readUInt32();
+    const std::uint16_t version = serializer.readUInt16();
+    serializer.readUInt16();
+    
+    PipelineCacheIdentity storedIdentity;
+    storedIdentity.vendorID = serializer.readUInt32();
+    storedIdentity.deviceID = serializer.readUInt32();
+    storedIdentity.driverVersion = serializer.readUInt32();
+    serializer.readBytes(storedIdentity.cacheUUID.data(), storedIdentity.cacheUUID.size());
+    
+    const std::uint64_t byteCount = serializer.readUInt64();
+    
+    if (magic != Magic || version != Version) {
+        LOG_V("Ignoring an outdated pipeline cache {}", path);
+        return false;
+    }
+    
+    if (storedIdentity != identity) {
+        LOG_V("Ignoring a pipeline cache {} that was created by a different device or driver", path);
+        return false;
+    }
+    
+    if (byteCount != dataSize - HeaderSize) {
+        LOG_W("Ignoring a pipeline cache {} with an invalid data size", path);
+        return false;
+    }
+    
+    data.resize(byteCount);
+    std::memcpy(data.data(), contents.data() + HeaderSize, byteCount);
+    
+    return true;
+}
+
+bool PipelineCacheStore::Save(const FileSystem& filesystem, const Path& path, const PipelineCacheIdentity& identity, const void* data, std::size_t byteCount) {
+    MemorySerializer serializer(HeaderSize + byteCount + ChecksumSize);
+    serializer.writeUInt32(Magic);
+    serializer.writeUInt16(Version);
+    serializer.writeUInt16(0);
+    WriteIdentity(serializer, identity);
+    serializer.writeUInt64(byteCount);
+    serializer.writeBytes(data, byteCount);
+    
+    if (!WriteChecksummedFile(filesystem, path, Path(path.getGenericString() + ".tmp"), serializer, "pipeline cache")) {
+        return false;
+    }
+    
+    LOG_V("Wrote {} bytes of pipeline cache data to {}", byteCount, path);
+    return true;
+}
+
+}
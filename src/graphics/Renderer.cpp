@@ -27,6 +27,7 @@
 // WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "graphics/Renderer.hpp"
+#include "graphics/AsyncPipelineCompiler.hpp"
 #include "core/Engine.hpp"
 #include "ImGuiImplementation.hpp"
 
@@ -32,6 +32,7 @@
 #include "graphics/RendererConstants.hpp"
 #include "graphics/VertexDataLayouts.hpp"
 
+#include <cstring>
 #include <stdexcept>
 #include <functional>
 #include <type_traits>
@@ -164,6 +165,29 @@ ShaderMacroWithValue::ShaderMacroWithValue(const char* nameString, std::size_t l
     newName[length] = '\0';
     
     name = newName;
+    nameLength = length;
+}
+
+ShaderMacroWithValue::ShaderMacroWithValue(const ShaderMacroWithValue& other) : macro(other.macro), name(other.name), nameLength(other.nameLength), value(other.value) {
+    if (macro == ShaderMacro::Custom) {
+        char* newName = new char[nameLength + 1];
+        std::memcpy(newName, other.name, nameLength + 1);
+        
+        name = newName;
+    }
+}
+
+ShaderMacroWithValue& ShaderMacroWithValue::operator=(const ShaderMacroWithValue& other) {
+    if (this != &other) {
+        ShaderMacroWithValue copy(other);
+        
+        std::swap(macro, copy.macro);
+        std::swap(name, copy.name);
+        std::swap(nameLength, copy.nameLength);
+        std::swap(value, copy.value);
+    }
+    
+    return *this;
 }
 
 ShaderMacroWithValue::~ShaderMacroWithValue() {
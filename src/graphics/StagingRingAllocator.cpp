@@ -0,0 +1,139 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/StagingRingAllocator.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace iyf {
+inline static std::uint64_t AlignUp(std::uint64_t value, std::uint64_t alignment) {
+    return ((value + alignment - 1) / alignment) * alignment;
+}
+
+StagingRingAllocator::StagingRingAllocator(std::uint64_t capacity)
+    : capacity(capacity), head(0), tail(0), used(0), submittedSize(0) {}
+
+void StagingRingAllocator::reset(std::uint64_t newCapacity) {
+    if (used != 0 || !submissions.empty()) {
+        throw std::logic_error("The memory of a StagingRingAllocator must be reclaimed before it can be reset");
+    }
+    
+    capacity = newCapacity;
+    head = 0;
+    tail = 0;
+}
+
+bool StagingRingAllocator::findOffset(std::uint64_t size, std::uint64_t alignment, std::uint64_t& offset, std::uint64_t& padding) const {
+    if (size == 0 || alignment == 0) {
+        throw std::invalid_argument("The size and the alignment of an allocation must be greater than 0");
+    }
+    
+    // An empty ring starts over, which keeps large allocations from failing just because the free space is split
+    const std::uint64_t start = (used == 0) ? 0 : head;
+    const std::uint64_t end = (used == 0) ? 0 : tail;
+    
+    if (used == capacity && capacity != 0) {
+        return false;
+    }
+    
+    const std::uint64_t aligned = AlignUp(start, alignment);
+    
+    if (start >= end) {
+        // The free space is [start, capacity) followed by [0, end)
+        if (aligned <= capacity && size <= capacity - aligned) {
+            offset = aligned;
+            padding = aligned - start;
+            return true;
+        }
+        
+        // Offset 0 is always aligned
+        if (size <= end) {
+            offset = 0;
+            padding = capacity - start;
+            return true;
+        }
+        
+        return false;
+    }
+    
+    // The free space is [start, end)
+    if (aligned <= end && size <= end - aligned) {
+        offset = aligned;
+        padding = aligned - start;
+        return true;
+    }
+    
+    return false;
+}
+
+bool StagingRingAllocator::canAllocate(std::uint64_t size, std::uint64_t alignment) const {
+    std::uint64_t offset;
+    std::uint64_t padding;
+    return findOffset(size, alignment, offset, padding);
+}
+
+std::uint64_t StagingRingAllocator::allocate(std::uint64_t size, std::uint64_t alignment) {
+    std::uint64_t offset;
+    std::uint64_t padding;
+    if (!findOffset(size, alignment, offset, padding)) {
+        return InvalidOffset;
+    }
+    
+    if (used == 0) {
+        head = 0;
+        tail = 0;
+    }
+    
+    used += padding + size;
+    head = offset + size;
+    
+    assert(used <= capacity);
+    return offset;
+}
+
+void StagingRingAllocator::submit(std::uint64_t fenceID) {
+    submissions.push_back({fenceID, head, used - submittedSize});
+    submittedSize = used;
+}
+
+void StagingRingAllocator::releaseOldest() {
+    const Submission& submission = submissions.front();
+    
+    used -= submission.size;
+    submittedSize -= submission.size;
+    
+    // Empty submissions don't own any memory. The ring may have started over since they were made, so they must not
+    // move the tail.
+    if (submission.size != 0) {
+        tail = submission.end;
+    }
+    
+    submissions.pop_front();
+}
+}
@@ -28,8 +28,11 @@
 
 #include "graphics/clusteredRenderers/ClusteredRenderer.hpp"
 #include "graphics/clusteredRenderers/ClusteredRendererConstants.hpp"
+#include "graphics/AsyncPipelineCompiler.hpp"
 #include "graphics/VertexDataLayouts.hpp"
+#include "graphics/ShaderConstants.hpp"
 #include "graphics/Camera.hpp"
+#include "graphics/Lights.hpp"
 #include "graphics/CameraAndLightBufferLayout.hpp"
 #include "graphics/TransformationBufferLayout.hpp"
 #include "graphics/materials/MaterialBufferLayout.hpp"
@@ -46,13 +49,22 @@
 
 #include "physics/PhysicsSystem.hpp"
 
+#include "threading/ThreadPool.hpp"
 #include "threading/ThreadProfiler.hpp"
 
 #include "utilities/DataSizes.hpp"
 
+#include <glm/gtc/constants.hpp>
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+
 // TODO remove this
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <iostream>
+#include <iterator>
 
 //#define IYF_LOG_PICKING
 
@@ -157,6 +169,13 @@ struct PushBuffer {
     glm::mat4 M;
 };
 
+struct InstancedPushBuffer {
+    glm::mat4 VP;
+};
+
+/// The initial capacity of each per frame instance buffer. It grows as needed.
+static const std::size_t InitialInstanceCapacity = 16384;
+
 struct AdjustmentPushBuffer {
     float exposure;
     glm::vec3 padding;
@@ -167,18 +186,10 @@ struct PickerPushBuffer {
     std::uint32_t objectID;
 };
 
-struct Cluster {
-    std::uint32_t offset;
-    std::uint32_t lightCount;
-};
-
-struct ClusterData {
-    glm::vec4 gridParameters;
-    Cluster clusters[MaxClusters];
-    std::uint32_t lightIDs[MaxLightIDs];
-};
+/// Where the light clusters end if the camera uses an infinite far plane
+static const float InfiniteFarClusteringDistance = 1000.0f;
 
-ClusteredRenderer::ClusteredRenderer(Engine* engine, GraphicsAPI* gfx) : Renderer(engine, gfx), vsSimple(AssetHandle<Shader>::CreateInvalid()), fsSimpleFlat(AssetHandle<Shader>::CreateInvalid()), fullScreenQuad(AssetHandle<Mesh>::CreateInvalid()) {
+ClusteredRenderer::ClusteredRenderer(Engine* engine, GraphicsAPI* gfx) : Renderer(engine, gfx), vsSimple(AssetHandle<Shader>::CreateInvalid()), fsSimpleFlat(AssetHandle<Shader>::CreateInvalid()), vsInstanced(AssetHandle<Shader>::CreateInvalid()), fullScreenQuad(AssetHandle<Mesh>::CreateInvalid()), recordingOpaqueInParallel(false), opaqueBatchesReady(false) {
 //     pickingEnabled = false;
 }
 
@@ -194,6 +205,194 @@ CommandBuffer* ClusteredRenderer::getCommandBuffer(CommandBufferID id) const {
     return commandBuffers[bufferID];
 }
 
+CommandBuffer* ClusteredRenderer::getMainSubpassCommandBuffer() const {
+    if (recordingOpaqueInParallel) {
+        return mainSubpassBuffers[gfx->getCurrentSwapImage()];
+    }
+    
+    return getCommandBuffer(CommandBufferID::World);
+}
+
+void ClusteredRenderer::initializeParallelRecording() {
+    iyft::ThreadPool* workerPool = engine->getFrameWorkerPool();
+    
+    if (gfx->doesBackendSupportMultithreading() != MultithreadingSupport::Full || !gfx->exposesMultipleCommandBuffers() ||
+        workerPool == nullptr || workerPool->getWorkerCount() == 0) {
+        LOG_V("Opaque meshes will be recorded on a single thread");
+        return;
+    }
+    
+    const std::size_t slotCount = workerPool->getWorkerCount() + 1;
+    const std::size_t swapImageCount = gfx->getSwapImageCount();
+    
+    recordingPools.reserve(slotCount);
+    for (std::size_t i = 0; i < slotCount; ++i) {
+        const std::string name = fmt::format("Clustered renderer recording pool {}", i);
+        recordingPools.push_back(gfx->createCommandPool(QueueType::Graphics, 0, name.c_str()));
+    }
+    
+    opaqueRecorder.initialize(recordingPools, swapImageCount, "Clustered renderer opaque");
+    
+    std::vector<std::string> names;
+    std::vector<const char*> charNames;
+    names.reserve(swapImageCount);
+    charNames.reserve(swapImageCount);
+    
+    for (std::size_t i = 0; i < swapImageCount; ++i) {
+        names.emplace_back(fmt::format("Clustered renderer main subpass secondary buffer. Swap: {}.", i));
+        charNames.emplace_back(names[i].c_str());
+    }
+    
+    mainSubpassBuffers = commandPool->allocateCommandBuffers(&charNames, swapImageCount, BufferLevel::Secondary, false);
+    
+    LOG_V("Opaque meshes will be recorded on up to {} threads", slotCount);
+}
+
+void ClusteredRenderer::initializeInstancing() {
+    AssetManager* manager = engine->getAssetManager();
+    vsInstanced = manager->getSystemAsset<Shader>("instancedVertex.vert");
+    
+    PipelineLayoutCreateInfo plci{worldDescriptorSetLayouts, {{ShaderStageFlagBits::Vertex, 0, sizeof(InstancedPushBuffer)}}};
+    instancedPipelineLayout = gfx->createPipelineLayout(plci, "Clustered renderer instanced pipeline layout");
+    
+    PipelineCreateInfo pci;
+    pci.shaders = {{ShaderStageFlagBits::Vertex, vsInstanced->handle}, {ShaderStageFlagBits::Fragment, fsSimpleFlat->handle}};
+    pci.layout = instancedPipelineLayout;
+    pci.rasterizationState.frontFace = FrontFace::Clockwise;
+    pci.depthStencilState.depthCompareOp = CompareOp::Greater;
+    pci.inputAssemblyState.topology = PrimitiveTopology::TriangleList;
+    pci.renderPass = mainRenderPass;
+    pci.dynamicState.dynamicStates = {DynamicState::Viewport, DynamicState::Scissor};
+    
+    // Per vertex data comes from binding 0 and the model matrix of each instance from binding 1. A matrix attribute
+    // takes up 4 consecutive locations.
+    pci.vertexInputState = con::GetVertexDataLayoutDefinition(VertexDataLayout::MeshVertex).createVertexInputStateCreateInfo(0);
+    const std::uint32_t firstInstanceLocation = static_cast<std::uint32_t>(pci.vertexInputState.vertexAttributeDescriptions.size());
+    
+    pci.vertexInputState.vertexBindingDescriptions.emplace_back(1, static_cast<std::uint32_t>(sizeof(InstanceData)), VertexInputRate::Instance);
+    for (std::uint32_t column = 0; column < 4; ++column) {
+        pci.vertexInputState.vertexAttributeDescriptions.emplace_back(firstInstanceLocation + column, 1, Format::R32_G32_B32_A32_sFloat,
+                                                                      static_cast<std::uint32_t>(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+    }
+    
+    instancedPipeline = gfx->createPipeline(pci, "Clustered renderer instanced pipeline");
+    
+    const std::size_t swapImageCount = gfx->getSwapImageCount();
+    instanceBuffers.reserve(swapImageCount);
+    
+    for (std::size_t i = 0; i < swapImageCount; ++i) {
+        BufferCreateInfo bci(BufferUsageFlagBits::VertexBuffer | BufferUsageFlagBits::TransferDestination,
+                             Bytes(InitialInstanceCapacity * sizeof(InstanceData)),
+                             MemoryUsage::CPUToGPU,
+                             true);
+        
+        const std::string name = fmt::format("Clustered renderer instance buffer. Swap: {}.", i);
+        instanceBuffers.push_back(gfx->createBuffer(bci, name.c_str()));
+    }
+}
+
+void ClusteredRenderer::disposeInstancing() {
+    for (const Buffer& buffer : instanceBuffers) {
+        gfx->destroyBuffer(buffer);
+    }
+    instanceBuffers.clear();
+    
+    gfx->destroyPipeline(instancedPipeline);
+    gfx->destroyPipelineLayout(instancedPipelineLayout);
+    vsInstanced.release();
+}
+
+void ClusteredRenderer::initializeLightClustering() {
+    clusterData = std::make_unique<ClusterData>();
+    
+    const std::size_t swapImageCount = gfx->getSwapImageCount();
+    clusterDataBuffers.reserve(swapImageCount);
+    
+    for (std::size_t i = 0; i < swapImageCount; ++i) {
+        BufferCreateInfo bci(BufferUsageFlagBits::StorageBuffer | BufferUsageFlagBits::TransferDestination,
+                             Bytes(sizeof(ClusterData)),
+                             MemoryUsage::CPUToGPU,
+                             true);
+        
+        const std::string name = fmt::format("Clustered renderer cluster data buffer. Swap: {}.", i);
+        clusterDataBuffers.push_back(gfx->createBuffer(bci, name.c_str()));
+    }
+    
+    DescriptorSetLayoutBinding perFrameDataBinding;
+    perFrameDataBinding.binding = 0;
+    perFrameDataBinding.descriptorType = DescriptorType::StorageBuffer;
+    perFrameDataBinding.descriptorCount = 1;
+    perFrameDataBinding.stageFlags = ShaderStageFlagBits::Vertex | ShaderStageFlagBits::Fragment;
+    
+    DescriptorSetLayoutCreateInfo dslciPerFrameData;
+    dslciPerFrameData.bindings.push_back(std::move(perFrameDataBinding));
+    perFrameDataSetLayout = gfx->createDescriptorSetLayout(dslciPerFrameData, "Clustered renderer per frame data descriptor set layout");
+    
+    // The sets below con::RendererDataBuffer only need compatible layouts. The renderer never binds them.
+    assert(con::RendererDataBuffer.binding == 0);
+    worldDescriptorSetLayouts.assign(con::RendererDataBuffer.set + 1, perFrameDataSetLayout);
+    
+    DescriptorPoolCreateInfo dpciClusterData;
+    dpciClusterData.maxSets = static_cast<std::uint32_t>(swapImageCount);
+    dpciClusterData.poolSizes.push_back({DescriptorType::StorageBuffer, static_cast<std::uint32_t>(swapImageCount)});
+    clusterDataDescriptorPool = gfx->createDescriptorPool(dpciClusterData, "Clustered renderer cluster data descriptor pool");
+    
+    DescriptorSetAllocateInfo dsaiClusterData;
+    dsaiClusterData.descriptorPool = clusterDataDescriptorPool;
+    dsaiClusterData.setLayouts.assign(swapImageCount, perFrameDataSetLayout);
+    clusterDataDescriptorSets = gfx->allocateDescriptorSets(dsaiClusterData);
+    
+    std::vector<WriteDescriptorSet> writes;
+    writes.reserve(swapImageCount);
+    
+    for (std::size_t i = 0; i < swapImageCount; ++i) {
+        DescriptorBufferInfo bufferInfo;
+        bufferInfo.buffer = clusterDataBuffers[i].handle();
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(ClusterData);
+        
+        WriteDescriptorSet wds;
+        wds.dstBinding = con::RendererDataBuffer.binding;
+        wds.dstArrayElement = 0;
+        wds.descriptorCount = 1;
+        wds.descriptorType = DescriptorType::StorageBuffer;
+        wds.dstSet = clusterDataDescriptorSets[i];
+        wds.bufferInfos.push_back(std::move(bufferInfo));
+        
+        writes.push_back(std::move(wds));
+    }
+    
+    gfx->updateDescriptorSets(writes);
+}
+
+void ClusteredRenderer::disposeLightClustering() {
+    // Destroying the pool frees the sets
+    gfx->destroyDescriptorPool(clusterDataDescriptorPool);
+    clusterDataDescriptorSets.clear();
+    
+    worldDescriptorSetLayouts.clear();
+    gfx->destroyDescriptorSetLayout(perFrameDataSetLayout);
+    
+    for (const Buffer& buffer : clusterDataBuffers) {
+        gfx->destroyBuffer(buffer);
+    }
+    clusterDataBuffers.clear();
+    
+    clusterData = nullptr;
+}
+
+void ClusteredRenderer::disposeParallelRecording() {
+    opaqueRecorder.dispose();
+    
+    for (CommandPool* pool : recordingPools) {
+        gfx->destroyCommandPool(pool);
+    }
+    recordingPools.clear();
+    
+    commandPool->freeCommandBuffers(mainSubpassBuffers);
+    mainSubpassBuffers.clear();
+}
+
 void ClusteredRenderer::initializeRenderPasses() {
     RenderPassCreateInfo rpci;
     rpci.attachments.reserve(3);
@@ -552,6 +751,7 @@ void ClusteredRenderer::initialize() {
     }
     
     commandBuffers = commandPool->allocateCommandBuffers(&charNames, totalBufferCount);
+    initializeParallelRecording();
     worldRenderComplete = gfx->createSemaphore("Clustered renderer world render complete semaphore");
     
     charNames.clear();
@@ -576,8 +776,11 @@ void ClusteredRenderer::initialize() {
     initializeTonemappingAndAdjustmentPipeline();
     initializePickingPipeline();
     
+    // The world pipelines below need the descriptor set layouts
+    initializeLightClustering();
+    
     // TODO remove -------------------------------------------------------------------------------------------------------
-    iyf::PipelineLayoutCreateInfo plci{{}, {{iyf::ShaderStageFlagBits::Vertex, 0, sizeof(PushBuffer)}}};
+    iyf::PipelineLayoutCreateInfo plci{worldDescriptorSetLayouts, {{iyf::ShaderStageFlagBits::Vertex, 0, sizeof(PushBuffer)}}};
     pipelineLayout = gfx->createPipelineLayout(plci, "Clustered renderer simple flat pipeline layout");
     
     iyf::ShaderStageFlags ssf = iyf::ShaderStageFlagBits::Vertex | iyf::ShaderStageFlagBits::Fragment;
@@ -603,10 +806,18 @@ void ClusteredRenderer::initialize() {
     simpleFlatPipeline = gfx->createPipeline(pci, "Clustered renderer simple flat pipeline");
     // TODO remove END -----------------------------------------------------------------------------------------------------
     
+    initializeInstancing();
+    
+    pipelineCompiler = std::make_unique<AsyncPipelineCompiler>(gfx, engine->getLongTermWorkerPool());
+    
     initialized = true;
     LOG_V("Finished initializing the renderer")
 }
 
+const Pipeline& ClusteredRenderer::getDefaultPipeline() const {
+    return simpleFlatPipeline;
+}
+
 std::pair<RenderPassHnd, std::uint32_t> ClusteredRenderer::getImGuiRenderPassAndSubPass() {
     return {mainRenderPass, 1};
 }
@@ -649,11 +860,22 @@ void ClusteredRenderer::destroyPickingPipeline() {
 }
 
 void ClusteredRenderer::dispose() {
+    // Must happen first. Pipelines that are still being created may depend on resources that are destroyed below.
+    pipelineCompiler->dispose();
+    pipelineCompiler = nullptr;
+    
+    disposeInstancing();
+    
     gfx->destroyPipeline(simpleFlatPipeline);
     vsSimple.release();
     fsSimpleFlat.release();
     gfx->destroyPipelineLayout(pipelineLayout);
     
+    // Must happen after the world pipeline layouts that use its descriptor set layout are gone
+    disposeLightClustering();
+    
+    disposeParallelRecording();
+    
     commandPool->freeCommandBuffers(commandBuffers);
     commandBuffers.clear();
     
@@ -721,7 +943,40 @@ void ClusteredRenderer::drawWorld(const World* world) {
     rpbi.clearValues.push_back(ClearColorValue(0.0f, 0.0f, 0.0f, 1.0f));
     rpbi.clearValues.push_back(ClearColorValue(std::numeric_limits<std::uint32_t>::max(), 0, 0, 0, true));
 
-    worldBuffer->beginRenderPass(rpbi);
+    opaqueBatchesReady = prepareOpaqueBatches(graphicsSystem);
+    
+    const GraphicsSystem::VisibleComponents& visibleComponents = graphicsSystem->getVisibleComponents();
+    updateLightClusters(camera, visibleComponents.pointLights, visibleComponents.spotLights);
+    
+    // Recording many draws in parallel is only possible if the main subpass consists solely of secondary buffers
+    const std::size_t opaqueCount = opaqueBatchesReady ? opaqueBatcher.getBatches().size() : visibleComponents.opaqueMeshEntityIDs.size();
+    recordingOpaqueInParallel = opaqueRecorder.shouldRecordInParallel(opaqueCount, engine->getFrameWorkerPool());
+    
+    worldBuffer->beginRenderPass(rpbi, recordingOpaqueInParallel ? SubpassContents::SecondaryCommandBuffers : SubpassContents::Inline);
+    
+    CommandBuffer* mainSubpassBuffer = getMainSubpassCommandBuffer();
+    if (recordingOpaqueInParallel) {
+        CommandBufferBeginInfo cbbi;
+        cbbi.flags = CommandBufferUsageFlagBits::OneTimeSubmit | CommandBufferUsageFlagBits::RenderPassContinue;
+        cbbi.inheritanceInfo.renderPass = mainRenderPass;
+        cbbi.inheritanceInfo.subpass = 0;
+        cbbi.inheritanceInfo.framebuffer = mainFramebuffers[gfx->getCurrentSwapImage()].handle;
+        
+        mainSubpassBuffer->begin(cbbi);
+        
+        // Dynamic state isn't inherited from the primary buffer
+        const glm::uvec2 size = getRenderSurfaceSize();
+        
+        Viewport vp;
+        vp.width = size.x;
+        vp.height = size.y;
+        mainSubpassBuffer->setViewport(0, vp);
+        
+        Rect2D sc;
+        sc.offset = glm::ivec2(0, 0);
+        sc.extent = size;
+        mainSubpassBuffer->setScissor(0, sc);
+    }
     
     //LOG_D(availableComponents.size() << " " << manager->getEntityCount() << " " << visibleTransparentEntityIDs.size() << " " << visibleOpaqueEntityIDs.size());
     drawVisibleOpaque(graphicsSystem);
@@ -734,6 +989,15 @@ void ClusteredRenderer::drawWorld(const World* world) {
     }
     
     drawSky(world);
+    
+    if (recordingOpaqueInParallel) {
+        mainSubpassBuffer->end();
+        
+        opaqueRecorder.executeRecorded(worldBuffer);
+        worldBuffer->executeCommands(1, &mainSubpassBuffer);
+        
+        recordingOpaqueInParallel = false;
+    }
     // beginPostProcess
     
     worldBuffer->nextSubpass();
@@ -870,7 +1134,7 @@ void ClusteredRenderer::drawIDBuffer(const GraphicsSystem* graphicsSystem) {
             
             worldBuffer->pushConstants(pipelineLayout, ShaderStageFlagBits::Vertex, 0, sizeof(PushBuffer), &pushBuffer);
             
-            const PrimitiveData& primitiveData = mesh->getMeshPrimitiveData();
+            const PrimitiveData primitiveData = mesh->getLODPrimitiveData(vc.lod);
             worldBuffer->drawIndexed(primitiveData.indexCount, 1, primitiveData.indexOffset, primitiveData.vertexOffset, 0);
         } else {
             throw std::runtime_error("TODO IMPLEMENT ME");
@@ -886,16 +1150,246 @@ void ClusteredRenderer::drawVisibleOpaque(const GraphicsSystem* graphicsSystem)
     //visibleOpaqueEntityIDs, manager->getEntityTransformations(), components;
     
     const GraphicsSystem::VisibleComponents& visibleComponents = graphicsSystem->getVisibleComponents();
+    const std::size_t count = opaqueBatchesReady ? opaqueBatcher.getBatches().size() : visibleComponents.opaqueMeshEntityIDs.size();
     
-    if (visibleComponents.opaqueMeshEntityIDs.size() == 0) {
+    if (count == 0) {
         return;
     }
     
+    auto recordFunction = [this, graphicsSystem](CommandBuffer* buffer, std::size_t first, std::size_t last) {
+        if (opaqueBatchesReady) {
+            recordOpaqueBatches(buffer, graphicsSystem, first, last);
+        } else {
+            recordOpaqueRange(buffer, graphicsSystem, first, last);
+        }
+    };
+    
+    if (recordingOpaqueInParallel) {
+        CommandBufferInheritanceInfo inheritance;
+        inheritance.renderPass = mainRenderPass;
+        inheritance.subpass = 0;
+        inheritance.framebuffer = mainFramebuffers[gfx->getCurrentSwapImage()].handle;
+        
+        opaqueRecorder.record(count, gfx->getCurrentSwapImage(), inheritance, engine->getFrameWorkerPool(), recordFunction);
+    } else {
+        recordFunction(getCommandBuffer(CommandBufferID::World), 0, count);
+    }
+}
+
+bool ClusteredRenderer::prepareOpaqueBatches(const GraphicsSystem* graphicsSystem) {
+    IYFT_PROFILE(PrepareOpaqueBatches, iyft::ProfilerTag::Graphics);
+    
+    opaqueBatcher.clear();
+    
+    const GraphicsSystem::VisibleComponents& visibleComponents = graphicsSystem->getVisibleComponents();
+    if (visibleComponents.opaqueMeshEntityIDs.empty() || instanceBuffers.empty()) {
+        return false;
+    }
+    
+    const ChunkedMeshVector& components = graphicsSystem->getMeshComponents();
+    const TransformationVector& transformations = graphicsSystem->getManager()->getEntityTransformations();
+    
+    for (const auto& vc : visibleComponents.opaqueMeshEntityIDs) {
+        const MeshComponent& c = static_cast<const MeshComponent&>(components.get(vc.componentID));
+        const AssetHandle<Mesh>& mesh = c.getMesh();
+        
+        if (mesh->submeshCount != 1) {
+            throw std::runtime_error("TODO IMPLEMENT ME");
+        }
+        
+        // Different detail levels of the same mesh use different index ranges and end up in separate batches
+        const PrimitiveData primitiveData = mesh->getLODPrimitiveData(vc.lod);
+        
+        DrawGeometry geometry;
+        geometry.vboID = mesh->vboID;
+        geometry.iboID = mesh->iboID;
+        geometry.indexCount = primitiveData.indexCount;
+        geometry.firstIndex = primitiveData.indexOffset;
+        geometry.vertexOffset = static_cast<std::int32_t>(primitiveData.vertexOffset);
+        
+        opaqueBatcher.add(vc.key, geometry, transformations[vc.componentID].getModelMatrix());
+    }
+    
+    opaqueBatcher.finish();
+    
+    const std::vector<InstanceData>& instanceData = opaqueBatcher.getInstanceData();
+    const Bytes requiredSize(instanceData.size() * sizeof(InstanceData));
+    
+    // The GPU is done with the buffer of this swap image, so it can be replaced safely
+    Buffer& instanceBuffer = instanceBuffers[gfx->getCurrentSwapImage()];
+    if (instanceBuffer.size() < requiredSize) {
+        const Bytes newSize(std::max(requiredSize.count(), instanceBuffer.size().count() * 2));
+        
+        BufferCreateInfo bci(BufferUsageFlagBits::VertexBuffer | BufferUsageFlagBits::TransferDestination, newSize, MemoryUsage::CPUToGPU, true);
+        const std::string name = fmt::format("Clustered renderer instance buffer. Swap: {}.", gfx->getCurrentSwapImage());
+        
+        gfx->destroyBuffer(instanceBuffer);
+        instanceBuffer = gfx->createBuffer(bci, name.c_str());
+    }
+    
+    DeviceMemoryManager* memoryManager = gfx->getDeviceMemoryManager();
+    const std::vector<BufferCopy> bufferCopies = {{0, 0, requiredSize.count()}};
+    
+    if (memoryManager->isStagingBufferNeeded(instanceBuffer) && !memoryManager->canBatchFitData(MemoryBatch::PerFrameData, memoryManager->computeUploadSize(bufferCopies))) {
+        LOG_W("The instance data of {} meshes won't fit into the per frame staging buffer. Drawing them one by one.", instanceData.size());
+        return false;
+    }
+    
+    memoryManager->updateBuffer(MemoryBatch::PerFrameData, instanceBuffer, bufferCopies, instanceData.data());
+    
+    return true;
+}
+
+bool ClusteredRenderer::updateLightClusters(const Camera& camera, const std::vector<PointLight>& pointLights, const std::vector<SpotLight>& spotLights) {
+    IYFT_PROFILE(UpdateLightClusters, iyft::ProfilerTag::Graphics);
+    
+    // The depth slices of the clusters assume a reverse Z projection
+    if (camera.getMode() == Camera::Mode::Standard) {
+        disableLightClusters();
+        return false;
+    }
+    
+    const float farDistance = (camera.getMode() == Camera::Mode::ReverseZInfiniteFar) ? InfiniteFarClusteringDistance : camera.getFarDistance();
+    lightClusterer.setProjection(camera.getVerticalFOV(), camera.getAspectRatio(), camera.getNearDistance(), farDistance);
+    
+    const glm::mat4 view = camera.getViewMatrix();
+    
+    clusterPointLights.resize(pointLights.size());
+    for (std::size_t i = 0; i < pointLights.size(); ++i) {
+        const PointLight& light = pointLights[i];
+        const glm::vec4 position = view * glm::vec4(light.position, 1.0f);
+        
+        clusterPointLights.set(i, position.x, position.y, position.z, light.radius);
+    }
+    
+    // The bounding sphere of a narrow cone is much smaller than the sphere of its range. The angle is the half angle
+    // of the cone in degrees. Nothing guarantees that the direction is a unit vector and an unnormalized one would
+    // move the sphere away from the cone.
+    clusterSpotLights.resize(spotLights.size());
+    for (std::size_t i = 0; i < spotLights.size(); ++i) {
+        const SpotLight& light = spotLights[i];
+        const glm::vec3 direction = glm::normalize(light.direction);
+        const float angle = glm::radians(std::min(light.angle, 90.0f));
+        const float cosAngle = std::cos(angle);
+        
+        glm::vec3 center;
+        float radius;
+        if (angle > glm::quarter_pi<float>()) {
+            center = light.position + direction * (light.radius * cosAngle);
+            radius = light.radius * std::sin(angle);
+        } else {
+            radius = light.radius / (2.0f * cosAngle);
+            center = light.position + direction * radius;
+        }
+        
+        const glm::vec4 position = view * glm::vec4(center, 1.0f);
+        clusterSpotLights.set(i, position.x, position.y, position.z, radius);
+    }
+    
+    lightClusterer.cluster(clusterPointLights, clusterSpotLights, engine->getFrameWorkerPool());
+    
+    if (lightClusterer.hasOverflowed()) {
+        LOG_W("The light clusters ran out of space. Some lights were dropped from them.");
+    }
+    
+    const glm::uvec2 surfaceSize = camera.getRenderSurfaceSize();
+    lightClusterer.writeClusterData(*clusterData, static_cast<float>(surfaceSize.x), static_cast<float>(surfaceSize.y));
+    
+    // The light IDs follow the header, so only the part that's in use needs to be uploaded
+    DeviceMemoryManager* memoryManager = gfx->getDeviceMemoryManager();
+    const std::size_t uploadSize = ClusterDataHeaderSize + lightClusterer.getLightIDCount() * sizeof(std::uint32_t);
+    const std::vector<BufferCopy> bufferCopies = {{0, 0, uploadSize}};
+    
+    Buffer& clusterDataBuffer = clusterDataBuffers[gfx->getCurrentSwapImage()];
+    if (memoryManager->isStagingBufferNeeded(clusterDataBuffer) && !memoryManager->canBatchFitData(MemoryBatch::PerFrameData, memoryManager->computeUploadSize(bufferCopies))) {
+        LOG_W("The light clusters won't fit into the per frame staging buffer. Looping over every light instead.");
+        disableLightClusters();
+        return false;
+    }
+    
+    memoryManager->updateBuffer(MemoryBatch::PerFrameData, clusterDataBuffer, bufferCopies, clusterData.get());
+    return true;
+}
+
+void ClusteredRenderer::disableLightClusters() {
+    std::fill(std::begin(clusterData->gridParameters), std::end(clusterData->gridParameters), 0.0f);
+    
+    DeviceMemoryManager* memoryManager = gfx->getDeviceMemoryManager();
+    const std::vector<BufferCopy> bufferCopies = {{0, 0, sizeof(clusterData->gridParameters)}};
+    
+    Buffer& clusterDataBuffer = clusterDataBuffers[gfx->getCurrentSwapImage()];
+    if (memoryManager->isStagingBufferNeeded(clusterDataBuffer) && !memoryManager->canBatchFitData(MemoryBatch::PerFrameData, memoryManager->computeUploadSize(bufferCopies))) {
+        LOG_W("The per frame staging buffer is full. The shaders will use the light clusters of an older frame.");
+        return;
+    }
+    
+    memoryManager->updateBuffer(MemoryBatch::PerFrameData, clusterDataBuffer, bufferCopies, clusterData.get());
+}
+
+void ClusteredRenderer::bindClusterData(CommandBuffer* buffer, PipelineLayoutHnd layout) const {
+    const DescriptorSetHnd& descriptorSet = clusterDataDescriptorSets[gfx->getCurrentSwapImage()];
+    buffer->bindDescriptorSets(PipelineBindPoint::Graphics, layout, con::RendererDataBuffer.set, 1, &descriptorSet, 0, nullptr);
+}
+
+void ClusteredRenderer::recordOpaqueBatches(CommandBuffer* buffer, const GraphicsSystem* graphicsSystem, std::size_t first, std::size_t last) const {
+    const std::vector<InstancedDrawBatch>& batches = opaqueBatcher.getBatches();
+    assert(first < last && last <= batches.size());
+    
+    const MeshTypeManager* meshManager = dynamic_cast<const MeshTypeManager*>(engine->getAssetManager()->getTypeManager(AssetType::Mesh));
+    
+    std::uint8_t previousVBO = batches[first].geometry.vboID;
+    std::uint8_t previousIBO = batches[first].geometry.iboID;
+    
+    buffer->bindVertexBuffer(0, meshManager->getVertexBuffer(previousVBO));
+    buffer->bindVertexBuffer(1, instanceBuffers[gfx->getCurrentSwapImage()]);
+    buffer->bindIndexBuffer(meshManager->getIndexBuffer(previousIBO), IndexType::UInt16);
+    buffer->bindPipeline(instancedPipeline);
+    bindClusterData(buffer, instancedPipelineLayout);
+    
+    const glm::uvec2 size = getRenderSurfaceSize();
+    
+    Viewport vp;
+    vp.width = size.x;
+    vp.height = size.y;
+    buffer->setViewport(0, vp);
+    
+    Rect2D sc;
+    sc.offset = glm::ivec2(0, 0);
+    sc.extent = size;
+    buffer->setScissor(0, sc);
+    
+    const Camera& camera = graphicsSystem->getActiveCamera();
+    
+    InstancedPushBuffer pushBuffer;
+    pushBuffer.VP = camera.getProjection() * camera.getViewMatrix();
+    buffer->pushConstants(instancedPipelineLayout, ShaderStageFlagBits::Vertex, 0, sizeof(InstancedPushBuffer), &pushBuffer);
+    
+    for (std::size_t i = first; i < last; ++i) {
+        const InstancedDrawBatch& batch = batches[i];
+        const DrawGeometry& geometry = batch.geometry;
+        
+        if (previousVBO != geometry.vboID) {
+            previousVBO = geometry.vboID;
+            buffer->bindVertexBuffer(0, meshManager->getVertexBuffer(previousVBO));
+        }
+        
+        if (previousIBO != geometry.iboID) {
+            previousIBO = geometry.iboID;
+            buffer->bindIndexBuffer(meshManager->getIndexBuffer(previousIBO), IndexType::UInt16);
+        }
+        
+        buffer->drawIndexed(geometry.indexCount, batch.instanceCount, geometry.firstIndex, geometry.vertexOffset, batch.firstInstance);
+    }
+}
+
+void ClusteredRenderer::recordOpaqueRange(CommandBuffer* buffer, const GraphicsSystem* graphicsSystem, std::size_t first, std::size_t last) const {
+    const GraphicsSystem::VisibleComponents& visibleComponents = graphicsSystem->getVisibleComponents();
+    assert(first < last && last <= visibleComponents.opaqueMeshEntityIDs.size());
+    
     const MeshTypeManager* meshManager = dynamic_cast<const MeshTypeManager*>(engine->getAssetManager()->getTypeManager(AssetType::Mesh));
-    CommandBuffer* worldBuffer = getCommandBuffer(CommandBufferID::World);
     
     const ChunkedMeshVector& components = graphicsSystem->getMeshComponents();
-    const MeshComponent& firstComponent = static_cast<const MeshComponent&>(components.get(visibleComponents.opaqueMeshEntityIDs[0].componentID));
+    const MeshComponent& firstComponent = static_cast<const MeshComponent&>(components.get(visibleComponents.opaqueMeshEntityIDs[first].componentID));
     const AssetHandle<Mesh>& firstMesh = firstComponent.getMesh();
     
     assert(firstMesh.isValid());
@@ -906,26 +1400,31 @@ void ClusteredRenderer::drawVisibleOpaque(const GraphicsSystem* graphicsSystem)
     Buffer ibo = meshManager->getIndexBuffer(previousIBO);
     Buffer vbo = meshManager->getVertexBuffer(previousVBO);
     
-    worldBuffer->bindVertexBuffer(0, vbo);
-    worldBuffer->bindIndexBuffer(ibo, IndexType::UInt16);
+    buffer->bindVertexBuffer(0, vbo);
+    buffer->bindIndexBuffer(ibo, IndexType::UInt16);
     
     const glm::uvec2 size = getRenderSurfaceSize();
     
     const Camera& camera = graphicsSystem->getActiveCamera();
     glm::mat4 VP = camera.getProjection() * camera.getViewMatrix();
-    worldBuffer->bindPipeline(simpleFlatPipeline);
+    buffer->bindPipeline(simpleFlatPipeline);
+    bindClusterData(buffer, pipelineLayout);
     
     Viewport vp;
     vp.width = size.x;
     vp.height = size.y;
-    worldBuffer->setViewport(0, vp);
+    buffer->setViewport(0, vp);
     
     Rect2D sc;
     sc.offset = glm::ivec2(0, 0);
     sc.extent = size;
-    worldBuffer->setScissor(0, sc);
+    buffer->setScissor(0, sc);
     
-    for (const auto& vc : visibleComponents.opaqueMeshEntityIDs) {
+    const EntitySystemManager* manager = graphicsSystem->getManager();
+    const TransformationVector& transformations = manager->getEntityTransformations();
+    
+    for (std::size_t i = first; i < last; ++i) {
+        const auto& vc = visibleComponents.opaqueMeshEntityIDs[i];
         const MeshComponent& c = static_cast<const MeshComponent&>(components.get(vc.componentID));
         const AssetHandle<Mesh>& mesh = c.getMesh();
         
@@ -933,33 +1432,26 @@ void ClusteredRenderer::drawVisibleOpaque(const GraphicsSystem* graphicsSystem)
             previousVBO = mesh->vboID;
             vbo = meshManager->getVertexBuffer(previousVBO);
             
-            worldBuffer->bindVertexBuffer(0, vbo);
+            buffer->bindVertexBuffer(0, vbo);
         }
         
         if (previousIBO != mesh->iboID) {
             previousIBO = mesh->iboID;
             ibo = meshManager->getIndexBuffer(previousIBO);
             
-            worldBuffer->bindIndexBuffer(ibo, IndexType::UInt16);
+            buffer->bindIndexBuffer(ibo, IndexType::UInt16);
         }
         
-        const EntitySystemManager* manager = graphicsSystem->getManager();
-        const TransformationVector& transformations = manager->getEntityTransformations();
-        
-        const TransformationComponent transform = transformations[vc.componentID];
+        const TransformationComponent& transform = transformations[vc.componentID];
         if (mesh->submeshCount == 1) {
             PushBuffer pushBuffer;
             pushBuffer.MVP = VP * transform.getModelMatrix();
             pushBuffer.M = transform.getModelMatrix();
             
-//             glm::mat4 MVPmatrix = camera.getProjection() * camera.getViewMatrix() * transform.getModelMatrix();
-//             assert(pushBuffer.MVP == MVPmatrix);
-//             LOG_D("HEY");
+            buffer->pushConstants(pipelineLayout, ShaderStageFlagBits::Vertex, 0, sizeof(PushBuffer), &pushBuffer);
             
-            worldBuffer->pushConstants(pipelineLayout, ShaderStageFlagBits::Vertex, 0, sizeof(PushBuffer), &pushBuffer);
-            
-            const PrimitiveData& primitiveData = mesh->getMeshPrimitiveData();
-            worldBuffer->drawIndexed(primitiveData.indexCount, 1, primitiveData.indexOffset, primitiveData.vertexOffset, 0);
+            const PrimitiveData primitiveData = mesh->getLODPrimitiveData(vc.lod);
+            buffer->drawIndexed(primitiveData.indexCount, 1, primitiveData.indexOffset, primitiveData.vertexOffset, 0);
         } else {
             throw std::runtime_error("TODO IMPLEMENT ME");
         }
@@ -983,7 +1475,7 @@ void ClusteredRenderer::drawSky(const World* world) {
     if (skybox != nullptr && skybox->isInitialized()) {
         const Camera& camera = graphicsSystem->getActiveCamera();
         
-        skybox->draw(getCommandBuffer(CommandBufferID::World), &camera);
+        skybox->draw(getMainSubpassCommandBuffer(), &camera);
     }
 }
 
@@ -998,14 +1490,14 @@ void ClusteredRenderer::drawDebugAndHelperMeshes(const World* world, const Debug
         
         assert(renderer != nullptr);
         
-        renderer->draw(getCommandBuffer(CommandBufferID::World), &camera);
+        renderer->draw(getMainSubpassCommandBuffer(), &camera);
     }
 }
 
 void ClusteredRenderer::submitCommandBuffers() {
     IYFT_PROFILE(SubmitCommandBuffers, iyft::ProfilerTag::Graphics);
     
-    // TODO this blocks until upload completes. I should use a pipeline barrier instead.
+    // Doesn't wait for the upload. It's submitted before the frame, so the barriers it records make the data visible.
     gfx->getDeviceMemoryManager()->beginBatchUpload(MemoryBatch::PerFrameData);
     
 //     worldBuffer->endRenderPass();
@@ -42,9 +42,10 @@ std::string ClusteredRendererProperties::makeRenderDataSet(ShaderLanguage langua
     }
     
     std::stringstream ss;
+    ss << "// Must match graphics/clusteredRenderers/ClusterBufferLayout.hpp\n";
     ss << "struct Cluster {\n";
     ss << "    uint offset;\n";
-    ss << "    uint lightCount;\n";
+    ss << "    uint lightCounts;\n";
     ss << "};\n\n";
     
     ss << "layout(std" << "430" << ", set = " << con::RendererDataBuffer.set << ", binding = " << con::RendererDataBuffer.binding << ") buffer ClusterDataBuffer {\n";
@@ -56,14 +57,49 @@ std::string ClusteredRendererProperties::makeRenderDataSet(ShaderLanguage langua
     return ss.str();
 }
 
+/// Writes the shading code of the point light at index i of cameraAndLights.pointLights
+inline void WritePointLight(std::stringstream& ss, const std::string& indent, const std::string& lightingFunction) {
+    ss << indent << "vec3 lightDirection = normalize(cameraAndLights.pointLights[i].position - fragmentInput.positionWS);\n";
+    ss << indent << "float lightDistance = length(cameraAndLights.pointLights[i].position - fragmentInput.positionWS);\n\n";
+    ss << indent << "float DdivR = lightDistance / cameraAndLights.pointLights[i].radius;\n";
+    ss << indent << "float falloff = clamp(1.0f - (DdivR * DdivR * DdivR * DdivR), 0.0f, 1.0f);\n";
+    ss << indent << "falloff *= falloff;\n";
+    ss << indent << "falloff = falloff / (lightDistance * lightDistance + 1);\n\n";
+    ss << indent << "vec3 lightColor = cameraAndLights.pointLights[i].color;\n";
+    ss << indent << "float lightIntensity = cameraAndLights.pointLights[i].intensity * falloff;\n\n";
+    ss << indent << "if (falloff > 0.0f) {\n";
+    ss << indent << "    " << lightingFunction << "\n";
+    ss << indent << "}\n";
+}
+
+/// Writes the shading code of the spot light at index i of cameraAndLights.spotLights. Same falloff as the point
+/// lights, faded out towards the edge of the cone. The angle is the half angle in degrees.
+inline void WriteSpotLight(std::stringstream& ss, const std::string& indent, const std::string& lightingFunction) {
+    ss << indent << "vec3 lightDirection = normalize(cameraAndLights.spotLights[i].position - fragmentInput.positionWS);\n";
+    ss << indent << "float lightDistance = length(cameraAndLights.spotLights[i].position - fragmentInput.positionWS);\n\n";
+    ss << indent << "float DdivR = lightDistance / cameraAndLights.spotLights[i].radius;\n";
+    ss << indent << "float falloff = clamp(1.0f - (DdivR * DdivR * DdivR * DdivR), 0.0f, 1.0f);\n";
+    ss << indent << "falloff *= falloff;\n";
+    ss << indent << "falloff = falloff / (lightDistance * lightDistance + 1);\n\n";
+    ss << indent << "float cosCone = cos(radians(cameraAndLights.spotLights[i].angle));\n";
+    ss << indent << "float cosAngle = dot(-lightDirection, normalize(cameraAndLights.spotLights[i].direction));\n";
+    ss << indent << "float cone = clamp((cosAngle - cosCone) / max(1.0f - cosCone, 0.0001f), 0.0f, 1.0f);\n";
+    ss << indent << "falloff *= cone * cone;\n\n";
+    ss << indent << "vec3 lightColor = cameraAndLights.spotLights[i].color;\n";
+    ss << indent << "float lightIntensity = cameraAndLights.spotLights[i].intensity * falloff;\n\n";
+    ss << indent << "if (falloff > 0.0f) {\n";
+    ss << indent << "    " << lightingFunction << "\n";
+    ss << indent << "}\n";
+}
+
 std::string ClusteredRendererProperties::makeLightLoops(ShaderLanguage language, const std::string& lightingFunction) const {
     if (language != ShaderLanguage::GLSLVulkan) {
         throw std::runtime_error("Only GLSLVulkan is supported by this renderer");
     }
     
+    const std::string loopIndent = "            ";
     std::stringstream ss;
     
-    ss << "    // WARNING - TEST ONLY!!! These are poorly performing regular forward rendering loops.\n";
     ss << "    // Directional lights\n";
     ss << "    for (int i = 0; i < cameraAndLights.directionalLightCount; ++i) {\n";
     ss << "        vec3 lightDirection = cameraAndLights.directionalLights[i].direction;\n";
@@ -73,30 +109,46 @@ std::string ClusteredRendererProperties::makeLightLoops(ShaderLanguage language,
     ss << "        " << lightingFunction << "\n";
     ss << "    }\n\n";
     
-//         float falloff = clamp(1.0f - (DdivR * DdivR * DdivR * DdivR), 0.0f, 1.0f);
-//         falloff *= falloff;
-//         falloff = falloff / (lightDistance * lightDistance + 1);
-// 
-//         if(falloff > 0.0f) {
-//             color.rgb += falloff * cookTorranceGGX(normal, viewDirection, lightDirection, lightsAndCamera.lightData[i].color.xyz, diffuseColor, 1.0f, 0.1f, 0.3f); // Point specular + diffuse
-//         }
-    ss << "    // Point lights\n";
-    ss << "    for (int i = 0; i < cameraAndLights.pointLightCount; ++i) {\n";
-    ss << "        vec3 lightDirection = normalize(cameraAndLights.pointLights[i].position - fragmentInput.positionWS);\n";
-    ss << "        float lightDistance = length(cameraAndLights.pointLights[i].position - fragmentInput.positionWS);\n\n";
-    ss << "        float DdivR = lightDistance / cameraAndLights.pointLights[i].radius;\n";
-    ss << "        float falloff = clamp(1.0f - (DdivR * DdivR * DdivR * DdivR), 0.0f, 1.0f);\n";
-    ss << "        falloff *= falloff;\n";
-    ss << "        falloff = falloff / (lightDistance * lightDistance + 1);\n\n";
-    ss << "        vec3 lightColor = cameraAndLights.pointLights[i].color;\n";
-    ss << "        float lightIntensity = cameraAndLights.pointLights[i].intensity * falloff;\n\n";
-    ss << "        if (falloff > 0.0f) {\n";
-    ss << "            " << lightingFunction << "\n";
+    // The renderer zeroes the grid parameters if it couldn't cluster the lights of this frame. The branch is uniform,
+    // so it costs next to nothing.
+    ss << "    if (clusterData.gridParameters.z > 0.0f) {\n";
+    
+    // Must match LightClusterer::getGridParameters() and LightClusterer::getClusterID()
+    ss << "        // Find the cluster of this fragment\n";
+    ss << "        float viewDepth = (cameraAndLights.V * vec4(fragmentInput.positionWS, 1.0f)).z;\n";
+    ss << "        int clusterSlice = clamp(int(log(max(viewDepth, 0.000001f)) * clusterData.gridParameters.x + clusterData.gridParameters.y), 0, " << (ClusterVolumeZ - 1) << ");\n";
+    ss << "        ivec2 clusterTile = clamp(ivec2(gl_FragCoord.xy * clusterData.gridParameters.zw), ivec2(0), ivec2(" << (ClusterVolumeX - 1) << ", " << (ClusterVolumeY - 1) << "));\n";
+    ss << "        uint clusterID = uint(clusterTile.x + " << ClusterVolumeX << " * (clusterTile.y + " << ClusterVolumeY << " * clusterSlice));\n\n";
+    
+    ss << "        uint lightCounts = clusterData.clusters[clusterID].lightCounts;\n";
+    ss << "        uint pointLightBegin = clusterData.clusters[clusterID].offset;\n";
+    ss << "        uint spotLightBegin = pointLightBegin + (lightCounts & 0xFFFFu);\n";
+    ss << "        uint spotLightEnd = spotLightBegin + (lightCounts >> 16);\n\n";
+    
+    ss << "        // Point lights that affect the cluster\n";
+    ss << "        for (uint l = pointLightBegin; l < spotLightBegin; ++l) {\n";
+    ss << "            uint i = clusterData.lightIDs[l];\n";
+    WritePointLight(ss, loopIndent, lightingFunction);
+    ss << "        }\n\n";
+    
+    ss << "        // Spot lights that affect the cluster\n";
+    ss << "        for (uint l = spotLightBegin; l < spotLightEnd; ++l) {\n";
+    ss << "            uint i = clusterData.lightIDs[l];\n";
+    WriteSpotLight(ss, loopIndent, lightingFunction);
     ss << "        }\n";
-    ss << "    }\n\n";
+    ss << "    } else {\n";
     
-    // TODO implement spotlights
-    ss << "   // TODO implement spotlights\n\n";
+    // Regular forward rendering loops over every light
+    ss << "        // Point lights\n";
+    ss << "        for (int i = 0; i < cameraAndLights.pointLightCount; ++i) {\n";
+    WritePointLight(ss, loopIndent, lightingFunction);
+    ss << "        }\n\n";
+    
+    ss << "        // Spot lights\n";
+    ss << "        for (int i = 0; i < cameraAndLights.spotLightCount; ++i) {\n";
+    WriteSpotLight(ss, loopIndent, lightingFunction);
+    ss << "        }\n";
+    ss << "    }\n\n";
     
     return ss.str();
 }
@@ -0,0 +1,547 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/clusteredRenderers/LightClusterer.hpp"
+#include "graphics/clusteredRenderers/ClusterBufferLayout.hpp"
+#include "threading/ParallelFor.hpp"
+#include "threading/ThreadProfiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define IYF_CLUSTERING_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IYF_CLUSTERING_SSE
+#endif
+
+namespace iyf {
+/// The light counts of a cluster are packed into 16 bits each
+static constexpr std::uint32_t MaxLightsPerCluster = 0xFFFF;
+
+void ClusterLightSet::clear() {
+    resize(0);
+}
+
+void ClusterLightSet::reserve(std::size_t capacity) {
+    const std::size_t padded = ((capacity + Padding - 1) / Padding) * Padding;
+    
+    xs.reserve(padded);
+    ys.reserve(padded);
+    zs.reserve(padded);
+    radii.reserve(padded);
+}
+
+void ClusterLightSet::resize(std::size_t newCount) {
+    const std::size_t padded = ((newCount + Padding - 1) / Padding) * Padding;
+    
+    xs.resize(padded, 0.0f);
+    ys.resize(padded, 0.0f);
+    zs.resize(padded, 0.0f);
+    radii.resize(padded, 0.0f);
+    
+    // When shrinking, the lights that became padding must not end up in any clusters
+    for (std::size_t i = newCount; i < std::min(count, padded); ++i) {
+        set(i, 0.0f, 0.0f, 0.0f, 0.0f);
+    }
+    
+    count = newCount;
+}
+
+void ClusterRanges::resize(std::size_t paddedCount) {
+    beginX.resize(paddedCount);
+    endX.resize(paddedCount);
+    beginY.resize(paddedCount);
+    endY.resize(paddedCount);
+    beginZ.resize(paddedCount);
+    endZ.resize(paddedCount);
+}
+
+LightClusterer::LightClusterer(std::uint32_t countX, std::uint32_t countY, std::uint32_t countZ, std::size_t maxLightIDs)
+    : countX(countX), countY(countY), countZ(countZ), maxLightIDs(maxLightIDs), mode(Mode::SIMD), usedLightIDs(0), overflowed(false) {
+    // The ranges are stored in 8 bit integers
+    if (countX == 0 || countY == 0 || countZ == 0 || countX > 255 || countY > 255 || countZ > 255) {
+        throw std::invalid_argument("Each dimension of the cluster grid must be in the [1; 255] range");
+    }
+    
+    const std::size_t clusterCount = getClusterCount();
+    offsets.resize(clusterCount, 0);
+    pointCounts.resize(clusterCount, 0);
+    spotCounts.resize(clusterCount, 0);
+    cursors.resize(clusterCount, 0);
+    lightIDs.resize(maxLightIDs);
+    
+    setProjection(1.5707964f, 1.0f, 0.1f, 100.0f);
+}
+
+void LightClusterer::setProjection(float fieldOfViewY, float aspectRatio, float zNear, float zFar) {
+    if (!(zNear > 0.0f) || !(zFar > zNear)) {
+        throw std::invalid_argument("The near plane must be in front of the camera and closer than the far plane");
+    }
+    
+    if (!(fieldOfViewY > 0.0f) || !(fieldOfViewY < 3.1415926f) || !(aspectRatio > 0.0f)) {
+        throw std::invalid_argument("Invalid field of view or aspect ratio");
+    }
+    
+    this->zNear = zNear;
+    this->zFar = zFar;
+    
+    tanHalfFovY = std::tan(fieldOfViewY * 0.5f);
+    tanHalfFovX = tanHalfFovY * aspectRatio;
+    
+    // The planes pass through the camera and the edges of the tiles on the near plane. The normals are normalized, so
+    // the plane equations return the real distances that can be compared to the radii.
+    edgeX.resize(countX + 1);
+    edgeXZ.resize(countX + 1);
+    for (std::uint32_t i = 0; i <= countX; ++i) {
+        const float slope = (-1.0f + 2.0f * static_cast<float>(i) / static_cast<float>(countX)) * tanHalfFovX;
+        const float invLength = 1.0f / std::sqrt(1.0f + slope * slope);
+        
+        edgeX[i] = invLength;
+        edgeXZ[i] = -slope * invLength;
+    }
+    
+    // Row 0 is at the top of the screen
+    edgeY.resize(countY + 1);
+    edgeYZ.resize(countY + 1);
+    for (std::uint32_t i = 0; i <= countY; ++i) {
+        const float slope = (1.0f - 2.0f * static_cast<float>(i) / static_cast<float>(countY)) * tanHalfFovY;
+        const float invLength = 1.0f / std::sqrt(1.0f + slope * slope);
+        
+        edgeY[i] = -invLength;
+        edgeYZ[i] = slope * invLength;
+    }
+    
+    sliceDepths.resize(countZ + 1);
+    const float depthRatio = zFar / zNear;
+    for (std::uint32_t i = 0; i <= countZ; ++i) {
+        sliceDepths[i] = zNear * std::pow(depthRatio, static_cast<float>(i) / static_cast<float>(countZ));
+    }
+    
+    sliceDepths[0] = zNear;
+    sliceDepths[countZ] = zFar;
+}
+
+// The distances to the edges decrease from the first edge to the last one. A sphere overlaps the tile between edges
+// t and t + 1 if it reaches past edge t (d[t] > -r) and doesn't lie completely behind edge t + 1 (d[t + 1] < r). Both
+// conditions hold for a contiguous range of tiles, so counting the edges is enough to find the begin and the end of
+// the range. Unlike a search, counting is branchless and easy to do for several lights at once.
+
+void LightClusterer::computeRangesScalar(const ClusterLightSet& lights, std::size_t begin, std::size_t end, ClusterRanges& ranges) const {
+    const float* xs = lights.getX();
+    const float* ys = lights.getY();
+    const float* zs = lights.getZ();
+    const float* radii = lights.getRadius();
+    
+    for (std::size_t i = begin; i < end; ++i) {
+        const float x = xs[i];
+        const float y = ys[i];
+        const float z = zs[i];
+        const float r = radii[i];
+        const float negR = -r;
+        
+        std::uint32_t beginX = 0;
+        std::uint32_t endX = 0;
+        for (std::uint32_t e = 0; e <= countX; ++e) {
+            const float d = edgeX[e] * x + edgeXZ[e] * z;
+            beginX += (e > 0 && d >= r) ? 1 : 0;
+            endX += (e < countX && d > negR) ? 1 : 0;
+        }
+        
+        std::uint32_t beginY = 0;
+        std::uint32_t endY = 0;
+        for (std::uint32_t e = 0; e <= countY; ++e) {
+            const float d = edgeY[e] * y + edgeYZ[e] * z;
+            beginY += (e > 0 && d >= r) ? 1 : 0;
+            endY += (e < countY && d > negR) ? 1 : 0;
+        }
+        
+        const float nearZ = z - r;
+        const float farZ = z + r;
+        
+        std::uint32_t beginZ = 0;
+        std::uint32_t endZ = 0;
+        for (std::uint32_t s = 0; s < countZ; ++s) {
+            beginZ += (sliceDepths[s + 1] <= nearZ) ? 1 : 0;
+            endZ += (sliceDepths[s] < farZ) ? 1 : 0;
+        }
+        
+        ranges.beginX[i] = static_cast<std::uint8_t>(beginX);
+        ranges.endX[i] = static_cast<std::uint8_t>(endX);
+        ranges.beginY[i] = static_cast<std::uint8_t>(beginY);
+        ranges.endY[i] = static_cast<std::uint8_t>(endY);
+        ranges.beginZ[i] = static_cast<std::uint8_t>(beginZ);
+        ranges.endZ[i] = static_cast<std::uint8_t>(endZ);
+    }
+}
+
+void LightClusterer::computeRangesSIMD(const ClusterLightSet& lights, std::size_t begin, std::size_t end, ClusterRanges& ranges) const {
+#if defined(IYF_CLUSTERING_AVX) || defined(IYF_CLUSTERING_SSE)
+#if defined(IYF_CLUSTERING_AVX)
+    constexpr std::size_t Width = 8;
+    using Vector = __m256;
+    #define IYF_CLUSTER_SET1 _mm256_set1_ps
+    #define IYF_CLUSTER_LOAD _mm256_loadu_ps
+    #define IYF_CLUSTER_STORE _mm256_storeu_ps
+    #define IYF_CLUSTER_ADD _mm256_add_ps
+    #define IYF_CLUSTER_SUB _mm256_sub_ps
+    #define IYF_CLUSTER_MUL _mm256_mul_ps
+    #define IYF_CLUSTER_AND _mm256_and_ps
+    #define IYF_CLUSTER_GT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+    #define IYF_CLUSTER_GE(a, b) _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+    #define IYF_CLUSTER_ZERO _mm256_setzero_ps
+#else
+    constexpr std::size_t Width = 4;
+    using Vector = __m128;
+    #define IYF_CLUSTER_SET1 _mm_set1_ps
+    #define IYF_CLUSTER_LOAD _mm_loadu_ps
+    #define IYF_CLUSTER_STORE _mm_storeu_ps
+    #define IYF_CLUSTER_ADD _mm_add_ps
+    #define IYF_CLUSTER_SUB _mm_sub_ps
+    #define IYF_CLUSTER_MUL _mm_mul_ps
+    #define IYF_CLUSTER_AND _mm_and_ps
+    #define IYF_CLUSTER_GT(a, b) _mm_cmpgt_ps(a, b)
+    #define IYF_CLUSTER_GE(a, b) _mm_cmpge_ps(a, b)
+    #define IYF_CLUSTER_ZERO _mm_setzero_ps
+#endif
+    
+    const float* xs = lights.getX();
+    const float* ys = lights.getY();
+    const float* zs = lights.getZ();
+    const float* radii = lights.getRadius();
+    
+    // The comparison masks are ANDed with 1.0f and summed. Small integers are exact in floating point.
+    const Vector one = IYF_CLUSTER_SET1(1.0f);
+    const std::size_t paddedSize = lights.getPaddedSize();
+    
+    alignas(32) float counts[6][Width];
+    
+    std::size_t i = begin;
+    for (; i < end && i + Width <= paddedSize; i += Width) {
+        const Vector x = IYF_CLUSTER_LOAD(xs + i);
+        const Vector y = IYF_CLUSTER_LOAD(ys + i);
+        const Vector z = IYF_CLUSTER_LOAD(zs + i);
+        const Vector r = IYF_CLUSTER_LOAD(radii + i);
+        const Vector negR = IYF_CLUSTER_SUB(IYF_CLUSTER_ZERO(), r);
+        
+        // Same operation order as the scalar code to get bit identical results. The first edge can't be the end of a
+        // range and the last one can't be the beginning.
+        Vector beginX = IYF_CLUSTER_ZERO();
+        Vector endX = IYF_CLUSTER_ZERO();
+        for (std::uint32_t e = 0; e <= countX; ++e) {
+            const Vector d = IYF_CLUSTER_ADD(IYF_CLUSTER_MUL(IYF_CLUSTER_SET1(edgeX[e]), x), IYF_CLUSTER_MUL(IYF_CLUSTER_SET1(edgeXZ[e]), z));
+            if (e > 0) {
+                beginX = IYF_CLUSTER_ADD(beginX, IYF_CLUSTER_AND(IYF_CLUSTER_GE(d, r), one));
+            }
+            
+            if (e < countX) {
+                endX = IYF_CLUSTER_ADD(endX, IYF_CLUSTER_AND(IYF_CLUSTER_GT(d, negR), one));
+            }
+        }
+        
+        Vector beginY = IYF_CLUSTER_ZERO();
+        Vector endY = IYF_CLUSTER_ZERO();
+        for (std::uint32_t e = 0; e <= countY; ++e) {
+            const Vector d = IYF_CLUSTER_ADD(IYF_CLUSTER_MUL(IYF_CLUSTER_SET1(edgeY[e]), y), IYF_CLUSTER_MUL(IYF_CLUSTER_SET1(edgeYZ[e]), z));
+            if (e > 0) {
+                beginY = IYF_CLUSTER_ADD(beginY, IYF_CLUSTER_AND(IYF_CLUSTER_GE(d, r), one));
+            }
+            
+            if (e < countY) {
+                endY = IYF_CLUSTER_ADD(endY, IYF_CLUSTER_AND(IYF_CLUSTER_GT(d, negR), one));
+            }
+        }
+        
+        const Vector nearZ = IYF_CLUSTER_SUB(z, r);
+        const Vector farZ = IYF_CLUSTER_ADD(z, r);
+        
+        Vector beginZ = IYF_CLUSTER_ZERO();
+        Vector endZ = IYF_CLUSTER_ZERO();
+        for (std::uint32_t s = 0; s < countZ; ++s) {
+            beginZ = IYF_CLUSTER_ADD(beginZ, IYF_CLUSTER_AND(IYF_CLUSTER_GE(nearZ, IYF_CLUSTER_SET1(sliceDepths[s + 1])), one));
+            endZ = IYF_CLUSTER_ADD(endZ, IYF_CLUSTER_AND(IYF_CLUSTER_GT(farZ, IYF_CLUSTER_SET1(sliceDepths[s])), one));
+        }
+        
+        IYF_CLUSTER_STORE(counts[0], beginX);
+        IYF_CLUSTER_STORE(counts[1], endX);
+        IYF_CLUSTER_STORE(counts[2], beginY);
+        IYF_CLUSTER_STORE(counts[3], endY);
+        IYF_CLUSTER_STORE(counts[4], beginZ);
+        IYF_CLUSTER_STORE(counts[5], endZ);
+        
+        // Don't touch the lanes that belong to the next range
+        const std::size_t laneCount = std::min(Width, end - i);
+        for (std::size_t l = 0; l < laneCount; ++l) {
+            ranges.beginX[i + l] = static_cast<std::uint8_t>(counts[0][l]);
+            ranges.endX[i + l] = static_cast<std::uint8_t>(counts[1][l]);
+            ranges.beginY[i + l] = static_cast<std::uint8_t>(counts[2][l]);
+            ranges.endY[i + l] = static_cast<std::uint8_t>(counts[3][l]);
+            ranges.beginZ[i + l] = static_cast<std::uint8_t>(counts[4][l]);
+            ranges.endZ[i + l] = static_cast<std::uint8_t>(counts[5][l]);
+        }
+    }
+    
+    #undef IYF_CLUSTER_SET1
+    #undef IYF_CLUSTER_LOAD
+    #undef IYF_CLUSTER_STORE
+    #undef IYF_CLUSTER_ADD
+    #undef IYF_CLUSTER_SUB
+    #undef IYF_CLUSTER_MUL
+    #undef IYF_CLUSTER_AND
+    #undef IYF_CLUSTER_GT
+    #undef IYF_CLUSTER_GE
+    #undef IYF_CLUSTER_ZERO
+    
+    // Only reached if begin wasn't a multiple of the vector width and the last vector would have read past the padding
+    if (i < end) {
+        computeRangesScalar(lights, i, end, ranges);
+    }
+#else
+    computeRangesScalar(lights, begin, end, ranges);
+#endif
+}
+
+const char* LightClusterer::GetSIMDInstructionSetName() {
+#if defined(IYF_CLUSTERING_AVX)
+    return "AVX";
+#elif defined(IYF_CLUSTERING_SSE)
+    return "SSE2";
+#else
+    return "None (scalar fallback)";
+#endif
+}
+
+void LightClusterer::computeRangeChunk(const ClusterLightSet& lights, ClusterRanges& ranges, std::size_t begin, std::size_t end) const {
+    if (mode == Mode::SIMD) {
+        computeRangesSIMD(lights, begin, end, ranges);
+    } else {
+        computeRangesScalar(lights, begin, end, ranges);
+    }
+}
+
+void LightClusterer::binBySlice(const ClusterRanges& ranges, std::size_t lightCount, SliceBins& bins) const {
+    bins.offsets.assign(countZ + 1, 0);
+    
+    for (std::size_t i = 0; i < lightCount; ++i) {
+        for (std::uint32_t z = ranges.beginZ[i]; z < ranges.endZ[i]; ++z) {
+            bins.offsets[z + 1]++;
+        }
+    }
+    
+    for (std::uint32_t z = 0; z < countZ; ++z) {
+        bins.offsets[z + 1] += bins.offsets[z];
+    }
+    
+    bins.lights.resize(bins.offsets[countZ]);
+    
+    // Reuses the lower offsets as cursors and restores them afterwards
+    for (std::size_t i = 0; i < lightCount; ++i) {
+        for (std::uint32_t z = ranges.beginZ[i]; z < ranges.endZ[i]; ++z) {
+            bins.lights[bins.offsets[z]++] = static_cast<std::uint32_t>(i);
+        }
+    }
+    
+    for (std::uint32_t z = countZ; z > 0; --z) {
+        bins.offsets[z] = bins.offsets[z - 1];
+    }
+    bins.offsets[0] = 0;
+}
+
+void LightClusterer::countSlice(std::uint32_t slice, const ClusterRanges& ranges, const SliceBins& bins, std::vector<std::uint32_t>& counts) {
+    const std::uint32_t sliceBegin = getClusterID(0, 0, slice);
+    const std::uint32_t sliceEnd = sliceBegin + countX * countY;
+    std::fill(counts.begin() + sliceBegin, counts.begin() + sliceEnd, 0);
+    
+    for (std::uint32_t l = bins.offsets[slice]; l < bins.offsets[slice + 1]; ++l) {
+        const std::uint32_t i = bins.lights[l];
+        
+        for (std::uint32_t y = ranges.beginY[i]; y < ranges.endY[i]; ++y) {
+            for (std::uint32_t x = ranges.beginX[i]; x < ranges.endX[i]; ++x) {
+                counts[getClusterID(x, y, slice)]++;
+            }
+        }
+    }
+}
+
+void LightClusterer::fillSlice(std::uint32_t slice, const ClusterRanges& ranges, const SliceBins& bins, bool spotLights) {
+    const std::uint32_t sliceBegin = getClusterID(0, 0, slice);
+    const std::uint32_t sliceEnd = sliceBegin + countX * countY;
+    std::fill(cursors.begin() + sliceBegin, cursors.begin() + sliceEnd, 0);
+    
+    const std::vector<std::uint32_t>& counts = spotLights ? spotCounts : pointCounts;
+    
+    // The bins are sorted, which keeps the IDs of every cluster sorted as well. If the cluster was truncated, the
+    // lights with the highest IDs are the ones that don't fit.
+    for (std::uint32_t l = bins.offsets[slice]; l < bins.offsets[slice + 1]; ++l) {
+        const std::uint32_t i = bins.lights[l];
+        
+        for (std::uint32_t y = ranges.beginY[i]; y < ranges.endY[i]; ++y) {
+            for (std::uint32_t x = ranges.beginX[i]; x < ranges.endX[i]; ++x) {
+                const std::uint32_t clusterID = getClusterID(x, y, slice);
+                const std::uint32_t slot = cursors[clusterID];
+                
+                if (slot < counts[clusterID]) {
+                    const std::uint32_t first = offsets[clusterID] + (spotLights ? pointCounts[clusterID] : 0);
+                    lightIDs[first + slot] = i;
+                    cursors[clusterID] = slot + 1;
+                }
+            }
+        }
+    }
+}
+
+void LightClusterer::cluster(const ClusterLightSet& pointLights, const ClusterLightSet& spotLights, iyft::ThreadPool* pool) {
+    IYFT_PROFILE(LightClustering, iyft::ProfilerTag::Graphics);
+    
+    const std::size_t pointCount = pointLights.size();
+    const std::size_t spotCount = spotLights.size();
+    
+    pointRanges.resize(pointLights.getPaddedSize());
+    spotRanges.resize(spotLights.getPaddedSize());
+    
+    // Phase 1: the cluster ranges of every light. The chunk size is a multiple of the padding to keep the SIMD loads of
+    // all chunks in bounds.
+    const std::size_t pointChunks = (pointCount + MinChunkSize - 1) / MinChunkSize;
+    const std::size_t spotChunks = (spotCount + MinChunkSize - 1) / MinChunkSize;
+    static_assert(MinChunkSize % ClusterLightSet::Padding == 0, "The chunk size must be a multiple of the padding");
+    
+    if (pointChunks + spotChunks > 0) {
+        iyft::ParallelFor(pool, pointChunks + spotChunks, [this, &pointLights, &spotLights, pointChunks, pointCount, spotCount](std::size_t chunk) {
+            if (chunk < pointChunks) {
+                const std::size_t begin = chunk * MinChunkSize;
+                computeRangeChunk(pointLights, pointRanges, begin, std::min(begin + MinChunkSize, pointCount));
+            } else {
+                const std::size_t begin = (chunk - pointChunks) * MinChunkSize;
+                computeRangeChunk(spotLights, spotRanges, begin, std::min(begin + MinChunkSize, spotCount));
+            }
+        });
+    }
+    
+    // Phase 2: the number of lights in every cluster. Most lights only reach a few slices, so they get binned first.
+    // Each slice only touches its own clusters, which means that the slices can be processed in parallel without any
+    // locking.
+    binBySlice(pointRanges, pointCount, pointBins);
+    binBySlice(spotRanges, spotCount, spotBins);
+    
+    iyft::ParallelFor(pool, countZ, [this](std::size_t slice) {
+        countSlice(static_cast<std::uint32_t>(slice), pointRanges, pointBins, pointCounts);
+        countSlice(static_cast<std::uint32_t>(slice), spotRanges, spotBins, spotCounts);
+    });
+    
+    // Phase 3: assign the storage. If there isn't enough of it, the clusters with the highest IDs get truncated.
+    // Point lights are kept over spot lights.
+    overflowed = false;
+    
+    std::size_t offset = 0;
+    const std::uint32_t clusterCount = getClusterCount();
+    for (std::uint32_t c = 0; c < clusterCount; ++c) {
+        std::uint32_t points = pointCounts[c];
+        std::uint32_t spots = spotCounts[c];
+        
+        if (points > MaxLightsPerCluster || spots > MaxLightsPerCluster) {
+            points = std::min(points, MaxLightsPerCluster);
+            spots = std::min(spots, MaxLightsPerCluster);
+            overflowed = true;
+        }
+        
+        const std::size_t available = maxLightIDs - offset;
+        if (points + spots > available) {
+            points = static_cast<std::uint32_t>(std::min<std::size_t>(points, available));
+            spots = static_cast<std::uint32_t>(available - points);
+            overflowed = true;
+        }
+        
+        offsets[c] = static_cast<std::uint32_t>(offset);
+        pointCounts[c] = points;
+        spotCounts[c] = spots;
+        
+        offset += points + spots;
+    }
+    
+    usedLightIDs = offset;
+    
+    // Phase 4: write the light IDs
+    iyft::ParallelFor(pool, countZ, [this](std::size_t slice) {
+        fillSlice(static_cast<std::uint32_t>(slice), pointRanges, pointBins, false);
+        fillSlice(static_cast<std::uint32_t>(slice), spotRanges, spotBins, true);
+    });
+}
+
+bool LightClusterer::findCluster(float x, float y, float z, std::uint32_t& clusterID) const {
+    // Uses the same planes as the range computations. Points exactly on an edge belong to the tile after it.
+    std::uint32_t column = 0;
+    for (std::uint32_t e = 0; e <= countX; ++e) {
+        column += (edgeX[e] * x + edgeXZ[e] * z >= 0.0f) ? 1 : 0;
+    }
+    
+    std::uint32_t row = 0;
+    for (std::uint32_t e = 0; e <= countY; ++e) {
+        row += (edgeY[e] * y + edgeYZ[e] * z >= 0.0f) ? 1 : 0;
+    }
+    
+    if (column == 0 || column > countX || row == 0 || row > countY || z < zNear || z >= zFar) {
+        return false;
+    }
+    
+    const std::uint32_t slice = static_cast<std::uint32_t>(std::upper_bound(sliceDepths.begin(), sliceDepths.end(), z) - sliceDepths.begin()) - 1;
+    
+    clusterID = getClusterID(column - 1, row - 1, slice);
+    return true;
+}
+
+std::array<float, 4> LightClusterer::getGridParameters() const {
+    const float scale = static_cast<float>(countZ) / std::log(zFar / zNear);
+    return {scale, -std::log(zNear) * scale, static_cast<float>(countX), static_cast<float>(countY)};
+}
+
+void LightClusterer::writeClusterData(ClusterData& data, float framebufferWidth, float framebufferHeight) const {
+    if (countX != ClusterVolumeX || countY != ClusterVolumeY || countZ != ClusterVolumeZ || maxLightIDs > MaxLightIDs) {
+        throw std::logic_error("The dimensions of the LightClusterer don't match the ClusterData");
+    }
+    
+    const std::array<float, 4> parameters = getGridParameters();
+    data.gridParameters[0] = parameters[0];
+    data.gridParameters[1] = parameters[1];
+    data.gridParameters[2] = parameters[2] / framebufferWidth;
+    data.gridParameters[3] = parameters[3] / framebufferHeight;
+    
+    const std::uint32_t clusterCount = getClusterCount();
+    for (std::uint32_t c = 0; c < clusterCount; ++c) {
+        data.clusters[c].offset = offsets[c];
+        data.clusters[c].lightCounts = pointCounts[c] | (spotCounts[c] << 16);
+    }
+    
+    if (usedLightIDs != 0) {
+        std::memcpy(data.lightIDs, lightIDs.data(), usedLightIDs * sizeof(std::uint32_t));
+    }
+}
+}
@@ -0,0 +1,318 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/culling/FrustumCuller.hpp"
+#include "threading/ParallelFor.hpp"
+#include "threading/ThreadProfiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define IYF_CULLING_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IYF_CULLING_SSE
+#endif
+
+namespace iyf {
+static constexpr float EmptyMin = std::numeric_limits<float>::max();
+static constexpr float EmptyMax = -std::numeric_limits<float>::max();
+
+void AABBSet::clear() {
+    resize(0);
+}
+
+void AABBSet::reserve(std::size_t capacity) {
+    const std::size_t padded = ((capacity + Padding - 1) / Padding) * Padding;
+    
+    minXs.reserve(padded);
+    minYs.reserve(padded);
+    minZs.reserve(padded);
+    maxXs.reserve(padded);
+    maxYs.reserve(padded);
+    maxZs.reserve(padded);
+}
+
+void AABBSet::resize(std::size_t newCount) {
+    const std::size_t padded = ((newCount + Padding - 1) / Padding) * Padding;
+    
+    minXs.resize(padded, EmptyMin);
+    minYs.resize(padded, EmptyMin);
+    minZs.resize(padded, EmptyMin);
+    maxXs.resize(padded, EmptyMax);
+    maxYs.resize(padded, EmptyMax);
+    maxZs.resize(padded, EmptyMax);
+    
+    // When shrinking, the boxes that became padding must not pass the tests either
+    for (std::size_t i = newCount; i < std::min(count, padded); ++i) {
+        setEmpty(i);
+    }
+    
+    count = newCount;
+}
+
+void AABBSet::removeAndSwap(std::size_t id) {
+    const std::size_t last = count - 1;
+    if (id != last) {
+        set(id, minXs[last], minYs[last], minZs[last], maxXs[last], maxYs[last], maxZs[last]);
+    }
+    
+    setEmpty(last);
+    count--;
+}
+
+void AABBSet::setEmpty(std::size_t id) {
+    // An inverted box of maximum size. Whichever corner a plane picks, the dot product ends up huge and positive
+    // (or inf, but never NaN because the components are finite), so the box always ends up outside.
+    set(id, EmptyMin, EmptyMin, EmptyMin, EmptyMax, EmptyMax, EmptyMax);
+}
+
+void FrustumCuller::CullRangeScalar(const CullingPlanes& planes, const AABBSet& boxes, std::size_t begin, std::size_t end, std::vector<std::uint32_t>& visibleIDs) {
+    const float* minX = boxes.getMinX();
+    const float* minY = boxes.getMinY();
+    const float* minZ = boxes.getMinZ();
+    const float* maxX = boxes.getMaxX();
+    const float* maxY = boxes.getMaxY();
+    const float* maxZ = boxes.getMaxZ();
+    
+    for (std::size_t i = begin; i < end; ++i) {
+        bool visible = true;
+        
+        // Same test as Frustum::isAABBInFrustum()
+        for (std::size_t p = 0; p < 6; ++p) {
+            const float x = (planes.x[p] < 0.0f) ? maxX[i] : minX[i];
+            const float y = (planes.y[p] < 0.0f) ? maxY[i] : minY[i];
+            const float z = (planes.z[p] < 0.0f) ? maxZ[i] : minZ[i];
+            
+            const float d = planes.x[p] * x + planes.y[p] * y + planes.z[p] * z;
+            if (d > -planes.w[p]) {
+                visible = false;
+                break;
+            }
+        }
+        
+        if (visible) {
+            visibleIDs.push_back(static_cast<std::uint32_t>(i));
+        }
+    }
+}
+
+#if defined(IYF_CULLING_AVX) || defined(IYF_CULLING_SSE)
+/// Appends the indices that correspond to the set bits of the mask
+inline static void AppendVisible(unsigned int mask, std::size_t base, std::vector<std::uint32_t>& visibleIDs) {
+    while (mask != 0) {
+#ifdef _MSC_VER
+        unsigned long bit;
+        _BitScanForward(&bit, mask);
+#else
+        const unsigned int bit = static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+        visibleIDs.push_back(static_cast<std::uint32_t>(base + bit));
+        mask &= mask - 1;
+    }
+}
+#endif
+
+void FrustumCuller::CullRangeSIMD(const CullingPlanes& planes, const AABBSet& boxes, std::size_t begin, std::size_t end, std::vector<std::uint32_t>& visibleIDs) {
+#if defined(IYF_CULLING_AVX) || defined(IYF_CULLING_SSE)
+    // The corner that is tested against a plane only depends on the signs of the plane normal, which means
+    // that we can pick the right arrays once instead of selecting the values for every box.
+    const float* xs[6];
+    const float* ys[6];
+    const float* zs[6];
+    
+    for (std::size_t p = 0; p < 6; ++p) {
+        xs[p] = (planes.x[p] < 0.0f) ? boxes.getMaxX() : boxes.getMinX();
+        ys[p] = (planes.y[p] < 0.0f) ? boxes.getMaxY() : boxes.getMinY();
+        zs[p] = (planes.z[p] < 0.0f) ? boxes.getMaxZ() : boxes.getMinZ();
+    }
+    
+#if defined(IYF_CULLING_AVX)
+    constexpr std::size_t Width = 8;
+    using Vector = __m256;
+    #define IYF_CULL_SET1 _mm256_set1_ps
+    #define IYF_CULL_LOAD _mm256_loadu_ps
+    #define IYF_CULL_ADD _mm256_add_ps
+    #define IYF_CULL_MUL _mm256_mul_ps
+    #define IYF_CULL_OR _mm256_or_ps
+    #define IYF_CULL_GT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+    #define IYF_CULL_MOVEMASK _mm256_movemask_ps
+    #define IYF_CULL_ZERO _mm256_setzero_ps
+#else
+    constexpr std::size_t Width = 4;
+    using Vector = __m128;
+    #define IYF_CULL_SET1 _mm_set1_ps
+    #define IYF_CULL_LOAD _mm_loadu_ps
+    #define IYF_CULL_ADD _mm_add_ps
+    #define IYF_CULL_MUL _mm_mul_ps
+    #define IYF_CULL_OR _mm_or_ps
+    #define IYF_CULL_GT(a, b) _mm_cmpgt_ps(a, b)
+    #define IYF_CULL_MOVEMASK _mm_movemask_ps
+    #define IYF_CULL_ZERO _mm_setzero_ps
+#endif
+    
+    Vector nx[6];
+    Vector ny[6];
+    Vector nz[6];
+    Vector negW[6];
+    
+    for (std::size_t p = 0; p < 6; ++p) {
+        nx[p] = IYF_CULL_SET1(planes.x[p]);
+        ny[p] = IYF_CULL_SET1(planes.y[p]);
+        nz[p] = IYF_CULL_SET1(planes.z[p]);
+        negW[p] = IYF_CULL_SET1(-planes.w[p]);
+    }
+    
+    constexpr unsigned int FullMask = (1u << Width) - 1;
+    const std::size_t paddedSize = boxes.getPaddedSize();
+    
+    std::size_t i = begin;
+    for (; i < end && i + Width <= paddedSize; i += Width) {
+        Vector outside = IYF_CULL_ZERO();
+        
+        for (std::size_t p = 0; p < 6; ++p) {
+            const Vector x = IYF_CULL_LOAD(xs[p] + i);
+            const Vector y = IYF_CULL_LOAD(ys[p] + i);
+            const Vector z = IYF_CULL_LOAD(zs[p] + i);
+            
+            // Same operation order as the scalar code to get bit identical results
+            const Vector d = IYF_CULL_ADD(IYF_CULL_ADD(IYF_CULL_MUL(nx[p], x), IYF_CULL_MUL(ny[p], y)), IYF_CULL_MUL(nz[p], z));
+            outside = IYF_CULL_OR(outside, IYF_CULL_GT(d, negW[p]));
+        }
+        
+        unsigned int visibleMask = ~static_cast<unsigned int>(IYF_CULL_MOVEMASK(outside)) & FullMask;
+        
+        // Drop the lanes that belong to the next range or to the padding
+        if (i + Width > end) {
+            visibleMask &= (1u << (end - i)) - 1;
+        }
+        
+        AppendVisible(visibleMask, i, visibleIDs);
+    }
+    
+    #undef IYF_CULL_SET1
+    #undef IYF_CULL_LOAD
+    #undef IYF_CULL_ADD
+    #undef IYF_CULL_MUL
+    #undef IYF_CULL_OR
+    #undef IYF_CULL_GT
+    #undef IYF_CULL_MOVEMASK
+    #undef IYF_CULL_ZERO
+    
+    // Only reached if begin wasn't a multiple of the vector width and the last vector would have read past the padding
+    if (i < end) {
+        CullRangeScalar(planes, boxes, i, end, visibleIDs);
+    }
+#else
+    CullRangeScalar(planes, boxes, begin, end, visibleIDs);
+#endif
+}
+
+const char* FrustumCuller::GetSIMDInstructionSetName() {
+#if defined(IYF_CULLING_AVX)
+    return "AVX";
+#elif defined(IYF_CULLING_SSE)
+    return "SSE2";
+#else
+    return "None (scalar fallback)";
+#endif
+}
+
+void FrustumCuller::cullChunk(const CullingPlanes& planes, const AABBSet& boxes, std::size_t chunkID, std::size_t chunkSize) {
+    const std::size_t begin = chunkID * chunkSize;
+    const std::size_t end = std::min(begin + chunkSize, boxes.size());
+    
+    std::vector<std::uint32_t>& result = chunkResults[chunkID];
+    result.clear();
+    
+    if (mode == Mode::SIMD) {
+        CullRangeSIMD(planes, boxes, begin, end, result);
+    } else {
+        CullRangeScalar(planes, boxes, begin, end, result);
+    }
+}
+
+void FrustumCuller::cull(const CullingPlanes& planes, const AABBSet& boxes, std::vector<std::uint32_t>& visibleIDs, iyft::ThreadPool* pool) {
+    IYFT_PROFILE(FrustumCulling, iyft::ProfilerTag::Graphics);
+    
+    visibleIDs.clear();
+    
+    const std::size_t count = boxes.size();
+    if (count == 0) {
+        return;
+    }
+    
+    // Creating several chunks per thread balances the load when some of the helpers start late. The chunk size is
+    // a multiple of the padding to keep the SIMD loads of all chunks in bounds.
+    const std::size_t threadCount = iyft::GetParallelForThreadCount(pool);
+    std::size_t chunkSize = std::max(MinChunkSize, (count + threadCount * 4 - 1) / (threadCount * 4));
+    chunkSize = ((chunkSize + AABBSet::Padding - 1) / AABBSet::Padding) * AABBSet::Padding;
+    
+    const std::size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    
+    if (chunkCount == 1 || threadCount == 1) {
+        if (mode == Mode::SIMD) {
+            CullRangeSIMD(planes, boxes, 0, count, visibleIDs);
+        } else {
+            CullRangeScalar(planes, boxes, 0, count, visibleIDs);
+        }
+        
+        return;
+    }
+    
+    if (chunkResults.size() < chunkCount) {
+        chunkResults.resize(chunkCount);
+    }
+    
+    // Since each chunk has its own result list, nothing needs to be locked
+    iyft::ParallelFor(pool, chunkCount, [this, &planes, &boxes, chunkSize](std::size_t chunkID) {
+        cullChunk(planes, boxes, chunkID, chunkSize);
+    });
+    
+    // Concatenate the results in chunk order. ParallelFor() synchronizes with the helpers, so their lists are complete.
+    std::size_t total = 0;
+    for (std::size_t c = 0; c < chunkCount; ++c) {
+        total += chunkResults[c].size();
+    }
+    
+    visibleIDs.resize(total);
+    
+    std::size_t offset = 0;
+    for (std::size_t c = 0; c < chunkCount; ++c) {
+        const std::vector<std::uint32_t>& result = chunkResults[c];
+        
+        if (!result.empty()) {
+            std::memcpy(visibleIDs.data() + offset, result.data(), result.size() * sizeof(std::uint32_t));
+            offset += result.size();
+        }
+    }
+}
+}
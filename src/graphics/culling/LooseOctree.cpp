@@ -0,0 +1,326 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/culling/LooseOctree.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace iyf {
+static inline glm::vec3 Centroid(const AABB& aabb) {
+    return (aabb.vertices[0] + aabb.vertices[1]) * 0.5f;
+}
+
+static inline float MaxHalfExtent(const AABB& aabb) {
+    const glm::vec3 extent = (aabb.vertices[1] - aabb.vertices[0]) * 0.5f;
+    return std::max(std::max(extent.x, extent.y), extent.z);
+}
+
+LooseOctree::Node::Node(const glm::vec3& center, float halfSize, std::uint32_t parent, std::uint32_t depth)
+    : looseBounds(center - glm::vec3(halfSize * 2.0f, halfSize * 2.0f, halfSize * 2.0f), center + glm::vec3(halfSize * 2.0f, halfSize * 2.0f, halfSize * 2.0f)),
+      center(center), halfSize(halfSize), parent(parent), depth(depth), subtreeObjectCount(0) {
+    children.fill(NoNode);
+}
+
+LooseOctree::LooseOctree(const AABB& worldBounds, std::uint32_t maxDepth) : worldBounds(worldBounds), maxDepth(maxDepth), objectCount(0) {
+    clear();
+}
+
+void LooseOctree::clear() {
+    nodes.clear();
+    objects.clear();
+    freeHandles.clear();
+    objectCount = 0;
+    
+    const glm::vec3 center = Centroid(worldBounds);
+    const float halfSize = MaxHalfExtent(worldBounds);
+    nodes.emplace_back(center, halfSize, NoNode, 0);
+}
+
+/// Checks if the point lies inside the cell of the node (not the loose bounds)
+static inline bool IsInCell(const glm::vec3& point, const glm::vec3& center, float halfSize) {
+    return std::abs(point.x - center.x) <= halfSize &&
+           std::abs(point.y - center.y) <= halfSize &&
+           std::abs(point.z - center.z) <= halfSize;
+}
+
+std::uint32_t LooseOctree::findNode(const AABB& bounds) {
+    const glm::vec3 objectCenter = Centroid(bounds);
+    const float objectHalfExtent = MaxHalfExtent(bounds);
+    
+    if (!IsInCell(objectCenter, nodes[0].center, nodes[0].halfSize)) {
+        return 0;
+    }
+    
+    std::uint32_t nodeID = 0;
+    while (true) {
+        const float childHalfSize = nodes[nodeID].halfSize * 0.5f;
+        
+        if (nodes[nodeID].depth == maxDepth || objectHalfExtent > childHalfSize) {
+            return nodeID;
+        }
+        
+        const glm::vec3& center = nodes[nodeID].center;
+        const std::size_t childIndex = static_cast<std::size_t>(objectCenter.x >= center.x) |
+                                       (static_cast<std::size_t>(objectCenter.y >= center.y) << 1) |
+                                       (static_cast<std::size_t>(objectCenter.z >= center.z) << 2);
+        
+        std::uint32_t childID = nodes[nodeID].children[childIndex];
+        if (childID == NoNode) {
+            const glm::vec3 offset((childIndex & 1) ? childHalfSize : -childHalfSize,
+                                   (childIndex & 2) ? childHalfSize : -childHalfSize,
+                                   (childIndex & 4) ? childHalfSize : -childHalfSize);
+            
+            childID = static_cast<std::uint32_t>(nodes.size());
+            const std::uint32_t depth = nodes[nodeID].depth + 1;
+            
+            // May reallocate, hence the indices
+            nodes.emplace_back(center + offset, childHalfSize, nodeID, depth);
+            nodes[nodeID].children[childIndex] = childID;
+        }
+        
+        nodeID = childID;
+    }
+}
+
+bool LooseOctree::fitsNode(std::uint32_t nodeID, const AABB& bounds) const {
+    const Node& node = nodes[nodeID];
+    const glm::vec3 objectCenter = Centroid(bounds);
+    const float objectHalfExtent = MaxHalfExtent(bounds);
+    
+    if (nodeID == 0) {
+        // The root also stores everything that's outside of the world, but objects that moved into the world should
+        // descend into the tree.
+        return !IsInCell(objectCenter, node.center, node.halfSize) || node.depth == maxDepth || objectHalfExtent > node.halfSize * 0.5f;
+    }
+    
+    // Staying in a node that's bigger than necessary is fine. Only leaving the loose bounds isn't.
+    return IsInCell(objectCenter, node.center, node.halfSize) && objectHalfExtent <= node.halfSize;
+}
+
+void LooseOctree::attachToNode(std::uint32_t handle, std::uint32_t nodeID) {
+    Object& object = objects[handle];
+    Node& node = nodes[nodeID];
+    
+    object.node = nodeID;
+    object.indexInNode = static_cast<std::uint32_t>(node.objectHandles.size());
+    node.objectHandles.push_back(handle);
+    
+    for (std::uint32_t n = nodeID; n != NoNode; n = nodes[n].parent) {
+        nodes[n].subtreeObjectCount++;
+    }
+}
+
+void LooseOctree::detachFromNode(std::uint32_t handle) {
+    Object& object = objects[handle];
+    Node& node = nodes[object.node];
+    
+    // Swap with the last handle to make removal O(1)
+    const std::uint32_t lastHandle = node.objectHandles.back();
+    node.objectHandles[object.indexInNode] = lastHandle;
+    objects[lastHandle].indexInNode = object.indexInNode;
+    node.objectHandles.pop_back();
+    
+    for (std::uint32_t n = object.node; n != NoNode; n = nodes[n].parent) {
+        nodes[n].subtreeObjectCount--;
+    }
+    
+    object.node = NoNode;
+}
+
+std::uint32_t LooseOctree::insert(std::uint32_t id, const AABB& bounds) {
+    std::uint32_t handle;
+    if (freeHandles.empty()) {
+        handle = static_cast<std::uint32_t>(objects.size());
+        objects.emplace_back();
+    } else {
+        handle = freeHandles.back();
+        freeHandles.pop_back();
+    }
+    
+    objects[handle].bounds = bounds;
+    objects[handle].id = id;
+    attachToNode(handle, findNode(bounds));
+    
+    objectCount++;
+    return handle;
+}
+
+void LooseOctree::update(std::uint32_t handle, const AABB& bounds) {
+    objects[handle].bounds = bounds;
+    
+    if (!fitsNode(objects[handle].node, bounds)) {
+        detachFromNode(handle);
+        attachToNode(handle, findNode(bounds));
+    }
+}
+
+void LooseOctree::remove(std::uint32_t handle) {
+    detachFromNode(handle);
+    objects[handle].id = InvalidHandle;
+    freeHandles.push_back(handle);
+    
+    objectCount--;
+}
+
+void LooseOctree::appendAll(std::uint32_t nodeID, std::vector<std::uint32_t>& ids) const {
+    const Node& node = nodes[nodeID];
+    if (node.subtreeObjectCount == 0) {
+        return;
+    }
+    
+    for (std::uint32_t handle : node.objectHandles) {
+        ids.push_back(objects[handle].id);
+    }
+    
+    for (std::uint32_t child : node.children) {
+        if (child != NoNode) {
+            appendAll(child, ids);
+        }
+    }
+}
+
+void LooseOctree::queryFrustumNode(std::uint32_t nodeID, const CullingPlanes& planes, std::uint8_t planeMask, std::vector<std::uint32_t>& ids) const {
+    const Node& node = nodes[nodeID];
+    if (node.subtreeObjectCount == 0) {
+        return;
+    }
+    
+    // The root may contain objects that are outside of its loose bounds, so it's never culled
+    if (nodeID != 0) {
+        const PlaneTestResult result = TestAABBAgainstPlanes(planes, node.looseBounds, planeMask);
+        if (result == PlaneTestResult::Outside) {
+            return;
+        } else if (result == PlaneTestResult::Inside) {
+            appendAll(nodeID, ids);
+            return;
+        }
+    }
+    
+    for (std::uint32_t handle : node.objectHandles) {
+        const Object& object = objects[handle];
+        std::uint8_t objectMask = planeMask;
+        
+        if (TestAABBAgainstPlanes(planes, object.bounds, objectMask) != PlaneTestResult::Outside) {
+            ids.push_back(object.id);
+        }
+    }
+    
+    for (std::uint32_t child : node.children) {
+        if (child != NoNode) {
+            queryFrustumNode(child, planes, planeMask, ids);
+        }
+    }
+}
+
+void LooseOctree::queryFrustum(const CullingPlanes& planes, std::vector<std::uint32_t>& ids) const {
+    queryFrustumNode(0, planes, AllFrustumPlanes, ids);
+}
+
+template <typename NodeTest, typename ObjectTest>
+void LooseOctree::query(NodeTest nodeTest, ObjectTest objectTest, std::vector<std::uint32_t>& ids) const {
+    std::vector<std::uint32_t> stack;
+    stack.push_back(0);
+    
+    while (!stack.empty()) {
+        const std::uint32_t nodeID = stack.back();
+        const Node& node = nodes[nodeID];
+        stack.pop_back();
+        
+        if (node.subtreeObjectCount == 0 || (nodeID != 0 && !nodeTest(node.looseBounds))) {
+            continue;
+        }
+        
+        for (std::uint32_t handle : node.objectHandles) {
+            if (objectTest(objects[handle].bounds)) {
+                ids.push_back(objects[handle].id);
+            }
+        }
+        
+        for (std::uint32_t child : node.children) {
+            if (child != NoNode) {
+                stack.push_back(child);
+            }
+        }
+    }
+}
+
+void LooseOctree::queryAABB(const AABB& aabb, std::vector<std::uint32_t>& ids) const {
+    auto test = [&aabb](const AABB& bounds) {
+        return AABBOverlapsAABB(bounds, aabb);
+    };
+    
+    query(test, test, ids);
+}
+
+void LooseOctree::querySphere(const BoundingSphere& sphere, std::vector<std::uint32_t>& ids) const {
+    auto test = [&sphere](const AABB& bounds) {
+        return SphereOverlapsAABB(sphere, bounds);
+    };
+    
+    query(test, test, ids);
+}
+
+bool LooseOctree::raycast(const Ray& ray, float maxDistance, RayHit& hit) const {
+    bool found = false;
+    float closest = maxDistance;
+    
+    std::vector<std::uint32_t> stack;
+    stack.push_back(0);
+    
+    while (!stack.empty()) {
+        const std::uint32_t nodeID = stack.back();
+        const Node& node = nodes[nodeID];
+        stack.pop_back();
+        
+        float distance;
+        if (node.subtreeObjectCount == 0 || (nodeID != 0 && !IntersectRayAABB(ray, node.looseBounds, closest, distance))) {
+            continue;
+        }
+        
+        for (std::uint32_t handle : node.objectHandles) {
+            const Object& object = objects[handle];
+            
+            if (IntersectRayAABB(ray, object.bounds, closest, distance) && (!found || distance < closest)) {
+                found = true;
+                closest = distance;
+                hit.id = object.id;
+                hit.distance = distance;
+            }
+        }
+        
+        for (std::uint32_t child : node.children) {
+            if (child != NoNode) {
+                stack.push_back(child);
+            }
+        }
+    }
+    
+    return found;
+}
+}
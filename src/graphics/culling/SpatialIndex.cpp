@@ -0,0 +1,190 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/culling/SpatialIndex.hpp"
+#include "threading/ThreadProfiler.hpp"
+
+#include <algorithm>
+
+namespace iyf {
+SpatialIndex::SpatialIndex(const AABB& worldBounds, std::uint32_t maxOctreeDepth) : octree(worldBounds, maxOctreeDepth), pendingStaticCount(0) {}
+
+void SpatialIndex::insert(std::uint32_t id, const AABB& bounds, bool isStatic) {
+    if (id >= records.size()) {
+        records.resize(id + 1);
+    }
+    
+    Record& record = records[id];
+    if (record.location != Location::None) {
+        return;
+    }
+    
+    // New static entities wait in the octree until the next BVH rebuild
+    record.location = Location::Octree;
+    record.isStatic = isStatic;
+    record.slot = octree.insert(id, bounds);
+    
+    if (isStatic) {
+        pendingStaticCount++;
+    }
+}
+
+void SpatialIndex::update(std::uint32_t id, const AABB& bounds, bool isStatic) {
+    if (!contains(id)) {
+        insert(id, bounds, isStatic);
+        return;
+    }
+    
+    Record& record = records[id];
+    if (record.location == Location::BVH) {
+        // Static objects that move are rare (e.g., an editor operation). Moving them to the octree is cheaper than
+        // rebuilding the BVH.
+        bvh.remove(record.slot);
+        
+        record.location = Location::Octree;
+        record.slot = octree.insert(id, bounds);
+    } else {
+        octree.update(record.slot, bounds);
+        
+        if (record.isStatic) {
+            pendingStaticCount--;
+        }
+    }
+    
+    record.isStatic = isStatic;
+    if (isStatic) {
+        pendingStaticCount++;
+    }
+}
+
+void SpatialIndex::remove(std::uint32_t id) {
+    if (!contains(id)) {
+        return;
+    }
+    
+    Record& record = records[id];
+    if (record.location == Location::BVH) {
+        bvh.remove(record.slot);
+    } else {
+        octree.remove(record.slot);
+        
+        if (record.isStatic) {
+            pendingStaticCount--;
+        }
+    }
+    
+    record = Record();
+}
+
+void SpatialIndex::clear() {
+    records.clear();
+    bvh.clear();
+    octree.clear();
+    pendingStaticCount = 0;
+}
+
+bool SpatialIndex::commit(bool force) {
+    // Rebuilding when the number of pending entities reaches a fraction of the BVH size keeps the amortized cost
+    // of an insertion constant, even when a level with hundreds of thousands of props is loaded one entity at a time.
+    const std::size_t pendingThreshold = std::max(MinPendingStaticCount, bvh.size() / 4);
+    const bool tooManyRemoved = bvh.getRemovedCount() > MinPendingStaticCount && bvh.getRemovedCount() > bvh.size() / 4;
+    const bool anythingChanged = pendingStaticCount > 0 || bvh.getRemovedCount() > 0;
+    
+    if (pendingStaticCount >= pendingThreshold || tooManyRemoved || (force && anythingChanged)) {
+        rebuildBVH();
+        return true;
+    }
+    
+    return false;
+}
+
+void SpatialIndex::rebuildBVH() {
+    IYFT_PROFILE(RebuildStaticBVH, iyft::ProfilerTag::Graphics);
+    
+    std::vector<StaticBVH::Entry> entries;
+    entries.reserve(bvh.size() + pendingStaticCount);
+    
+    for (std::size_t slot = 0; slot < bvh.getEntryCount(); ++slot) {
+        const std::uint32_t id = bvh.getEntryID(slot);
+        
+        if (id != StaticBVH::InvalidID) {
+            entries.push_back({bvh.getEntryBounds(slot), id});
+        }
+    }
+    
+    for (std::uint32_t id = 0; id < records.size(); ++id) {
+        Record& record = records[id];
+        
+        if (record.location == Location::Octree && record.isStatic) {
+            entries.push_back({octree.getBounds(record.slot), id});
+            octree.remove(record.slot);
+        }
+    }
+    
+    pendingStaticCount = 0;
+    bvh.build(std::move(entries));
+    
+    // The build reorders the entries
+    for (std::size_t slot = 0; slot < bvh.getEntryCount(); ++slot) {
+        Record& record = records[bvh.getEntryID(slot)];
+        record.location = Location::BVH;
+        record.slot = static_cast<std::uint32_t>(slot);
+    }
+}
+
+void SpatialIndex::queryFrustum(const CullingPlanes& planes, std::vector<std::uint32_t>& ids) const {
+    bvh.queryFrustum(planes, ids);
+    octree.queryFrustum(planes, ids);
+}
+
+void SpatialIndex::queryAABB(const AABB& aabb, std::vector<std::uint32_t>& ids) const {
+    bvh.queryAABB(aabb, ids);
+    octree.queryAABB(aabb, ids);
+}
+
+void SpatialIndex::querySphere(const BoundingSphere& sphere, std::vector<std::uint32_t>& ids) const {
+    bvh.querySphere(sphere, ids);
+    octree.querySphere(sphere, ids);
+}
+
+bool SpatialIndex::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const {
+    const Ray ray(origin, direction);
+    
+    bool found = bvh.raycast(ray, maxDistance, hit);
+    if (found) {
+        maxDistance = hit.distance;
+    }
+    
+    // The octree only reports hits that are closer than the one found in the BVH
+    if (octree.raycast(ray, maxDistance, hit)) {
+        found = true;
+    }
+    
+    return found;
+}
+}
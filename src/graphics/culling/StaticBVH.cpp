@@ -0,0 +1,376 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/culling/StaticBVH.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace iyf {
+/// Number of bins used when evaluating the surface area heuristic
+static constexpr std::size_t BinCount = 12;
+
+static inline glm::vec3 Centroid(const AABB& aabb) {
+    return (aabb.vertices[0] + aabb.vertices[1]) * 0.5f;
+}
+
+static inline void Grow(AABB& aabb, const AABB& other) {
+    for (int i = 0; i < 3; ++i) {
+        aabb.vertices[0][i] = std::min(aabb.vertices[0][i], other.vertices[0][i]);
+        aabb.vertices[1][i] = std::max(aabb.vertices[1][i], other.vertices[1][i]);
+    }
+}
+
+static inline float HalfSurfaceArea(const AABB& aabb) {
+    const glm::vec3 extent = aabb.vertices[1] - aabb.vertices[0];
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+static inline AABB MakeEmptyAABB() {
+    const float max = std::numeric_limits<float>::max();
+    return AABB(glm::vec3(max, max, max), glm::vec3(-max, -max, -max));
+}
+
+void StaticBVH::build(std::vector<Entry> newEntries) {
+    entries = std::move(newEntries);
+    removedCount = 0;
+    nodes.clear();
+    
+    if (entries.empty()) {
+        return;
+    }
+    
+    // A binary tree with leaves of at least one entry never has more than 2n - 1 nodes
+    nodes.reserve(entries.size() * 2);
+    nodes.emplace_back();
+    buildNode(0, 0, static_cast<std::uint32_t>(entries.size()));
+    nodes.shrink_to_fit();
+}
+
+void StaticBVH::buildNode(std::uint32_t nodeID, std::uint32_t first, std::uint32_t count) {
+    AABB bounds = MakeEmptyAABB();
+    AABB centroidBounds = MakeEmptyAABB();
+    
+    for (std::uint32_t i = first; i < first + count; ++i) {
+        Grow(bounds, entries[i].bounds);
+        
+        const glm::vec3 c = Centroid(entries[i].bounds);
+        Grow(centroidBounds, AABB(c, c));
+    }
+    
+    nodes[nodeID].bounds = bounds;
+    
+    if (count <= MaxLeafSize) {
+        nodes[nodeID].offset = first;
+        nodes[nodeID].count = count;
+        return;
+    }
+    
+    // Split along the axis with the largest centroid extent
+    const glm::vec3 centroidExtent = centroidBounds.vertices[1] - centroidBounds.vertices[0];
+    int axis = 0;
+    if (centroidExtent.y > centroidExtent[axis]) {
+        axis = 1;
+    }
+    if (centroidExtent.z > centroidExtent[axis]) {
+        axis = 2;
+    }
+    
+    const float axisMin = centroidBounds.vertices[0][axis];
+    const float axisExtent = centroidExtent[axis];
+    
+    std::uint32_t splitCount = 0;
+    if (axisExtent > 0.0f) {
+        std::array<AABB, BinCount> binBounds;
+        std::array<std::uint32_t, BinCount> binCounts;
+        binBounds.fill(MakeEmptyAABB());
+        binCounts.fill(0);
+        
+        const float scale = static_cast<float>(BinCount) / axisExtent;
+        auto binOf = [axis, axisMin, scale](const Entry& e) {
+            const std::size_t bin = static_cast<std::size_t>((Centroid(e.bounds)[axis] - axisMin) * scale);
+            return std::min(bin, BinCount - 1);
+        };
+        
+        for (std::uint32_t i = first; i < first + count; ++i) {
+            const std::size_t bin = binOf(entries[i]);
+            binCounts[bin]++;
+            Grow(binBounds[bin], entries[i].bounds);
+        }
+        
+        // Sweep from the right to get the cost of every right side, then from the left to find the best split
+        std::array<float, BinCount> rightCosts;
+        AABB accumulated = MakeEmptyAABB();
+        std::uint32_t accumulatedCount = 0;
+        for (std::size_t b = BinCount - 1; b > 0; --b) {
+            Grow(accumulated, binBounds[b]);
+            accumulatedCount += binCounts[b];
+            rightCosts[b] = (accumulatedCount == 0) ? 0.0f : HalfSurfaceArea(accumulated) * static_cast<float>(accumulatedCount);
+        }
+        
+        float bestCost = std::numeric_limits<float>::max();
+        std::size_t bestBin = 0;
+        accumulated = MakeEmptyAABB();
+        accumulatedCount = 0;
+        for (std::size_t b = 0; b < BinCount - 1; ++b) {
+            Grow(accumulated, binBounds[b]);
+            accumulatedCount += binCounts[b];
+            
+            const float leftCost = (accumulatedCount == 0) ? 0.0f : HalfSurfaceArea(accumulated) * static_cast<float>(accumulatedCount);
+            const float cost = leftCost + rightCosts[b + 1];
+            
+            if (accumulatedCount != 0 && accumulatedCount != count && cost < bestCost) {
+                bestCost = cost;
+                bestBin = b;
+            }
+        }
+        
+        if (bestCost < std::numeric_limits<float>::max()) {
+            auto middle = std::partition(entries.begin() + first, entries.begin() + first + count, [&binOf, bestBin](const Entry& e) {
+                return binOf(e) <= bestBin;
+            });
+            
+            splitCount = static_cast<std::uint32_t>(middle - (entries.begin() + first));
+        }
+    }
+    
+    // All centroids are (nearly) identical. Split in the middle to keep the depth logarithmic.
+    if (splitCount == 0 || splitCount == count) {
+        splitCount = count / 2;
+        std::nth_element(entries.begin() + first, entries.begin() + first + splitCount, entries.begin() + first + count, [axis](const Entry& a, const Entry& b) {
+            return Centroid(a.bounds)[axis] < Centroid(b.bounds)[axis];
+        });
+    }
+    
+    nodes[nodeID].count = 0;
+    
+    const std::uint32_t leftID = static_cast<std::uint32_t>(nodes.size());
+    nodes.emplace_back();
+    buildNode(leftID, first, splitCount);
+    
+    const std::uint32_t rightID = static_cast<std::uint32_t>(nodes.size());
+    nodes.emplace_back();
+    buildNode(rightID, first + splitCount, count - splitCount);
+    
+    nodes[nodeID].offset = rightID;
+}
+
+void StaticBVH::clear() {
+    nodes.clear();
+    entries.clear();
+    removedCount = 0;
+}
+
+void StaticBVH::remove(std::size_t slot) {
+    if (entries[slot].id != InvalidID) {
+        entries[slot].id = InvalidID;
+        removedCount++;
+    }
+}
+
+void StaticBVH::appendAll(std::uint32_t nodeID, std::vector<std::uint32_t>& ids) const {
+    // Leaves of a subtree occupy a contiguous range of entries, so there's no need to walk the nodes
+    std::uint32_t firstLeaf = nodeID;
+    while (nodes[firstLeaf].count == 0) {
+        firstLeaf++;
+    }
+    
+    std::uint32_t lastLeaf = nodeID;
+    while (nodes[lastLeaf].count == 0) {
+        lastLeaf = nodes[lastLeaf].offset;
+    }
+    
+    const std::uint32_t begin = nodes[firstLeaf].offset;
+    const std::uint32_t end = nodes[lastLeaf].offset + nodes[lastLeaf].count;
+    
+    for (std::uint32_t i = begin; i < end; ++i) {
+        if (entries[i].id != InvalidID) {
+            ids.push_back(entries[i].id);
+        }
+    }
+}
+
+void StaticBVH::queryFrustumNode(std::uint32_t nodeID, const CullingPlanes& planes, std::uint8_t planeMask, std::vector<std::uint32_t>& ids) const {
+    const Node& node = nodes[nodeID];
+    
+    const PlaneTestResult result = TestAABBAgainstPlanes(planes, node.bounds, planeMask);
+    if (result == PlaneTestResult::Outside) {
+        return;
+    } else if (result == PlaneTestResult::Inside) {
+        appendAll(nodeID, ids);
+        return;
+    }
+    
+    if (node.count != 0) {
+        for (std::uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+            const Entry& entry = entries[i];
+            std::uint8_t entryMask = planeMask;
+            
+            if (entry.id != InvalidID && TestAABBAgainstPlanes(planes, entry.bounds, entryMask) != PlaneTestResult::Outside) {
+                ids.push_back(entry.id);
+            }
+        }
+        
+        return;
+    }
+    
+    queryFrustumNode(nodeID + 1, planes, planeMask, ids);
+    queryFrustumNode(node.offset, planes, planeMask, ids);
+}
+
+void StaticBVH::queryFrustum(const CullingPlanes& planes, std::vector<std::uint32_t>& ids) const {
+    if (nodes.empty()) {
+        return;
+    }
+    
+    queryFrustumNode(0, planes, AllFrustumPlanes, ids);
+}
+
+void StaticBVH::queryAABB(const AABB& aabb, std::vector<std::uint32_t>& ids) const {
+    if (nodes.empty()) {
+        return;
+    }
+    
+    std::vector<std::uint32_t> stack;
+    stack.push_back(0);
+    
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        const std::uint32_t nodeID = stack.back();
+        stack.pop_back();
+        
+        if (!AABBOverlapsAABB(node.bounds, aabb)) {
+            continue;
+        }
+        
+        if (node.count == 0) {
+            stack.push_back(node.offset);
+            stack.push_back(nodeID + 1);
+            continue;
+        }
+        
+        for (std::uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+            if (entries[i].id != InvalidID && AABBOverlapsAABB(entries[i].bounds, aabb)) {
+                ids.push_back(entries[i].id);
+            }
+        }
+    }
+}
+
+void StaticBVH::querySphere(const BoundingSphere& sphere, std::vector<std::uint32_t>& ids) const {
+    if (nodes.empty()) {
+        return;
+    }
+    
+    std::vector<std::uint32_t> stack;
+    stack.push_back(0);
+    
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        const std::uint32_t nodeID = stack.back();
+        stack.pop_back();
+        
+        if (!SphereOverlapsAABB(sphere, node.bounds)) {
+            continue;
+        }
+        
+        if (node.count == 0) {
+            stack.push_back(node.offset);
+            stack.push_back(nodeID + 1);
+            continue;
+        }
+        
+        for (std::uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+            if (entries[i].id != InvalidID && SphereOverlapsAABB(sphere, entries[i].bounds)) {
+                ids.push_back(entries[i].id);
+            }
+        }
+    }
+}
+
+bool StaticBVH::raycast(const Ray& ray, float maxDistance, RayHit& hit) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    
+    bool found = false;
+    float closest = maxDistance;
+    
+    std::vector<std::uint32_t> stack;
+    stack.push_back(0);
+    
+    while (!stack.empty()) {
+        const std::uint32_t nodeID = stack.back();
+        const Node& node = nodes[nodeID];
+        stack.pop_back();
+        
+        float distance;
+        if (!IntersectRayAABB(ray, node.bounds, closest, distance)) {
+            continue;
+        }
+        
+        if (node.count != 0) {
+            for (std::uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                if (entries[i].id != InvalidID && IntersectRayAABB(ray, entries[i].bounds, closest, distance) && (!found || distance < closest)) {
+                    found = true;
+                    closest = distance;
+                    hit.id = entries[i].id;
+                    hit.distance = distance;
+                }
+            }
+            
+            continue;
+        }
+        
+        // Visit the closer child first. It's pushed last, so it ends up on top of the stack.
+        const std::uint32_t leftID = nodeID + 1;
+        const std::uint32_t rightID = node.offset;
+        
+        float leftDistance;
+        float rightDistance;
+        const bool leftHit = IntersectRayAABB(ray, nodes[leftID].bounds, closest, leftDistance);
+        const bool rightHit = IntersectRayAABB(ray, nodes[rightID].bounds, closest, rightDistance);
+        
+        if (leftHit && rightHit) {
+            if (leftDistance < rightDistance) {
+                stack.push_back(rightID);
+                stack.push_back(leftID);
+            } else {
+                stack.push_back(leftID);
+                stack.push_back(rightID);
+            }
+        } else if (leftHit) {
+            stack.push_back(leftID);
+        } else if (rightHit) {
+            stack.push_back(rightID);
+        }
+    }
+    
+    return found;
+}
+}
@@ -0,0 +1,239 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/materials/MaterialTemplateFormat.hpp"
+#include "io/serialization/Serializer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+
+namespace iyf::mtf::v2 {
+static std::uint64_t AlignUp(std::uint64_t value) {
+    return (value + BlobAlignment - 1) & ~static_cast<std::uint64_t>(BlobAlignment - 1);
+}
+
+static void WritePadding(Serializer& output, std::uint64_t targetPosition) {
+    static const char Zeros[BlobAlignment] = {};
+    
+    const std::int64_t position = output.tell();
+    assert(position >= 0 && static_cast<std::uint64_t>(position) <= targetPosition);
+    
+    output.writeBytes(Zeros, targetPosition - static_cast<std::uint64_t>(position));
+}
+
+/// The order of the table
+static std::tuple<std::uint64_t, std::uint8_t, std::uint8_t> MakeSortKey(std::uint64_t macroHash, std::uint8_t vertexDataLayout, std::uint8_t stage) {
+    return std::make_tuple(macroHash, vertexDataLayout, stage);
+}
+
+VariantStage ToVariantStage(ShaderStageFlagBits stage) {
+    switch (stage) {
+        case ShaderStageFlagBits::Vertex:
+            return VariantStage::Vertex;
+        case ShaderStageFlagBits::Geometry:
+            return VariantStage::Geometry;
+        case ShaderStageFlagBits::TessControl:
+            return VariantStage::TessControl;
+        case ShaderStageFlagBits::TessEvaluation:
+            return VariantStage::TessEvaluation;
+        case ShaderStageFlagBits::Fragment:
+            return VariantStage::Fragment;
+        default:
+            throw std::invalid_argument("Material templates can't store shaders of this stage");
+    }
+}
+
+ShaderStageFlagBits ToShaderStage(VariantStage stage) {
+    switch (stage) {
+        case VariantStage::Vertex:
+            return ShaderStageFlagBits::Vertex;
+        case VariantStage::Geometry:
+            return ShaderStageFlagBits::Geometry;
+        case VariantStage::TessControl:
+            return ShaderStageFlagBits::TessControl;
+        case VariantStage::TessEvaluation:
+            return ShaderStageFlagBits::TessEvaluation;
+        case VariantStage::Fragment:
+            return ShaderStageFlagBits::Fragment;
+        case VariantStage::COUNT:
+            break;
+    }
+    
+    throw std::invalid_argument("Invalid VariantStage");
+}
+
+void WriteMaterialTemplate(Serializer& output, std::uint64_t macroVersionHash, const std::vector<VariantData>& variants) {
+    std::vector<const VariantData*> sorted;
+    sorted.reserve(variants.size());
+    
+    for (const VariantData& variant : variants) {
+        if (variant.stage >= VariantStage::COUNT || variant.size % 4 != 0 || (variant.size > 0 && variant.bytecode == nullptr)) {
+            throw std::invalid_argument("Invalid variant");
+        }
+        
+        sorted.push_back(&variant);
+    }
+    
+    std::sort(sorted.begin(), sorted.end(), [](const VariantData* a, const VariantData* b) {
+        return MakeSortKey(a->macroHash, a->vertexDataLayout, static_cast<std::uint8_t>(a->stage)) <
+               MakeSortKey(b->macroHash, b->vertexDataLayout, static_cast<std::uint8_t>(b->stage));
+    });
+    
+    const auto duplicate = std::adjacent_find(sorted.begin(), sorted.end(), [](const VariantData* a, const VariantData* b) {
+        return a->macroHash == b->macroHash && a->vertexDataLayout == b->vertexDataLayout && a->stage == b->stage;
+    });
+    
+    if (duplicate != sorted.end()) {
+        throw std::invalid_argument("Multiple variants have the same macro hash, vertex data layout and stage");
+    }
+    
+    std::vector<std::uint64_t> offsets;
+    offsets.reserve(sorted.size());
+    
+    std::uint64_t offset = AlignUp(sizeof(Header) + sorted.size() * sizeof(VariantRecord));
+    for (const VariantData* variant : sorted) {
+        offsets.push_back(offset);
+        offset = AlignUp(offset + variant->size);
+    }
+    
+    const std::uint64_t fileSize = offset;
+    
+    output.writeBytes(MagicNumber, sizeof(MagicNumber));
+    output.writeUInt16(VersionNumber);
+    output.writeUInt8(0);
+    output.writeUInt32(static_cast<std::uint32_t>(sorted.size()));
+    output.writeUInt32(0);
+    output.writeUInt64(macroVersionHash);
+    output.writeUInt64(fileSize);
+    
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        const VariantData* variant = sorted[i];
+        
+        output.writeUInt64(variant->macroHash);
+        output.writeUInt64(offsets[i]);
+        output.writeUInt32(variant->size);
+        output.writeUInt8(variant->vertexDataLayout);
+        output.writeUInt8(static_cast<std::uint8_t>(variant->stage));
+        output.writeUInt8(0);
+        output.writeUInt8(0);
+    }
+    
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        WritePadding(output, offsets[i]);
+        output.writeBytes(sorted[i]->bytecode, sorted[i]->size);
+    }
+    
+    WritePadding(output, fileSize);
+}
+
+VariantRecord MaterialTemplateFileView::getRecord(std::size_t id) const {
+    assert(id < header.variantCount);
+    
+    VariantRecord record;
+    std::memcpy(&record, records + id * sizeof(VariantRecord), sizeof(VariantRecord));
+    return record;
+}
+
+std::int64_t MaterialTemplateFileView::findVariant(std::uint64_t macroHash, std::uint8_t vertexDataLayout, VariantStage stage) const {
+    const auto key = MakeSortKey(macroHash, vertexDataLayout, static_cast<std::uint8_t>(stage));
+    
+    std::size_t first = 0;
+    std::size_t count = header.variantCount;
+    
+    while (count > 0) {
+        const std::size_t step = count / 2;
+        const std::size_t middle = first + step;
+        const VariantRecord record = getRecord(middle);
+        
+        if (MakeSortKey(record.macroHash, record.vertexDataLayout, record.stage) < key) {
+            first = middle + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    
+    if (first < header.variantCount) {
+        const VariantRecord record = getRecord(first);
+        
+        if (MakeSortKey(record.macroHash, record.vertexDataLayout, record.stage) == key) {
+            return static_cast<std::int64_t>(first);
+        }
+    }
+    
+    return -1;
+}
+
+bool ParseMaterialTemplate(const char* data, std::size_t size, MaterialTemplateFileView& view) {
+    if (data == nullptr || size < sizeof(Header)) {
+        return false;
+    }
+    
+    Header& header = view.header;
+    std::memcpy(&header, data, sizeof(Header));
+    
+    const std::uint16_t versionNumber = static_cast<std::uint16_t>(header.versionNumber[0] | (header.versionNumber[1] << 8));
+    if (std::memcmp(header.magicNumber, MagicNumber, sizeof(MagicNumber)) != 0 || versionNumber != VersionNumber) {
+        return false;
+    }
+    
+    if (header.fileSize != size || sizeof(Header) + static_cast<std::uint64_t>(header.variantCount) * sizeof(VariantRecord) > size) {
+        return false;
+    }
+    
+    view.records = data + sizeof(Header);
+    view.data = data;
+    
+    for (std::size_t i = 0; i < header.variantCount; ++i) {
+        const VariantRecord record = view.getRecord(i);
+        
+        if (record.stage >= static_cast<std::uint8_t>(VariantStage::COUNT) || record.size % 4 != 0) {
+            return false;
+        }
+        
+        if (record.offset % BlobAlignment != 0 || record.offset > size || record.size > size - record.offset) {
+            return false;
+        }
+        
+        // The binary search depends on the order and duplicates would be ambiguous
+        if (i > 0) {
+            const VariantRecord previous = view.getRecord(i - 1);
+            
+            if (!(MakeSortKey(previous.macroHash, previous.vertexDataLayout, previous.stage) < MakeSortKey(record.macroHash, record.vertexDataLayout, record.stage))) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+}
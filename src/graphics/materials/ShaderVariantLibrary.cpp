@@ -0,0 +1,131 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/materials/ShaderVariantLibrary.hpp"
+#include "graphics/GraphicsAPI.hpp"
+#include "io/FileSystem.hpp"
+#include "io/exceptions/FileException.hpp"
+#include "logging/Logger.hpp"
+
+#include "fmt/format.h"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace iyf {
+ShaderVariantLibrary::~ShaderVariantLibrary() {
+    assert(shaders.empty());
+}
+
+bool ShaderVariantLibrary::open(const FileSystem& filesystem, const Path& path) {
+    {
+        std::lock_guard<std::mutex> lock(shaderMutex);
+        
+        if (!shaders.empty()) {
+            throw std::logic_error("All shaders need to be released before opening a new file");
+        }
+    }
+    
+    file = FileView();
+    view = mtf::v2::MaterialTemplateFileView();
+    
+    FileView contents;
+    try {
+        contents = filesystem.mapWholeFile(path);
+    } catch (const FileException& e) {
+        LOG_W("Failed to read the material template {}: {}", path, e.what());
+        return false;
+    }
+    
+    mtf::v2::MaterialTemplateFileView newView;
+    if (!mtf::v2::ParseMaterialTemplate(contents.data(), contents.size(), newView)) {
+        LOG_W("{} is not a valid version {} material template", path, mtf::v2::VersionNumber);
+        return false;
+    }
+    
+    file = std::move(contents);
+    view = newView;
+    
+    return true;
+}
+
+const char* ShaderVariantLibrary::findBytecode(std::uint64_t macroHash, VertexDataLayout vertexDataLayout, ShaderStageFlagBits stage, std::size_t& size) const {
+    if (!isOpen()) {
+        return nullptr;
+    }
+    
+    const std::int64_t id = view.findVariant(macroHash, static_cast<std::uint8_t>(vertexDataLayout), mtf::v2::ToVariantStage(stage));
+    if (id < 0) {
+        return nullptr;
+    }
+    
+    const mtf::v2::VariantRecord record = view.getRecord(static_cast<std::size_t>(id));
+    size = record.size;
+    
+    return view.getBytecode(record);
+}
+
+ShaderHnd ShaderVariantLibrary::getShader(GraphicsAPI* api, std::uint64_t macroHash, VertexDataLayout vertexDataLayout, ShaderStageFlagBits stage) {
+    if (!isOpen()) {
+        return ShaderHnd();
+    }
+    
+    const std::int64_t id = view.findVariant(macroHash, static_cast<std::uint8_t>(vertexDataLayout), mtf::v2::ToVariantStage(stage));
+    if (id < 0) {
+        return ShaderHnd();
+    }
+    
+    std::lock_guard<std::mutex> lock(shaderMutex);
+    
+    const auto result = shaders.find(static_cast<std::uint32_t>(id));
+    if (result != shaders.end()) {
+        return result->second;
+    }
+    
+    const mtf::v2::VariantRecord record = view.getRecord(static_cast<std::size_t>(id));
+    const std::string name = fmt::format("MaterialTemplateVariant{:016x}_{}_{}", macroHash, record.vertexDataLayout, record.stage);
+    
+    const ShaderHnd shader = api->createShader(stage, view.getBytecode(record), record.size, name.c_str());
+    if (shader.isValid()) {
+        shaders.emplace(static_cast<std::uint32_t>(id), shader);
+    }
+    
+    return shader;
+}
+
+void ShaderVariantLibrary::releaseShaders(GraphicsAPI* api) {
+    std::lock_guard<std::mutex> lock(shaderMutex);
+    
+    for (const auto& shader : shaders) {
+        api->destroyShader(shader.second);
+    }
+    
+    shaders.clear();
+}
+
+}
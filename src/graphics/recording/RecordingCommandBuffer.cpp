@@ -0,0 +1,533 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/recording/RecordingCommandBuffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include "fmt/format.h"
+
+namespace iyf {
+/// Size of the type and payload size fields that precede the payload of every command in the stream
+static constexpr std::size_t CommandHeaderSize = sizeof(RecordedCommandType) + sizeof(std::uint32_t);
+
+RecordingCommandBuffer::RecordingCommandBuffer(BufferLevel level, RecordingCommandPool* pool, std::string name)
+    : CommandBuffer(level), pool(pool), name(std::move(name)), recording(false), renderPassActive(false), continuesRenderPass(false),
+      subpassContents(SubpassContents::Inline) {
+    commandCounts.fill(0);
+    resetBoundState();
+}
+
+void RecordingCommandBuffer::reset() {
+    stream.clear();
+    commandCounts.fill(0);
+    validationErrors.clear();
+    
+    renderPassActive = false;
+    continuesRenderPass = false;
+    subpassContents = SubpassContents::Inline;
+    resetBoundState();
+}
+
+void RecordingCommandBuffer::resetBoundState() {
+    pipelineBound = false;
+    indexBufferBound = false;
+    viewportSet = false;
+    scissorSet = false;
+}
+
+void RecordingCommandBuffer::addError(std::string error) {
+    validationErrors.push_back(fmt::format("{}: {}", name, error));
+}
+
+void RecordingCommandBuffer::recordHeader(RecordedCommandType type, std::uint32_t payloadSize) {
+    if (!recording) {
+        addError("a command was recorded into a buffer that isn't recording");
+    }
+    
+    commandCounts[static_cast<std::size_t>(type)]++;
+    
+    const std::size_t start = stream.size();
+    stream.resize(start + CommandHeaderSize);
+    std::memcpy(stream.data() + start, &type, sizeof(RecordedCommandType));
+    std::memcpy(stream.data() + start + sizeof(RecordedCommandType), &payloadSize, sizeof(std::uint32_t));
+}
+
+void RecordingCommandBuffer::recordPayload(const void* data, std::size_t size) {
+    const std::size_t start = stream.size();
+    stream.resize(start + size);
+    std::memcpy(stream.data() + start, data, size);
+}
+
+void RecordingCommandBuffer::validateInlineCommand(const char* command) {
+    if (renderPassActive && subpassContents == SubpassContents::SecondaryCommandBuffers) {
+        addError(fmt::format("{} was recorded inline in a subpass that expects secondary command buffers", command));
+    }
+}
+
+void RecordingCommandBuffer::validateRenderPassCommand(const char* command) {
+    validateInlineCommand(command);
+    
+    if (!renderPassActive && !continuesRenderPass) {
+        addError(fmt::format("{} was recorded outside of a render pass", command));
+    }
+}
+
+void RecordingCommandBuffer::validateDraw(const char* command, bool indexed) {
+    validateRenderPassCommand(command);
+    
+    // Dynamic state and bindings aren't inherited by secondary command buffers, which makes these easy to forget
+    if (!pipelineBound) {
+        addError(fmt::format("{} was recorded without a bound pipeline", command));
+    }
+    
+    if (indexed && !indexBufferBound) {
+        addError(fmt::format("{} was recorded without a bound index buffer", command));
+    }
+    
+    if (!viewportSet || !scissorSet) {
+        addError(fmt::format("{} was recorded without setting the viewport and the scissor", command));
+    }
+}
+
+void RecordingCommandBuffer::setViewports(std::uint32_t first, std::uint32_t count, const std::vector<Viewport>& viewports) {
+    if (viewports.size() < count) {
+        addError("setViewports received fewer viewports than requested");
+        return;
+    }
+    
+    setViewports(first, count, viewports.data());
+}
+
+void RecordingCommandBuffer::setScissors(std::uint32_t first, std::uint32_t count, const std::vector<Rect2D>& rectangles) {
+    if (rectangles.size() < count) {
+        addError("setScissors received fewer rectangles than requested");
+        return;
+    }
+    
+    setScissors(first, count, rectangles.data());
+}
+
+void RecordingCommandBuffer::setViewports(std::uint32_t first, std::uint32_t count, const Viewport* viewports) {
+    validateInlineCommand("setViewports");
+    
+    recordHeader(RecordedCommandType::SetViewports, static_cast<std::uint32_t>(sizeof(first) + sizeof(Viewport) * count));
+    recordPayload(&first, sizeof(first));
+    recordPayload(viewports, sizeof(Viewport) * count);
+    
+    viewportSet = true;
+}
+
+void RecordingCommandBuffer::setScissors(std::uint32_t first, std::uint32_t count, const Rect2D* rectangles) {
+    validateInlineCommand("setScissors");
+    
+    recordHeader(RecordedCommandType::SetScissors, static_cast<std::uint32_t>(sizeof(first) + sizeof(Rect2D) * count));
+    recordPayload(&first, sizeof(first));
+    recordPayload(rectangles, sizeof(Rect2D) * count);
+    
+    scissorSet = true;
+}
+
+void RecordingCommandBuffer::setViewport(std::uint32_t first, const Viewport& viewport) {
+    setViewports(first, 1, &viewport);
+}
+
+void RecordingCommandBuffer::setScissor(std::uint32_t first, const Rect2D& rectangle) {
+    setScissors(first, 1, &rectangle);
+}
+
+void RecordingCommandBuffer::draw(std::uint32_t vertexCount, std::uint32_t instanceCount, std::uint32_t firstVertex, std::uint32_t firstInstance) {
+    validateDraw("draw", false);
+    record(RecordedCommandType::Draw, vertexCount, instanceCount, firstVertex, firstInstance);
+}
+
+void RecordingCommandBuffer::drawIndexed(std::uint32_t indexCount, std::uint32_t instanceCount, std::uint32_t firstIndex, std::int32_t vertexOffset, std::uint32_t firstInstance) {
+    validateDraw("drawIndexed", true);
+    record(RecordedCommandType::DrawIndexed, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+}
+
+void RecordingCommandBuffer::dispatch(std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+    if (renderPassActive || continuesRenderPass) {
+        addError("dispatch was recorded inside of a render pass");
+    }
+    
+    if (!pipelineBound) {
+        addError("dispatch was recorded without a bound pipeline");
+    }
+    
+    record(RecordedCommandType::Dispatch, x, y, z);
+}
+
+void RecordingCommandBuffer::bindVertexBuffers(std::uint32_t firstBinding, std::uint32_t bindingCount, const std::vector<Buffer>& buffers) {
+    validateInlineCommand("bindVertexBuffers");
+    
+    if (buffers.size() < bindingCount) {
+        addError("bindVertexBuffers received fewer buffers than requested");
+        return;
+    }
+    
+    recordHeader(RecordedCommandType::BindVertexBuffers, static_cast<std::uint32_t>(sizeof(firstBinding) + sizeof(BufferHnd) * bindingCount));
+    recordPayload(&firstBinding, sizeof(firstBinding));
+    
+    for (std::uint32_t i = 0; i < bindingCount; ++i) {
+        const BufferHnd handle = buffers[i].handle();
+        recordPayload(&handle, sizeof(BufferHnd));
+    }
+}
+
+void RecordingCommandBuffer::bindVertexBuffer(std::uint32_t firstBinding, const Buffer& buffer) {
+    validateInlineCommand("bindVertexBuffer");
+    record(RecordedCommandType::BindVertexBuffers, firstBinding, buffer.handle());
+}
+
+void RecordingCommandBuffer::bindIndexBuffer(const Buffer& buffer, IndexType indexType) {
+    validateInlineCommand("bindIndexBuffer");
+    record(RecordedCommandType::BindIndexBuffer, buffer.handle(), indexType);
+    
+    indexBufferBound = true;
+}
+
+void RecordingCommandBuffer::pushConstants(PipelineLayoutHnd handle, ShaderStageFlags flags, std::uint32_t offset, std::uint32_t size, const void* data) {
+    validateInlineCommand("pushConstants");
+    
+    if (size == 0 || (size % 4) != 0 || (offset % 4) != 0) {
+        addError(fmt::format("pushConstants received an invalid range (offset {}, size {})", offset, size));
+    }
+    
+    if (data == nullptr) {
+        addError("pushConstants received no data");
+        return;
+    }
+    
+    const std::uint32_t rawFlags = static_cast<std::uint32_t>(flags);
+    
+    recordHeader(RecordedCommandType::PushConstants, static_cast<std::uint32_t>(sizeof(handle) + sizeof(rawFlags) + sizeof(offset) + size));
+    recordPayload(&handle, sizeof(handle));
+    recordPayload(&rawFlags, sizeof(rawFlags));
+    recordPayload(&offset, sizeof(offset));
+    recordPayload(data, size);
+}
+
+bool RecordingCommandBuffer::bindDescriptorSets(PipelineBindPoint point, PipelineLayoutHnd layout, std::uint32_t firstSet, const std::vector<DescriptorSetHnd> descriptorSets, const std::vector<std::uint32_t> dynamicOffsets) {
+    return bindDescriptorSets(point, layout, firstSet, descriptorSets.size(), descriptorSets.data(), dynamicOffsets.size(), dynamicOffsets.data());
+}
+
+bool RecordingCommandBuffer::bindDescriptorSets(PipelineBindPoint point, PipelineLayoutHnd layout, std::uint32_t firstSet, std::uint32_t descriptorSetCount, const DescriptorSetHnd* descriptorSets, std::uint32_t dynamicOffsetCount, const std::uint32_t* dynamicOffsets) {
+    validateInlineCommand("bindDescriptorSets");
+    
+    const std::uint32_t payloadSize = sizeof(point) + sizeof(layout) + sizeof(firstSet) + sizeof(descriptorSetCount) + sizeof(DescriptorSetHnd) * descriptorSetCount +
+                                      sizeof(dynamicOffsetCount) + sizeof(std::uint32_t) * dynamicOffsetCount;
+    
+    recordHeader(RecordedCommandType::BindDescriptorSets, payloadSize);
+    recordPayload(&point, sizeof(point));
+    recordPayload(&layout, sizeof(layout));
+    recordPayload(&firstSet, sizeof(firstSet));
+    recordPayload(&descriptorSetCount, sizeof(descriptorSetCount));
+    recordPayload(descriptorSets, sizeof(DescriptorSetHnd) * descriptorSetCount);
+    recordPayload(&dynamicOffsetCount, sizeof(dynamicOffsetCount));
+    recordPayload(dynamicOffsets, sizeof(std::uint32_t) * dynamicOffsetCount);
+    
+    return true;
+}
+
+void RecordingCommandBuffer::bindPipeline(const Pipeline& pipeline) {
+    validateInlineCommand("bindPipeline");
+    
+    if (!pipeline.handle.isValid()) {
+        addError("bindPipeline received an invalid pipeline");
+    }
+    
+    record(RecordedCommandType::BindPipeline, pipeline.handle, pipeline.bindPoint);
+    
+    pipelineBound = true;
+}
+
+void RecordingCommandBuffer::begin(const CommandBufferBeginInfo& cbbi) {
+    // Like in Vulkan, beginning a buffer implicitly resets it
+    const bool wasRecording = recording;
+    reset();
+    
+    if (wasRecording) {
+        addError("begin was called on a buffer that's already recording");
+    } else if (!pool->beginRecording()) {
+        addError(fmt::format("buffers of the pool \"{}\" are being recorded on several threads at the same time", pool->getName()));
+    }
+    
+    recording = true;
+    
+    if (cbbi.flags & CommandBufferUsageFlagBits::RenderPassContinue) {
+        if (level == BufferLevel::Primary) {
+            addError("primary command buffers can't continue a render pass");
+        } else if (!cbbi.inheritanceInfo.renderPass.isValid()) {
+            addError("a render pass continuing secondary buffer was begun without a render pass in its inheritance info");
+        } else {
+            continuesRenderPass = true;
+        }
+    }
+}
+
+void RecordingCommandBuffer::end() {
+    if (!recording) {
+        addError("end was called on a buffer that isn't recording");
+        return;
+    }
+    
+    if (renderPassActive) {
+        addError("end was called before ending the render pass");
+    }
+    
+    recording = false;
+    pool->endRecording();
+}
+
+void RecordingCommandBuffer::beginRenderPass(const RenderPassBeginInfo& rpbi, SubpassContents contents) {
+    if (level == BufferLevel::Secondary) {
+        addError("beginRenderPass was recorded into a secondary command buffer");
+    }
+    
+    if (renderPassActive) {
+        addError("beginRenderPass was recorded inside of another render pass");
+    }
+    
+    if (!rpbi.renderPass.isValid() || !rpbi.framebuffer.isValid()) {
+        addError("beginRenderPass received an invalid render pass or framebuffer");
+    }
+    
+    record(RecordedCommandType::BeginRenderPass, rpbi.renderPass, rpbi.framebuffer, contents);
+    
+    renderPassActive = true;
+    subpassContents = contents;
+}
+
+void RecordingCommandBuffer::nextSubpass(SubpassContents contents) {
+    if (!renderPassActive) {
+        addError("nextSubpass was recorded outside of a render pass");
+    }
+    
+    record(RecordedCommandType::NextSubpass, contents);
+    
+    subpassContents = contents;
+}
+
+void RecordingCommandBuffer::endRenderPass() {
+    if (!renderPassActive) {
+        addError("endRenderPass was recorded outside of a render pass");
+    }
+    
+    record(RecordedCommandType::EndRenderPass);
+    
+    renderPassActive = false;
+    subpassContents = SubpassContents::Inline;
+}
+
+void RecordingCommandBuffer::copyImageToBuffer(const Image& srcImage, ImageLayout layout, const Buffer& dstBuffer, const std::vector<BufferImageCopy>& regions) {
+    if (renderPassActive || continuesRenderPass) {
+        addError("copyImageToBuffer was recorded inside of a render pass");
+    }
+    
+    const ImageHnd image = srcImage.getHandle();
+    const BufferHnd buffer = dstBuffer.handle();
+    const std::uint32_t regionCount = static_cast<std::uint32_t>(regions.size());
+    
+    record(RecordedCommandType::CopyImageToBuffer, image, layout, buffer, regionCount);
+}
+
+void RecordingCommandBuffer::executeCommands(std::uint32_t count, CommandBuffer* const* buffers) {
+    if (level == BufferLevel::Secondary) {
+        addError("executeCommands was recorded into a secondary command buffer");
+    }
+    
+    if (renderPassActive && subpassContents != SubpassContents::SecondaryCommandBuffers) {
+        addError("executeCommands was recorded in a subpass that expects inline commands");
+    }
+    
+    recordHeader(RecordedCommandType::ExecuteCommands, static_cast<std::uint32_t>(sizeof(count) + sizeof(RecordingCommandBuffer*) * count));
+    recordPayload(&count, sizeof(count));
+    
+    for (std::uint32_t i = 0; i < count; ++i) {
+        RecordingCommandBuffer* secondary = static_cast<RecordingCommandBuffer*>(buffers[i]);
+        recordPayload(&secondary, sizeof(RecordingCommandBuffer*));
+        
+        if (secondary->getLevel() != BufferLevel::Secondary) {
+            addError(fmt::format("executeCommands received a primary command buffer \"{}\"", secondary->getName()));
+        } else if (secondary->isRecording()) {
+            addError(fmt::format("executeCommands received the secondary buffer \"{}\" that's still recording", secondary->getName()));
+        } else if (renderPassActive != secondary->continuesRenderPass) {
+            addError(fmt::format("the render pass continuation state of the secondary buffer \"{}\" doesn't match the primary", secondary->getName()));
+        }
+        
+        for (const std::string& error : secondary->getValidationErrors()) {
+            validationErrors.push_back(error);
+        }
+    }
+    
+    resetBoundState();
+}
+
+template <typename F>
+static void ForEachCommand(const std::vector<std::uint8_t>& stream, F&& f) {
+    std::size_t offset = 0;
+    while (offset < stream.size()) {
+        RecordedCommandType type;
+        std::uint32_t payloadSize;
+        std::memcpy(&type, stream.data() + offset, sizeof(RecordedCommandType));
+        std::memcpy(&payloadSize, stream.data() + offset + sizeof(RecordedCommandType), sizeof(std::uint32_t));
+        
+        offset += CommandHeaderSize;
+        f(type, stream.data() + offset, payloadSize);
+        offset += payloadSize;
+    }
+}
+
+template <typename F>
+static void ForEachExecutedBuffer(const std::uint8_t* payload, F&& f) {
+    std::uint32_t count;
+    std::memcpy(&count, payload, sizeof(count));
+    
+    for (std::uint32_t i = 0; i < count; ++i) {
+        const RecordingCommandBuffer* secondary;
+        std::memcpy(&secondary, payload + sizeof(count) + i * sizeof(RecordingCommandBuffer*), sizeof(RecordingCommandBuffer*));
+        f(secondary);
+    }
+}
+
+std::uint64_t RecordingCommandBuffer::getTotalCommandCount() const {
+    std::uint64_t total = 0;
+    for (const std::uint64_t count : commandCounts) {
+        total += count;
+    }
+    
+    return total;
+}
+
+std::uint64_t RecordingCommandBuffer::getExecutedCommandCount(RecordedCommandType type) const {
+    std::uint64_t total = getCommandCount(type);
+    
+    if (getCommandCount(RecordedCommandType::ExecuteCommands) == 0) {
+        return total;
+    }
+    
+    ForEachCommand(stream, [&total, type](RecordedCommandType commandType, const std::uint8_t* payload, std::uint32_t) {
+        if (commandType == RecordedCommandType::ExecuteCommands) {
+            ForEachExecutedBuffer(payload, [&total, type](const RecordingCommandBuffer* secondary) {
+                total += secondary->getExecutedCommandCount(type);
+            });
+        }
+    });
+    
+    return total;
+}
+
+void RecordingCommandBuffer::collectCommandPayloads(RecordedCommandType type, std::vector<std::uint8_t>& out) const {
+    ForEachCommand(stream, [&out, type](RecordedCommandType commandType, const std::uint8_t* payload, std::uint32_t payloadSize) {
+        if (commandType == type) {
+            out.insert(out.end(), payload, payload + payloadSize);
+        }
+        
+        if (commandType == RecordedCommandType::ExecuteCommands) {
+            ForEachExecutedBuffer(payload, [&out, type](const RecordingCommandBuffer* secondary) {
+                secondary->collectCommandPayloads(type, out);
+            });
+        }
+    });
+}
+
+// --------------------------------- Command pool
+
+RecordingCommandPool::RecordingCommandPool(std::string name) : name(std::move(name)), recordingBufferCount(0) {}
+
+RecordingCommandPool::~RecordingCommandPool() {
+    for (RecordingCommandBuffer* buffer : allocatedBuffers) {
+        delete buffer;
+    }
+}
+
+CommandBuffer* RecordingCommandPool::allocateCommandBuffer(const char* name, BufferLevel level, bool beginBuffer) {
+    RecordingCommandBuffer* buffer = new RecordingCommandBuffer(level, this, (name != nullptr) ? name : "unnamed");
+    allocatedBuffers.push_back(buffer);
+    
+    if (beginBuffer) {
+        buffer->begin();
+    }
+    
+    return buffer;
+}
+
+std::vector<CommandBuffer*> RecordingCommandPool::allocateCommandBuffers(const std::vector<const char*>* names, std::uint32_t count, BufferLevel level, bool beginBuffers) {
+    if (names != nullptr && names->size() != count) {
+        throw std::runtime_error("The number of names must be equal to the number of buffers.");
+    }
+    
+    std::vector<CommandBuffer*> buffers;
+    buffers.reserve(count);
+    
+    for (std::uint32_t i = 0; i < count; ++i) {
+        buffers.push_back(allocateCommandBuffer((names != nullptr) ? (*names)[i] : nullptr, level, beginBuffers));
+    }
+    
+    return buffers;
+}
+
+void RecordingCommandPool::freeCommandBuffer(CommandBuffer* cmdBuf) {
+    auto it = std::find(allocatedBuffers.begin(), allocatedBuffers.end(), cmdBuf);
+    if (it == allocatedBuffers.end()) {
+        throw std::logic_error("The command buffer wasn't allocated from this pool");
+    }
+    
+    delete *it;
+    allocatedBuffers.erase(it);
+}
+
+void RecordingCommandPool::freeCommandBuffers(const std::vector<CommandBuffer*>& cmdBuffs) {
+    for (CommandBuffer* cmdBuf : cmdBuffs) {
+        freeCommandBuffer(cmdBuf);
+    }
+}
+
+bool RecordingCommandPool::beginRecording() {
+    std::lock_guard<std::mutex> lock(recordingMutex);
+    
+    const std::thread::id currentThread = std::this_thread::get_id();
+    const bool sameThread = (recordingBufferCount == 0) || (recordingThread == currentThread);
+    
+    recordingThread = currentThread;
+    recordingBufferCount++;
+    
+    return sameThread;
+}
+
+void RecordingCommandPool::endRecording() {
+    std::lock_guard<std::mutex> lock(recordingMutex);
+    
+    assert(recordingBufferCount > 0);
+    recordingBufferCount--;
+}
+}
@@ -0,0 +1,148 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/shaderGeneration/ShaderVariantCache.hpp"
+#include "graphics/shaderGeneration/ShaderGenerator.hpp"
+#include "io/ChecksummedFile.hpp"
+#include "io/FileSystem.hpp"
+#include "io/serialization/MemorySerializer.hpp"
+#include "logging/Logger.hpp"
+
+#include "fmt/format.h"
+
+#include <functional>
+#include <thread>
+
+namespace iyf {
+/// Magic, version, padding, key, bytecode size and padding
+static constexpr std::size_t HeaderSize = 4 + 2 + 2 + 8 + 4 + 4;
+
+ShaderVariantCache::ShaderVariantCache(const FileSystem* filesystem, Path directory) : filesystem(filesystem), directory(std::move(directory)), enabled(false) {
+    if (this->directory.empty()) {
+        return;
+    }
+    
+    if (!filesystem->isDirectory(this->directory) && filesystem->createDirectory(this->directory) != FileSystemResult::Success) {
+        LOG_W("Failed to create the shader variant cache directory {}. The cache will not be used.", this->directory);
+        return;
+    }
+    
+    enabled = true;
+}
+
+std::uint64_t ShaderVariantCache::ComputeKey(ShaderLanguage language, ShaderStageFlagBits stage, const std::string& source, const ShaderCompilationSettings& settings, std::uint32_t helperFunctionVersion) {
+    MemorySerializer data(256 + settings.macros.size() * 48);
+    
+    data.writeUInt16(Version);
+    data.writeUInt32(helperFunctionVersion);
+    data.writeUInt8(static_cast<std::uint8_t>(language));
+    data.writeUInt32(static_cast<std::uint32_t>(stage));
+    data.writeUInt8(static_cast<std::uint8_t>(settings.optimizationLevel));
+    data.writeUInt8(static_cast<std::uint8_t>(settings.vertexDataLayout));
+    
+    // The order of the macros matters because later definitions override the earlier ones
+    data.writeUInt32(static_cast<std::uint32_t>(settings.macros.size()));
+    for (const ShaderMacroWithValue& macro : settings.macros) {
+        data.writeString(macro.getName(), StringLengthIndicator::UInt16);
+        data.writeUInt8(static_cast<std::uint8_t>(macro.getRawValue().index()));
+        data.writeUInt64(macro.getValueHash().value());
+    }
+    
+    data.writeUInt64(source.size());
+    data.writeUInt64(HF(source.data(), source.size()).value());
+    
+    return HF(data.data(), data.size()).value();
+}
+
+Path ShaderVariantCache::makeEntryPath(std::uint64_t key) const {
+    return directory / fmt::format("{:016x}.spv", key);
+}
+
+bool ShaderVariantCache::load(std::uint64_t key, std::vector<std::uint8_t>& bytecode) const {
+    if (!enabled) {
+        return false;
+    }
+    
+    const Path path = makeEntryPath(key);
+    
+    const FileView contents = ReadChecksummedFile(*filesystem, path, HeaderSize, "shader variant cache entry");
+    if (contents.empty()) {
+        return false;
+    }
+    
+    const std::size_t dataSize = contents.size();
+    MemorySerializer serializer(contents.data(), dataSize);
+    
+    const std::uint32_t magic = serializer.readUInt32();
+    const std::uint16_t version = serializer.readUInt16();
+    serializer.readUInt16();
+    
+    const std::uint64_t storedKey = serializer.readUInt64();
+    const std::uint32_t size = serializer.readUInt32();
+    serializer.readUInt32();
+    
+    if (magic != Magic || version != Version || storedKey != key) {
+        LOG_V("Ignoring an outdated shader variant cache entry {}", path);
+        return false;
+    }
+    
+    if (HeaderSize + static_cast<std::size_t>(size) != dataSize) {
+        LOG_W("Ignoring a shader variant cache entry with an invalid size {}", path);
+        return false;
+    }
+    
+    const std::uint8_t* begin = reinterpret_cast<const std::uint8_t*>(contents.data() + HeaderSize);
+    bytecode.assign(begin, begin + size);
+    
+    return true;
+}
+
+bool ShaderVariantCache::store(std::uint64_t key, const std::vector<std::uint8_t>& bytecode) const {
+    if (!enabled) {
+        return false;
+    }
+    
+    MemorySerializer data(HeaderSize + bytecode.size() + ChecksumSize);
+    data.writeUInt32(Magic);
+    data.writeUInt16(Version);
+    data.writeUInt16(0);
+    data.writeUInt64(key);
+    data.writeUInt32(static_cast<std::uint32_t>(bytecode.size()));
+    data.writeUInt32(0);
+    data.writeBytes(bytecode.data(), bytecode.size());
+    
+    const Path path = makeEntryPath(key);
+    
+    // Multiple threads (or editor instances) may compile the same variant at the same time
+    const std::size_t threadHash = std::hash<std::thread::id>()(std::this_thread::get_id());
+    const Path temporaryPath = Path(fmt::format("{}.{:016x}.tmp", path.getGenericString(), threadHash));
+    
+    return WriteChecksummedFile(*filesystem, path, temporaryPath, data, "shader variant cache entry");
+}
+
+}
@@ -0,0 +1,146 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "graphics/shaderGeneration/ShaderVariantCompiler.hpp"
+#include "graphics/shaderGeneration/ShaderVariantCache.hpp"
+#include "graphics/shaderGeneration/VulkanGLSLShaderGenerator.hpp"
+#include "threading/ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <thread>
+
+namespace iyf {
+ShaderVariantCompiler::ShaderVariantCompiler(const FileSystem* fileSystem, std::size_t threadCount, std::unique_ptr<ShaderVariantCache> cache) : cache(std::move(cache)) {
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    
+    generators.reserve(threadCount);
+    for (std::size_t i = 0; i < threadCount; ++i) {
+        generators.push_back(std::make_unique<VulkanGLSLShaderGenerator>(fileSystem));
+    }
+    
+    if (threadCount > 1) {
+        pool = std::make_unique<iyft::ThreadPool>(threadCount - 1);
+    }
+}
+
+ShaderVariantCompiler::~ShaderVariantCompiler() {}
+
+bool ShaderVariantCompiler::compile(std::vector<ShaderVariant>& variants) {
+    std::lock_guard<std::mutex> lock(compilationMutex);
+    
+    for (ShaderVariant& variant : variants) {
+        assert(variant.source != nullptr);
+        
+        variant.result = ShaderCompilationResult();
+        variant.loadedFromCache = false;
+    }
+    
+    // Variants are claimed one by one because their compilation times differ a lot, especially when some of them can be
+    // loaded from the cache
+    std::atomic<std::size_t> nextVariant(0);
+    std::atomic<bool> failed(false);
+    
+    auto work = [this, &variants, &nextVariant, &failed](const VulkanGLSLShaderGenerator& generator) {
+        try {
+            std::size_t id;
+            while (!failed.load(std::memory_order_relaxed) && (id = nextVariant.fetch_add(1, std::memory_order_relaxed)) < variants.size()) {
+                ShaderVariant& variant = variants[id];
+                compileVariant(generator, variant);
+                
+                if (!variant.result) {
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            }
+        } catch (...) {
+            failed.store(true, std::memory_order_relaxed);
+            throw;
+        }
+    };
+    
+    const std::size_t helperCount = (pool == nullptr) ? 0 : std::min(pool->getWorkerCount(), variants.size());
+    
+    iyft::Barrier barrier(static_cast<int>(helperCount));
+    for (std::size_t i = 0; i < helperCount; ++i) {
+        const VulkanGLSLShaderGenerator* generator = generators[i + 1].get();
+        pool->addTask(barrier, [&work, generator]() {
+            work(*generator);
+        });
+    }
+    
+    // The helpers reference the local state, so they must complete even if this thread throws
+    std::exception_ptr exception;
+    try {
+        work(*generators[0]);
+    } catch (...) {
+        exception = std::current_exception();
+    }
+    
+    try {
+        barrier.waitForAll();
+    } catch (...) {
+        if (exception == nullptr) {
+            exception = std::current_exception();
+        }
+    }
+    
+    if (exception != nullptr) {
+        std::rethrow_exception(exception);
+    }
+    
+    return !failed.load();
+}
+
+void ShaderVariantCompiler::compileVariant(const VulkanGLSLShaderGenerator& generator, ShaderVariant& variant) const {
+    std::uint64_t key = 0;
+    const bool cacheEnabled = (cache != nullptr) && cache->isEnabled();
+    
+    if (cacheEnabled) {
+        key = ShaderVariantCache::ComputeKey(generator.getShaderLanguage(), variant.stage, *variant.source, variant.settings, generator.GetHelperFunctionVersion());
+        
+        std::vector<std::uint8_t> bytecode;
+        if (cache->load(key, bytecode)) {
+            variant.result = ShaderCompilationResult(ShaderCompilationResult::Status::Success, "", std::move(bytecode));
+            variant.loadedFromCache = true;
+            
+            return;
+        }
+    }
+    
+    variant.result = generator.compileShader(variant.stage, *variant.source, variant.name, variant.settings);
+    
+    if (cacheEnabled && variant.result) {
+        cache->store(key, variant.result.getBytecode());
+    }
+}
+
+}
@@ -42,9 +42,11 @@
 #undef Bool
 
 #include "core/Engine.hpp"
+#include "io/DefaultFileSystem.hpp"
 #include "logging/Logger.hpp"
 #include "core/Debug.hpp"
 #include "graphics/Renderer.hpp"
+#include "graphics/PipelineCacheStore.hpp"
 #include "graphics/vulkan/VulkanUtilities.hpp"
 #include "threading/ThreadProfiler.hpp"
 
@@ -333,6 +335,15 @@ void VulkanAPI::dispose() {
     
     vkDestroySurfaceKHR(instance, surface, nullptr);
     
+    const Path pipelineCachePath = getPipelineCachePath(getPipelineCacheIdentity());
+    if (!pipelineCachePath.empty()) {
+        const std::vector<std::uint8_t> pipelineCacheData = getPipelineCacheData(getMainPipelineCache());
+        
+        if (!pipelineCacheData.empty()) {
+            PipelineCacheStore::Save(DefaultFileSystem::Instance(), pipelineCachePath, getPipelineCacheIdentity(), pipelineCacheData.data(), pipelineCacheData.size());
+        }
+    }
+    
     vkDestroyPipelineCache(logicalDevice.handle, pipelineCache, nullptr);
     vkDestroyCommandPool(logicalDevice.handle, commandPool, nullptr);
     
@@ -817,8 +828,10 @@ Pipeline VulkanAPI::createPipeline(const PipelineCreateInfo& info, const char* n
     pci.basePipelineHandle  = nullptr;
     pci.basePipelineIndex   = -1;
 
+    const VkPipelineCache cache = info.pipelineCache.isValid() ? info.pipelineCache.toNative<VkPipelineCache>() : pipelineCache;
+    
     VkPipeline pipeline;
-    vkCreateGraphicsPipelines(logicalDevice.handle, pipelineCache, 1, &pci, nullptr, &pipeline);
+    checkResult(vkCreateGraphicsPipelines(logicalDevice.handle, cache, 1, &pci, nullptr, &pipeline), fmt::format("Failed to create a graphics pipeline called \"{}\"", name));
     
     setObjectName(VK_OBJECT_TYPE_PIPELINE, reinterpret_cast<std::uint64_t>(pipeline), name);
     
@@ -834,6 +847,60 @@ bool VulkanAPI::destroyPipeline(const Pipeline& pipeline) {
     return true;
 }
 
+PipelineCacheIdentity VulkanAPI::getPipelineCacheIdentity() const {
+    static_assert(VK_UUID_SIZE == std::tuple_size<decltype(PipelineCacheIdentity::cacheUUID)>::value, "Unexpected pipeline cache UUID size");
+    
+    PipelineCacheIdentity identity;
+    identity.vendorID = physicalDevice.properties.vendorID;
+    identity.deviceID = physicalDevice.properties.deviceID;
+    identity.driverVersion = physicalDevice.properties.driverVersion;
+    std::memcpy(identity.cacheUUID.data(), physicalDevice.properties.pipelineCacheUUID, VK_UUID_SIZE);
+    
+    return identity;
+}
+
+PipelineCacheHnd VulkanAPI::createPipelineCache(const void* initialData, std::size_t byteCount, const char* name) {
+    VkPipelineCacheCreateInfo pcci;
+    pcci.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pcci.pNext           = nullptr;
+    pcci.flags           = 0;
+    pcci.initialDataSize = byteCount;
+    pcci.pInitialData    = initialData;
+    
+    VkPipelineCache cache;
+    checkResult(vkCreatePipelineCache(logicalDevice.handle, &pcci, nullptr, &cache), "Failed to create a pipeline cache");
+    setObjectName(VK_OBJECT_TYPE_PIPELINE_CACHE, reinterpret_cast<std::uint64_t>(cache), name);
+    
+    return PipelineCacheHnd(cache);
+}
+
+bool VulkanAPI::destroyPipelineCache(PipelineCacheHnd handle) {
+    vkDestroyPipelineCache(logicalDevice.handle, handle.toNative<VkPipelineCache>(), nullptr);
+    return true;
+}
+
+std::vector<std::uint8_t> VulkanAPI::getPipelineCacheData(PipelineCacheHnd handle) {
+    const VkPipelineCache cache = handle.toNative<VkPipelineCache>();
+    
+    std::size_t byteCount = 0;
+    if (!checkResult(vkGetPipelineCacheData(logicalDevice.handle, cache, &byteCount, nullptr), "Failed to retrieve the size of the pipeline cache data", false)) {
+        return {};
+    }
+    
+    std::vector<std::uint8_t> data(byteCount);
+    if (!checkResult(vkGetPipelineCacheData(logicalDevice.handle, cache, &byteCount, data.data()), "Failed to retrieve the pipeline cache data", false)) {
+        return {};
+    }
+    
+    // The cache may have been shrunk by another thread
+    data.resize(byteCount);
+    return data;
+}
+
+PipelineCacheHnd VulkanAPI::getMainPipelineCache() const {
+    return PipelineCacheHnd(pipelineCache);
+}
+
 Pipeline VulkanAPI::createPipeline(const ComputePipelineCreateInfo& info, const char* name) {
     VkPipelineShaderStageCreateInfo pssci;
     pssci.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -853,9 +920,10 @@ Pipeline VulkanAPI::createPipeline(const ComputePipelineCreateInfo& info, const
     pci.basePipelineHandle = nullptr;
     pci.basePipelineIndex  = -1;
     
+    const VkPipelineCache cache = info.pipelineCache.isValid() ? info.pipelineCache.toNative<VkPipelineCache>() : pipelineCache;
+    
     VkPipeline pipeline;
-    vkCreateComputePipelines(logicalDevice.handle, pipelineCache, 1, &pci, nullptr, &pipeline);
-//    vkCreateGraphicsPipelines(logicalDevice.handle, pipelineCache, 1, &pci, nullptr, &pipeline);
+    checkResult(vkCreateComputePipelines(logicalDevice.handle, cache, 1, &pci, nullptr, &pipeline), fmt::format("Failed to create a compute pipeline called \"{}\"", name));
     
     setObjectName(VK_OBJECT_TYPE_PIPELINE, reinterpret_cast<std::uint64_t>(pipeline), name);
     
@@ -2017,6 +2085,22 @@ void VulkanCommandBuffer::copyImageToBuffer(const Image& srcImage, ImageLayout l
     vkCmdCopyImageToBuffer(cmdBuff, srcImage.getHandle().toNative<VkImage>(), vk::imageLayout(layout), dstBuffer.handle().toNative<VkBuffer>(), regions.size(), convertedRegions.data());
 }
 
+void VulkanCommandBuffer::executeCommands(std::uint32_t count, CommandBuffer* const* buffers) {
+    assert(level == BufferLevel::Primary);
+
+    if (count == 0) {
+        return;
+    }
+
+    tempSecondaryBuffers.clear();
+    for (std::uint32_t i = 0; i < count; ++i) {
+        assert(buffers[i]->getLevel() == BufferLevel::Secondary);
+        tempSecondaryBuffers.push_back(static_cast<VulkanCommandBuffer*>(buffers[i])->cmdBuff);
+    }
+
+    vkCmdExecuteCommands(cmdBuff, count, tempSecondaryBuffers.data());
+}
+
 // --------------------------------- Command pool
 
 CommandBuffer* VulkanCommandPool::allocateCommandBuffer(const char* name, BufferLevel level, bool beginBuffer) {
@@ -37,6 +37,13 @@
 namespace iyf {
 using namespace literals;
 
+/// Alignment of all staging allocations. Satisfies the offset requirements of buffer to image copies for all formats
+/// with texel blocks of up to 16 bytes.
+static const std::uint64_t StagingAlignment = 16;
+
+/// How long to wait for an upload before giving up, in nanoseconds
+static const std::uint64_t UploadTimeout = 50000000000;
+
 inline Bytes getSize(const std::vector<Bytes>& sizes, MemoryBatch batch) {
     return sizes[static_cast<std::size_t>(batch)];
 }
@@ -55,6 +62,12 @@ inline std::string getDebugName(MemoryBatch batch) {
     throw std::runtime_error("Invalid or unknown MemoryBatch");
 }
 
+/// The number of frames whose uploads may use the staging buffer of the batch at the same time. Instant uploads always
+/// wait for completion.
+inline std::uint64_t getFramesInFlight(GraphicsAPI* gfx, MemoryBatch batch) {
+    return (batch == MemoryBatch::Instant) ? 1 : gfx->getSwapImageCount();
+}
+
 VulkanDeviceMemoryManager::VulkanDeviceMemoryManager(VulkanAPI* gfx, std::vector<Bytes> stagingBufferSizes)
     : DeviceMemoryManager(std::move(stagingBufferSizes)), gfx(gfx), firstFrame(true) {}
 
@@ -128,17 +141,25 @@ void VulkanDeviceMemoryManager::initialize() {
     if (!created) {
         throw std::runtime_error("Failed to create a staging buffer for instantly transferred data");
     }
-    
-    uploadCompleteFence = gfx->createFence(false, "Device memory manager upload complete fence");
 }
 
 VulkanDeviceMemoryManager::~VulkanDeviceMemoryManager() {}
 
 void VulkanDeviceMemoryManager::dispose() {
-    gfx->destroyFence(uploadCompleteFence);
-    
     for (StagingBufferData& data : stagingBuffers) {
-        gfx->destroyBuffers(data.buffers);
+        if (!data.APIObjectsCreated) {
+            continue;
+        }
+        
+        while (data.ring.getPendingSubmissionCount() != 0) {
+            waitForOldestUpload(data);
+        }
+        
+        for (FenceHnd fence : data.fences) {
+            gfx->destroyFence(fence);
+        }
+        
+        gfx->destroyBuffer(data.buffer);
         commandPool->freeCommandBuffers(data.commandBuffers);
     }
     
@@ -161,52 +182,51 @@ VulkanDeviceMemoryManager::StagingBufferData& VulkanDeviceMemoryManager::getStag
 
 bool VulkanDeviceMemoryManager::initOrUpdateStagingBuffer(MemoryBatch batch, Bytes size) {
     StagingBufferData& stagingBufferData = getStagingBufferForBatch(batch);
-    
-    BufferCreateInfo bci(BufferUsageFlagBits::TransferSource, size, MemoryUsage::CPUOnly, false);
     stagingBufferData.batch = batch;
     
+    // Each frame in flight needs its own part of the ring
+    const Bytes capacity(size.count() * getFramesInFlight(gfx, batch));
+    BufferCreateInfo bci(BufferUsageFlagBits::TransferSource, capacity, MemoryUsage::CPUOnly, false);
+    const std::string bufferName = fmt::format("Vulkan Device Memory Manager staging buffer for {}", getDebugName(batch));
+    
     if (!stagingBufferData.APIObjectsCreated) {
-        const std::uint32_t swapImageCount = gfx->getSwapImageCount();
+        // One more slot than frames in flight, so that the uploads of the next frame can be recorded while the GPU is
+        // still busy with all the others
+        const std::uint32_t slotCount = gfx->getSwapImageCount() + 1;
         
         std::vector<std::string> names;
-        names.reserve(swapImageCount);
+        names.reserve(slotCount);
         
         std::vector<const char*> namesCStr;
-        namesCStr.reserve(swapImageCount);
+        namesCStr.reserve(slotCount);
         
-        for (std::uint32_t i = 0; i < swapImageCount; ++i) {
+        for (std::uint32_t i = 0; i < slotCount; ++i) {
             names.emplace_back(fmt::format("Vulkan Device Memory Manager command buffer {} for {}", i, getDebugName(batch)));
             namesCStr.emplace_back(names[i].c_str());
         }
         
-        stagingBufferData.commandBuffers = commandPool->allocateCommandBuffers(&namesCStr, swapImageCount, BufferLevel::Primary, false);
-        
-        names.clear();
-        namesCStr.clear();
+        stagingBufferData.commandBuffers = commandPool->allocateCommandBuffers(&namesCStr, slotCount, BufferLevel::Primary, false);
         
-        std::vector<BufferCreateInfo> bcis;
-        bcis.reserve(swapImageCount);
-        
-        for (std::uint32_t i = 0; i < swapImageCount; ++i) {
-            names.emplace_back(fmt::format("Vulkan Device Memory Manager staging buffer {} for {}", i, getDebugName(batch)));
-            namesCStr.emplace_back(names[i].c_str());
-            bcis.emplace_back(bci);
+        for (std::uint32_t i = 0; i < slotCount; ++i) {
+            const std::string name = fmt::format("Vulkan Device Memory Manager upload fence {} for {}", i, getDebugName(batch));
+            stagingBufferData.fences.push_back(gfx->createFence(false, name.c_str()));
         }
         
-        stagingBufferData.buffers = gfx->createBuffers(bcis, &namesCStr);
         stagingBufferData.APIObjectsCreated = true;
-/*        
-        for (const auto& b : stagingBufferData.buffers) {
-            assert(b.size() == size);
-        }*/
     } else {
-        Buffer& buffer = stagingBufferData.getBufferForThisFrame(gfx);
-        gfx->destroyBuffer(buffer);
-        buffer = gfx->createBuffer(bci, getDebugName(batch).c_str());
+        // Growing is rare, so simply waiting for all uploads that still use the old buffer is good enough
+        while (stagingBufferData.ring.getPendingSubmissionCount() != 0) {
+            waitForOldestUpload(stagingBufferData);
+        }
         
-        assert(static_cast<const AllocationAndInfo*>(buffer.allocationInfo())->info.pMappedData != nullptr);
+        gfx->destroyBuffer(stagingBufferData.buffer);
     }
     
+    stagingBufferData.buffer = gfx->createBuffer(bci, bufferName.c_str());
+    stagingBufferData.ring.reset(stagingBufferData.buffer.size().count());
+    
+    assert(static_cast<const AllocationAndInfo*>(stagingBufferData.buffer.allocationInfo())->info.pMappedData != nullptr);
+    
     return true;
 }
 
@@ -221,14 +241,15 @@ void VulkanDeviceMemoryManager::beginFrame() {
 }
 
 void VulkanDeviceMemoryManager::resetData(StagingBufferData& data) {
-    Buffer& buffer = data.getBufferForThisFrame(gfx);
+    reclaimStagingMemory(data);
     
-    if (buffer.size() < data.maxRequestedUploadSize) {
+    // Uploads that were recorded but not submitted yet keep using the current buffer, so it can't be replaced
+    const std::uint64_t requiredCapacity = data.maxRequestedUploadSize * getFramesInFlight(gfx, data.batch);
+    if (!data.recording && data.ring.getCapacity() < requiredCapacity) {
+        LOG_V("Growing the staging buffer for {} to {} bytes", getDebugName(data.batch), requiredCapacity);
         initOrUpdateStagingBuffer(data.batch, Bytes(data.maxRequestedUploadSize));
     }
     
-    data.currentOffset = 0;
-    
     if (!firstFrame && data.batch != MemoryBatch::Instant && data.uploadCalls == 0) {
         LOG_W("beginBatchUpload() wasn't called last frame for MemoryBatch with ID {}", static_cast<std::uint32_t>(data.batch));
     }
@@ -236,6 +257,64 @@ void VulkanDeviceMemoryManager::resetData(StagingBufferData& data) {
     data.uploadCalls = 0;
 }
 
+void VulkanDeviceMemoryManager::reclaimStagingMemory(StagingBufferData& data) {
+    data.ring.reclaim([this, &data](std::uint64_t slot) {
+        return gfx->getFenceStatus(data.fences[slot]);
+    });
+}
+
+void VulkanDeviceMemoryManager::waitForOldestUpload(StagingBufferData& data) {
+    IYFT_PROFILE(waitForOldestUpload, iyft::ProfilerTag::Graphics)
+    
+    assert(data.ring.getPendingSubmissionCount() != 0);
+    
+    const FenceHnd fence = data.fences[data.ring.getOldestFenceID()];
+    if (!gfx->waitForFence(fence, UploadTimeout)) {
+        throw std::runtime_error("Timed out while waiting for an upload to complete");
+    }
+    
+    data.ring.reclaimOldest();
+}
+
+CommandBuffer* VulkanDeviceMemoryManager::beginRecording(StagingBufferData& data) {
+    CommandBuffer* commandBuffer = data.commandBuffers[data.currentSlot];
+    
+    if (data.recording) {
+        return commandBuffer;
+    }
+    
+    // The slots are reused in order, so if all of them are in flight, the oldest one belongs to the current slot
+    while (data.ring.getPendingSubmissionCount() >= data.commandBuffers.size()) {
+        waitForOldestUpload(data);
+    }
+    
+    commandBuffer->begin();
+    
+    // The destinations may still be read by the frames that are in flight. Their commands were submitted earlier, so an
+    // execution dependency is enough to prevent write-after-read hazards.
+    VkCommandBuffer uploadBuffer = commandBuffer->getHandle().toNative<VkCommandBuffer>();
+    vkCmdPipelineBarrier(uploadBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+    
+    data.recording = true;
+    return commandBuffer;
+}
+
+std::uint64_t VulkanDeviceMemoryManager::allocateStagingMemory(StagingBufferData& data, std::uint64_t size) {
+    std::uint64_t offset = data.ring.allocate(size, StagingAlignment);
+    
+    // Only happens if canBatchFitData() was called for several uploads at once and the alignment padding didn't fit
+    while (offset == StagingRingAllocator::InvalidOffset && data.ring.getPendingSubmissionCount() != 0) {
+        waitForOldestUpload(data);
+        offset = data.ring.allocate(size, StagingAlignment);
+    }
+    
+    if (offset == StagingRingAllocator::InvalidOffset) {
+        throw std::runtime_error("The data doesn't fit into the staging buffer. Did you call canBatchFitData()?");
+    }
+    
+    return offset;
+}
+
 bool VulkanDeviceMemoryManager::isStagingBufferNeeded(const Buffer& destinationBuffer) {
     // We use VMA_ALLOCATION_CREATE_MAPPED_BIT to ensure host visible memory is always mapped.
     const AllocationAndInfo* allocationInfo = static_cast<const AllocationAndInfo*>(destinationBuffer.allocationInfo());
@@ -248,14 +327,13 @@ bool VulkanDeviceMemoryManager::canBatchFitData(MemoryBatch batch, Bytes totalSi
     
     sbData.maxRequestedUploadSize = std::max(totalSize.count(), sbData.maxRequestedUploadSize);
     
-    const Buffer& buffer = sbData.getBufferForThisFrame(gfx);
-    
-    const Bytes bufferSize = buffer.size();
-    const std::uint64_t sizeAfterUpload = totalSize.count() + sbData.currentOffset;
-    
-//     LOG_D("{} {}", bufferSize.count(), sizeAfterUpload);
+    if (totalSize.count() == 0) {
+        return true;
+    }
     
-    return sizeAfterUpload <= bufferSize;
+    // Doesn't wait. If the GPU is still busy with older uploads, the caller can try again next frame.
+    reclaimStagingMemory(sbData);
+    return sbData.ring.canAllocate(totalSize.count(), StagingAlignment);
 }
 
 bool VulkanDeviceMemoryManager::updateBuffer(MemoryBatch batch, const Buffer& destinationBuffer, const std::vector<BufferCopy>& copies, const void* data) {
@@ -292,13 +370,15 @@ bool VulkanDeviceMemoryManager::updateBuffer(MemoryBatch batch, const Buffer& de
         StagingBufferData& stagingBufferData = getStagingBufferForBatch(batch);
         assert(stagingBufferData.APIObjectsCreated);
         
-        Buffer& buffer = stagingBufferData.getBufferForThisFrame(gfx);
-        CommandBuffer* commandBuffer = stagingBufferData.getCommandBufferForThisFrame(gfx);
-        
-        if (!commandBuffer->isRecording()) {
-            commandBuffer->begin();
+        const std::uint64_t totalSize = computeUploadSize(copies).count();
+        if (totalSize == 0) {
+            return true;
         }
         
+        Buffer& buffer = stagingBufferData.buffer;
+        CommandBuffer* commandBuffer = beginRecording(stagingBufferData);
+        const std::uint64_t stagingOffset = allocateStagingMemory(stagingBufferData, totalSize);
+        
         const AllocationAndInfo* stagingAllocationInfo = static_cast<const AllocationAndInfo*>(buffer.allocationInfo());
         
         std::vector<VkBufferCopy> stagingCopies;
@@ -306,23 +386,24 @@ bool VulkanDeviceMemoryManager::updateBuffer(MemoryBatch batch, const Buffer& de
         
         const bool needsFlushing = !(VK_MEMORY_PROPERTY_HOST_COHERENT_BIT & stagingAllocationInfo->memoryFlags);
         
-        std::uint64_t offset = stagingBufferData.currentOffset;
+        std::uint64_t offset = stagingOffset;
         for (const auto& c : copies) {
             const char* source = static_cast<const char*>(data);
             source += c.srcOffset;
             
             char* destination = static_cast<char*>(stagingAllocationInfo->info.pMappedData);
             destination += offset;
-            offset += c.size;
             
             std::memcpy(destination, source, c.size);
             
             if (needsFlushing) {
-                vmaFlushAllocation(allocator, stagingAllocationInfo->allocation, c.dstOffset, c.size);
+                vmaFlushAllocation(allocator, stagingAllocationInfo->allocation, offset, c.size);
             }
+            
+            offset += c.size;
         }
         
-        offset = stagingBufferData.currentOffset;
+        offset = stagingOffset;
         for (const auto& c : copies) {
             VkBufferCopy bc;
             bc.srcOffset = offset;
@@ -337,17 +418,58 @@ bool VulkanDeviceMemoryManager::updateBuffer(MemoryBatch batch, const Buffer& de
         VkCommandBuffer copyBuff = commandBuffer->getHandle().toNative<VkCommandBuffer>();
         vkCmdCopyBuffer(copyBuff, buffer.handle().toNative<VkBuffer>(), destinationBuffer.handle().toNative<VkBuffer>(), stagingCopies.size(), stagingCopies.data());
         
-        stagingBufferData.currentOffset = offset;
-        
         if (batch == MemoryBatch::Instant) {
-            executeUpload(commandBuffer, true);
-            resetData(stagingBufferData);
+            executeUpload(stagingBufferData, true);
         }
     }
     
     return true;
 }
 
+bool VulkanDeviceMemoryManager::copyBuffer(MemoryBatch batch, const Buffer& sourceBuffer, const Buffer& destinationBuffer, const std::vector<BufferCopy>& copies) {
+    IYFT_PROFILE(copyBuffer, iyft::ProfilerTag::Graphics)
+    
+    if (copies.empty()) {
+        return true;
+    }
+    
+    StagingBufferData& stagingBufferData = getStagingBufferForBatch(batch);
+    assert(stagingBufferData.APIObjectsCreated);
+    
+    CommandBuffer* commandBuffer = beginRecording(stagingBufferData);
+    
+    std::vector<VkBufferCopy> bufferCopies;
+    bufferCopies.reserve(copies.size());
+    
+    for (const auto& c : copies) {
+        VkBufferCopy bc;
+        bc.srcOffset = c.srcOffset;
+        bc.dstOffset = c.dstOffset;
+        bc.size = c.size;
+        
+        bufferCopies.push_back(std::move(bc));
+    }
+    
+    // The source data may have been uploaded by this batch and the old regions may be overwritten by later uploads of this batch,
+    // so the copies need to be ordered with the rest of the transfers.
+    VkMemoryBarrier barrier;
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext         = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    
+    VkCommandBuffer copyBuff = commandBuffer->getHandle().toNative<VkCommandBuffer>();
+    vkCmdPipelineBarrier(copyBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    vkCmdCopyBuffer(copyBuff, sourceBuffer.handle().toNative<VkBuffer>(), destinationBuffer.handle().toNative<VkBuffer>(), bufferCopies.size(), bufferCopies.data());
+    vkCmdPipelineBarrier(copyBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    
+    if (batch == MemoryBatch::Instant) {
+        executeUpload(stagingBufferData, true);
+    }
+    
+    return true;
+}
+
 bool VulkanDeviceMemoryManager::beginBatchUpload(MemoryBatch batch) {
     IYFT_PROFILE(beginBatchUpload, iyft::ProfilerTag::Graphics)
     
@@ -380,8 +502,7 @@ bool VulkanDeviceMemoryManager::beginBatchUpload(MemoryBatch batch) {
     }
     
     if (shouldUpload) {
-        CommandBuffer* commandBuffer =  stagingBufferData.getCommandBufferForThisFrame(gfx);
-        executeUpload(commandBuffer, false);
+        executeUpload(stagingBufferData, false);
     }
     
     return true;
@@ -393,18 +514,15 @@ bool VulkanDeviceMemoryManager::updateImage(MemoryBatch batch, const Image& imag
     StagingBufferData& stagingBufferData = getStagingBufferForBatch(batch);
     assert(stagingBufferData.APIObjectsCreated);
     
-    Buffer& buffer = stagingBufferData.getBufferForThisFrame(gfx);
-    CommandBuffer* commandBuffer = stagingBufferData.getCommandBufferForThisFrame(gfx);
-        
-    if (!commandBuffer->isRecording()) {
-        commandBuffer->begin();
-    }
+    Buffer& buffer = stagingBufferData.buffer;
+    CommandBuffer* commandBuffer = beginRecording(stagingBufferData);
+    const std::uint64_t stagingOffset = allocateStagingMemory(stagingBufferData, data.size);
     
     const AllocationAndInfo* stagingAllocationInfo = static_cast<const AllocationAndInfo*>(buffer.allocationInfo());
     
     std::vector<VkBufferImageCopy> bics;
     std::size_t layerId = 0;
-    std::size_t offset = stagingBufferData.currentOffset;
+    std::size_t offset = stagingOffset;
     
     for (std::size_t face = 0; face < data.faceCount; ++face) {
         for (std::size_t level = 0; level < data.mipmapLevelCount; ++level) {
@@ -440,16 +558,14 @@ bool VulkanDeviceMemoryManager::updateImage(MemoryBatch batch, const Image& imag
     void* destinationMemory = stagingAllocationInfo->info.pMappedData;
     
     char* destination = static_cast<char*>(destinationMemory);
-    destination += stagingBufferData.currentOffset;
+    destination += stagingOffset;
         
     std::memcpy(destination, data.data, data.size);
     
     if (needsFlushing) {
-        vmaFlushAllocation(allocator, stagingAllocationInfo->allocation, stagingBufferData.currentOffset, data.size);
+        vmaFlushAllocation(allocator, stagingAllocationInfo->allocation, stagingOffset, data.size);
     }
     
-    stagingBufferData.currentOffset = offset;
-    
     VkImage vulkanImage = image.getHandle().toNative<VkImage>();
     
     VkImageSubresourceRange sr;
@@ -461,39 +577,58 @@ bool VulkanDeviceMemoryManager::updateImage(MemoryBatch batch, const Image& imag
     
     VkCommandBuffer uploadBuffer = commandBuffer->getHandle().toNative<VkCommandBuffer>();
     
-    stagingBufferData.currentOffset = offset;
-
     gfx->setImageLayout(uploadBuffer, vulkanImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, sr, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
     vkCmdCopyBufferToImage(uploadBuffer, buffer.handle().toNative<VkBuffer>(), vulkanImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, bics.size(), bics.data());
     gfx->setImageLayout(uploadBuffer, vulkanImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, sr, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
     
     if (batch == MemoryBatch::Instant) {
-        executeUpload(commandBuffer, true);
-        resetData(stagingBufferData);
+        executeUpload(stagingBufferData, true);
     }
     
     return true;
 }
 
 
-void VulkanDeviceMemoryManager::executeUpload(CommandBuffer* commandBuffer, bool /*waitForCompletion*/) {
+void VulkanDeviceMemoryManager::executeUpload(StagingBufferData& data, bool waitForCompletion) {
     IYFT_PROFILE(executeUpload, iyft::ProfilerTag::Graphics)
     
+    assert(data.recording);
+    
+    const std::size_t slot = data.currentSlot;
+    CommandBuffer* commandBuffer = data.commandBuffers[slot];
     assert(commandBuffer->isRecording());
+    
+    // Makes the transferred data visible to everything that gets submitted after the upload. All work runs on the
+    // graphics queue, so no queue family ownership transfers are needed.
+    // TODO once transfer queues are supported, release the ownership here and acquire it on the graphics queue
+    VkMemoryBarrier barrier;
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext         = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    
+    VkCommandBuffer uploadBuffer = commandBuffer->getHandle().toNative<VkCommandBuffer>();
+    vkCmdPipelineBarrier(uploadBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    
     commandBuffer->end();
     
-    // TODO start using pipeline barriers instead of waiting for operations to complete.
+    // The previous submission of this slot has already been reclaimed by beginRecording()
+    const FenceHnd fence = data.fences[slot];
+    gfx->resetFence(fence);
+    
     SubmitInfo si;
     si.commandBuffers = {commandBuffer->getHandle()};
+    gfx->submitQueue(si, fence);
+    
+    data.ring.submit(slot);
+    data.recording = false;
+    data.currentSlot = (slot + 1) % data.commandBuffers.size();
     
-//     if (waitForCompletion) {
-        gfx->submitQueue(si, uploadCompleteFence);
-        gfx->waitForFence(uploadCompleteFence, 50000000000);
-        gfx->resetFence(uploadCompleteFence);
-        // TODO use proper synchronisation instead of this fence
-//     } else {
-//         gfx->submitQueue(si);
-//     }
+    if (waitForCompletion) {
+        while (data.ring.getPendingSubmissionCount() != 0) {
+            waitForOldestUpload(data);
+        }
+    }
 }
 
 Buffer VulkanDeviceMemoryManager::createBuffer(const BufferCreateInfo& info, const char* name) {
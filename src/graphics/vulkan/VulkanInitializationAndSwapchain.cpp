@@ -29,6 +29,7 @@
 #include "graphics/vulkan/VulkanAPI.hpp"
 #include "graphics/vulkan/VulkanDeviceMemoryManager.hpp"
 #include "graphics/interfaces/SwapchainChangeListener.hpp"
+#include "graphics/PipelineCacheStore.hpp"
 
 #include "../VERSION.hpp"
 
@@ -36,6 +37,7 @@
 #include "utilities/DataSizes.hpp"
 #include "logging/Logger.hpp"
 #include "core/Engine.hpp"
+#include "io/DefaultFileSystem.hpp"
 
 // WARNING DO NOT TOUCH these undefs. Vulkan headers pull in X11, Project.hpp pulls in RapidJSON,
 // names clash, things explode. This solves it.
@@ -123,16 +125,15 @@ bool VulkanAPI::initialize() {
         setObjectName(VK_OBJECT_TYPE_SEMAPHORE, reinterpret_cast<std::uint64_t>(renderingCompleteSemaphores[i]), name.c_str());
     }
     
-    VkPipelineCacheCreateInfo pcci;
-    pcci.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-    pcci.pNext           = nullptr;
-    pcci.flags           = 0;
-    pcci.initialDataSize = 0;
-    pcci.pInitialData    = nullptr;
+    std::vector<std::uint8_t> pipelineCacheData;
     
-    // TODO load from disk
-    checkResult(vkCreatePipelineCache(logicalDevice.handle, &pcci, nullptr, &pipelineCache), "");
-    setObjectName(VK_OBJECT_TYPE_PIPELINE_CACHE, reinterpret_cast<std::uint64_t>(pipelineCache), "Main pipeline cache");
+    const PipelineCacheIdentity pipelineCacheIdentity = getPipelineCacheIdentity();
+    const Path pipelineCachePath = getPipelineCachePath(pipelineCacheIdentity);
+    if (!pipelineCachePath.empty() && PipelineCacheStore::Load(DefaultFileSystem::Instance(), pipelineCachePath, pipelineCacheIdentity, pipelineCacheData)) {
+        LOG_V("Loaded {} bytes of pipeline cache data from {}", pipelineCacheData.size(), pipelineCachePath);
+    }
+    
+    pipelineCache = createPipelineCache(pipelineCacheData.data(), pipelineCacheData.size(), "Main pipeline cache").toNative<VkPipelineCache>();
 
     mainCommandBuffer = allocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, false);//TODO allocate >1
     imageUploadCommandBuffer = allocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, false);
@@ -0,0 +1,111 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "physics/CollisionMeshCache.hpp"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace iyf {
+template <typename Source, typename Destination>
+static void CopyIndices(const void* source, std::size_t count, char* destination) {
+    const Source* in = static_cast<const Source*>(source);
+    Destination* out = reinterpret_cast<Destination*>(destination);
+    
+    for (std::size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<Destination>(in[i]);
+    }
+}
+
+std::pair<GraphicsToPhysicsDataMapping, GraphicsToPhysicsDataMapping> CollisionMeshCache::insert(StringHash key, const void* vertices, std::size_t vertexCount,
+    std::uint32_t vertexStride, std::uint32_t positionOffset, const void* indices, std::size_t indexCount, std::uint32_t indexStride) {
+    if (indexStride != 2 && indexStride != 4) {
+        throw std::invalid_argument("The index stride must be 2 or 4");
+    }
+    
+    if (positionOffset + PositionStride > vertexStride) {
+        throw std::invalid_argument("The position doesn't fit in the vertex");
+    }
+    
+    erase(key);
+    
+    // Every index of a mesh with this few vertices fits in 16 bits
+    const bool narrowIndices = (indexStride == 4) && (vertexCount <= std::numeric_limits<std::uint16_t>::max() + std::size_t(1));
+    
+    Entry entry;
+    entry.vertexCount = vertexCount;
+    entry.indexCount = indexCount;
+    entry.indexStride = narrowIndices ? 2 : indexStride;
+    entry.data = std::unique_ptr<char[]>(new char[entry.getSize()]);
+    
+    const char* vertexData = static_cast<const char*>(vertices) + positionOffset;
+    char* positions = entry.data.get();
+    for (std::size_t i = 0; i < vertexCount; ++i) {
+        std::memcpy(positions + i * PositionStride, vertexData + i * vertexStride, PositionStride);
+    }
+    
+    char* indexData = positions + vertexCount * PositionStride;
+    if (narrowIndices) {
+        CopyIndices<std::uint32_t, std::uint16_t>(indices, indexCount, indexData);
+    } else {
+        std::memcpy(indexData, indices, indexCount * indexStride);
+    }
+    
+    memoryUsage += entry.getSize();
+    entries.emplace(key, std::move(entry));
+    
+    return getMapping(key);
+}
+
+std::pair<GraphicsToPhysicsDataMapping, GraphicsToPhysicsDataMapping> CollisionMeshCache::getMapping(StringHash key) const {
+    const Entry& entry = entries.at(key);
+    
+    const char* positions = entry.data.get();
+    const char* indices = positions + entry.vertexCount * PositionStride;
+    
+    return {{positions, entry.vertexCount, PositionStride}, {indices, entry.indexCount, entry.indexStride}};
+}
+
+bool CollisionMeshCache::erase(StringHash key) {
+    auto result = entries.find(key);
+    if (result == entries.end()) {
+        return false;
+    }
+    
+    memoryUsage -= result->second.getSize();
+    entries.erase(result);
+    
+    return true;
+}
+
+void CollisionMeshCache::clear() {
+    entries.clear();
+    memoryUsage = 0;
+}
+}
@@ -164,12 +164,39 @@ void BulletPhysicsSystem::dispose() {
     delete broadphase;
 }
 
-void BulletPhysicsSystem::update(float delta, const EntityStateVector& entityStates) {
+void BulletPhysicsSystem::update(float delta, const EntityStateVector&) {
     IYFT_PROFILE(PhysicsUpdate, iyft::ProfilerTag::Physics);
     
+    stepSimulation(delta);
+    drawDebugData(delta);
+}
+
+void BulletPhysicsSystem::declareJobs(TaskGraph& graph, const EntityStateVector&) {
+    // Motion states move the TransformationComponents. MeshComponent and LightComponent objects update their data when
+    // that happens, so the step writes them as well.
+    JobAccess stepAccess;
+    stepAccess.write(ComponentBaseType::Physics).writeTransformations().write(MeshComponent::Type).write(LightComponent::Type);
+    graph.addJob("PhysicsStep", [this](float delta) {
+        stepSimulation(delta);
+    }, stepAccess, JobAffinity::AnyThread);
+    
+    // Reads the dynamics world. The debug renderer belongs to this System and GraphicsDrawRecording reads it, hence the
+    // write. Doesn't touch any components, so it runs in parallel with the camera update and culling.
+    JobAccess debugAccess;
+    debugAccess.writeSystemData(ComponentBaseType::Physics);
+    graph.addJob("PhysicsDebugDraw", [this](float delta) {
+        drawDebugData(delta);
+    }, debugAccess, JobAffinity::MainThread);
+}
+
+void BulletPhysicsSystem::stepSimulation(float delta) {
+    IYFT_PROFILE(PhysicsStep, iyft::ProfilerTag::Physics);
+    
     // http://bulletphysics.org/mediawiki-1.5.8/index.php/Stepping_The_World
     dynamicsWorld->stepSimulation(delta, 8);
-    
+}
+
+void BulletPhysicsSystem::drawDebugData(float delta) {
     if (drawDebug) {
         debugRenderer->update(delta);
         dynamicsWorld->debugDrawWorld();
@@ -0,0 +1,67 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "utilities/BufferRangeAllocator.hpp"
+#include "utilities/BufferRangeSet.hpp"
+#include "utilities/TLSFBufferRangeAllocator.hpp"
+
+#include <stdexcept>
+
+namespace iyf {
+std::unique_ptr<BufferRangeAllocator> BufferRangeAllocator::Create(BufferRangeAllocatorType type, Bytes totalSpace) {
+    switch (type) {
+        case BufferRangeAllocatorType::FirstFit:
+            return std::make_unique<BufferRangeSet>(totalSpace);
+        case BufferRangeAllocatorType::TLSF:
+            return std::make_unique<TLSFBufferRangeAllocator>(totalSpace);
+    }
+    
+    throw std::invalid_argument("Unknown BufferRangeAllocatorType");
+}
+
+BufferRangeAllocator::FreeRange BufferRangeAllocator::relocate(const BufferRange& range, std::uint32_t startPadding, Bytes alignment) {
+    const Bytes dataSize = range.size - Bytes(startPadding);
+    
+    if (dataSize == Bytes(0)) {
+        return {BufferRange(), 0, false};
+    }
+    
+    FreeRange result = getFreeRange(dataSize, alignment);
+    if (!result.status) {
+        return result;
+    }
+    
+    // Moving the data up would defeat the purpose
+    if (result.completeRange.offset >= range.offset) {
+        insert(result.completeRange);
+        return {BufferRange(), 0, false};
+    }
+    
+    return result;
+}
+}
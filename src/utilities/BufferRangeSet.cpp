@@ -159,33 +159,45 @@ BufferRangeSet::FreeRange BufferRangeSet::getFreeRange(Bytes size, Bytes alignme
         
         if (r.size >= size) {
             Bytes offset = r.offset;
+            Bytes allocatedSize = size;
             
             std::uint32_t padding = 0;
             // The offset is not aligned to what we need. We'll have to add some padding
             if (offset % alignment != 0) {
                 padding = alignment - (offset % alignment);
                 
-                // We will also need to increase the size of the allocation and this may render it invalid
-                size += Bytes(padding);
+                // We will also need to increase the size of the allocation and this may render it invalid. The padding
+                // only applies to this range, so size itself must stay unchanged for the next iterations.
+                allocatedSize += Bytes(padding);
                 
-                if (r.size < size) {
+                if (r.size < allocatedSize) {
                     continue;
                 }
             }
             
-            r.size -= size;
-            r.offset += size;
-            freeSpace -= size;
+            r.size -= allocatedSize;
+            r.offset += allocatedSize;
+            freeSpace -= allocatedSize;
             
             if (r.size == Bytes(0)) {
                 // This should be safe since we're returning immediately
                 data.erase(it);
             }
             
-            return {BufferRange(offset, size), padding, true};
+            return {BufferRange(offset, allocatedSize), padding, true};
         }
     }
     
     return {BufferRange(), 0, false};
 }
+
+Bytes BufferRangeSet::getLargestFreeRange() const {
+    Bytes largest(0);
+    
+    for (const BufferRange& r : data) {
+        largest = std::max(largest, r.size);
+    }
+    
+    return largest;
+}
 }
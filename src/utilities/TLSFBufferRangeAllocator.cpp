@@ -0,0 +1,357 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "utilities/TLSFBufferRangeAllocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace iyf {
+inline static std::uint32_t FindLastSet(std::uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanReverse64(&bit, value);
+    return static_cast<std::uint32_t>(bit);
+#else
+    return 63 - static_cast<std::uint32_t>(__builtin_clzll(value));
+#endif
+}
+
+inline static std::uint32_t FindFirstSet(std::uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward64(&bit, value);
+    return static_cast<std::uint32_t>(bit);
+#else
+    return static_cast<std::uint32_t>(__builtin_ctzll(value));
+#endif
+}
+
+inline static std::uint64_t ComputePadding(std::uint64_t offset, std::uint64_t alignment) {
+    const std::uint64_t remainder = offset % alignment;
+    return (remainder == 0) ? 0 : (alignment - remainder);
+}
+
+TLSFBufferRangeAllocator::TLSFBufferRangeAllocator(Bytes totalSpace) : BufferRangeAllocator(totalSpace), firstLevelBitmap(0), freeBlockCount(0) {
+    secondLevelBitmaps.fill(0);
+    freeLists.fill(InvalidBlock);
+    
+    if (totalSpace == Bytes(0)) {
+        return;
+    }
+    
+    const std::uint32_t block = createBlock();
+    blocks[block].offset = 0;
+    blocks[block].size = totalSpace.count();
+    
+    insertFreeBlock(block);
+}
+
+void TLSFBufferRangeAllocator::MapSize(std::uint64_t size, std::uint32_t& firstLevel, std::uint32_t& secondLevel) {
+    if (size < SecondLevelCount) {
+        firstLevel = 0;
+        secondLevel = static_cast<std::uint32_t>(size);
+    } else {
+        const std::uint32_t log2 = FindLastSet(size);
+        firstLevel = log2 - SecondLevelLog2 + 1;
+        secondLevel = static_cast<std::uint32_t>(size >> (log2 - SecondLevelLog2)) - SecondLevelCount;
+    }
+}
+
+std::uint64_t TLSFBufferRangeAllocator::RoundUpToSizeClass(std::uint64_t size) {
+    if (size < SecondLevelCount) {
+        return size;
+    }
+    
+    const std::uint64_t classSize = std::uint64_t(1) << (FindLastSet(size) - SecondLevelLog2);
+    return size + classSize - 1;
+}
+
+std::uint32_t TLSFBufferRangeAllocator::findFreeBlock(std::uint32_t firstLevel, std::uint32_t secondLevel) const {
+    if (firstLevel >= FirstLevelCount) {
+        return InvalidBlock;
+    }
+    
+    // Look for a non-empty list in the same power of two class first and in the bigger ones if nothing was found
+    std::uint32_t secondLevelMap = secondLevelBitmaps[firstLevel] & (~std::uint32_t(0) << secondLevel);
+    
+    if (secondLevelMap == 0) {
+        const std::uint64_t firstLevelMap = (firstLevel + 1 < 64) ? (firstLevelBitmap & (~std::uint64_t(0) << (firstLevel + 1))) : 0;
+        
+        if (firstLevelMap == 0) {
+            return InvalidBlock;
+        }
+        
+        firstLevel = FindFirstSet(firstLevelMap);
+        secondLevelMap = secondLevelBitmaps[firstLevel];
+        assert(secondLevelMap != 0);
+    }
+    
+    secondLevel = FindFirstSet(secondLevelMap);
+    return freeLists[firstLevel * SecondLevelCount + secondLevel];
+}
+
+std::uint32_t TLSFBufferRangeAllocator::findFittingBlock(std::uint64_t size, std::uint64_t alignment) const {
+    std::uint32_t firstLevel;
+    std::uint32_t secondLevel;
+    
+    // Every block in the lists that are at least one size class above the requested size will fit the request. The padding
+    // usually isn't needed, so try without it first.
+    MapSize(RoundUpToSizeClass(size), firstLevel, secondLevel);
+    std::uint32_t block = findFreeBlock(firstLevel, secondLevel);
+    
+    if (block != InvalidBlock && blocks[block].size >= size + ComputePadding(blocks[block].offset, alignment)) {
+        return block;
+    }
+    
+    if (alignment > 1) {
+        MapSize(RoundUpToSizeClass(size + alignment - 1), firstLevel, secondLevel);
+        block = findFreeBlock(firstLevel, secondLevel);
+        
+        if (block != InvalidBlock) {
+            return block;
+        }
+    }
+    
+    // Rounding up may skip a block that would fit (e.g., the last free block of an almost full buffer). Such blocks can only
+    // be in the list of the requested size class.
+    MapSize(size, firstLevel, secondLevel);
+    block = freeLists[firstLevel * SecondLevelCount + secondLevel];
+    
+    while (block != InvalidBlock) {
+        if (blocks[block].size >= size + ComputePadding(blocks[block].offset, alignment)) {
+            return block;
+        }
+        
+        block = blocks[block].nextFree;
+    }
+    
+    return InvalidBlock;
+}
+
+TLSFBufferRangeAllocator::FreeRange TLSFBufferRangeAllocator::getFreeRange(Bytes size, Bytes alignment) {
+    if (size % alignment != 0) {
+        throw std::logic_error("size must be a multiple of alignment");
+    }
+    
+    if (size == Bytes(0)) {
+        return {BufferRange(), 0, true};
+    }
+    
+    if (size > freeSpace) {
+        return {BufferRange(), 0, false};
+    }
+    
+    const std::uint32_t block = findFittingBlock(size.count(), alignment.count());
+    if (block == InvalidBlock) {
+        return {BufferRange(), 0, false};
+    }
+    
+    removeFreeBlock(block);
+    
+    const std::uint64_t offset = blocks[block].offset;
+    const std::uint64_t padding = ComputePadding(offset, alignment.count());
+    const std::uint64_t allocatedSize = size.count() + padding;
+    assert(blocks[block].size >= allocatedSize);
+    
+    // Return the remainder to the free lists
+    if (blocks[block].size > allocatedSize) {
+        // Must be done first because it may reallocate the block vector
+        const std::uint32_t remainder = createBlock();
+        
+        Block& current = blocks[block];
+        Block& next = blocks[remainder];
+        
+        next.offset = offset + allocatedSize;
+        next.size = current.size - allocatedSize;
+        next.previousPhysical = block;
+        next.nextPhysical = current.nextPhysical;
+        
+        if (current.nextPhysical != InvalidBlock) {
+            blocks[current.nextPhysical].previousPhysical = remainder;
+        }
+        
+        current.nextPhysical = remainder;
+        current.size = allocatedSize;
+        
+        insertFreeBlock(remainder);
+    }
+    
+    blocks[block].free = false;
+    allocatedBlocks.emplace(offset, block);
+    freeSpace -= Bytes(allocatedSize);
+    
+    return {BufferRange(Bytes(offset), Bytes(allocatedSize)), static_cast<std::uint32_t>(padding), true};
+}
+
+bool TLSFBufferRangeAllocator::insert(const BufferRange& value) {
+    if (value.size == Bytes(0)) {
+        return true;
+    }
+    
+    auto it = allocatedBlocks.find(value.offset.count());
+    if (it == allocatedBlocks.end() || blocks[it->second].size != value.size.count()) {
+        return false;
+    }
+    
+    std::uint32_t block = it->second;
+    allocatedBlocks.erase(it);
+    
+    freeSpace += value.size;
+    
+    // Merge with the free neighbours
+    const std::uint32_t previous = blocks[block].previousPhysical;
+    if (previous != InvalidBlock && blocks[previous].free) {
+        removeFreeBlock(previous);
+        
+        blocks[previous].size += blocks[block].size;
+        blocks[previous].nextPhysical = blocks[block].nextPhysical;
+        
+        if (blocks[block].nextPhysical != InvalidBlock) {
+            blocks[blocks[block].nextPhysical].previousPhysical = previous;
+        }
+        
+        destroyBlock(block);
+        block = previous;
+    }
+    
+    const std::uint32_t next = blocks[block].nextPhysical;
+    if (next != InvalidBlock && blocks[next].free) {
+        removeFreeBlock(next);
+        
+        blocks[block].size += blocks[next].size;
+        blocks[block].nextPhysical = blocks[next].nextPhysical;
+        
+        if (blocks[next].nextPhysical != InvalidBlock) {
+            blocks[blocks[next].nextPhysical].previousPhysical = block;
+        }
+        
+        destroyBlock(next);
+    }
+    
+    insertFreeBlock(block);
+    return true;
+}
+
+Bytes TLSFBufferRangeAllocator::getLargestFreeRange() const {
+    if (firstLevelBitmap == 0) {
+        return Bytes(0);
+    }
+    
+    // The blocks in the highest non-empty list aren't sorted, but all of them are bigger than anything in the other lists
+    const std::uint32_t firstLevel = FindLastSet(firstLevelBitmap);
+    const std::uint32_t secondLevel = FindLastSet(secondLevelBitmaps[firstLevel]);
+    
+    std::uint64_t largest = 0;
+    for (std::uint32_t block = freeLists[firstLevel * SecondLevelCount + secondLevel]; block != InvalidBlock; block = blocks[block].nextFree) {
+        largest = std::max(largest, blocks[block].size);
+    }
+    
+    return Bytes(largest);
+}
+
+void TLSFBufferRangeAllocator::insertFreeBlock(std::uint32_t block) {
+    std::uint32_t firstLevel;
+    std::uint32_t secondLevel;
+    MapSize(blocks[block].size, firstLevel, secondLevel);
+    
+    std::uint32_t& head = freeLists[firstLevel * SecondLevelCount + secondLevel];
+    
+    blocks[block].free = true;
+    blocks[block].previousFree = InvalidBlock;
+    blocks[block].nextFree = head;
+    
+    if (head != InvalidBlock) {
+        blocks[head].previousFree = block;
+    }
+    
+    head = block;
+    
+    firstLevelBitmap |= std::uint64_t(1) << firstLevel;
+    secondLevelBitmaps[firstLevel] |= std::uint32_t(1) << secondLevel;
+    freeBlockCount++;
+}
+
+void TLSFBufferRangeAllocator::removeFreeBlock(std::uint32_t block) {
+    std::uint32_t firstLevel;
+    std::uint32_t secondLevel;
+    MapSize(blocks[block].size, firstLevel, secondLevel);
+    
+    const std::uint32_t previous = blocks[block].previousFree;
+    const std::uint32_t next = blocks[block].nextFree;
+    
+    if (previous != InvalidBlock) {
+        blocks[previous].nextFree = next;
+    }
+    
+    if (next != InvalidBlock) {
+        blocks[next].previousFree = previous;
+    }
+    
+    std::uint32_t& head = freeLists[firstLevel * SecondLevelCount + secondLevel];
+    if (head == block) {
+        head = next;
+        
+        if (head == InvalidBlock) {
+            secondLevelBitmaps[firstLevel] &= ~(std::uint32_t(1) << secondLevel);
+            
+            if (secondLevelBitmaps[firstLevel] == 0) {
+                firstLevelBitmap &= ~(std::uint64_t(1) << firstLevel);
+            }
+        }
+    }
+    
+    blocks[block].free = false;
+    freeBlockCount--;
+}
+
+std::uint32_t TLSFBufferRangeAllocator::createBlock() {
+    std::uint32_t block;
+    
+    if (unusedBlocks.empty()) {
+        block = static_cast<std::uint32_t>(blocks.size());
+        blocks.emplace_back();
+    } else {
+        block = unusedBlocks.back();
+        unusedBlocks.pop_back();
+    }
+    
+    blocks[block] = {0, 0, InvalidBlock, InvalidBlock, InvalidBlock, InvalidBlock, false};
+    return block;
+}
+
+void TLSFBufferRangeAllocator::destroyBlock(std::uint32_t block) {
+    unusedBlocks.push_back(block);
+}
+
+}
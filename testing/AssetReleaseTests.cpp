@@ -0,0 +1,430 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "AssetReleaseTests.hpp"
+#include "assets/AssetManager.hpp"
+#include "assets/typeManagers/ChunkedVectorTypeManager.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace iyf::test {
+class TestAsset : public Asset {
+public:
+    virtual AssetType getType() const final override {
+        return AssetType::Custom;
+    }
+};
+
+using TestAssetHandle = AssetHandle<TestAsset>;
+
+/// A ChunkedVectorTypeManager that loads its assets synchronously without reading anything. Freeing an asset only counts it.
+class TestTypeManager : public ChunkedVectorTypeManager<TestAsset> {
+public:
+    TestTypeManager(std::uint32_t gracePeriod) : gracePeriod(gracePeriod), freed(0) {}
+    
+    virtual AssetType getType() final override {
+        return AssetType::Custom;
+    }
+    
+    /// Loads a new asset, which may reuse the slot of a freed one.
+    ///
+    /// \param id Set to the slot of the asset.
+    TestAssetHandle loadNew(std::uint32_t& id) {
+        const auto result = load(StringHash(assets.size()), Path(), Metadata(), id, false, 0.0f);
+        return TestAssetHandle(static_cast<TestAsset*>(result.first), result.second);
+    }
+    
+    /// Returns a new handle to an asset that is still loaded, just like AssetManager::load() does when it finds the asset in
+    /// the lookup map.
+    TestAssetHandle acquire(std::uint32_t id) {
+        const auto result = fetch(id);
+        return TestAssetHandle(static_cast<TestAsset*>(result.first), result.second);
+    }
+    
+    void fullCollection() {
+        collectGarbage(GarbageCollectionRunPolicy::FullCollection);
+    }
+    
+    void incrementalCollection() {
+        collectGarbage(GarbageCollectionRunPolicy::IncrementalCollection);
+    }
+    
+    bool isLoaded(std::uint32_t id) const {
+        return assets[id].isLoaded();
+    }
+    
+    std::size_t getFreedCount() const {
+        return freed;
+    }
+protected:
+    virtual std::unique_ptr<LoadedAssetData> readFile(StringHash, const Path&, const Metadata& meta, TestAsset& assetData) final override {
+        return std::make_unique<LoadedAssetData>(meta, assetData, FileView());
+    }
+    
+    virtual void enableAsset(std::unique_ptr<LoadedAssetData> loadedAssetData, bool) final override {
+        loadedAssetData->assetData.setLoaded(true);
+    }
+    
+    virtual void performFree(TestAsset&) final override {
+        freed++;
+    }
+    
+    virtual void initMissingAssetHandle() final override {}
+    virtual void notifyRemoval(StringHash) final override {}
+    
+    virtual void submitStreamingRequest(std::unique_ptr<StreamingRequest>) final override {
+        throw std::logic_error("The TestTypeManager only loads assets synchronously");
+    }
+    
+    virtual void notifyStreamingRequestEnabled(StreamingRequest*) final override {
+        throw std::logic_error("The TestTypeManager only loads assets synchronously");
+    }
+    
+    virtual std::uint32_t getGarbageCollectionGracePeriod() const final override {
+        return gracePeriod;
+    }
+private:
+    std::uint32_t gracePeriod;
+    std::size_t freed;
+};
+
+AssetReleaseTests::AssetReleaseTests(bool verbose) : TestBase(verbose) { }
+AssetReleaseTests::~AssetReleaseTests() {}
+
+void AssetReleaseTests::initialize() {}
+
+TestResults AssetReleaseTests::validateReleaseList() {
+    const std::size_t count = 8;
+    
+    TestAsset asset;
+    AssetReleaseList list;
+    std::vector<AssetHandleRefCounter> counters(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        counters[i].setReleaseList(&list, static_cast<std::uint32_t>(i));
+    }
+    
+    std::vector<std::uint32_t> drained;
+    auto drain = [&list, &drained]() {
+        drained.clear();
+        const std::size_t result = list.drain([&drained](AssetHandleRefCounter& counter) {
+            drained.push_back(counter.getID());
+        });
+        
+        std::sort(drained.begin(), drained.end());
+        return result;
+    };
+    
+    // Every counter that drops to 0 must be reported exactly once
+    for (std::size_t i = 0; i < 4; ++i) {
+        TestAssetHandle handle(&asset, &counters[i]);
+    }
+    
+    if (drain() != 4 || drained != std::vector<std::uint32_t>{0, 1, 2, 3}) {
+        return TestResults(false, "Released counters were not reported");
+    }
+    
+    // Counters that still have references must not be reported
+    TestAssetHandle kept(&asset, &counters[4]);
+    {
+        TestAssetHandle copy = kept;
+    }
+    
+    if (drain() != 0) {
+        return TestResults(false, "A counter that still has references was reported");
+    }
+    
+    // A counter that gets released several times before the list is drained must only be reported once
+    for (std::size_t i = 0; i < 3; ++i) {
+        TestAssetHandle handle(&asset, &counters[5]);
+    }
+    
+    if (drain() != 1 || drained != std::vector<std::uint32_t>{5}) {
+        return TestResults(false, "A counter was reported more than once");
+    }
+    
+    // ...but it must be reported again once the list has been drained
+    {
+        TestAssetHandle handle(&asset, &counters[5]);
+    }
+    
+    if (drain() != 1 || drained != std::vector<std::uint32_t>{5}) {
+        return TestResults(false, "A drained counter was not reported again");
+    }
+    
+    // Counters that have no list (e.g., ones that belong to missing asset handles) don't report anything
+    AssetHandleRefCounter detached;
+    {
+        TestAssetHandle handle(&asset, &detached);
+    }
+    
+    if (drain() != 0) {
+        return TestResults(false, "A counter without a list was reported");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults AssetReleaseTests::validateConcurrentReleases() {
+    const std::size_t counterCount = 1024;
+    const std::size_t threadCount = 4;
+    const std::size_t iterations = 100000;
+    
+    TestAsset asset;
+    AssetReleaseList list;
+    std::vector<AssetHandleRefCounter> counters(counterCount);
+    for (std::size_t i = 0; i < counterCount; ++i) {
+        counters[i].setReleaseList(&list, static_cast<std::uint32_t>(i));
+    }
+    
+    // Every thread keeps a few handles alive for a while to make the counts bounce around 0
+    std::vector<std::thread> threads;
+    std::atomic<std::size_t> finished(0);
+    for (std::size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 generator(static_cast<std::uint32_t>(t));
+            std::uniform_int_distribution<std::size_t> distribution(0, counterCount - 1);
+            
+            std::vector<TestAssetHandle> handles(8, TestAssetHandle::CreateInvalid());
+            for (std::size_t i = 0; i < iterations; ++i) {
+                handles[i % handles.size()] = TestAssetHandle(&asset, &counters[distribution(generator)]);
+            }
+            
+            finished++;
+        });
+    }
+    
+    // The drained counters are recorded by a single thread that runs concurrently with the releases, just like the main thread does
+    std::vector<std::uint32_t> drainCounts(counterCount, 0);
+    bool duplicate = false;
+    auto drain = [&]() {
+        std::vector<bool> seen(counterCount, false);
+        list.drain([&](AssetHandleRefCounter& counter) {
+            const std::uint32_t id = counter.getID();
+            
+            duplicate |= seen[id];
+            seen[id] = true;
+            drainCounts[id]++;
+        });
+    };
+    
+    while (finished != threadCount) {
+        drain();
+        std::this_thread::yield();
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    drain();
+    
+    if (duplicate) {
+        return TestResults(false, "A counter was reported more than once in a single drain");
+    }
+    
+    for (std::size_t i = 0; i < counterCount; ++i) {
+        if (counters[i] != 0) {
+            return TestResults(false, "A reference count is not 0 after all handles were destroyed");
+        }
+        
+        if (drainCounts[i] == 0) {
+            return TestResults(false, "A released counter was never reported");
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults AssetReleaseTests::validateGracePeriod() {
+    const std::uint32_t gracePeriod = 3;
+    
+    TestTypeManager collector(gracePeriod);
+    std::vector<TestAssetHandle> handles;
+    for (std::uint32_t i = 0; i < 16; ++i) {
+        std::uint32_t id;
+        handles.push_back(collector.loadNew(id));
+    }
+    
+    // Released assets stay loaded during the grace period
+    handles[5] = TestAssetHandle::CreateInvalid();
+    for (std::uint32_t i = 0; i < gracePeriod; ++i) {
+        collector.incrementalCollection();
+        
+        if (!collector.isLoaded(5)) {
+            return TestResults(false, "An asset was freed before its grace period expired");
+        }
+    }
+    
+    // Reacquiring an asset during the grace period keeps it alive
+    handles[5] = collector.acquire(5);
+    for (std::uint32_t i = 0; i < gracePeriod * 2; ++i) {
+        collector.incrementalCollection();
+    }
+    
+    if (!collector.isLoaded(5) || collector.getFreedCount() != 0) {
+        return TestResults(false, "A reacquired asset was freed");
+    }
+    
+    // Releasing it again restarts the grace period
+    handles[5] = TestAssetHandle::CreateInvalid();
+    collector.incrementalCollection();
+    handles[5] = collector.acquire(5);
+    collector.incrementalCollection();
+    handles[5] = TestAssetHandle::CreateInvalid();
+    
+    for (std::uint32_t i = 0; i < gracePeriod; ++i) {
+        collector.incrementalCollection();
+        
+        if (!collector.isLoaded(5)) {
+            return TestResults(false, "An asset was freed using an outdated release");
+        }
+    }
+    
+    collector.incrementalCollection();
+    if (collector.isLoaded(5) || collector.getFreedCount() != 1) {
+        return TestResults(false, "An asset was not freed after its grace period expired");
+    }
+    
+    // Reloaded assets can be released and freed again
+    std::uint32_t reloaded;
+    handles[5] = collector.loadNew(reloaded);
+    if (reloaded != 5) {
+        return TestResults(false, "The slot of a freed asset was not reused");
+    }
+    
+    handles[5] = TestAssetHandle::CreateInvalid();
+    for (std::uint32_t i = 0; i <= gracePeriod; ++i) {
+        collector.incrementalCollection();
+    }
+    
+    if (collector.isLoaded(5) || collector.getFreedCount() != 2) {
+        return TestResults(false, "A reloaded asset was not freed");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults AssetReleaseTests::compareCollectionCost() {
+    const std::size_t assetCount = 500000;
+    const std::size_t releasesPerFrame = 10;
+    const std::size_t frameCount = 500;
+    
+    // Simulates a frame loop where a few assets get released and some of them get reacquired before the collection runs. The
+    // freed assets are loaded again after the collection, so every frame starts with all assets loaded and referenced.
+    auto measure = [&](bool incremental) {
+        TestTypeManager collector(0);
+        
+        std::vector<TestAssetHandle> handles;
+        handles.reserve(assetCount);
+        for (std::uint32_t i = 0; i < assetCount; ++i) {
+            std::uint32_t id;
+            handles.push_back(collector.loadNew(id));
+        }
+        
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<std::uint32_t> distribution(0, assetCount - 1);
+        
+        std::chrono::nanoseconds total(0);
+        for (std::size_t f = 0; f < frameCount; ++f) {
+            for (std::size_t r = 0; r < releasesPerFrame; ++r) {
+                handles[distribution(generator)] = TestAssetHandle::CreateInvalid();
+                
+                const std::uint32_t reacquired = distribution(generator);
+                if (!handles[reacquired].isValid()) {
+                    handles[reacquired] = collector.acquire(reacquired);
+                }
+            }
+            
+            const std::size_t freedBefore = collector.getFreedCount();
+            
+            const auto start = std::chrono::steady_clock::now();
+            if (incremental) {
+                collector.incrementalCollection();
+            } else {
+                collector.fullCollection();
+            }
+            total += std::chrono::steady_clock::now() - start;
+            
+            for (std::size_t i = freedBefore; i < collector.getFreedCount(); ++i) {
+                std::uint32_t id;
+                TestAssetHandle handle = collector.loadNew(id);
+                handles[id] = handle;
+            }
+        }
+        
+        const std::chrono::duration<double, std::micro> average = total / frameCount;
+        return std::make_pair(average.count(), collector.getFreedCount());
+    };
+    
+    const auto [fullTime, fullFreed] = measure(false);
+    const auto [incrementalTime, incrementalFreed] = measure(true);
+    
+    std::stringstream ss;
+    ss << "\n\t\t\t" << assetCount << " assets, " << releasesPerFrame << " releases per frame, " << frameCount << " frames";
+    ss << "\n\t\t\tFull collection:        " << fullTime << " us per frame";
+    ss << "\n\t\t\tIncremental collection: " << incrementalTime << " us per frame";
+    
+    if (fullFreed != incrementalFreed) {
+        return TestResults(false, "Different numbers of assets were freed" + ss.str());
+    }
+    
+    if (incrementalTime >= fullTime) {
+        return TestResults(false, "Incremental collection was not faster than full collection" + ss.str());
+    }
+    
+    return TestResults(true, ss.str());
+}
+
+TestResults AssetReleaseTests::run() {
+    TestResults results = validateReleaseList();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateConcurrentReleases();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateGracePeriod();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return compareCollectionCost();
+}
+
+void AssetReleaseTests::cleanup() {}
+
+}
@@ -0,0 +1,60 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_ASSET_RELEASE_TESTS_HPP
+#define IYF_ASSET_RELEASE_TESTS_HPP
+
+#include "TestBase.hpp"
+
+namespace iyf::test {
+
+/// Validates the AssetReleaseList that the TypeManagers use for event-driven garbage collection and compares the per frame
+/// cost of scanning all reference counters with the cost of draining the list when many assets are loaded, but only a few
+/// of them get released every frame.
+class AssetReleaseTests : public TestBase {
+public:
+    AssetReleaseTests(bool verbose);
+    virtual ~AssetReleaseTests();
+    
+    virtual std::string getName() const final override {
+        return "Event-driven asset garbage collection";
+    }
+    
+    virtual void initialize() final override;
+    virtual TestResults run() final override;
+    virtual void cleanup() final override;
+private:
+    TestResults validateReleaseList();
+    TestResults validateConcurrentReleases();
+    TestResults validateGracePeriod();
+    TestResults compareCollectionCost();
+};
+
+}
+
+#endif // IYF_ASSET_RELEASE_TESTS_HPP
@@ -0,0 +1,271 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "AsyncEnableTests.hpp"
+#include "assets/AssetManager.hpp"
+#include "assets/typeManagers/ChunkedVectorTypeManager.hpp"
+#include "threading/MPSCQueue.hpp"
+#include "threading/ThreadPool.hpp"
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace iyf::test {
+class StubAsset : public Asset {
+public:
+    virtual AssetType getType() const final override {
+        return AssetType::Custom;
+    }
+};
+
+/// A ChunkedVectorTypeManager whose reads block until the test opens them. It also stands in for the StreamingScheduler
+/// and dispatches every request to the ThreadPool as soon as it gets submitted.
+class BlockingTypeManager : public ChunkedVectorTypeManager<StubAsset> {
+public:
+    BlockingTypeManager(iyft::ThreadPool* pool, std::size_t assetCount) : pool(pool), gates(assetCount) {
+        for (auto& gate : gates) {
+            opened.push_back(gate.get_future().share());
+        }
+    }
+    
+    virtual AssetType getType() final override {
+        return AssetType::Custom;
+    }
+    
+    /// Starts an asynchronous load of the asset. Its read blocks until open() is called with the same index.
+    AssetHandle<StubAsset> loadAsync(std::size_t index) {
+        std::uint32_t id;
+        const auto result = load(StringHash(index), Path(), Metadata(), id, true, 0.0f);
+        
+        return AssetHandle<StubAsset>(static_cast<StubAsset*>(result.first), result.second);
+    }
+    
+    /// Lets the read of the asset finish.
+    void open(std::size_t index) {
+        gates[index].set_value();
+    }
+    
+    /// Does what AssetManager::enableLoadedAssets() does for a single asset.
+    ///
+    /// \return true if an asset was enabled, false if no reads have finished.
+    bool enableNext() {
+        if (hasAssetsToEnable() != AssetsToEnableResult::HasAssetsToEnable) {
+            return false;
+        }
+        
+        enableAsyncLoadedAsset(false);
+        return true;
+    }
+    
+    /// \return The indices of the enabled assets in the order in which they were enabled.
+    const std::vector<std::size_t>& getEnableOrder() const {
+        return enableOrder;
+    }
+protected:
+    virtual std::unique_ptr<LoadedAssetData> readFile(StringHash nameHash, const Path&, const Metadata& meta, StubAsset& assetData) final override {
+        opened[nameHash.value()].wait();
+        return std::make_unique<LoadedAssetData>(meta, assetData, FileView());
+    }
+    
+    virtual void enableAsset(std::unique_ptr<LoadedAssetData> loadedAssetData, bool) final override {
+        enableOrder.push_back(loadedAssetData->assetData.getNameHash().value());
+        loadedAssetData->assetData.setLoaded(true);
+    }
+    
+    virtual void performFree(StubAsset&) final override {}
+    virtual void initMissingAssetHandle() final override {}
+    virtual void notifyRemoval(StringHash) final override {}
+    
+    virtual void submitStreamingRequest(std::unique_ptr<StreamingRequest> request) final override {
+        StreamingRequest* dispatched = request.get();
+        requests.push_back(std::move(request));
+        
+        pool->addTask([this, dispatched]() {
+            static_cast<StreamingRequestHandler*>(this)->executeStreamingRequest(*dispatched);
+        });
+    }
+    
+    virtual void notifyStreamingRequestEnabled(StreamingRequest* request) final override {
+        requests.erase(std::find_if(requests.begin(), requests.end(), [request](const std::unique_ptr<StreamingRequest>& r) {
+            return r.get() == request;
+        }));
+    }
+    
+    virtual std::uint32_t getGarbageCollectionGracePeriod() const final override {
+        return 0;
+    }
+private:
+    iyft::ThreadPool* pool;
+    std::vector<std::promise<void>> gates;
+    std::vector<std::shared_future<void>> opened;
+    std::vector<std::unique_ptr<StreamingRequest>> requests;
+    std::vector<std::size_t> enableOrder;
+};
+
+AsyncEnableTests::AsyncEnableTests(bool verbose) : TestBase(verbose) { }
+AsyncEnableTests::~AsyncEnableTests() {}
+
+void AsyncEnableTests::initialize() {}
+
+TestResults AsyncEnableTests::validateQueue() {
+    constexpr std::size_t ProducerCount = 4;
+    constexpr std::uint32_t ItemsPerProducer = 200000;
+    
+    struct Item {
+        std::uint32_t producer = 0;
+        std::uint32_t sequence = 0;
+    };
+    
+    iyft::MPSCQueue<Item> queue;
+    std::vector<std::thread> producers;
+    producers.reserve(ProducerCount);
+    
+    for (std::uint32_t p = 0; p < ProducerCount; ++p) {
+        producers.emplace_back([&queue, p]() {
+            for (std::uint32_t i = 0; i < ItemsPerProducer; ++i) {
+                queue.push(Item{p, i});
+            }
+        });
+    }
+    
+    // Consume while the producers are still running. Items from a single producer must arrive in order.
+    std::vector<std::uint32_t> expected(ProducerCount, 0);
+    std::size_t received = 0;
+    bool ordered = true;
+    
+    while (received < ProducerCount * ItemsPerProducer) {
+        Item item;
+        if (!queue.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        
+        ordered = ordered && (item.sequence == expected[item.producer]);
+        expected[item.producer] = item.sequence + 1;
+        received++;
+    }
+    
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    
+    if (!ordered) {
+        return TestResults(false, "The MPSCQueue reordered the items of a producer");
+    }
+    
+    Item item;
+    if (!queue.empty() || queue.pop(item)) {
+        return TestResults(false, "The MPSCQueue returned more items than were pushed");
+    }
+    
+    // Items that were never popped must be destroyed together with the queue
+    auto tracker = std::make_shared<int>(0);
+    {
+        iyft::MPSCQueue<std::shared_ptr<int>> owners;
+        for (int i = 0; i < 16; ++i) {
+            owners.push(tracker);
+        }
+        
+        std::shared_ptr<int> popped;
+        owners.pop(popped);
+        
+        if (owners.front() == nullptr || **owners.front() != 0 || tracker.use_count() != 17) {
+            return TestResults(false, "The MPSCQueue lost track of its items");
+        }
+    }
+    
+    if (tracker.use_count() != 1) {
+        return TestResults(false, "The MPSCQueue leaked items that were never popped");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults AsyncEnableTests::validateEnableOrder() {
+    const std::size_t assetCount = 8;
+    
+    // Every read gets its own worker, so reads only ever wait for their own gates
+    iyft::ThreadPool pool(assetCount);
+    BlockingTypeManager manager(&pool, assetCount);
+    
+    std::vector<AssetHandle<StubAsset>> handles;
+    for (std::size_t i = 0; i < assetCount; ++i) {
+        handles.push_back(manager.loadAsync(i));
+    }
+    
+    if (manager.enableNext()) {
+        return TestResults(false, "An asset was enabled before its read finished");
+    }
+    
+    // The reads finish in the reverse of the request order. E.g., the first asset stands for a large one that's still being
+    // read when the small ones requested after it finish, and they must not wait for it.
+    std::vector<std::size_t> completionOrder;
+    for (std::size_t i = assetCount; i > 0; --i) {
+        completionOrder.push_back(i - 1);
+    }
+    
+    for (const std::size_t index : completionOrder) {
+        manager.open(index);
+        
+        while (!manager.enableNext()) {
+            std::this_thread::yield();
+        }
+        
+        if (manager.enableNext()) {
+            return TestResults(false, "An asset was enabled before its read finished");
+        }
+    }
+    
+    if (manager.getEnableOrder() != completionOrder) {
+        return TestResults(false, "The assets were not enabled in the order in which their reads finished");
+    }
+    
+    for (const auto& handle : handles) {
+        if (!handle->isLoaded()) {
+            return TestResults(false, "An enabled asset was not marked as loaded");
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults AsyncEnableTests::run() {
+    const TestResults results = validateQueue();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return validateEnableOrder();
+}
+
+void AsyncEnableTests::cleanup() {}
+
+}
@@ -0,0 +1,58 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_ASYNC_ENABLE_TESTS_HPP
+#define IYF_ASYNC_ENABLE_TESTS_HPP
+
+#include "TestBase.hpp"
+
+namespace iyf::test {
+
+/// Validates the MPSCQueue that TypeManagers use to receive asynchronously loaded assets and checks that a
+/// ChunkedVectorTypeManager enables assets in the order in which their reads finish instead of the order in which they
+/// were requested.
+class AsyncEnableTests : public TestBase {
+public:
+    AsyncEnableTests(bool verbose);
+    virtual ~AsyncEnableTests();
+    
+    virtual std::string getName() const final override {
+        return "Completion ordered async asset enabling";
+    }
+    
+    virtual void initialize() final override;
+    virtual TestResults run() final override;
+    virtual void cleanup() final override;
+private:
+    TestResults validateQueue();
+    TestResults validateEnableOrder();
+};
+
+}
+
+#endif // IYF_ASYNC_ENABLE_TESTS_HPP
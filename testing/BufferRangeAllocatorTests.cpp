@@ -0,0 +1,468 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "BufferRangeAllocatorTests.hpp"
+#include "utilities/BufferRangeSet.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace iyf::test {
+struct TestAllocation {
+    BufferRange range;
+    std::uint32_t padding;
+    Bytes alignment;
+    std::uint8_t tag;
+};
+
+static const char* AllocatorName(BufferRangeAllocatorType type) {
+    switch (type) {
+        case BufferRangeAllocatorType::FirstFit:
+            return "FirstFit";
+        case BufferRangeAllocatorType::TLSF:
+            return "TLSF";
+    }
+    
+    return "Unknown";
+}
+
+/// Generates mesh-like allocations: element sizes of common vertex layouts and 16 bit indices, mostly small element counts.
+class AllocationGenerator {
+public:
+    AllocationGenerator(std::uint32_t seed, std::uint32_t maxElements) : generator(seed), alignmentDistribution(0, 5), elementDistribution(0.0f, 1.0f), maxElements(maxElements) {}
+    
+    std::pair<Bytes, Bytes> next() {
+        static const std::uint64_t alignments[] = {2, 4, 12, 20, 32, 48};
+        const std::uint64_t alignment = alignments[alignmentDistribution(generator)];
+        
+        // Cubing makes small meshes a lot more common than big ones
+        const float r = elementDistribution(generator);
+        const std::uint64_t elements = 1 + static_cast<std::uint64_t>(r * r * r * maxElements);
+        
+        return {Bytes(elements * alignment), Bytes(alignment)};
+    }
+    
+    std::mt19937& getGenerator() {
+        return generator;
+    }
+private:
+    std::mt19937 generator;
+    std::uniform_int_distribution<std::size_t> alignmentDistribution;
+    std::uniform_real_distribution<float> elementDistribution;
+    std::uint32_t maxElements;
+};
+
+BufferRangeAllocatorTests::BufferRangeAllocatorTests(bool verbose) : TestBase(verbose) { }
+BufferRangeAllocatorTests::~BufferRangeAllocatorTests() {}
+
+void BufferRangeAllocatorTests::initialize() {}
+
+TestResults BufferRangeAllocatorTests::validateBasics(BufferRangeAllocatorType type) {
+    const std::string name = AllocatorName(type);
+    
+    // The example from the documentation of BufferRangeAllocator::FreeRange
+    {
+        auto allocator = BufferRangeAllocator::Create(type, Bytes(64));
+        
+        const auto first = allocator->getFreeRange(Bytes(8), Bytes(2));
+        const auto second = allocator->getFreeRange(Bytes(10), Bytes(5));
+        
+        if (!first.status || !second.status || first.completeRange != BufferRange(Bytes(0), Bytes(8)) ||
+            second.completeRange != BufferRange(Bytes(8), Bytes(12)) || second.startPadding != 2) {
+            return TestResults(false, name + ": unexpected ranges or padding");
+        }
+        
+        if (allocator->getFreeSpace() != Bytes(44) || allocator->getFreeRangeCount() != 1) {
+            return TestResults(false, name + ": unexpected free space after allocation");
+        }
+        
+        // Freeing the ranges must merge them back into a single one
+        allocator->insert(first.completeRange);
+        allocator->insert(second.completeRange);
+        
+        if (allocator->getFreeSpace() != Bytes(64) || allocator->getFreeRangeCount() != 1 || allocator->getLargestFreeRange() != Bytes(64)) {
+            return TestResults(false, name + ": freed ranges were not merged");
+        }
+    }
+    
+    // The whole buffer must be usable, even if the request can't be rounded up to a bigger size class
+    {
+        auto allocator = BufferRangeAllocator::Create(type, Bytes(1000));
+        
+        const auto all = allocator->getFreeRange(Bytes(1000), Bytes(4));
+        if (!all.status || allocator->getFreeSpace() != Bytes(0) || allocator->getFragmentation() != 0.0f) {
+            return TestResults(false, name + ": failed to allocate the whole buffer");
+        }
+        
+        if (allocator->getFreeRange(Bytes(4), Bytes(4)).status) {
+            return TestResults(false, name + ": allocated from a full buffer");
+        }
+        
+        allocator->insert(all.completeRange);
+        
+        // Three holes of 100 bytes with 100 byte gaps between them
+        std::vector<BufferRangeAllocator::FreeRange> ranges;
+        for (std::size_t i = 0; i < 10; ++i) {
+            ranges.push_back(allocator->getFreeRange(Bytes(100), Bytes(4)));
+        }
+        
+        for (std::size_t i = 1; i < 6; i += 2) {
+            allocator->insert(ranges[i].completeRange);
+        }
+        
+        if (allocator->getFreeRangeCount() != 3 || allocator->getLargestFreeRange() != Bytes(100) || allocator->getFreeSpace() != Bytes(300)) {
+            return TestResults(false, name + ": unexpected free ranges");
+        }
+        
+        if (allocator->getFreeRange(Bytes(200), Bytes(4)).status) {
+            return TestResults(false, name + ": allocated a range that's bigger than any free one");
+        }
+        
+        // Relocation only moves ranges down
+        const auto moved = allocator->relocate(ranges[8].completeRange, 0, Bytes(4));
+        if (!moved.status || moved.completeRange.offset >= ranges[8].completeRange.offset) {
+            return TestResults(false, name + ": failed to relocate a range");
+        }
+        
+        allocator->insert(moved.completeRange);
+        if (allocator->relocate(ranges[0].completeRange, 0, Bytes(4)).status) {
+            return TestResults(false, name + ": relocated a range up");
+        }
+        
+        if (allocator->getFreeSpace() != Bytes(300)) {
+            return TestResults(false, name + ": a failed relocation changed the free space");
+        }
+    }
+    
+    // Zero sized allocations are allowed (e.g., meshes without indices)
+    {
+        auto allocator = BufferRangeAllocator::Create(type, Bytes(64));
+        
+        const auto empty = allocator->getFreeRange(Bytes(0), Bytes(2));
+        if (!empty.status || empty.completeRange.size != Bytes(0) || !allocator->insert(empty.completeRange) || allocator->getFreeSpace() != Bytes(64)) {
+            return TestResults(false, name + ": zero sized allocations are broken");
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults BufferRangeAllocatorTests::validateChurn(BufferRangeAllocatorType type) {
+    const std::string name = AllocatorName(type);
+    const Bytes totalSpace(4 * 1024 * 1024);
+    const std::size_t operations = 100000;
+    
+    auto allocator = BufferRangeAllocator::Create(type, totalSpace);
+    AllocationGenerator allocations(1337, 2048);
+    std::uniform_int_distribution<int> coin(0, 99);
+    
+    std::vector<TestAllocation> live;
+    std::map<std::uint64_t, std::uint64_t> used;
+    Bytes usedSpace(0);
+    std::size_t failures = 0;
+    float maxFragmentation = 0.0f;
+    
+    for (std::size_t i = 0; i < operations; ++i) {
+        // Slightly more allocations than frees fill the buffer up and keep it close to full
+        if (live.empty() || coin(allocations.getGenerator()) < 55) {
+            const auto [size, alignment] = allocations.next();
+            const auto result = allocator->getFreeRange(size, alignment);
+            
+            if (!result.status) {
+                failures++;
+                continue;
+            }
+            
+            const BufferRange& range = result.completeRange;
+            if (range.offset + range.size > totalSpace || range.size != size + Bytes(result.startPadding) ||
+                (range.offset.count() + result.startPadding) % alignment.count() != 0) {
+                return TestResults(false, name + ": returned an invalid range");
+            }
+            
+            // Check the neighbours for overlaps
+            auto next = used.lower_bound(range.offset.count());
+            if (next != used.end() && next->first < range.offset.count() + range.size.count()) {
+                return TestResults(false, name + ": returned an overlapping range");
+            }
+            
+            if (next != used.begin() && std::prev(next)->first + std::prev(next)->second > range.offset.count()) {
+                return TestResults(false, name + ": returned an overlapping range");
+            }
+            
+            used.emplace(range.offset.count(), range.size.count());
+            live.push_back({range, result.startPadding, alignment, 0});
+            usedSpace += range.size;
+        } else {
+            std::uniform_int_distribution<std::size_t> pick(0, live.size() - 1);
+            const std::size_t id = pick(allocations.getGenerator());
+            
+            if (!allocator->insert(live[id].range)) {
+                return TestResults(false, name + ": failed to free a range");
+            }
+            
+            used.erase(live[id].range.offset.count());
+            usedSpace -= live[id].range.size;
+            
+            std::swap(live[id], live.back());
+            live.pop_back();
+        }
+        
+        if (allocator->getFreeSpace() + usedSpace != totalSpace) {
+            return TestResults(false, name + ": the free space is out of sync");
+        }
+        
+        maxFragmentation = std::max(maxFragmentation, allocator->getFragmentation());
+    }
+    
+    for (const TestAllocation& a : live) {
+        allocator->insert(a.range);
+    }
+    
+    if (allocator->getFreeSpace() != totalSpace || allocator->getFreeRangeCount() != 1 || allocator->getLargestFreeRange() != totalSpace) {
+        return TestResults(false, name + ": the buffer was not restored after freeing everything");
+    }
+    
+    std::stringstream ss;
+    ss << "\n\t\t\t" << name << ": " << failures << " failed allocations, max fragmentation " << maxFragmentation * 100.0f << "%";
+    return TestResults(true, ss.str());
+}
+
+TestResults BufferRangeAllocatorTests::validateCompaction(BufferRangeAllocatorType type) {
+    const std::string name = AllocatorName(type);
+    const Bytes totalSpace(4 * 1024 * 1024);
+    
+    auto allocator = BufferRangeAllocator::Create(type, totalSpace);
+    AllocationGenerator allocations(7, 1024);
+    
+    // Fill the buffer and free every other allocation. The contents of the mirror are used to check the moves.
+    std::vector<std::uint8_t> mirror(totalSpace.count(), 0);
+    std::vector<TestAllocation> live;
+    
+    std::vector<TestAllocation> all;
+    while (true) {
+        const auto [size, alignment] = allocations.next();
+        const auto result = allocator->getFreeRange(size, alignment);
+        
+        if (!result.status) {
+            break;
+        }
+        
+        all.push_back({result.completeRange, result.startPadding, alignment, 0});
+    }
+    
+    for (std::size_t i = 0; i < all.size(); ++i) {
+        if (i % 2 == 0) {
+            allocator->insert(all[i].range);
+            continue;
+        }
+        
+        TestAllocation& a = all[i];
+        a.tag = static_cast<std::uint8_t>(1 + live.size() % 255);
+        std::memset(mirror.data() + a.range.offset.count() + a.padding, a.tag, a.range.size.count() - a.padding);
+        live.push_back(a);
+    }
+    
+    const float fragmentationBefore = allocator->getFragmentation();
+    const Bytes largestBefore = allocator->getLargestFreeRange();
+    
+    // Same as the MeshTypeManager defragmenter: move the allocations with the highest offsets down until nothing moves
+    std::size_t moves = 0;
+    std::size_t passes = 0;
+    bool moved = true;
+    while (moved) {
+        moved = false;
+        passes++;
+        
+        std::sort(live.begin(), live.end(), [](const TestAllocation& a, const TestAllocation& b) {
+            return a.range.offset > b.range.offset;
+        });
+        
+        for (TestAllocation& a : live) {
+            const auto result = allocator->relocate(a.range, a.padding, a.alignment);
+            if (!result.status) {
+                continue;
+            }
+            
+            const std::uint64_t oldOffset = a.range.offset.count() + a.padding;
+            const std::uint64_t newOffset = result.completeRange.offset.count() + result.startPadding;
+            const std::uint64_t dataSize = a.range.size.count() - a.padding;
+            
+            std::memcpy(mirror.data() + newOffset, mirror.data() + oldOffset, dataSize);
+            std::memset(mirror.data() + oldOffset, 0, dataSize);
+            
+            allocator->insert(a.range);
+            a.range = result.completeRange;
+            a.padding = result.startPadding;
+            
+            moves++;
+            moved = true;
+        }
+    }
+    
+    for (const TestAllocation& a : live) {
+        const std::uint8_t* data = mirror.data() + a.range.offset.count() + a.padding;
+        const std::uint64_t dataSize = a.range.size.count() - a.padding;
+        
+        if (std::any_of(data, data + dataSize, [&a](std::uint8_t value) { return value != a.tag; })) {
+            return TestResults(false, name + ": the data was corrupted during compaction");
+        }
+    }
+    
+    const float fragmentationAfter = allocator->getFragmentation();
+    if (fragmentationAfter >= fragmentationBefore || allocator->getLargestFreeRange() <= largestBefore) {
+        return TestResults(false, name + ": compaction did not reduce fragmentation");
+    }
+    
+    std::stringstream ss;
+    ss << "\n\t\t\t" << name << " compaction: " << moves << " moves in " << passes << " passes, fragmentation " << fragmentationBefore * 100.0f << "% -> "
+       << fragmentationAfter * 100.0f << "%, largest free range " << largestBefore.count() << " B -> " << allocator->getLargestFreeRange().count() << " B";
+    return TestResults(true, ss.str());
+}
+
+TestResults BufferRangeAllocatorTests::compareLatency() {
+    const Bytes totalSpace(64 * 1024 * 1024);
+    const std::size_t warmupAllocations = 40000;
+    const std::size_t operations = 200000;
+    
+    std::stringstream ss;
+    ss << "\n\t\t\tRandom churn on a " << Mebibytes(totalSpace).count() << " MiB buffer, " << operations << " operations (ns per call):";
+    
+    std::vector<double> averageAllocationTimes;
+    for (BufferRangeAllocatorType type : {BufferRangeAllocatorType::FirstFit, BufferRangeAllocatorType::TLSF}) {
+        auto allocator = BufferRangeAllocator::Create(type, totalSpace);
+        AllocationGenerator allocations(42, 512);
+        std::uniform_int_distribution<int> coin(0, 1);
+        
+        std::vector<BufferRange> live;
+        live.reserve(warmupAllocations * 2);
+        
+        for (std::size_t i = 0; i < warmupAllocations; ++i) {
+            const auto [size, alignment] = allocations.next();
+            const auto result = allocator->getFreeRange(size, alignment);
+            
+            if (result.status) {
+                live.push_back(result.completeRange);
+            }
+        }
+        
+        std::vector<double> allocationTimes;
+        std::vector<double> freeTimes;
+        allocationTimes.reserve(operations);
+        freeTimes.reserve(operations);
+        std::size_t failures = 0;
+        
+        for (std::size_t i = 0; i < operations; ++i) {
+            if (live.empty() || coin(allocations.getGenerator()) == 0) {
+                const auto [size, alignment] = allocations.next();
+                
+                const auto start = std::chrono::steady_clock::now();
+                const auto result = allocator->getFreeRange(size, alignment);
+                const auto end = std::chrono::steady_clock::now();
+                
+                allocationTimes.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+                
+                if (result.status) {
+                    live.push_back(result.completeRange);
+                } else {
+                    failures++;
+                }
+            } else {
+                std::uniform_int_distribution<std::size_t> pick(0, live.size() - 1);
+                const std::size_t id = pick(allocations.getGenerator());
+                
+                const auto start = std::chrono::steady_clock::now();
+                allocator->insert(live[id]);
+                const auto end = std::chrono::steady_clock::now();
+                
+                freeTimes.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+                
+                std::swap(live[id], live.back());
+                live.pop_back();
+            }
+        }
+        
+        auto summarize = [](std::vector<double>& times) {
+            const double average = std::accumulate(times.begin(), times.end(), 0.0) / static_cast<double>(times.size());
+            
+            std::sort(times.begin(), times.end());
+            const double p99 = times[static_cast<std::size_t>(times.size() * 0.99)];
+            
+            return std::make_pair(average, p99);
+        };
+        
+        const auto [allocationAverage, allocationP99] = summarize(allocationTimes);
+        const auto [freeAverage, freeP99] = summarize(freeTimes);
+        averageAllocationTimes.push_back(allocationAverage);
+        
+        ss << "\n\t\t\t" << AllocatorName(type) << ": allocation avg " << allocationAverage << " p99 " << allocationP99
+           << ", free avg " << freeAverage << " p99 " << freeP99 << ", " << live.size() << " live ranges, "
+           << allocator->getFreeRangeCount() << " free ranges, " << failures << " failed allocations";
+    }
+    
+    if (averageAllocationTimes[1] >= averageAllocationTimes[0]) {
+        return TestResults(false, "TLSF allocations were not faster than first fit ones" + ss.str());
+    }
+    
+    return TestResults(true, ss.str());
+}
+
+TestResults BufferRangeAllocatorTests::run() {
+    std::string notes;
+    
+    for (BufferRangeAllocatorType type : {BufferRangeAllocatorType::FirstFit, BufferRangeAllocatorType::TLSF}) {
+        TestResults results = validateBasics(type);
+        if (!results.isSuccessful()) {
+            return results;
+        }
+        
+        results = validateChurn(type);
+        if (!results.isSuccessful()) {
+            return results;
+        }
+        notes += results.getNotes();
+        
+        results = validateCompaction(type);
+        if (!results.isSuccessful()) {
+            return results;
+        }
+        notes += results.getNotes();
+    }
+    
+    TestResults results = compareLatency();
+    return TestResults(results.isSuccessful(), notes + results.getNotes());
+}
+
+void BufferRangeAllocatorTests::cleanup() {}
+
+}
@@ -0,0 +1,60 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_BUFFER_RANGE_ALLOCATOR_TESTS_HPP
+#define IYF_BUFFER_RANGE_ALLOCATOR_TESTS_HPP
+
+#include "TestBase.hpp"
+#include "utilities/BufferRangeAllocator.hpp"
+
+namespace iyf::test {
+
+/// Validates the BufferRangeAllocator implementations under random churn, checks that BufferRangeAllocator::relocate() can
+/// compact a fragmented buffer and compares the allocation and deallocation latencies of the first fit and TLSF allocators.
+class BufferRangeAllocatorTests : public TestBase {
+public:
+    BufferRangeAllocatorTests(bool verbose);
+    virtual ~BufferRangeAllocatorTests();
+    
+    virtual std::string getName() const final override {
+        return "Buffer range allocator tests";
+    }
+    
+    virtual void initialize() final override;
+    virtual TestResults run() final override;
+    virtual void cleanup() final override;
+private:
+    TestResults validateBasics(BufferRangeAllocatorType type);
+    TestResults validateChurn(BufferRangeAllocatorType type);
+    TestResults validateCompaction(BufferRangeAllocatorType type);
+    TestResults compareLatency();
+};
+
+}
+
+#endif // IYF_BUFFER_RANGE_ALLOCATOR_TESTS_HPP
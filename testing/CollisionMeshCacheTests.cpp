@@ -0,0 +1,260 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "CollisionMeshCacheTests.hpp"
+#include "physics/CollisionMeshCache.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif // __linux__
+
+namespace iyf::test {
+/// Same size and position offset as the vertices of the biggest engine vertex layouts
+struct TestVertex {
+    float position[3];
+    float normal[3];
+    float tangent[3];
+    float bitangent[3];
+    float uv[2];
+};
+
+#if defined(__SANITIZE_ADDRESS__)
+#define IYF_ADDRESS_SANITIZER_ACTIVE
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define IYF_ADDRESS_SANITIZER_ACTIVE
+#endif
+#endif
+
+/// \remark AddressSanitizer keeps freed memory in quarantine, which makes the measurements useless in such builds
+///
+/// \return The resident set size of this process or an std::nullopt if it can't be determined on this platform
+static std::optional<std::uint64_t> GetResidentMemory() {
+#if defined(__linux__) && !defined(IYF_ADDRESS_SANITIZER_ACTIVE)
+    std::ifstream statm("/proc/self/statm");
+    std::uint64_t size = 0;
+    std::uint64_t resident = 0;
+    
+    if (statm >> size >> resident) {
+        return resident * static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+#endif // defined(__linux__) && !defined(IYF_ADDRESS_SANITIZER_ACTIVE)
+    
+    return std::nullopt;
+}
+
+static double ToMiB(std::uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+static void FillMesh(std::mt19937& generator, TestVertex* vertices, std::size_t vertexCount, void* indices, std::size_t indexCount, bool indices32Bit) {
+    std::uniform_real_distribution<float> values(-100.0f, 100.0f);
+    std::uniform_int_distribution<std::uint32_t> ids(0, static_cast<std::uint32_t>(vertexCount - 1));
+    
+    for (std::size_t i = 0; i < vertexCount; ++i) {
+        float* v = reinterpret_cast<float*>(&vertices[i]);
+        for (std::size_t j = 0; j < sizeof(TestVertex) / sizeof(float); ++j) {
+            v[j] = values(generator);
+        }
+    }
+    
+    for (std::size_t i = 0; i < indexCount; ++i) {
+        if (indices32Bit) {
+            static_cast<std::uint32_t*>(indices)[i] = ids(generator);
+        } else {
+            static_cast<std::uint16_t*>(indices)[i] = static_cast<std::uint16_t>(ids(generator));
+        }
+    }
+}
+
+CollisionMeshCacheTests::CollisionMeshCacheTests(bool verbose) : TestBase(verbose) { }
+CollisionMeshCacheTests::~CollisionMeshCacheTests() {}
+
+void CollisionMeshCacheTests::initialize() {}
+
+TestResults CollisionMeshCacheTests::validateContents() {
+    std::mt19937 generator(42);
+    CollisionMeshCache cache;
+    
+    // The first mesh is small enough to have its indices narrowed, the second one isn't
+    for (const std::size_t vertexCount : {std::size_t(1000), std::size_t(70000)}) {
+        const std::size_t indexCount = vertexCount * 3;
+        const StringHash key(vertexCount);
+        
+        std::vector<TestVertex> vertices(vertexCount);
+        std::vector<std::uint32_t> indices(indexCount);
+        FillMesh(generator, vertices.data(), vertexCount, indices.data(), indexCount, true);
+        
+        const auto mapping = cache.insert(key, vertices.data(), vertexCount, sizeof(TestVertex), 0, indices.data(), indexCount, 4);
+        if (mapping != cache.getMapping(key)) {
+            return TestResults(false, "The mapping returned by insert() doesn't match the one returned by getMapping()");
+        }
+        
+        const auto& [vertexMapping, indexMapping] = mapping;
+        if (vertexMapping.count != vertexCount || vertexMapping.stride != CollisionMeshCache::PositionStride || indexMapping.count != indexCount) {
+            return TestResults(false, "Unexpected mapping counts or strides");
+        }
+        
+        const std::size_t expectedIndexStride = (vertexCount <= 65536) ? 2 : 4;
+        if (indexMapping.stride != expectedIndexStride) {
+            return TestResults(false, "Unexpected index stride");
+        }
+        
+        for (std::size_t i = 0; i < vertexCount; ++i) {
+            if (std::memcmp(vertexMapping.data + i * vertexMapping.stride, vertices[i].position, CollisionMeshCache::PositionStride) != 0) {
+                return TestResults(false, "The positions were not copied correctly");
+            }
+        }
+        
+        for (std::size_t i = 0; i < indexCount; ++i) {
+            const std::uint32_t index = (indexMapping.stride == 2) ? reinterpret_cast<const std::uint16_t*>(indexMapping.data)[i] :
+                                                                     reinterpret_cast<const std::uint32_t*>(indexMapping.data)[i];
+            if (index != indices[i]) {
+                return TestResults(false, "The indices were not copied correctly");
+            }
+        }
+    }
+    
+    // A position that doesn't start at the beginning of a vertex
+    {
+        std::vector<TestVertex> vertices(16);
+        std::vector<std::uint16_t> indices(48);
+        FillMesh(generator, vertices.data(), vertices.size(), indices.data(), indices.size(), false);
+        
+        const std::uint32_t offset = offsetof(TestVertex, normal);
+        const auto mapping = cache.insert(StringHash(1), vertices.data(), vertices.size(), sizeof(TestVertex), offset, indices.data(), indices.size(), 2);
+        if (std::memcmp(mapping.first.data + 5 * CollisionMeshCache::PositionStride, vertices[5].normal, CollisionMeshCache::PositionStride) != 0) {
+            return TestResults(false, "The position offset was ignored");
+        }
+    }
+    
+    const std::uint64_t expectedUsage = (1000 * 12 + 3000 * 2) + (70000 * 12 + 210000 * 4) + (16 * 12 + 48 * 2);
+    if (cache.getSize() != 3 || cache.getMemoryUsage() != Bytes(expectedUsage)) {
+        return TestResults(false, "Unexpected cache size or memory usage");
+    }
+    
+    if (!cache.erase(StringHash(1)) || cache.erase(StringHash(1)) || cache.contains(StringHash(1))) {
+        return TestResults(false, "Failed to erase an entry");
+    }
+    
+    cache.clear();
+    if (cache.getSize() != 0 || cache.getMemoryUsage() != Bytes(0)) {
+        return TestResults(false, "Failed to clear the cache");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults CollisionMeshCacheTests::compareResidentMemory() {
+    // A synthetic mesh set: 256 meshes, 1 in 8 of them is used by the physics engine
+    const std::size_t meshCount = 256;
+    const std::size_t physicsMeshInterval = 8;
+    const std::size_t vertexCount = 4096;
+    const std::size_t indexCount = 3 * 8192;
+    const std::size_t vertexBytes = vertexCount * sizeof(TestVertex);
+    const std::size_t indexBytes = indexCount * sizeof(std::uint16_t);
+    
+    std::mt19937 generator(7);
+    
+    // Mimics a file read: only one mesh is in system RAM at a time
+    std::vector<TestVertex> loadedVertices(vertexCount);
+    std::vector<std::uint16_t> loadedIndices(indexCount);
+    
+    const auto baseline = GetResidentMemory();
+    
+    // MeshHostDataMode::MirrorBuffers keeps everything
+    std::unique_ptr<char[]> vboMirror(new char[meshCount * vertexBytes]);
+    std::unique_ptr<char[]> iboMirror(new char[meshCount * indexBytes]);
+    
+    for (std::size_t i = 0; i < meshCount; ++i) {
+        FillMesh(generator, loadedVertices.data(), vertexCount, loadedIndices.data(), indexCount, false);
+        std::memcpy(vboMirror.get() + i * vertexBytes, loadedVertices.data(), vertexBytes);
+        std::memcpy(iboMirror.get() + i * indexBytes, loadedIndices.data(), indexBytes);
+    }
+    
+    const auto withMirrors = GetResidentMemory();
+    const std::uint64_t mirrorBytes = meshCount * (vertexBytes + indexBytes);
+    
+    vboMirror.reset();
+    iboMirror.reset();
+    
+    // MeshHostDataMode::CollisionCache only keeps positions and indices of the physics meshes
+    CollisionMeshCache cache;
+    for (std::size_t i = 0; i < meshCount; i += physicsMeshInterval) {
+        FillMesh(generator, loadedVertices.data(), vertexCount, loadedIndices.data(), indexCount, false);
+        cache.insert(StringHash(i), loadedVertices.data(), vertexCount, sizeof(TestVertex), 0, loadedIndices.data(), indexCount, 2);
+    }
+    
+    const auto withCache = GetResidentMemory();
+    const std::uint64_t cacheBytes = cache.getMemoryUsage().count();
+    
+    std::stringstream ss;
+    ss.precision(2);
+    ss << std::fixed;
+    ss << "\n\t\tHost data of " << meshCount << " meshes (" << (meshCount / physicsMeshInterval) << " used by physics):"
+       << "\n\t\t\tMirror buffers: " << ToMiB(mirrorBytes) << " MiB, collision cache: " << ToMiB(cacheBytes) << " MiB";
+    
+    if (cacheBytes * 10 > mirrorBytes) {
+        return TestResults(false, "The collision cache is too big" + ss.str());
+    }
+    
+    if (baseline && withMirrors && withCache) {
+        ss << "\n\t\t\tRSS: baseline " << ToMiB(*baseline) << " MiB, with mirror buffers " << ToMiB(*withMirrors)
+           << " MiB, with collision cache " << ToMiB(*withCache) << " MiB";
+        
+        if (*withCache >= *withMirrors) {
+            return TestResults(false, "Dropping the mirror buffers did not reduce the resident memory" + ss.str());
+        }
+    } else {
+        ss << "\n\t\t\tRSS can't be measured on this platform";
+    }
+    
+    return TestResults(true, ss.str());
+}
+
+TestResults CollisionMeshCacheTests::run() {
+    TestResults results = validateContents();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return compareResidentMemory();
+}
+
+void CollisionMeshCacheTests::cleanup() {}
+
+}
@@ -0,0 +1,250 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "FrustumCullingTests.hpp"
+#include "graphics/culling/FrustumCuller.hpp"
+#include "threading/ThreadPool.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace iyf::test {
+/// Makes a perspective-like frustum with the apex at the origin that looks down the +Z axis. The normals point
+/// outwards, just like the ones computed by Frustum::update().
+static CullingPlanes MakeTestPlanes() {
+    const float slope = 0.7f;
+    const float length = std::sqrt(1.0f + slope * slope);
+    
+    CullingPlanes planes;
+    
+    // Left, right, top, bottom
+    planes.x = {-1.0f / length,  1.0f / length,  0.0f,           0.0f,          0.0f,  0.0f};
+    planes.y = { 0.0f,           0.0f,           1.0f / length, -1.0f / length, 0.0f,  0.0f};
+    planes.z = {-slope / length, -slope / length, -slope / length, -slope / length, -1.0f, 1.0f};
+    
+    // Near at z = 1, far at z = 500
+    planes.w = { 0.0f,           0.0f,           0.0f,           0.0f,          1.0f, -500.0f};
+    
+    return planes;
+}
+
+static void FillRandomBoxes(AABBSet& boxes, std::size_t count, std::uint32_t seed) {
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> xyDistribution(-600.0f, 600.0f);
+    std::uniform_real_distribution<float> zDistribution(-100.0f, 600.0f);
+    std::uniform_real_distribution<float> extentDistribution(0.5f, 5.0f);
+    
+    boxes.clear();
+    boxes.reserve(count);
+    
+    for (std::size_t i = 0; i < count; ++i) {
+        const float x = xyDistribution(generator);
+        const float y = xyDistribution(generator);
+        const float z = zDistribution(generator);
+        const float e = extentDistribution(generator);
+        
+        boxes.add(x - e, y - e, z - e, x + e, y + e, z + e);
+    }
+}
+
+FrustumCullingTests::FrustumCullingTests(bool verbose) : TestBase(verbose) { }
+FrustumCullingTests::~FrustumCullingTests() {}
+
+void FrustumCullingTests::initialize() {}
+
+TestResults FrustumCullingTests::validateKnownBoxes() {
+    const CullingPlanes planes = MakeTestPlanes();
+    
+    AABBSet boxes;
+    const std::uint32_t inside = boxes.add(-1.0f, -1.0f, 99.0f, 1.0f, 1.0f, 101.0f);
+    // Behind the camera, beyond the far plane and to the left
+    boxes.add(-1.0f, -1.0f, -101.0f, 1.0f, 1.0f, -99.0f);
+    boxes.add(-1.0f, -1.0f, 600.0f, 1.0f, 1.0f, 602.0f);
+    boxes.add(-200.0f, -1.0f, 99.0f, -150.0f, 1.0f, 101.0f);
+    const std::uint32_t crossingRight = boxes.add(60.0f, -1.0f, 99.0f, 80.0f, 1.0f, 101.0f);
+    const std::uint32_t empty = boxes.add(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+    boxes.setEmpty(empty);
+    
+    const std::vector<std::uint32_t> expected = {inside, crossingRight};
+    
+    std::vector<std::uint32_t> scalarResult;
+    FrustumCuller::CullRangeScalar(planes, boxes, 0, boxes.size(), scalarResult);
+    
+    if (scalarResult != expected) {
+        return TestResults(false, fmt::format("The scalar path found {} visible boxes instead of {}", scalarResult.size(), expected.size()));
+    }
+    
+    std::vector<std::uint32_t> simdResult;
+    FrustumCuller::CullRangeSIMD(planes, boxes, 0, boxes.size(), simdResult);
+    
+    if (simdResult != expected) {
+        return TestResults(false, fmt::format("The SIMD path found {} visible boxes instead of {}", simdResult.size(), expected.size()));
+    }
+    
+    // The last (empty) box takes the place of the removed one and the box it leaves behind must not become visible
+    boxes.removeAndSwap(inside);
+    
+    const std::vector<std::uint32_t> expectedAfterRemoval = {crossingRight};
+    
+    simdResult.clear();
+    FrustumCuller::CullRangeSIMD(planes, boxes, 0, boxes.getPaddedSize(), simdResult);
+    
+    if (boxes.size() != 5 || simdResult != expectedAfterRemoval) {
+        return TestResults(false, fmt::format("After a removal, {} boxes were visible instead of {}", simdResult.size(), expectedAfterRemoval.size()));
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults FrustumCullingTests::validateAgainstScalar() {
+    const CullingPlanes planes = MakeTestPlanes();
+    
+    // Not a multiple of the vector width to make sure that the padding never leaks into the results
+    const std::size_t count = 100003;
+    AABBSet boxes;
+    FillRandomBoxes(boxes, count, 42);
+    
+    std::vector<std::uint32_t> reference;
+    FrustumCuller::CullRangeScalar(planes, boxes, 0, count, reference);
+    
+    if (reference.empty() || reference.size() == count) {
+        return TestResults(false, "The test data is useless. Either all or none of the boxes are visible");
+    }
+    
+    // Ranges that don't start on a vector boundary
+    const std::size_t begin = 3;
+    const std::size_t end = count - 5;
+    std::vector<std::uint32_t> expectedRange;
+    FrustumCuller::CullRangeScalar(planes, boxes, begin, end, expectedRange);
+    
+    std::vector<std::uint32_t> result;
+    FrustumCuller::CullRangeSIMD(planes, boxes, begin, end, result);
+    
+    if (result != expectedRange) {
+        return TestResults(false, fmt::format("SIMD culling of an unaligned range produced {} visible boxes instead of {}", result.size(), expectedRange.size()));
+    }
+    
+    FrustumCuller culler;
+    for (FrustumCuller::Mode mode : {FrustumCuller::Mode::Scalar, FrustumCuller::Mode::SIMD}) {
+        culler.setMode(mode);
+        
+        culler.cull(planes, boxes, result);
+        if (result != reference) {
+            return TestResults(false, fmt::format("Single threaded culling (mode {}) produced {} visible boxes instead of {}", static_cast<int>(mode), result.size(), reference.size()));
+        }
+        
+        for (std::size_t workerCount : {1, 2, 4}) {
+            iyft::ThreadPool pool(workerCount, iyft::SchedulingMode::WorkStealing);
+            
+            culler.cull(planes, boxes, result, &pool);
+            if (result != reference) {
+                return TestResults(false, fmt::format("Culling with {} workers (mode {}) produced {} visible boxes instead of {}", workerCount, static_cast<int>(mode), result.size(), reference.size()));
+            }
+            
+            // Culling runs on a worker of the frame pool. This must not deadlock, even if it's the only worker.
+            auto future = pool.addTaskWithResult([&]() {
+                std::vector<std::uint32_t> nestedResult;
+                culler.cull(planes, boxes, nestedResult, &pool);
+                return nestedResult == reference;
+            });
+            
+            if (!future.get()) {
+                return TestResults(false, fmt::format("Culling from a worker of a pool with {} workers (mode {}) produced wrong results", workerCount, static_cast<int>(mode)));
+            }
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+std::string FrustumCullingTests::benchmarkCulling() {
+    const int repetitions = 20;
+    const std::size_t counts[] = {100000, 250000, 500000, 1000000};
+    const CullingPlanes planes = MakeTestPlanes();
+    
+    const std::size_t hardwareThreads = std::thread::hardware_concurrency();
+    const std::size_t workerCount = (hardwareThreads > 1) ? (hardwareThreads - 1) : 1;
+    iyft::ThreadPool pool(workerCount, iyft::SchedulingMode::WorkStealing);
+    
+    std::string report = fmt::format("\n\t\tSIMD instruction set: {}; workers: {}", FrustumCuller::GetSIMDInstructionSetName(), workerCount);
+    report += "\n\t\t  Boxes | Scalar (ns/box) | SIMD (ns/box) | SIMD + pool (ns/box) | Visible";
+    
+    AABBSet boxes;
+    FrustumCuller culler;
+    std::vector<std::uint32_t> result;
+    
+    auto measure = [&](iyft::ThreadPool* usedPool) {
+        // Warm up. Also grows the result lists to their peak size.
+        culler.cull(planes, boxes, result, usedPool);
+        
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; ++i) {
+            culler.cull(planes, boxes, result, usedPool);
+        }
+        const auto end = std::chrono::steady_clock::now();
+        
+        const std::chrono::duration<double, std::nano> duration = end - start;
+        return duration.count() / (static_cast<double>(repetitions) * boxes.size());
+    };
+    
+    for (std::size_t count : counts) {
+        FillRandomBoxes(boxes, count, 1337);
+        
+        culler.setMode(FrustumCuller::Mode::Scalar);
+        const double scalar = measure(nullptr);
+        
+        culler.setMode(FrustumCuller::Mode::SIMD);
+        const double simd = measure(nullptr);
+        const double simdPool = measure(&pool);
+        
+        report += fmt::format("\n\t\t{:>7} | {:>15.3f} | {:>13.3f} | {:>20.3f} | {}", count, scalar, simd, simdPool, result.size());
+    }
+    
+    return report;
+}
+
+TestResults FrustumCullingTests::run() {
+    TestResults results = validateKnownBoxes();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateAgainstScalar();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return TestResults(true, benchmarkCulling());
+}
+
+void FrustumCullingTests::cleanup() {}
+
+}
@@ -0,0 +1,375 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "InstanceBatchingTests.hpp"
+#include "graphics/InstanceBatcher.hpp"
+#include "graphics/recording/RecordingCommandBuffer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace iyf::test {
+/// A stand-in for a visible mesh that has already been culled and sorted by its RenderDataKey.
+struct TestEntity {
+    RenderDataKey key;
+    std::uint32_t geometry;
+    glm::mat4 model;
+};
+
+/// Fake handles. The recording backend never dereferences them.
+template <typename T>
+static T MakeHandle(std::uintptr_t value) {
+    return T(reinterpret_cast<void*>(value));
+}
+
+static Buffer MakeBuffer(std::uintptr_t id) {
+    return Buffer(MakeHandle<BufferHnd>(id), BufferUsageFlags(), MemoryUsage::GPUOnly, Bytes(1024), nullptr);
+}
+
+static bool SameMatrix(const glm::mat4& a, const glm::mat4& b) {
+    for (int column = 0; column < 4; ++column) {
+        for (int row = 0; row < 4; ++row) {
+            if (a[column][row] != b[column][row]) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+class TestScene {
+public:
+    /// \param entityCount Number of visible meshes
+    /// \param repeatedGeometryCount Number of meshes (e.g., rocks or trees) that make up most of the scene
+    /// \param keyCount Number of distinct pipeline and material combinations
+    TestScene(std::size_t entityCount, std::uint32_t repeatedGeometryCount, std::uint16_t keyCount, std::uint32_t seed) {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> positionDistribution(-500.0f, 500.0f);
+        std::uniform_int_distribution<std::uint32_t> repeatedDistribution(0, repeatedGeometryCount - 1);
+        std::uniform_int_distribution<std::uint16_t> keyDistribution(0, keyCount - 1);
+        std::uniform_int_distribution<std::uint32_t> indexDistribution(36, 30000);
+        
+        // Every 16th entity uses a mesh nobody else uses
+        const std::size_t uniqueCount = entityCount / 16;
+        const std::uint32_t geometryCount = repeatedGeometryCount + static_cast<std::uint32_t>(uniqueCount);
+        
+        geometries.resize(geometryCount);
+        for (std::uint32_t i = 0; i < geometryCount; ++i) {
+            DrawGeometry& geometry = geometries[i];
+            geometry.vboID = static_cast<std::uint8_t>(i % 3);
+            geometry.iboID = static_cast<std::uint8_t>(i % 2);
+            geometry.indexCount = indexDistribution(generator);
+            geometry.firstIndex = i * 3;
+            geometry.vertexOffset = static_cast<std::int32_t>(i);
+        }
+        
+        entities.resize(entityCount);
+        std::uint32_t nextUnique = repeatedGeometryCount;
+        for (std::size_t i = 0; i < entityCount; ++i) {
+            TestEntity& entity = entities[i];
+            
+            const std::uint16_t keyID = keyDistribution(generator);
+            entity.key = RenderDataKey(PipelineID(1 + keyID / 4), VertexBufferID(0), IndexBufferID(0), UniformBufferID(0), MaterialID(keyID % 4));
+            entity.geometry = (i % 16 == 15 && nextUnique < geometryCount) ? nextUnique++ : repeatedDistribution(generator);
+            
+            entity.model = glm::mat4(1.0f);
+            entity.model[3][0] = positionDistribution(generator);
+            entity.model[3][1] = positionDistribution(generator);
+            entity.model[3][2] = positionDistribution(generator);
+        }
+        
+        // Draw lists are sorted by key. Within a key, different meshes stay interleaved.
+        std::stable_sort(entities.begin(), entities.end(), [](const TestEntity& a, const TestEntity& b) {
+            return a.key < b.key;
+        });
+    }
+    
+    void batch(InstanceBatcher& batcher) const {
+        batcher.clear();
+        
+        for (const TestEntity& entity : entities) {
+            batcher.add(entity.key, geometries[entity.geometry], entity.model);
+        }
+        
+        batcher.finish();
+    }
+    
+    /// Mirrors ClusteredRenderer::recordOpaqueBatches()
+    static void Record(CommandBuffer* buffer, const InstanceBatcher& batcher) {
+        const std::vector<InstancedDrawBatch>& batches = batcher.getBatches();
+        
+        std::uint8_t previousVBO = batches[0].geometry.vboID;
+        std::uint8_t previousIBO = batches[0].geometry.iboID;
+        
+        Pipeline pipeline;
+        pipeline.handle = MakeHandle<PipelineHnd>(0x1000);
+        pipeline.bindPoint = PipelineBindPoint::Graphics;
+        
+        buffer->bindVertexBuffer(0, MakeBuffer(0x10000 + previousVBO));
+        buffer->bindVertexBuffer(1, MakeBuffer(0x30000));
+        buffer->bindIndexBuffer(MakeBuffer(0x20000 + previousIBO), IndexType::UInt16);
+        buffer->bindPipeline(pipeline);
+        
+        Viewport vp;
+        vp.width = 1920.0f;
+        vp.height = 1080.0f;
+        buffer->setViewport(0, vp);
+        
+        Rect2D sc;
+        sc.offset = glm::ivec2(0, 0);
+        sc.extent = glm::uvec2(1920, 1080);
+        buffer->setScissor(0, sc);
+        
+        const glm::mat4 viewProjection(1.0f);
+        buffer->pushConstants(MakeHandle<PipelineLayoutHnd>(0x2000), ShaderStageFlagBits::Vertex, 0, sizeof(glm::mat4), &viewProjection);
+        
+        for (const InstancedDrawBatch& batch : batches) {
+            const DrawGeometry& geometry = batch.geometry;
+            
+            if (previousVBO != geometry.vboID) {
+                previousVBO = geometry.vboID;
+                buffer->bindVertexBuffer(0, MakeBuffer(0x10000 + previousVBO));
+            }
+            
+            if (previousIBO != geometry.iboID) {
+                previousIBO = geometry.iboID;
+                buffer->bindIndexBuffer(MakeBuffer(0x20000 + previousIBO), IndexType::UInt16);
+            }
+            
+            buffer->drawIndexed(geometry.indexCount, batch.instanceCount, geometry.firstIndex, geometry.vertexOffset, batch.firstInstance);
+        }
+    }
+    
+    const std::vector<TestEntity>& getEntities() const {
+        return entities;
+    }
+    
+    const std::vector<DrawGeometry>& getGeometries() const {
+        return geometries;
+    }
+private:
+    std::vector<DrawGeometry> geometries;
+    std::vector<TestEntity> entities;
+};
+
+InstanceBatchingTests::InstanceBatchingTests(bool verbose) : TestBase(verbose) { }
+InstanceBatchingTests::~InstanceBatchingTests() {}
+
+void InstanceBatchingTests::initialize() {}
+
+TestResults InstanceBatchingTests::validateBatching() {
+    const TestScene scene(20000, 8, 6, 42);
+    const std::vector<TestEntity>& entities = scene.getEntities();
+    
+    InstanceBatcher batcher;
+    scene.batch(batcher);
+    
+    // The expected batches, computed the slow way. Each one lists the models of its instances in draw list order.
+    std::map<std::pair<std::uint64_t, std::uint32_t>, std::vector<const glm::mat4*>> expected;
+    for (const TestEntity& entity : entities) {
+        expected[{entity.key.getKey(), entity.geometry}].push_back(&entity.model);
+    }
+    
+    const std::vector<InstancedDrawBatch>& batches = batcher.getBatches();
+    const std::vector<InstanceData>& instanceData = batcher.getInstanceData();
+    
+    if (batcher.getDrawCount() != entities.size() || instanceData.size() != entities.size()) {
+        return TestResults(false, fmt::format("Expected {} instances, got {}", entities.size(), instanceData.size()));
+    }
+    
+    if (batches.size() != expected.size()) {
+        return TestResults(false, fmt::format("Expected {} batches, got {}", expected.size(), batches.size()));
+    }
+    
+    std::size_t totalInstances = 0;
+    std::uint32_t nextFirstInstance = 0;
+    for (std::size_t i = 0; i < batches.size(); ++i) {
+        const InstancedDrawBatch& batch = batches[i];
+        
+        if (i > 0 && batch.key < batches[i - 1].key) {
+            return TestResults(false, fmt::format("Batch {} broke the RenderDataKey order of the draw list", i));
+        }
+        
+        if (batch.firstInstance != nextFirstInstance) {
+            return TestResults(false, fmt::format("The instance data of batch {} is not contiguous", i));
+        }
+        nextFirstInstance += batch.instanceCount;
+        
+        const auto geometry = std::find(scene.getGeometries().begin(), scene.getGeometries().end(), batch.geometry);
+        if (geometry == scene.getGeometries().end()) {
+            return TestResults(false, fmt::format("Batch {} uses a geometry that doesn't exist", i));
+        }
+        
+        const auto models = expected.find({batch.key.getKey(), static_cast<std::uint32_t>(geometry - scene.getGeometries().begin())});
+        if (models == expected.end() || models->second.size() != batch.instanceCount) {
+            return TestResults(false, fmt::format("Batch {} has a wrong number of instances", i));
+        }
+        
+        for (std::uint32_t j = 0; j < batch.instanceCount; ++j) {
+            if (!SameMatrix(instanceData[batch.firstInstance + j].model, *models->second[j])) {
+                return TestResults(false, fmt::format("Instance {} of batch {} has a wrong model matrix", j, i));
+            }
+        }
+        
+        totalInstances += batch.instanceCount;
+    }
+    
+    if (totalInstances != entities.size()) {
+        return TestResults(false, fmt::format("The batches contain {} instances instead of {}", totalInstances, entities.size()));
+    }
+    
+    // Batching the same draws again must reuse the batcher without leftovers
+    scene.batch(batcher);
+    if (batcher.getBatches().size() != expected.size() || batcher.getInstanceData().size() != entities.size()) {
+        return TestResults(false, "Reusing the batcher after clear() produced different results");
+    }
+    
+    // Draws with a different key must never be merged, even if they use the same geometry
+    InstanceBatcher keyBatcher;
+    const glm::mat4 identity(1.0f);
+    const DrawGeometry& geometry = scene.getGeometries()[0];
+    keyBatcher.add(RenderDataKey(PipelineID(1), VertexBufferID(0), IndexBufferID(0), UniformBufferID(0), MaterialID(0)), geometry, identity);
+    keyBatcher.add(RenderDataKey(PipelineID(1), VertexBufferID(0), IndexBufferID(0), UniformBufferID(0), MaterialID(1)), geometry, identity);
+    keyBatcher.add(RenderDataKey(PipelineID(1), VertexBufferID(0), IndexBufferID(0), UniformBufferID(0), MaterialID(1)), geometry, identity);
+    keyBatcher.finish();
+    
+    if (keyBatcher.getBatches().size() != 2 || keyBatcher.getBatches()[1].instanceCount != 2) {
+        return TestResults(false, "Draws with different keys were merged or draws with the same key weren't");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults InstanceBatchingTests::validateRecording() {
+    const TestScene scene(50000, 12, 4, 1337);
+    
+    InstanceBatcher batcher;
+    scene.batch(batcher);
+    
+    RecordingCommandPool commandPool("Instancing pool");
+    RecordingCommandBuffer* primary = static_cast<RecordingCommandBuffer*>(commandPool.allocateCommandBuffer("Primary", BufferLevel::Primary, false));
+    
+    RenderPassBeginInfo rpbi;
+    rpbi.renderPass = MakeHandle<RenderPassHnd>(0x3000);
+    rpbi.framebuffer = MakeHandle<FramebufferHnd>(0x4000);
+    rpbi.renderArea.offset = {0, 0};
+    rpbi.renderArea.extent = {1920, 1080};
+    
+    primary->begin();
+    primary->beginRenderPass(rpbi, SubpassContents::Inline);
+    TestScene::Record(primary, batcher);
+    primary->endRenderPass();
+    primary->end();
+    
+    if (primary->hasValidationErrors()) {
+        return TestResults(false, fmt::format("Recording the batches produced errors. First: {}", primary->getValidationErrors()[0]));
+    }
+    
+    const std::size_t drawCount = primary->getCommandCount(RecordedCommandType::DrawIndexed);
+    if (drawCount != batcher.getBatches().size()) {
+        return TestResults(false, fmt::format("Expected {} draw calls, got {}", batcher.getBatches().size(), drawCount));
+    }
+    
+    // 4 keys and 12 repeated meshes can't produce more than 48 instanced draws. Every unique mesh needs its own.
+    const std::size_t uniqueMeshCount = scene.getGeometries().size() - 12;
+    if (drawCount > 48 + uniqueMeshCount) {
+        return TestResults(false, fmt::format("{} draw calls is too many for {} repeated and {} unique meshes", drawCount, 12, uniqueMeshCount));
+    }
+    
+    if (primary->getCommandCount(RecordedCommandType::PushConstants) != 1) {
+        return TestResults(false, "The view projection matrix should be pushed once for all batches");
+    }
+    
+    // Each DrawIndexed payload is indexCount, instanceCount, firstIndex, vertexOffset, firstInstance
+    std::vector<std::uint8_t> payloads;
+    primary->collectCommandPayloads(RecordedCommandType::DrawIndexed, payloads);
+    
+    const std::size_t payloadSize = 5 * sizeof(std::uint32_t);
+    std::size_t instanceCount = 0;
+    for (std::size_t offset = 0; offset + payloadSize <= payloads.size(); offset += payloadSize) {
+        std::uint32_t drawInstances;
+        std::memcpy(&drawInstances, payloads.data() + offset + sizeof(std::uint32_t), sizeof(std::uint32_t));
+        instanceCount += drawInstances;
+    }
+    
+    if (instanceCount != scene.getEntities().size()) {
+        return TestResults(false, fmt::format("The draw calls render {} instances instead of {}", instanceCount, scene.getEntities().size()));
+    }
+    
+    return TestResults(true, "");
+}
+
+std::string InstanceBatchingTests::benchmarkBatching() {
+    const int repetitions = 20;
+    const std::size_t counts[] = {10000, 50000, 100000, 200000};
+    
+    InstanceBatcher batcher;
+    
+    std::string report = "\n\t\tEntities | Draws before | Draws after | Batching (ns/entity)";
+    for (std::size_t count : counts) {
+        const TestScene scene(count, 16, 8, 7);
+        
+        // Warm up. Also grows the internal buffers to their peak size.
+        scene.batch(batcher);
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; ++i) {
+            scene.batch(batcher);
+        }
+        const auto end = std::chrono::steady_clock::now();
+        const std::chrono::duration<double, std::nano> duration = end - start;
+        
+        report += fmt::format("\n\t\t{:>8} | {:>12} | {:>11} | {:>20.2f}", count, count, batcher.getBatches().size(),
+                              duration.count() / (static_cast<double>(repetitions) * count));
+    }
+    
+    return report;
+}
+
+TestResults InstanceBatchingTests::run() {
+    TestResults results = validateBatching();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateRecording();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return TestResults(true, benchmarkBatching());
+}
+
+void InstanceBatchingTests::cleanup() {}
+
+}
@@ -0,0 +1,403 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "LightClusteringTests.hpp"
+#include "graphics/clusteredRenderers/LightClusterer.hpp"
+#include "threading/ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace iyf::test {
+static const float TestFieldOfView = 1.0471976f; // 60 degrees
+static const float TestAspectRatio = 16.0f / 9.0f;
+static const float TestNear = 0.1f;
+static const float TestFar = 250.0f;
+
+static void FillRandomLights(ClusterLightSet& lights, std::size_t count, std::uint32_t seed) {
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> xyDistribution(-150.0f, 150.0f);
+    std::uniform_real_distribution<float> zDistribution(-20.0f, 300.0f);
+    std::uniform_real_distribution<float> radiusDistribution(0.5f, 10.0f);
+    
+    lights.clear();
+    lights.reserve(count);
+    
+    for (std::size_t i = 0; i < count; ++i) {
+        const float x = xyDistribution(generator);
+        const float y = xyDistribution(generator);
+        const float z = zDistribution(generator);
+        const float r = radiusDistribution(generator);
+        
+        lights.add(x, y, z, r);
+    }
+}
+
+/// Flattens the results into a single list: the point light count, the spot light count and the light IDs of each
+/// cluster, in cluster order.
+static std::vector<std::uint32_t> GetClusterContents(const LightClusterer& clusterer) {
+    std::vector<std::uint32_t> contents;
+    
+    for (std::uint32_t c = 0; c < clusterer.getClusterCount(); ++c) {
+        const std::uint32_t pointCount = clusterer.getPointLightCount(c);
+        const std::uint32_t spotCount = clusterer.getSpotLightCount(c);
+        const std::uint32_t* ids = clusterer.getLightIDs(c);
+        
+        contents.push_back(pointCount);
+        contents.push_back(spotCount);
+        contents.insert(contents.end(), ids, ids + pointCount + spotCount);
+    }
+    
+    return contents;
+}
+
+static bool RangesMatch(const ClusterRanges& a, const ClusterRanges& b, std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+        if (a.beginX[i] != b.beginX[i] || a.endX[i] != b.endX[i] ||
+            a.beginY[i] != b.beginY[i] || a.endY[i] != b.endY[i] ||
+            a.beginZ[i] != b.beginZ[i] || a.endZ[i] != b.endZ[i]) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+LightClusteringTests::LightClusteringTests(bool verbose) : TestBase(verbose) { }
+LightClusteringTests::~LightClusteringTests() {}
+
+void LightClusteringTests::initialize() {}
+
+TestResults LightClusteringTests::validateKnownLights() {
+    // 16x8x24 clusters. With this projection, the tiles are 3x3 units big 12 units away from the camera.
+    LightClusterer clusterer;
+    clusterer.setProjection(1.5707964f, 2.0f, 0.1f, 1000.0f);
+    
+    ClusterLightSet pointLights;
+    const std::uint32_t small = pointLights.add(0.5f, 0.5f, 12.0f, 0.01f);
+    // Behind the camera and beyond the end of the grid
+    pointLights.add(0.0f, 0.0f, -50.0f, 1.0f);
+    pointLights.add(0.0f, 0.0f, 2000.0f, 1.0f);
+    const std::uint32_t huge = pointLights.add(0.0f, 0.0f, 0.0f, 5000.0f);
+    
+    ClusterLightSet spotLights;
+    const std::uint32_t smallSpot = spotLights.add(0.5f, 0.5f, 12.0f, 0.01f);
+    
+    std::uint32_t expectedCluster;
+    if (!clusterer.findCluster(0.5f, 0.5f, 12.0f, expectedCluster)) {
+        return TestResults(false, "findCluster() didn't find a point that's in the middle of the grid");
+    }
+    
+    // Column 8 is just to the right of the center and row 3 is just above it. The depth of 12 is in slice 12.
+    if (expectedCluster != clusterer.getClusterID(8, 3, 12)) {
+        return TestResults(false, fmt::format("findCluster() returned cluster {} instead of {}", expectedCluster, clusterer.getClusterID(8, 3, 12)));
+    }
+    
+    std::uint32_t unused;
+    if (clusterer.findCluster(0.0f, 0.0f, -1.0f, unused) || clusterer.findCluster(0.0f, 0.0f, 1500.0f, unused) || clusterer.findCluster(100.0f, 0.0f, 12.0f, unused)) {
+        return TestResults(false, "findCluster() found a point that's outside of the grid");
+    }
+    
+    for (LightClusterer::Mode mode : {LightClusterer::Mode::Scalar, LightClusterer::Mode::SIMD}) {
+        clusterer.setMode(mode);
+        clusterer.cluster(pointLights, spotLights);
+        
+        if (clusterer.hasOverflowed()) {
+            return TestResults(false, fmt::format("Unexpected overflow (mode {})", static_cast<int>(mode)));
+        }
+        
+        for (std::uint32_t c = 0; c < clusterer.getClusterCount(); ++c) {
+            const std::uint32_t* ids = clusterer.getLightIDs(c);
+            
+            std::vector<std::uint32_t> expected = {huge};
+            if (c == expectedCluster) {
+                expected = {small, huge, smallSpot};
+            }
+            
+            const std::uint32_t pointCount = clusterer.getPointLightCount(c);
+            const std::uint32_t spotCount = clusterer.getSpotLightCount(c);
+            const std::vector<std::uint32_t> result(ids, ids + pointCount + spotCount);
+            
+            if (result != expected || spotCount != ((c == expectedCluster) ? 1 : 0)) {
+                return TestResults(false, fmt::format("Cluster {} contains {} point and {} spot lights (mode {})", c, pointCount, spotCount, static_cast<int>(mode)));
+            }
+        }
+        
+        if (clusterer.getLightIDCount() != clusterer.getClusterCount() + 2) {
+            return TestResults(false, fmt::format("{} light IDs were used instead of {} (mode {})", clusterer.getLightIDCount(), clusterer.getClusterCount() + 2, static_cast<int>(mode)));
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults LightClusteringTests::validateAgainstScalar() {
+    LightClusterer clusterer;
+    clusterer.setProjection(TestFieldOfView, TestAspectRatio, TestNear, TestFar);
+    
+    // Not multiples of the vector width to make sure that the padding never leaks into the results
+    ClusterLightSet pointLights;
+    FillRandomLights(pointLights, 10007, 42);
+    
+    ClusterLightSet spotLights;
+    FillRandomLights(spotLights, 2003, 43);
+    
+    // Ranges that don't start on a vector boundary
+    const std::size_t begin = 3;
+    const std::size_t end = pointLights.size() - 5;
+    
+    ClusterRanges scalarRanges;
+    scalarRanges.resize(pointLights.getPaddedSize());
+    clusterer.computeRangesScalar(pointLights, 0, pointLights.size(), scalarRanges);
+    
+    ClusterRanges simdRanges;
+    simdRanges.resize(pointLights.getPaddedSize());
+    clusterer.computeRangesSIMD(pointLights, 0, pointLights.size(), simdRanges);
+    
+    if (!RangesMatch(scalarRanges, simdRanges, 0, pointLights.size())) {
+        return TestResults(false, "The SIMD path computed different cluster ranges than the scalar path");
+    }
+    
+    clusterer.computeRangesSIMD(pointLights, begin, end, simdRanges);
+    if (!RangesMatch(scalarRanges, simdRanges, begin, end)) {
+        return TestResults(false, "The SIMD path computed different cluster ranges for an unaligned range");
+    }
+    
+    clusterer.setMode(LightClusterer::Mode::Scalar);
+    clusterer.cluster(pointLights, spotLights);
+    
+    const std::vector<std::uint32_t> reference = GetClusterContents(clusterer);
+    if (clusterer.getLightIDCount() == 0 || clusterer.hasOverflowed()) {
+        return TestResults(false, "The test data is useless. Either no clusters contain lights or the storage overflowed");
+    }
+    
+    for (LightClusterer::Mode mode : {LightClusterer::Mode::Scalar, LightClusterer::Mode::SIMD}) {
+        clusterer.setMode(mode);
+        
+        clusterer.cluster(pointLights, spotLights);
+        if (GetClusterContents(clusterer) != reference) {
+            return TestResults(false, fmt::format("Single threaded clustering (mode {}) produced different results", static_cast<int>(mode)));
+        }
+        
+        for (std::size_t workerCount : {1, 2, 4}) {
+            iyft::ThreadPool pool(workerCount, iyft::SchedulingMode::WorkStealing);
+            
+            clusterer.cluster(pointLights, spotLights, &pool);
+            if (GetClusterContents(clusterer) != reference) {
+                return TestResults(false, fmt::format("Clustering with {} workers (mode {}) produced different results", workerCount, static_cast<int>(mode)));
+            }
+            
+            // Clustering runs on a worker of the frame pool. This must not deadlock, even if it's the only worker.
+            auto future = pool.addTaskWithResult([&]() {
+                clusterer.cluster(pointLights, spotLights, &pool);
+                return GetClusterContents(clusterer) == reference;
+            });
+            
+            if (!future.get()) {
+                return TestResults(false, fmt::format("Clustering from a worker of a pool with {} workers (mode {}) produced different results", workerCount, static_cast<int>(mode)));
+            }
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults LightClusteringTests::validateConservativeness() {
+    LightClusterer clusterer;
+    clusterer.setProjection(TestFieldOfView, TestAspectRatio, TestNear, TestFar);
+    
+    ClusterLightSet pointLights;
+    FillRandomLights(pointLights, 2000, 7);
+    
+    ClusterLightSet spotLights;
+    clusterer.cluster(pointLights, spotLights);
+    
+    // Every point inside of a light must end up in a cluster that contains the light
+    std::mt19937 generator(8);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    
+    std::size_t checkedPoints = 0;
+    for (std::uint32_t i = 0; i < pointLights.size(); ++i) {
+        const float r = pointLights.getRadius()[i] * 0.999f;
+        
+        for (int sample = 0; sample < 64; ++sample) {
+            const float dx = distribution(generator);
+            const float dy = distribution(generator);
+            const float dz = distribution(generator);
+            
+            if (dx * dx + dy * dy + dz * dz > 1.0f) {
+                continue;
+            }
+            
+            std::uint32_t clusterID;
+            if (!clusterer.findCluster(pointLights.getX()[i] + dx * r, pointLights.getY()[i] + dy * r, pointLights.getZ()[i] + dz * r, clusterID)) {
+                continue;
+            }
+            
+            checkedPoints++;
+            
+            const std::uint32_t* ids = clusterer.getLightIDs(clusterID);
+            const std::uint32_t* idsEnd = ids + clusterer.getPointLightCount(clusterID);
+            if (!std::binary_search(ids, idsEnd, i)) {
+                return TestResults(false, fmt::format("Light {} is missing from cluster {} even though it reaches it", i, clusterID));
+            }
+        }
+    }
+    
+    if (checkedPoints == 0) {
+        return TestResults(false, "The test data is useless. None of the lights are in the grid");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults LightClusteringTests::validateOverflow() {
+    try {
+        LightClusterer invalid(256, 1, 1);
+        return TestResults(false, "A grid with more than 255 columns was accepted");
+    } catch (const std::invalid_argument&) {}
+    
+    // 4 clusters and room for 10 light IDs. Every light reaches every cluster.
+    LightClusterer clusterer(2, 2, 1, 10);
+    clusterer.setProjection(TestFieldOfView, TestAspectRatio, TestNear, TestFar);
+    
+    ClusterLightSet pointLights;
+    pointLights.add(0.0f, 0.0f, 0.0f, 1000.0f);
+    pointLights.add(0.0f, 0.0f, 0.0f, 1000.0f);
+    
+    ClusterLightSet spotLights;
+    spotLights.add(0.0f, 0.0f, 0.0f, 1000.0f);
+    
+    clusterer.cluster(pointLights, spotLights);
+    
+    if (!clusterer.hasOverflowed() || clusterer.getLightIDCount() != 10) {
+        return TestResults(false, fmt::format("The overflow wasn't handled. Overflowed: {}, light IDs: {}", clusterer.hasOverflowed(), clusterer.getLightIDCount()));
+    }
+    
+    // The first 3 clusters fit completely. The last one only has room for the first point light.
+    const std::uint32_t expectedPointCounts[] = {2, 2, 2, 1};
+    const std::uint32_t expectedSpotCounts[] = {1, 1, 1, 0};
+    for (std::uint32_t c = 0; c < 4; ++c) {
+        const std::uint32_t* ids = clusterer.getLightIDs(c);
+        
+        if (clusterer.getPointLightCount(c) != expectedPointCounts[c] || clusterer.getSpotLightCount(c) != expectedSpotCounts[c] || ids[0] != 0) {
+            return TestResults(false, fmt::format("Cluster {} was truncated incorrectly", c));
+        }
+    }
+    
+    pointLights.resize(1);
+    clusterer.cluster(pointLights, spotLights);
+    
+    if (clusterer.hasOverflowed() || clusterer.getLightIDCount() != 8) {
+        return TestResults(false, "The overflow flag wasn't reset");
+    }
+    
+    return TestResults(true, "");
+}
+
+std::string LightClusteringTests::benchmarkClustering() {
+    const int repetitions = 50;
+    const std::size_t counts[] = {1000, 2500, 5000, 10000};
+    
+    const std::size_t hardwareThreads = std::thread::hardware_concurrency();
+    const std::size_t workerCount = (hardwareThreads > 1) ? (hardwareThreads - 1) : 1;
+    iyft::ThreadPool pool(workerCount, iyft::SchedulingMode::WorkStealing);
+    
+    std::string report = fmt::format("\n\t\tSIMD instruction set: {}; workers: {}", LightClusterer::GetSIMDInstructionSetName(), workerCount);
+    report += "\n\t\t Lights | Scalar (us) | SIMD (us) | SIMD + pool (us) | Light IDs";
+    
+    ClusterLightSet pointLights;
+    ClusterLightSet spotLights;
+    
+    LightClusterer clusterer;
+    clusterer.setProjection(TestFieldOfView, TestAspectRatio, TestNear, TestFar);
+    
+    auto measure = [&](iyft::ThreadPool* usedPool) {
+        // Warm up
+        clusterer.cluster(pointLights, spotLights, usedPool);
+        
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; ++i) {
+            clusterer.cluster(pointLights, spotLights, usedPool);
+        }
+        const auto end = std::chrono::steady_clock::now();
+        
+        const std::chrono::duration<double, std::micro> duration = end - start;
+        return duration.count() / static_cast<double>(repetitions);
+    };
+    
+    for (std::size_t count : counts) {
+        // 3 point lights for each spot light
+        FillRandomLights(pointLights, count - count / 4, 1337);
+        FillRandomLights(spotLights, count / 4, 1338);
+        
+        clusterer.setMode(LightClusterer::Mode::Scalar);
+        const double scalar = measure(nullptr);
+        
+        clusterer.setMode(LightClusterer::Mode::SIMD);
+        const double simd = measure(nullptr);
+        const double simdPool = measure(&pool);
+        
+        report += fmt::format("\n\t\t{:>7} | {:>11.1f} | {:>9.1f} | {:>16.1f} | {}{}", count, scalar, simd, simdPool, clusterer.getLightIDCount(), clusterer.hasOverflowed() ? " (overflowed)" : "");
+    }
+    
+    return report;
+}
+
+TestResults LightClusteringTests::run() {
+    TestResults results = validateKnownLights();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateAgainstScalar();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateConservativeness();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateOverflow();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return TestResults(true, benchmarkClustering());
+}
+
+void LightClusteringTests::cleanup() {}
+
+}
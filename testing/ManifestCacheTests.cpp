@@ -0,0 +1,248 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "ManifestCacheTests.hpp"
+#include "assets/AssetConstants.hpp"
+#include "assets/ManifestCache.hpp"
+#include "assets/metadata/TextureMetadata.hpp"
+#include "io/DefaultFileSystem.hpp"
+#include "io/File.hpp"
+#include "io/serialization/FileSerializer.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+namespace iyf::test {
+/// Creates asset files and binary metadata, just like the importers would
+static void CreateAssets(const Path& directory, std::size_t count) {
+    std::filesystem::create_directories(directory.getNativeString());
+    
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::string sourcePath = fmt::format("raw/textures/texture{}.png", i);
+        const StringHash nameHash = HS(sourcePath);
+        
+        const Path assetPath = directory / std::to_string(nameHash.value());
+        std::ofstream(assetPath.getNativeString(), std::ios::binary | std::ios::trunc) << "texture";
+        
+        const TextureMetadata metadata(FileHash(i), Path(sourcePath), FileHash(i * 3), false, {"benchmark"}, 256, 256, 1, 1, 1, 9, 4,
+                                       TextureFilteringMethod::Trilinear, TextureTilingMethod::Repeat, TextureTilingMethod::Repeat, 8,
+                                       TextureCompressionFormat::BC7, true, 87424);
+        
+        FileSerializer serializer(DefaultFileSystem::Instance(), Path(assetPath.getGenericString() + con::MetadataExtension()), FileOpenMode::Write);
+        metadata.serialize(serializer);
+    }
+}
+
+/// Moves the modification time of a directory to the past, as if the assets were created during a previous run.
+static void AgeDirectory(const Path& directory, std::chrono::hours age) {
+    std::filesystem::last_write_time(directory.getNativeString(), std::filesystem::file_time_type::clock::now() - age);
+}
+
+static bool ManifestsEqual(const ManifestCache::Manifest& a, const ManifestCache::Manifest& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    
+    for (const auto& element : a) {
+        const auto other = b.find(element.first);
+        
+        if (other == b.end() || other->second.path != element.second.path || other->second.type != element.second.type ||
+            other->second.systemAsset != element.second.systemAsset || other->second.metadata != element.second.metadata ||
+            other->second.metadata.getBase().getMetadataSource() != element.second.metadata.getBase().getMetadataSource()) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+static ManifestCache::Fingerprints MakeFingerprints(std::uint64_t textureFingerprint) {
+    ManifestCache::Fingerprints fingerprints;
+    fingerprints.fill(ManifestCache::UncacheableFingerprint);
+    fingerprints[static_cast<std::size_t>(AssetType::Texture)] = textureFingerprint;
+    
+    return fingerprints;
+}
+
+ManifestCacheTests::ManifestCacheTests(bool verbose) : TestBase(verbose) { }
+ManifestCacheTests::~ManifestCacheTests() {}
+
+void ManifestCacheTests::initialize() {
+    directory = Path(std::filesystem::temp_directory_path()) / "IYFManifestCacheTests";
+    std::filesystem::remove_all(directory.getNativeString());
+    std::filesystem::create_directories(directory.getNativeString());
+}
+
+TestResults ManifestCacheTests::validateRoundTrip() {
+    const DefaultFileSystem& filesystem = DefaultFileSystem::Instance();
+    
+    const Path assetDirectory = directory / "roundTrip";
+    CreateAssets(assetDirectory, 1000);
+    
+    ManifestCache::Manifest scanned;
+    if (AssetManager::AddFilesToManifest(&filesystem, AssetType::Texture, assetDirectory, scanned) != 1000) {
+        return TestResults(false, "The scan didn't find all assets");
+    }
+    
+    const Path cachePath = directory / ("roundTrip" + con::ManifestCacheExtension());
+    if (!ManifestCache::Save(filesystem, cachePath, MakeFingerprints(42), scanned)) {
+        return TestResults(false, "Failed to save the manifest cache");
+    }
+    
+    ManifestCache::Manifest cached;
+    const ManifestCache::TypeMask loaded = ManifestCache::Load(filesystem, cachePath, MakeFingerprints(42), cached);
+    if (loaded.count() != 1 || !loaded.test(static_cast<std::size_t>(AssetType::Texture)) || !ManifestsEqual(scanned, cached)) {
+        return TestResults(false, "The cached manifest doesn't match the scanned one");
+    }
+    
+    ManifestCache::Manifest changed;
+    if (ManifestCache::Load(filesystem, cachePath, MakeFingerprints(43), changed).any() || !changed.empty()) {
+        return TestResults(false, "A section with a different fingerprint was loaded");
+    }
+    
+    ManifestCache::Manifest uncacheable;
+    if (ManifestCache::Load(filesystem, cachePath, MakeFingerprints(ManifestCache::UncacheableFingerprint), uncacheable).any()) {
+        return TestResults(false, "A section was loaded even though the directory couldn't be fingerprinted");
+    }
+    
+    // Flip a single bit in the middle of the records
+    {
+        std::fstream file(cachePath.getNativeString(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(0, std::ios::end);
+        const std::streamoff middle = file.tellg() / 2;
+        
+        char byte;
+        file.seekg(middle);
+        file.read(&byte, 1);
+        byte ^= 0x10;
+        file.seekp(middle);
+        file.write(&byte, 1);
+    }
+    
+    ManifestCache::Manifest corrupt;
+    if (ManifestCache::Load(filesystem, cachePath, MakeFingerprints(42), corrupt).any() || !corrupt.empty()) {
+        return TestResults(false, "A corrupt manifest cache was loaded");
+    }
+    
+    ManifestCache::Manifest missing;
+    if (ManifestCache::Load(filesystem, directory / "missing", MakeFingerprints(42), missing).any()) {
+        return TestResults(false, "A missing manifest cache was loaded");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults ManifestCacheTests::validateFingerprints() {
+    const Path assetDirectory = directory / "fingerprints";
+    CreateAssets(assetDirectory, 10);
+    
+    const std::vector<Path> sources = {assetDirectory};
+    if (ManifestCache::ComputeFingerprint(sources) != ManifestCache::UncacheableFingerprint) {
+        return TestResults(false, "A directory that was modified a moment ago was fingerprinted");
+    }
+    
+    if (ManifestCache::ComputeFingerprint({directory / "missing"}) != ManifestCache::UncacheableFingerprint) {
+        return TestResults(false, "A missing directory was fingerprinted");
+    }
+    
+    AgeDirectory(assetDirectory, std::chrono::hours(2));
+    
+    const std::uint64_t fingerprint = ManifestCache::ComputeFingerprint(sources);
+    if (fingerprint == ManifestCache::UncacheableFingerprint || fingerprint != ManifestCache::ComputeFingerprint(sources)) {
+        return TestResults(false, "The fingerprint of an unchanged directory isn't stable");
+    }
+    
+    std::filesystem::remove((assetDirectory / "0").getNativeString());
+    std::ofstream((assetDirectory / "0").getNativeString()) << "new";
+    AgeDirectory(assetDirectory, std::chrono::hours(1));
+    
+    if (ManifestCache::ComputeFingerprint(sources) == fingerprint) {
+        return TestResults(false, "Adding a file didn't change the fingerprint");
+    }
+    
+    return TestResults(true, "");
+}
+
+std::string ManifestCacheTests::benchmarkStartup() {
+    const DefaultFileSystem& filesystem = DefaultFileSystem::Instance();
+    
+    std::string report = "\n\t\tBuilding the manifest (ms):";
+    report += "\n\t\t  Assets | Full scan | Cache load | Cache size (KiB)";
+    
+    for (const std::size_t count : {10000, 100000}) {
+        const Path assetDirectory = directory / fmt::format("benchmark{}", count);
+        CreateAssets(assetDirectory, count);
+        AgeDirectory(assetDirectory, std::chrono::hours(1));
+        
+        const ManifestCache::Fingerprints fingerprints = MakeFingerprints(ManifestCache::ComputeFingerprint({assetDirectory}));
+        const Path cachePath = directory / fmt::format("benchmark{}{}", count, con::ManifestCacheExtension());
+        
+        const auto scanStart = std::chrono::steady_clock::now();
+        ManifestCache::Manifest scanned;
+        AssetManager::AddFilesToManifest(&filesystem, AssetType::Texture, assetDirectory, scanned);
+        const auto scanEnd = std::chrono::steady_clock::now();
+        
+        ManifestCache::Save(filesystem, cachePath, fingerprints, scanned);
+        
+        const auto loadStart = std::chrono::steady_clock::now();
+        ManifestCache::Manifest cached;
+        const ManifestCache::Fingerprints currentFingerprints = MakeFingerprints(ManifestCache::ComputeFingerprint({assetDirectory}));
+        ManifestCache::Load(filesystem, cachePath, currentFingerprints, cached);
+        const auto loadEnd = std::chrono::steady_clock::now();
+        
+        const std::chrono::duration<double, std::milli> scanTime = scanEnd - scanStart;
+        const std::chrono::duration<double, std::milli> loadTime = loadEnd - loadStart;
+        
+        const std::string status = (cached.size() == count) ? "" : " (cache load FAILED)";
+        report += fmt::format("\n\t\t{:>8} | {:>9.1f} | {:>10.1f} | {:>16}{}", count, scanTime.count(), loadTime.count(),
+                              std::filesystem::file_size(cachePath.getNativeString()) / 1024, status);
+    }
+    
+    return report;
+}
+
+TestResults ManifestCacheTests::run() {
+    TestResults results = validateRoundTrip();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateFingerprints();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return TestResults(true, benchmarkStartup());
+}
+
+void ManifestCacheTests::cleanup() {
+    std::filesystem::remove_all(directory.getNativeString());
+}
+
+}
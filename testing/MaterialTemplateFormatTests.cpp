@@ -0,0 +1,276 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "MaterialTemplateFormatTests.hpp"
+#include "graphics/materials/MaterialTemplateFormat.hpp"
+#include "graphics/materials/ShaderVariantLibrary.hpp"
+#include "io/DefaultFileSystem.hpp"
+#include "io/serialization/MemorySerializer.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+namespace iyf::test {
+struct TestVariant {
+    std::uint64_t macroHash;
+    VertexDataLayout layout;
+    ShaderStageFlagBits stage;
+    std::vector<std::uint8_t> bytecode;
+};
+
+/// Every combination of the macro hashes, two vertex data layouts and two stages, in a random order. The bytecode is
+/// random, but its size is a multiple of 4, just like SPIR-V.
+static std::vector<TestVariant> MakeVariants(std::mt19937& generator, std::size_t macroCombinationCount) {
+    std::uniform_int_distribution<std::uint64_t> hashes;
+    std::uniform_int_distribution<std::uint32_t> words(16, 512);
+    std::uniform_int_distribution<int> bytes(0, 255);
+    
+    std::vector<TestVariant> variants;
+    for (std::size_t i = 0; i < macroCombinationCount; ++i) {
+        const std::uint64_t macroHash = hashes(generator);
+        
+        for (VertexDataLayout layout : {VertexDataLayout::MeshVertex, VertexDataLayout::MeshVertexColored}) {
+            for (ShaderStageFlagBits stage : {ShaderStageFlagBits::Vertex, ShaderStageFlagBits::Fragment}) {
+                TestVariant variant;
+                variant.macroHash = macroHash;
+                variant.layout = layout;
+                variant.stage = stage;
+                variant.bytecode.resize(words(generator) * 4);
+                
+                for (std::uint8_t& b : variant.bytecode) {
+                    b = static_cast<std::uint8_t>(bytes(generator));
+                }
+                
+                variants.push_back(std::move(variant));
+            }
+        }
+    }
+    
+    std::shuffle(variants.begin(), variants.end(), generator);
+    return variants;
+}
+
+static std::vector<mtf::v2::VariantData> MakeVariantData(const std::vector<TestVariant>& variants) {
+    std::vector<mtf::v2::VariantData> data;
+    data.reserve(variants.size());
+    
+    for (const TestVariant& variant : variants) {
+        data.push_back({variant.macroHash, static_cast<std::uint8_t>(variant.layout), mtf::v2::ToVariantStage(variant.stage), variant.bytecode.data(),
+                        static_cast<std::uint32_t>(variant.bytecode.size())});
+    }
+    
+    return data;
+}
+
+static bool BytecodeMatches(const mtf::v2::MaterialTemplateFileView& view, const TestVariant& variant) {
+    const std::int64_t id = view.findVariant(variant.macroHash, static_cast<std::uint8_t>(variant.layout), mtf::v2::ToVariantStage(variant.stage));
+    if (id < 0) {
+        return false;
+    }
+    
+    const mtf::v2::VariantRecord record = view.getRecord(static_cast<std::size_t>(id));
+    return record.size == variant.bytecode.size() && std::memcmp(view.getBytecode(record), variant.bytecode.data(), record.size) == 0;
+}
+
+MaterialTemplateFormatTests::MaterialTemplateFormatTests(bool verbose) : TestBase(verbose) { }
+MaterialTemplateFormatTests::~MaterialTemplateFormatTests() {}
+
+void MaterialTemplateFormatTests::initialize() {
+    directory = Path(std::filesystem::temp_directory_path()) / "IYFMaterialTemplateFormatTests";
+    std::filesystem::remove_all(directory.getNativeString());
+    std::filesystem::create_directories(directory.getNativeString());
+}
+
+TestResults MaterialTemplateFormatTests::validateLookups() {
+    std::mt19937 generator(1);
+    const std::vector<TestVariant> variants = MakeVariants(generator, 64);
+    
+    MemorySerializer serializer(1024 * 1024);
+    mtf::v2::WriteMaterialTemplate(serializer, 42, MakeVariantData(variants));
+    
+    mtf::v2::MaterialTemplateFileView view;
+    if (!mtf::v2::ParseMaterialTemplate(serializer.data(), serializer.size(), view)) {
+        return TestResults(false, "Failed to parse a valid file");
+    }
+    
+    if (view.getVariantCount() != variants.size() || view.header.macroVersionHash != 42) {
+        return TestResults(false, "The header doesn't match the contents");
+    }
+    
+    for (const TestVariant& variant : variants) {
+        if (!BytecodeMatches(view, variant)) {
+            return TestResults(false, fmt::format("Failed to find variant {:016x}", variant.macroHash));
+        }
+    }
+    
+    for (std::size_t i = 0; i < view.getVariantCount(); ++i) {
+        if (view.getRecord(i).offset % mtf::v2::BlobAlignment != 0) {
+            return TestResults(false, "Found a misaligned variant");
+        }
+    }
+    
+    // Known hash, but a layout that was never compiled
+    if (view.findVariant(variants[0].macroHash, static_cast<std::uint8_t>(VertexDataLayout::MeshVertexWithBones), mtf::v2::ToVariantStage(variants[0].stage)) >= 0) {
+        return TestResults(false, "Found a variant that doesn't exist");
+    }
+    
+    std::vector<mtf::v2::VariantData> duplicated = MakeVariantData(variants);
+    duplicated.push_back(duplicated.front());
+    
+    try {
+        MemorySerializer duplicateSerializer(1024 * 1024);
+        mtf::v2::WriteMaterialTemplate(duplicateSerializer, 42, duplicated);
+        
+        return TestResults(false, "Wrote a file with duplicate variants");
+    } catch (const std::invalid_argument&) {}
+    
+    return TestResults(true, "");
+}
+
+TestResults MaterialTemplateFormatTests::validateCorruption() {
+    std::mt19937 generator(2);
+    const std::vector<TestVariant> variants = MakeVariants(generator, 4);
+    
+    MemorySerializer valid(1024 * 1024);
+    mtf::v2::WriteMaterialTemplate(valid, 42, MakeVariantData(variants));
+    
+    mtf::v2::MaterialTemplateFileView view;
+    if (mtf::v2::ParseMaterialTemplate(valid.data(), valid.size() - mtf::v2::BlobAlignment, view)) {
+        return TestResults(false, "Parsed a truncated file");
+    }
+    
+    // Version 1 files start with the same magic number
+    std::vector<char> corrupted(valid.data(), valid.data() + valid.size());
+    corrupted[offsetof(mtf::v2::Header, versionNumber)] = 1;
+    if (mtf::v2::ParseMaterialTemplate(corrupted.data(), corrupted.size(), view)) {
+        return TestResults(false, "Parsed a version 1 file");
+    }
+    
+    // Breaks the order of the table that the binary search depends on
+    corrupted.assign(valid.data(), valid.data() + valid.size());
+    std::swap_ranges(corrupted.begin() + sizeof(mtf::v2::Header), corrupted.begin() + sizeof(mtf::v2::Header) + sizeof(mtf::v2::VariantRecord),
+                     corrupted.begin() + sizeof(mtf::v2::Header) + sizeof(mtf::v2::VariantRecord));
+    if (mtf::v2::ParseMaterialTemplate(corrupted.data(), corrupted.size(), view)) {
+        return TestResults(false, "Parsed a file with an unsorted table");
+    }
+    
+    // Moves the bytecode of the last variant past the end of the file
+    corrupted.assign(valid.data(), valid.data() + valid.size());
+    const std::size_t lastOffset = sizeof(mtf::v2::Header) + (variants.size() - 1) * sizeof(mtf::v2::VariantRecord) + offsetof(mtf::v2::VariantRecord, offset);
+    corrupted[lastOffset + 1] += 1;
+    if (mtf::v2::ParseMaterialTemplate(corrupted.data(), corrupted.size(), view)) {
+        return TestResults(false, "Parsed a file with a variant that's out of bounds");
+    }
+    
+    corrupted.assign(valid.data(), valid.data() + valid.size());
+    corrupted[lastOffset] += 4;
+    if (mtf::v2::ParseMaterialTemplate(corrupted.data(), corrupted.size(), view)) {
+        return TestResults(false, "Parsed a file with a misaligned variant");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults MaterialTemplateFormatTests::validateSingleVariantLoad() {
+    std::mt19937 generator(3);
+    const std::vector<TestVariant> variants = MakeVariants(generator, 128);
+    const TestVariant& requested = variants[variants.size() / 3];
+    
+    MemorySerializer serializer(4 * 1024 * 1024);
+    mtf::v2::WriteMaterialTemplate(serializer, 42, MakeVariantData(variants));
+    
+    mtf::v2::MaterialTemplateFileView writtenView;
+    if (!mtf::v2::ParseMaterialTemplate(serializer.data(), serializer.size(), writtenView)) {
+        return TestResults(false, "Failed to parse a valid file");
+    }
+    
+    // Overwrites the bytecode of every other variant. If the library validated or read it, the data would be garbage.
+    std::vector<char> contents(serializer.data(), serializer.data() + serializer.size());
+    const std::int64_t requestedID = writtenView.findVariant(requested.macroHash, static_cast<std::uint8_t>(requested.layout), mtf::v2::ToVariantStage(requested.stage));
+    
+    std::size_t untouchedBytes = 0;
+    for (std::size_t i = 0; i < writtenView.getVariantCount(); ++i) {
+        const mtf::v2::VariantRecord record = writtenView.getRecord(i);
+        
+        if (static_cast<std::int64_t>(i) != requestedID) {
+            std::fill(contents.begin() + record.offset, contents.begin() + record.offset + record.size, '\xCD');
+            untouchedBytes += record.size;
+        }
+    }
+    
+    const Path path = directory / "singleVariant.iyfmt";
+    {
+        std::ofstream stream(path.getNativeString(), std::ios::binary | std::ios::trunc);
+        stream.write(contents.data(), contents.size());
+    }
+    
+    ShaderVariantLibrary library;
+    if (!library.open(DefaultFileSystem::Instance(), path)) {
+        return TestResults(false, "Failed to open the file");
+    }
+    
+    std::size_t size = 0;
+    const char* bytecode = library.findBytecode(requested.macroHash, requested.layout, requested.stage, size);
+    if (bytecode == nullptr || size != requested.bytecode.size() || std::memcmp(bytecode, requested.bytecode.data(), size) != 0) {
+        return TestResults(false, "The requested variant doesn't match");
+    }
+    
+    if (library.getShaderCount() != 0) {
+        return TestResults(false, "Shader modules were created before they were requested");
+    }
+    
+    return TestResults(true, fmt::format("\n\t\tLoaded 1 of {} variants. {} of {} bytes belong to variants that were never accessed.",
+                                         library.getVariantCount(), untouchedBytes, contents.size()));
+}
+
+TestResults MaterialTemplateFormatTests::run() {
+    TestResults results = validateLookups();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateCorruption();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return validateSingleVariantLoad();
+}
+
+void MaterialTemplateFormatTests::cleanup() {
+    std::filesystem::remove_all(directory.getNativeString());
+}
+
+}
@@ -0,0 +1,280 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "MemoryMappedFileTests.hpp"
+#include "io/DefaultFileSystem.hpp"
+#include "io/MemoryMappedFile.hpp"
+#include "io/exceptions/FileOpenException.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+namespace iyf::test {
+/// The constructor of MemoryMappedFile is only available to the file systems
+class TestMemoryMappedFile : public MemoryMappedFile {
+public:
+    TestMemoryMappedFile(const Path& path) : MemoryMappedFile(path) {}
+};
+
+static std::vector<char> MakeContents(std::size_t size, std::uint32_t seed) {
+    std::mt19937 generator(seed);
+    std::vector<char> contents(size);
+    
+    for (char& c : contents) {
+        c = static_cast<char>(generator());
+    }
+    
+    return contents;
+}
+
+static void WriteContents(const Path& path, const std::vector<char>& contents) {
+    std::ofstream stream(path.getNativeString(), std::ios::binary | std::ios::trunc);
+    stream.write(contents.data(), contents.size());
+}
+
+/// Touches every byte, just like a parser would
+static std::uint64_t Checksum(const char* data, std::size_t size) {
+    std::uint64_t sum = 0;
+    std::size_t i = 0;
+    
+    for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        sum += word;
+    }
+    
+    for (; i < size; ++i) {
+        sum += static_cast<unsigned char>(data[i]);
+    }
+    
+    return sum;
+}
+
+MemoryMappedFileTests::MemoryMappedFileTests(bool verbose) : TestBase(verbose) { }
+MemoryMappedFileTests::~MemoryMappedFileTests() {}
+
+void MemoryMappedFileTests::initialize() {
+    directory = Path(std::filesystem::temp_directory_path()) / "IYFMemoryMappedFileTests";
+    std::filesystem::create_directories(directory.getNativeString());
+}
+
+TestResults MemoryMappedFileTests::validateReads() {
+    const Path path = directory / "reads.bin";
+    const std::vector<char> contents = MakeContents(10000, 1);
+    WriteContents(path, contents);
+    
+    TestMemoryMappedFile file(path);
+    
+    char buffer[256];
+    if (file.readBytes(buffer, 100) != 100 || std::memcmp(buffer, contents.data(), 100) != 0 || file.tell() != 100) {
+        return TestResults(false, "The first read returned wrong data");
+    }
+    
+    if (file.seek(-10, File::SeekFrom::Current) != 90 || file.readBytes(buffer, 10) != 10 || std::memcmp(buffer, contents.data() + 90, 10) != 0) {
+        return TestResults(false, "Seeking relative to the current position failed");
+    }
+    
+    if (file.seek(-50, File::SeekFrom::End) != 9950 || file.isEOF()) {
+        return TestResults(false, "Seeking relative to the end failed");
+    }
+    
+    // Reads are clamped to the end of the file
+    if (file.readBytes(buffer, 256) != 50 || std::memcmp(buffer, contents.data() + 9950, 50) != 0 || !file.isEOF()) {
+        return TestResults(false, "A read past the end of the file wasn't clamped or didn't set the EOF flag");
+    }
+    
+    if (file.readBytes(buffer, 1) != 0) {
+        return TestResults(false, "A read at the end of the file returned data");
+    }
+    
+    if (file.seek(-1, File::SeekFrom::Start) != -1) {
+        return TestResults(false, "Seeking before the start of the file succeeded");
+    }
+    
+    if (file.seek(0, File::SeekFrom::Start) != 0 || file.isEOF()) {
+        return TestResults(false, "Seeking didn't reset the EOF flag");
+    }
+    
+    if (file.writeBytes(buffer, 1) != -1) {
+        return TestResults(false, "Writing to a memory mapped file succeeded");
+    }
+    
+    // The buffered backend must agree with the mapped one
+    auto bufferedFile = DefaultFileSystem::Instance().openFile(path, FileOpenMode::Read);
+    if (bufferedFile->seek(-50, File::SeekFrom::End) != 9950) {
+        return TestResults(false, "The buffered backend returned a wrong position after seeking");
+    }
+    
+    const auto wholeFile = bufferedFile->readWholeFile();
+    if (wholeFile.second != static_cast<std::int64_t>(contents.size()) || std::memcmp(wholeFile.first.get(), contents.data(), contents.size()) != 0) {
+        return TestResults(false, "The buffered backend read wrong data");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults MemoryMappedFileTests::validateViews() {
+    const Path path = directory / "views.bin";
+    const std::vector<char> contents = MakeContents(1024 * 1024, 2);
+    WriteContents(path, contents);
+    
+    FileView view;
+    {
+        TestMemoryMappedFile file(path);
+        view = file.mapWholeFile();
+        
+        file.close();
+    }
+    
+    // The view must keep the mapping alive after the file is gone
+    if (!view.isMemoryMapped() || view.size() != contents.size() || std::memcmp(view.data(), contents.data(), contents.size()) != 0) {
+        return TestResults(false, "A view didn't outlive the file that created it");
+    }
+    
+    const FileView fileSystemView = DefaultFileSystem::Instance().mapWholeFile(path);
+    if (fileSystemView.isMemoryMapped() != MemoryMappedFile::IsSupported() || fileSystemView.asStringView() != view.asStringView()) {
+        return TestResults(false, "The file system returned a wrong view");
+    }
+    
+    // The buffered fallback returns the same data
+    const FileView bufferedView = DefaultFileSystem::Instance().openFile(path, FileOpenMode::Read)->mapWholeFile();
+    if (bufferedView.isMemoryMapped() || bufferedView.asStringView() != view.asStringView()) {
+        return TestResults(false, "The buffered fallback returned a wrong view");
+    }
+    
+    // Small files aren't worth mapping
+    const Path smallPath = directory / "small.bin";
+    WriteContents(smallPath, MakeContents(MemoryMappedFile::MinimumMappedFileSize - 1, 4));
+    
+    const FileView smallView = DefaultFileSystem::Instance().mapWholeFile(smallPath);
+    if (smallView.isMemoryMapped() || smallView.size() != MemoryMappedFile::MinimumMappedFileSize - 1) {
+        return TestResults(false, "A file below the mapping threshold was mapped");
+    }
+    
+    const Path emptyPath = directory / "empty.bin";
+    WriteContents(emptyPath, {});
+    
+    const FileView emptyView = DefaultFileSystem::Instance().mapWholeFile(emptyPath);
+    if (!emptyView.empty()) {
+        return TestResults(false, "Mapping an empty file returned data");
+    }
+    
+    bool threw = false;
+    try {
+        TestMemoryMappedFile missing(directory / "missing.bin");
+    } catch (const FileOpenException&) {
+        threw = true;
+    }
+    
+    if (!threw) {
+        return TestResults(false, "Mapping a missing file didn't throw");
+    }
+    
+    return TestResults(true, "");
+}
+
+std::string MemoryMappedFileTests::benchmarkReads() {
+    const std::size_t sizes[] = {1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024, 16 * 1024 * 1024, 256 * 1024 * 1024};
+    
+    std::string report = "\n\t\tReading and checksumming whole files that are in the page cache (MiB/s):";
+    report += fmt::format("\n\t\tFiles below {} KiB are read into a buffer by DefaultFileSystem::mapWholeFile()", MemoryMappedFile::MinimumMappedFileSize / 1024);
+    report += "\n\t\t     Size | readWholeFile() | Always mapped | DefaultFileSystem::mapWholeFile()";
+    
+    for (const std::size_t size : sizes) {
+        const Path path = directory / "benchmark.bin";
+        WriteContents(path, MakeContents(size, 3));
+        
+        // Roughly 1 GiB of reads per size, but at least a few of them for the largest files
+        const std::size_t repetitions = std::max(std::size_t(4), (std::size_t(1) << 30) / size);
+        volatile std::uint64_t sink = 0;
+        
+        auto measure = [&](auto read) {
+            // Warm up the page cache
+            read();
+            
+            const auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < repetitions; ++i) {
+                read();
+            }
+            const auto end = std::chrono::steady_clock::now();
+            
+            const std::chrono::duration<double> duration = end - start;
+            return (static_cast<double>(size) * repetitions) / (1024.0 * 1024.0) / duration.count();
+        };
+        
+        const double buffered = measure([&]() {
+            auto file = DefaultFileSystem::Instance().openFile(path, FileOpenMode::Read);
+            const auto contents = file->readWholeFile();
+            sink = sink + Checksum(contents.first.get(), contents.second);
+        });
+        
+        const double alwaysMapped = measure([&]() {
+            TestMemoryMappedFile file(path);
+            const FileView view = file.mapWholeFile();
+            sink = sink + Checksum(view.data(), view.size());
+        });
+        
+        const double mapped = measure([&]() {
+            const FileView view = DefaultFileSystem::Instance().mapWholeFile(path);
+            sink = sink + Checksum(view.data(), view.size());
+        });
+        
+        const std::string sizeName = (size >= 1024 * 1024) ? fmt::format("{} MiB", size / (1024 * 1024)) : fmt::format("{} KiB", size / 1024);
+        report += fmt::format("\n\t\t{:>9} | {:>15.1f} | {:>13.1f} | {:>33.1f}", sizeName, buffered, alwaysMapped, mapped);
+    }
+    
+    return report;
+}
+
+TestResults MemoryMappedFileTests::run() {
+    if (!MemoryMappedFile::IsSupported()) {
+        return TestResults(true, "Memory mapped files are not supported on this platform");
+    }
+    
+    TestResults results = validateReads();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateViews();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return TestResults(true, benchmarkReads());
+}
+
+void MemoryMappedFileTests::cleanup() {
+    std::filesystem::remove_all(directory.getNativeString());
+}
+
+}
@@ -0,0 +1,435 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "MeshFormatTests.hpp"
+#include "assets/loaders/MeshLoader.hpp"
+#include "graphics/MeshFormats.hpp"
+#include "graphics/VertexDataTypes.hpp"
+#include "io/DefaultFileSystem.hpp"
+#include "io/serialization/MemorySerializer.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace iyf::test {
+/// Contents of a synthetic mesh without bones or vertex colors
+struct TestMesh {
+    std::vector<std::uint32_t> vertexCounts;
+    std::vector<std::uint32_t> indexCounts;
+    std::vector<MeshVertex> vertices;
+    std::vector<std::uint16_t> indices;
+};
+
+static TestMesh MakeMesh(std::mt19937& generator, std::size_t submeshCount, std::uint32_t verticesPerSubmesh) {
+    std::uniform_real_distribution<float> values(-10.0f, 10.0f);
+    std::uniform_int_distribution<std::uint32_t> ids(0, verticesPerSubmesh - 1);
+    
+    TestMesh mesh;
+    for (std::size_t s = 0; s < submeshCount; ++s) {
+        const std::uint32_t indexCount = verticesPerSubmesh * 3;
+        mesh.vertexCounts.push_back(verticesPerSubmesh);
+        mesh.indexCounts.push_back(indexCount);
+        
+        for (std::uint32_t v = 0; v < verticesPerSubmesh; ++v) {
+            MeshVertex vertex;
+            vertex.position = glm::vec3(values(generator), values(generator), values(generator));
+            vertex.normal = generator();
+            vertex.tangent = generator();
+            vertex.bitangent = generator();
+            vertex.uv = glm::vec2(values(generator), values(generator));
+            mesh.vertices.push_back(vertex);
+        }
+        
+        for (std::uint32_t i = 0; i < indexCount; ++i) {
+            mesh.indices.push_back(static_cast<std::uint16_t>(ids(generator)));
+        }
+    }
+    
+    return mesh;
+}
+
+static void WriteFile(const Path& path, const MemorySerializer& serializer) {
+    std::ofstream stream(path.getNativeString(), std::ios::binary | std::ios::trunc);
+    stream.write(serializer.data(), serializer.size());
+}
+
+/// Mirrors the layout MeshConverter used to write before version 2
+static void WriteV1(const Path& path, const TestMesh& mesh) {
+    MemorySerializer fw(1024 * 1024);
+    fw.writeBytes(mf::MagicNumber, sizeof(mf::MagicNumber));
+    fw.writeUInt16(1);
+    fw.writeUInt8(static_cast<std::uint8_t>(mesh.vertexCounts.size()));
+    fw.writeUInt32(static_cast<std::uint32_t>(mesh.vertices.size()));
+    fw.writeUInt32(static_cast<std::uint32_t>(mesh.indices.size()));
+    fw.writeUInt8(0);
+    fw.writeUInt8(0);
+    
+    std::size_t vertexOffset = 0;
+    std::size_t indexOffset = 0;
+    for (std::size_t s = 0; s < mesh.vertexCounts.size(); ++s) {
+        fw.writeUInt16(static_cast<std::uint16_t>(mesh.vertexCounts[s]));
+        for (std::size_t v = 0; v < mesh.vertexCounts[s]; ++v) {
+            const MeshVertex& vertex = mesh.vertices[vertexOffset + v];
+            fw.writeFloat(vertex.position.x);
+            fw.writeFloat(vertex.position.y);
+            fw.writeFloat(vertex.position.z);
+            fw.writeUInt32(vertex.normal);
+            fw.writeUInt32(vertex.tangent);
+            fw.writeUInt32(vertex.bitangent);
+            fw.writeFloat(vertex.uv.x);
+            fw.writeFloat(vertex.uv.y);
+        }
+        
+        fw.writeUInt32(mesh.indexCounts[s]);
+        for (std::size_t i = 0; i < mesh.indexCounts[s]; ++i) {
+            fw.writeUInt16(mesh.indices[indexOffset + i]);
+        }
+        
+        vertexOffset += mesh.vertexCounts[s];
+        indexOffset += mesh.indexCounts[s];
+    }
+    
+    for (float f : {-1.0f, -2.0f, -3.0f, 1.0f, 2.0f, 3.0f, 0.0f, 0.0f, 0.0f, 3.0f}) {
+        fw.writeFloat(f);
+    }
+    
+    fw.writeUInt32(0);
+    WriteFile(path, fw);
+}
+
+static void SerializeV2(MemorySerializer& fw, const TestMesh& mesh, const std::vector<mf::v2::LodRecord>& lods = {}) {
+    mf::v2::MeshFileContents contents;
+    contents.lods = lods;
+    contents.header.vertexDataLayout = static_cast<std::uint8_t>(VertexDataLayout::MeshVertex);
+    contents.header.vertexCount = static_cast<std::uint32_t>(mesh.vertices.size());
+    
+    const float aabb[] = {-1.0f, -2.0f, -3.0f, 1.0f, 2.0f, 3.0f};
+    std::memcpy(contents.header.aabbMinimum, aabb, sizeof(float) * 3);
+    std::memcpy(contents.header.aabbMaximum, aabb + 3, sizeof(float) * 3);
+    contents.header.boundingSphere[3] = 3.0f;
+    
+    std::uint32_t vertexOffset = 0;
+    std::uint32_t indexOffset = 0;
+    for (std::size_t s = 0; s < mesh.vertexCounts.size(); ++s) {
+        contents.submeshes.push_back({vertexOffset, mesh.vertexCounts[s], indexOffset, mesh.indexCounts[s]});
+        vertexOffset += mesh.vertexCounts[s];
+        indexOffset += mesh.indexCounts[s];
+    }
+    
+    contents.vertexData = mesh.vertices.data();
+    contents.vertexDataSize = mesh.vertices.size() * sizeof(MeshVertex);
+    contents.indexData = mesh.indices.data();
+    contents.indexDataSize = mesh.indices.size() * sizeof(std::uint16_t);
+    
+    mf::v2::WriteMesh(fw, contents);
+}
+
+static void WriteV2(const Path& path, const TestMesh& mesh) {
+    MemorySerializer fw(1024 * 1024);
+    SerializeV2(fw, mesh);
+    WriteFile(path, fw);
+}
+
+MeshFormatTests::MeshFormatTests(bool verbose) : TestBase(verbose) { }
+MeshFormatTests::~MeshFormatTests() {}
+
+void MeshFormatTests::initialize() {
+    directory = Path(std::filesystem::temp_directory_path()) / "IYFMeshFormatTests";
+    std::filesystem::create_directories(directory.getNativeString());
+}
+
+TestResults MeshFormatTests::validateEquivalence() {
+    std::mt19937 generator(1);
+    const TestMesh mesh = MakeMesh(generator, 3, 1000);
+    
+    const Path v1Path = directory / "equivalence_v1.iyfm";
+    const Path v2Path = directory / "equivalence_v2.iyfm";
+    WriteV1(v1Path, mesh);
+    WriteV2(v2Path, mesh);
+    
+    const MeshLoader loader(&DefaultFileSystem::Instance());
+    
+    const MeshLoader::MemoryRequirements v1Requirements = loader.getMeshMemoryRequirements(v1Path);
+    const MeshLoader::MemoryRequirements v2Requirements = loader.getMeshMemoryRequirements(v2Path);
+    if (v1Requirements.vertexSize != v2Requirements.vertexSize || v1Requirements.indexSize != v2Requirements.indexSize ||
+        v1Requirements.vertexDataLayout != v2Requirements.vertexDataLayout || v2Requirements.indices32Bit || v2Requirements.boneCount != 0) {
+        return TestResults(false, "Memory requirements of version 1 and version 2 files don't match");
+    }
+    
+    const std::size_t vertexSize = mesh.vertices.size() * sizeof(MeshVertex);
+    const std::size_t indexSize = mesh.indices.size() * sizeof(std::uint16_t);
+    if (v2Requirements.vertexSize.count() != vertexSize || v2Requirements.indexSize.count() != indexSize) {
+        return TestResults(false, "Unexpected memory requirements");
+    }
+    
+    MeshLoader::LoadedMeshData v1Data;
+    std::vector<char> v1Vertices(vertexSize);
+    std::vector<char> v1Indices(indexSize);
+    if (!loader.loadMesh(v1Path, v1Data, v1Vertices.data(), v1Indices.data())) {
+        return TestResults(false, "Failed to load a version 1 file");
+    }
+    
+    MeshLoader::LoadedMeshData v2Data;
+    std::vector<char> v2Vertices(vertexSize);
+    std::vector<char> v2Indices(indexSize);
+    if (!loader.loadMesh(v2Path, v2Data, v2Vertices.data(), v2Indices.data())) {
+        return TestResults(false, "Failed to load a version 2 file");
+    }
+    
+    MeshLoader::LoadedMeshData mappedV1Data;
+    MeshLoader::MappedMeshData mappedV1;
+    MeshLoader::LoadedMeshData mappedV2Data;
+    MeshLoader::MappedMeshData mappedV2;
+    if (!loader.mapMesh(v1Path, mappedV1Data, mappedV1) || !loader.mapMesh(v2Path, mappedV2Data, mappedV2)) {
+        return TestResults(false, "Failed to map a mesh file");
+    }
+    
+    if (std::memcmp(v1Vertices.data(), mesh.vertices.data(), vertexSize) != 0 || std::memcmp(v1Indices.data(), mesh.indices.data(), indexSize) != 0 ||
+        v1Vertices != v2Vertices || v1Indices != v2Indices) {
+        return TestResults(false, "Loaded vertex or index data doesn't match");
+    }
+    
+    if (std::memcmp(mappedV1.vertexData, mesh.vertices.data(), vertexSize) != 0 || std::memcmp(mappedV1.indexData, mesh.indices.data(), indexSize) != 0 ||
+        std::memcmp(mappedV2.vertexData, mesh.vertices.data(), vertexSize) != 0 || std::memcmp(mappedV2.indexData, mesh.indices.data(), indexSize) != 0) {
+        return TestResults(false, "Mapped vertex or index data doesn't match");
+    }
+    
+    if (reinterpret_cast<std::uintptr_t>(mappedV2.vertexData) % mf::v2::BlobAlignment != 0 ||
+        reinterpret_cast<std::uintptr_t>(mappedV2.indexData) % mf::v2::BlobAlignment != 0) {
+        return TestResults(false, "Version 2 data blobs are not aligned");
+    }
+    
+    for (const MeshLoader::LoadedMeshData* data : {&v2Data, &mappedV1Data, &mappedV2Data}) {
+        if (data->count != v1Data.count || data->animationCount != v1Data.animationCount ||
+            data->boundingSphere.radius != v1Data.boundingSphere.radius ||
+            data->aabb.vertices[static_cast<int>(AABB::Vertex::Maximum)] != v1Data.aabb.vertices[static_cast<int>(AABB::Vertex::Maximum)]) {
+            return TestResults(false, "Loaded mesh data doesn't match");
+        }
+        
+        for (std::size_t s = 0; s < v1Data.count; ++s) {
+            if (data->submeshes[s].numVertices != v1Data.submeshes[s].numVertices || data->submeshes[s].numIndices != v1Data.submeshes[s].numIndices) {
+                return TestResults(false, "Loaded submesh data doesn't match");
+            }
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults MeshFormatTests::validateCorruption() {
+    std::mt19937 generator(2);
+    const TestMesh mesh = MakeMesh(generator, 1, 100);
+    MemorySerializer valid(1024 * 1024);
+    SerializeV2(valid, mesh);
+    
+    mf::v2::MeshFileView view;
+    if (!mf::v2::ParseMesh(valid.data(), valid.size(), view)) {
+        return TestResults(false, "Failed to parse a valid version 2 file");
+    }
+    
+    if (mf::v2::ParseMesh(valid.data(), valid.size() - 1, view)) {
+        return TestResults(false, "Parsed a truncated version 2 file");
+    }
+    
+    // Breaks the offset of the vertex chunk
+    std::vector<char> corrupted(valid.data(), valid.data() + valid.size());
+    corrupted[sizeof(mf::v2::Header) + sizeof(mf::v2::ChunkEntry) + offsetof(mf::v2::ChunkEntry, offset)] += 1;
+    if (mf::v2::ParseMesh(corrupted.data(), corrupted.size(), view)) {
+        return TestResults(false, "Parsed a version 2 file with a misaligned chunk");
+    }
+    
+    // Declares more indices than the file has
+    corrupted.assign(valid.data(), valid.data() + valid.size());
+    corrupted[offsetof(mf::v2::Header, indexCount)] += 1;
+    if (mf::v2::ParseMesh(corrupted.data(), corrupted.size(), view)) {
+        return TestResults(false, "Parsed a version 2 file with a wrong index count");
+    }
+    
+    // Detail levels use the indices that follow the ones of the sub-meshes
+    TestMesh lodMesh = mesh;
+    lodMesh.indices.insert(lodMesh.indices.end(), mesh.indices.begin(), mesh.indices.begin() + 150);
+    
+    const mf::v2::LodRecord lod = {300, 150, 0.25f, 0, 1, {0, 0}};
+    MemorySerializer withLODs(1024 * 1024);
+    SerializeV2(withLODs, lodMesh, {lod});
+    
+    if (!mf::v2::ParseMesh(withLODs.data(), withLODs.size(), view) || view.lodCount != 1) {
+        return TestResults(false, "Failed to parse a version 2 file with detail levels");
+    }
+    
+    const mf::v2::LodRecord parsed = view.getLod(0);
+    if (parsed.indexOffset != lod.indexOffset || parsed.indexCount != lod.indexCount || parsed.error != lod.error || parsed.level != lod.level) {
+        return TestResults(false, "Detail level records don't match");
+    }
+    
+    // Levels must start from 1 and point into the index chunk
+    for (const mf::v2::LodRecord& invalid : {mf::v2::LodRecord{300, 150, 0.25f, 0, 2, {0, 0}}, mf::v2::LodRecord{400, 150, 0.25f, 0, 1, {0, 0}}}) {
+        MemorySerializer invalidLODs(1024 * 1024);
+        SerializeV2(invalidLODs, lodMesh, {invalid});
+        
+        if (mf::v2::ParseMesh(invalidLODs.data(), invalidLODs.size(), view)) {
+            return TestResults(false, "Parsed a version 2 file with an invalid detail level");
+        }
+    }
+    
+    const Path path = directory / "corrupted.iyfm";
+    std::ofstream(path.getNativeString(), std::ios::binary | std::ios::trunc).write(corrupted.data(), corrupted.size());
+    
+    const MeshLoader loader(&DefaultFileSystem::Instance());
+    MeshLoader::LoadedMeshData data;
+    MeshLoader::MappedMeshData mapped;
+    if (loader.mapMesh(path, data, mapped)) {
+        return TestResults(false, "Loaded a corrupted version 2 file");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults MeshFormatTests::benchmarkLoading() {
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    
+    // Many small props and a few big meshes
+    struct CorpusEntry {
+        std::size_t count;
+        std::size_t submeshes;
+        std::uint32_t verticesPerSubmesh;
+    };
+    const CorpusEntry corpus[] = {{512, 1, 300}, {128, 2, 4000}, {16, 4, 30000}};
+    
+    std::mt19937 generator(3);
+    std::vector<Path> v1Paths;
+    std::vector<Path> v2Paths;
+    std::size_t maxVertexSize = 0;
+    std::size_t maxIndexSize = 0;
+    std::size_t totalSize = 0;
+    
+    for (const CorpusEntry& entry : corpus) {
+        for (std::size_t i = 0; i < entry.count; ++i) {
+            const TestMesh mesh = MakeMesh(generator, entry.submeshes, entry.verticesPerSubmesh);
+            
+            v1Paths.push_back(directory / ("corpus_v1_" + std::to_string(v1Paths.size()) + ".iyfm"));
+            v2Paths.push_back(directory / ("corpus_v2_" + std::to_string(v2Paths.size()) + ".iyfm"));
+            WriteV1(v1Paths.back(), mesh);
+            WriteV2(v2Paths.back(), mesh);
+            
+            maxVertexSize = std::max(maxVertexSize, mesh.vertices.size() * sizeof(MeshVertex));
+            maxIndexSize = std::max(maxIndexSize, mesh.indices.size() * sizeof(std::uint16_t));
+            totalSize += mesh.vertices.size() * sizeof(MeshVertex) + mesh.indices.size() * sizeof(std::uint16_t);
+        }
+    }
+    
+    const MeshLoader loader(&DefaultFileSystem::Instance());
+    std::vector<char> vertices(maxVertexSize);
+    std::vector<char> indices(maxIndexSize);
+    MeshLoader::LoadedMeshData data;
+    
+    // Requirements are read from the file here to include the header reads in the measurements
+    auto loadAll = [&](const std::vector<Path>& paths) {
+        const auto start = std::chrono::steady_clock::now();
+        
+        for (const Path& path : paths) {
+            loader.getMeshMemoryRequirements(path);
+            if (!loader.loadMesh(path, data, vertices.data(), indices.data())) {
+                return Milliseconds(-1.0);
+            }
+        }
+        
+        return Milliseconds(std::chrono::steady_clock::now() - start);
+    };
+    
+    auto mapAll = [&](const std::vector<Path>& paths) {
+        const auto start = std::chrono::steady_clock::now();
+        
+        // Touching the data, just like an upload would
+        std::uint64_t checksum = 0;
+        for (const Path& path : paths) {
+            MeshLoader::MappedMeshData mapped;
+            if (!loader.mapMesh(path, data, mapped)) {
+                return Milliseconds(-1.0);
+            }
+            
+            for (std::size_t s = 0, offset = 0; s < data.count; ++s) {
+                offset += data.submeshes[s].numVertices * sizeof(MeshVertex);
+                checksum += static_cast<unsigned char>(mapped.vertexData[offset - 1]);
+            }
+        }
+        
+        if (checksum == 0) {
+            return Milliseconds(-1.0);
+        }
+        
+        return Milliseconds(std::chrono::steady_clock::now() - start);
+    };
+    
+    // The first pass warms up the page cache for both versions
+    loadAll(v1Paths);
+    loadAll(v2Paths);
+    
+    const Milliseconds v1Load = loadAll(v1Paths);
+    const Milliseconds v2Load = loadAll(v2Paths);
+    const Milliseconds v1Map = mapAll(v1Paths);
+    const Milliseconds v2Map = mapAll(v2Paths);
+    
+    if (v1Load.count() < 0.0 || v2Load.count() < 0.0 || v1Map.count() < 0.0 || v2Map.count() < 0.0) {
+        return TestResults(false, "Failed to load the corpus");
+    }
+    
+    std::stringstream ss;
+    ss.precision(2);
+    ss << std::fixed;
+    ss << "\n\t\tLoading " << v1Paths.size() << " meshes (" << (totalSize / (1024.0 * 1024.0)) << " MiB of vertex and index data, warm page cache):"
+       << "\n\t\t\tloadMesh(): v1 " << v1Load.count() << " ms, v2 " << v2Load.count() << " ms"
+       << "\n\t\t\tmapMesh():  v1 " << v1Map.count() << " ms, v2 " << v2Map.count() << " ms";
+    
+    return TestResults(true, ss.str());
+}
+
+TestResults MeshFormatTests::run() {
+    TestResults results = validateEquivalence();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateCorruption();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return benchmarkLoading();
+}
+
+void MeshFormatTests::cleanup() {
+    std::filesystem::remove_all(directory.getNativeString());
+}
+
+}
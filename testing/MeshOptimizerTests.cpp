@@ -0,0 +1,239 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "MeshOptimizerTests.hpp"
+#include "graphics/MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace iyf::test {
+/// Same size as MeshVertex. The ID identifies the vertex after the fetch optimization moves it
+struct TestVertex {
+    float position[3];
+    std::uint32_t id;
+    std::uint32_t padding[4];
+};
+static_assert(sizeof(TestVertex) == 32);
+
+struct TestMesh {
+    std::vector<TestVertex> vertices;
+    std::vector<std::uint32_t> indices;
+    
+    std::vector<char> getVertexBytes() const {
+        std::vector<char> bytes(vertices.size() * sizeof(TestVertex));
+        std::memcpy(bytes.data(), vertices.data(), bytes.size());
+        return bytes;
+    }
+};
+
+static void AddVertex(TestMesh& mesh, float x, float y, float z) {
+    TestVertex vertex = {};
+    vertex.position[0] = x;
+    vertex.position[1] = y;
+    vertex.position[2] = z;
+    vertex.id = static_cast<std::uint32_t>(mesh.vertices.size());
+    mesh.vertices.push_back(vertex);
+}
+
+/// A flat grid with triangles in scanline order, just like many exporters write them
+static TestMesh MakeGrid(std::uint32_t size) {
+    TestMesh mesh;
+    for (std::uint32_t y = 0; y <= size; ++y) {
+        for (std::uint32_t x = 0; x <= size; ++x) {
+            AddVertex(mesh, static_cast<float>(x), static_cast<float>(y), 0.0f);
+        }
+    }
+    
+    for (std::uint32_t y = 0; y < size; ++y) {
+        for (std::uint32_t x = 0; x < size; ++x) {
+            const std::uint32_t v = y * (size + 1) + x;
+            mesh.indices.insert(mesh.indices.end(), {v, v + 1, v + size + 1, v + 1, v + size + 2, v + size + 1});
+        }
+    }
+    
+    return mesh;
+}
+
+static TestMesh MakeSphere(std::uint32_t rings, std::uint32_t segments) {
+    const float pi = 3.14159265358979f;
+    
+    TestMesh mesh;
+    for (std::uint32_t r = 0; r <= rings; ++r) {
+        const float theta = pi * static_cast<float>(r) / static_cast<float>(rings);
+        for (std::uint32_t s = 0; s <= segments; ++s) {
+            const float phi = 2.0f * pi * static_cast<float>(s) / static_cast<float>(segments);
+            AddVertex(mesh, std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+        }
+    }
+    
+    for (std::uint32_t r = 0; r < rings; ++r) {
+        for (std::uint32_t s = 0; s < segments; ++s) {
+            const std::uint32_t v = r * (segments + 1) + s;
+            mesh.indices.insert(mesh.indices.end(), {v, v + segments + 1, v + 1, v + 1, v + segments + 1, v + segments + 2});
+        }
+    }
+    
+    return mesh;
+}
+
+/// Shuffles the triangles, just like a mesh with a bad index order would have them
+static void ShuffleTriangles(TestMesh& mesh, std::uint32_t seed) {
+    std::vector<std::array<std::uint32_t, 3>> triangles(mesh.indices.size() / 3);
+    std::memcpy(triangles.data(), mesh.indices.data(), mesh.indices.size() * sizeof(std::uint32_t));
+    
+    std::mt19937 generator(seed);
+    std::shuffle(triangles.begin(), triangles.end(), generator);
+    std::memcpy(mesh.indices.data(), triangles.data(), mesh.indices.size() * sizeof(std::uint32_t));
+}
+
+/// Rotates each triangle so that the smallest ID goes first. This keeps the winding, so it must survive all optimizations
+static std::vector<std::array<std::uint32_t, 3>> GetCanonicalTriangles(const std::vector<char>& vertexBytes, const std::vector<std::uint32_t>& indices) {
+    const TestVertex* vertices = reinterpret_cast<const TestVertex*>(vertexBytes.data());
+    
+    std::vector<std::array<std::uint32_t, 3>> triangles;
+    triangles.reserve(indices.size() / 3);
+    
+    for (std::size_t i = 0; i < indices.size(); i += 3) {
+        std::array<std::uint32_t, 3> t = {vertices[indices[i]].id, vertices[indices[i + 1]].id, vertices[indices[i + 2]].id};
+        std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+        triangles.push_back(t);
+    }
+    
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+MeshOptimizerTests::MeshOptimizerTests(bool verbose) : TestBase(verbose) { }
+MeshOptimizerTests::~MeshOptimizerTests() {}
+
+void MeshOptimizerTests::initialize() {}
+
+TestResults MeshOptimizerTests::run() {
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    
+    struct TestCase {
+        const char* name;
+        TestMesh mesh;
+    };
+    
+    std::vector<TestCase> testCases;
+    testCases.push_back({"Grid, scanline order", MakeGrid(180)});
+    testCases.push_back({"Grid, shuffled", MakeGrid(180)});
+    ShuffleTriangles(testCases.back().mesh, 1);
+    testCases.push_back({"Sphere, shuffled", MakeSphere(128, 254)});
+    ShuffleTriangles(testCases.back().mesh, 2);
+    
+    // An unreferenced vertex that the fetch optimization must drop
+    AddVertex(testCases.back().mesh, 5.0f, 5.0f, 5.0f);
+    
+    std::stringstream ss;
+    ss.precision(3);
+    ss << std::fixed;
+    ss << "\n\t\tFIFO size " << DefaultVertexCacheSize << "; all optimizations enabled";
+    
+    for (TestCase& testCase : testCases) {
+        std::vector<char> vertices = testCase.mesh.getVertexBytes();
+        std::vector<std::uint32_t> indices = testCase.mesh.indices;
+        const auto expectedTriangles = GetCanonicalTriangles(vertices, indices);
+        const std::size_t unusedVertices = testCase.mesh.vertices.size() - (testCase.mesh.indices.empty() ? 0 :
+            (*std::max_element(testCase.mesh.indices.begin(), testCase.mesh.indices.end()) + 1));
+        
+        MeshOptimizationSettings settings;
+        const auto start = std::chrono::steady_clock::now();
+        const MeshOptimizationReport report = OptimizeMesh(vertices, sizeof(TestVertex), indices, settings);
+        const Milliseconds duration = std::chrono::steady_clock::now() - start;
+        
+        if (GetCanonicalTriangles(vertices, indices) != expectedTriangles) {
+            return TestResults(false, std::string(testCase.name) + ": the optimizations changed the triangles");
+        }
+        
+        if (report.removedVertexCount != unusedVertices || vertices.size() / sizeof(TestVertex) != testCase.mesh.vertices.size() - unusedVertices) {
+            return TestResults(false, std::string(testCase.name) + ": unexpected number of removed vertices");
+        }
+        
+        // The fetch optimization must leave the vertices in the order of their first use
+        std::uint32_t nextVertex = 0;
+        for (std::uint32_t index : indices) {
+            if (index > nextVertex) {
+                return TestResults(false, std::string(testCase.name) + ": vertices are not in the order of their first use");
+            } else if (index == nextVertex) {
+                nextVertex++;
+            }
+        }
+        
+        if (report.after.acmr > report.before.acmr || report.after.acmr > 0.8f || report.after.atvr > 1.6f) {
+            std::stringstream es;
+            es << testCase.name << ": the vertex cache optimization is not good enough. ACMR " << report.after.acmr << ", ATVR " << report.after.atvr;
+            return TestResults(false, es.str());
+        }
+        
+        ss << "\n\t\t" << testCase.name << " (" << indices.size() / 3 << " triangles, " << duration.count() << " ms, "
+           << report.clusterCount << " clusters):"
+           << "\n\t\t\tACMR " << report.before.acmr << " -> " << report.after.acmr
+           << "; ATVR " << report.before.atvr << " -> " << report.after.atvr;
+    }
+    
+    // The overdraw pass trades some ACMR for clusters that can be sorted
+    TestMesh sphere = MakeSphere(128, 254);
+    ShuffleTriangles(sphere, 3);
+    std::vector<char> vertices = sphere.getVertexBytes();
+    
+    MeshOptimizationSettings settings;
+    settings.optimizeOverdraw = false;
+    std::vector<std::uint32_t> indices = sphere.indices;
+    const MeshOptimizationReport cacheOnly = OptimizeMesh(vertices, sizeof(TestVertex), indices, settings);
+    
+    for (float threshold : {1.0f, 1.05f, 1.2f}) {
+        settings.optimizeOverdraw = true;
+        settings.overdrawThreshold = threshold;
+        
+        vertices = sphere.getVertexBytes();
+        indices = sphere.indices;
+        const MeshOptimizationReport report = OptimizeMesh(vertices, sizeof(TestVertex), indices, settings);
+        
+        if (report.after.acmr > cacheOnly.after.acmr * threshold * 1.05f) {
+            return TestResults(false, "The overdraw optimization increased the ACMR more than the threshold allows");
+        }
+        
+        ss << "\n\t\tSphere, overdraw threshold " << threshold << ": " << report.clusterCount << " clusters, ACMR "
+           << cacheOnly.after.acmr << " -> " << report.after.acmr;
+    }
+    
+    return TestResults(true, ss.str());
+}
+
+void MeshOptimizerTests::cleanup() {}
+
+}
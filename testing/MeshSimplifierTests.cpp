@@ -0,0 +1,351 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "MeshSimplifierTests.hpp"
+#include "graphics/MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace iyf::test {
+/// Same size as MeshVertex, so the simplifier has to respect the stride
+struct TestVertex {
+    float position[3];
+    std::uint32_t padding[5];
+};
+static_assert(sizeof(TestVertex) == 32);
+
+struct TestMesh {
+    std::vector<TestVertex> vertices;
+    std::vector<std::uint32_t> indices;
+};
+
+static void AddVertex(TestMesh& mesh, float x, float y, float z) {
+    TestVertex vertex = {};
+    vertex.position[0] = x;
+    vertex.position[1] = y;
+    vertex.position[2] = z;
+    mesh.vertices.push_back(vertex);
+}
+
+/// A flat grid. Everything except for the border can be removed without any error
+static TestMesh MakeGrid(std::uint32_t size) {
+    TestMesh mesh;
+    for (std::uint32_t y = 0; y <= size; ++y) {
+        for (std::uint32_t x = 0; x <= size; ++x) {
+            AddVertex(mesh, static_cast<float>(x), static_cast<float>(y), 0.0f);
+        }
+    }
+    
+    for (std::uint32_t y = 0; y < size; ++y) {
+        for (std::uint32_t x = 0; x < size; ++x) {
+            const std::uint32_t v = y * (size + 1) + x;
+            mesh.indices.insert(mesh.indices.end(), {v, v + 1, v + size + 1, v + 1, v + size + 2, v + size + 1});
+        }
+    }
+    
+    return mesh;
+}
+
+/// A UV sphere with a radius of 1. Just like the ones exported by modelling software, it has a UV seam and duplicated
+/// pole vertices
+static TestMesh MakeSphere(std::uint32_t rings, std::uint32_t segments) {
+    const float pi = 3.14159265358979f;
+    
+    TestMesh mesh;
+    for (std::uint32_t r = 0; r <= rings; ++r) {
+        const float theta = pi * static_cast<float>(r) / static_cast<float>(rings);
+        for (std::uint32_t s = 0; s <= segments; ++s) {
+            const float phi = 2.0f * pi * static_cast<float>(s) / static_cast<float>(segments);
+            AddVertex(mesh, std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+        }
+    }
+    
+    for (std::uint32_t r = 0; r < rings; ++r) {
+        for (std::uint32_t s = 0; s < segments; ++s) {
+            const std::uint32_t v = r * (segments + 1) + s;
+            mesh.indices.insert(mesh.indices.end(), {v, v + segments + 1, v + 1, v + 1, v + segments + 1, v + segments + 2});
+        }
+    }
+    
+    return mesh;
+}
+
+struct Point {
+    float x;
+    float y;
+    float z;
+};
+
+static Point GetPosition(const TestMesh& mesh, std::uint32_t index) {
+    const float* p = mesh.vertices[index].position;
+    return {p[0], p[1], p[2]};
+}
+
+static Point Subtract(const Point& a, const Point& b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+static float Dot(const Point& a, const Point& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Point Cross(const Point& a, const Point& b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+/// From "Real-Time Collision Detection" by Christer Ericson
+static float PointTriangleDistance(const Point& p, const Point& a, const Point& b, const Point& c) {
+    const Point ab = Subtract(b, a);
+    const Point ac = Subtract(c, a);
+    const Point ap = Subtract(p, a);
+    
+    auto distanceTo = [&p](float x, float y, float z) {
+        const Point d = {p.x - x, p.y - y, p.z - z};
+        return std::sqrt(Dot(d, d));
+    };
+    
+    const float d1 = Dot(ab, ap);
+    const float d2 = Dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        return distanceTo(a.x, a.y, a.z);
+    }
+    
+    const Point bp = Subtract(p, b);
+    const float d3 = Dot(ab, bp);
+    const float d4 = Dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        return distanceTo(b.x, b.y, b.z);
+    }
+    
+    const float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        const float v = d1 / (d1 - d3);
+        return distanceTo(a.x + ab.x * v, a.y + ab.y * v, a.z + ab.z * v);
+    }
+    
+    const Point cp = Subtract(p, c);
+    const float d5 = Dot(ab, cp);
+    const float d6 = Dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        return distanceTo(c.x, c.y, c.z);
+    }
+    
+    const float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        const float w = d2 / (d2 - d6);
+        return distanceTo(a.x + ac.x * w, a.y + ac.y * w, a.z + ac.z * w);
+    }
+    
+    const float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+        const float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        return distanceTo(b.x + (c.x - b.x) * w, b.y + (c.y - b.y) * w, b.z + (c.z - b.z) * w);
+    }
+    
+    const float denominator = 1.0f / (va + vb + vc);
+    const float v = vb * denominator;
+    const float w = vc * denominator;
+    return distanceTo(a.x + ab.x * v + ac.x * w, a.y + ab.y * v + ac.y * w, a.z + ab.z * v + ac.z * w);
+}
+
+/// The largest distance from an original vertex to the simplified surface. A one sided Hausdorff distance
+/// approximation that's good enough for small meshes.
+static float MeasureDeviation(const TestMesh& mesh, const std::vector<std::uint32_t>& simplified) {
+    float deviation = 0.0f;
+    
+    for (std::uint32_t v = 0; v < mesh.vertices.size(); ++v) {
+        const Point p = GetPosition(mesh, v);
+        
+        float closest = std::numeric_limits<float>::max();
+        for (std::size_t i = 0; i < simplified.size(); i += 3) {
+            closest = std::min(closest, PointTriangleDistance(p, GetPosition(mesh, simplified[i]), GetPosition(mesh, simplified[i + 1]),
+                                                              GetPosition(mesh, simplified[i + 2])));
+        }
+        
+        deviation = std::max(deviation, closest);
+    }
+    
+    return deviation;
+}
+
+/// \return an empty string if the indices are a valid triangle list whose triangles face away from the origin
+static std::string ValidateTriangles(const TestMesh& mesh, const std::vector<std::uint32_t>& indices, bool checkOutwardFacing) {
+    if (indices.size() % 3 != 0) {
+        return "the index count is not divisible by 3";
+    }
+    
+    for (std::size_t i = 0; i < indices.size(); i += 3) {
+        const std::uint32_t a = indices[i];
+        const std::uint32_t b = indices[i + 1];
+        const std::uint32_t c = indices[i + 2];
+        
+        if (a >= mesh.vertices.size() || b >= mesh.vertices.size() || c >= mesh.vertices.size()) {
+            return "an index is out of range";
+        }
+        
+        if (a == b || b == c || a == c) {
+            return "a degenerate triangle was not removed";
+        }
+        
+        if (checkOutwardFacing) {
+            const Point pa = GetPosition(mesh, a);
+            const Point normal = Cross(Subtract(GetPosition(mesh, b), pa), Subtract(GetPosition(mesh, c), pa));
+            
+            // The sphere is wound clockwise when seen from the outside. The triangles that touch the poles have no
+            // area, so their normals are meaningless.
+            if (Dot(normal, normal) > 1e-12f && Dot(normal, pa) > 0.0f) {
+                return "a triangle got flipped";
+            }
+        }
+    }
+    
+    return "";
+}
+
+MeshSimplifierTests::MeshSimplifierTests(bool verbose) : TestBase(verbose) { }
+MeshSimplifierTests::~MeshSimplifierTests() {}
+
+void MeshSimplifierTests::initialize() {}
+
+TestResults MeshSimplifierTests::run() {
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    
+    std::stringstream ss;
+    ss.precision(4);
+    ss << std::fixed;
+    
+    LODGenerationSettings settings;
+    settings.lodCount = 3;
+    settings.reductionFactor = 0.5f;
+    settings.maxError = 0.05f;
+    
+    // A flat grid must be simplified down to the target without any error
+    const TestMesh grid = MakeGrid(32);
+    const std::vector<GeneratedLOD> gridLODs = GenerateLODs(grid.indices.data(), grid.indices.size(), grid.vertices.data(), sizeof(TestVertex),
+                                                            grid.vertices.size(), 16.0f * std::sqrt(2.0f), settings);
+    
+    if (gridLODs.size() != settings.lodCount) {
+        return TestResults(false, "Not all detail levels of the flat grid were generated");
+    }
+    
+    std::size_t previousTriangles = grid.indices.size() / 3;
+    ss << "\n\t\tGrid: " << previousTriangles << " triangles";
+    
+    for (const GeneratedLOD& lod : gridLODs) {
+        const std::string validation = ValidateTriangles(grid, lod.indices, false);
+        if (!validation.empty()) {
+            return TestResults(false, "Grid: " + validation);
+        }
+        
+        const std::size_t triangles = lod.indices.size() / 3;
+        if (triangles > previousTriangles / 2) {
+            return TestResults(false, "Grid: a detail level did not reach its triangle target");
+        }
+        
+        if (lod.error > 1e-5f || MeasureDeviation(grid, lod.indices) > 1e-4f) {
+            return TestResults(false, "Grid: simplifying a plane introduced an error");
+        }
+        
+        ss << " -> " << triangles;
+        previousTriangles = triangles;
+    }
+    
+    // A sphere can't be simplified without an error. The reported error must stay within the limit and grow with the
+    // level, while the real deviation from the original surface must stay close to the reported error.
+    const TestMesh sphere = MakeSphere(32, 64);
+    const std::vector<GeneratedLOD> sphereLODs = GenerateLODs(sphere.indices.data(), sphere.indices.size(), sphere.vertices.data(), sizeof(TestVertex),
+                                                              sphere.vertices.size(), 1.0f, settings);
+    
+    if (sphereLODs.size() < 2) {
+        return TestResults(false, "Sphere: too few detail levels were generated");
+    }
+    
+    previousTriangles = sphere.indices.size() / 3;
+    float previousError = 0.0f;
+    ss << "\n\t\tSphere: " << previousTriangles << " triangles";
+    
+    for (const GeneratedLOD& lod : sphereLODs) {
+        const std::string validation = ValidateTriangles(sphere, lod.indices, true);
+        if (!validation.empty()) {
+            return TestResults(false, "Sphere: " + validation);
+        }
+        
+        const std::size_t triangles = lod.indices.size() / 3;
+        if (triangles > previousTriangles * 3 / 4) {
+            return TestResults(false, "Sphere: a detail level removed too few triangles");
+        }
+        
+        if (lod.error > settings.maxError || lod.error < previousError) {
+            return TestResults(false, "Sphere: the errors are above the limit or not increasing");
+        }
+        
+        const float deviation = MeasureDeviation(sphere, lod.indices);
+        if (deviation > 3.0f * lod.error + 1e-3f) {
+            std::stringstream es;
+            es << "Sphere: the real deviation " << deviation << " is much larger than the reported error " << lod.error;
+            return TestResults(false, es.str());
+        }
+        
+        ss << "\n\t\t\t" << triangles << " triangles, error " << lod.error << ", deviation " << deviation;
+        previousTriangles = triangles;
+        previousError = lod.error;
+    }
+    
+    // No collapse may happen if it exceeds the target error
+    std::vector<std::uint32_t> simplified;
+    const float tightError = SimplifyMesh(simplified, sphere.indices.data(), sphere.indices.size(), sphere.vertices.data(), sizeof(TestVertex),
+                                          sphere.vertices.size(), 0, 0.001f);
+    if (tightError > 0.001f || MeasureDeviation(sphere, simplified) > 0.003f) {
+        return TestResults(false, "Sphere: the error limit was not respected");
+    }
+    
+    ss << "\n\t\tSphere, error limit 0.001: " << simplified.size() / 3 << " triangles, error " << tightError;
+    
+    const TestMesh largeSphere = MakeSphere(128, 254);
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<GeneratedLOD> largeLODs = GenerateLODs(largeSphere.indices.data(), largeSphere.indices.size(), largeSphere.vertices.data(),
+                                                             sizeof(TestVertex), largeSphere.vertices.size(), 1.0f, settings);
+    const Milliseconds duration = std::chrono::steady_clock::now() - start;
+    
+    ss << "\n\t\tLarge sphere: " << largeSphere.indices.size() / 3 << " triangles";
+    for (const GeneratedLOD& lod : largeLODs) {
+        ss << " -> " << lod.indices.size() / 3;
+    }
+    ss << " in " << duration.count() << " ms";
+    
+    return TestResults(true, ss.str());
+}
+
+void MeshSimplifierTests::cleanup() {}
+
+}
@@ -0,0 +1,509 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "ParallelCommandRecordingTests.hpp"
+#include "graphics/ParallelCommandRecorder.hpp"
+#include "graphics/recording/RecordingCommandBuffer.hpp"
+#include "threading/ThreadPool.hpp"
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace iyf::test {
+/// A stand-in for a visible mesh. Enough data to make recording a draw cost roughly what it costs in the renderer.
+struct TestDraw {
+    float model[16];
+    std::uint32_t indexCount;
+    std::uint32_t firstIndex;
+    std::int32_t vertexOffset;
+    std::uint8_t vboID;
+    std::uint8_t iboID;
+};
+
+/// Same size as the PushBuffer of the ClusteredRenderer
+struct TestPushBuffer {
+    float MVP[16];
+    float M[16];
+};
+
+static void MultiplyMatrices(const float* a, const float* b, float* result) {
+    for (int column = 0; column < 4; ++column) {
+        for (int row = 0; row < 4; ++row) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k) {
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            }
+            
+            result[column * 4 + row] = sum;
+        }
+    }
+}
+
+/// Fake handles. The recording backend never dereferences them.
+template <typename T>
+static T MakeHandle(std::uintptr_t value) {
+    return T(reinterpret_cast<void*>(value));
+}
+
+class TestScene {
+public:
+    TestScene(std::size_t drawCount, std::uint32_t seed) {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> positionDistribution(-500.0f, 500.0f);
+        std::uniform_int_distribution<std::uint32_t> indexDistribution(36, 30000);
+        
+        draws.resize(drawCount);
+        for (std::size_t i = 0; i < drawCount; ++i) {
+            TestDraw& draw = draws[i];
+            std::fill(std::begin(draw.model), std::end(draw.model), 0.0f);
+            draw.model[0] = draw.model[5] = draw.model[10] = draw.model[15] = 1.0f;
+            draw.model[12] = positionDistribution(generator);
+            draw.model[13] = positionDistribution(generator);
+            draw.model[14] = positionDistribution(generator);
+            
+            draw.indexCount = indexDistribution(generator);
+            draw.firstIndex = static_cast<std::uint32_t>(i * 3);
+            draw.vertexOffset = static_cast<std::int32_t>(i);
+            
+            // Draw lists are sorted, so buffer changes are rare
+            draw.vboID = static_cast<std::uint8_t>(i / 4096);
+            draw.iboID = static_cast<std::uint8_t>(i / 8192);
+        }
+        
+        std::fill(std::begin(viewProjection), std::end(viewProjection), 0.0f);
+        viewProjection[0] = viewProjection[5] = 1.0f;
+        viewProjection[10] = viewProjection[11] = -1.0f;
+        viewProjection[14] = 0.1f;
+        
+        pipeline.handle = MakeHandle<PipelineHnd>(0x1000);
+        pipeline.bindPoint = PipelineBindPoint::Graphics;
+        layout = MakeHandle<PipelineLayoutHnd>(0x2000);
+        
+        renderPass = MakeHandle<RenderPassHnd>(0x3000);
+        framebuffer = MakeHandle<FramebufferHnd>(0x4000);
+    }
+    
+    /// Mirrors ClusteredRenderer::recordOpaqueRange()
+    void record(CommandBuffer* buffer, std::size_t first, std::size_t last, bool setDynamicState = true) const {
+        std::uint8_t previousVBO = draws[first].vboID;
+        std::uint8_t previousIBO = draws[first].iboID;
+        
+        buffer->bindVertexBuffer(0, MakeBuffer(previousVBO, 0x10000));
+        buffer->bindIndexBuffer(MakeBuffer(previousIBO, 0x20000), IndexType::UInt16);
+        buffer->bindPipeline(pipeline);
+        
+        if (setDynamicState) {
+            Viewport vp;
+            vp.width = 1920.0f;
+            vp.height = 1080.0f;
+            buffer->setViewport(0, vp);
+            
+            Rect2D sc;
+            sc.offset = glm::ivec2(0, 0);
+            sc.extent = glm::uvec2(1920, 1080);
+            buffer->setScissor(0, sc);
+        }
+        
+        for (std::size_t i = first; i < last; ++i) {
+            const TestDraw& draw = draws[i];
+            
+            if (previousVBO != draw.vboID) {
+                previousVBO = draw.vboID;
+                buffer->bindVertexBuffer(0, MakeBuffer(previousVBO, 0x10000));
+            }
+            
+            if (previousIBO != draw.iboID) {
+                previousIBO = draw.iboID;
+                buffer->bindIndexBuffer(MakeBuffer(previousIBO, 0x20000), IndexType::UInt16);
+            }
+            
+            TestPushBuffer pushBuffer;
+            MultiplyMatrices(viewProjection, draw.model, pushBuffer.MVP);
+            std::copy(std::begin(draw.model), std::end(draw.model), std::begin(pushBuffer.M));
+            
+            buffer->pushConstants(layout, ShaderStageFlagBits::Vertex, 0, sizeof(TestPushBuffer), &pushBuffer);
+            buffer->drawIndexed(draw.indexCount, 1, draw.firstIndex, draw.vertexOffset, 0);
+        }
+    }
+    
+    RenderPassBeginInfo makeRenderPassBeginInfo() const {
+        RenderPassBeginInfo rpbi;
+        rpbi.renderPass = renderPass;
+        rpbi.framebuffer = framebuffer;
+        rpbi.renderArea.offset = {0, 0};
+        rpbi.renderArea.extent = {1920, 1080};
+        
+        return rpbi;
+    }
+    
+    CommandBufferInheritanceInfo makeInheritanceInfo() const {
+        CommandBufferInheritanceInfo inheritance;
+        inheritance.renderPass = renderPass;
+        inheritance.subpass = 0;
+        inheritance.framebuffer = framebuffer;
+        
+        return inheritance;
+    }
+    
+    std::size_t size() const {
+        return draws.size();
+    }
+private:
+    static Buffer MakeBuffer(std::uint8_t id, std::uintptr_t base) {
+        return Buffer(MakeHandle<BufferHnd>(base + id), BufferUsageFlags(), MemoryUsage::GPUOnly, Bytes(1024), nullptr);
+    }
+    
+    std::vector<TestDraw> draws;
+    float viewProjection[16];
+    Pipeline pipeline;
+    PipelineLayoutHnd layout;
+    RenderPassHnd renderPass;
+    FramebufferHnd framebuffer;
+};
+
+/// Owns the per-slot pools of a ParallelCommandRecorder
+class TestRecorder {
+public:
+    TestRecorder(std::size_t slotCount) {
+        std::vector<CommandPool*> rawPools;
+        for (std::size_t i = 0; i < slotCount; ++i) {
+            pools.push_back(std::make_unique<RecordingCommandPool>(fmt::format("Test pool {}", i)));
+            rawPools.push_back(pools.back().get());
+        }
+        
+        recorder.initialize(std::move(rawPools), 1, "Test");
+    }
+    
+    ~TestRecorder() {
+        recorder.dispose();
+    }
+    
+    ParallelCommandRecorder recorder;
+private:
+    std::vector<std::unique_ptr<RecordingCommandPool>> pools;
+};
+
+static void RecordSerially(const TestScene& scene, RecordingCommandBuffer* primary) {
+    primary->begin();
+    primary->beginRenderPass(scene.makeRenderPassBeginInfo(), SubpassContents::Inline);
+    scene.record(primary, 0, scene.size());
+    primary->endRenderPass();
+    primary->end();
+}
+
+static std::size_t RecordInParallel(const TestScene& scene, ParallelCommandRecorder& recorder, iyft::ThreadPool* pool, RecordingCommandBuffer* primary) {
+    primary->begin();
+    primary->beginRenderPass(scene.makeRenderPassBeginInfo(), SubpassContents::SecondaryCommandBuffers);
+    
+    const std::size_t bufferCount = recorder.record(scene.size(), 0, scene.makeInheritanceInfo(), pool, [&scene](CommandBuffer* buffer, std::size_t first, std::size_t last) {
+        scene.record(buffer, first, last);
+    });
+    recorder.executeRecorded(primary);
+    
+    primary->endRenderPass();
+    primary->end();
+    
+    return bufferCount;
+}
+
+static bool SameCommands(const RecordingCommandBuffer* a, const RecordingCommandBuffer* b, RecordedCommandType type) {
+    std::vector<std::uint8_t> payloadsA;
+    std::vector<std::uint8_t> payloadsB;
+    
+    a->collectCommandPayloads(type, payloadsA);
+    b->collectCommandPayloads(type, payloadsB);
+    
+    return !payloadsA.empty() && payloadsA == payloadsB;
+}
+
+ParallelCommandRecordingTests::ParallelCommandRecordingTests(bool verbose) : TestBase(verbose) { }
+ParallelCommandRecordingTests::~ParallelCommandRecordingTests() {}
+
+void ParallelCommandRecordingTests::initialize() {}
+
+TestResults ParallelCommandRecordingTests::validateBackend() {
+    const TestScene scene(64, 7);
+    RecordingCommandPool commandPool("Validation pool");
+    
+    RecordingCommandBuffer* primary = static_cast<RecordingCommandBuffer*>(commandPool.allocateCommandBuffer("Primary", BufferLevel::Primary, false));
+    RecordingCommandBuffer* secondary = static_cast<RecordingCommandBuffer*>(commandPool.allocateCommandBuffer("Secondary", BufferLevel::Secondary, false));
+    CommandBuffer* secondaryBuffer = secondary;
+    
+    RecordSerially(scene, primary);
+    if (primary->hasValidationErrors()) {
+        return TestResults(false, fmt::format("Valid serial recording produced errors. First: {}", primary->getValidationErrors()[0]));
+    }
+    
+    if (primary->getCommandCount(RecordedCommandType::DrawIndexed) != scene.size() || primary->getCommandCount(RecordedCommandType::PushConstants) != scene.size()) {
+        return TestResults(false, "The serially recorded buffer has a wrong number of draws or push constant updates");
+    }
+    
+    // Drawing outside of a render pass
+    primary->begin();
+    scene.record(primary, 0, 1);
+    primary->end();
+    if (!primary->hasValidationErrors()) {
+        return TestResults(false, "A draw outside of a render pass was not detected");
+    }
+    
+    // Inline commands in a subpass that expects secondary buffers
+    primary->begin();
+    primary->beginRenderPass(scene.makeRenderPassBeginInfo(), SubpassContents::SecondaryCommandBuffers);
+    scene.record(primary, 0, 1);
+    primary->endRenderPass();
+    primary->end();
+    if (!primary->hasValidationErrors()) {
+        return TestResults(false, "Inline draws in a subpass that expects secondary buffers were not detected");
+    }
+    
+    CommandBufferBeginInfo cbbi;
+    cbbi.flags = CommandBufferUsageFlagBits::RenderPassContinue;
+    cbbi.inheritanceInfo = scene.makeInheritanceInfo();
+    
+    // Secondary buffers don't inherit dynamic state. Forgetting to set it is the most likely bug of parallel
+    // recording and it must be reported by the primary buffer that executes the secondary.
+    secondary->begin(cbbi);
+    scene.record(secondary, 0, 1, false);
+    secondary->end();
+    
+    primary->begin();
+    primary->beginRenderPass(scene.makeRenderPassBeginInfo(), SubpassContents::SecondaryCommandBuffers);
+    primary->executeCommands(1, &secondaryBuffer);
+    primary->endRenderPass();
+    primary->end();
+    if (!primary->hasValidationErrors()) {
+        return TestResults(false, "A secondary buffer that didn't set its dynamic state was not detected");
+    }
+    
+    // Executing secondary buffers in an inline subpass
+    secondary->begin(cbbi);
+    scene.record(secondary, 0, 1);
+    secondary->end();
+    if (secondary->hasValidationErrors()) {
+        return TestResults(false, fmt::format("A valid secondary buffer produced errors. First: {}", secondary->getValidationErrors()[0]));
+    }
+    
+    primary->begin();
+    primary->beginRenderPass(scene.makeRenderPassBeginInfo(), SubpassContents::Inline);
+    primary->executeCommands(1, &secondaryBuffer);
+    primary->endRenderPass();
+    primary->end();
+    if (!primary->hasValidationErrors()) {
+        return TestResults(false, "Executing a secondary buffer in an inline subpass was not detected");
+    }
+    
+    // Recording two buffers of the same pool on different threads at the same time
+    primary->begin();
+    std::thread otherThread([secondary, &cbbi]() {
+        secondary->begin(cbbi);
+        secondary->end();
+    });
+    otherThread.join();
+    primary->end();
+    if (!secondary->hasValidationErrors()) {
+        return TestResults(false, "Concurrent use of a command pool was not detected");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults ParallelCommandRecordingTests::validateParallelRecording() {
+    // Not a multiple of the slot count to make sure that no draws are lost or duplicated at the chunk boundaries
+    const TestScene scene(50003, 42);
+    
+    RecordingCommandPool primaryPool("Primary pool");
+    RecordingCommandBuffer* serial = static_cast<RecordingCommandBuffer*>(primaryPool.allocateCommandBuffer("Serial", BufferLevel::Primary, false));
+    RecordingCommandBuffer* parallel = static_cast<RecordingCommandBuffer*>(primaryPool.allocateCommandBuffer("Parallel", BufferLevel::Primary, false));
+    
+    RecordSerially(scene, serial);
+    
+    for (std::size_t workerCount : {1, 2, 4}) {
+        iyft::ThreadPool pool(workerCount, iyft::SchedulingMode::WorkStealing);
+        TestRecorder testRecorder(workerCount + 1);
+        
+        if (!testRecorder.recorder.shouldRecordInParallel(scene.size(), &pool)) {
+            return TestResults(false, fmt::format("Parallel recording of {} draws with {} workers was rejected", scene.size(), workerCount));
+        }
+        
+        auto check = [&](const char* caller) -> TestResults {
+            if (parallel->hasValidationErrors()) {
+                return TestResults(false, fmt::format("Parallel recording with {} workers ({}) produced errors. First: {}", workerCount, caller, parallel->getValidationErrors()[0]));
+            }
+            
+            const std::uint64_t executedDraws = parallel->getExecutedCommandCount(RecordedCommandType::DrawIndexed);
+            if (executedDraws != scene.size()) {
+                return TestResults(false, fmt::format("Parallel recording with {} workers ({}) executes {} draws instead of {}", workerCount, caller, executedDraws, scene.size()));
+            }
+            
+            if (!SameCommands(serial, parallel, RecordedCommandType::DrawIndexed) || !SameCommands(serial, parallel, RecordedCommandType::PushConstants)) {
+                return TestResults(false, fmt::format("Parallel recording with {} workers ({}) changed the order or the contents of the draws", workerCount, caller));
+            }
+            
+            return TestResults(true, "");
+        };
+        
+        const std::size_t bufferCount = RecordInParallel(scene, testRecorder.recorder, &pool, parallel);
+        if (bufferCount != workerCount + 1) {
+            return TestResults(false, fmt::format("Expected {} secondary buffers, got {}", workerCount + 1, bufferCount));
+        }
+        
+        TestResults results = check("caller");
+        if (!results.isSuccessful()) {
+            return results;
+        }
+        
+        // The renderer may run on a worker of the frame pool. This must not deadlock, even if it's the only worker.
+        auto future = pool.addTaskWithResult([&]() {
+            return RecordInParallel(scene, testRecorder.recorder, &pool, parallel);
+        });
+        future.get();
+        
+        results = check("worker");
+        if (!results.isSuccessful()) {
+            return results;
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults ParallelCommandRecordingTests::validateExceptions() {
+    const TestScene scene(50003, 42);
+    const std::size_t workerCount = 4;
+    
+    iyft::ThreadPool pool(workerCount, iyft::SchedulingMode::WorkStealing);
+    TestRecorder testRecorder(workerCount + 1);
+    
+    RecordingCommandPool primaryPool("Primary pool");
+    RecordingCommandBuffer* primary = static_cast<RecordingCommandBuffer*>(primaryPool.allocateCommandBuffer("Primary", BufferLevel::Primary, false));
+    
+    // The first, a middle and the last chunk
+    for (std::size_t throwingChunk : {std::size_t(0), std::size_t(1), workerCount}) {
+        const std::size_t throwingFirst = (scene.size() * throwingChunk) / (workerCount + 1);
+        bool thrown = false;
+        
+        try {
+            testRecorder.recorder.record(scene.size(), 0, scene.makeInheritanceInfo(), &pool, [&](CommandBuffer* buffer, std::size_t first, std::size_t last) {
+                if (first == throwingFirst) {
+                    throw std::runtime_error("Test");
+                }
+                
+                scene.record(buffer, first, last);
+            });
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        
+        if (!thrown) {
+            return TestResults(false, fmt::format("An exception thrown while recording chunk {} didn't reach the caller", throwingChunk));
+        }
+        
+        if (!testRecorder.recorder.getRecordedBuffers().empty()) {
+            return TestResults(false, fmt::format("Buffers were kept after an exception was thrown while recording chunk {}", throwingChunk));
+        }
+        
+        // The buffers must remain usable
+        const std::size_t bufferCount = RecordInParallel(scene, testRecorder.recorder, &pool, primary);
+        if (bufferCount != workerCount + 1 || primary->hasValidationErrors() ||
+            primary->getExecutedCommandCount(RecordedCommandType::DrawIndexed) != scene.size()) {
+            return TestResults(false, fmt::format("Recording failed after an exception was thrown while recording chunk {}", throwingChunk));
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+std::string ParallelCommandRecordingTests::benchmarkRecording() {
+    const int repetitions = 20;
+    const std::size_t counts[] = {10000, 50000, 100000, 200000};
+    
+    const std::size_t hardwareThreads = std::thread::hardware_concurrency();
+    const std::size_t workerCount = (hardwareThreads > 1) ? (hardwareThreads - 1) : 1;
+    iyft::ThreadPool pool(workerCount, iyft::SchedulingMode::WorkStealing);
+    TestRecorder testRecorder(workerCount + 1);
+    
+    RecordingCommandPool primaryPool("Benchmark pool");
+    RecordingCommandBuffer* primary = static_cast<RecordingCommandBuffer*>(primaryPool.allocateCommandBuffer("Primary", BufferLevel::Primary, false));
+    
+    std::string report = fmt::format("\n\t\tWorkers: {}", workerCount);
+    report += "\n\t\t  Draws | Serial (ns/draw) | Parallel (ns/draw) | Secondary buffers | Speedup";
+    
+    for (std::size_t count : counts) {
+        const TestScene scene(count, 1337);
+        
+        // Warm up. Also grows the command streams to their peak size.
+        RecordSerially(scene, primary);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; ++i) {
+            RecordSerially(scene, primary);
+        }
+        auto end = std::chrono::steady_clock::now();
+        const std::chrono::duration<double, std::nano> serial = end - start;
+        
+        std::size_t bufferCount = RecordInParallel(scene, testRecorder.recorder, &pool, primary);
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; ++i) {
+            bufferCount = RecordInParallel(scene, testRecorder.recorder, &pool, primary);
+        }
+        end = std::chrono::steady_clock::now();
+        const std::chrono::duration<double, std::nano> parallel = end - start;
+        
+        const double divisor = static_cast<double>(repetitions) * count;
+        report += fmt::format("\n\t\t{:>7} | {:>16.2f} | {:>18.2f} | {:>17} | {:>6.2f}x", count, serial.count() / divisor, parallel.count() / divisor,
+                              bufferCount, serial.count() / parallel.count());
+    }
+    
+    return report;
+}
+
+TestResults ParallelCommandRecordingTests::run() {
+    TestResults results = validateBackend();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateParallelRecording();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateExceptions();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return TestResults(true, benchmarkRecording());
+}
+
+void ParallelCommandRecordingTests::cleanup() {}
+
+}
@@ -0,0 +1,409 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "PipelineCompilerTests.hpp"
+#include "graphics/AsyncPipelineCompiler.hpp"
+#include "graphics/PipelineCacheStore.hpp"
+#include "configuration/Configuration.hpp"
+#include "io/DefaultFileSystem.hpp"
+#include "threading/ThreadPool.hpp"
+
+#include "fmt/format.h"
+
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <unordered_set>
+
+namespace iyf::test {
+/// Only implements the functions that deal with pipelines. Pipeline creation can be blocked to simulate a slow driver.
+class MockGraphicsAPI : public GraphicsAPI {
+public:
+    MockGraphicsAPI(Configuration* config) : GraphicsAPI(nullptr, false, config), nextHandle(1), createCallCount(0), blocked(false) {}
+    
+    void setBlocked(bool block) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocked = block;
+        }
+        
+        blockedCondition.notify_all();
+    }
+    
+    void setFailing(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        failingNames.insert(name);
+    }
+    
+    std::size_t getCreateCallCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return createCallCount;
+    }
+    
+    std::size_t getLivePipelineCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return livePipelines.size();
+    }
+    
+    virtual Pipeline createPipeline(const PipelineCreateInfo&, const char* name) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        blockedCondition.wait(lock, [this]() { return !blocked; });
+        
+        createCallCount++;
+        
+        if (failingNames.find(name) != failingNames.end()) {
+            throw std::runtime_error("Simulated driver failure");
+        }
+        
+        Pipeline pipeline;
+        pipeline.handle = PipelineHnd(reinterpret_cast<void*>(nextHandle++));
+        pipeline.bindPoint = PipelineBindPoint::Graphics;
+        
+        livePipelines.insert(pipeline.handle.toNative<void*>());
+        return pipeline;
+    }
+    
+    virtual Pipeline createPipeline(const ComputePipelineCreateInfo&, const char*) override {
+        throw std::logic_error("Not used by the tests");
+    }
+    
+    virtual bool destroyPipeline(const Pipeline& pipeline) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        return livePipelines.erase(pipeline.handle.toNative<void*>()) == 1;
+    }
+    
+    virtual PipelineCacheIdentity getPipelineCacheIdentity() const override { return PipelineCacheIdentity(); }
+    virtual PipelineCacheHnd createPipelineCache(const void*, std::size_t, const char*) override { return PipelineCacheHnd(); }
+    virtual bool destroyPipelineCache(PipelineCacheHnd) override { return true; }
+    virtual std::vector<std::uint8_t> getPipelineCacheData(PipelineCacheHnd) override { return {}; }
+    virtual PipelineCacheHnd getMainPipelineCache() const override { return PipelineCacheHnd(); }
+    
+    // Everything below is unused
+    virtual bool initialize() override { return true; }
+    virtual void dispose() override {}
+    virtual bool backendSupportsMultipleFramesInFlight() const override { return false; }
+    virtual RenderPassHnd createRenderPass(const RenderPassCreateInfo&, const char*) override { return RenderPassHnd(); }
+    virtual bool destroyRenderPass(RenderPassHnd) override { return true; }
+    virtual bool startFrame() override { return true; }
+    virtual bool endFrame() override { return true; }
+    virtual CommandPool* createCommandPool(QueueType, std::uint32_t, const char*) override { return nullptr; }
+    virtual bool destroyCommandPool(CommandPool*) override { return true; }
+    virtual ShaderHnd createShader(ShaderStageFlags, const void*, std::size_t, const char*) override { return ShaderHnd(); }
+    virtual ShaderHnd createShaderFromSource(ShaderStageFlags, const std::string&, const char*) override { return ShaderHnd(); }
+    virtual bool destroyShader(ShaderHnd) override { return true; }
+    virtual PipelineLayoutHnd createPipelineLayout(const PipelineLayoutCreateInfo&, const char*) override { return PipelineLayoutHnd(); }
+    virtual bool destroyPipelineLayout(PipelineLayoutHnd) override { return true; }
+    virtual DescriptorSetLayoutHnd createDescriptorSetLayout(const DescriptorSetLayoutCreateInfo&, const char*) override { return DescriptorSetLayoutHnd(); }
+    virtual bool destroyDescriptorSetLayout(DescriptorSetLayoutHnd) override { return true; }
+    virtual std::vector<DescriptorSetHnd> allocateDescriptorSets(const DescriptorSetAllocateInfo&) override { return {}; }
+    virtual bool updateDescriptorSets(const std::vector<WriteDescriptorSet>&) override { return true; }
+    virtual bool freeDescriptorSets(DescriptorPoolHnd, std::vector<DescriptorSetHnd>&) override { return true; }
+    virtual DescriptorPoolHnd createDescriptorPool(const DescriptorPoolCreateInfo&, const char*) override { return DescriptorPoolHnd(); }
+    virtual bool destroyDescriptorPool(DescriptorPoolHnd) override { return true; }
+    virtual Framebuffer createFramebufferWithAttachments(const glm::uvec2&, RenderPassHnd, const std::vector<std::variant<Image, FramebufferAttachmentCreateInfo>>&, const char*) override { return Framebuffer(); }
+    virtual void destroyFramebufferWithAttachments(const Framebuffer&) override {}
+    virtual Image createImage(const ImageCreateInfo&, const char*) override { return Image(); }
+    virtual Image createUncompressedImage(const UncompressedImageCreateInfo&, const char*) override { return Image(); }
+    virtual bool destroyImage(const Image&) override { return true; }
+    virtual SamplerHnd createSampler(const SamplerCreateInfo&, const char*) override { return SamplerHnd(); }
+    virtual bool destroySampler(SamplerHnd) override { return true; }
+    virtual ImageViewHnd createImageView(const ImageViewCreateInfo&, const char*) override { return ImageViewHnd(); }
+    virtual bool destroyImageView(ImageViewHnd) override { return true; }
+    virtual Buffer createBuffer(const BufferCreateInfo&, const char*) override { return Buffer(); }
+    virtual bool destroyBuffer(const Buffer&) override { return true; }
+    virtual bool readHostVisibleBuffer(const Buffer&, const std::vector<BufferCopy>&, void*) override { return true; }
+    virtual SemaphoreHnd createSemaphore(const char*) override { return SemaphoreHnd(); }
+    virtual void destroySemaphore(SemaphoreHnd) override {}
+    virtual FenceHnd createFence(bool, const char*) override { return FenceHnd(); }
+    virtual void destroyFence(FenceHnd) override {}
+    virtual bool getFenceStatus(FenceHnd) override { return true; }
+    virtual bool waitForFences(const std::vector<FenceHnd>&, bool, std::uint64_t) override { return true; }
+    virtual bool waitForFence(FenceHnd, std::uint64_t) override { return true; }
+    virtual void resetFences(const std::vector<FenceHnd>&) override {}
+    virtual void resetFence(FenceHnd) override {}
+    virtual void submitQueue(const SubmitInfo&, FenceHnd) override {}
+    virtual void waitUntilDone() override {}
+    virtual void waitUntilFrameCompletes() override {}
+    virtual MultithreadingSupport doesBackendSupportMultithreading() override { return MultithreadingSupport::Full; }
+    virtual bool exposesMultipleCommandBuffers() const override { return true; }
+    virtual glm::uvec2 getSwapchainImageSize() const override { return glm::uvec2(0, 0); }
+    virtual std::uint32_t getCurrentSwapImage() const override { return 0; }
+    virtual std::uint32_t getSwapImageCount() const override { return 1; }
+    virtual const Image& getSwapImage(std::uint32_t) const override { return swapImage; }
+    virtual SemaphoreHnd getRenderCompleteSemaphore() override { return SemaphoreHnd(); }
+    virtual SemaphoreHnd getPresentationCompleteSemaphore() override { return SemaphoreHnd(); }
+    virtual Format getSurfaceFormat() override { return Format::Undefined; }
+    virtual Format getDepthStencilFormat() override { return Format::Undefined; }
+protected:
+    virtual BackendType getBackendType() override { return BackendType::Vulkan; }
+private:
+    mutable std::mutex mutex;
+    std::condition_variable blockedCondition;
+    std::unordered_set<void*> livePipelines;
+    std::unordered_set<std::string> failingNames;
+    std::uintptr_t nextHandle;
+    std::size_t createCallCount;
+    bool blocked;
+    Image swapImage;
+};
+
+/// A pipeline that the tests can recognize. It's never passed to the GraphicsAPI.
+static Pipeline MakeFallbackPipeline() {
+    Pipeline pipeline;
+    pipeline.handle = PipelineHnd(reinterpret_cast<void*>(std::uintptr_t(0xFA11BAC0)));
+    pipeline.bindPoint = PipelineBindPoint::Graphics;
+    
+    return pipeline;
+}
+
+static void* Native(const Pipeline& pipeline) {
+    return pipeline.handle.toNative<void*>();
+}
+
+PipelineCompilerTests::PipelineCompilerTests(bool verbose) : TestBase(verbose) { }
+PipelineCompilerTests::~PipelineCompilerTests() {}
+
+void PipelineCompilerTests::initialize() {
+    directory = Path(std::filesystem::temp_directory_path()) / "IYFPipelineCompilerTests";
+    std::filesystem::remove_all(directory.getNativeString());
+    std::filesystem::create_directories(directory.getNativeString());
+    
+    // The GraphicsAPI is Configurable and a Configuration needs at least one file
+    const Path configPath = directory / "mock.cfg";
+    std::ofstream(configPath.getNativeString(), std::ios::binary | std::ios::trunc);
+    
+    config = std::make_unique<Configuration>(std::vector<ConfigurationPath>{ConfigurationPath(configPath, &DefaultFileSystem::Instance())}, Configuration::Mode::ReadOnly);
+}
+
+TestResults PipelineCompilerTests::validateFallback() {
+    MockGraphicsAPI api(config.get());
+    iyft::ThreadPool pool(2);
+    AsyncPipelineCompiler compiler(&api, &pool);
+    
+    const Pipeline fallback = MakeFallbackPipeline();
+    
+    // Simulates a driver that is still compiling while the frames are being recorded
+    api.setBlocked(true);
+    
+    std::shared_future<Pipeline> first = compiler.requestPipeline(1, PipelineCreateInfo(), "First");
+    std::shared_future<Pipeline> second = compiler.requestPipeline(2, PipelineCreateInfo(), "Second");
+    std::shared_future<Pipeline> duplicate = compiler.requestPipeline(1, PipelineCreateInfo(), "Duplicate");
+    
+    if (compiler.getPendingCount() != 2) {
+        return TestResults(false, fmt::format("Expected 2 pending pipelines, got {}", compiler.getPendingCount()));
+    }
+    
+    for (std::uint64_t key = 1; key <= 3; ++key) {
+        if (Native(compiler.getPipeline(key, fallback)) != Native(fallback)) {
+            return TestResults(false, fmt::format("A pipeline with key {} was returned before it could be ready", key));
+        }
+    }
+    
+    if (compiler.getState(1) != AsyncPipelineCompiler::State::Pending) {
+        return TestResults(false, "A blocked pipeline wasn't reported as pending");
+    }
+    
+    api.setBlocked(false);
+    
+    const Pipeline firstPipeline = first.get();
+    const Pipeline secondPipeline = second.get();
+    
+    if (Native(duplicate.get()) != Native(firstPipeline)) {
+        return TestResults(false, "A duplicate request returned a different pipeline");
+    }
+    
+    if (api.getCreateCallCount() != 2) {
+        return TestResults(false, fmt::format("Expected 2 pipelines to be created, however, createPipeline() was called {} times", api.getCreateCallCount()));
+    }
+    
+    if (Native(compiler.getPipeline(1, fallback)) != Native(firstPipeline) || Native(compiler.getPipeline(2, fallback)) != Native(secondPipeline)) {
+        return TestResults(false, "The fallback pipeline was returned after the pipelines became ready");
+    }
+    
+    if (Native(compiler.getPipeline(3, fallback)) != Native(fallback) || compiler.getPendingCount() != 0 || !compiler.isReady(1)) {
+        return TestResults(false, "Incorrect state after the pipelines became ready");
+    }
+    
+    // Without a pool, the pipelines must be ready as soon as they're requested
+    AsyncPipelineCompiler immediateCompiler(&api, nullptr);
+    immediateCompiler.requestPipeline(1, PipelineCreateInfo(), "Immediate");
+    
+    if (!immediateCompiler.isReady(1) || Native(immediateCompiler.getPipeline(1, fallback)) == Native(fallback)) {
+        return TestResults(false, "A pipeline that was created without a pool wasn't ready");
+    }
+    
+    compiler.dispose();
+    immediateCompiler.dispose();
+    
+    if (api.getLivePipelineCount() != 0) {
+        return TestResults(false, fmt::format("{} pipeline(s) were not destroyed by dispose()", api.getLivePipelineCount()));
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults PipelineCompilerTests::validateFailures() {
+    MockGraphicsAPI api(config.get());
+    iyft::ThreadPool pool(2);
+    AsyncPipelineCompiler compiler(&api, &pool);
+    
+    const Pipeline fallback = MakeFallbackPipeline();
+    
+    api.setFailing("Broken");
+    
+    std::shared_future<Pipeline> broken = compiler.requestPipeline(1, PipelineCreateInfo(), "Broken");
+    std::shared_future<Pipeline> working = compiler.requestPipeline(2, PipelineCreateInfo(), "Working");
+    
+    compiler.waitForPending();
+    
+    bool threw = false;
+    try {
+        broken.get();
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    
+    if (!threw) {
+        return TestResults(false, "The future of a failed pipeline didn't receive the exception");
+    }
+    
+    if (compiler.getState(1) != AsyncPipelineCompiler::State::Failed || Native(compiler.getPipeline(1, fallback)) != Native(fallback)) {
+        return TestResults(false, "A failed pipeline didn't fall back");
+    }
+    
+    if (Native(compiler.getPipeline(2, fallback)) != Native(working.get())) {
+        return TestResults(false, "A failure affected a different pipeline");
+    }
+    
+    // Failed pipelines are not compiled again
+    compiler.requestPipeline(1, PipelineCreateInfo(), "Broken");
+    compiler.waitForPending();
+    
+    if (api.getCreateCallCount() != 2) {
+        return TestResults(false, "A failed pipeline was compiled again");
+    }
+    
+    compiler.dispose();
+    
+    if (api.getLivePipelineCount() != 0) {
+        return TestResults(false, fmt::format("{} pipeline(s) were not destroyed by dispose()", api.getLivePipelineCount()));
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults PipelineCompilerTests::validateCacheStore() {
+    PipelineCacheIdentity identity;
+    identity.vendorID = 0x10DE;
+    identity.deviceID = 0x1B80;
+    identity.driverVersion = 0x1A2B3C;
+    std::iota(identity.cacheUUID.begin(), identity.cacheUUID.end(), 1);
+    
+    PipelineCacheIdentity newDriver = identity;
+    newDriver.driverVersion++;
+    
+    PipelineCacheIdentity newCacheFormat = identity;
+    newCacheFormat.cacheUUID[15] = 0;
+    
+    if (PipelineCacheStore::MakeFileName(identity) == PipelineCacheStore::MakeFileName(newDriver) ||
+        PipelineCacheStore::MakeFileName(identity) == PipelineCacheStore::MakeFileName(newCacheFormat)) {
+        return TestResults(false, "Different identities must use different files");
+    }
+    
+    std::vector<std::uint8_t> data(4096);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<std::uint8_t>(i * 31);
+    }
+    
+    const FileSystem& filesystem = DefaultFileSystem::Instance();
+    const Path path = directory / PipelineCacheStore::MakeFileName(identity);
+    
+    if (!PipelineCacheStore::Save(filesystem, path, identity, data.data(), data.size())) {
+        return TestResults(false, "Failed to save the pipeline cache");
+    }
+    
+    std::vector<std::uint8_t> loaded;
+    if (!PipelineCacheStore::Load(filesystem, path, identity, loaded) || loaded != data) {
+        return TestResults(false, "The loaded pipeline cache data differs from the saved data");
+    }
+    
+    if (PipelineCacheStore::Load(filesystem, path, newDriver, loaded) || PipelineCacheStore::Load(filesystem, path, newCacheFormat, loaded)) {
+        return TestResults(false, "Pipeline cache data of a different driver was loaded");
+    }
+    
+    if (!loaded.empty()) {
+        return TestResults(false, "Rejected pipeline cache data wasn't cleared");
+    }
+    
+    const auto fileSize = std::filesystem::file_size(path.getNativeString());
+    
+    {
+        std::fstream file(path.getNativeString(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(static_cast<std::streamoff>(fileSize / 2));
+        file.put(static_cast<char>(0xCD));
+    }
+    
+    if (PipelineCacheStore::Load(filesystem, path, identity, loaded)) {
+        return TestResults(false, "Corrupt pipeline cache data was loaded");
+    }
+    
+    std::filesystem::resize_file(path.getNativeString(), 16);
+    
+    if (PipelineCacheStore::Load(filesystem, path, identity, loaded)) {
+        return TestResults(false, "Truncated pipeline cache data was loaded");
+    }
+    
+    if (PipelineCacheStore::Load(filesystem, directory / "missing.bin", identity, loaded)) {
+        return TestResults(false, "A missing pipeline cache was loaded");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults PipelineCompilerTests::run() {
+    TestResults results = validateFallback();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateFailures();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return validateCacheStore();
+}
+
+void PipelineCompilerTests::cleanup() {
+    config = nullptr;
+    std::filesystem::remove_all(directory.getNativeString());
+}
+
+}
@@ -0,0 +1,69 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_PIPELINE_COMPILER_TESTS_HPP
+#define IYF_PIPELINE_COMPILER_TESTS_HPP
+
+#include "TestBase.hpp"
+#include "io/Path.hpp"
+
+#include <memory>
+
+namespace iyf {
+class Configuration;
+}
+
+namespace iyf::test {
+
+/// Uses a mock GraphicsAPI to check that the AsyncPipelineCompiler returns the fallback pipeline until the requested
+/// one is ready, compiles each key once and destroys everything it created. Also checks that the PipelineCacheStore
+/// rejects data of different devices or drivers and corrupt files.
+class PipelineCompilerTests : public TestBase {
+public:
+    PipelineCompilerTests(bool verbose);
+    virtual ~PipelineCompilerTests();
+    
+    virtual std::string getName() const final override {
+        return "Pipeline compiler and cache tests";
+    }
+    
+    virtual void initialize() final override;
+    virtual TestResults run() final override;
+    virtual void cleanup() final override;
+private:
+    TestResults validateFallback();
+    TestResults validateFailures();
+    TestResults validateCacheStore();
+    
+    Path directory;
+    std::unique_ptr<Configuration> config;
+};
+
+}
+
+#endif // IYF_PIPELINE_COMPILER_TESTS_HPP
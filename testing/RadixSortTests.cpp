@@ -0,0 +1,314 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "RadixSortTests.hpp"
+#include "graphics/RenderDataKey.hpp"
+#include "utilities/RadixSort.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace iyf::test {
+/// Mirrors GraphicsSystem::DrawingListElement
+struct TestDrawElement {
+    std::uint32_t componentID;
+    float depth;
+    RenderDataKey key;
+};
+
+struct TestOpaqueKey {
+    inline std::uint64_t operator()(const TestDrawElement& element) const {
+        return element.key.getKey();
+    }
+};
+
+struct TestTransparentKey {
+    inline std::uint64_t operator()(const TestDrawElement& element) const {
+        return element.key.getBackToFrontKey(element.depth);
+    }
+};
+
+struct TestElementID {
+    inline std::uint32_t operator()(const TestDrawElement& element) const {
+        return element.componentID;
+    }
+};
+
+/// Simulates the visible part of a scene. Keys follow a skewed distribution: a few pipelines and buffers, many
+/// materials of which some are far more common than others.
+class TestScene {
+public:
+    TestScene(std::size_t entityCount, std::uint32_t seed) : generator(seed), keys(entityCount), depths(entityCount) {
+        std::geometric_distribution<int> pipelineDistribution(0.3);
+        std::uniform_int_distribution<int> bufferDistribution(0, 3);
+        std::geometric_distribution<int> materialDistribution(0.01);
+        std::uniform_real_distribution<float> depthDistribution(0.1f, 1000.0f);
+        
+        for (std::size_t i = 0; i < entityCount; ++i) {
+            const std::uint16_t pipeline = static_cast<std::uint16_t>(std::min(pipelineDistribution(generator), 63));
+            const std::uint8_t vbo = static_cast<std::uint8_t>(bufferDistribution(generator));
+            const std::uint8_t ibo = static_cast<std::uint8_t>(bufferDistribution(generator));
+            const std::uint16_t material = static_cast<std::uint16_t>(std::min(materialDistribution(generator), 4095));
+            
+            keys[i] = RenderDataKey(PipelineID(pipeline), VertexBufferID(vbo), IndexBufferID(ibo), UniformBufferID(0), MaterialID(material));
+            depths[i] = depthDistribution(generator);
+        }
+    }
+    
+    /// Makes the visible list of the first frame. Culling produces the elements in an order that has nothing to do
+    /// with their keys.
+    std::vector<TestDrawElement> makeFirstFrame(std::size_t visibleCount) {
+        visible.resize(keys.size());
+        std::iota(visible.begin(), visible.end(), 0);
+        std::shuffle(visible.begin(), visible.end(), generator);
+        visible.resize(visibleCount);
+        
+        return makeList();
+    }
+    
+    /// Simulates a camera that moved a bit: a small fraction of the visible entities is replaced and all transparent
+    /// ones change their depth slightly.
+    std::vector<TestDrawElement> makeNextFrame(float replacedFraction) {
+        std::uniform_int_distribution<std::size_t> entityDistribution(0, keys.size() - 1);
+        std::uniform_int_distribution<std::size_t> visibleDistribution(0, visible.size() - 1);
+        
+        const std::size_t replacedCount = static_cast<std::size_t>(visible.size() * replacedFraction);
+        for (std::size_t i = 0; i < replacedCount; ++i) {
+            // Duplicates are possible. They're removed below.
+            visible[visibleDistribution(generator)] = static_cast<std::uint32_t>(entityDistribution(generator));
+        }
+        
+        std::sort(visible.begin(), visible.end());
+        visible.erase(std::unique(visible.begin(), visible.end()), visible.end());
+        std::shuffle(visible.begin(), visible.end(), generator);
+        
+        std::uniform_real_distribution<float> jitterDistribution(-0.5f, 0.5f);
+        for (float& depth : depths) {
+            depth = std::max(0.1f, depth + jitterDistribution(generator));
+        }
+        
+        return makeList();
+    }
+private:
+    std::vector<TestDrawElement> makeList() const {
+        std::vector<TestDrawElement> result;
+        result.reserve(visible.size());
+        
+        for (std::uint32_t id : visible) {
+            result.push_back({id, depths[id], keys[id]});
+        }
+        
+        return result;
+    }
+    
+    std::mt19937 generator;
+    std::vector<RenderDataKey> keys;
+    std::vector<float> depths;
+    std::vector<std::uint32_t> visible;
+};
+
+template <typename KeyFunction>
+static bool IsSortedPermutation(std::vector<TestDrawElement> sorted, std::vector<TestDrawElement> original, KeyFunction key) {
+    if (sorted.size() != original.size()) {
+        return false;
+    }
+    
+    for (std::size_t i = 1; i < sorted.size(); ++i) {
+        if (key(sorted[i - 1]) > key(sorted[i])) {
+            return false;
+        }
+    }
+    
+    auto byID = [](const TestDrawElement& a, const TestDrawElement& b) {
+        return a.componentID < b.componentID;
+    };
+    
+    std::sort(sorted.begin(), sorted.end(), byID);
+    std::sort(original.begin(), original.end(), byID);
+    
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        if (sorted[i].componentID != original[i].componentID || key(sorted[i]) != key(original[i])) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+RadixSortTests::RadixSortTests(bool verbose) : TestBase(verbose) { }
+RadixSortTests::~RadixSortTests() {}
+
+void RadixSortTests::initialize() {}
+
+TestResults RadixSortTests::validateSorting() {
+    // Depth keys must sort back to front, including negative depths
+    const RenderDataKey key(PipelineID(1), VertexBufferID(0), IndexBufferID(0), UniformBufferID(0), MaterialID(0));
+    if (!(key.getBackToFrontKey(100.0f) < key.getBackToFrontKey(10.0f) && key.getBackToFrontKey(10.0f) < key.getBackToFrontKey(-5.0f))) {
+        return TestResults(false, "Back to front keys do not sort by decreasing depth");
+    }
+    
+    TestScene scene(50000, 3);
+    std::vector<TestDrawElement> scratch;
+    
+    std::vector<TestDrawElement> original = scene.makeFirstFrame(20000);
+    std::vector<TestDrawElement> data = original;
+    util::RadixSort64(data, scratch, TestOpaqueKey());
+    if (!IsSortedPermutation(data, original, TestOpaqueKey())) {
+        return TestResults(false, "RadixSort64 failed to sort opaque keys");
+    }
+    
+    data = original;
+    util::RadixSort64(data, scratch, TestTransparentKey());
+    if (!IsSortedPermutation(data, original, TestTransparentKey())) {
+        return TestResults(false, "RadixSort64 failed to sort transparent keys");
+    }
+    
+    util::CoherentRadixSorter<TestDrawElement, TestOpaqueKey, TestElementID> opaqueSorter;
+    util::CoherentRadixSorter<TestDrawElement, TestTransparentKey, TestElementID> transparentSorter;
+    
+    for (int frame = 0; frame < 10; ++frame) {
+        // The last frame replaces half of the list to trigger the full sort fallback
+        original = (frame == 0) ? original : scene.makeNextFrame(frame == 9 ? 0.5f : 0.02f);
+        
+        data = original;
+        opaqueSorter.sort(data);
+        if (!IsSortedPermutation(data, original, TestOpaqueKey())) {
+            return TestResults(false, fmt::format("The coherent sorter failed to sort opaque keys in frame {}", frame));
+        }
+        
+        data = original;
+        transparentSorter.sort(data);
+        if (!IsSortedPermutation(data, original, TestTransparentKey())) {
+            return TestResults(false, fmt::format("The coherent sorter failed to sort transparent keys in frame {}", frame));
+        }
+        
+        if (frame != 0 && frame != 9 && opaqueSorter.getLastMethod() == decltype(opaqueSorter)::Method::FullSort) {
+            return TestResults(false, fmt::format("The coherent sorter did not use the previous order in frame {}", frame));
+        }
+    }
+    
+    // Sorting the sorted result again must be a no-op
+    data = original;
+    opaqueSorter.sort(data);
+    opaqueSorter.sort(data);
+    if (opaqueSorter.getLastMethod() != decltype(opaqueSorter)::Method::AlreadySorted) {
+        return TestResults(false, "The coherent sorter did not detect an already sorted list");
+    }
+    
+    return TestResults(true, "");
+}
+
+template <typename SortFunction>
+static double MeasureFrames(TestScene& scene, std::size_t visibleCount, int frameCount, SortFunction sortFunction) {
+    std::vector<TestDrawElement> data = scene.makeFirstFrame(visibleCount);
+    sortFunction(data);
+    
+    double total = 0.0;
+    for (int i = 0; i < frameCount; ++i) {
+        data = scene.makeNextFrame(0.01f);
+        
+        const auto start = std::chrono::steady_clock::now();
+        sortFunction(data);
+        const auto end = std::chrono::steady_clock::now();
+        
+        total += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+    
+    return total / frameCount;
+}
+
+std::string RadixSortTests::benchmarkSorting() {
+    const std::size_t visibleCounts[] = {10000, 50000, 100000, 250000, 500000};
+    const int frameCount = 10;
+    
+    std::string report = "\n\t\tTimes in ms per frame. 1% of the visible entities change between frames.";
+    report += "\n\t\t Visible |     Keys    | std::sort | RadixSort64 | Coherent";
+    
+    for (std::size_t visibleCount : visibleCounts) {
+        for (int transparent = 0; transparent < 2; ++transparent) {
+            std::vector<TestDrawElement> scratch;
+            util::CoherentRadixSorter<TestDrawElement, TestOpaqueKey, TestElementID> opaqueSorter;
+            util::CoherentRadixSorter<TestDrawElement, TestTransparentKey, TestElementID> transparentSorter;
+            
+            // Each measurement uses a fresh scene with the same seed to get identical frames
+            const std::size_t entityCount = visibleCount * 4;
+            
+            double stdSort;
+            double radixSort;
+            double coherentSort;
+            if (transparent == 0) {
+                TestScene a(entityCount, 99), b(entityCount, 99), c(entityCount, 99);
+                stdSort = MeasureFrames(a, visibleCount, frameCount, [](std::vector<TestDrawElement>& data) {
+                    std::sort(data.begin(), data.end(), [](const TestDrawElement& x, const TestDrawElement& y) {
+                        return x.key < y.key;
+                    });
+                });
+                radixSort = MeasureFrames(b, visibleCount, frameCount, [&scratch](std::vector<TestDrawElement>& data) {
+                    util::RadixSort64(data, scratch, TestOpaqueKey());
+                });
+                coherentSort = MeasureFrames(c, visibleCount, frameCount, [&opaqueSorter](std::vector<TestDrawElement>& data) {
+                    opaqueSorter.sort(data);
+                });
+            } else {
+                TestScene a(entityCount, 99), b(entityCount, 99), c(entityCount, 99);
+                TestTransparentKey key;
+                stdSort = MeasureFrames(a, visibleCount, frameCount, [&key](std::vector<TestDrawElement>& data) {
+                    std::sort(data.begin(), data.end(), [&key](const TestDrawElement& x, const TestDrawElement& y) {
+                        return key(x) < key(y);
+                    });
+                });
+                radixSort = MeasureFrames(b, visibleCount, frameCount, [&scratch](std::vector<TestDrawElement>& data) {
+                    util::RadixSort64(data, scratch, TestTransparentKey());
+                });
+                coherentSort = MeasureFrames(c, visibleCount, frameCount, [&transparentSorter](std::vector<TestDrawElement>& data) {
+                    transparentSorter.sort(data);
+                });
+            }
+            
+            report += fmt::format("\n\t\t{:>8} | {:>11} | {:>9.3f} | {:>11.3f} | {:>8.3f}", visibleCount, transparent ? "transparent" : "opaque", stdSort, radixSort, coherentSort);
+        }
+    }
+    
+    return report;
+}
+
+TestResults RadixSortTests::run() {
+    TestResults results = validateSorting();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return TestResults(true, benchmarkSorting());
+}
+
+void RadixSortTests::cleanup() {}
+
+}
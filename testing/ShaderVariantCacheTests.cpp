@@ -0,0 +1,320 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "ShaderVariantCacheTests.hpp"
+#include "graphics/shaderGeneration/ShaderVariantCache.hpp"
+#include "graphics/shaderGeneration/ShaderVariantCompiler.hpp"
+#include "io/DefaultFileSystem.hpp"
+
+#include "fmt/format.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace iyf::test {
+/// Each variant enables a different subset of the features. The loop gives the optimizer some work to do, just like
+/// the lighting code of the real material templates.
+static const std::string TestShaderSource = R"(#version 450
+layout(location = 0) in vec2 uv;
+layout(location = 0) out vec4 color;
+
+layout(set = 0, binding = 0) uniform Parameters {
+    vec4 values[16];
+} parameters;
+
+void main() {
+    vec4 result = vec4(0.0);
+    
+    for (int i = 0; i < 16; ++i) {
+        vec4 value = parameters.values[i];
+#ifdef FEATURE_0
+        value = sin(value * uv.x);
+#endif
+#ifdef FEATURE_1
+        value = pow(abs(value), vec4(2.2));
+#endif
+#ifdef FEATURE_2
+        value = normalize(value + vec4(uv, 0.0, 1.0));
+#endif
+#ifdef FEATURE_3
+        value = mix(value, value.wzyx, uv.y);
+#endif
+#ifdef FEATURE_4
+        value = exp2(value) - log2(abs(value) + 1.0);
+#endif
+#ifdef FEATURE_5
+        value = smoothstep(vec4(0.0), vec4(1.0), value);
+#endif
+#ifdef FEATURE_6
+        value = reflect(value, normalize(vec4(uv.yx, 1.0, 0.0)));
+#endif
+#ifdef FEATURE_7
+        value = clamp(value * value.yzwx, -1.0, 1.0);
+#endif
+        result += value;
+    }
+    
+    color = result;
+}
+)";
+
+static constexpr std::size_t FeatureCount = 8;
+
+static std::vector<ShaderVariant> MakeVariants(const std::string& source) {
+    std::vector<ShaderVariant> variants;
+    variants.reserve(1 << FeatureCount);
+    
+    for (std::size_t mask = 0; mask < (1 << FeatureCount); ++mask) {
+        ShaderVariant variant;
+        variant.stage = ShaderStageFlagBits::Fragment;
+        variant.source = &source;
+        variant.name = fmt::format("TestVariant{}", mask);
+        
+        for (std::size_t feature = 0; feature < FeatureCount; ++feature) {
+            if (mask & (1 << feature)) {
+                variant.settings.macros.emplace_back(fmt::format("FEATURE_{}", feature));
+            }
+        }
+        
+        variants.push_back(std::move(variant));
+    }
+    
+    return variants;
+}
+
+static std::string GetFirstError(const std::vector<ShaderVariant>& variants) {
+    for (const ShaderVariant& variant : variants) {
+        if (!variant.result) {
+            return variant.result.getErrorsAndWarnings();
+        }
+    }
+    
+    return "";
+}
+
+ShaderVariantCacheTests::ShaderVariantCacheTests(bool verbose) : TestBase(verbose) { }
+ShaderVariantCacheTests::~ShaderVariantCacheTests() {}
+
+void ShaderVariantCacheTests::initialize() {
+    directory = Path(std::filesystem::temp_directory_path()) / "IYFShaderVariantCacheTests";
+    std::filesystem::remove_all(directory.getNativeString());
+}
+
+TestResults ShaderVariantCacheTests::validateKeys() {
+    const std::string source = TestShaderSource;
+    
+    ShaderCompilationSettings settings;
+    settings.macros.emplace_back("FEATURE_0");
+    settings.macros.emplace_back("FEATURE_1", std::int64_t(2));
+    
+    const auto computeKey = [&source](const ShaderCompilationSettings& s, ShaderStageFlagBits stage = ShaderStageFlagBits::Fragment, std::uint32_t helperFunctionVersion = 1) {
+        return ShaderVariantCache::ComputeKey(ShaderLanguage::GLSLVulkan, stage, source, s, helperFunctionVersion);
+    };
+    
+    const std::uint64_t baseKey = computeKey(settings);
+    
+    ShaderCompilationSettings loggingSettings = settings;
+    loggingSettings.logAssembly = true;
+    if (computeKey(loggingSettings) != baseKey) {
+        return TestResults(false, "Logging the assembly changed the key");
+    }
+    
+    ShaderCompilationSettings valueSettings = settings;
+    valueSettings.macros[1] = ShaderMacroWithValue("FEATURE_1", std::int64_t(3));
+    
+    ShaderCompilationSettings reorderedSettings = settings;
+    std::swap(reorderedSettings.macros[0], reorderedSettings.macros[1]);
+    
+    ShaderCompilationSettings layoutSettings = settings;
+    layoutSettings.vertexDataLayout = VertexDataLayout::MeshVertexColored;
+    
+    ShaderCompilationSettings optimizationSettings = settings;
+    optimizationSettings.optimizationLevel = ShaderOptimizationLevel::Size;
+    
+    const std::uint64_t changedKeys[] = {
+        computeKey(valueSettings),
+        computeKey(reorderedSettings),
+        computeKey(layoutSettings),
+        computeKey(optimizationSettings),
+        computeKey(settings, ShaderStageFlagBits::Vertex),
+        computeKey(settings, ShaderStageFlagBits::Fragment, 2),
+        ShaderVariantCache::ComputeKey(ShaderLanguage::GLSLVulkan, ShaderStageFlagBits::Fragment, source + "\n", settings, 1),
+    };
+    
+    for (std::size_t i = 0; i < std::size(changedKeys); ++i) {
+        if (changedKeys[i] == baseKey) {
+            return TestResults(false, fmt::format("Change {} didn't affect the key", i));
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults ShaderVariantCacheTests::validateEntries() {
+    const ShaderVariantCache cache(&DefaultFileSystem::Instance(), directory / "entries");
+    if (!cache.isEnabled()) {
+        return TestResults(false, "Failed to create the cache directory");
+    }
+    
+    std::vector<std::uint8_t> bytecode(4096);
+    for (std::size_t i = 0; i < bytecode.size(); ++i) {
+        bytecode[i] = static_cast<std::uint8_t>(i * 7);
+    }
+    
+    std::vector<std::uint8_t> loaded;
+    if (cache.load(42, loaded)) {
+        return TestResults(false, "Loaded an entry that was never stored");
+    }
+    
+    if (!cache.store(42, bytecode) || !cache.load(42, loaded) || loaded != bytecode) {
+        return TestResults(false, "The entry didn't survive a round trip");
+    }
+    
+    // An entry that was copied to a file with a different name must not be used
+    std::filesystem::copy_file(cache.makeEntryPath(42).getNativeString(), cache.makeEntryPath(43).getNativeString());
+    if (cache.load(43, loaded)) {
+        return TestResults(false, "Loaded an entry that has a different key");
+    }
+    
+    const std::string entryPath = cache.makeEntryPath(42).getNativeString();
+    {
+        std::fstream file(entryPath, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(100);
+        file.put('\xFF');
+    }
+    
+    if (cache.load(42, loaded)) {
+        return TestResults(false, "Loaded a corrupt entry");
+    }
+    
+    std::filesystem::resize_file(entryPath, 16);
+    if (cache.load(42, loaded)) {
+        return TestResults(false, "Loaded a truncated entry");
+    }
+    
+    if (!cache.store(42, bytecode) || !cache.load(42, loaded) || loaded != bytecode) {
+        return TestResults(false, "Failed to replace a corrupt entry");
+    }
+    
+    const ShaderVariantCache disabledCache(&DefaultFileSystem::Instance(), Path());
+    if (disabledCache.isEnabled() || disabledCache.store(42, bytecode) || disabledCache.load(42, loaded)) {
+        return TestResults(false, "A cache without a directory was used");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults ShaderVariantCacheTests::benchmarkCompilation() {
+    const FileSystem* filesystem = &DefaultFileSystem::Instance();
+    const std::string source = TestShaderSource;
+    
+    using Clock = std::chrono::steady_clock;
+    const auto toMilliseconds = [](Clock::duration duration) {
+        return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(duration).count();
+    };
+    
+    std::vector<ShaderVariant> serialVariants = MakeVariants(source);
+    ShaderVariantCompiler serialCompiler(filesystem, 1);
+    
+    const auto serialStart = Clock::now();
+    if (!serialCompiler.compile(serialVariants)) {
+        return TestResults(false, fmt::format("Serial compilation failed: {}", GetFirstError(serialVariants)));
+    }
+    const double serialTime = toMilliseconds(Clock::now() - serialStart);
+    
+    std::vector<ShaderVariant> parallelVariants = MakeVariants(source);
+    ShaderVariantCompiler parallelCompiler(filesystem);
+    
+    const auto parallelStart = Clock::now();
+    if (!parallelCompiler.compile(parallelVariants)) {
+        return TestResults(false, "Parallel compilation failed");
+    }
+    const double parallelTime = toMilliseconds(Clock::now() - parallelStart);
+    
+    // Two compilers that share a directory behave like two runs of the editor
+    const Path cacheDirectory = directory / "benchmark";
+    
+    std::vector<ShaderVariant> coldVariants = MakeVariants(source);
+    ShaderVariantCompiler coldCompiler(filesystem, 0, std::make_unique<ShaderVariantCache>(filesystem, cacheDirectory));
+    
+    const auto coldStart = Clock::now();
+    if (!coldCompiler.compile(coldVariants)) {
+        return TestResults(false, "Compilation with an empty cache failed");
+    }
+    const double coldTime = toMilliseconds(Clock::now() - coldStart);
+    
+    std::vector<ShaderVariant> warmVariants = MakeVariants(source);
+    ShaderVariantCompiler warmCompiler(filesystem, 0, std::make_unique<ShaderVariantCache>(filesystem, cacheDirectory));
+    
+    const auto warmStart = Clock::now();
+    if (!warmCompiler.compile(warmVariants)) {
+        return TestResults(false, "Compilation with a full cache failed");
+    }
+    const double warmTime = toMilliseconds(Clock::now() - warmStart);
+    
+    for (std::size_t i = 0; i < serialVariants.size(); ++i) {
+        const std::vector<std::uint8_t>& expected = serialVariants[i].result.getBytecode();
+        
+        if (parallelVariants[i].result.getBytecode() != expected || coldVariants[i].result.getBytecode() != expected ||
+            warmVariants[i].result.getBytecode() != expected) {
+            return TestResults(false, fmt::format("Variant {} has different bytecode", i));
+        }
+        
+        if (coldVariants[i].loadedFromCache || !warmVariants[i].loadedFromCache) {
+            return TestResults(false, fmt::format("Variant {} was loaded from the cache incorrectly", i));
+        }
+    }
+    
+    std::string report = fmt::format("\n\t\tCompiling {} variants (ms):", serialVariants.size());
+    report += "\n\t\t  Serial | Parallel | Parallel, empty cache | Full cache | Threads";
+    report += fmt::format("\n\t\t  {:6.1f} | {:8.1f} | {:21.1f} | {:10.1f} | {:7}", serialTime, parallelTime, coldTime, warmTime, parallelCompiler.getThreadCount());
+    
+    return TestResults(true, report);
+}
+
+TestResults ShaderVariantCacheTests::run() {
+    TestResults results = validateKeys();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateEntries();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return benchmarkCompilation();
+}
+
+void ShaderVariantCacheTests::cleanup() {
+    std::filesystem::remove_all(directory.getNativeString());
+}
+
+}
@@ -0,0 +1,304 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "SpatialIndexTests.hpp"
+#include "graphics/culling/SpatialIndex.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace iyf::test {
+/// A frustum with the apex at the origin that looks down the +Z axis. slope controls the field of view.
+static CullingPlanes MakePlanes(float slope, float farDistance) {
+    const float length = std::sqrt(1.0f + slope * slope);
+    
+    CullingPlanes planes;
+    planes.x = {-1.0f / length,  1.0f / length,  0.0f,           0.0f,          0.0f,  0.0f};
+    planes.y = { 0.0f,           0.0f,           1.0f / length, -1.0f / length, 0.0f,  0.0f};
+    planes.z = {-slope / length, -slope / length, -slope / length, -slope / length, -1.0f, 1.0f};
+    planes.w = { 0.0f,           0.0f,           0.0f,           0.0f,          1.0f, -farDistance};
+    
+    return planes;
+}
+
+/// Reference data that mirrors the contents of the SpatialIndex
+class BruteForceWorld {
+public:
+    void set(std::uint32_t id, const AABB& aabb) {
+        if (id >= bounds.size()) {
+            bounds.resize(id + 1);
+            alive.resize(id + 1, false);
+        }
+        
+        bounds[id] = aabb;
+        alive[id] = true;
+    }
+    
+    void remove(std::uint32_t id) {
+        alive[id] = false;
+    }
+    
+    template <typename Test>
+    std::vector<std::uint32_t> query(Test test) const {
+        std::vector<std::uint32_t> result;
+        
+        for (std::uint32_t i = 0; i < bounds.size(); ++i) {
+            if (alive[i] && test(bounds[i])) {
+                result.push_back(i);
+            }
+        }
+        
+        return result;
+    }
+    
+    bool raycast(const Ray& ray, float maxDistance, float& closest) const {
+        bool found = false;
+        closest = maxDistance;
+        
+        for (std::uint32_t i = 0; i < bounds.size(); ++i) {
+            float distance;
+            if (alive[i] && IntersectRayAABB(ray, bounds[i], closest, distance) && (!found || distance < closest)) {
+                found = true;
+                closest = distance;
+            }
+        }
+        
+        return found;
+    }
+private:
+    std::vector<AABB> bounds;
+    std::vector<bool> alive;
+};
+
+static AABB MakeBox(std::mt19937& generator, float worldHalfSize, float maxHalfExtent, float worldHalfHeight = 0.0f) {
+    if (worldHalfHeight == 0.0f) {
+        worldHalfHeight = worldHalfSize;
+    }
+    
+    std::uniform_real_distribution<float> positionDistribution(-worldHalfSize, worldHalfSize);
+    std::uniform_real_distribution<float> heightDistribution(-worldHalfHeight, worldHalfHeight);
+    std::uniform_real_distribution<float> extentDistribution(0.25f, maxHalfExtent);
+    
+    const glm::vec3 center(positionDistribution(generator), heightDistribution(generator), positionDistribution(generator));
+    const glm::vec3 extent(extentDistribution(generator), extentDistribution(generator), extentDistribution(generator));
+    
+    return AABB(center - extent, center + extent);
+}
+
+SpatialIndexTests::SpatialIndexTests(bool verbose) : TestBase(verbose) { }
+SpatialIndexTests::~SpatialIndexTests() {}
+
+void SpatialIndexTests::initialize() {}
+
+TestResults SpatialIndexTests::validateQueries() {
+    std::mt19937 generator(7);
+    
+    // Small world bounds to make sure that objects outside of the octree are handled as well
+    SpatialIndex index(AABB(glm::vec3(-400.0f, -400.0f, -400.0f), glm::vec3(400.0f, 400.0f, 400.0f)), 6);
+    BruteForceWorld reference;
+    
+    const std::uint32_t staticCount = 20000;
+    const std::uint32_t dynamicCount = 3000;
+    
+    for (std::uint32_t i = 0; i < staticCount + dynamicCount; ++i) {
+        const bool isStatic = i < staticCount;
+        const AABB box = MakeBox(generator, 500.0f, isStatic ? 4.0f : 40.0f);
+        
+        index.insert(i, box, isStatic);
+        reference.set(i, box);
+    }
+    
+    const CullingPlanes planes = MakePlanes(0.6f, 450.0f);
+    const AABB queryBox(glm::vec3(-50.0f, -20.0f, 30.0f), glm::vec3(80.0f, 60.0f, 90.0f));
+    const BoundingSphere querySphere(glm::vec3(10.0f, -30.0f, 100.0f), 75.0f);
+    const Ray ray(glm::vec3(-450.0f, 1.0f, 2.0f), glm::normalize(glm::vec3(1.0f, 0.01f, 0.02f)));
+    
+    auto compare = [&](const char* stage) -> TestResults {
+        std::vector<std::uint32_t> result;
+        
+        index.queryFrustum(planes, result);
+        std::sort(result.begin(), result.end());
+        
+        auto expected = reference.query([&planes](const AABB& box) {
+            std::uint8_t mask = AllFrustumPlanes;
+            return TestAABBAgainstPlanes(planes, box, mask) != PlaneTestResult::Outside;
+        });
+        
+        if (result != expected) {
+            return TestResults(false, fmt::format("{}: the frustum query returned {} entities instead of {}", stage, result.size(), expected.size()));
+        }
+        
+        result.clear();
+        index.queryAABB(queryBox, result);
+        std::sort(result.begin(), result.end());
+        
+        expected = reference.query([&queryBox](const AABB& box) {
+            return AABBOverlapsAABB(box, queryBox);
+        });
+        
+        if (result != expected) {
+            return TestResults(false, fmt::format("{}: the AABB query returned {} entities instead of {}", stage, result.size(), expected.size()));
+        }
+        
+        result.clear();
+        index.querySphere(querySphere, result);
+        std::sort(result.begin(), result.end());
+        
+        expected = reference.query([&querySphere](const AABB& box) {
+            return SphereOverlapsAABB(querySphere, box);
+        });
+        
+        if (result != expected) {
+            return TestResults(false, fmt::format("{}: the sphere query returned {} entities instead of {}", stage, result.size(), expected.size()));
+        }
+        
+        RayHit hit;
+        float expectedDistance;
+        const bool expectedHit = reference.raycast(ray, 2000.0f, expectedDistance);
+        
+        if (index.raycast(ray.origin, ray.direction, 2000.0f, hit) != expectedHit || (expectedHit && hit.distance != expectedDistance)) {
+            return TestResults(false, fmt::format("{}: the raycast did not find the closest hit", stage));
+        }
+        
+        return TestResults(true, "");
+    };
+    
+    TestResults results = compare("Before the BVH build");
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    if (!index.commit() || index.getStaticCount() != staticCount || index.getDynamicCount() != dynamicCount) {
+        return TestResults(false, "The BVH was not built or contains a wrong number of entities");
+    }
+    
+    results = compare("After the BVH build");
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    // Move every dynamic entity a couple of times, including some static ones, then remove a part of both
+    for (int frame = 0; frame < 3; ++frame) {
+        for (std::uint32_t i = staticCount; i < staticCount + dynamicCount; ++i) {
+            const AABB box = MakeBox(generator, 500.0f, 40.0f);
+            index.update(i, box, false);
+            reference.set(i, box);
+        }
+    }
+    
+    for (std::uint32_t i = 0; i < staticCount; i += 97) {
+        const AABB box = MakeBox(generator, 500.0f, 4.0f);
+        index.update(i, box, true);
+        reference.set(i, box);
+    }
+    
+    for (std::uint32_t i = 5; i < staticCount + dynamicCount; i += 13) {
+        index.remove(i);
+        reference.remove(i);
+    }
+    
+    results = compare("After updates and removals");
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    index.commit(true);
+    if (index.getPendingStaticCount() != 0) {
+        return TestResults(false, "A forced commit did not move the pending static entities to the BVH");
+    }
+    
+    return compare("After the second BVH build");
+}
+
+std::string SpatialIndexTests::benchmarkCulling() {
+    const std::uint32_t staticCount = 200000;
+    const std::uint32_t dynamicCount = 500;
+    const int repetitions = 50;
+    
+    std::mt19937 generator(1234);
+    SpatialIndex index;
+    AABBSet allBoxes;
+    allBoxes.reserve(staticCount + dynamicCount);
+    
+    for (std::uint32_t i = 0; i < staticCount + dynamicCount; ++i) {
+        // A mostly flat level
+        const AABB box = MakeBox(generator, 4000.0f, 3.0f, 50.0f);
+        const glm::vec3& minCorner = box.getVertex(AABB::Vertex::Minimum);
+        const glm::vec3& maxCorner = box.getVertex(AABB::Vertex::Maximum);
+        
+        index.insert(i, box, i < staticCount);
+        allBoxes.add(minCorner.x, minCorner.y, minCorner.z, maxCorner.x, maxCorner.y, maxCorner.z);
+    }
+    
+    auto buildStart = std::chrono::steady_clock::now();
+    index.commit(true);
+    auto buildEnd = std::chrono::steady_clock::now();
+    const std::chrono::duration<double, std::milli> buildTime = buildEnd - buildStart;
+    
+    // A narrow view that only sees a few hundred props
+    const CullingPlanes planes = MakePlanes(0.5f, 500.0f);
+    std::vector<std::uint32_t> visible;
+    
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+        visible.clear();
+        index.queryFrustum(planes, visible);
+    }
+    auto end = std::chrono::steady_clock::now();
+    const std::chrono::duration<double, std::micro> indexTime = end - start;
+    const std::size_t indexVisible = visible.size();
+    
+    FrustumCuller culler;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+        culler.cull(planes, allBoxes, visible);
+    }
+    end = std::chrono::steady_clock::now();
+    const std::chrono::duration<double, std::micro> bruteForceTime = end - start;
+    
+    std::string report = fmt::format("\n\t\tStatic: {}; dynamic: {}; BVH build time: {:.3f} ms", staticCount, dynamicCount, buildTime.count());
+    report += fmt::format("\n\t\tSpatial index query:  {:>10.3f} us ({} visible)", indexTime.count() / repetitions, indexVisible);
+    report += fmt::format("\n\t\tBrute force SIMD:     {:>10.3f} us ({} visible)", bruteForceTime.count() / repetitions, visible.size());
+    return report;
+}
+
+TestResults SpatialIndexTests::run() {
+    TestResults results = validateQueries();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return TestResults(true, benchmarkCulling());
+}
+
+void SpatialIndexTests::cleanup() {}
+
+}
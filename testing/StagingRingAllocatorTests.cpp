@@ -0,0 +1,366 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "StagingRingAllocatorTests.hpp"
+#include "graphics/StagingRingAllocator.hpp"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace iyf::test {
+/// Stands in for a GPU queue. Submissions get consecutive fence IDs and a fence is signaled once signal() reaches it,
+/// unless a test signals fences one by one.
+class SimulatedFences {
+public:
+    SimulatedFences() : nextFence(1), lastCompleted(0) {}
+    
+    std::uint64_t submit() {
+        signaled.push_back(false);
+        return nextFence++;
+    }
+    
+    /// Signals every fence up to and including fenceID
+    void signalUpTo(std::uint64_t fenceID) {
+        for (std::uint64_t f = lastCompleted + 1; f <= fenceID && f < nextFence; ++f) {
+            signaled[f - 1] = true;
+        }
+        
+        lastCompleted = std::max(lastCompleted, fenceID);
+    }
+    
+    void signal(std::uint64_t fenceID) {
+        signaled[fenceID - 1] = true;
+    }
+    
+    bool isSignaled(std::uint64_t fenceID) const {
+        return signaled[fenceID - 1];
+    }
+    
+    std::uint64_t getLastSubmitted() const {
+        return nextFence - 1;
+    }
+private:
+    std::uint64_t nextFence;
+    std::uint64_t lastCompleted;
+    std::vector<bool> signaled;
+};
+
+StagingRingAllocatorTests::StagingRingAllocatorTests(bool verbose) : TestBase(verbose) { }
+StagingRingAllocatorTests::~StagingRingAllocatorTests() {}
+
+void StagingRingAllocatorTests::initialize() {}
+
+TestResults StagingRingAllocatorTests::testBasicAllocation() {
+    StagingRingAllocator ring(1024);
+    SimulatedFences fences;
+    auto isSignaled = [&fences](std::uint64_t fenceID) { return fences.isSignaled(fenceID); };
+    
+    if (ring.allocate(100, 1) != 0 || ring.allocate(10, 64) != 128 || ring.getUsedSize() != 138) {
+        return TestResults(false, "Allocations weren't placed or aligned correctly");
+    }
+    
+    // Alignments don't have to be powers of two
+    if (ring.allocate(5, 3) != 138 || ring.getOpenSize() != 143) {
+        return TestResults(false, "A non power of two alignment wasn't handled correctly");
+    }
+    
+    if (ring.canAllocate(1000, 1) || ring.allocate(1000, 1) != StagingRingAllocator::InvalidOffset || ring.getUsedSize() != 143) {
+        return TestResults(false, "An allocation that doesn't fit succeeded or changed the state");
+    }
+    
+    try {
+        ring.allocate(0, 1);
+        return TestResults(false, "An empty allocation was accepted");
+    } catch (const std::invalid_argument&) {}
+    
+    const std::uint64_t fence = fences.submit();
+    ring.submit(fence);
+    
+    if (ring.getOpenSize() != 0 || ring.getPendingSubmissionCount() != 1) {
+        return TestResults(false, "submit() didn't close the submission");
+    }
+    
+    try {
+        ring.reset(2048);
+        return TestResults(false, "The ring was reset while its memory was still in use");
+    } catch (const std::logic_error&) {}
+    
+    if (ring.reclaim(isSignaled) != 0 || ring.getUsedSize() != 143) {
+        return TestResults(false, "Memory was reclaimed before the fence was signaled");
+    }
+    
+    fences.signalUpTo(fence);
+    if (ring.reclaim(isSignaled) != 1 || ring.getUsedSize() != 0) {
+        return TestResults(false, "Memory wasn't reclaimed after the fence was signaled");
+    }
+    
+    // An empty ring starts over, so the whole capacity is available again
+    if (ring.allocate(1024, 1) != 0) {
+        return TestResults(false, "An empty ring didn't start over");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults StagingRingAllocatorTests::testWrapAround() {
+    StagingRingAllocator ring(1000);
+    SimulatedFences fences;
+    auto isSignaled = [&fences](std::uint64_t fenceID) { return fences.isSignaled(fenceID); };
+    
+    ring.allocate(400, 1);
+    const std::uint64_t first = fences.submit();
+    ring.submit(first);
+    
+    ring.allocate(400, 1);
+    ring.submit(fences.submit());
+    
+    // [0, 800) is in use. 300 bytes only fit at the start, which is still in use.
+    if (ring.canAllocate(300, 1)) {
+        return TestResults(false, "An allocation overlapped memory that's in use");
+    }
+    
+    fences.signal(first);
+    ring.reclaim(isSignaled);
+    
+    // Now they fit at the start. The 200 bytes at the end get skipped.
+    const std::uint64_t offset = ring.allocate(300, 1);
+    if (offset != 0 || ring.getUsedSize() != 900) {
+        return TestResults(false, fmt::format("The allocation didn't wrap around correctly. Offset: {}, used: {}", offset, ring.getUsedSize()));
+    }
+    
+    // The skipped bytes belong to the submission that wrapped around
+    const std::uint64_t wrapped = fences.submit();
+    ring.submit(wrapped);
+    
+    // Only [300, 400) is free
+    if (!ring.canAllocate(100, 1) || ring.canAllocate(101, 1) || ring.canAllocate(90, 64)) {
+        return TestResults(false, "The free space between the head and the tail was computed incorrectly");
+    }
+    
+    fences.signalUpTo(wrapped);
+    ring.reclaim(isSignaled);
+    
+    if (ring.getUsedSize() != 0 || ring.getPendingSubmissionCount() != 0) {
+        return TestResults(false, fmt::format("{} bytes are still in use after all fences were signaled", ring.getUsedSize()));
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults StagingRingAllocatorTests::testInOrderReclamation() {
+    StagingRingAllocator ring(1000);
+    SimulatedFences fences;
+    auto isSignaled = [&fences](std::uint64_t fenceID) { return fences.isSignaled(fenceID); };
+    
+    std::uint64_t ids[3];
+    for (std::uint64_t& id : ids) {
+        ring.allocate(100, 1);
+        id = fences.submit();
+        ring.submit(id);
+    }
+    
+    // An empty submission in the middle of the queue
+    const std::uint64_t empty = fences.submit();
+    ring.submit(empty);
+    
+    // Newer submissions can't be reclaimed before the older ones because the memory is handed out in order
+    fences.signal(ids[1]);
+    fences.signal(ids[2]);
+    if (ring.reclaim(isSignaled) != 0 || ring.getUsedSize() != 300) {
+        return TestResults(false, "Memory was reclaimed out of order");
+    }
+    
+    if (ring.getOldestFenceID() != ids[0]) {
+        return TestResults(false, "getOldestFenceID() returned the wrong fence");
+    }
+    
+    // Simulates waiting for the oldest fence
+    fences.signal(ids[0]);
+    if (!ring.reclaimOldest() || ring.reclaim(isSignaled) != 2 || ring.getUsedSize() != 0) {
+        return TestResults(false, "The remaining submissions weren't reclaimed after the oldest one completed");
+    }
+    
+    // The empty submission must not move the tail after the ring started over
+    ring.allocate(500, 1);
+    fences.signal(empty);
+    ring.reclaim(isSignaled);
+    
+    if (ring.getPendingSubmissionCount() != 0 || ring.getUsedSize() != 500 || !ring.canAllocate(500, 1)) {
+        return TestResults(false, "Reclaiming an empty submission corrupted the ring");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults StagingRingAllocatorTests::testFramePipeline() {
+    // 3 frames in flight. The GPU finishes a frame's uploads 2 frames after they're submitted.
+    const std::uint64_t capacity = 64 * 1024;
+    const std::uint64_t latency = 2;
+    const std::uint64_t alignments[] = {1, 4, 16, 256};
+    
+    StagingRingAllocator ring(capacity);
+    SimulatedFences fences;
+    auto isSignaled = [&fences](std::uint64_t fenceID) { return fences.isSignaled(fenceID); };
+    
+    struct Block {
+        std::uint64_t offset;
+        std::uint64_t size;
+        std::uint64_t fenceID;
+    };
+    
+    std::vector<Block> liveBlocks;
+    std::vector<Block> openBlocks;
+    
+    // Forgets the blocks of reclaimed submissions. Returns false if any of them had an unsignaled fence.
+    auto pruneLiveBlocks = [&]() {
+        std::vector<Block> stillLive;
+        for (const Block& block : liveBlocks) {
+            if (ring.getPendingSubmissionCount() != 0 && block.fenceID >= ring.getOldestFenceID()) {
+                stillLive.push_back(block);
+            } else if (!fences.isSignaled(block.fenceID)) {
+                return false;
+            }
+        }
+        
+        liveBlocks = std::move(stillLive);
+        return true;
+    };
+    
+    std::mt19937 generator(1234);
+    std::uniform_int_distribution<std::uint64_t> sizeDistribution(1, capacity / 16);
+    std::uniform_int_distribution<int> countDistribution(0, 12);
+    std::uniform_int_distribution<int> alignmentDistribution(0, 3);
+    
+    std::size_t deferred = 0;
+    std::size_t stalls = 0;
+    std::size_t allocations = 0;
+    
+    for (std::uint64_t frame = 0; frame < 2000; ++frame) {
+        const std::uint64_t lastSubmitted = fences.getLastSubmitted();
+        if (lastSubmitted > latency) {
+            fences.signalUpTo(lastSubmitted - latency);
+        }
+        
+        ring.reclaim(isSignaled);
+        
+        if (!pruneLiveBlocks()) {
+            return TestResults(false, fmt::format("Frame {}: a block was reclaimed before its fence was signaled", frame));
+        }
+        
+        const int uploadCount = countDistribution(generator);
+        for (int u = 0; u < uploadCount; ++u) {
+            const std::uint64_t size = sizeDistribution(generator);
+            const std::uint64_t alignment = alignments[alignmentDistribution(generator)];
+            
+            if (!ring.canAllocate(size, alignment)) {
+                // Most uploads can be deferred to the next frame. Every 4th one is urgent and waits for the GPU.
+                if (u % 4 != 0) {
+                    deferred++;
+                    continue;
+                }
+                
+                while (!ring.canAllocate(size, alignment) && ring.getPendingSubmissionCount() != 0) {
+                    fences.signal(ring.getOldestFenceID());
+                    ring.reclaimOldest();
+                    stalls++;
+                }
+                
+                pruneLiveBlocks();
+                
+                // Only the blocks of this frame are left and they're too big. Defer it after all.
+                if (!ring.canAllocate(size, alignment)) {
+                    deferred++;
+                    continue;
+                }
+            }
+            
+            const std::uint64_t offset = ring.allocate(size, alignment);
+            if (offset == StagingRingAllocator::InvalidOffset || offset % alignment != 0 || offset + size > capacity) {
+                return TestResults(false, fmt::format("Frame {}: invalid allocation at offset {}", frame, offset));
+            }
+            
+            for (const std::vector<Block>* blocks : {&liveBlocks, &openBlocks}) {
+                for (const Block& block : *blocks) {
+                    if (offset < block.offset + block.size && block.offset < offset + size) {
+                        return TestResults(false, fmt::format("Frame {}: [{}, {}) overlaps a block that's in use", frame, offset, offset + size));
+                    }
+                }
+            }
+            
+            openBlocks.push_back({offset, size, 0});
+            allocations++;
+        }
+        
+        const std::uint64_t fenceID = fences.submit();
+        ring.submit(fenceID);
+        
+        for (Block& block : openBlocks) {
+            block.fenceID = fenceID;
+            liveBlocks.push_back(block);
+        }
+        openBlocks.clear();
+    }
+    
+    fences.signalUpTo(fences.getLastSubmitted());
+    ring.reclaim(isSignaled);
+    
+    if (ring.getUsedSize() != 0 || ring.getPendingSubmissionCount() != 0) {
+        return TestResults(false, fmt::format("{} bytes are still in use after all fences were signaled", ring.getUsedSize()));
+    }
+    
+    if (allocations == 0 || stalls == 0 || deferred == 0) {
+        return TestResults(false, "The simulation didn't exercise all code paths. Adjust the parameters.");
+    }
+    
+    return TestResults(true, fmt::format("\n\t\t{} allocations, {} deferred, {} stalls", allocations, deferred, stalls));
+}
+
+TestResults StagingRingAllocatorTests::run() {
+    TestResults results = testBasicAllocation();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = testWrapAround();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = testInOrderReclamation();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return testFramePipeline();
+}
+
+void StagingRingAllocatorTests::cleanup() {}
+
+}
@@ -0,0 +1,413 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "StreamingSchedulerTests.hpp"
+#include "assets/StreamingScheduler.hpp"
+#include "threading/MPSCQueue.hpp"
+#include "threading/ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace iyf::test {
+/// Records what the scheduler asked for and simulates the enabling part of AssetManager::enableLoadedAssets()
+class TestRequestHandler : public StreamingRequestHandler {
+public:
+    TestRequestHandler(std::chrono::microseconds readTime = std::chrono::microseconds(0)) : readTime(readTime) {}
+    
+    virtual void executeStreamingRequest(StreamingRequest& request) final override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            executed.push_back(request.nameHash);
+        }
+        
+        if (readTime.count() != 0) {
+            std::this_thread::sleep_for(readTime);
+        }
+        
+        completed.push(&request);
+    }
+    
+    virtual void cancelStreamingRequest(StreamingRequest& request) final override {
+        cancelled.push_back(request.nameHash);
+    }
+    
+    /// Enables completed requests while the upload budget allows it.
+    ///
+    /// \return The number of enabled requests.
+    std::size_t enable(StreamingScheduler& scheduler) {
+        std::size_t count = 0;
+        
+        StreamingRequest** next;
+        while ((next = completed.front()) != nullptr && scheduler.canUpload((*next)->estimatedSize)) {
+            StreamingRequest* request;
+            completed.pop(request);
+            
+            enabled.push_back(request->nameHash);
+            scheduler.notifyEnabled(request);
+            count++;
+        }
+        
+        return count;
+    }
+    
+    std::vector<StringHash> getExecuted() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return executed;
+    }
+    
+    std::vector<StringHash> enabled;
+    std::vector<StringHash> cancelled;
+private:
+    std::chrono::microseconds readTime;
+    std::mutex mutex;
+    std::vector<StringHash> executed;
+    iyft::MPSCQueue<StreamingRequest*> completed;
+};
+
+static std::unique_ptr<StreamingRequest> MakeRequest(TestRequestHandler& handler, std::uint64_t name, float priority, std::uint64_t size = 0,
+                                                     const AssetHandleRefCounter* counter = nullptr) {
+    return std::make_unique<StreamingRequest>(&handler, StringHash(name), 0, nullptr, Path(), Metadata(), counter, size, priority);
+}
+
+static StreamingBudget MakeBudget(std::size_t maxReadsInFlight, Bytes cpuMemory = Bytes(1024 * 1024 * 1024), Bytes uploadPerFrame = Bytes(1024 * 1024 * 1024)) {
+    StreamingBudget budget;
+    budget.maxReadsInFlight = maxReadsInFlight;
+    budget.cpuMemory = cpuMemory;
+    budget.uploadPerFrame = uploadPerFrame;
+    
+    return budget;
+}
+
+/// Runs frames until all requests are enabled or cancelled
+static void RunUntilIdle(StreamingScheduler& scheduler, TestRequestHandler& handler) {
+    while (true) {
+        scheduler.update();
+        scheduler.waitForReads();
+        handler.enable(scheduler);
+        
+        const StreamingStatistics stats = scheduler.getStatistics();
+        if (stats.queuedRequests == 0 && stats.readsInFlight == 0 && stats.awaitingEnable == 0) {
+            return;
+        }
+    }
+}
+
+StreamingSchedulerTests::StreamingSchedulerTests(bool verbose) : TestBase(verbose) { }
+StreamingSchedulerTests::~StreamingSchedulerTests() {}
+
+void StreamingSchedulerTests::initialize() {}
+
+TestResults StreamingSchedulerTests::validatePriorities() {
+    iyft::ThreadPool pool(1);
+    
+    // A single read at a time makes the execution order equal to the dispatch order
+    {
+        TestRequestHandler handler;
+        StreamingScheduler scheduler(&pool, MakeBudget(1));
+        
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<int> distribution(0, 8);
+        
+        std::vector<std::pair<float, std::uint64_t>> expected;
+        for (std::uint64_t i = 1; i <= 64; ++i) {
+            const float priority = static_cast<float>(distribution(generator));
+            scheduler.submit(MakeRequest(handler, i, priority));
+            expected.emplace_back(priority, i);
+        }
+        
+        // Higher priorities first, submission order among equal ones
+        std::stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) {
+            return a.first > b.first;
+        });
+        
+        RunUntilIdle(scheduler, handler);
+        
+        const std::vector<StringHash> executed = handler.getExecuted();
+        if (executed.size() != expected.size()) {
+            return TestResults(false, "Not all requests were executed");
+        }
+        
+        for (std::size_t i = 0; i < expected.size(); ++i) {
+            if (executed[i] != StringHash(expected[i].second)) {
+                return TestResults(false, "The requests were not executed in priority order");
+            }
+        }
+        
+        if (scheduler.getStatistics().completedRequests != expected.size()) {
+            return TestResults(false, "The statistics don't match the number of completed requests");
+        }
+    }
+    
+    // Reprioritization of queued requests. The read takes long enough to keep the other requests queued while the first one
+    // is in flight.
+    {
+        TestRequestHandler handler(std::chrono::milliseconds(20));
+        StreamingScheduler scheduler(&pool, MakeBudget(1));
+        
+        scheduler.submit(MakeRequest(handler, 1, 1.0f));
+        scheduler.submit(MakeRequest(handler, 2, 2.0f));
+        scheduler.submit(MakeRequest(handler, 3, 3.0f));
+        
+        if (!scheduler.setPriority(StringHash(1), 10.0f) || scheduler.setPriority(StringHash(4), 10.0f)) {
+            return TestResults(false, "setPriority() returned an unexpected result");
+        }
+        
+        scheduler.update();
+        scheduler.waitForReads();
+        
+        if (scheduler.setPriority(StringHash(1), 0.0f)) {
+            return TestResults(false, "A dispatched request was reprioritized");
+        }
+        
+        scheduler.setPriority(StringHash(2), 5.0f);
+        RunUntilIdle(scheduler, handler);
+        
+        const std::vector<StringHash> expected = {StringHash(1), StringHash(2), StringHash(3)};
+        if (handler.getExecuted() != expected) {
+            return TestResults(false, "Reprioritized requests were executed in the wrong order");
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults StreamingSchedulerTests::validateCancellation() {
+    iyft::ThreadPool pool(1);
+    TestRequestHandler handler(std::chrono::milliseconds(20));
+    StreamingScheduler scheduler(&pool, MakeBudget(1));
+    
+    AssetHandleRefCounter released(0);
+    AssetHandleRefCounter neverReferenced(0);
+    AssetHandleRefCounter alive(0);
+    AssetHandleRefCounter releasedEarly(0);
+    
+    scheduler.submit(MakeRequest(handler, 1, 10.0f));
+    scheduler.submit(MakeRequest(handler, 2, 0.0f, 0, &released));
+    scheduler.submit(MakeRequest(handler, 3, 0.0f, 0, &neverReferenced));
+    scheduler.submit(MakeRequest(handler, 4, 0.0f, 0, &alive));
+    scheduler.submit(MakeRequest(handler, 5, 0.0f, 0, &releasedEarly));
+    
+    // Simulates the AssetHandles that AssetManager::load() returns. The handle of request 5 is destroyed before the first
+    // update() call.
+    released = 1;
+    alive = 1;
+    
+    if (!scheduler.markReferenced(StringHash(2)) || !scheduler.markReferenced(StringHash(4)) ||
+        !scheduler.markReferenced(StringHash(5)) || scheduler.markReferenced(StringHash(6))) {
+        return TestResults(false, "markReferenced() returned an unexpected result");
+    }
+    
+    // Dispatches request 1 and cancels request 5
+    scheduler.update();
+    scheduler.waitForReads();
+    handler.enable(scheduler);
+    
+    // The last handle of request 2 gets destroyed before its load starts
+    released = 0;
+    RunUntilIdle(scheduler, handler);
+    
+    const std::vector<StringHash> expectedCancelled = {StringHash(5), StringHash(2)};
+    if (handler.cancelled != expectedCancelled || scheduler.getStatistics().cancelledRequests != 2) {
+        return TestResults(false, "The unreferenced requests were not cancelled");
+    }
+    
+    const std::vector<StringHash> executed = handler.getExecuted();
+    if (executed.size() != 3 || std::find(executed.begin(), executed.end(), StringHash(2)) != executed.end() ||
+        std::find(executed.begin(), executed.end(), StringHash(5)) != executed.end()) {
+        return TestResults(false, "A cancelled request was executed or a live one was skipped");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults StreamingSchedulerTests::validateBudgets() {
+    iyft::ThreadPool pool(2);
+    
+    // CPU memory budget
+    {
+        TestRequestHandler handler;
+        StreamingScheduler scheduler(&pool, MakeBudget(8, Bytes(100)));
+        
+        for (std::uint64_t i = 1; i <= 4; ++i) {
+            scheduler.submit(MakeRequest(handler, i, 0.0f, 60));
+        }
+        
+        scheduler.update();
+        scheduler.waitForReads();
+        
+        StreamingStatistics stats = scheduler.getStatistics();
+        if (stats.queuedRequests != 3 || stats.bytesInFlight != 60) {
+            return TestResults(false, "The CPU memory budget was not respected");
+        }
+        
+        // Requests that are bigger than the whole budget must still be dispatched once nothing else is in flight
+        scheduler.submit(MakeRequest(handler, 5, 10.0f, 500));
+        handler.enable(scheduler);
+        scheduler.update();
+        scheduler.waitForReads();
+        
+        stats = scheduler.getStatistics();
+        if (stats.bytesInFlight != 500 || stats.queuedRequests != 3) {
+            return TestResults(false, "A request that's bigger than the CPU memory budget was not dispatched");
+        }
+        
+        RunUntilIdle(scheduler, handler);
+    }
+    
+    // Upload budget
+    {
+        TestRequestHandler handler;
+        StreamingScheduler scheduler(&pool, MakeBudget(8, Bytes(1000), Bytes(100)));
+        
+        for (std::uint64_t i = 1; i <= 3; ++i) {
+            scheduler.submit(MakeRequest(handler, i, 0.0f, 60));
+        }
+        
+        scheduler.update();
+        scheduler.waitForReads();
+        
+        for (std::size_t frame = 0; frame < 3; ++frame) {
+            if (handler.enable(scheduler) != 1) {
+                return TestResults(false, "The upload budget was not respected");
+            }
+            
+            scheduler.update();
+        }
+        
+        if (!scheduler.canUpload(5000)) {
+            return TestResults(false, "The first upload of a frame must always be allowed");
+        }
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults StreamingSchedulerTests::compareOpenWorldLatency() {
+    constexpr std::size_t AssetCount = 400;
+    constexpr std::size_t NearbyAssetCount = AssetCount / 10;
+    constexpr std::chrono::milliseconds FrameTime(4);
+    
+    // Assets are spread around the camera in random order. The nearby ones are the ones that matter the most.
+    std::vector<float> distances(AssetCount);
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<float> distribution(0.0f, 1000.0f);
+    std::generate(distances.begin(), distances.end(), [&]() { return distribution(generator); });
+    
+    std::vector<float> sortedDistances = distances;
+    std::sort(sortedDistances.begin(), sortedDistances.end());
+    const float nearbyThreshold = sortedDistances[NearbyAssetCount - 1];
+    
+    iyft::ThreadPool pool(2);
+    
+    auto measure = [&](bool usePriorities) {
+        TestRequestHandler handler(std::chrono::microseconds(500));
+        StreamingScheduler scheduler(&pool, MakeBudget(2));
+        
+        for (std::size_t i = 0; i < AssetCount; ++i) {
+            const float priority = usePriorities ? StreamingScheduler::PriorityFromDistance(distances[i]) : StreamingScheduler::DefaultPriority;
+            scheduler.submit(MakeRequest(handler, i + 1, priority, 1024));
+        }
+        
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<double> enabledAt(AssetCount, 0.0);
+        
+        std::size_t enabled = 0;
+        while (enabled < AssetCount) {
+            const auto frameStart = std::chrono::steady_clock::now();
+            
+            scheduler.update();
+            
+            const std::size_t newlyEnabled = handler.enable(scheduler);
+            const double now = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            
+            for (std::size_t e = enabled; e < enabled + newlyEnabled; ++e) {
+                enabledAt[handler.enabled[e].value() - 1] = now;
+            }
+            enabled += newlyEnabled;
+            
+            std::this_thread::sleep_until(frameStart + FrameTime);
+        }
+        
+        std::vector<double> nearby;
+        for (std::size_t i = 0; i < AssetCount; ++i) {
+            if (distances[i] <= nearbyThreshold) {
+                nearby.push_back(enabledAt[i]);
+            }
+        }
+        
+        std::sort(nearby.begin(), nearby.end());
+        const StreamingStatistics stats = scheduler.getStatistics();
+        
+        return std::make_pair(nearby[nearby.size() / 2], stats);
+    };
+    
+    const auto fifo = measure(false);
+    const auto prioritized = measure(true);
+    
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    std::string report = fmt::format("\n\t\tStreaming {} assets, time until the nearest {} are enabled (ms):", AssetCount, NearbyAssetCount);
+    report += "\n\t\t      Priorities | Nearby median | All p50 | All p90 | All p99";
+    report += fmt::format("\n\t\t            None | {:>13.1f} | {:>7.1f} | {:>7.1f} | {:>7.1f}", fifo.first,
+                          Milliseconds(fifo.second.latencyP50).count(), Milliseconds(fifo.second.latencyP90).count(), Milliseconds(fifo.second.latencyP99).count());
+    report += fmt::format("\n\t\t        Distance | {:>13.1f} | {:>7.1f} | {:>7.1f} | {:>7.1f}", prioritized.first,
+                          Milliseconds(prioritized.second.latencyP50).count(), Milliseconds(prioritized.second.latencyP90).count(), Milliseconds(prioritized.second.latencyP99).count());
+    
+    if (prioritized.first >= fifo.first) {
+        return TestResults(false, "Nearby assets were not streamed in sooner when priorities were used" + report);
+    }
+    
+    return TestResults(true, report);
+}
+
+TestResults StreamingSchedulerTests::run() {
+    TestResults results = validatePriorities();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateCancellation();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateBudgets();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return compareOpenWorldLatency();
+}
+
+void StreamingSchedulerTests::cleanup() {}
+
+}
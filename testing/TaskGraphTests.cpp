@@ -0,0 +1,338 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "TaskGraphTests.hpp"
+#include "core/TaskGraph.hpp"
+#include "threading/ThreadPool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace iyf::test {
+/// A minimal stand-in for a World that only contains CPU-side data. It mimics the shape of a real frame: physics moves
+/// every transformation, culling is split into chunks that only read data and a final main thread job consumes the results.
+class HeadlessBenchmarkWorld {
+public:
+    static const std::size_t EntityCount = 200000;
+    static const std::size_t CullingChunkCount = 16;
+    
+    HeadlessBenchmarkWorld() : positions(EntityCount * 3), velocities(EntityCount * 3), radii(EntityCount), visible(EntityCount), chunkVisibleCounts(CullingChunkCount), totalVisible(0) {
+        for (std::size_t i = 0; i < EntityCount; ++i) {
+            positions[i * 3 + 0] = static_cast<float>(i % 1000);
+            positions[i * 3 + 1] = static_cast<float>((i / 1000) % 100);
+            positions[i * 3 + 2] = static_cast<float>(i / 100000);
+            
+            velocities[i * 3 + 0] = std::sin(static_cast<float>(i));
+            velocities[i * 3 + 1] = std::cos(static_cast<float>(i));
+            velocities[i * 3 + 2] = 0.5f;
+            
+            radii[i] = 1.0f + static_cast<float>(i % 7);
+        }
+    }
+    
+    void declareJobs(TaskGraph& graph) {
+        JobAccess physicsAccess;
+        physicsAccess.write(ComponentBaseType::Physics).write(ComponentBaseType::Graphics).writeTransformations();
+        graph.addJob("BenchmarkPhysics", [this](float delta) {
+            for (std::size_t i = 0; i < positions.size(); ++i) {
+                positions[i] += velocities[i] * delta;
+            }
+        }, physicsAccess);
+        
+        // The chunks only read shared data and write to their own slots, so they can all run at the same time.
+        JobAccess cullingAccess;
+        cullingAccess.read(ComponentBaseType::Graphics).readTransformations();
+        
+        std::vector<TaskGraph::JobID> cullingJobs;
+        for (std::size_t c = 0; c < CullingChunkCount; ++c) {
+            cullingJobs.push_back(graph.addJob("BenchmarkCulling", [this, c](float) {
+                cullChunk(c);
+            }, cullingAccess));
+        }
+        
+        JobAccess drawAccess;
+        drawAccess.read(ComponentBaseType::Graphics);
+        graph.addJob("BenchmarkDraw", [this](float) {
+            std::size_t sum = 0;
+            for (std::size_t count : chunkVisibleCounts) {
+                sum += count;
+            }
+            
+            totalVisible = sum;
+        }, drawAccess, JobAffinity::MainThread, cullingJobs);
+    }
+    
+    std::size_t getTotalVisible() const {
+        return totalVisible;
+    }
+private:
+    void cullChunk(std::size_t chunk) {
+        const std::size_t chunkSize = EntityCount / CullingChunkCount;
+        const std::size_t start = chunk * chunkSize;
+        const std::size_t end = (chunk == CullingChunkCount - 1) ? EntityCount : start + chunkSize;
+        
+        // A sphere vs. 6 planes test, similar in cost to Frustum::isBoundingVolumeInFrustum()
+        const float planes[6][4] = {
+            { 1.0f,  0.0f,  0.0f,   0.0f}, {-1.0f,  0.0f,  0.0f, 800.0f},
+            { 0.0f,  1.0f,  0.0f,   0.0f}, { 0.0f, -1.0f,  0.0f,  80.0f},
+            { 0.0f,  0.0f,  1.0f,  10.0f}, { 0.0f,  0.0f, -1.0f,  10.0f},
+        };
+        
+        std::size_t count = 0;
+        for (std::size_t i = start; i < end; ++i) {
+            const float x = positions[i * 3 + 0];
+            const float y = positions[i * 3 + 1];
+            const float z = positions[i * 3 + 2];
+            
+            bool inside = true;
+            for (const auto& p : planes) {
+                if (p[0] * x + p[1] * y + p[2] * z + p[3] < -radii[i]) {
+                    inside = false;
+                    break;
+                }
+            }
+            
+            visible[i] = inside;
+            count += inside;
+        }
+        
+        chunkVisibleCounts[chunk] = count;
+    }
+    
+    std::vector<float> positions;
+    std::vector<float> velocities;
+    std::vector<float> radii;
+    std::vector<std::uint8_t> visible;
+    std::vector<std::size_t> chunkVisibleCounts;
+    std::size_t totalVisible;
+};
+
+TaskGraphTests::TaskGraphTests(bool verbose) : TestBase(verbose) { }
+TaskGraphTests::~TaskGraphTests() {}
+
+void TaskGraphTests::initialize() {}
+
+TestResults TaskGraphTests::validateDependencies() {
+    TaskGraph graph;
+    auto noop = [](float){};
+    
+    JobAccess writeTransforms;
+    writeTransforms.write(ComponentBaseType::Physics).writeTransformations();
+    
+    JobAccess readTransforms;
+    readTransforms.readTransformations();
+    
+    JobAccess writeGraphics;
+    writeGraphics.write(ComponentBaseType::Graphics).readTransformations();
+    
+    const auto physics = graph.addJob("Physics", noop, writeTransforms);
+    const auto readerA = graph.addJob("ReaderA", noop, readTransforms);
+    const auto readerB = graph.addJob("ReaderB", noop, readTransforms);
+    const auto graphics = graph.addJob("Graphics", noop, writeGraphics);
+    const auto secondPhysics = graph.addJob("SecondPhysics", noop, writeTransforms);
+    const auto explicitJob = graph.addJob("Explicit", noop, JobAccess(), JobAffinity::AnyThread, {readerA});
+    
+    if (!graph.isOrdered(physics, readerA) || !graph.isOrdered(physics, readerB) || !graph.isOrdered(physics, graphics)) {
+        return TestResults(false, "Readers of transformations must wait for the job that writes them");
+    }
+    
+    if (graph.isOrdered(readerA, readerB) || graph.isOrdered(readerA, graphics)) {
+        return TestResults(false, "Jobs that only read the same data must be allowed to run in parallel");
+    }
+    
+    if (!graph.isOrdered(readerA, secondPhysics) || !graph.isOrdered(graphics, secondPhysics)) {
+        return TestResults(false, "A writer must wait for all previous readers");
+    }
+    
+    if (graph.getDependencies(explicitJob) != std::vector<TaskGraph::JobID>{readerA}) {
+        return TestResults(false, "Explicit dependencies were not recorded");
+    }
+    
+    // Component subtypes and System data are tracked separately. Access to a whole base type covers all of them.
+    TaskGraph fineGraph;
+    
+    JobAccess meshWriter;
+    meshWriter.write(ComponentType(ComponentBaseType::Graphics, GraphicsComponent::Mesh));
+    
+    JobAccess cameraWriter;
+    cameraWriter.write(ComponentType(ComponentBaseType::Graphics, GraphicsComponent::Camera));
+    
+    JobAccess systemDataWriter;
+    systemDataWriter.writeSystemData(ComponentBaseType::Graphics);
+    
+    JobAccess graphicsReader;
+    graphicsReader.read(ComponentBaseType::Graphics);
+    
+    const auto meshJob = fineGraph.addJob("MeshWriter", noop, meshWriter);
+    const auto cameraJob = fineGraph.addJob("CameraWriter", noop, cameraWriter);
+    const auto systemDataJob = fineGraph.addJob("SystemDataWriter", noop, systemDataWriter);
+    const auto readerJob = fineGraph.addJob("GraphicsReader", noop, graphicsReader);
+    
+    if (fineGraph.isOrdered(meshJob, cameraJob) || fineGraph.isOrdered(meshJob, systemDataJob) || fineGraph.isOrdered(cameraJob, systemDataJob)) {
+        return TestResults(false, "Jobs that write different component subtypes or System data must be allowed to run in parallel");
+    }
+    
+    if (!fineGraph.isOrdered(meshJob, readerJob) || !fineGraph.isOrdered(cameraJob, readerJob) || !fineGraph.isOrdered(systemDataJob, readerJob)) {
+        return TestResults(false, "A job that reads a whole base type must wait for the writers of its subtypes and System data");
+    }
+    
+    bool threw = false;
+    try {
+        graph.addJob("Invalid", noop, JobAccess(), JobAffinity::AnyThread, {100});
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    
+    if (!threw) {
+        return TestResults(false, "A dependency on a job that wasn't added yet must be rejected");
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults TaskGraphTests::validateExecution() {
+    const std::size_t jobCount = 64;
+    const std::thread::id mainThreadID = std::this_thread::get_id();
+    
+    TaskGraph graph;
+    std::atomic<std::uint32_t> clock(0);
+    std::vector<std::uint32_t> started(jobCount);
+    std::vector<std::uint32_t> finished(jobCount);
+    std::atomic<bool> affinityViolated(false);
+    
+    // A mix of readers and writers of two resources creates a layered graph with lots of parallel jobs.
+    for (std::size_t i = 0; i < jobCount; ++i) {
+        JobAccess access;
+        if (i % 8 == 0) {
+            access.write(ComponentBaseType::Physics);
+        } else if (i % 8 == 4) {
+            access.write(ComponentBaseType::Graphics).read(ComponentBaseType::Physics);
+        } else {
+            access.read(ComponentBaseType::Physics).read(ComponentBaseType::Graphics);
+        }
+        
+        const JobAffinity affinity = (i % 5 == 0) ? JobAffinity::MainThread : JobAffinity::AnyThread;
+        graph.addJob("Job" + std::to_string(i), [&, i, affinity](float) {
+            started[i] = clock++;
+            
+            if (affinity == JobAffinity::MainThread && std::this_thread::get_id() != mainThreadID) {
+                affinityViolated = true;
+            }
+            
+            std::this_thread::yield();
+            finished[i] = clock++;
+        }, access, affinity);
+    }
+    
+    iyft::ThreadPool pool(4, iyft::SchedulingMode::WorkStealing);
+    for (int run = 0; run < 100; ++run) {
+        graph.execute(&pool, 0.016f);
+        
+        if (affinityViolated) {
+            return TestResults(false, "A main thread job was executed on a worker");
+        }
+        
+        for (TaskGraph::JobID i = 0; i < jobCount; ++i) {
+            for (TaskGraph::JobID dependency : graph.getDependencies(i)) {
+                if (finished[dependency] > started[i]) {
+                    return TestResults(false, fmt::format("Job {} started before its dependency {} finished", i, dependency));
+                }
+            }
+        }
+    }
+    
+    JobAccess access;
+    graph.addJob("Throwing", [](float) {
+        throw std::runtime_error("Expected");
+    }, access);
+    
+    bool threw = false;
+    try {
+        graph.execute(&pool, 0.016f);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    
+    if (!threw) {
+        return TestResults(false, "An exception thrown by a job was not propagated to the caller");
+    }
+    
+    return TestResults(true, "");
+}
+
+std::string TaskGraphTests::benchmarkHeadlessWorld() {
+    const int frameCount = 100;
+    const std::size_t workerCounts[] = {1, 2, 4, 8};
+    
+    std::string report = "\n\t\tWorkers | Frame time (ms)";
+    
+    HeadlessBenchmarkWorld world;
+    TaskGraph graph;
+    world.declareJobs(graph);
+    
+    for (std::size_t workerCount : workerCounts) {
+        iyft::ThreadPool pool(workerCount, iyft::SchedulingMode::WorkStealing);
+        
+        // Warm up
+        graph.execute(&pool, 0.016f);
+        
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frameCount; ++i) {
+            graph.execute(&pool, 0.016f);
+        }
+        const auto end = std::chrono::steady_clock::now();
+        
+        const std::chrono::duration<double, std::milli> duration = end - start;
+        report += fmt::format("\n\t\t{:>7} | {:>15.3f}", workerCount, duration.count() / frameCount);
+    }
+    
+    report += fmt::format("\n\t\tVisible entities in the last frame: {}", world.getTotalVisible());
+    return report;
+}
+
+TestResults TaskGraphTests::run() {
+    TestResults results = validateDependencies();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateExecution();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return TestResults(true, benchmarkHeadlessWorld());
+}
+
+void TaskGraphTests::cleanup() {}
+
+}
@@ -0,0 +1,433 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "ThreadPoolTests.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#include "threading/ParallelFor.hpp"
+
+/// Allocations are only counted while an AllocationCounter exists. Other suites allocate exactly like they would with
+/// the default operator new.
+static std::atomic<bool> CountAllocations(false);
+static std::atomic<std::size_t> AllocationCount(0);
+
+void* operator new(std::size_t size) {
+    if (CountAllocations.load(std::memory_order_relaxed)) {
+        AllocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace iyf::test {
+/// Counts the allocations made by every thread of the executable during its lifetime, which lets the tests see the
+/// allocations made by the workers as well as the ones made by the thread that adds the tasks.
+///
+/// \warning Only one AllocationCounter may exist at a time.
+class AllocationCounter {
+public:
+    AllocationCounter() : start(AllocationCount.load()) {
+        CountAllocations.store(true);
+    }
+    
+    ~AllocationCounter() {
+        CountAllocations.store(false);
+    }
+    
+    /// \return The number of allocations made since the counter was created.
+    std::size_t getCount() const {
+        return AllocationCount.load() - start;
+    }
+private:
+    std::size_t start;
+};
+
+/// The number of tasks used in each benchmark run.
+static const std::size_t BenchmarkTaskCount = 500000;
+
+/// The number of children spawned by each task in the nested benchmark.
+static const std::size_t NestedFanOut = 4;
+
+/// A tiny amount of work to make sure the benchmarks measure scheduling overhead.
+static inline std::uint64_t SmallWork(std::uint64_t seed) {
+    std::uint64_t x = seed + 1;
+    for (int i = 0; i < 16; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    return x;
+}
+
+static const char* ModeName(iyft::SchedulingMode mode) {
+    return (mode == iyft::SchedulingMode::SharedQueue) ? "SharedQueue" : "WorkStealing";
+}
+
+/// Waits until the counter reaches the expected value. The main thread of the test does
+/// nothing else, so spinning is fine here.
+static void WaitForCounter(const std::atomic<std::size_t>& counter, std::size_t expected) {
+    while (counter.load(std::memory_order_acquire) != expected) {
+        std::this_thread::yield();
+    }
+}
+
+static void SpawnNested(iyft::ThreadPool* pool, std::atomic<std::size_t>* completed, std::atomic<std::size_t>* budget, std::atomic<std::uint64_t>* sink) {
+    sink->fetch_add(SmallWork(budget->load(std::memory_order_relaxed)), std::memory_order_relaxed);
+    
+    for (std::size_t i = 0; i < NestedFanOut; ++i) {
+        // Reserve a slot for the child. Stop spawning once the budget runs out.
+        std::size_t remaining = budget->load(std::memory_order_relaxed);
+        bool reserved = false;
+        while (remaining > 0) {
+            if (budget->compare_exchange_weak(remaining, remaining - 1, std::memory_order_relaxed)) {
+                reserved = true;
+                break;
+            }
+        }
+        
+        if (!reserved) {
+            break;
+        }
+        
+        pool->addTask(SpawnNested, pool, completed, budget, sink);
+    }
+    
+    completed->fetch_add(1, std::memory_order_release);
+}
+
+ThreadPoolTests::ThreadPoolTests(bool verbose) : TestBase(verbose) { }
+ThreadPoolTests::~ThreadPoolTests() {}
+
+void ThreadPoolTests::initialize() {
+    const std::size_t maxWorkers = std::max(std::thread::hardware_concurrency(), 2u);
+    
+    for (std::size_t i = 1; i <= maxWorkers; i *= 2) {
+        workerCounts.push_back(i);
+    }
+    
+    if (workerCounts.back() != maxWorkers) {
+        workerCounts.push_back(maxWorkers);
+    }
+}
+
+TestResults ThreadPoolTests::validateSteadyStateAllocations(iyft::SchedulingMode mode, std::size_t workerCount) {
+    const std::size_t taskCount = 20000;
+    
+    iyft::ThreadPool pool(workerCount, mode);
+    std::atomic<std::size_t> completed(0);
+    std::atomic<std::uint64_t> sink(0);
+    
+    auto addTasks = [&](std::size_t count){
+        for (std::size_t i = 0; i < count; ++i) {
+            pool.addTask([&completed, &sink, i](){
+                sink.fetch_add(SmallWork(i), std::memory_order_relaxed);
+                completed.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+        
+        // Nested tasks use the local deques when work stealing is enabled
+        std::atomic<std::size_t> budget(count - 1);
+        pool.addTask(SpawnNested, &pool, &completed, &budget, &sink);
+        
+        pool.waitForAll();
+    };
+    
+    // The warm up grows the queues and the node pool to their peak sizes. The peaks depend on timing,
+    // so several bigger batches are used to make sure that they won't be exceeded later.
+    for (int i = 0; i < 3; ++i) {
+        addTasks(taskCount * 4);
+    }
+    
+    std::size_t noResultAllocations;
+    {
+        AllocationCounter counter;
+        addTasks(taskCount);
+        noResultAllocations = counter.getCount();
+    }
+    
+    if (noResultAllocations != 0) {
+        return TestResults(false, fmt::format("{}: {} allocations were made while adding {} tasks without results in a steady state", ModeName(mode), noResultAllocations, taskCount * 2));
+    }
+    
+    // The shared states of the futures come from a pool as well
+    const std::size_t futureCount = 1000;
+    std::vector<std::future<std::size_t>> futures;
+    
+    auto addTasksWithResults = [&](std::size_t count){
+        for (std::size_t i = 0; i < count; ++i) {
+            futures.push_back(pool.addTaskWithResult([](std::size_t a){ return a * 2; }, i));
+        }
+        
+        for (auto& f : futures) {
+            f.get();
+        }
+        
+        futures.clear();
+    };
+    
+    // A worker may still hold the promise for a moment after the future becomes ready, so the warm up
+    // needs to leave some spare blocks in the pool.
+    futures.reserve(futureCount * 4);
+    addTasksWithResults(futureCount * 4);
+    
+    std::size_t resultAllocations;
+    {
+        AllocationCounter counter;
+        addTasksWithResults(futureCount);
+        resultAllocations = counter.getCount();
+    }
+    
+    if (resultAllocations != 0) {
+        return TestResults(false, fmt::format("{}: {} allocations were made while adding {} tasks with results in a steady state", ModeName(mode), resultAllocations, futureCount));
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults ThreadPoolTests::validate(iyft::SchedulingMode mode, std::size_t workerCount) {
+    iyft::ThreadPool pool(workerCount, mode);
+    
+    if (pool.getSchedulingMode() != mode) {
+        return TestResults(false, fmt::format("{}: the pool reported a wrong scheduling mode", ModeName(mode)));
+    }
+    
+    // Futures
+    const int futureCount = 1000;
+    std::vector<std::future<int>> futures;
+    futures.reserve(futureCount);
+    for (int i = 0; i < futureCount; ++i) {
+        futures.push_back(pool.addTaskWithResult([](int a, int b){ return a * b; }, i, 2));
+    }
+    
+    for (int i = 0; i < futureCount; ++i) {
+        const int result = futures[i].get();
+        if (result != i * 2) {
+            return TestResults(false, fmt::format("{}: future {} returned {}, expected {}", ModeName(mode), i, result, i * 2));
+        }
+    }
+    
+    // Barriers
+    const int barrierTaskCount = 1000;
+    std::atomic<int> barrierCounter(0);
+    iyft::Barrier barrier(barrierTaskCount);
+    for (int i = 0; i < barrierTaskCount; ++i) {
+        pool.addTask(barrier, [&barrierCounter](){ barrierCounter++; });
+    }
+    barrier.waitForAll();
+    
+    if (barrierCounter != barrierTaskCount) {
+        return TestResults(false, fmt::format("{}: the barrier released after {} of {} tasks", ModeName(mode), barrierCounter.load(), barrierTaskCount));
+    }
+    
+    // Exceptions must not prevent the barrier from releasing and must reach the waiting thread
+    const int throwingTaskCount = 100;
+    std::atomic<int> throwingCounter(0);
+    iyft::Barrier throwingBarrier(throwingTaskCount);
+    for (int i = 0; i < throwingTaskCount; ++i) {
+        pool.addTask(throwingBarrier, [&throwingCounter, i](){
+            throwingCounter++;
+            
+            if (i % 10 == 0) {
+                throw std::runtime_error("Test exception");
+            }
+        });
+    }
+    
+    bool rethrown = false;
+    try {
+        throwingBarrier.waitForAll();
+    } catch (const std::runtime_error&) {
+        rethrown = true;
+    }
+    
+    if (!rethrown || throwingCounter != throwingTaskCount) {
+        return TestResults(false, fmt::format("{}: a barrier didn't rethrow a task exception after all tasks completed", ModeName(mode)));
+    }
+    
+    // ParallelFor must process every index exactly once, both when called by an outside thread and by a worker
+    const std::size_t parallelForCount = 10007;
+    std::vector<std::atomic<int>> visits(parallelForCount);
+    auto visit = [&visits](std::size_t i) {
+        visits[i]++;
+    };
+    
+    iyft::ParallelFor(&pool, parallelForCount, visit);
+    pool.addTaskWithResult([&pool, &visit]() {
+        iyft::ParallelFor(&pool, parallelForCount, visit);
+    }).get();
+    
+    for (std::size_t i = 0; i < parallelForCount; ++i) {
+        if (visits[i] != 2) {
+            return TestResults(false, fmt::format("{}: ParallelFor processed index {} {} times instead of 2", ModeName(mode), i, visits[i].load()));
+        }
+    }
+    
+    rethrown = false;
+    try {
+        iyft::ParallelFor(&pool, parallelForCount, [](std::size_t i) {
+            if (i == parallelForCount / 2) {
+                throw std::runtime_error("Test exception");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        rethrown = true;
+    }
+    
+    if (!rethrown) {
+        return TestResults(false, fmt::format("{}: ParallelFor didn't rethrow an exception", ModeName(mode)));
+    }
+    
+    // Tasks added from inside the workers
+    const std::size_t nestedCount = 10000;
+    std::atomic<std::size_t> completed(0);
+    std::atomic<std::size_t> budget(nestedCount - 1);
+    std::atomic<std::uint64_t> sink(0);
+    pool.addTask(SpawnNested, &pool, &completed, &budget, &sink);
+    WaitForCounter(completed, nestedCount);
+    
+    // waitForAll() must cover tasks that were added before the call and tasks that they added
+    completed = 0;
+    budget = nestedCount - 1;
+    pool.addTask(SpawnNested, &pool, &completed, &budget, &sink);
+    pool.waitForAll();
+    
+    if (completed != nestedCount || pool.getPendingTaskCount() != 0) {
+        return TestResults(false, fmt::format("{}: waitForAll() returned after {} of {} tasks", ModeName(mode), completed.load(), nestedCount));
+    }
+    
+    // Timeouts
+    std::atomic<bool> release(false);
+    pool.addTask([&release](){
+        while (!release) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    
+    if (pool.waitForAll(std::chrono::milliseconds(20))) {
+        return TestResults(false, fmt::format("{}: waitForAll(timeout) returned true while a task was still running", ModeName(mode)));
+    }
+    
+    release = true;
+    if (!pool.waitForAll(std::chrono::seconds(10))) {
+        return TestResults(false, fmt::format("{}: waitForAll(timeout) timed out after the last task completed", ModeName(mode)));
+    }
+    
+    return TestResults(true, "");
+}
+
+double ThreadPoolTests::benchmarkExternalSubmission(iyft::SchedulingMode mode, std::size_t workerCount, std::size_t taskCount) {
+    iyft::ThreadPool pool(workerCount, mode);
+    std::atomic<std::size_t> completed(0);
+    std::atomic<std::uint64_t> sink(0);
+    
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < taskCount; ++i) {
+        pool.addTask([&completed, &sink, i](){
+            sink.fetch_add(SmallWork(i), std::memory_order_relaxed);
+            completed.fetch_add(1, std::memory_order_release);
+        });
+    }
+    WaitForCounter(completed, taskCount);
+    const auto end = std::chrono::steady_clock::now();
+    
+    const std::chrono::duration<double> seconds = end - start;
+    return taskCount / seconds.count();
+}
+
+double ThreadPoolTests::benchmarkNestedSubmission(iyft::SchedulingMode mode, std::size_t workerCount, std::size_t taskCount) {
+    iyft::ThreadPool pool(workerCount, mode);
+    std::atomic<std::size_t> completed(0);
+    std::atomic<std::uint64_t> sink(0);
+    
+    const std::size_t rootCount = workerCount;
+    std::atomic<std::size_t> budget(taskCount - rootCount);
+    
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < rootCount; ++i) {
+        pool.addTask(SpawnNested, &pool, &completed, &budget, &sink);
+    }
+    WaitForCounter(completed, taskCount);
+    const auto end = std::chrono::steady_clock::now();
+    
+    const std::chrono::duration<double> seconds = end - start;
+    return taskCount / seconds.count();
+}
+
+TestResults ThreadPoolTests::run() {
+    const iyft::SchedulingMode modes[] = {iyft::SchedulingMode::SharedQueue, iyft::SchedulingMode::WorkStealing};
+    
+    for (const auto mode : modes) {
+        for (const std::size_t workerCount : workerCounts) {
+            TestResults results = validate(mode, workerCount);
+            if (!results.isSuccessful()) {
+                return results;
+            }
+            
+            results = validateSteadyStateAllocations(mode, workerCount);
+            if (!results.isSuccessful()) {
+                return results;
+            }
+        }
+    }
+    
+    std::string report = "\n\t\tWorkers | Mode         | External (tasks/s) | Nested (tasks/s)";
+    for (const std::size_t workerCount : workerCounts) {
+        for (const auto mode : modes) {
+            const double external = benchmarkExternalSubmission(mode, workerCount, BenchmarkTaskCount);
+            const double nested = benchmarkNestedSubmission(mode, workerCount, BenchmarkTaskCount);
+            
+            report += fmt::format("\n\t\t{:>7} | {:<12} | {:>18.0f} | {:>16.0f}", workerCount, ModeName(mode), external, nested);
+        }
+    }
+    
+    return TestResults(true, report);
+}
+
+void ThreadPoolTests::cleanup() {
+    workerCounts.clear();
+}
+
+}
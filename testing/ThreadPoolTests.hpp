@@ -0,0 +1,71 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef IYF_THREAD_POOL_TESTS_HPP
+#define IYF_THREAD_POOL_TESTS_HPP
+
+#include "TestBase.hpp"
+#include "threading/ThreadPool.hpp"
+
+#include <vector>
+#include <string>
+
+namespace iyf::test {
+
+/// Validates both scheduling modes of the iyft::ThreadPool and benchmarks their throughput
+/// (tasks/second) with 1..N workers.
+class ThreadPoolTests : public TestBase {
+public:
+    ThreadPoolTests(bool verbose);
+    virtual ~ThreadPoolTests();
+    
+    virtual std::string getName() const final override {
+        return "Thread pool tests and benchmarks";
+    }
+    
+    virtual void initialize() final override;
+    virtual TestResults run() final override;
+    virtual void cleanup() final override;
+private:
+    TestResults validate(iyft::SchedulingMode mode, std::size_t workerCount);
+    
+    /// Checks that tasks with small captures don't allocate any memory once the pool has warmed up.
+    TestResults validateSteadyStateAllocations(iyft::SchedulingMode mode, std::size_t workerCount);
+    
+    /// Adds all tasks from the calling (non-worker) thread.
+    double benchmarkExternalSubmission(iyft::SchedulingMode mode, std::size_t workerCount, std::size_t taskCount);
+    
+    /// Adds a few root tasks that recursively spawn the rest from inside the workers.
+    double benchmarkNestedSubmission(iyft::SchedulingMode mode, std::size_t workerCount, std::size_t taskCount);
+    
+    std::vector<std::size_t> workerCounts;
+};
+
+}
+
+#endif // IYF_THREAD_POOL_TESTS_HPP
@@ -0,0 +1,410 @@
+// The IYFEngine
+//
+// Copyright (C) 2015-2018, Manvydas Šliamka
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+// conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+// of conditions and the following disclaimer in the documentation and/or other materials
+// provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+// used to endorse or promote products derived from this software without specific prior
+// written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+// WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "TransformStoreTests.hpp"
+#include "core/TransformStore.hpp"
+#include "core/TransformationComponent.hpp"
+#include "threading/ThreadPool.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace iyf::test {
+/// The same transformation, kept the way TransformationComponent keeps it
+struct ReferenceTransform {
+    glm::vec3 position;
+    glm::quat rotation;
+    glm::vec3 scale;
+    TransformStore::Handle parent;
+};
+
+static bool NearlyEqual(const glm::mat4& a, const glm::mat4& b) {
+    for (int column = 0; column < 4; ++column) {
+        for (int row = 0; row < 4; ++row) {
+            const float difference = std::abs(a[column][row] - b[column][row]);
+            const float magnitude = std::max(std::abs(a[column][row]), std::abs(b[column][row]));
+            
+            if (difference > 1e-4f * std::max(1.0f, magnitude)) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+class TestHierarchy {
+public:
+    TestHierarchy(std::size_t count, std::uint32_t seed) : generator(seed) {
+        transforms.resize(count);
+        
+        // Parents always have lower handles than their children, which lets the reference update them in order
+        for (std::size_t i = 0; i < count; ++i) {
+            ReferenceTransform& transform = transforms[i];
+            transform.parent = (i < count / 4) ? TransformStore::InvalidHandle : pickParent(i);
+            randomize(transform);
+        }
+    }
+    
+    /// Creates the transformations in the store. The store must be empty.
+    void create(TransformStore& store) const {
+        for (std::size_t i = 0; i < transforms.size(); ++i) {
+            const ReferenceTransform& transform = transforms[i];
+            const TransformStore::Handle handle = store.create(transform.parent);
+            
+            if (handle != i) {
+                throw std::logic_error("An empty store handed out an unexpected handle");
+            }
+            
+            store.setPosition(handle, transform.position);
+            store.setRotation(handle, transform.rotation);
+            store.setScale(handle, transform.scale);
+        }
+    }
+    
+    /// Changes about a third of the transformations and moves a few of them to different parents
+    void modify(TransformStore& store) {
+        std::uniform_int_distribution<int> choice(0, 2);
+        std::uniform_int_distribution<int> reparentChoice(0, 50);
+        
+        for (std::size_t i = 0; i < transforms.size(); ++i) {
+            if (choice(generator) != 0) {
+                continue;
+            }
+            
+            ReferenceTransform& transform = transforms[i];
+            const TransformStore::Handle handle = static_cast<TransformStore::Handle>(i);
+            
+            const glm::vec3 translation(offsetDistribution(generator), offsetDistribution(generator), offsetDistribution(generator));
+            transform.position += translation;
+            store.translate(handle, translation);
+            
+            const glm::quat rotation = glm::angleAxis(angleDistribution(generator), glm::normalize(glm::vec3(0.3f, 1.0f, -0.2f)));
+            transform.rotation = glm::normalize(rotation * transform.rotation);
+            store.rotate(handle, rotation);
+            
+            if (i >= transforms.size() / 4 && reparentChoice(generator) == 0) {
+                transform.parent = (reparentChoice(generator) < 10) ? TransformStore::InvalidHandle : pickParent(i);
+                store.setParent(handle, transform.parent);
+            }
+        }
+    }
+    
+    std::vector<glm::mat4> computeReference() const {
+        std::vector<glm::mat4> result(transforms.size());
+        
+        for (std::size_t i = 0; i < transforms.size(); ++i) {
+            const ReferenceTransform& transform = transforms[i];
+            
+            // Same as TransformationComponent::performUpdate()
+            const glm::mat4 local = glm::translate(transform.position) * glm::mat4_cast(transform.rotation) * glm::scale(transform.scale);
+            result[i] = (transform.parent == TransformStore::InvalidHandle) ? local : result[transform.parent] * local;
+        }
+        
+        return result;
+    }
+    
+    std::size_t size() const {
+        return transforms.size();
+    }
+private:
+    TransformStore::Handle pickParent(std::size_t child) {
+        std::uniform_int_distribution<std::size_t> parentDistribution(0, child - 1);
+        return static_cast<TransformStore::Handle>(parentDistribution(generator));
+    }
+    
+    void randomize(ReferenceTransform& transform) {
+        transform.position = glm::vec3(offsetDistribution(generator), offsetDistribution(generator), offsetDistribution(generator));
+        transform.rotation = glm::normalize(glm::quat(componentDistribution(generator), componentDistribution(generator), componentDistribution(generator), componentDistribution(generator)));
+        transform.scale = glm::vec3(scaleDistribution(generator), scaleDistribution(generator), scaleDistribution(generator));
+    }
+    
+    std::mt19937 generator;
+    std::uniform_real_distribution<float> offsetDistribution{-2.0f, 2.0f};
+    std::uniform_real_distribution<float> componentDistribution{-1.0f, 1.0f};
+    std::uniform_real_distribution<float> angleDistribution{-0.5f, 0.5f};
+    std::uniform_real_distribution<float> scaleDistribution{0.8f, 1.25f};
+    std::vector<ReferenceTransform> transforms;
+};
+
+static bool MatchesReference(const TransformStore& store, const std::vector<glm::mat4>& reference, std::size_t& mismatch) {
+    for (std::size_t i = 0; i < reference.size(); ++i) {
+        if (!NearlyEqual(store.getModelMatrix(static_cast<TransformStore::Handle>(i)), reference[i])) {
+            mismatch = i;
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+TransformStoreTests::TransformStoreTests(bool verbose) : TestBase(verbose) { }
+TransformStoreTests::~TransformStoreTests() {}
+
+void TransformStoreTests::initialize() {}
+
+TestResults TransformStoreTests::validateAgainstReference() {
+    // Big enough to be split into several chunks
+    const std::size_t count = 3 * TransformStore::MinChunkSize + 123;
+    
+    std::vector<std::unique_ptr<iyft::ThreadPool>> pools;
+    pools.push_back(nullptr);
+    pools.push_back(std::make_unique<iyft::ThreadPool>(1, iyft::SchedulingMode::WorkStealing));
+    pools.push_back(std::make_unique<iyft::ThreadPool>(4, iyft::SchedulingMode::WorkStealing));
+    
+    const TransformStore::Mode modes[] = {TransformStore::Mode::Scalar, TransformStore::Mode::SIMD};
+    
+    for (TransformStore::Mode mode : modes) {
+        for (const auto& pool : pools) {
+            const std::string name = fmt::format("{} mode with {} workers", (mode == TransformStore::Mode::SIMD) ? "SIMD" : "scalar", pool ? pool->getWorkerCount() : 0);
+            
+            TestHierarchy hierarchy(count, 99);
+            TransformStore store;
+            store.setMode(mode);
+            hierarchy.create(store);
+            
+            for (int frame = 0; frame < 4; ++frame) {
+                if (frame != 0) {
+                    hierarchy.modify(store);
+                }
+                
+                store.updateDirtyTransforms(pool.get());
+                
+                std::size_t mismatch = 0;
+                if (!MatchesReference(store, hierarchy.computeReference(), mismatch)) {
+                    return TestResults(false, fmt::format("{}: the matrix of transformation {} doesn't match the reference in frame {}", name, mismatch, frame));
+                }
+            }
+        }
+    }
+    
+    // Updating from a worker thread must not deadlock even if the caller is the only worker
+    iyft::ThreadPool singleWorker(1, iyft::SchedulingMode::WorkStealing);
+    TestHierarchy hierarchy(count, 7);
+    TransformStore store;
+    hierarchy.create(store);
+    
+    auto result = singleWorker.addTaskWithResult([&store, &singleWorker]() {
+        store.updateDirtyTransforms(&singleWorker);
+        return true;
+    });
+    result.get();
+    
+    std::size_t mismatch = 0;
+    if (!MatchesReference(store, hierarchy.computeReference(), mismatch)) {
+        return TestResults(false, fmt::format("Updating from a worker thread produced a wrong matrix for transformation {}", mismatch));
+    }
+    
+    return TestResults(true, "");
+}
+
+TestResults TransformStoreTests::validateDirtyTracking() {
+    TransformStore store;
+    
+    const TransformStore::Handle root = store.create();
+    const TransformStore::Handle child = store.create(root);
+    const TransformStore::Handle grandchild = store.create(child);
+    const TransformStore::Handle other = store.create();
+    
+    store.setPosition(root, glm::vec3(1.0f, 0.0f, 0.0f));
+    store.setPosition(child, glm::vec3(0.0f, 2.0f, 0.0f));
+    store.setPosition(grandchild, glm::vec3(0.0f, 0.0f, 3.0f));
+    store.updateDirtyTransforms();
+    
+    if (store.isDirty(root) || store.isDirty(grandchild)) {
+        return TestResults(false, "Transformations are still dirty after an update");
+    }
+    
+    const glm::mat4& grandchildMatrix = store.getModelMatrix(grandchild);
+    if (grandchildMatrix[3][0] != 1.0f || grandchildMatrix[3][1] != 2.0f || grandchildMatrix[3][2] != 3.0f) {
+        return TestResults(false, "The translations of the ancestors weren't applied to a grandchild");
+    }
+    
+    const std::uint32_t rootCount = store.getUpdateCount(root);
+    const std::uint32_t childCount = store.getUpdateCount(child);
+    const std::uint32_t grandchildCount = store.getUpdateCount(grandchild);
+    const std::uint32_t otherCount = store.getUpdateCount(other);
+    
+    // Moving the root must update the whole subtree and nothing else
+    store.translate(root, glm::vec3(1.0f, 0.0f, 0.0f));
+    if (!store.isDirty(root) || store.isDirty(child)) {
+        return TestResults(false, "Only the changed transformation should be marked as dirty");
+    }
+    
+    store.updateDirtyTransforms();
+    if (store.getUpdateCount(root) != rootCount + 1 || store.getUpdateCount(child) != childCount + 1 ||
+        store.getUpdateCount(grandchild) != grandchildCount + 1 || store.getUpdateCount(other) != otherCount) {
+        return TestResults(false, "Moving a root didn't update exactly its subtree");
+    }
+    
+    if (store.getModelMatrix(grandchild)[3][0] != 2.0f) {
+        return TestResults(false, "The grandchild didn't follow its moving ancestor");
+    }
+    
+    // Moving a leaf must not touch its ancestors
+    store.translate(grandchild, glm::vec3(0.0f, 0.0f, 1.0f));
+    store.updateDirtyTransforms();
+    if (store.getUpdateCount(root) != rootCount + 1 || store.getUpdateCount(child) != childCount + 1 || store.getUpdateCount(grandchild) != grandchildCount + 2) {
+        return TestResults(false, "Moving a leaf updated other transformations");
+    }
+    
+    // An update without changes does nothing
+    store.updateDirtyTransforms();
+    if (store.getUpdateCount(grandchild) != grandchildCount + 2) {
+        return TestResults(false, "An update without changes rebuilt a matrix");
+    }
+    
+    bool threw = false;
+    try {
+        store.setParent(root, grandchild);
+    } catch (const std::logic_error&) {
+        threw = true;
+    }
+    
+    if (!threw) {
+        return TestResults(false, "A cycle in the hierarchy was not detected");
+    }
+    
+    threw = false;
+    try {
+        store.destroy(child);
+    } catch (const std::logic_error&) {
+        threw = true;
+    }
+    
+    if (!threw) {
+        return TestResults(false, "A transformation with children was destroyed");
+    }
+    
+    // Detaching keeps the local transformation, so the grandchild jumps back to its own position
+    store.setParent(grandchild, TransformStore::InvalidHandle);
+    store.updateDirtyTransforms();
+    if (store.getModelMatrix(grandchild)[3][0] != 0.0f || store.getModelMatrix(grandchild)[3][2] != 4.0f) {
+        return TestResults(false, "A detached transformation kept the transformation of its old parent");
+    }
+    
+    // Destroyed handles are reused and come back as identity transformations
+    store.destroy(grandchild);
+    const TransformStore::Handle reused = store.create();
+    store.updateDirtyTransforms();
+    
+    if (reused != grandchild || store.size() != 4 || store.getModelMatrix(reused)[3][2] != 0.0f) {
+        return TestResults(false, "A destroyed handle was not reused or the new transformation wasn't an identity");
+    }
+    
+    return TestResults(true, "");
+}
+
+std::string TransformStoreTests::benchmarkUpdates() {
+    const int frames = 20;
+    const std::size_t count = 100000;
+    const glm::vec3 velocity(0.01f, 0.0f, -0.02f);
+    const glm::quat spin = glm::angleAxis(0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+    
+    const std::size_t hardwareThreads = std::thread::hardware_concurrency();
+    const std::size_t workerCount = (hardwareThreads > 1) ? (hardwareThreads - 1) : 1;
+    iyft::ThreadPool pool(workerCount, iyft::SchedulingMode::WorkStealing);
+    
+    std::string report = fmt::format("\n\t\tSIMD instruction set: {}; workers: {}", TransformStore::GetSIMDInstructionSetName(), workerCount);
+    report += fmt::format("\n\t\tMoving all {} transformations every frame (ns/transformation):", count);
+    report += "\n\t\t   Hierarchy | TransformationComponent | Store, scalar | Store, SIMD | Store, SIMD + pool";
+    
+    // Components update their matrices as soon as they're moved
+    std::vector<TransformationComponent> components(count);
+    const auto componentStart = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        for (TransformationComponent& component : components) {
+            component.translate(velocity);
+            component.rotate(spin);
+        }
+    }
+    const auto componentEnd = std::chrono::steady_clock::now();
+    const std::chrono::duration<double, std::nano> componentDuration = componentEnd - componentStart;
+    const double componentTime = componentDuration.count() / (static_cast<double>(frames) * count);
+    
+    // Flat: 100k roots. Deep: 10k roots with 9 children each.
+    const std::size_t childrenPerRoot[] = {0, 9};
+    for (std::size_t children : childrenPerRoot) {
+        TransformStore store;
+        for (std::size_t i = 0; i < count; ++i) {
+            const bool isRoot = (children == 0) || (i % (children + 1) == 0);
+            store.create(isRoot ? TransformStore::InvalidHandle : static_cast<TransformStore::Handle>(i - i % (children + 1)));
+        }
+        
+        auto measure = [&](TransformStore::Mode mode, iyft::ThreadPool* usedPool) {
+            store.setMode(mode);
+            store.updateDirtyTransforms(usedPool);
+            
+            const auto start = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < frames; ++frame) {
+                for (std::size_t i = 0; i < count; ++i) {
+                    const TransformStore::Handle handle = static_cast<TransformStore::Handle>(i);
+                    store.translate(handle, velocity);
+                    store.rotate(handle, spin);
+                }
+                
+                store.updateDirtyTransforms(usedPool);
+            }
+            const auto end = std::chrono::steady_clock::now();
+            
+            const std::chrono::duration<double, std::nano> duration = end - start;
+            return duration.count() / (static_cast<double>(frames) * count);
+        };
+        
+        const double scalar = measure(TransformStore::Mode::Scalar, nullptr);
+        const double simd = measure(TransformStore::Mode::SIMD, nullptr);
+        const double threaded = measure(TransformStore::Mode::SIMD, &pool);
+        
+        report += fmt::format("\n\t\t{:>12} | {:>23.2f} | {:>13.2f} | {:>11.2f} | {:>18.2f}", (children == 0) ? "Flat" : "10k x 10", componentTime, scalar, simd, threaded);
+    }
+    
+    return report;
+}
+
+TestResults TransformStoreTests::run() {
+    TestResults results = validateDirtyTracking();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    results = validateAgainstReference();
+    if (!results.isSuccessful()) {
+        return results;
+    }
+    
+    return TestResults(true, benchmarkUpdates());
+}
+
+void TransformStoreTests::cleanup() {}
+
+}
@@ -42,6 +42,29 @@
 #include "MetadataSerializationTests.hpp"
 #include "ConfigurationTests.hpp"
 #include "ChunkedVectorTests.hpp"
+#include "ThreadPoolTests.hpp"
+#include "TaskGraphTests.hpp"
+#include "FrustumCullingTests.hpp"
+#include "SpatialIndexTests.hpp"
+#include "RadixSortTests.hpp"
+#include "ParallelCommandRecordingTests.hpp"
+#include "InstanceBatchingTests.hpp"
+#include "TransformStoreTests.hpp"
+#include "MemoryMappedFileTests.hpp"
+#include "ManifestCacheTests.hpp"
+#include "AsyncEnableTests.hpp"
+#include "StreamingSchedulerTests.hpp"
+#include "AssetReleaseTests.hpp"
+#include "BufferRangeAllocatorTests.hpp"
+#include "CollisionMeshCacheTests.hpp"
+#include "MeshFormatTests.hpp"
+#include "MeshOptimizerTests.hpp"
+#include "MeshSimplifierTests.hpp"
+#include "ShaderVariantCacheTests.hpp"
+#include "MaterialTemplateFormatTests.hpp"
+#include "PipelineCompilerTests.hpp"
+#include "LightClusteringTests.hpp"
+#include "StagingRingAllocatorTests.hpp"
 
 //#include "did/InitState.h"
 
@@ -110,6 +133,29 @@ int main(int, char*[]) {
 //     ADD_TESTS(MetadataSerializationTests)
 //     ADD_TESTS(ConfigurationTests)
     ADD_TESTS(ChunkedVectorTests)
+    ADD_TESTS(ThreadPoolTests)
+    ADD_TESTS(TaskGraphTests)
+    ADD_TESTS(FrustumCullingTests)
+    ADD_TESTS(SpatialIndexTests)
+    ADD_TESTS(RadixSortTests)
+    ADD_TESTS(ParallelCommandRecordingTests)
+    ADD_TESTS(InstanceBatchingTests)
+    ADD_TESTS(TransformStoreTests)
+    ADD_TESTS(MemoryMappedFileTests)
+    ADD_TESTS(ManifestCacheTests)
+    ADD_TESTS(AsyncEnableTests)
+    ADD_TESTS(StreamingSchedulerTests)
+    ADD_TESTS(AssetReleaseTests)
+    ADD_TESTS(BufferRangeAllocatorTests)
+    ADD_TESTS(CollisionMeshCacheTests)
+    ADD_TESTS(MeshFormatTests)
+    ADD_TESTS(MeshOptimizerTests)
+    ADD_TESTS(MeshSimplifierTests)
+    ADD_TESTS(ShaderVariantCacheTests)
+    ADD_TESTS(MaterialTemplateFormatTests)
+    ADD_TESTS(PipelineCompilerTests)
+    ADD_TESTS(LightClusteringTests)
+    ADD_TESTS(StagingRingAllocatorTests)
     
     runner.runTests();
     
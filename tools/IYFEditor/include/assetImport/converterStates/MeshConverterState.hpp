@@ -30,6 +30,8 @@
 #define IYF_MESH_CONVERTER_STATE_HPP
 
 #include "assetImport/ConverterState.hpp"
+#include "graphics/MeshOptimizer.hpp"
+#include "graphics/MeshSimplifier.hpp"
 
 namespace iyf::editor {
 class MeshConverterState : public ConverterState {
@@ -39,6 +41,12 @@ public:
     bool use32bitIndices;
     float scale;
     
+    /// Vertex cache, overdraw and vertex fetch optimizations that are applied to each sub-mesh
+    MeshOptimizationSettings optimizationSettings;
+    
+    /// Simplified detail levels that are generated for meshes with a single sub-mesh
+    LODGenerationSettings lodSettings;
+    
     // TODO expose Assimp optimization options instead of going with the default
     // TODO allow to only import certain animations
     // TODO generate materials based on data retrieved from file
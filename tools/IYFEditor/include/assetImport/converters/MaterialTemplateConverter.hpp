@@ -32,12 +32,9 @@
 #include "assetImport/Converter.hpp"
 #include "graphics/GraphicsAPIConstants.hpp"
 
-#include <optional>
-
 namespace iyf {
 class VulkanGLSLShaderGenerator;
-class MemorySerializer;
-struct ShaderCompilationSettings;
+class ShaderVariantCompiler;
 }
 
 namespace iyf::editor {
@@ -51,11 +48,10 @@ public:
     virtual std::unique_ptr<ConverterState> initializeConverter(const Path& inPath, PlatformIdentifier platformID) const final override;
     virtual bool convert(ConverterState& state) const final override;
 private:
-    /// Compiles a shader variant into bytecode fit for driver consumption
-    /// \returns A lookup StringHash that combines the macroHash together with a hash of the shader stage and VertexDataLayout
-    std::optional<StringHash> compileShader(StringHash macroHash, ShaderStageFlagBits stage, const std::string& shaderCode, const std::string& name, const ShaderCompilationSettings& settings, MemorySerializer& serializer) const;
-    
     std::unique_ptr<VulkanGLSLShaderGenerator> vulkanShaderGen;
+    
+    /// Compiles the variants in parallel and caches the bytecode in the preference directory
+    std::unique_ptr<ShaderVariantCompiler> variantCompiler;
     std::unique_ptr<AvailableShaderCombos> availableShaderCombos;
 };
 
@@ -63,17 +63,9 @@ class MeshConverter : public Converter {
         virtual ~MeshConverter();
     private:
         
-        /// V1 format consists of header (see MeshConverter::writeHeader),
-        /// 8 bit number of sub-meshes
-        /// \param[in] inPath path of the input file
-        /// \param[in] outPath path of the output file
-        bool convertV1(ConverterState& state) const;
-        
-        /// Writes the header of a mesh file.
-        /// It consists of 4 chars 'I', 'Y', 'F', 'M' and a 16 bit version number.
-        /// \param[in] fw output file handle
-        /// \param[in] versionNumber unique numerical format id
-        void writeHeader(Serializer& fw, std::uint16_t versionNumber) const;
+        /// Writes a V2 mesh file (see mf::v2 in MeshFormats.hpp for the description of the layout) and V1
+        /// animation files.
+        bool convertV2(ConverterState& state) const;
         
         /// Writes the header of an animation file.
         /// It consists of 4 chars 'I', 'Y', 'F', 'A' and a 16 bit version number.
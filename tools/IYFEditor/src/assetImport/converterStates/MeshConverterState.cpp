@@ -35,13 +35,22 @@ namespace iyf::editor {
 static const char* USE_32_BIT_INDICES_FIELD_NAME = "use32BitIndices";
 static const char* CONVERT_ANIMATIONS_FIELD_NAME = "exportAnimations";
 static const char* MESH_SCALE_FIELD_NAME = "scale";
+static const char* OPTIMIZE_VERTEX_CACHE_FIELD_NAME = "optimizeVertexCache";
+static const char* OPTIMIZE_OVERDRAW_FIELD_NAME = "optimizeOverdraw";
+static const char* OPTIMIZE_VERTEX_FETCH_FIELD_NAME = "optimizeVertexFetch";
+static const char* VERTEX_CACHE_SIZE_FIELD_NAME = "vertexCacheSize";
+static const char* OVERDRAW_THRESHOLD_FIELD_NAME = "overdrawThreshold";
+static const char* GENERATE_LODS_FIELD_NAME = "generateLODs";
+static const char* LOD_COUNT_FIELD_NAME = "lodCount";
+static const char* LOD_REDUCTION_FACTOR_FIELD_NAME = "lodReductionFactor";
+static const char* LOD_MAX_ERROR_FIELD_NAME = "lodMaxError";
 
 std::uint64_t MeshConverterState::getLatestSerializedDataVersion() const {
-    return 1;
+    return 3;
 }
 
 void MeshConverterState::serializeJSONImpl(PrettyStringWriter& pw, std::uint64_t version) const {
-    assert(version == 1);
+    assert(version == 3);
     
     pw.Key(USE_32_BIT_INDICES_FIELD_NAME);
     pw.Bool(use32bitIndices);
@@ -52,19 +61,57 @@ void MeshConverterState::serializeJSONImpl(PrettyStringWriter& pw, std::uint64_t
     pw.Key(MESH_SCALE_FIELD_NAME);
     pw.Double(scale);
     
-    // TODO serialize the not yet created fields
-    // if (version == 2) {}
+    pw.Key(OPTIMIZE_VERTEX_CACHE_FIELD_NAME);
+    pw.Bool(optimizationSettings.optimizeVertexCache);
+    
+    pw.Key(OPTIMIZE_OVERDRAW_FIELD_NAME);
+    pw.Bool(optimizationSettings.optimizeOverdraw);
+    
+    pw.Key(OPTIMIZE_VERTEX_FETCH_FIELD_NAME);
+    pw.Bool(optimizationSettings.optimizeVertexFetch);
+    
+    pw.Key(VERTEX_CACHE_SIZE_FIELD_NAME);
+    pw.Uint(optimizationSettings.vertexCacheSize);
+    
+    pw.Key(OVERDRAW_THRESHOLD_FIELD_NAME);
+    pw.Double(optimizationSettings.overdrawThreshold);
+    
+    pw.Key(GENERATE_LODS_FIELD_NAME);
+    pw.Bool(lodSettings.generateLODs);
+    
+    pw.Key(LOD_COUNT_FIELD_NAME);
+    pw.Uint(lodSettings.lodCount);
+    
+    pw.Key(LOD_REDUCTION_FACTOR_FIELD_NAME);
+    pw.Double(lodSettings.reductionFactor);
+    
+    pw.Key(LOD_MAX_ERROR_FIELD_NAME);
+    pw.Double(lodSettings.maxError);
 }
 
 void MeshConverterState::deserializeJSONImpl(JSONObject& jo, std::uint64_t version) {
-    assert(version == 1);
+    assert(version >= 1 && version <= 3);
     
     use32bitIndices = jo[USE_32_BIT_INDICES_FIELD_NAME].GetBool();
     convertAnimations = jo[CONVERT_ANIMATIONS_FIELD_NAME].GetBool();
     scale = jo[MESH_SCALE_FIELD_NAME].GetFloat();
     
-    // TODO deserialize the not yet created fields
-    // if (version == 2) {}
+    // Version 1 settings were created before the optimizer existed. They keep the defaults.
+    if (version >= 2) {
+        optimizationSettings.optimizeVertexCache = jo[OPTIMIZE_VERTEX_CACHE_FIELD_NAME].GetBool();
+        optimizationSettings.optimizeOverdraw = jo[OPTIMIZE_OVERDRAW_FIELD_NAME].GetBool();
+        optimizationSettings.optimizeVertexFetch = jo[OPTIMIZE_VERTEX_FETCH_FIELD_NAME].GetBool();
+        optimizationSettings.vertexCacheSize = jo[VERTEX_CACHE_SIZE_FIELD_NAME].GetUint();
+        optimizationSettings.overdrawThreshold = jo[OVERDRAW_THRESHOLD_FIELD_NAME].GetFloat();
+    }
+    
+    // Older settings keep the default LOD generation settings
+    if (version >= 3) {
+        lodSettings.generateLODs = jo[GENERATE_LODS_FIELD_NAME].GetBool();
+        lodSettings.lodCount = static_cast<std::uint8_t>(jo[LOD_COUNT_FIELD_NAME].GetUint());
+        lodSettings.reductionFactor = jo[LOD_REDUCTION_FACTOR_FIELD_NAME].GetFloat();
+        lodSettings.maxError = jo[LOD_MAX_ERROR_FIELD_NAME].GetFloat();
+    }
 }
 }
 
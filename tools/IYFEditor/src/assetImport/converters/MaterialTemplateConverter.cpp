@@ -32,9 +32,14 @@
 #include "assets/metadata/MaterialTemplateMetadata.hpp"
 
 #include "graphics/Renderer.hpp"
+#include "graphics/materials/MaterialTemplateFormat.hpp"
 #include "graphics/shaderGeneration/ShaderMacroCombiner.hpp"
+#include "graphics/shaderGeneration/ShaderVariantCache.hpp"
+#include "graphics/shaderGeneration/ShaderVariantCompiler.hpp"
 #include "graphics/shaderGeneration/VulkanGLSLShaderGenerator.hpp"
 
+#include "io/DefaultFileSystem.hpp"
+
 #include "io/File.hpp"
 #include "io/FileSystem.hpp"
 #include "io/serialization/MemorySerializer.hpp"
@@ -45,13 +50,13 @@
 #include "tools/MaterialEditor.hpp"
 
 #include "utilities/DataSizes.hpp"
-#include "utilities/hashing/HashCombine.hpp"
 
 #include "rapidjson/error/en.h"
 
 #include "glm/gtx/string_cast.hpp"
 
 #include <bitset>
+#include <chrono>
 
 //#define IYF_PRINT_MACRO_LIST_AND_COMBOS
 
@@ -123,6 +128,13 @@ public:
 
 MaterialTemplateConverter::MaterialTemplateConverter(const ConverterManager* manager) : Converter(manager) {
     vulkanShaderGen = std::make_unique<VulkanGLSLShaderGenerator>(manager->getFileSystem());
+    
+    // The cache is shared by all projects. That's fine because the entries are keyed by their contents.
+    const Path& preferenceDirectory = manager->getFileSystem()->getPreferenceDirectory();
+    const Path cacheDirectory = preferenceDirectory.empty() ? Path() : (preferenceDirectory / "shaderVariantCache");
+    
+    variantCompiler = std::make_unique<ShaderVariantCompiler>(manager->getFileSystem(), 0,
+                                                              std::make_unique<ShaderVariantCache>(&DefaultFileSystem::Instance(), cacheDirectory));
     availableShaderCombos = std::make_unique<AvailableShaderCombos>();
     
     availableShaderCombos->macrosWithAllowedValues = ShaderMacroCombiner::MakeMacroAndValueVectors();
@@ -243,22 +255,12 @@ bool MaterialTemplateConverter::convert(ConverterState& state) const {
     ShaderCompilationSettings scs;
     scs.optimizationLevel = ShaderOptimizationLevel::Performance;
     
-    std::size_t totalShaders = 0;
     std::size_t estimatedTotalShaders = availableShaderCombos->allAvailableCombos.size() * VertexLayoutCount * ShaderStageCount;
     
-    std::uint64_t size = Bytes(Mebibytes(2)).count();
-    MemorySerializer ms(size);
-    
-    const std::array<char, 5> magicNumber = {'I', 'Y', 'F', 'M', 'T'};
-    ms.writeBytes(magicNumber.data(), magicNumber.size());
-    ms.writeUInt16(1); // Version
-    ms.writeUInt32(estimatedTotalShaders);
-
-#ifndef NDEBUG
-    std::unordered_set<StringHash> finalHashes;
-    std::stringstream ssc;
-#endif // NDEBUG
+    std::vector<ShaderVariant> variants;
+    variants.reserve(estimatedTotalShaders);
     
+    // The order of this loop determines the order of the variants in the file
     for (const auto& combo : availableShaderCombos->allAvailableCombos) {
         scs.macros = combo.second;
         
@@ -270,33 +272,78 @@ bool MaterialTemplateConverter::convert(ConverterState& state) const {
             const VertexDataLayoutDefinition& layoutDefinition = con::GetVertexDataLayoutDefinition(vdl);
             
             for (ShaderStageFlagBits stage : ShaderStages) {
-                const std::string* code = nullptr;
+                ShaderVariant variant;
+                variant.stage = stage;
+                variant.settings = scs;
+                
                 switch (stage) {
                     case ShaderStageFlagBits::Vertex:
-                        code = &vertResult.getContents();
+                        variant.source = &vertResult.getContents();
+                        variant.name = layoutDefinition.getName() + "VertexShader";
                         break;
                     case ShaderStageFlagBits::Fragment:
-                        code = &fragResult.getContents();
+                        variant.source = &fragResult.getContents();
+                        variant.name = layoutDefinition.getName() + "FragmentShader";
                         break;
                     default:
                         throw std::runtime_error("The MaterialTemplateConverter can't handle this shader stage");
                 }
                 
-                std::optional<StringHash> compilationResult = compileShader(combo.first, stage, *code, layoutDefinition.getName(), scs, ms); ;
-                if (!compilationResult) {
-                    return false;
-                }
+                variants.push_back(std::move(variant));
+            }
+        }
+    }
+    assert(estimatedTotalShaders == variants.size());
+    
+    const auto compilationStart = std::chrono::steady_clock::now();
+    const bool compiled = variantCompiler->compile(variants);
+    const auto compilationDuration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - compilationStart);
+    
+    std::size_t cachedShaders = 0;
+    for (const ShaderVariant& variant : variants) {
+        if (variant.result && !variant.result.getErrorsAndWarnings().empty()) {
+            LOG_W("{}", variant.result.getErrorsAndWarnings());
+        } else if (!variant.result && variant.result.getStatus() != ShaderCompilationResult::Status::Invalid) {
+            LOG_W("Material template conversion failed\n\t{}", variant.result.getErrorsAndWarnings());
+        }
+        
+        if (variant.loadedFromCache) {
+            cachedShaders++;
+        }
+    }
+    
+    if (!compiled) {
+        return false;
+    }
+    
+    LOG_V("Processed {} shader variant(s) of {} in {} ms using {} thread(s). {} variant(s) were loaded from the cache.",
+          variants.size(), state.getSourceFilePath(), compilationDuration.count(), variantCompiler->getThreadCount(), cachedShaders);
+    
+    // WriteMaterialTemplate() sorts the variants to build the lookup table
+    std::vector<mtf::v2::VariantData> variantData;
+    variantData.reserve(variants.size());
+    
+    std::size_t variantID = 0;
+    std::size_t totalBytecodeSize = 0;
+    for (const auto& combo : availableShaderCombos->allAvailableCombos) {
+        for (std::size_t i = 0; i < VertexLayouts.size(); ++i) {
+            for (ShaderStageFlagBits stage : ShaderStages) {
+                const ShaderVariant& variant = variants[variantID];
+                assert(variant.stage == stage && variant.settings.vertexDataLayout == VertexLayouts[i]);
                 
-#ifndef NDEBUG
-                auto uniqueCheck = finalHashes.emplace(*compilationResult);
-                assert(uniqueCheck.second);
-#endif // NDEBUG
+                const std::vector<std::uint8_t>& bytecode = variant.result.getBytecode();
+                variantData.push_back({combo.first.value(), static_cast<std::uint8_t>(VertexLayouts[i]), mtf::v2::ToVariantStage(stage), bytecode.data(),
+                                       static_cast<std::uint32_t>(bytecode.size())});
                 
-                totalShaders++;
+                totalBytecodeSize += bytecode.size();
+                variantID++;
             }
         }
     }
-    assert(estimatedTotalShaders == totalShaders);
+    assert(variantID == variants.size());
+    
+    MemorySerializer ms(totalBytecodeSize + variantData.size() * (sizeof(mtf::v2::VariantRecord) + mtf::v2::BlobAlignment) + Bytes(Kibibytes(4)).count());
+    mtf::v2::WriteMaterialTemplate(ms, availableShaderCombos->versionHash.value(), variantData);
     
      const Path outputPath = manager->makeFinalPathForAsset(state.getSourceFilePath(), state.getType(), state.getPlatformIdentifier());
      
@@ -314,58 +361,4 @@ bool MaterialTemplateConverter::convert(ConverterState& state) const {
     return true;
 }
 
-std::optional<StringHash> MaterialTemplateConverter::compileShader(StringHash macroHash, ShaderStageFlagBits stage, const std::string& shaderCode, const std::string& name, const ShaderCompilationSettings& settings, MemorySerializer& serializer) const {
-    const char* stageName = nullptr;
-    std::uint8_t stageID = 255;
-    
-    switch (stage) {
-        case ShaderStageFlagBits::Vertex:
-            stageName = "VertexShader";
-            stageID = 0;
-            break;
-        case ShaderStageFlagBits::Geometry:
-            stageName = "GeometryShader";
-            stageID = 1;
-            break;
-        case ShaderStageFlagBits::TessControl:
-            stageName = "TessControlShader";
-            stageID = 2;
-            break;
-        case ShaderStageFlagBits::TessEvaluation:
-            stageName = "TessEvaluationShader";
-            stageID = 3;
-            break;
-        case ShaderStageFlagBits::Fragment:
-            stageName = "FragmentShader";
-            stageID = 4;
-            break;
-        default:
-            break;
-    }
-    
-    assert(stageName != nullptr && stageID != 255);
-    
-    const ShaderCompilationResult compResult = vulkanShaderGen->compileShader(stage, shaderCode, name + stageName, settings);
-    if (!compResult) {
-        LOG_W("Material template conversion failed\n\t{}", compResult.getErrorsAndWarnings());
-        return {};
-    } else if (!compResult.getErrorsAndWarnings().empty()) {
-        LOG_W("{}", compResult.getErrorsAndWarnings());
-    }
-    
-    StringHash lookupHash(macroHash);
-    util::HashCombine(lookupHash, HS(reinterpret_cast<const char*>(&settings.vertexDataLayout), sizeof(settings.vertexDataLayout)));
-    util::HashCombine(lookupHash, HS(reinterpret_cast<const char*>(&stage), sizeof(ShaderStageFlagBits)));
-    
-    serializer.writeUInt8(static_cast<std::uint8_t>(settings.vertexDataLayout));
-    serializer.writeUInt8(stageID);
-    serializer.writeUInt64(macroHash);
-    serializer.writeUInt64(lookupHash);
-    serializer.writeUInt32(compResult.getBytecode().size());
-    serializer.writeBytes(compResult.getBytecode().data(), compResult.getBytecode().size());
-    
-    return lookupHash;
-}
-
 }
-
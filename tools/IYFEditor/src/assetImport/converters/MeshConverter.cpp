@@ -49,6 +49,8 @@
 #include "graphics/AnimationDataStructures.hpp"
 #include "graphics/culling/BoundingVolumes.hpp"
 #include "graphics/MeshFormats.hpp"
+#include "graphics/MeshOptimizer.hpp"
+#include "graphics/MeshSimplifier.hpp"
 
 #include "logging/Logger.hpp"
 #include "core/Constants.hpp"
@@ -95,7 +97,7 @@ std::unique_ptr<ConverterState> MeshConverter::initializeConverter(const Path& i
 }
 
 bool MeshConverter::convert(ConverterState& state) const {
-    return convertV1(state);
+    return convertV2(state);
     // If (once) we have different mesh file versions
 //    switch (versionNumber) {
 //        case 1:
@@ -106,11 +108,6 @@ bool MeshConverter::convert(ConverterState& state) const {
 //    }
 }
 
-void MeshConverter::writeHeader(Serializer& fw, std::uint16_t versionNumber) const {
-    fw.writeBytes(mf::MagicNumber, sizeof(char) * 4);
-    fw.writeUInt16(versionNumber);
-}
-
 void MeshConverter::writeAnimationHeader(Serializer& fw, std::uint16_t versionNumber) const {
     fw.writeBytes(af::MagicNumber, sizeof(char) * 4);
     fw.writeUInt16(versionNumber);
@@ -154,7 +151,7 @@ static glm::mat4 aiMatToGLMMat(aiMatrix4x4 aiMat) {
 
 static void makeV1Skeleton(const aiNode* node, std::vector<Bone>& bones, std::unordered_map<StringHash, std::uint8_t>& nameHashToID, std::uint8_t parentID = 0) {
     std::uint8_t id = bones.size();
-    assert(bones.size() <= mf::v1::MaxBones);
+    assert(bones.size() <= mf::v2::MaxBones);
 
     glm::mat4 transform = aiMatToGLMMat(node->mTransformation);
 
@@ -188,10 +185,12 @@ static const aiNode* determineSkeletonRoot(const aiNode* sceneRoot) {
 }
 
 // TODO FIXME this function does not clean up after a failed import. It returns false, so broken files will not end up in the asset database, however, they will remain on the hard drive.
-bool MeshConverter::convertV1(ConverterState& state) const {
+bool MeshConverter::convertV2(ConverterState& state) const {
     MeshConverterInternalState* internalState = dynamic_cast<MeshConverterInternalState*>(state.getInternalState());
     assert(internalState != nullptr);
     
+    const MeshConverterState& meshState = dynamic_cast<const MeshConverterState&>(state);
+    
     std::vector<ImportedAssetData>& importedAssets = state.getImportedAssets();
     
     Assimp::Importer* importer = internalState->importer.get();
@@ -248,16 +247,16 @@ bool MeshConverter::convertV1(ConverterState& state) const {
     
     unsigned int numSubMeshes = root->mChildren[firstMeshNode]->mNumMeshes;
 //    LOG_D("First ID of node with meshes is " << firstMeshNode << ". It has " << numSubMeshes << " sub-meshes.")
-    if (numSubMeshes > mf::v1::MaxSubmeshes) {
-        LOG_W("File {} contains more than {} sub-mesh nodes, only the first {} will be processed.", inFile, mf::v1::MaxSubmeshes, mf::v1::MaxSubmeshes)
+    if (numSubMeshes > mf::v2::MaxSubmeshes) {
+        LOG_W("File {} contains more than {} sub-mesh nodes, only the first {} will be processed.", inFile, mf::v2::MaxSubmeshes, mf::v2::MaxSubmeshes)
                 
-        numSubMeshes = mf::v1::MaxSubmeshes;
+        numSubMeshes = mf::v2::MaxSubmeshes;
     }
     
     std::uint32_t totalVertices = 0;
     std::uint32_t totalIndices = 0;
     
-    std::bitset<mf::v1::MaxSubmeshes> hasBones;
+    std::bitset<mf::v2::MaxSubmeshes> hasBones;
     for (unsigned int i = 0; i < numSubMeshes; ++i) {
         const aiMesh* mesh = scene->mMeshes[root->mChildren[firstMeshNode]->mMeshes[i]];
         
@@ -276,11 +275,6 @@ bool MeshConverter::convertV1(ConverterState& state) const {
             LOG_E("File {} has a mesh with non-triangle elements", inFile)
         }
         
-        if (mesh->mNumVertices > mf::v1::MaxVertices) {
-            LOG_E("File {} has a mesh with more than {} vertices", inFile, mf::v1::MaxVertices)
-            return false;
-        }
-        
         if (!mesh->HasPositions()) {
             outputError(inFile, "vertex positions", mesh);
             return false;
@@ -299,8 +293,8 @@ bool MeshConverter::convertV1(ConverterState& state) const {
         if (mesh->GetNumUVChannels() == 0) {
             outputError(inFile, "UV coordinates", mesh);
             return false;
-        } else if (mesh->GetNumUVChannels() > mf::v1::MaxTextureChannels) {
-            LOG_W("File {} contains more than {} UV channels, only the first {} will be processed.", inFile, mf::v1::MaxTextureChannels, mf::v1::MaxTextureChannels)
+        } else if (mesh->GetNumUVChannels() > mf::v2::MaxTextureChannels) {
+            LOG_W("File {} contains more than {} UV channels, only the first {} will be processed.", inFile, mf::v2::MaxTextureChannels, mf::v2::MaxTextureChannels)
         }
         
         // Default texture is not necessary
@@ -314,8 +308,8 @@ bool MeshConverter::convertV1(ConverterState& state) const {
        if (mesh->GetNumColorChannels() > 0) {
             hasVertexColors = true;
            
-            if (mesh->GetNumColorChannels() > mf::v1::MaxColorChannels) {
-                LOG_W("File {} contains more than {} color channel(s), only the  first {} will be processed.", inFile, mf::v1::MaxColorChannels, mf::v1::MaxColorChannels)
+            if (mesh->GetNumColorChannels() > mf::v2::MaxColorChannels) {
+                LOG_W("File {} contains more than {} color channel(s), only the  first {} will be processed.", inFile, mf::v2::MaxColorChannels, mf::v2::MaxColorChannels)
             }
        }
         
@@ -341,8 +335,8 @@ bool MeshConverter::convertV1(ConverterState& state) const {
         LOG_W("All sub-meshes must either have bones or not. Cases when only some have bones are not supported. In this file {} sub-meshes out of{} have bones", hasBones.count(), numSubMeshes);
         return false;
     } else if (hasBones.any()) {
-        bones.reserve(mf::v1::MaxBones);
-        nameHashToID.reserve(mf::v1::MaxBones);
+        bones.reserve(mf::v2::MaxBones);
+        nameHashToID.reserve(mf::v2::MaxBones);
         
         const aiNode* armatureRoot = determineSkeletonRoot(root);
         
@@ -358,8 +352,8 @@ bool MeshConverter::convertV1(ConverterState& state) const {
 
         makeV1Skeleton(armatureRoot, bones, nameHashToID);
         
-        if (bones.size() > mf::v1::MaxBones) {
-            LOG_W("Too many bones in mesh {}. Max allowed is {}, was: {}", inFile, mf::v1::MaxBones, bones.size());
+        if (bones.size() > mf::v2::MaxBones) {
+            LOG_W("Too many bones in mesh {}. Max allowed is {}, was: {}", inFile, mf::v2::MaxBones, bones.size());
             return false;
         }
         
@@ -391,9 +385,9 @@ bool MeshConverter::convertV1(ConverterState& state) const {
     if (bones.size() > 0 && scene->mNumAnimations == 0) {
         LOG_E("Can't import mesh file {} because the mesh has bones but no animations.", inFile)
         return false;
-    } else if (bones.size() > 0 && scene->mNumAnimations > mf::v1::MaxAnimations) {
-        LOG_W("Mesh file {} has {} however, engine only supports up to {} animations for each mesh. Only the first {} will be imported.", inFile, scene->mNumAnimations, mf::v1::MaxAnimations, scene->mNumAnimations);
-        numAnimations = mf::v1::MaxAnimations;
+    } else if (bones.size() > 0 && scene->mNumAnimations > mf::v2::MaxAnimations) {
+        LOG_W("Mesh file {} has {} however, engine only supports up to {} animations for each mesh. Only the first {} will be imported.", inFile, scene->mNumAnimations, mf::v2::MaxAnimations, scene->mNumAnimations);
+        numAnimations = mf::v2::MaxAnimations;
     } else if (bones.size() > 0 && scene->mNumAnimations > 0) {
         numAnimations = scene->mNumAnimations;
     }
@@ -403,35 +397,48 @@ bool MeshConverter::convertV1(ConverterState& state) const {
     // If changing something here, make sure that mesh importers match what's being
     // done here. Moreover, INCREASE VERSION NUMBER.
     
-    const std::uint16_t versionNumber = 1;
-    // WRITE: First - magic number, second - version number, then - number of sub-meshes, total number of vertices, total number of indices
-    // and, finally, the number of bones
-    //iyf::MemorySerializer fw(1024 * 512);
+    const std::uint16_t versionNumber = mf::v2::VersionNumber;
     const Path meshOutputPath = manager->makeFinalPathForAsset(state.getSourceFilePath(), AssetType::Mesh, state.getPlatformIdentifier());
-    iyf::MemorySerializer fw(1024 * 512);
-    writeHeader(fw, versionNumber);
-    fw.writeUInt8(numSubMeshes);
-    // This is 4 bytes despite con::MaxVerticesPerMesh limit
-    fw.writeUInt32(totalVertices);
-    fw.writeUInt32(totalIndices);
-    fw.writeUInt8(bones.size());
-    fw.writeUInt8(hasVertexColors ? 1 : 0);
+    
+    // The vertex and index data of all sub-meshes is stored in two contiguous blobs that get written to the file as is
+    iyf::MemorySerializer vw(1024 * 512);
+    iyf::MemorySerializer iw(1024 * 128);
+    
+    mf::v2::MeshFileContents contents;
+    contents.submeshes.reserve(numSubMeshes);
+    
+    VertexDataLayout vertexDataLayout;
+    if (bones.empty()) {
+        vertexDataLayout = hasVertexColors ? VertexDataLayout::MeshVertexColored : VertexDataLayout::MeshVertex;
+    } else {
+        vertexDataLayout = hasVertexColors ? VertexDataLayout::MeshVertexColoredWithBones : VertexDataLayout::MeshVertexWithBones;
+    }
+    
+    const std::size_t vertexSize = con::GetVertexDataLayoutDefinition(vertexDataLayout).getSize().count();
     
     std::vector<AABB> aabbs;
     aabbs.reserve(numSubMeshes);
+    
+    // The indices of the simplified levels are written after the indices of all sub-meshes
+    std::vector<std::vector<GeneratedLOD>> submeshLODs(numSubMeshes);
+    
+    // The engine can't pick detail levels for meshes with sub-meshes yet
+    LODGenerationSettings lodSettings = meshState.lodSettings;
+    lodSettings.lodCount = std::min<std::uint8_t>(lodSettings.lodCount, mf::v2::MaxLODs - 1);
+    if (numSubMeshes > 1 && lodSettings.generateLODs) {
+        LOG_W("File {} has {} sub-meshes. Detail levels can only be generated for meshes that have a single one.", inFile, numSubMeshes)
+        lodSettings.generateLODs = false;
+    }
 
     for (unsigned int i = 0; i < numSubMeshes; ++i) {
         const aiMesh* mesh = scene->mMeshes[root->mChildren[firstMeshNode]->mMeshes[i]];
         
         // TODO move to another format. v1 supports only a single UV channel and no color channels, so these are useless
         const unsigned int uvsInMesh = mesh->GetNumUVChannels();
-        const std::uint8_t uvChannels = (uvsInMesh > mf::v1::MaxTextureChannels) ? mf::v1::MaxTextureChannels : uvsInMesh;
+        const std::uint8_t uvChannels = (uvsInMesh > mf::v2::MaxTextureChannels) ? mf::v2::MaxTextureChannels : uvsInMesh;
         
 //        const unsigned int colInMesh = mesh->GetNumColorChannels();
-//        const std::uint8_t colorChannels = (colInMesh > mf::v1::MaxColorChannels) ? mf::v1::MaxColorChannels : colInMesh;
-        
-        // WRITE: the number of vertices in mesh
-        fw.writeUInt16(mesh->mNumVertices);
+//        const std::uint8_t colorChannels = (colInMesh > mf::v2::MaxColorChannels) ? mf::v2::MaxColorChannels : colInMesh;
         
         // TODO move to another format. v1 supports only a single UV channel and no color channels, so these are useless
         // WRITE: the number of UV channels and the number of vertex color channels
@@ -455,7 +462,7 @@ bool MeshConverter::convertV1(ConverterState& state) const {
                     
                     MeshVertexBoneDataImport& d = boneData[weight.mVertexId];
                     
-                    assert(d.currentID < mf::v1::MaxBonesPerVertex);
+                    assert(d.currentID < mf::v2::MaxBonesPerVertex);
                     assert(weight.mWeight > 0.0f);
                     
                     d.boneIDs[d.currentID] = idIt->second;
@@ -486,14 +493,17 @@ bool MeshConverter::convertV1(ConverterState& state) const {
         glm::vec3 minPos = rootTransformation * glm::vec4(mesh->mVertices[0].x, mesh->mVertices[0].y, mesh->mVertices[0].z, 1.0f);
         glm::vec3 maxPos = rootTransformation * glm::vec4(mesh->mVertices[0].x, mesh->mVertices[0].y, mesh->mVertices[0].z, 1.0f);
         
+        // The vertices of this sub-mesh are collected separately because the optimizer may reorder or drop them
+        iyf::MemorySerializer sw(mesh->mNumVertices * vertexSize);
+        
         for (unsigned int j = 0; j < mesh->mNumVertices; ++j) {
             const aiVector3D* p = mesh->mVertices;
             glm::vec3 pos = rootTransformation * glm::vec4(p[j].x, p[j].y, p[j].z, 1.0f);
             
             // WRITE: vertex position values
-            fw.writeFloat(pos.x);
-            fw.writeFloat(pos.y);
-            fw.writeFloat(pos.z);
+            sw.writeFloat(pos.x);
+            sw.writeFloat(pos.y);
+            sw.writeFloat(pos.z);
             
             // Building the AABB by finding the largest and smallest values in all axes
             minPos.x = std::min(pos.x, minPos.x);
@@ -518,9 +528,9 @@ bool MeshConverter::convertV1(ConverterState& state) const {
             // Moreover, this can be shrunken even more by only saving normals, tangents and a bias. Bias (1 or -1) goes into the last component 
             // of one of the two remaining vectors and bitangent is recovered in shader. However, for the time being, current solution is more 
             // than sufficient and I see no need to prematurely optimize.
-            fw.writeUInt32(glm::packSnorm3x10_1x2(glm::vec4(n[j].x, n[j].y, n[j].z, 0.0f)));
-            fw.writeUInt32(glm::packSnorm3x10_1x2(glm::vec4(t[j].x, t[j].y, t[j].z, 0.0f)));
-            fw.writeUInt32(glm::packSnorm3x10_1x2(glm::vec4(b[j].x, b[j].y, b[j].z, 0.0f)));
+            sw.writeUInt32(glm::packSnorm3x10_1x2(glm::vec4(n[j].x, n[j].y, n[j].z, 0.0f)));
+            sw.writeUInt32(glm::packSnorm3x10_1x2(glm::vec4(t[j].x, t[j].y, t[j].z, 0.0f)));
+            sw.writeUInt32(glm::packSnorm3x10_1x2(glm::vec4(b[j].x, b[j].y, b[j].z, 0.0f)));
             
             // TODO move to another format. v1 supports only a single UV channel and no color channels, so these are useless
 //            for (unsigned int k = 0; k < colorChannels; ++k) {
@@ -528,44 +538,83 @@ bool MeshConverter::convertV1(ConverterState& state) const {
 //                // WRITE: vertex colors are packed into a single 32 bit integer and then written
 //                // Honestly, I've never used vertex colors all that much, so I'm not sure if this precision is sufficient
 //                // for most use cases.
-//                fw.writeUInt32(glm::packUnorm4x8(glm::vec4(c[i].r, c[i].g, c[i].b, c[i].a)));
+//                sw.writeUInt32(glm::packUnorm4x8(glm::vec4(c[i].r, c[i].g, c[i].b, c[i].a)));
 //            }
             
             for (unsigned int k = 0; k < uvChannels; ++k) {
                 const aiVector3D* uv = mesh->mTextureCoords[k];
                 // WRITE: UV coordinates as two floats
                 // TODO Will we need the Z coordinate for UVs?
-                fw.writeFloat(uv[j].x);
-                fw.writeFloat(uv[j].y);
+                sw.writeFloat(uv[j].x);
+                sw.writeFloat(uv[j].y);
             }
             
             // WRITE: vertex bone data (if any)
             if (mesh->HasBones()) {
-                fw.writeUInt8(boneData[j].boneIDs[0]);
-                fw.writeUInt8(boneData[j].boneIDs[1]);
-                fw.writeUInt8(boneData[j].boneIDs[2]);
-                fw.writeUInt8(boneData[j].boneIDs[3]);
+                sw.writeUInt8(boneData[j].boneIDs[0]);
+                sw.writeUInt8(boneData[j].boneIDs[1]);
+                sw.writeUInt8(boneData[j].boneIDs[2]);
+                sw.writeUInt8(boneData[j].boneIDs[3]);
                 
-                fw.writeUInt32(glm::packUnorm4x8(glm::vec4(boneData[j].boneWeights[0], boneData[j].boneWeights[1], boneData[j].boneWeights[2], boneData[j].boneWeights[3])));
+                sw.writeUInt32(glm::packUnorm4x8(glm::vec4(boneData[j].boneWeights[0], boneData[j].boneWeights[1], boneData[j].boneWeights[2], boneData[j].boneWeights[3])));
             }
             
             if (hasVertexColors && mesh->GetNumColorChannels() > 0) {
                 aiColor4D* c = mesh->mColors[0];
                 
-                fw.writeUInt32(glm::packUnorm4x8(glm::vec4(c->r, c->g, c->b, c->a)));
+                sw.writeUInt32(glm::packUnorm4x8(glm::vec4(c->r, c->g, c->b, c->a)));
             } else if (hasVertexColors && mesh->GetNumColorChannels() == 0) {
-                fw.writeUInt32(glm::packUnorm4x8(glm::vec4(0.0f, 0.0f, 0.0f, 0.0f)));
+                sw.writeUInt32(glm::packUnorm4x8(glm::vec4(0.0f, 0.0f, 0.0f, 0.0f)));
             }
         }
         
-        // WRITE: number of indices
-        fw.writeUInt32(mesh->mNumFaces * 3);
+        std::vector<std::uint32_t> submeshIndices;
+        submeshIndices.reserve(mesh->mNumFaces * 3);
+        
         for (unsigned int j = 0; j < mesh->mNumFaces; ++j) {
             unsigned int* f = mesh->mFaces[j].mIndices;
-            // WRITE: mesh indices
-            fw.writeUInt16(f[0]);
-            fw.writeUInt16(f[1]);
-            fw.writeUInt16(f[2]);
+            submeshIndices.insert(submeshIndices.end(), {f[0], f[1], f[2]});
+        }
+        
+        // Assimp keeps the triangle order of the source file. Reorder everything for the post transform cache,
+        // overdraw and vertex fetches. Positions are always the first vertex attribute.
+        std::vector<char> submeshVertices(sw.data(), sw.data() + sw.size());
+        const MeshOptimizationReport report = OptimizeMesh(submeshVertices, vertexSize, submeshIndices, meshState.optimizationSettings);
+        
+        LOG_I("Sub-mesh {} of {}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}, {} overdraw cluster(s), {} unused vertices removed",
+              i, inFile, report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr, report.clusterCount, report.removedVertexCount)
+        
+        const std::uint32_t submeshVertexCount = static_cast<std::uint32_t>(submeshVertices.size() / vertexSize);
+        
+        // The errors are relative to the radius of the bounding sphere of the mesh. With a single sub-mesh, it's built
+        // from the AABB of this sub-mesh.
+        const float submeshRadius = std::max(std::max((maxPos.x - minPos.x) * 0.5f, (maxPos.y - minPos.y) * 0.5f), (maxPos.z - minPos.z) * 0.5f);
+        submeshLODs[i] = GenerateLODs(submeshIndices.data(), submeshIndices.size(), submeshVertices.data(), vertexSize, submeshVertexCount,
+                                      submeshRadius, lodSettings);
+        
+        for (std::size_t l = 0; l < submeshLODs[i].size(); ++l) {
+            GeneratedLOD& lod = submeshLODs[i][l];
+            
+            if (meshState.optimizationSettings.optimizeVertexCache) {
+                std::vector<std::uint32_t> optimized(lod.indices.size());
+                OptimizeVertexCache(optimized.data(), lod.indices.data(), lod.indices.size(), submeshVertexCount, meshState.optimizationSettings.vertexCacheSize);
+                lod.indices = std::move(optimized);
+            }
+            
+            LOG_I("Sub-mesh {} of {}: LOD {} has {} of {} triangles, error {:.4f}", i, inFile, l + 1, lod.indices.size() / 3,
+                  submeshIndices.size() / 3, lod.error)
+        }
+        
+        // WRITE: a record that describes where the data of this sub-mesh is stored
+        contents.submeshes.push_back({static_cast<std::uint32_t>(vw.size() / vertexSize), submeshVertexCount,
+                                      static_cast<std::uint32_t>(iw.size() / sizeof(std::uint16_t)), static_cast<std::uint32_t>(submeshIndices.size())});
+        
+        // WRITE: vertex data
+        vw.writeBytes(submeshVertices.data(), submeshVertices.size());
+        
+        // WRITE: mesh indices
+        for (std::uint32_t index : submeshIndices) {
+            iw.writeUInt16(static_cast<std::uint16_t>(index));
         }
         
 //         glm::vec3 boundingSphereCenter = glm::vec3(minPos.x + (maxPos.x - minPos.x) * 0.5f,
@@ -671,6 +720,29 @@ bool MeshConverter::convertV1(ConverterState& state) const {
         }
     }
     
+    for (unsigned int i = 0; i < numSubMeshes; ++i) {
+        for (std::size_t l = 0; l < submeshLODs[i].size(); ++l) {
+            const GeneratedLOD& lod = submeshLODs[i][l];
+            
+            // WRITE: a record that describes where the indices of this detail level are stored
+            mf::v2::LodRecord record = {};
+            record.indexOffset = static_cast<std::uint32_t>(iw.size() / sizeof(std::uint16_t));
+            record.indexCount = static_cast<std::uint32_t>(lod.indices.size());
+            record.error = lod.error;
+            record.submesh = static_cast<std::uint8_t>(i);
+            record.level = static_cast<std::uint8_t>(l + 1);
+            contents.lods.push_back(record);
+            
+            // WRITE: detail level indices. They use the vertices of the sub-mesh
+            for (std::uint32_t index : lod.indices) {
+                iw.writeUInt16(static_cast<std::uint16_t>(index));
+            }
+        }
+    }
+    
+    // The engine allocates room for the indices of the detail levels as well
+    totalIndices = static_cast<std::uint32_t>(iw.size() / sizeof(std::uint16_t));
+    
     // Build an AABB and a bounding sphere for this mesh from submesh AABB data
     int min = static_cast<int>(AABB::Vertex::Minimum);
     int max = static_cast<int>(AABB::Vertex::Maximum);
@@ -694,55 +766,47 @@ bool MeshConverter::convertV1(ConverterState& state) const {
     float boundingSphereRadius = std::max(std::max((maxPos.x - minPos.x) * 0.5f, (maxPos.y - minPos.y) * 0.5f), (maxPos.z - minPos.z) * 0.5f);
 
     // WRITE: per mesh AABB and bounding sphere data
-    fw.writeFloat(minPos.x);
-    fw.writeFloat(minPos.y);
-    fw.writeFloat(minPos.z);
-
-    fw.writeFloat(maxPos.x);
-    fw.writeFloat(maxPos.y);
-    fw.writeFloat(maxPos.z);
-
-    fw.writeFloat(boundingSphereCenter.x);
-    fw.writeFloat(boundingSphereCenter.y);
-    fw.writeFloat(boundingSphereCenter.z);
-
-    fw.writeFloat(boundingSphereRadius);
+    mf::v2::Header& header = contents.header;
+    header.vertexDataLayout = static_cast<std::uint8_t>(vertexDataLayout);
+    header.flags = 0;
+    // The optimizer may have dropped unused vertices
+    totalVertices = static_cast<std::uint32_t>(vw.size() / vertexSize);
+    header.vertexCount = totalVertices;
+    header.colorChannelCount = hasVertexColors ? 1 : 0;
+    
+    header.aabbMinimum[0] = minPos.x;
+    header.aabbMinimum[1] = minPos.y;
+    header.aabbMinimum[2] = minPos.z;
+    
+    header.aabbMaximum[0] = maxPos.x;
+    header.aabbMaximum[1] = maxPos.y;
+    header.aabbMaximum[2] = maxPos.z;
     
+    header.boundingSphere[0] = boundingSphereCenter.x;
+    header.boundingSphere[1] = boundingSphereCenter.y;
+    header.boundingSphere[2] = boundingSphereCenter.z;
+    header.boundingSphere[3] = boundingSphereRadius;
+    
+    contents.bones.reserve(bones.size());
     for (const auto& b : bones) {
         // WRITE: parent id (or same id, if no parent) and transformation
-        fw.writeUInt8(b.parent);
-
-        fw.writeFloat(b.transform[0][0]);
-        fw.writeFloat(b.transform[0][1]);
-        fw.writeFloat(b.transform[0][2]);
-        fw.writeFloat(b.transform[0][3]);
-        fw.writeFloat(b.transform[1][0]);
-        fw.writeFloat(b.transform[1][1]);
-        fw.writeFloat(b.transform[1][2]);
-        fw.writeFloat(b.transform[1][3]);
-        fw.writeFloat(b.transform[2][0]);
-        fw.writeFloat(b.transform[2][1]);
-        fw.writeFloat(b.transform[2][2]);
-        fw.writeFloat(b.transform[2][3]);
-        fw.writeFloat(b.transform[3][0]);
-        fw.writeFloat(b.transform[3][1]);
-        fw.writeFloat(b.transform[3][2]);
-        fw.writeFloat(b.transform[3][3]);
-
-//        glm::mat4 r(b.transform[0][0], b.transform[0][1], b.transform[0][2], b.transform[0][3],
-//                    b.transform[1][0], b.transform[1][1], b.transform[1][2], b.transform[1][3],
-//                    b.transform[2][0], b.transform[2][1], b.transform[2][2], b.transform[2][3],
-//                    b.transform[3][0], b.transform[3][1], b.transform[3][2], b.transform[3][3]);
-//
-//        assert(r == b.transform);
+        mf::v2::BoneRecord record = {};
+        record.parent = b.parent;
+        
+        for (int c = 0; c < 4; ++c) {
+            for (int r = 0; r < 4; ++r) {
+                record.transform[c * 4 + r] = b.transform[c][r];
+            }
+        }
+        
+        contents.bones.push_back(record);
     }
     
     // TODO make animations shareable
     // TODO do NOT return false, but start exporting another animation
     LOG_D("AnyBones {}", hasBones.any())
     if (hasBones.any() && scene->HasAnimations()) {
-        // WRITE: number of animation handles that will be written in the mesh file
-        fw.writeUInt32(numAnimations);
+        contents.animations.reserve(numAnimations);
         
         for (unsigned int i = 0; i < numAnimations; ++i) {
             Animation currentAnim;
@@ -879,7 +943,7 @@ bool MeshConverter::convertV1(ConverterState& state) const {
             const Path animOut = manager->makeFinalPathForAsset(animIn, AssetType::Animation, state.getPlatformIdentifier());
             
             // WRITE: hashed animation name for finding and loading it later
-            fw.writeUInt64(HS(animOut.getGenericString()));
+            contents.animations.push_back(HS(animOut.getGenericString()));
             
             const std::uint16_t animationVersionNumber = 1;
             iyf::MemorySerializer aw(1024*512);
@@ -937,12 +1001,16 @@ bool MeshConverter::convertV1(ConverterState& state) const {
     } else if (hasBones.none() && scene->HasAnimations()) {
         // At the time of writing, assimp does not even seem to be able to load shape keys.
         LOG_D("Mesh animation not yet supported")
-        // WRITE: number of animation handles that will be written in the mesh file
-        fw.writeUInt32(0);
-    } else {
-        fw.writeUInt32(0);
     }
     
+    contents.vertexData = vw.data();
+    contents.vertexDataSize = vw.size();
+    contents.indexData = iw.data();
+    contents.indexDataSize = iw.size();
+    
+    iyf::MemorySerializer fw(sizeof(mf::v2::Header) + vw.size() + iw.size() + 1024);
+    mf::v2::WriteMesh(fw, contents);
+    
     auto meshFile = VirtualFileSystem::Instance().openFile(meshOutputPath, FileOpenMode::Write);
     meshFile->writeBytes(fw.data(), fw.size());
     meshFile->close();
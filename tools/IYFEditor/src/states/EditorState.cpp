@@ -726,6 +726,28 @@ void EditorState::showDebugWindow() {
             printBufferInfo("Index buffer", indexBuffers);
         }
         
+        const MeshTypeManager::DefragmentationStatistics& defragmentation = meshManager->getDefragmentationStatistics();
+        ImGui::Text("Defragmentation passes: %lu", defragmentation.passes);
+        ImGui::Text("Moved meshes: %lu (%lu KiB)", defragmentation.movedMeshes, Kibibytes(defragmentation.movedBytes).count());
+        ImGui::Text("Host copies: %lu KiB", Kibibytes(meshManager->getHostMemoryUsage()).count());
+        
+        ImGui::TreePop();
+    }
+    
+    ImGui::SetNextTreeNodeOpen(true, ImGuiCond_Once);
+    if (ImGui::TreeNode("Asset Streaming")) {
+        const StreamingStatistics stats = engine->getAssetManager()->getStreamingScheduler()->getStatistics();
+        using Milliseconds = std::chrono::duration<double, std::milli>;
+        
+        ImGui::Text("Queued requests: %zu", stats.queuedRequests);
+        ImGui::Text("Reads in flight: %zu", stats.readsInFlight);
+        ImGui::Text("Awaiting enable: %zu", stats.awaitingEnable);
+        ImGui::Text("Bytes in flight: %.2f MiB", stats.bytesInFlight / (1024.0 * 1024.0));
+        ImGui::Text("Uploaded this frame: %.2f MiB", stats.bytesUploadedThisFrame / (1024.0 * 1024.0));
+        ImGui::Text("Completed: %lu, cancelled: %lu", stats.completedRequests, stats.cancelledRequests);
+        ImGui::Text("Latency p50/p90/p99: %.1f/%.1f/%.1f ms", Milliseconds(stats.latencyP50).count(),
+                    Milliseconds(stats.latencyP90).count(), Milliseconds(stats.latencyP99).count());
+        
         ImGui::TreePop();
     }
     
@@ -761,7 +783,7 @@ void EditorState::printBufferInfo(const char* name, const std::vector<MeshTypeMa
         
         ImGui::SetNextTreeNodeOpen(true, ImGuiCond_Once);
         if (ImGui::TreeNode(buff)) {
-            double percentage = ((double)(buffers[i].freeRanges.getFreeSpace().count()) / (double)(buffers[i].freeRanges.getTotalSpace().count())) * 100.0;
+            double percentage = ((double)(buffers[i].freeRanges->getFreeSpace().count()) / (double)(buffers[i].freeRanges->getTotalSpace().count())) * 100.0;
             
             std::uint64_t freeSpace;
             std::uint64_t totalSpace;
@@ -769,26 +791,27 @@ void EditorState::printBufferInfo(const char* name, const std::vector<MeshTypeMa
             
             switch (debugDataUnit) {
             case DebugDataUnit::Bytes:
-                freeSpace = buffers[i].freeRanges.getFreeSpace().count();
-                totalSpace = buffers[i].freeRanges.getTotalSpace().count();
+                freeSpace = buffers[i].freeRanges->getFreeSpace().count();
+                totalSpace = buffers[i].freeRanges->getTotalSpace().count();
                 unitName = "B";
                 
                 break;
             case DebugDataUnit::Kibibytes:
-                freeSpace = Kibibytes(buffers[i].freeRanges.getFreeSpace()).count();
-                totalSpace = Kibibytes(buffers[i].freeRanges.getTotalSpace()).count();
+                freeSpace = Kibibytes(buffers[i].freeRanges->getFreeSpace()).count();
+                totalSpace = Kibibytes(buffers[i].freeRanges->getTotalSpace()).count();
                 unitName = "KiB";
                 
                 break;
             case DebugDataUnit::Mebibytes:
-                freeSpace = Mebibytes(buffers[i].freeRanges.getFreeSpace()).count();
-                totalSpace = Mebibytes(buffers[i].freeRanges.getTotalSpace()).count();
+                freeSpace = Mebibytes(buffers[i].freeRanges->getFreeSpace()).count();
+                totalSpace = Mebibytes(buffers[i].freeRanges->getTotalSpace()).count();
                 unitName = "MiB";
                 
                 break;
             }
             
             ImGui::Text("%.2f%% (%lu%s of %lu%s) free", percentage, freeSpace, unitName, totalSpace, unitName);
+            ImGui::Text("%lu free ranges, %.2f%% fragmentation", buffers[i].freeRanges->getFreeRangeCount(), buffers[i].freeRanges->getFragmentation() * 100.0f);
             ImGui::TreePop();
         }
     }